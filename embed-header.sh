@@ -1,5 +1,6 @@
 #!/bin/sh
-# Convert qjsx-module-resolution.h into a C string literal for embedding in qjsxc
+# Convert qjsx-module-resolution.h (preceded by the qjsx-path.h primitives it
+# uses) into a C string literal for embedding in qjsxc
 
 set -e
 
@@ -14,6 +15,17 @@ cat > "$OUTPUT" << 'HEADER_START'
 static const char *qjsx_module_resolution_code =
 HEADER_START
 
+# qjsx-path.h as is, after its leading comment (its includes are needed too)
+awk '
+BEGIN { skip = 1; }
+/^#/ { skip = 0; }
+!skip {
+    gsub(/\\/, "\\\\\\\\");
+    gsub(/"/, "\\\"");
+    printf("\"%s\\n\"\n", $0);
+}
+' qjsx-path.h >> "$OUTPUT"
+
 # Read the input file, skip header guards and includes, convert to string literal
 awk '
 BEGIN { skip = 1; }
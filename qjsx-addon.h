@@ -0,0 +1,86 @@
+/*
+ * QJSX Native Addon ABI
+ *
+ * Header for native modules (".so" addons) loaded by qjsx and by qjsxc-built
+ * executables. The qjsxc build copies it next to quickjs.h and libquickjs.a,
+ * so an addon is compiled with the same -I directory as a qjsxc program:
+ *
+ *   cc -shared -fPIC -I bin/linux -o hello.so hello.c
+ *
+ * An addon declares its init function with QJSX_ADDON():
+ *
+ *   #include "qjsx-addon.h"
+ *
+ *   QJSX_ADDON(hello)
+ *   {
+ *       JSModuleDef *m = JS_NewCModule(ctx, module_name, hello_init);
+ *       ...
+ *       return m;
+ *   }
+ *
+ * Built as a shared library this exports "js_init_module" (the entry point
+ * quickjs-libc looks up) and "qjsx_addon_abi_version", which the qjsx loader
+ * checks before handing the library to quickjs-libc. Built with
+ * -DQJSX_ADDON_STATIC it only defines js_init_module_<name>(), which is what
+ * "qjsxc -M <name>" calls, so several addons can be linked into one program.
+ */
+
+#ifndef QJSX_ADDON_H
+#define QJSX_ADDON_H
+
+#include "quickjs.h"
+
+/*
+ * Bumped whenever an addon built against an older qjsx-addon.h/quickjs.h can
+ * no longer be loaded safely (JSValue layout, QuickJS API changes). Loading an
+ * addon built for a different version fails with a ReferenceError instead of
+ * crashing inside the library.
+ */
+#define QJSX_ADDON_ABI_VERSION 1
+
+/*
+ * Platform tag for prebuilt addons. Modules can ship several builds side by
+ * side ("name.linux-x64.so", "name.darwin-arm64.so", ...) and the resolver
+ * prefers the one matching the running platform over a plain "name.so".
+ */
+#if defined(__linux__)
+#define QJSX_ADDON_OS "linux"
+#elif defined(__APPLE__)
+#define QJSX_ADDON_OS "darwin"
+#elif defined(__FreeBSD__)
+#define QJSX_ADDON_OS "freebsd"
+#endif
+
+#if defined(__x86_64__)
+#define QJSX_ADDON_ARCH "x64"
+#elif defined(__aarch64__)
+#define QJSX_ADDON_ARCH "arm64"
+#elif defined(__i386__)
+#define QJSX_ADDON_ARCH "ia32"
+#elif defined(__arm__)
+#define QJSX_ADDON_ARCH "arm"
+#elif defined(__riscv) && __riscv_xlen == 64
+#define QJSX_ADDON_ARCH "riscv64"
+#endif
+
+#if defined(QJSX_ADDON_OS) && defined(QJSX_ADDON_ARCH)
+#define QJSX_ADDON_PLATFORM QJSX_ADDON_OS "-" QJSX_ADDON_ARCH
+#endif
+
+#define QJSX_ADDON_EXPORT __attribute__((visibility("default")))
+
+#ifdef QJSX_ADDON_STATIC
+#define QJSX_ADDON(name) \
+    JSModuleDef *js_init_module_##name(JSContext *ctx, const char *module_name)
+#else
+#define QJSX_ADDON(name) \
+    QJSX_ADDON_EXPORT const int qjsx_addon_abi_version = QJSX_ADDON_ABI_VERSION; \
+    JSModuleDef *js_init_module_##name(JSContext *ctx, const char *module_name); \
+    QJSX_ADDON_EXPORT JSModuleDef *js_init_module(JSContext *ctx, const char *module_name) \
+    { \
+        return js_init_module_##name(ctx, module_name); \
+    } \
+    JSModuleDef *js_init_module_##name(JSContext *ctx, const char *module_name)
+#endif
+
+#endif /* QJSX_ADDON_H */
@@ -0,0 +1,176 @@
+/*
+ * QJSX qjsx:events module
+ *
+ * The emit() of node:events' EventEmitter, which sits on every I/O path of
+ * the Node.js API in qjsx-node (streams, child processes, signals).
+ *
+ *   import * as native from "qjsx:events";
+ *   EventEmitter.prototype.emit = native.emitter(errorMonitor);
+ *
+ *   native.emitter(errorMonitor) -> emit(type, ...args): calls the listeners
+ *     of this._events[type] with this and args, returns whether there were
+ *     any. An 'error' event without listeners throws its argument (wrapped
+ *     in an Error with code ERR_UNHANDLED_ERROR if it is not one); the
+ *     listeners of the errorMonitor symbol see every 'error' event first.
+ *
+ * Listeners are stored as Node.js stores them: _events is a prototype-less
+ * object mapping an event to its only listener, or to an array of them once
+ * there are several (see qjsx-node/node/events.js). emit() hands its own
+ * arguments to the listeners and snapshots an array of listeners on the C
+ * stack, so emitting allocates nothing for up to EV_STACK_LISTENERS
+ * listeners. As in Node.js, listeners added or removed by a listener take
+ * effect from the next emit().
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "quickjs/cutils.h"
+#include "quickjs/quickjs.h"
+
+#define EV_STACK_LISTENERS  16
+
+/* call handler (a listener or an array of them) with this_val and argv */
+static int ev_call(JSContext *ctx, JSValueConst this_val, JSValueConst handler,
+                   int argc, JSValueConst *argv)
+{
+    JSValue stack[EV_STACK_LISTENERS], *list = stack, ret;
+    uint32_t n, i;
+    int err = 0;
+
+    if (JS_IsFunction(ctx, handler)) {
+        ret = JS_Call(ctx, handler, this_val, argc, argv);
+        if (JS_IsException(ret))
+            return -1;
+        JS_FreeValue(ctx, ret);
+        return 0;
+    }
+    if (JS_IsArray(ctx, handler) <= 0)
+        return 0;
+    ret = JS_GetPropertyStr(ctx, handler, "length");
+    err = JS_ToUint32(ctx, &n, ret);
+    JS_FreeValue(ctx, ret);
+    if (err)
+        return -1;
+    if (n > EV_STACK_LISTENERS) {
+        list = js_malloc(ctx, n * sizeof(*list));
+        if (!list)
+            return -1;
+    }
+    for (i = 0; i < n; i++)
+        list[i] = JS_GetPropertyUint32(ctx, handler, i);
+    for (i = 0; i < n; i++) {
+        if (!err) {
+            ret = JS_Call(ctx, list[i], this_val, argc, argv);
+            if (JS_IsException(ret))
+                err = -1;
+            else
+                JS_FreeValue(ctx, ret);
+        }
+        JS_FreeValue(ctx, list[i]);
+    }
+    if (list != stack)
+        js_free(ctx, list);
+    return err;
+}
+
+/* throw for an 'error' event nobody listens to */
+static JSValue ev_unhandled(JSContext *ctx, JSValueConst er)
+{
+    char msg[256];
+    const char *s;
+    JSValue err;
+
+    if (JS_IsError(ctx, er))
+        return JS_Throw(ctx, JS_DupValue(ctx, er));
+    s = JS_ToCString(ctx, er);
+    if (!s)     /* e.g. a Symbol */
+        JS_FreeValue(ctx, JS_GetException(ctx));
+    snprintf(msg, sizeof(msg), "Unhandled error. (%s)", s ? s : "?");
+    JS_FreeCString(ctx, s);
+    err = JS_NewError(ctx);
+    if (JS_IsException(err))
+        return err;
+    JS_DefinePropertyValueStr(ctx, err, "message", JS_NewString(ctx, msg),
+                              JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE);
+    JS_DefinePropertyValueStr(ctx, err, "code", JS_NewString(ctx, "ERR_UNHANDLED_ERROR"), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, err, "context", JS_DupValue(ctx, er), JS_PROP_C_W_E);
+    return JS_Throw(ctx, err);
+}
+
+/* emit(type, ...args); func_data[0] is the errorMonitor symbol */
+static JSValue js_ev_emit(JSContext *ctx, JSValueConst this_val,
+                          int argc, JSValueConst *argv, int magic, JSValue *func_data)
+{
+    JSValueConst er = argc > 1 ? argv[1] : JS_UNDEFINED;
+    JSValue events, handler;
+    JSAtom type, error_atom;
+    int is_error, ret;
+
+    type = JS_ValueToAtom(ctx, argv[0]);
+    if (type == JS_ATOM_NULL)
+        return JS_EXCEPTION;
+    error_atom = JS_NewAtom(ctx, "error");
+    is_error = type == error_atom;
+    JS_FreeAtom(ctx, error_atom);
+
+    events = JS_GetPropertyStr(ctx, this_val, "_events");
+    if (!JS_IsObject(events)) {
+        JS_FreeAtom(ctx, type);
+        if (JS_IsException(events))
+            return events;
+        JS_FreeValue(ctx, events);
+        return is_error ? ev_unhandled(ctx, er) : JS_FALSE;
+    }
+    if (is_error) {
+        /* errorMonitor listeners see the error whether or not it is handled */
+        JSAtom monitor = JS_ValueToAtom(ctx, func_data[0]);
+        handler = JS_GetProperty(ctx, events, monitor);
+        JS_FreeAtom(ctx, monitor);
+        ret = JS_IsException(handler) ? -1 :
+              ev_call(ctx, this_val, handler, argc > 0 ? argc - 1 : 0, argv + 1);
+        JS_FreeValue(ctx, handler);
+        if (ret < 0) {
+            JS_FreeValue(ctx, events);
+            JS_FreeAtom(ctx, type);
+            return JS_EXCEPTION;
+        }
+    }
+    handler = JS_GetProperty(ctx, events, type);
+    JS_FreeValue(ctx, events);
+    JS_FreeAtom(ctx, type);
+    if (JS_IsException(handler))
+        return handler;
+    if (JS_IsUndefined(handler))
+        return is_error ? ev_unhandled(ctx, er) : JS_FALSE;
+    ret = ev_call(ctx, this_val, handler, argc > 0 ? argc - 1 : 0, argv + 1);
+    JS_FreeValue(ctx, handler);
+    return ret < 0 ? JS_EXCEPTION : JS_TRUE;
+}
+
+static JSValue js_ev_emitter(JSContext *ctx, JSValueConst this_val,
+                             int argc, JSValueConst *argv)
+{
+    if (!JS_IsSymbol(argv[0]))
+        return JS_ThrowTypeError(ctx, "errorMonitor must be a symbol");
+    return JS_NewCFunctionData(ctx, js_ev_emit, 1, 0, 1, argv);
+}
+
+static const JSCFunctionListEntry js_ev_funcs[] = {
+    JS_CFUNC_DEF("emitter", 1, js_ev_emitter ),
+};
+
+static int js_ev_init(JSContext *ctx, JSModuleDef *m)
+{
+    return JS_SetModuleExportList(ctx, m, js_ev_funcs, countof(js_ev_funcs));
+}
+
+JSModuleDef *js_init_module_qjsx_events(JSContext *ctx, const char *module_name)
+{
+    JSModuleDef *m;
+
+    m = JS_NewCModule(ctx, module_name, js_ev_init);
+    if (!m)
+        return NULL;
+    JS_AddModuleExportList(ctx, m, js_ev_funcs, countof(js_ev_funcs));
+    return m;
+}
@@ -0,0 +1,930 @@
+/*
+ * QJSX qjsx:ffi module
+ *
+ * Calls into shared libraries without spawning helper processes:
+ *
+ *   import * as ffi from "qjsx:ffi";
+ *   const z = ffi.dlopen("libz.so.1");        // null: the running program
+ *   const crc32 = z.func("crc32", "u64", ["u64", "ptr", "u32"]);
+ *   crc32(0n, bytes, bytes.length);           // bytes: passed as a pointer
+ *
+ *   ffi.dlopen(path)                  -> Library
+ *   lib.func(name, ret, args)         -> function
+ *   lib.symbol(name)                  -> BigInt address
+ *   lib.close()
+ *   ffi.func(address, ret, args)      -> function
+ *   ffi.callback(ret, args, fn)       -> Callback, usable as a "ptr" argument
+ *   cb.ptr                            -> BigInt address, cb.close()
+ *   ffi.ptr(typedArrayOrBuffer)       -> BigInt address of the data
+ *   ffi.toArrayBuffer(address, len)   -> ArrayBuffer over native memory
+ *   ffi.cstring(address)              -> string
+ *   ffi.suffix                        -> "so" or "dylib"
+ *
+ * Types: "void", "i8", "u8", "i16", "u16", "i32", "u32", "i64", "u64",
+ * "f32", "f64", "ptr" and "string". i64/u64/ptr values are BigInts (numbers
+ * are accepted as arguments). A "ptr" argument may be null, an address, an
+ * ArrayBuffer, a typed array (pointing at its first element, no copy) or a
+ * Callback. A "string" argument is passed as a temporary UTF-8 copy, a
+ * "string" result is read as UTF-8 (null for NULL).
+ *
+ * There is no libffi and no code generation: both in the x86-64 SysV and in
+ * the AArch64 ABI, integer and floating point arguments go in two
+ * independent register files, in order. So any signature whose arguments
+ * all fit in registers (6 integer + 8 float on x86-64, 8 + 8 on AArch64)
+ * can be called through a single generic prototype taking every register,
+ * with one variant per return class (integer, double, float). Variadic
+ * functions, structs by value and stack-passed arguments are not
+ * supported. Callbacks work the same way in reverse, from a fixed pool of
+ * C entry points; a callback must be called on the thread that created it,
+ * and an exception it throws is rethrown when the outer native call
+ * returns.
+ *
+ * Nothing is checked: a wrong signature or a dangling pointer crashes the
+ * process, as it would in C.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include "quickjs/cutils.h"
+#include "quickjs/quickjs.h"
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define FFI_INT_REGS 6
+#define FFI_INT_PARAMS uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t
+#define FFI_INT_ARGS(a) a[0], a[1], a[2], a[3], a[4], a[5]
+#define FFI_INT_DECL uint64_t i0, uint64_t i1, uint64_t i2, uint64_t i3, \
+        uint64_t i4, uint64_t i5
+#define FFI_INT_LIST i0, i1, i2, i3, i4, i5
+#elif defined(__aarch64__) && !defined(_WIN32)
+#define FFI_INT_REGS 8
+#define FFI_INT_PARAMS uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, \
+        uint64_t, uint64_t, uint64_t
+#define FFI_INT_ARGS(a) a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]
+#define FFI_INT_DECL uint64_t i0, uint64_t i1, uint64_t i2, uint64_t i3, \
+        uint64_t i4, uint64_t i5, uint64_t i6, uint64_t i7
+#define FFI_INT_LIST i0, i1, i2, i3, i4, i5, i6, i7
+#else
+#define FFI_UNSUPPORTED
+#define FFI_INT_REGS 0
+#endif
+
+#define FFI_FLOAT_REGS 8
+#define FFI_FLOAT_PARAMS double, double, double, double, double, double, \
+        double, double
+#define FFI_FLOAT_ARGS(a) a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]
+#define FFI_FLOAT_DECL double d0, double d1, double d2, double d3, \
+        double d4, double d5, double d6, double d7
+#define FFI_FLOAT_LIST d0, d1, d2, d3, d4, d5, d6, d7
+
+#define FFI_MAX_ARGS (FFI_INT_REGS + FFI_FLOAT_REGS)
+#define FFI_CALLBACK_SLOTS 16
+
+typedef enum {
+    FFI_VOID,
+    FFI_I8,
+    FFI_U8,
+    FFI_I16,
+    FFI_U16,
+    FFI_I32,
+    FFI_U32,
+    FFI_I64,
+    FFI_U64,
+    FFI_F32,
+    FFI_F64,
+    FFI_PTR,
+    FFI_STRING,
+    FFI_TYPE_COUNT,
+} FFIType;
+
+static const char *ffi_type_names[FFI_TYPE_COUNT] = {
+    "void", "i8", "u8", "i16", "u16", "i32", "u32", "i64", "u64",
+    "f32", "f64", "ptr", "string",
+};
+
+static inline BOOL ffi_is_float(int type)
+{
+    return type == FFI_F32 || type == FFI_F64;
+}
+
+typedef struct {
+    uint8_t ret;
+    uint8_t nargs;
+    uint8_t args[FFI_MAX_ARGS + 1];
+} FFISignature;
+
+typedef struct {
+    void *handle;           /* NULL once closed */
+} FFILibrary;
+
+typedef struct {
+    void *fn;
+    FFISignature sig;
+    JSValue lib_obj;        /* keeps the library loaded, or undefined */
+} FFIFunction;
+
+typedef struct {
+    BOOL used;
+    JSContext *ctx;
+    JSValue func;           /* owned by the Callback object */
+    FFISignature sig;
+} FFICallbackSlot;
+
+static JSClassID js_ffi_library_class_id;
+static JSClassID js_ffi_function_class_id;
+static JSClassID js_ffi_callback_class_id;
+
+/* Slots [0, FFI_CALLBACK_SLOTS) return integers, the others floats */
+static FFICallbackSlot ffi_callbacks[2 * FFI_CALLBACK_SLOTS];
+static pthread_mutex_t ffi_callback_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* C entry points of the callback slots */
+static void *const ffi_callback_fns[2 * FFI_CALLBACK_SLOTS];
+
+/* exception thrown by a callback, rethrown by the outer native call */
+static __thread JSContext *ffi_error_ctx;
+static __thread JSValue ffi_error;
+
+static int ffi_parse_type(JSContext *ctx, JSValueConst val, BOOL is_ret)
+{
+    const char *str;
+    int i;
+
+    str = JS_ToCString(ctx, val);
+    if (!str)
+        return -1;
+    for (i = 0; i < FFI_TYPE_COUNT; i++) {
+        if (!strcmp(str, ffi_type_names[i]))
+            break;
+    }
+    if (i == FFI_TYPE_COUNT || (i == FFI_VOID && !is_ret)) {
+        JS_ThrowTypeError(ctx, "invalid FFI type '%s'", str);
+        i = -1;
+    }
+    JS_FreeCString(ctx, str);
+    return i;
+}
+
+static int ffi_parse_signature(JSContext *ctx, FFISignature *sig,
+                               JSValueConst ret, JSValueConst args)
+{
+    JSValue v;
+    int64_t len;
+    int i, type, nint = 0, nfloat = 0, ret_code;
+
+#ifdef FFI_UNSUPPORTED
+    JS_ThrowTypeError(ctx, "qjsx:ffi is not supported on this platform");
+    return -1;
+#endif
+    memset(sig, 0, sizeof(*sig));
+    type = ffi_parse_type(ctx, ret, TRUE);
+    if (type < 0)
+        return -1;
+    sig->ret = type;
+    if (JS_IsUndefined(args))
+        return 0;
+    v = JS_GetPropertyStr(ctx, args, "length");
+    if (JS_IsException(v))
+        return -1;
+    ret_code = JS_ToInt64(ctx, &len, v);
+    JS_FreeValue(ctx, v);
+    if (ret_code)
+        return -1;
+    if (len > FFI_MAX_ARGS)
+        goto too_many;
+    for (i = 0; i < len; i++) {
+        v = JS_GetPropertyUint32(ctx, args, i);
+        if (JS_IsException(v))
+            return -1;
+        type = ffi_parse_type(ctx, v, FALSE);
+        JS_FreeValue(ctx, v);
+        if (type < 0)
+            return -1;
+        if (ffi_is_float(type))
+            nfloat++;
+        else
+            nint++;
+        sig->args[i] = type;
+    }
+    if (nint > FFI_INT_REGS || nfloat > FFI_FLOAT_REGS)
+        goto too_many;
+    sig->nargs = len;
+    return 0;
+ too_many:
+    JS_ThrowRangeError(ctx, "at most %d integer and %d floating point arguments are supported",
+                       FFI_INT_REGS, FFI_FLOAT_REGS);
+    return -1;
+}
+
+/* Low 32 bits of a float register hold a float argument or result */
+static inline double ffi_float_to_reg(float f)
+{
+    union { double d; float f; } u;
+    u.d = 0;
+    u.f = f;
+    return u.d;
+}
+
+static inline float ffi_reg_to_float(double d)
+{
+    union { double d; float f; } u;
+    u.d = d;
+    return u.f;
+}
+
+static JSValue ffi_new_pointer(JSContext *ctx, const void *p)
+{
+    return JS_NewBigUint64(ctx, (uintptr_t)p);
+}
+
+static int ffi_to_pointer(JSContext *ctx, void **pp, JSValueConst val)
+{
+    size_t offset, length, elem_size, size;
+    uint8_t *data;
+    int slot;
+    int64_t v;
+    JSValue buf;
+
+    if (JS_IsNull(val) || JS_IsUndefined(val)) {
+        *pp = NULL;
+        return 0;
+    }
+    if (JS_IsObject(val)) {
+        if (JS_GetTypedArrayType(val) >= 0) {
+            buf = JS_GetTypedArrayBuffer(ctx, val, &offset, &length, &elem_size);
+            if (JS_IsException(buf))
+                return -1;
+            data = JS_GetArrayBuffer(ctx, &size, buf);
+            JS_FreeValue(ctx, buf);
+            if (!data)
+                return -1;
+            *pp = data + offset;
+            return 0;
+        }
+        slot = (intptr_t)JS_GetOpaque(val, js_ffi_callback_class_id) - 1;
+        if (slot >= 0) {
+            *pp = ffi_callback_fns[slot];
+            return 0;
+        }
+        /* throws "ArrayBuffer object expected" for other objects */
+        data = JS_GetArrayBuffer(ctx, &size, val);
+        if (!data)
+            return -1;
+        *pp = data;
+        return 0;
+    }
+    if (JS_ToInt64Ext(ctx, &v, val))
+        return -1;
+    *pp = (void *)(uintptr_t)v;
+    return 0;
+}
+
+/* Convert a JS value to the bits of an integer register */
+static int ffi_to_int(JSContext *ctx, uint64_t *pv, int type, JSValueConst val)
+{
+    int32_t i32;
+    int64_t i64;
+    void *p;
+
+    switch (type) {
+    case FFI_I8:
+    case FFI_U8:
+    case FFI_I16:
+    case FFI_U16:
+    case FFI_I32:
+    case FFI_U32:
+        if (JS_ToInt32(ctx, &i32, val))
+            return -1;
+        switch (type) {
+        case FFI_I8:  *pv = (int64_t)(int8_t)i32; break;
+        case FFI_U8:  *pv = (uint8_t)i32; break;
+        case FFI_I16: *pv = (int64_t)(int16_t)i32; break;
+        case FFI_U16: *pv = (uint16_t)i32; break;
+        case FFI_I32: *pv = (int64_t)i32; break;
+        default:      *pv = (uint32_t)i32; break;
+        }
+        return 0;
+    case FFI_I64:
+    case FFI_U64:
+        if (JS_ToInt64Ext(ctx, &i64, val))
+            return -1;
+        *pv = i64;
+        return 0;
+    default:
+        if (ffi_to_pointer(ctx, &p, val))
+            return -1;
+        *pv = (uintptr_t)p;
+        return 0;
+    }
+}
+
+static JSValue ffi_from_int(JSContext *ctx, int type, uint64_t v)
+{
+    switch (type) {
+    case FFI_VOID:   return JS_UNDEFINED;
+    case FFI_I8:     return JS_NewInt32(ctx, (int8_t)v);
+    case FFI_U8:     return JS_NewInt32(ctx, (uint8_t)v);
+    case FFI_I16:    return JS_NewInt32(ctx, (int16_t)v);
+    case FFI_U16:    return JS_NewInt32(ctx, (uint16_t)v);
+    case FFI_I32:    return JS_NewInt32(ctx, (int32_t)v);
+    case FFI_U32:    return JS_NewUint32(ctx, (uint32_t)v);
+    case FFI_I64:    return JS_NewBigInt64(ctx, v);
+    case FFI_U64:    return JS_NewBigUint64(ctx, v);
+    case FFI_STRING:
+        if (!v)
+            return JS_NULL;
+        return JS_NewString(ctx, (const char *)(uintptr_t)v);
+    default:
+        return ffi_new_pointer(ctx, (void *)(uintptr_t)v);
+    }
+}
+
+static int ffi_rethrow_callback_error(JSContext *ctx)
+{
+    JSValue err;
+
+    if (likely(!ffi_error_ctx))
+        return 0;
+    err = ffi_error;
+    ffi_error_ctx = NULL;
+    JS_Throw(ctx, err);
+    return -1;
+}
+
+#ifndef FFI_UNSUPPORTED
+typedef uint64_t ffi_int_fn(FFI_INT_PARAMS, FFI_FLOAT_PARAMS);
+typedef double ffi_double_fn(FFI_INT_PARAMS, FFI_FLOAT_PARAMS);
+typedef float ffi_float_fn(FFI_INT_PARAMS, FFI_FLOAT_PARAMS);
+#endif
+
+static JSValue ffi_call(JSContext *ctx, void *fn, const FFISignature *sig,
+                        int argc, JSValueConst *argv)
+{
+#ifdef FFI_UNSUPPORTED
+    return JS_ThrowTypeError(ctx, "qjsx:ffi is not supported on this platform");
+#else
+    uint64_t iregs[FFI_INT_REGS] = { 0 }, r;
+    double fregs[FFI_FLOAT_REGS] = { 0 }, d;
+    const char *strings[FFI_MAX_ARGS];
+    JSValueConst arg;
+    int i, type, nint = 0, nfloat = 0, nstrings = 0;
+    JSValue ret = JS_UNDEFINED;
+
+    for (i = 0; i < sig->nargs; i++) {
+        type = sig->args[i];
+        arg = i < argc ? argv[i] : JS_UNDEFINED;
+        if (ffi_is_float(type)) {
+            if (JS_ToFloat64(ctx, &d, arg))
+                goto fail;
+            fregs[nfloat++] = type == FFI_F32 ? ffi_float_to_reg(d) : d;
+        } else if (type == FFI_STRING) {
+            if (JS_IsNull(arg) || JS_IsUndefined(arg)) {
+                iregs[nint++] = 0;
+                continue;
+            }
+            strings[nstrings] = JS_ToCString(ctx, arg);
+            if (!strings[nstrings])
+                goto fail;
+            iregs[nint++] = (uintptr_t)strings[nstrings++];
+        } else {
+            if (ffi_to_int(ctx, &iregs[nint++], type, arg))
+                goto fail;
+        }
+    }
+
+    switch (sig->ret) {
+    case FFI_F64:
+        d = ((ffi_double_fn *)fn)(FFI_INT_ARGS(iregs), FFI_FLOAT_ARGS(fregs));
+        ret = JS_NewFloat64(ctx, d);
+        break;
+    case FFI_F32:
+        d = ((ffi_float_fn *)fn)(FFI_INT_ARGS(iregs), FFI_FLOAT_ARGS(fregs));
+        ret = JS_NewFloat64(ctx, d);
+        break;
+    default:
+        r = ((ffi_int_fn *)fn)(FFI_INT_ARGS(iregs), FFI_FLOAT_ARGS(fregs));
+        ret = ffi_from_int(ctx, sig->ret, r);
+        break;
+    }
+    if (ffi_rethrow_callback_error(ctx)) {
+        JS_FreeValue(ctx, ret);
+        ret = JS_EXCEPTION;
+    }
+    goto done;
+ fail:
+    ret = JS_EXCEPTION;
+ done:
+    for (i = 0; i < nstrings; i++)
+        JS_FreeCString(ctx, strings[i]);
+    return ret;
+#endif
+}
+
+/* Callbacks */
+
+static uint64_t ffi_callback_invoke(int slot, const uint64_t *iregs,
+                                    const double *fregs)
+{
+    FFICallbackSlot *cb = &ffi_callbacks[slot];
+    JSContext *ctx = cb->ctx;
+    JSValue argv[FFI_MAX_ARGS], ret;
+    uint64_t r = 0;
+    double d;
+    int i, type, nint = 0, nfloat = 0;
+
+    for (i = 0; i < cb->sig.nargs; i++) {
+        type = cb->sig.args[i];
+        if (type == FFI_F32)
+            argv[i] = JS_NewFloat64(ctx, ffi_reg_to_float(fregs[nfloat++]));
+        else if (type == FFI_F64)
+            argv[i] = JS_NewFloat64(ctx, fregs[nfloat++]);
+        else
+            argv[i] = ffi_from_int(ctx, type, iregs[nint++]);
+    }
+    ret = JS_Call(ctx, cb->func, JS_UNDEFINED, cb->sig.nargs, (JSValueConst *)argv);
+    for (i = 0; i < cb->sig.nargs; i++)
+        JS_FreeValue(ctx, argv[i]);
+    if (JS_IsException(ret))
+        goto exception;
+    type = cb->sig.ret;
+    if (ffi_is_float(type)) {
+        if (JS_ToFloat64(ctx, &d, ret))
+            goto exception;
+        if (type == FFI_F32)
+            d = ffi_float_to_reg(d);
+        memcpy(&r, &d, sizeof(r));
+    } else if (type != FFI_VOID) {
+        /* a returned string would not outlive the call */
+        if (ffi_to_int(ctx, &r, type == FFI_STRING ? FFI_PTR : type, ret))
+            goto exception;
+    }
+    JS_FreeValue(ctx, ret);
+    return r;
+ exception:
+    JS_FreeValue(ctx, ret);
+    if (!ffi_error_ctx) {
+        ffi_error_ctx = ctx;
+        ffi_error = JS_GetException(ctx);
+    } else {
+        JS_FreeValue(ctx, JS_GetException(ctx));
+    }
+    return 0;
+}
+
+#ifndef FFI_UNSUPPORTED
+#define FFI_CALLBACK(n)                                                 \
+    static uint64_t ffi_callback_int_##n(FFI_INT_DECL, FFI_FLOAT_DECL)  \
+    {                                                                   \
+        uint64_t iregs[] = { FFI_INT_LIST };                            \
+        double fregs[] = { FFI_FLOAT_LIST };                            \
+        return ffi_callback_invoke(n, iregs, fregs);                    \
+    }                                                                   \
+    static double ffi_callback_float_##n(FFI_INT_DECL, FFI_FLOAT_DECL) \
+    {                                                                   \
+        uint64_t iregs[] = { FFI_INT_LIST }, r;                         \
+        double fregs[] = { FFI_FLOAT_LIST }, d;                         \
+        r = ffi_callback_invoke(FFI_CALLBACK_SLOTS + n, iregs, fregs);  \
+        memcpy(&d, &r, sizeof(d));                                      \
+        return d;                                                       \
+    }
+
+FFI_CALLBACK(0)
+FFI_CALLBACK(1)
+FFI_CALLBACK(2)
+FFI_CALLBACK(3)
+FFI_CALLBACK(4)
+FFI_CALLBACK(5)
+FFI_CALLBACK(6)
+FFI_CALLBACK(7)
+FFI_CALLBACK(8)
+FFI_CALLBACK(9)
+FFI_CALLBACK(10)
+FFI_CALLBACK(11)
+FFI_CALLBACK(12)
+FFI_CALLBACK(13)
+FFI_CALLBACK(14)
+FFI_CALLBACK(15)
+
+#undef FFI_CALLBACK
+
+static void *const ffi_callback_fns[2 * FFI_CALLBACK_SLOTS] = {
+    ffi_callback_int_0, ffi_callback_int_1, ffi_callback_int_2,
+    ffi_callback_int_3, ffi_callback_int_4, ffi_callback_int_5,
+    ffi_callback_int_6, ffi_callback_int_7, ffi_callback_int_8,
+    ffi_callback_int_9, ffi_callback_int_10, ffi_callback_int_11,
+    ffi_callback_int_12, ffi_callback_int_13, ffi_callback_int_14,
+    ffi_callback_int_15,
+    ffi_callback_float_0, ffi_callback_float_1, ffi_callback_float_2,
+    ffi_callback_float_3, ffi_callback_float_4, ffi_callback_float_5,
+    ffi_callback_float_6, ffi_callback_float_7, ffi_callback_float_8,
+    ffi_callback_float_9, ffi_callback_float_10, ffi_callback_float_11,
+    ffi_callback_float_12, ffi_callback_float_13, ffi_callback_float_14,
+    ffi_callback_float_15,
+};
+#endif
+
+static JSValue js_ffi_callback(JSContext *ctx, JSValueConst this_val,
+                               int argc, JSValueConst *argv)
+{
+    FFISignature sig;
+    JSValue obj;
+    int slot, first;
+
+    if (ffi_parse_signature(ctx, &sig, argv[0], argv[1]))
+        return JS_EXCEPTION;
+    if (!JS_IsFunction(ctx, argv[2]))
+        return JS_ThrowTypeError(ctx, "not a function");
+    obj = JS_NewObjectClass(ctx, js_ffi_callback_class_id);
+    if (JS_IsException(obj))
+        return obj;
+    first = ffi_is_float(sig.ret) ? FFI_CALLBACK_SLOTS : 0;
+    pthread_mutex_lock(&ffi_callback_mutex);
+    for (slot = first; slot < first + FFI_CALLBACK_SLOTS; slot++) {
+        if (!ffi_callbacks[slot].used)
+            break;
+    }
+    if (slot < first + FFI_CALLBACK_SLOTS) {
+        ffi_callbacks[slot].used = TRUE;
+        ffi_callbacks[slot].ctx = ctx;
+        ffi_callbacks[slot].func = JS_DupValue(ctx, argv[2]);
+        ffi_callbacks[slot].sig = sig;
+    }
+    pthread_mutex_unlock(&ffi_callback_mutex);
+    if (slot == first + FFI_CALLBACK_SLOTS) {
+        JS_FreeValue(ctx, obj);
+        return JS_ThrowRangeError(ctx, "too many live callbacks (at most %d per return type)",
+                                  FFI_CALLBACK_SLOTS);
+    }
+    JS_SetOpaque(obj, (void *)(intptr_t)(slot + 1));
+    return obj;
+}
+
+static void ffi_callback_release(JSRuntime *rt, int slot)
+{
+    JS_FreeValueRT(rt, ffi_callbacks[slot].func);
+    pthread_mutex_lock(&ffi_callback_mutex);
+    ffi_callbacks[slot].used = FALSE;
+    ffi_callbacks[slot].ctx = NULL;
+    pthread_mutex_unlock(&ffi_callback_mutex);
+}
+
+static void js_ffi_callback_finalizer(JSRuntime *rt, JSValue val)
+{
+    int slot = (intptr_t)JS_GetOpaque(val, js_ffi_callback_class_id) - 1;
+
+    if (slot >= 0)
+        ffi_callback_release(rt, slot);
+}
+
+static void js_ffi_callback_mark(JSRuntime *rt, JSValueConst val,
+                                 JS_MarkFunc *mark_func)
+{
+    int slot = (intptr_t)JS_GetOpaque(val, js_ffi_callback_class_id) - 1;
+
+    if (slot >= 0)
+        JS_MarkValue(rt, ffi_callbacks[slot].func, mark_func);
+}
+
+/* a closed callback has no opaque and is rejected like any other object */
+static JSValue js_ffi_callback_get_ptr(JSContext *ctx, JSValueConst this_val)
+{
+    void *opaque = JS_GetOpaque2(ctx, this_val, js_ffi_callback_class_id);
+
+    if (!opaque)
+        return JS_EXCEPTION;
+    return ffi_new_pointer(ctx, ffi_callback_fns[(intptr_t)opaque - 1]);
+}
+
+static JSValue js_ffi_callback_close(JSContext *ctx, JSValueConst this_val,
+                                     int argc, JSValueConst *argv)
+{
+    void *opaque = JS_GetOpaque(this_val, js_ffi_callback_class_id);
+
+    if (opaque) {
+        JS_SetOpaque(this_val, NULL);
+        ffi_callback_release(JS_GetRuntime(ctx), (intptr_t)opaque - 1);
+    }
+    return JS_UNDEFINED;
+}
+
+/* Functions */
+
+static JSValue js_ffi_function_call(JSContext *ctx, JSValueConst func_obj,
+                                    JSValueConst this_val, int argc,
+                                    JSValueConst *argv, int flags)
+{
+    FFIFunction *f = JS_GetOpaque(func_obj, js_ffi_function_class_id);
+    FFILibrary *lib;
+
+    if (!JS_IsUndefined(f->lib_obj)) {
+        lib = JS_GetOpaque(f->lib_obj, js_ffi_library_class_id);
+        if (!lib->handle)
+            return JS_ThrowTypeError(ctx, "library is closed");
+    }
+    return ffi_call(ctx, f->fn, &f->sig, argc, argv);
+}
+
+static void js_ffi_function_finalizer(JSRuntime *rt, JSValue val)
+{
+    FFIFunction *f = JS_GetOpaque(val, js_ffi_function_class_id);
+
+    if (f) {
+        JS_FreeValueRT(rt, f->lib_obj);
+        js_free_rt(rt, f);
+    }
+}
+
+static void js_ffi_function_mark(JSRuntime *rt, JSValueConst val,
+                                 JS_MarkFunc *mark_func)
+{
+    FFIFunction *f = JS_GetOpaque(val, js_ffi_function_class_id);
+
+    if (f)
+        JS_MarkValue(rt, f->lib_obj, mark_func);
+}
+
+static JSValue ffi_new_function(JSContext *ctx, void *fn, JSValueConst lib_obj,
+                                const char *name, JSValueConst ret,
+                                JSValueConst args)
+{
+    FFIFunction *f;
+    JSValue obj;
+    FFISignature sig;
+
+    if (ffi_parse_signature(ctx, &sig, ret, args))
+        return JS_EXCEPTION;
+    obj = JS_NewObjectClass(ctx, js_ffi_function_class_id);
+    if (JS_IsException(obj))
+        return obj;
+    f = js_mallocz(ctx, sizeof(*f));
+    if (!f) {
+        JS_FreeValue(ctx, obj);
+        return JS_EXCEPTION;
+    }
+    f->fn = fn;
+    f->sig = sig;
+    f->lib_obj = JS_DupValue(ctx, lib_obj);
+    JS_SetOpaque(obj, f);
+    JS_DefinePropertyValueStr(ctx, obj, "name", JS_NewString(ctx, name),
+                              JS_PROP_CONFIGURABLE);
+    JS_DefinePropertyValueStr(ctx, obj, "length", JS_NewInt32(ctx, sig.nargs),
+                              JS_PROP_CONFIGURABLE);
+    return obj;
+}
+
+static JSValue js_ffi_func(JSContext *ctx, JSValueConst this_val,
+                           int argc, JSValueConst *argv)
+{
+    void *fn;
+
+    if (ffi_to_pointer(ctx, &fn, argv[0]))
+        return JS_EXCEPTION;
+    if (!fn)
+        return JS_ThrowTypeError(ctx, "null function pointer");
+    return ffi_new_function(ctx, fn, JS_UNDEFINED, "", argv[1], argv[2]);
+}
+
+/* Libraries */
+
+static JSValue js_ffi_dlopen(JSContext *ctx, JSValueConst this_val,
+                             int argc, JSValueConst *argv)
+{
+    FFILibrary *lib;
+    const char *path = NULL;
+    void *handle;
+    JSValue obj;
+
+    if (!JS_IsNull(argv[0]) && !JS_IsUndefined(argv[0])) {
+        path = JS_ToCString(ctx, argv[0]);
+        if (!path)
+            return JS_EXCEPTION;
+    }
+    handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (path)
+        JS_FreeCString(ctx, path);
+    if (!handle)
+        return JS_ThrowReferenceError(ctx, "%s", dlerror());
+    obj = JS_NewObjectClass(ctx, js_ffi_library_class_id);
+    if (JS_IsException(obj))
+        goto fail;
+    lib = js_mallocz(ctx, sizeof(*lib));
+    if (!lib) {
+        JS_FreeValue(ctx, obj);
+        goto fail;
+    }
+    lib->handle = handle;
+    JS_SetOpaque(obj, lib);
+    return obj;
+ fail:
+    dlclose(handle);
+    return JS_EXCEPTION;
+}
+
+static void js_ffi_library_finalizer(JSRuntime *rt, JSValue val)
+{
+    FFILibrary *lib = JS_GetOpaque(val, js_ffi_library_class_id);
+
+    if (lib) {
+        if (lib->handle)
+            dlclose(lib->handle);
+        js_free_rt(rt, lib);
+    }
+}
+
+static void *ffi_library_symbol(JSContext *ctx, JSValueConst this_val,
+                                JSValueConst name_val, const char **pname)
+{
+    FFILibrary *lib = JS_GetOpaque2(ctx, this_val, js_ffi_library_class_id);
+    const char *name;
+    void *p;
+
+    if (!lib)
+        return NULL;
+    if (!lib->handle) {
+        JS_ThrowTypeError(ctx, "library is closed");
+        return NULL;
+    }
+    name = JS_ToCString(ctx, name_val);
+    if (!name)
+        return NULL;
+    dlerror();
+    p = dlsym(lib->handle, name);
+    if (!p) {
+        JS_ThrowReferenceError(ctx, "symbol '%s' not found", name);
+        JS_FreeCString(ctx, name);
+        return NULL;
+    }
+    if (pname)
+        *pname = name;
+    else
+        JS_FreeCString(ctx, name);
+    return p;
+}
+
+static JSValue js_ffi_library_symbol(JSContext *ctx, JSValueConst this_val,
+                                     int argc, JSValueConst *argv)
+{
+    void *p = ffi_library_symbol(ctx, this_val, argv[0], NULL);
+
+    if (!p)
+        return JS_EXCEPTION;
+    return ffi_new_pointer(ctx, p);
+}
+
+static JSValue js_ffi_library_func(JSContext *ctx, JSValueConst this_val,
+                                   int argc, JSValueConst *argv)
+{
+    const char *name;
+    void *p;
+    JSValue ret;
+
+    p = ffi_library_symbol(ctx, this_val, argv[0], &name);
+    if (!p)
+        return JS_EXCEPTION;
+    ret = ffi_new_function(ctx, p, this_val, name, argv[1], argv[2]);
+    JS_FreeCString(ctx, name);
+    return ret;
+}
+
+static JSValue js_ffi_library_close(JSContext *ctx, JSValueConst this_val,
+                                    int argc, JSValueConst *argv)
+{
+    FFILibrary *lib = JS_GetOpaque2(ctx, this_val, js_ffi_library_class_id);
+
+    if (!lib)
+        return JS_EXCEPTION;
+    if (lib->handle) {
+        dlclose(lib->handle);
+        lib->handle = NULL;
+    }
+    return JS_UNDEFINED;
+}
+
+/* Memory helpers */
+
+static JSValue js_ffi_ptr(JSContext *ctx, JSValueConst this_val,
+                          int argc, JSValueConst *argv)
+{
+    void *p;
+
+    if (!JS_IsObject(argv[0]))
+        return JS_ThrowTypeError(ctx, "ArrayBuffer or typed array expected");
+    if (ffi_to_pointer(ctx, &p, argv[0]))
+        return JS_EXCEPTION;
+    return ffi_new_pointer(ctx, p);
+}
+
+static JSValue js_ffi_to_array_buffer(JSContext *ctx, JSValueConst this_val,
+                                      int argc, JSValueConst *argv)
+{
+    void *p;
+    int64_t len;
+
+    if (ffi_to_pointer(ctx, &p, argv[0]) || JS_ToInt64Ext(ctx, &len, argv[1]))
+        return JS_EXCEPTION;
+    if (!p || len < 0)
+        return JS_ThrowRangeError(ctx, "invalid pointer or length");
+    /* not owned: no free function */
+    return JS_NewArrayBuffer(ctx, p, len, NULL, NULL, FALSE);
+}
+
+static JSValue js_ffi_cstring(JSContext *ctx, JSValueConst this_val,
+                              int argc, JSValueConst *argv)
+{
+    void *p;
+
+    if (ffi_to_pointer(ctx, &p, argv[0]))
+        return JS_EXCEPTION;
+    if (!p)
+        return JS_NULL;
+    return JS_NewString(ctx, p);
+}
+
+static JSClassDef js_ffi_library_class = {
+    "Library",
+    .finalizer = js_ffi_library_finalizer,
+};
+
+static JSClassDef js_ffi_function_class = {
+    "Function",
+    .finalizer = js_ffi_function_finalizer,
+    .gc_mark = js_ffi_function_mark,
+    .call = js_ffi_function_call,
+};
+
+static JSClassDef js_ffi_callback_class = {
+    "Callback",
+    .finalizer = js_ffi_callback_finalizer,
+    .gc_mark = js_ffi_callback_mark,
+};
+
+static const JSCFunctionListEntry js_ffi_library_proto_funcs[] = {
+    JS_CFUNC_DEF("func", 3, js_ffi_library_func ),
+    JS_CFUNC_DEF("symbol", 1, js_ffi_library_symbol ),
+    JS_CFUNC_DEF("close", 0, js_ffi_library_close ),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Library", JS_PROP_CONFIGURABLE ),
+};
+
+static const JSCFunctionListEntry js_ffi_callback_proto_funcs[] = {
+    JS_CGETSET_DEF("ptr", js_ffi_callback_get_ptr, NULL ),
+    JS_CFUNC_DEF("close", 0, js_ffi_callback_close ),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Callback", JS_PROP_CONFIGURABLE ),
+};
+
+static const JSCFunctionListEntry js_ffi_funcs[] = {
+    JS_CFUNC_DEF("dlopen", 1, js_ffi_dlopen ),
+    JS_CFUNC_DEF("func", 3, js_ffi_func ),
+    JS_CFUNC_DEF("callback", 3, js_ffi_callback ),
+    JS_CFUNC_DEF("ptr", 1, js_ffi_ptr ),
+    JS_CFUNC_DEF("toArrayBuffer", 2, js_ffi_to_array_buffer ),
+    JS_CFUNC_DEF("cstring", 1, js_ffi_cstring ),
+#ifdef __APPLE__
+    JS_PROP_STRING_DEF("suffix", "dylib", 0 ),
+#else
+    JS_PROP_STRING_DEF("suffix", "so", 0 ),
+#endif
+};
+
+static int js_ffi_init(JSContext *ctx, JSModuleDef *m)
+{
+    JSRuntime *rt = JS_GetRuntime(ctx);
+    JSValue proto, global, func_ctor;
+
+    JS_NewClassID(rt, &js_ffi_library_class_id);
+    JS_NewClass(rt, js_ffi_library_class_id, &js_ffi_library_class);
+    proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, proto, js_ffi_library_proto_funcs,
+                               countof(js_ffi_library_proto_funcs));
+    JS_SetClassProto(ctx, js_ffi_library_class_id, proto);
+
+    JS_NewClassID(rt, &js_ffi_callback_class_id);
+    JS_NewClass(rt, js_ffi_callback_class_id, &js_ffi_callback_class);
+    proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, proto, js_ffi_callback_proto_funcs,
+                               countof(js_ffi_callback_proto_funcs));
+    JS_SetClassProto(ctx, js_ffi_callback_class_id, proto);
+
+    /* native functions are callable objects inheriting from
+       Function.prototype */
+    JS_NewClassID(rt, &js_ffi_function_class_id);
+    JS_NewClass(rt, js_ffi_function_class_id, &js_ffi_function_class);
+    global = JS_GetGlobalObject(ctx);
+    func_ctor = JS_GetPropertyStr(ctx, global, "Function");
+    JS_SetClassProto(ctx, js_ffi_function_class_id,
+                     JS_GetPropertyStr(ctx, func_ctor, "prototype"));
+    JS_FreeValue(ctx, func_ctor);
+    JS_FreeValue(ctx, global);
+
+    return JS_SetModuleExportList(ctx, m, js_ffi_funcs, countof(js_ffi_funcs));
+}
+
+JSModuleDef *js_init_module_qjsx_ffi(JSContext *ctx, const char *module_name)
+{
+    JSModuleDef *m;
+    m = JS_NewCModule(ctx, module_name, js_ffi_init);
+    if (!m)
+        return NULL;
+    JS_AddModuleExportList(ctx, m, js_ffi_funcs, countof(js_ffi_funcs));
+    return m;
+}
@@ -0,0 +1,2495 @@
+/*
+ * QJSX qjsx:kv module
+ *
+ * An embedded, crash-safe key-value store: a copy-on-write B+tree in a
+ * single memory-mapped file, in the style of LMDB.
+ *
+ *   import * as kv from "qjsx:kv";
+ *   const db = kv.open("state.db");
+ *   db.put("user:42", JSON.stringify(user));
+ *   const user = JSON.parse(db.getString("user:42"));
+ *   db.write(txn => { txn.put("a", "1"); txn.delete("b"); });
+ *   for (const [key, value] of db.range({ prefix: "user:" })) ...
+ *
+ *   kv.open(path, { readOnly, mapSize, sync }) -> Database
+ *   db.get(key)              -> ArrayBuffer view into the map, or undefined
+ *   db.getString(key)        -> string, or undefined
+ *   db.put(key, value)
+ *   db.delete(key)           -> true if the key existed
+ *   db.range(options)        -> iterator of [key, value]
+ *   db.begin({ readOnly })   -> Transaction
+ *   db.read(fn), db.write(fn) -> result of fn(txn); write() commits unless
+ *                               fn throws
+ *   db.stat(), db.close()
+ *   txn.get/getString/put/delete/range, txn.commit(), txn.abort()
+ *
+ * Keys are strings (stored as UTF-8) or binary data (ArrayBuffer or typed
+ * array) of 1 to 511 bytes, ordered bytewise. Values are strings or binary
+ * data. range() takes { start, end (exclusive), prefix, reverse, limit,
+ * keys: "string" | "buffer", values: "buffer" | "string" }.
+ *
+ * Writes never modify a page that a committed tree refers to: a write
+ * transaction copies the pages it changes, appends them (or reuses pages
+ * freed by older transactions) and commits by writing one of the two meta
+ * pages at the start of the file, after the new pages are on disk. A crash
+ * at any point leaves the previous meta page, and so the previous tree,
+ * intact. Pages freed by a commit are only reused once no reader can see
+ * them anymore, so read transactions see a stable snapshot without locks,
+ * and get() in a read transaction returns views straight into the map: the
+ * view pins its snapshot until it is garbage collected. The map is
+ * read-only, writing through such a view crashes the process; slice() it
+ * first. Values read in a write transaction are copies.
+ *
+ * One process opens a database for writing (one write transaction at a
+ * time, any number of readers); several processes can open it read-only
+ * when nobody writes. { sync: false } skips fdatasync(): commits survive a
+ * crash of the process but not of the machine.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include "quickjs/cutils.h"
+#include "quickjs/quickjs.h"
+
+#define KV_MAGIC            UINT64_C(0x0031766b78736a71) /* "qjsxkv1" */
+#define KV_VERSION          1
+#define KV_PAGE_SIZE        4096
+#define KV_MIN_PAGE_SIZE    512
+#define KV_MAX_PAGE_SIZE    32768
+#define KV_NUM_METAS        2
+#define KV_MAX_KEY          511
+#define KV_MAX_DEPTH        32
+#if INTPTR_MAX > INT32_MAX
+#define KV_DEFAULT_MAP_SIZE ((size_t)1 << 30)
+#else
+#define KV_DEFAULT_MAP_SIZE ((size_t)1 << 28)
+#endif
+
+enum {
+    KV_PAGE_BRANCH = 1,
+    KV_PAGE_LEAF = 2,
+    KV_PAGE_OVERFLOW = 4,
+    KV_PAGE_FREELIST = 8,
+    KV_PAGE_META = 16,
+};
+
+/* leaf node flags */
+#define KV_NODE_BIG 1 /* the value is in a run of overflow pages */
+
+enum {
+    KV_OK = 0,
+    KV_ENOMEM = -1,
+    KV_EIO = -2,      /* errno holds the cause */
+    KV_EFULL = -3,    /* the map size is exhausted */
+    KV_ECORRUPT = -4,
+};
+
+/*
+ * Every page starts with this header. Branch and leaf pages are slotted:
+ * an array of node offsets follows the header and the nodes are packed at
+ * the end of the page, 8-byte aligned.
+ */
+typedef struct KVPage {
+    uint64_t pgno;
+    uint16_t flags;
+    uint16_t nkeys;
+    uint16_t upper;     /* start of the node area */
+    uint16_t unused;
+    uint32_t count;     /* overflow: pages in the run; freelist: entries */
+    uint32_t unused2;
+    uint64_t next;      /* freelist: next page of the list */
+} KVPage;
+
+#define KV_HDR          ((uint32_t)sizeof(KVPage))
+#define KV_SLOTS(p)     ((uint16_t *)((uint8_t *)(p) + KV_HDR))
+#define KV_NODE(p, i)   ((uint8_t *)(p) + KV_SLOTS(p)[i])
+
+typedef struct KVLeaf {
+    uint16_t ksize;
+    uint16_t flags;
+    uint32_t vsize;
+    /* key, then the value or the uint64_t first overflow page */
+} KVLeaf;
+
+typedef struct KVBranch {
+    uint64_t child;
+    uint16_t ksize;
+    uint16_t unused[3];
+    /* key; the key of node 0 is ignored (it stands for -infinity) */
+} KVBranch;
+
+/* stored after the page header of pages 0 and 1 */
+typedef struct KVMeta {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t psize;
+    uint64_t txnid;
+    uint64_t root;      /* 0: empty tree */
+    uint64_t npages;    /* allocated pages, including the meta pages */
+    uint64_t entries;
+    uint64_t freelist;  /* first freelist page, 0: none */
+    uint64_t nfree;
+    uint32_t depth;
+    uint32_t unused;
+    uint64_t checksum;
+} KVMeta;
+
+/* a free page and the transaction that freed it (0: reusable by anyone) */
+typedef struct KVFreeEntry {
+    uint64_t pgno;
+    uint64_t txnid;
+} KVFreeEntry;
+
+typedef struct KVReader KVReader;
+typedef struct KVTxn KVTxn;
+
+typedef struct KVEnv {
+    JSRuntime *rt;
+    int ref_count;          /* database object, transactions, readers */
+    int fd;                 /* -1 once closed */
+    BOOL read_only;
+    BOOL no_sync;
+    uint32_t psize;
+    uint32_t max_node;      /* larger leaf nodes use overflow pages */
+    uint8_t *map;
+    size_t map_size;
+    uint64_t file_pages;    /* pages backed by the file */
+    KVMeta meta;            /* last committed transaction */
+    KVFreeEntry *free;
+    size_t nfree;
+    KVReader *readers;      /* live snapshots */
+    KVTxn *writer;
+} KVEnv;
+
+/* a read snapshot, kept alive by its transaction and by the views into it */
+struct KVReader {
+    KVEnv *env;
+    uint64_t txnid;
+    int ref_count;
+    KVReader *prev, *next;
+};
+
+typedef struct KVDirty {
+    uint64_t pgno;          /* 0: empty slot, 1: deleted slot */
+    uint32_t npages;
+    uint8_t *page;
+} KVDirty;
+
+struct KVTxn {
+    KVEnv *env;
+    KVReader *reader;       /* read-only transactions */
+    KVMeta meta;
+    BOOL read_only;
+    BOOL done;
+    BOOL failed;
+    uint32_t generation;    /* bumped by every change, for iterators */
+    int os_error;
+    /* write transactions: pages copied or allocated by this transaction */
+    KVDirty *dirty;
+    uint32_t dirty_bits;
+    size_t ndirty, dirty_used;
+    /* pages that can be allocated, sorted */
+    uint64_t *reuse;
+    size_t nreuse, reuse_size;
+    /* free pages that readers may still see */
+    KVFreeEntry *pending;
+    size_t npending;
+    /* pages freed by this transaction */
+    uint64_t *freed;
+    size_t nfreed, freed_size;
+};
+
+typedef struct KVPath {
+    int depth;
+    uint64_t pgno[KV_MAX_DEPTH];
+    uint8_t *page[KV_MAX_DEPTH];
+    int idx[KV_MAX_DEPTH];
+} KVPath;
+
+typedef struct KVCursor {
+    KVTxn *txn;
+    int depth;
+    BOOL valid;
+    uint64_t pgno[KV_MAX_DEPTH];
+    int idx[KV_MAX_DEPTH];
+} KVCursor;
+
+static inline uint64_t kv_min(uint64_t a, uint64_t b)
+{
+    return a < b ? a : b;
+}
+
+static inline uint64_t kv_max(uint64_t a, uint64_t b)
+{
+    return a > b ? a : b;
+}
+
+static inline size_t kv_align(size_t n)
+{
+    return (n + 7) & ~(size_t)7;
+}
+
+static inline int kv_cmp(const uint8_t *a, size_t alen,
+                         const uint8_t *b, size_t blen)
+{
+    int r = memcmp(a, b, alen < blen ? alen : blen);
+
+    if (r)
+        return r;
+    return (alen > blen) - (alen < blen);
+}
+
+static int kv_grow(JSRuntime *rt, void **pbuf, size_t *psize,
+                   size_t elem_size, size_t min_size)
+{
+    size_t size = kv_max(*psize * 3 / 2, 16);
+    void *buf;
+
+    if (size < min_size)
+        size = min_size;
+    buf = js_realloc_rt(rt, *pbuf, size * elem_size);
+    if (!buf)
+        return KV_ENOMEM;
+    *pbuf = buf;
+    *psize = size;
+    return KV_OK;
+}
+
+static uint64_t kv_checksum(const KVMeta *m)
+{
+    const uint8_t *p = (const uint8_t *)m;
+    uint64_t h = UINT64_C(0xcbf29ce484222325);
+
+    for (size_t i = 0; i < offsetof(KVMeta, checksum); i++)
+        h = (h ^ p[i]) * UINT64_C(0x100000001b3);
+    return h;
+}
+
+static int kv_pwrite(int fd, const uint8_t *buf, size_t len, uint64_t off)
+{
+    while (len > 0) {
+        ssize_t n = pwrite(fd, buf, len, off);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return KV_EIO;
+        }
+        buf += n;
+        len -= n;
+        off += n;
+    }
+    return KV_OK;
+}
+
+static int kv_fsync(KVEnv *env)
+{
+    if (env->no_sync)
+        return KV_OK;
+#ifdef __APPLE__
+    if (fcntl(env->fd, F_FULLFSYNC) < 0 && fsync(env->fd) < 0)
+        return KV_EIO;
+#else
+    if (fdatasync(env->fd) < 0)
+        return KV_EIO;
+#endif
+    return KV_OK;
+}
+
+/* Pages and nodes */
+
+static inline KVLeaf *kv_leaf(const uint8_t *p, int i)
+{
+    return (KVLeaf *)KV_NODE(p, i);
+}
+
+static inline KVBranch *kv_branch(const uint8_t *p, int i)
+{
+    return (KVBranch *)KV_NODE(p, i);
+}
+
+static inline uint8_t *kv_leaf_key(KVLeaf *n)
+{
+    return (uint8_t *)(n + 1);
+}
+
+static inline uint8_t *kv_branch_key(KVBranch *n)
+{
+    return (uint8_t *)(n + 1);
+}
+
+static inline size_t kv_leaf_size(const KVLeaf *n)
+{
+    return kv_align(sizeof(KVLeaf) + n->ksize +
+                    ((n->flags & KV_NODE_BIG) ? 8 : n->vsize));
+}
+
+static inline size_t kv_branch_size(const KVBranch *n)
+{
+    return kv_align(sizeof(KVBranch) + n->ksize);
+}
+
+static size_t kv_node_size(const uint8_t *p, int i)
+{
+    if (((KVPage *)p)->flags & KV_PAGE_BRANCH)
+        return kv_branch_size(kv_branch(p, i));
+    return kv_leaf_size(kv_leaf(p, i));
+}
+
+static uint64_t kv_big_pgno(KVLeaf *n)
+{
+    uint64_t pgno;
+
+    memcpy(&pgno, kv_leaf_key(n) + n->ksize, sizeof(pgno));
+    return pgno;
+}
+
+static void kv_page_init(uint8_t *p, uint64_t pgno, int flags, uint32_t psize)
+{
+    KVPage *h = (KVPage *)p;
+
+    memset(h, 0, KV_HDR);
+    h->pgno = pgno;
+    h->flags = flags;
+    h->upper = psize;
+}
+
+static inline size_t kv_page_room(const uint8_t *p)
+{
+    const KVPage *h = (const KVPage *)p;
+    return h->upper - KV_HDR - 2 * h->nkeys;
+}
+
+static inline size_t kv_page_used(const uint8_t *p, uint32_t psize)
+{
+    const KVPage *h = (const KVPage *)p;
+    return psize - h->upper + 2 * h->nkeys;
+}
+
+static void kv_page_insert(uint8_t *p, int i, const void *node, size_t size)
+{
+    KVPage *h = (KVPage *)p;
+    uint16_t *slots = KV_SLOTS(p);
+
+    h->upper -= size;
+    memcpy(p + h->upper, node, size);
+    memmove(slots + i + 1, slots + i, (h->nkeys - i) * sizeof(*slots));
+    slots[i] = h->upper;
+    h->nkeys++;
+}
+
+static void kv_page_delete(uint8_t *p, int i)
+{
+    KVPage *h = (KVPage *)p;
+    uint16_t *slots = KV_SLOTS(p);
+    uint16_t off = slots[i];
+    size_t size = kv_node_size(p, i);
+
+    memmove(p + h->upper + size, p + h->upper, off - h->upper);
+    for (int j = 0; j < h->nkeys; j++) {
+        if (slots[j] < off)
+            slots[j] += size;
+    }
+    memmove(slots + i, slots + i + 1, (h->nkeys - i - 1) * sizeof(*slots));
+    h->nkeys--;
+    h->upper += size;
+}
+
+/* index of the first node >= key */
+static int kv_leaf_search(const uint8_t *p, const uint8_t *key, size_t len,
+                          BOOL *exact)
+{
+    int lo = 0, hi = ((KVPage *)p)->nkeys;
+    KVLeaf *n;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        n = kv_leaf(p, mid);
+        if (kv_cmp(kv_leaf_key(n), n->ksize, key, len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (exact) {
+        n = kv_leaf(p, lo);
+        *exact = lo < ((KVPage *)p)->nkeys &&
+            !kv_cmp(kv_leaf_key(n), n->ksize, key, len);
+    }
+    return lo;
+}
+
+/* index of the child whose subtree covers key */
+static int kv_branch_search(const uint8_t *p, const uint8_t *key, size_t len)
+{
+    int lo = 1, hi = ((KVPage *)p)->nkeys;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        KVBranch *n = kv_branch(p, mid);
+        if (kv_cmp(kv_branch_key(n), n->ksize, key, len) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo - 1;
+}
+
+/* Dirty pages */
+
+static KVDirty *kv_dirty_find(KVTxn *txn, uint64_t pgno)
+{
+    uint32_t mask, h;
+
+    if (!txn->dirty)
+        return NULL;
+    mask = (1U << txn->dirty_bits) - 1;
+    h = (pgno * UINT64_C(0x9e3779b97f4a7c15)) >> (64 - txn->dirty_bits);
+    for (;; h = (h + 1) & mask) {
+        KVDirty *d = &txn->dirty[h];
+        if (d->pgno == pgno)
+            return d;
+        if (d->pgno == 0)
+            return NULL;
+    }
+}
+
+static void kv_dirty_insert(KVDirty *table, uint32_t bits, uint64_t pgno,
+                            uint8_t *page, uint32_t npages)
+{
+    uint32_t mask = (1U << bits) - 1;
+    uint32_t h = (pgno * UINT64_C(0x9e3779b97f4a7c15)) >> (64 - bits);
+
+    while (table[h].pgno > 1)
+        h = (h + 1) & mask;
+    table[h].pgno = pgno;
+    table[h].npages = npages;
+    table[h].page = page;
+}
+
+static int kv_dirty_add(KVTxn *txn, uint64_t pgno, uint8_t *page,
+                        uint32_t npages)
+{
+    JSRuntime *rt = txn->env->rt;
+
+    if ((txn->dirty_used + 1) * 2 > ((size_t)1 << txn->dirty_bits) || !txn->dirty) {
+        uint32_t bits = 6;
+        KVDirty *table;
+
+        while (((size_t)1 << bits) < (txn->ndirty + 1) * 4)
+            bits++;
+        table = js_mallocz_rt(rt, sizeof(KVDirty) << bits);
+        if (!table)
+            return KV_ENOMEM;
+        for (size_t i = 0; txn->dirty && i < ((size_t)1 << txn->dirty_bits); i++) {
+            KVDirty *d = &txn->dirty[i];
+            if (d->pgno > 1)
+                kv_dirty_insert(table, bits, d->pgno, d->page, d->npages);
+        }
+        js_free_rt(rt, txn->dirty);
+        txn->dirty = table;
+        txn->dirty_bits = bits;
+        txn->dirty_used = txn->ndirty;
+    }
+    kv_dirty_insert(txn->dirty, txn->dirty_bits, pgno, page, npages);
+    txn->ndirty++;
+    txn->dirty_used++;
+    return KV_OK;
+}
+
+static void kv_dirty_free(KVTxn *txn)
+{
+    for (size_t i = 0; txn->dirty && i < ((size_t)1 << txn->dirty_bits); i++) {
+        if (txn->dirty[i].pgno > 1)
+            js_free_rt(txn->env->rt, txn->dirty[i].page);
+    }
+    js_free_rt(txn->env->rt, txn->dirty);
+    txn->dirty = NULL;
+    txn->ndirty = txn->dirty_used = 0;
+}
+
+/* Page allocation */
+
+static int kv_reuse_add(KVTxn *txn, uint64_t pgno)
+{
+    size_t lo = 0, hi = txn->nreuse;
+
+    if (txn->nreuse == txn->reuse_size &&
+        kv_grow(txn->env->rt, (void **)&txn->reuse, &txn->reuse_size,
+                sizeof(uint64_t), txn->nreuse + 1))
+        return KV_ENOMEM;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (txn->reuse[mid] < pgno)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    memmove(txn->reuse + lo + 1, txn->reuse + lo,
+            (txn->nreuse - lo) * sizeof(uint64_t));
+    txn->reuse[lo] = pgno;
+    txn->nreuse++;
+    return KV_OK;
+}
+
+/* take n consecutive reusable pages, 0 if there are none */
+static uint64_t kv_reuse_take(KVTxn *txn, uint32_t n)
+{
+    size_t i, run = 1;
+    uint64_t pgno;
+
+    if (txn->nreuse < n)
+        return 0;
+    if (n == 1)
+        return txn->reuse[--txn->nreuse];
+    for (i = txn->nreuse - 1; i > 0; i--) {
+        if (txn->reuse[i - 1] + 1 == txn->reuse[i]) {
+            if (++run == n)
+                break;
+        } else {
+            run = 1;
+        }
+    }
+    if (run < n)
+        return 0;
+    pgno = txn->reuse[i - 1];
+    memmove(txn->reuse + i - 1, txn->reuse + i - 1 + n,
+            (txn->nreuse - (i - 1 + n)) * sizeof(uint64_t));
+    txn->nreuse -= n;
+    return pgno;
+}
+
+static int kv_alloc(KVTxn *txn, uint32_t n, int flags, uint64_t *ppgno,
+                    uint8_t **ppage)
+{
+    KVEnv *env = txn->env;
+    uint64_t pgno = kv_reuse_take(txn, n);
+    uint8_t *page;
+
+    if (!pgno) {
+        if (txn->meta.npages + n > env->map_size / env->psize)
+            return KV_EFULL;
+        pgno = txn->meta.npages;
+        txn->meta.npages += n;
+    }
+    page = js_mallocz_rt(env->rt, (size_t)n * env->psize);
+    if (!page)
+        return KV_ENOMEM;
+    if (kv_dirty_add(txn, pgno, page, n)) {
+        js_free_rt(env->rt, page);
+        return KV_ENOMEM;
+    }
+    kv_page_init(page, pgno, flags, env->psize);
+    *ppgno = pgno;
+    *ppage = page;
+    return KV_OK;
+}
+
+static int kv_free_pages(KVTxn *txn, uint64_t pgno, uint32_t n)
+{
+    KVDirty *d = kv_dirty_find(txn, pgno);
+
+    if (d) {
+        /* allocated by this transaction: nobody else can see it */
+        js_free_rt(txn->env->rt, d->page);
+        d->pgno = 1;
+        d->page = NULL;
+        txn->ndirty--;
+        for (uint32_t i = 0; i < n; i++) {
+            if (kv_reuse_add(txn, pgno + i))
+                return KV_ENOMEM;
+        }
+        return KV_OK;
+    }
+    if (txn->nfreed + n > txn->freed_size &&
+        kv_grow(txn->env->rt, (void **)&txn->freed, &txn->freed_size,
+                sizeof(uint64_t), txn->nfreed + n))
+        return KV_ENOMEM;
+    for (uint32_t i = 0; i < n; i++)
+        txn->freed[txn->nfreed++] = pgno + i;
+    return KV_OK;
+}
+
+/* a page as seen by the transaction, NULL if the reference is invalid */
+static uint8_t *kv_txn_page(KVTxn *txn, uint64_t pgno)
+{
+    KVEnv *env = txn->env;
+    KVDirty *d = kv_dirty_find(txn, pgno);
+    KVPage *h;
+    uint64_t end;
+
+    if (d)
+        return d->page;
+    end = kv_min(txn->meta.npages, env->file_pages);
+    if (pgno < KV_NUM_METAS || pgno >= end)
+        return NULL;
+    h = (KVPage *)(env->map + pgno * env->psize);
+    if (h->pgno != pgno)
+        return NULL;
+    if (h->flags & KV_PAGE_OVERFLOW) {
+        if (h->count == 0 || h->count > end - pgno)
+            return NULL;
+    } else if (!(h->flags & (KV_PAGE_BRANCH | KV_PAGE_LEAF)) ||
+               h->upper > env->psize || KV_HDR + 2 * h->nkeys > h->upper ||
+               ((h->flags & KV_PAGE_BRANCH) && h->nkeys == 0)) {
+        return NULL;
+    }
+    return (uint8_t *)h;
+}
+
+/* value of a leaf node: inline, or in its overflow pages */
+static int kv_leaf_value(KVTxn *txn, KVLeaf *n, uint8_t **pval, size_t *plen)
+{
+    uint8_t *p;
+
+    *plen = n->vsize;
+    if (!(n->flags & KV_NODE_BIG)) {
+        *pval = kv_leaf_key(n) + n->ksize;
+        return KV_OK;
+    }
+    p = kv_txn_page(txn, kv_big_pgno(n));
+    if (!p || !(((KVPage *)p)->flags & KV_PAGE_OVERFLOW) ||
+        KV_HDR + (uint64_t)n->vsize > (uint64_t)((KVPage *)p)->count * txn->env->psize)
+        return KV_ECORRUPT;
+    *pval = p + KV_HDR;
+    return KV_OK;
+}
+
+/* copy a page for writing, unless this transaction already did */
+static int kv_touch(KVTxn *txn, uint64_t *ppgno, uint8_t **ppage)
+{
+    KVDirty *d = kv_dirty_find(txn, *ppgno);
+    uint8_t *src, *page;
+    uint64_t pgno;
+    int ret;
+
+    if (d) {
+        *ppage = d->page;
+        return KV_OK;
+    }
+    src = kv_txn_page(txn, *ppgno);
+    if (!src)
+        return KV_ECORRUPT;
+    ret = kv_alloc(txn, 1, 0, &pgno, &page);
+    if (ret)
+        return ret;
+    memcpy(page, src, txn->env->psize);
+    ((KVPage *)page)->pgno = pgno;
+    ret = kv_free_pages(txn, *ppgno, 1);
+    if (ret)
+        return ret;
+    *ppgno = pgno;
+    *ppage = page;
+    return KV_OK;
+}
+
+/* B+tree */
+
+static int kv_get(KVTxn *txn, const uint8_t *key, size_t len,
+                  uint8_t **pval, size_t *pvlen, BOOL *found)
+{
+    uint64_t pgno = txn->meta.root;
+    BOOL exact;
+
+    *found = FALSE;
+    if (!pgno)
+        return KV_OK;
+    for (int level = 0; level < KV_MAX_DEPTH; level++) {
+        uint8_t *p = kv_txn_page(txn, pgno);
+        int i;
+
+        if (!p)
+            return KV_ECORRUPT;
+        if (((KVPage *)p)->flags & KV_PAGE_BRANCH) {
+            pgno = kv_branch(p, kv_branch_search(p, key, len))->child;
+            continue;
+        }
+        if (!(((KVPage *)p)->flags & KV_PAGE_LEAF))
+            return KV_ECORRUPT;
+        i = kv_leaf_search(p, key, len, &exact);
+        if (!exact)
+            return KV_OK;
+        *found = TRUE;
+        if (!pval)
+            return KV_OK;
+        return kv_leaf_value(txn, kv_leaf(p, i), pval, pvlen);
+    }
+    return KV_ECORRUPT;
+}
+
+/* copy the path from the root to the leaf covering key */
+static int kv_touch_path(KVTxn *txn, KVPath *path, const uint8_t *key,
+                         size_t len)
+{
+    uint64_t pgno = txn->meta.root;
+    uint8_t *p;
+    int ret;
+
+    ret = kv_touch(txn, &pgno, &p);
+    if (ret)
+        return ret;
+    txn->meta.root = pgno;
+    for (int level = 0; level < KV_MAX_DEPTH; level++) {
+        KVBranch *b;
+        uint8_t *child;
+        int i;
+
+        path->pgno[level] = pgno;
+        path->page[level] = p;
+        if (!(((KVPage *)p)->flags & KV_PAGE_BRANCH)) {
+            path->depth = level + 1;
+            return (((KVPage *)p)->flags & KV_PAGE_LEAF) ? KV_OK : KV_ECORRUPT;
+        }
+        i = kv_branch_search(p, key, len);
+        path->idx[level] = i;
+        pgno = kv_branch(p, i)->child;
+        ret = kv_touch(txn, &pgno, &child);
+        if (ret)
+            return ret;
+        b = kv_branch(p, i);
+        b->child = pgno;
+        p = child;
+    }
+    return KV_ECORRUPT;
+}
+
+static int kv_insert(KVTxn *txn, KVPath *path, int level, int idx,
+                     const uint8_t *node, size_t size);
+
+/*
+ * Split a full page to insert a node: the page keeps the lower half, a
+ * new page gets the upper half and its first key goes up to the parent.
+ * Appending at the end of a page (sequential keys) leaves the page full.
+ */
+static int kv_split(KVTxn *txn, KVPath *path, int level, int idx,
+                    const uint8_t *node, size_t size)
+{
+    KVEnv *env = txn->env;
+    uint8_t *p = path->page[level], *copy, *rp;
+    KVPage *h = (KVPage *)p;
+    int flags = h->flags, n = h->nkeys + 1, s, ret;
+    const uint8_t **ents, *sep;
+    size_t *sizes, total = 0, left = 0, sep_len;
+    uint8_t sep_node[kv_align(sizeof(KVBranch) + KV_MAX_KEY)];
+    KVBranch *b = (KVBranch *)sep_node;
+    uint64_t rpgno;
+
+    copy = js_malloc_rt(env->rt, env->psize + n * (sizeof(*ents) + sizeof(*sizes)));
+    if (!copy)
+        return KV_ENOMEM;
+    memcpy(copy, p, env->psize);
+    ents = (const uint8_t **)(copy + env->psize);
+    sizes = (size_t *)(ents + n);
+    for (int i = 0, j = 0; i < n; i++) {
+        if (i == idx) {
+            ents[i] = node;
+            sizes[i] = size;
+        } else {
+            ents[i] = KV_NODE(copy, j);
+            sizes[i] = kv_node_size(copy, j);
+            j++;
+        }
+        total += sizes[i] + 2;
+    }
+    if (idx == n - 1) {
+        s = n - 1;
+    } else {
+        for (s = 0; s < n - 1; s++) {
+            if (s > 0 && left + sizes[s] + 2 > total / 2)
+                break;
+            left += sizes[s] + 2;
+        }
+    }
+
+    ret = kv_alloc(txn, 1, flags, &rpgno, &rp);
+    if (ret)
+        goto done;
+    kv_page_init(p, h->pgno, flags, env->psize);
+    for (int i = 0; i < s; i++)
+        kv_page_insert(p, i, ents[i], sizes[i]);
+    for (int i = s; i < n; i++)
+        kv_page_insert(rp, i - s, ents[i], sizes[i]);
+
+    if (flags & KV_PAGE_BRANCH) {
+        sep = kv_branch_key((KVBranch *)ents[s]);
+        sep_len = ((KVBranch *)ents[s])->ksize;
+    } else {
+        sep = kv_leaf_key((KVLeaf *)ents[s]);
+        sep_len = ((KVLeaf *)ents[s])->ksize;
+    }
+    memset(b, 0, sizeof(*b));
+    b->child = rpgno;
+    b->ksize = sep_len;
+    memcpy(kv_branch_key(b), sep, sep_len);
+
+    if (level == 0) {
+        uint8_t *root;
+        uint64_t root_pgno;
+        KVBranch first;
+
+        ret = kv_alloc(txn, 1, KV_PAGE_BRANCH, &root_pgno, &root);
+        if (ret)
+            goto done;
+        memset(&first, 0, sizeof(first));
+        first.child = path->pgno[0];
+        kv_page_insert(root, 0, &first, sizeof(first));
+        kv_page_insert(root, 1, b, kv_branch_size(b));
+        txn->meta.root = root_pgno;
+        txn->meta.depth++;
+    } else {
+        ret = kv_insert(txn, path, level - 1, path->idx[level - 1] + 1,
+                        sep_node, kv_branch_size(b));
+    }
+ done:
+    js_free_rt(env->rt, copy);
+    return ret;
+}
+
+static int kv_insert(KVTxn *txn, KVPath *path, int level, int idx,
+                     const uint8_t *node, size_t size)
+{
+    uint8_t *p = path->page[level];
+
+    if (kv_page_room(p) >= size + 2) {
+        kv_page_insert(p, idx, node, size);
+        return KV_OK;
+    }
+    return kv_split(txn, path, level, idx, node, size);
+}
+
+static int kv_free_value(KVTxn *txn, KVLeaf *n)
+{
+    uint8_t *p;
+
+    if (!(n->flags & KV_NODE_BIG))
+        return KV_OK;
+    p = kv_txn_page(txn, kv_big_pgno(n));
+    if (!p)
+        return KV_ECORRUPT;
+    return kv_free_pages(txn, kv_big_pgno(n), ((KVPage *)p)->count);
+}
+
+static int kv_put(KVTxn *txn, const uint8_t *key, size_t klen,
+                  const uint8_t *val, size_t vlen)
+{
+    KVEnv *env = txn->env;
+    uint8_t node[KV_MAX_PAGE_SIZE / 4];
+    KVLeaf *n = (KVLeaf *)node;
+    KVPath path;
+    uint8_t *leaf;
+    BOOL exact;
+    int i, ret;
+
+    memset(n, 0, sizeof(*n));
+    n->ksize = klen;
+    n->vsize = vlen;
+    memcpy(kv_leaf_key(n), key, klen);
+    if (sizeof(KVLeaf) + klen + vlen > env->max_node) {
+        uint32_t npages = (KV_HDR + vlen + env->psize - 1) / env->psize;
+        uint64_t pgno;
+        uint8_t *p;
+
+        ret = kv_alloc(txn, npages, KV_PAGE_OVERFLOW, &pgno, &p);
+        if (ret)
+            return ret;
+        ((KVPage *)p)->count = npages;
+        memcpy(p + KV_HDR, val, vlen);
+        n->flags = KV_NODE_BIG;
+        memcpy(kv_leaf_key(n) + klen, &pgno, sizeof(pgno));
+    } else {
+        memcpy(kv_leaf_key(n) + klen, val, vlen);
+    }
+    txn->generation++;
+
+    if (!txn->meta.root) {
+        uint64_t pgno;
+
+        ret = kv_alloc(txn, 1, KV_PAGE_LEAF, &pgno, &leaf);
+        if (ret)
+            return ret;
+        kv_page_insert(leaf, 0, n, kv_leaf_size(n));
+        txn->meta.root = pgno;
+        txn->meta.depth = 1;
+        txn->meta.entries = 1;
+        return KV_OK;
+    }
+    ret = kv_touch_path(txn, &path, key, klen);
+    if (ret)
+        return ret;
+    leaf = path.page[path.depth - 1];
+    i = kv_leaf_search(leaf, key, klen, &exact);
+    if (exact) {
+        ret = kv_free_value(txn, kv_leaf(leaf, i));
+        if (ret)
+            return ret;
+        kv_page_delete(leaf, i);
+    } else {
+        txn->meta.entries++;
+    }
+    return kv_insert(txn, &path, path.depth - 1, i, node, kv_leaf_size(n));
+}
+
+/*
+ * Merge an underfilled page with a sibling when both fit in one page,
+ * then fix the parent. Pages that cannot be merged stay underfilled.
+ */
+static int kv_rebalance(KVTxn *txn, KVPath *path, int level)
+{
+    KVEnv *env = txn->env;
+    uint8_t *p = path->page[level], *parent, *sp, *lp, *rp;
+    KVPage *h = (KVPage *)p;
+    BOOL branch = h->flags & KV_PAGE_BRANCH;
+    int pi, si, li, ri, ret;
+    uint64_t spgno;
+    size_t need;
+
+    if (level == 0) {
+        if (!branch && h->nkeys == 0) {
+            txn->meta.root = 0;
+            txn->meta.depth = 0;
+            return kv_free_pages(txn, path->pgno[0], 1);
+        }
+        if (branch && h->nkeys == 1) {
+            txn->meta.root = kv_branch(p, 0)->child;
+            txn->meta.depth--;
+            return kv_free_pages(txn, path->pgno[0], 1);
+        }
+        return KV_OK;
+    }
+    if (h->nkeys >= (branch ? 2 : 1) &&
+        kv_page_used(p, env->psize) >= env->psize / 4)
+        return KV_OK;
+    parent = path->page[level - 1];
+    pi = path->idx[level - 1];
+    if (((KVPage *)parent)->nkeys < 2)
+        return kv_rebalance(txn, path, level - 1);
+
+    si = pi > 0 ? pi - 1 : pi + 1;
+    spgno = kv_branch(parent, si)->child;
+    ret = kv_touch(txn, &spgno, &sp);
+    if (ret)
+        return ret;
+    kv_branch(parent, si)->child = spgno;
+    li = min_int(pi, si);
+    ri = max_int(pi, si);
+    lp = li == pi ? p : sp;
+    rp = li == pi ? sp : p;
+
+    need = kv_page_used(lp, env->psize) + kv_page_used(rp, env->psize);
+    if (branch) {
+        KVBranch *sep = kv_branch(parent, ri);
+        need += kv_align(sizeof(KVBranch) + sep->ksize) -
+            kv_branch_size(kv_branch(rp, 0));
+    }
+    if (need > env->psize - KV_HDR)
+        return KV_OK;
+
+    for (int i = 0; i < ((KVPage *)rp)->nkeys; i++) {
+        int at = ((KVPage *)lp)->nkeys;
+        if (branch && i == 0) {
+            /* the first key of a branch page is implicit: use the
+               separator from the parent instead */
+            uint8_t node[kv_align(sizeof(KVBranch) + KV_MAX_KEY)];
+            KVBranch *b = (KVBranch *)node, *sep = kv_branch(parent, ri);
+            memset(b, 0, sizeof(*b));
+            b->child = kv_branch(rp, 0)->child;
+            b->ksize = sep->ksize;
+            memcpy(kv_branch_key(b), kv_branch_key(sep), sep->ksize);
+            kv_page_insert(lp, at, b, kv_branch_size(b));
+        } else {
+            kv_page_insert(lp, at, KV_NODE(rp, i), kv_node_size(rp, i));
+        }
+    }
+    ret = kv_free_pages(txn, kv_branch(parent, ri)->child, 1);
+    if (ret)
+        return ret;
+    kv_page_delete(parent, ri);
+    return kv_rebalance(txn, path, level - 1);
+}
+
+static int kv_del(KVTxn *txn, const uint8_t *key, size_t klen, BOOL *found)
+{
+    KVPath path;
+    uint8_t *leaf;
+    BOOL exact;
+    int i, ret;
+
+    /* look the key up first, so that deleting a missing key copies
+       nothing */
+    ret = kv_get(txn, key, klen, NULL, NULL, found);
+    if (ret || !*found)
+        return ret;
+    txn->generation++;
+    ret = kv_touch_path(txn, &path, key, klen);
+    if (ret)
+        return ret;
+    leaf = path.page[path.depth - 1];
+    i = kv_leaf_search(leaf, key, klen, &exact);
+    if (!exact)
+        return KV_ECORRUPT;
+    ret = kv_free_value(txn, kv_leaf(leaf, i));
+    if (ret)
+        return ret;
+    kv_page_delete(leaf, i);
+    txn->meta.entries--;
+    return kv_rebalance(txn, &path, path.depth - 1);
+}
+
+/* Cursors */
+
+static int kv_cursor_step(KVCursor *c, BOOL back);
+
+static int kv_cursor_descend(KVCursor *c, int level, uint64_t pgno, BOOL last)
+{
+    for (; level < KV_MAX_DEPTH; level++) {
+        uint8_t *p = kv_txn_page(c->txn, pgno);
+        KVPage *h = (KVPage *)p;
+
+        if (!p)
+            return KV_ECORRUPT;
+        c->pgno[level] = pgno;
+        c->idx[level] = last ? h->nkeys - 1 : 0;
+        if (!(h->flags & KV_PAGE_BRANCH)) {
+            c->depth = level + 1;
+            c->valid = TRUE;
+            /* a leaf that could not be merged away can be empty */
+            return h->nkeys > 0 ? KV_OK : kv_cursor_step(c, last);
+        }
+        pgno = kv_branch(p, c->idx[level])->child;
+    }
+    return KV_ECORRUPT;
+}
+
+static int kv_cursor_step(KVCursor *c, BOOL back)
+{
+    for (int level = c->depth - 1; level >= 0; level--) {
+        uint8_t *p = kv_txn_page(c->txn, c->pgno[level]);
+        int i = c->idx[level] + (back ? -1 : 1);
+
+        if (!p)
+            return KV_ECORRUPT;
+        if (i < 0 || i >= ((KVPage *)p)->nkeys)
+            continue;
+        c->idx[level] = i;
+        if (level == c->depth - 1)
+            return KV_OK;
+        return kv_cursor_descend(c, level + 1, kv_branch(p, i)->child, back);
+    }
+    c->valid = FALSE;
+    return KV_OK;
+}
+
+static int kv_cursor_first(KVCursor *c, BOOL last)
+{
+    c->valid = FALSE;
+    if (!c->txn->meta.root)
+        return KV_OK;
+    return kv_cursor_descend(c, 0, c->txn->meta.root, last);
+}
+
+/* position on the first key >= key */
+static int kv_cursor_seek(KVCursor *c, const uint8_t *key, size_t len)
+{
+    uint64_t pgno = c->txn->meta.root;
+
+    c->valid = FALSE;
+    if (!pgno)
+        return KV_OK;
+    for (int level = 0; level < KV_MAX_DEPTH; level++) {
+        uint8_t *p = kv_txn_page(c->txn, pgno);
+        KVPage *h = (KVPage *)p;
+
+        if (!p)
+            return KV_ECORRUPT;
+        c->pgno[level] = pgno;
+        if (h->flags & KV_PAGE_BRANCH) {
+            c->idx[level] = kv_branch_search(p, key, len);
+            pgno = kv_branch(p, c->idx[level])->child;
+            continue;
+        }
+        c->depth = level + 1;
+        c->idx[level] = kv_leaf_search(p, key, len, NULL);
+        if (c->idx[level] < h->nkeys) {
+            c->valid = TRUE;
+            return KV_OK;
+        }
+        /* past the end of this leaf: the answer is in the next one */
+        c->idx[level] = h->nkeys - 1;
+        return kv_cursor_step(c, FALSE);
+    }
+    return KV_ECORRUPT;
+}
+
+static int kv_cursor_get(KVCursor *c, const uint8_t **pkey, size_t *pklen,
+                         uint8_t **pval, size_t *pvlen)
+{
+    uint8_t *p = kv_txn_page(c->txn, c->pgno[c->depth - 1]);
+    KVLeaf *n;
+
+    if (!p)
+        return KV_ECORRUPT;
+    n = kv_leaf(p, c->idx[c->depth - 1]);
+    *pkey = kv_leaf_key(n);
+    *pklen = n->ksize;
+    return kv_leaf_value(c->txn, n, pval, pvlen);
+}
+
+/* Environments and transactions */
+
+static void kv_env_release(KVEnv *env)
+{
+    if (--env->ref_count > 0)
+        return;
+    if (env->map)
+        munmap(env->map, env->map_size);
+    if (env->fd >= 0)
+        close(env->fd);
+    js_free_rt(env->rt, env->free);
+    js_free_rt(env->rt, env);
+}
+
+static KVReader *kv_reader_new(KVEnv *env)
+{
+    KVReader *r = js_mallocz_rt(env->rt, sizeof(*r));
+
+    if (!r)
+        return NULL;
+    r->env = env;
+    r->txnid = env->meta.txnid;
+    r->ref_count = 1;
+    r->next = env->readers;
+    if (env->readers)
+        env->readers->prev = r;
+    env->readers = r;
+    env->ref_count++;
+    return r;
+}
+
+static void kv_reader_release(KVReader *r)
+{
+    KVEnv *env = r->env;
+
+    if (--r->ref_count > 0)
+        return;
+    if (r->prev)
+        r->prev->next = r->next;
+    else
+        env->readers = r->next;
+    if (r->next)
+        r->next->prev = r->prev;
+    js_free_rt(env->rt, r);
+    kv_env_release(env);
+}
+
+static int kv_free_entry_cmp(const void *a, const void *b)
+{
+    uint64_t x = ((const KVFreeEntry *)a)->pgno, y = ((const KVFreeEntry *)b)->pgno;
+    return (x > y) - (x < y);
+}
+
+static int kv_txn_begin(KVEnv *env, BOOL read_only, KVTxn **ptxn)
+{
+    KVTxn *txn = js_mallocz_rt(env->rt, sizeof(*txn));
+    uint64_t oldest = UINT64_MAX;
+
+    if (!txn)
+        return KV_ENOMEM;
+    txn->env = env;
+    txn->meta = env->meta;
+    txn->read_only = read_only;
+    if (read_only) {
+        txn->reader = kv_reader_new(env);
+        if (!txn->reader) {
+            js_free_rt(env->rt, txn);
+            return KV_ENOMEM;
+        }
+        *ptxn = txn;
+        return KV_OK;
+    }
+
+    /* split the free pages into those nobody can see anymore and those
+       that a live snapshot may still use */
+    for (KVReader *r = env->readers; r; r = r->next)
+        oldest = kv_min(oldest, r->txnid);
+    if (env->nfree) {
+        txn->reuse = js_malloc_rt(env->rt, env->nfree * sizeof(uint64_t));
+        txn->pending = js_malloc_rt(env->rt, env->nfree * sizeof(KVFreeEntry));
+        if (!txn->reuse || !txn->pending) {
+            js_free_rt(env->rt, txn->reuse);
+            js_free_rt(env->rt, txn->pending);
+            js_free_rt(env->rt, txn);
+            return KV_ENOMEM;
+        }
+        txn->reuse_size = env->nfree;
+        for (size_t i = 0; i < env->nfree; i++) {
+            if (env->free[i].txnid <= oldest)
+                txn->reuse[txn->nreuse++] = env->free[i].pgno;
+            else
+                txn->pending[txn->npending++] = env->free[i];
+        }
+    }
+    env->writer = txn;
+    env->ref_count++;
+    *ptxn = txn;
+    return KV_OK;
+}
+
+static void kv_txn_end(KVTxn *txn)
+{
+    KVEnv *env = txn->env;
+
+    if (txn->done)
+        return;
+    txn->done = TRUE;
+    if (txn->read_only) {
+        kv_reader_release(txn->reader);
+        txn->reader = NULL;
+        return;
+    }
+    kv_dirty_free(txn);
+    js_free_rt(env->rt, txn->reuse);
+    js_free_rt(env->rt, txn->pending);
+    js_free_rt(env->rt, txn->freed);
+    txn->reuse = txn->freed = NULL;
+    txn->pending = NULL;
+    env->writer = NULL;
+    kv_env_release(env);
+}
+
+static int kv_page_pgno_cmp(const void *a, const void *b)
+{
+    uint64_t x = ((const KVDirty *)a)->pgno, y = ((const KVDirty *)b)->pgno;
+    return (x > y) - (x < y);
+}
+
+static int kv_write_meta(KVEnv *env, KVMeta *meta)
+{
+    uint8_t buf[sizeof(KVPage) + sizeof(KVMeta)];
+
+    meta->checksum = kv_checksum(meta);
+    kv_page_init(buf, meta->txnid % KV_NUM_METAS, KV_PAGE_META, env->psize);
+    memcpy(buf + KV_HDR, meta, sizeof(*meta));
+    return kv_pwrite(env->fd, buf, sizeof(buf),
+                     (meta->txnid % KV_NUM_METAS) * env->psize);
+}
+
+/*
+ * Commit: write the new pages and the new free list, flush, then switch
+ * to the new tree by writing the meta page the previous commit did not
+ * use, and flush again.
+ */
+static int kv_txn_commit(KVTxn *txn)
+{
+    KVEnv *env = txn->env;
+    KVMeta meta = txn->meta;
+    KVFreeEntry *all = NULL;
+    KVDirty *pages = NULL;
+    uint8_t *fl = NULL;
+    size_t total, npages = 0, per_page, nfl, k;
+    uint64_t txnid = env->meta.txnid + 1, first_fl;
+    int ret = KV_OK;
+
+    if (txn->read_only || !txn->generation)
+        goto done;
+
+    /* the pages of the current free list are freed by this commit */
+    for (uint64_t pgno = env->meta.freelist; pgno;) {
+        KVPage *h = (KVPage *)(env->map + pgno * env->psize);
+        if (pgno < KV_NUM_METAS || pgno >= env->file_pages ||
+            h->pgno != pgno || !(h->flags & KV_PAGE_FREELIST)) {
+            ret = KV_ECORRUPT;
+            goto done;
+        }
+        ret = kv_free_pages(txn, pgno, 1);
+        if (ret)
+            goto done;
+        pgno = h->next;
+    }
+
+    total = txn->npending + txn->nreuse + txn->nfreed;
+    all = js_malloc_rt(env->rt, kv_max(total, 1) * sizeof(KVFreeEntry));
+    if (!all) {
+        ret = KV_ENOMEM;
+        goto done;
+    }
+    k = txn->npending;
+    if (k)
+        memcpy(all, txn->pending, k * sizeof(KVFreeEntry));
+    for (size_t i = 0; i < txn->nreuse; i++)
+        all[k++] = (KVFreeEntry){ txn->reuse[i], 0 };
+    for (size_t i = 0; i < txn->nfreed; i++)
+        all[k++] = (KVFreeEntry){ txn->freed[i], txnid };
+    qsort(all, total, sizeof(KVFreeEntry), kv_free_entry_cmp);
+
+    /* the new free list goes at the end of the file */
+    per_page = (env->psize - KV_HDR) / sizeof(KVFreeEntry);
+    nfl = (total + per_page - 1) / per_page;
+    if (meta.npages + nfl > env->map_size / env->psize) {
+        ret = KV_EFULL;
+        goto done;
+    }
+    first_fl = nfl ? meta.npages : 0;
+    if (nfl) {
+        fl = js_mallocz_rt(env->rt, nfl * env->psize);
+        if (!fl) {
+            ret = KV_ENOMEM;
+            goto done;
+        }
+        for (size_t i = 0; i < nfl; i++) {
+            uint8_t *p = fl + i * env->psize;
+            size_t n = kv_min(per_page, total - i * per_page);
+            kv_page_init(p, first_fl + i, KV_PAGE_FREELIST, env->psize);
+            ((KVPage *)p)->count = n;
+            ((KVPage *)p)->next = i + 1 < nfl ? first_fl + i + 1 : 0;
+            memcpy(p + KV_HDR, all + i * per_page, n * sizeof(KVFreeEntry));
+        }
+        meta.npages += nfl;
+    }
+
+    pages = js_malloc_rt(env->rt, kv_max(txn->ndirty, 1) * sizeof(KVDirty));
+    if (!pages) {
+        ret = KV_ENOMEM;
+        goto done;
+    }
+    for (size_t i = 0; txn->dirty && i < ((size_t)1 << txn->dirty_bits); i++) {
+        if (txn->dirty[i].pgno > 1)
+            pages[npages++] = txn->dirty[i];
+    }
+    qsort(pages, npages, sizeof(KVDirty), kv_page_pgno_cmp);
+    for (size_t i = 0; i < npages; i++) {
+        ret = kv_pwrite(env->fd, pages[i].page, (size_t)pages[i].npages * env->psize,
+                        pages[i].pgno * env->psize);
+        if (ret)
+            goto done;
+    }
+    if (nfl) {
+        ret = kv_pwrite(env->fd, fl, nfl * env->psize, first_fl * env->psize);
+        if (ret)
+            goto done;
+    }
+    ret = kv_fsync(env);
+    if (ret)
+        goto done;
+
+    meta.txnid = txnid;
+    meta.freelist = first_fl;
+    meta.nfree = total;
+    ret = kv_write_meta(env, &meta);
+    if (!ret)
+        ret = kv_fsync(env);
+    if (ret)
+        goto done;
+
+    env->meta = meta;
+    env->file_pages = kv_max(env->file_pages, meta.npages);
+    js_free_rt(env->rt, env->free);
+    env->free = all;
+    env->nfree = total;
+    all = NULL;
+ done:
+    if (ret == KV_EIO)
+        txn->os_error = errno;
+    js_free_rt(env->rt, all);
+    js_free_rt(env->rt, pages);
+    js_free_rt(env->rt, fl);
+    if (ret)
+        txn->failed = TRUE;
+    else
+        kv_txn_end(txn);
+    return ret;
+}
+
+static BOOL kv_meta_valid(const KVMeta *m, uint32_t psize)
+{
+    return m->magic == KV_MAGIC && m->version == KV_VERSION &&
+        m->psize == psize && m->checksum == kv_checksum(m) &&
+        m->npages >= KV_NUM_METAS && m->depth <= KV_MAX_DEPTH &&
+        m->root < m->npages && m->freelist < m->npages;
+}
+
+static int kv_read_metas(KVEnv *env, uint64_t size)
+{
+    static const uint32_t psizes[] = { KV_PAGE_SIZE, 512, 1024, 2048, 8192, 16384, 32768 };
+    uint8_t buf[sizeof(KVPage) + sizeof(KVMeta)];
+    KVMeta m;
+    BOOL found = FALSE;
+
+    /* the page size is stored in the meta pages; if page 0 is damaged,
+       look for page 1 at each possible page size */
+    for (size_t i = 0; i < countof(psizes) && !found; i++) {
+        for (int slot = 0; slot < KV_NUM_METAS; slot++) {
+            uint64_t off = (uint64_t)slot * psizes[i];
+            if (off + sizeof(buf) > size ||
+                pread(env->fd, buf, sizeof(buf), off) != sizeof(buf))
+                continue;
+            memcpy(&m, buf + KV_HDR, sizeof(m));
+            if (!kv_meta_valid(&m, psizes[i]))
+                continue;
+            if (!found || m.txnid > env->meta.txnid)
+                env->meta = m;
+            found = TRUE;
+        }
+    }
+    if (!found)
+        return KV_ECORRUPT;
+    env->psize = env->meta.psize;
+    return KV_OK;
+}
+
+static int kv_load_freelist(KVEnv *env)
+{
+    size_t n = 0;
+
+    if (env->meta.nfree > env->meta.npages)
+        return KV_ECORRUPT;
+    env->free = js_malloc_rt(env->rt, kv_max(env->meta.nfree, 1) * sizeof(KVFreeEntry));
+    if (!env->free)
+        return KV_ENOMEM;
+    for (uint64_t pgno = env->meta.freelist, i = 0; pgno; i++) {
+        KVPage *h = (KVPage *)(env->map + pgno * env->psize);
+        if (pgno < KV_NUM_METAS || pgno >= env->file_pages || i >= env->meta.npages ||
+            h->pgno != pgno || !(h->flags & KV_PAGE_FREELIST) ||
+            h->count > env->meta.nfree - n ||
+            KV_HDR + h->count * sizeof(KVFreeEntry) > env->psize)
+            return KV_ECORRUPT;
+        memcpy(env->free + n, h + 1, h->count * sizeof(KVFreeEntry));
+        n += h->count;
+        pgno = h->next;
+    }
+    if (n != env->meta.nfree)
+        return KV_ECORRUPT;
+    env->nfree = n;
+    return KV_OK;
+}
+
+static int kv_env_open(JSRuntime *rt, const char *path, BOOL read_only,
+                       BOOL no_sync, size_t map_size, KVEnv **penv,
+                       int *os_error)
+{
+    KVEnv *env = js_mallocz_rt(rt, sizeof(*env));
+    struct stat st;
+    int ret;
+
+    if (!env)
+        return KV_ENOMEM;
+    env->rt = rt;
+    env->ref_count = 1;
+    env->read_only = read_only;
+    env->no_sync = no_sync;
+    env->fd = open(path, read_only ? O_RDONLY : O_RDWR | O_CREAT, 0644);
+    if (env->fd < 0)
+        goto io_error;
+    fcntl(env->fd, F_SETFD, FD_CLOEXEC);
+    if (flock(env->fd, (read_only ? LOCK_SH : LOCK_EX) | LOCK_NB) < 0)
+        goto io_error;
+    if (fstat(env->fd, &st) < 0)
+        goto io_error;
+
+    if (st.st_size == 0 && !read_only) {
+        /* new database: two meta pages of an empty tree */
+        uint8_t *p = js_mallocz_rt(rt, 2 * KV_PAGE_SIZE);
+        if (!p) {
+            ret = KV_ENOMEM;
+            goto fail;
+        }
+        env->psize = KV_PAGE_SIZE;
+        env->meta = (KVMeta){ .magic = KV_MAGIC, .version = KV_VERSION,
+                              .psize = KV_PAGE_SIZE, .npages = KV_NUM_METAS };
+        env->meta.checksum = kv_checksum(&env->meta);
+        for (int i = 0; i < KV_NUM_METAS; i++) {
+            kv_page_init(p + i * KV_PAGE_SIZE, i, KV_PAGE_META, KV_PAGE_SIZE);
+            memcpy(p + i * KV_PAGE_SIZE + KV_HDR, &env->meta, sizeof(KVMeta));
+        }
+        ret = kv_pwrite(env->fd, p, 2 * KV_PAGE_SIZE, 0);
+        js_free_rt(rt, p);
+        if (ret || fsync(env->fd) < 0)
+            goto io_error;
+        st.st_size = 2 * KV_PAGE_SIZE;
+    } else {
+        ret = kv_read_metas(env, st.st_size);
+        if (ret)
+            goto fail;
+    }
+
+    env->max_node = ((env->psize - KV_HDR) / 4 - 2) & ~7;
+    env->file_pages = st.st_size / env->psize;
+    map_size = kv_max(map_size, env->meta.npages * env->psize);
+    map_size = kv_max(map_size, env->file_pages * env->psize);
+    env->map_size = (map_size + env->psize - 1) / env->psize * env->psize;
+    env->map = mmap(NULL, env->map_size, PROT_READ, MAP_SHARED, env->fd, 0);
+    if (env->map == MAP_FAILED) {
+        env->map = NULL;
+        goto io_error;
+    }
+    ret = kv_load_freelist(env);
+    if (ret)
+        goto fail;
+    *penv = env;
+    return KV_OK;
+ io_error:
+    ret = KV_EIO;
+    *os_error = errno;
+ fail:
+    kv_env_release(env);
+    return ret;
+}
+
+/* JavaScript bindings */
+
+static JSClassID js_kv_db_class_id;
+static JSClassID js_kv_txn_class_id;
+static JSClassID js_kv_iter_class_id;
+
+typedef struct KVIter {
+    JSValue txn_obj;
+    KVCursor cursor;
+    uint8_t *start, *end;       /* end is exclusive */
+    size_t start_len, end_len;
+    BOOL reverse;
+    BOOL started;
+    BOOL done;
+    BOOL owns_txn;              /* db.range(): ends its snapshot when done */
+    BOOL keys_as_buffer;
+    BOOL values_as_string;
+    int64_t remaining;          /* -1: no limit */
+    uint32_t generation;
+    uint8_t last_key[KV_MAX_KEY];
+    size_t last_len;
+} KVIter;
+
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    const char *str;
+} KVBytes;
+
+static JSValue __attribute__((format(printf, 2, 3)))
+kv_throw(JSContext *ctx, const char *fmt, ...)
+{
+    char buf[256];
+    va_list ap;
+    JSValue err;
+
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    err = JS_NewError(ctx);
+    if (JS_IsException(err))
+        return err;
+    JS_DefinePropertyValueStr(ctx, err, "message", JS_NewString(ctx, buf),
+                              JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE);
+    return JS_Throw(ctx, err);
+}
+
+static JSValue kv_throw_status(JSContext *ctx, KVEnv *env, int status,
+                               int os_error)
+{
+    switch (status) {
+    case KV_ENOMEM:
+        return JS_ThrowOutOfMemory(ctx);
+    case KV_EFULL:
+        return JS_ThrowRangeError(ctx, "database is full (mapSize is %zu bytes)",
+                                  env->map_size);
+    case KV_ECORRUPT:
+        return kv_throw(ctx, "database is corrupted");
+    default:
+        return kv_throw(ctx, "database I/O error: %s", strerror(os_error));
+    }
+}
+
+static JSValue kv_txn_throw(JSContext *ctx, KVTxn *txn, int status)
+{
+    if (status == KV_EIO && !txn->os_error)
+        txn->os_error = errno;
+    if (!txn->read_only)
+        txn->failed = TRUE;
+    return kv_throw_status(ctx, txn->env, status, txn->os_error);
+}
+
+static int kv_get_bytes(JSContext *ctx, KVBytes *b, JSValueConst val,
+                        const char *what, size_t max_len)
+{
+    size_t offset, length, elem_size, size;
+    JSValue buf;
+
+    b->str = NULL;
+    if (JS_IsString(val)) {
+        b->str = JS_ToCStringLen(ctx, &b->len, val);
+        if (!b->str)
+            return -1;
+        b->data = (const uint8_t *)b->str;
+    } else if (JS_IsObject(val) && JS_GetTypedArrayType(val) >= 0) {
+        buf = JS_GetTypedArrayBuffer(ctx, val, &offset, &length, &elem_size);
+        if (JS_IsException(buf))
+            return -1;
+        /* the typed array keeps the buffer alive */
+        b->data = JS_GetArrayBuffer(ctx, &size, buf);
+        JS_FreeValue(ctx, buf);
+        if (!b->data)
+            return -1;
+        b->data += offset;
+        b->len = length;
+    } else if (JS_IsObject(val)) {
+        b->data = JS_GetArrayBuffer(ctx, &b->len, val);
+        if (!b->data)
+            return -1;
+    } else {
+        JS_ThrowTypeError(ctx, "%s must be a string, ArrayBuffer or typed array", what);
+        return -1;
+    }
+    if (b->len < (max_len == KV_MAX_KEY) || b->len > max_len) {
+        if (b->str)
+            JS_FreeCString(ctx, b->str);
+        JS_ThrowRangeError(ctx, "%s must be %s%zu bytes", what,
+                           max_len == KV_MAX_KEY ? "1 to " : "at most ", max_len);
+        return -1;
+    }
+    return 0;
+}
+
+static void kv_free_bytes(JSContext *ctx, KVBytes *b)
+{
+    if (b->str)
+        JS_FreeCString(ctx, b->str);
+}
+
+static void kv_view_free(JSRuntime *rt, void *opaque, void *ptr)
+{
+    kv_reader_release(opaque);
+}
+
+/* a value read in txn: a view pinning the snapshot, or a copy */
+static JSValue kv_new_value(JSContext *ctx, KVTxn *txn, uint8_t *val,
+                            size_t len, BOOL as_string)
+{
+    if (as_string)
+        return JS_NewStringLen(ctx, (const char *)val, len);
+    if (!txn->read_only)
+        return JS_NewArrayBufferCopy(ctx, val, len);
+    txn->reader->ref_count++;
+    return JS_NewArrayBuffer(ctx, val, len, kv_view_free, txn->reader, FALSE);
+}
+
+static KVEnv *kv_get_env(JSContext *ctx, JSValueConst this_val)
+{
+    KVEnv *env = JS_GetOpaque2(ctx, this_val, js_kv_db_class_id);
+
+    if (!env)
+        return NULL;
+    if (env->fd < 0) {
+        JS_ThrowTypeError(ctx, "database is closed");
+        return NULL;
+    }
+    return env;
+}
+
+static KVTxn *kv_get_txn(JSContext *ctx, JSValueConst this_val)
+{
+    KVTxn *txn = JS_GetOpaque2(ctx, this_val, js_kv_txn_class_id);
+
+    if (!txn)
+        return NULL;
+    if (txn->done) {
+        JS_ThrowTypeError(ctx, "transaction has ended");
+        return NULL;
+    }
+    if (txn->env->fd < 0) {
+        JS_ThrowTypeError(ctx, "database is closed");
+        return NULL;
+    }
+    if (txn->failed) {
+        JS_ThrowTypeError(ctx, "transaction failed and must be aborted");
+        return NULL;
+    }
+    return txn;
+}
+
+static JSValue kv_txn_get(JSContext *ctx, KVTxn *txn, JSValueConst key_val,
+                          BOOL as_string)
+{
+    KVBytes key;
+    uint8_t *val;
+    size_t len;
+    BOOL found;
+    int ret;
+
+    if (kv_get_bytes(ctx, &key, key_val, "key", KV_MAX_KEY))
+        return JS_EXCEPTION;
+    ret = kv_get(txn, key.data, key.len, &val, &len, &found);
+    kv_free_bytes(ctx, &key);
+    if (ret)
+        return kv_txn_throw(ctx, txn, ret);
+    if (!found)
+        return JS_UNDEFINED;
+    return kv_new_value(ctx, txn, val, len, as_string);
+}
+
+static JSValue kv_txn_put(JSContext *ctx, KVTxn *txn, JSValueConst key_val,
+                          JSValueConst val_val)
+{
+    KVBytes key, val;
+    int ret;
+
+    if (txn->read_only)
+        return JS_ThrowTypeError(ctx, "read-only transaction");
+    if (kv_get_bytes(ctx, &key, key_val, "key", KV_MAX_KEY))
+        return JS_EXCEPTION;
+    if (kv_get_bytes(ctx, &val, val_val, "value", UINT32_MAX - KV_HDR)) {
+        kv_free_bytes(ctx, &key);
+        return JS_EXCEPTION;
+    }
+    ret = kv_put(txn, key.data, key.len, val.data, val.len);
+    kv_free_bytes(ctx, &key);
+    kv_free_bytes(ctx, &val);
+    if (ret)
+        return kv_txn_throw(ctx, txn, ret);
+    return JS_UNDEFINED;
+}
+
+static JSValue kv_txn_delete(JSContext *ctx, KVTxn *txn, JSValueConst key_val)
+{
+    KVBytes key;
+    BOOL found;
+    int ret;
+
+    if (txn->read_only)
+        return JS_ThrowTypeError(ctx, "read-only transaction");
+    if (kv_get_bytes(ctx, &key, key_val, "key", KV_MAX_KEY))
+        return JS_EXCEPTION;
+    ret = kv_del(txn, key.data, key.len, &found);
+    kv_free_bytes(ctx, &key);
+    if (ret)
+        return kv_txn_throw(ctx, txn, ret);
+    return JS_NewBool(ctx, found);
+}
+
+static JSValue kv_new_txn_object(JSContext *ctx, KVEnv *env, BOOL read_only)
+{
+    KVTxn *txn;
+    JSValue obj;
+    int ret;
+
+    if (!read_only && env->read_only)
+        return JS_ThrowTypeError(ctx, "database is read-only");
+    if (!read_only && env->writer)
+        return JS_ThrowTypeError(ctx, "a write transaction is already active");
+    obj = JS_NewObjectClass(ctx, js_kv_txn_class_id);
+    if (JS_IsException(obj))
+        return obj;
+    ret = kv_txn_begin(env, read_only, &txn);
+    if (ret) {
+        JS_FreeValue(ctx, obj);
+        return kv_throw_status(ctx, env, ret, 0);
+    }
+    JS_SetOpaque(obj, txn);
+    return obj;
+}
+
+static void js_kv_txn_finalizer(JSRuntime *rt, JSValue val)
+{
+    KVTxn *txn = JS_GetOpaque(val, js_kv_txn_class_id);
+
+    if (txn) {
+        kv_txn_end(txn);
+        js_free_rt(rt, txn);
+    }
+}
+
+/* Iterators */
+
+static int kv_get_option(JSContext *ctx, JSValueConst options,
+                         const char *name, JSValue *pval)
+{
+    *pval = JS_UNDEFINED;
+    if (JS_IsUndefined(options) || JS_IsNull(options))
+        return 0;
+    *pval = JS_GetPropertyStr(ctx, options, name);
+    return JS_IsException(*pval) ? -1 : 0;
+}
+
+static int kv_get_bool_option(JSContext *ctx, JSValueConst options,
+                              const char *name, BOOL *pval)
+{
+    JSValue v;
+
+    if (kv_get_option(ctx, options, name, &v))
+        return -1;
+    if (!JS_IsUndefined(v))
+        *pval = JS_ToBool(ctx, v);
+    JS_FreeValue(ctx, v);
+    return 0;
+}
+
+static int kv_get_key_option(JSContext *ctx, JSValueConst options,
+                             const char *name, uint8_t **pkey, size_t *plen)
+{
+    KVBytes b;
+    JSValue v;
+    int ret = 0;
+
+    if (kv_get_option(ctx, options, name, &v))
+        return -1;
+    if (!JS_IsUndefined(v)) {
+        ret = kv_get_bytes(ctx, &b, v, name, KV_MAX_KEY);
+        if (!ret) {
+            *pkey = js_malloc(ctx, b.len);
+            if (*pkey) {
+                memcpy(*pkey, b.data, b.len);
+                *plen = b.len;
+            } else {
+                ret = -1;
+            }
+            kv_free_bytes(ctx, &b);
+        }
+    }
+    JS_FreeValue(ctx, v);
+    return ret;
+}
+
+static int kv_get_enum_option(JSContext *ctx, JSValueConst options,
+                              const char *name, const char *a, const char *b,
+                              BOOL *pis_b)
+{
+    const char *str;
+    JSValue v;
+    int ret = 0;
+
+    if (kv_get_option(ctx, options, name, &v))
+        return -1;
+    if (!JS_IsUndefined(v)) {
+        str = JS_ToCString(ctx, v);
+        if (!str) {
+            ret = -1;
+        } else {
+            if (!strcmp(str, b)) {
+                *pis_b = TRUE;
+            } else if (strcmp(str, a)) {
+                JS_ThrowTypeError(ctx, "%s must be \"%s\" or \"%s\"", name, a, b);
+                ret = -1;
+            }
+            JS_FreeCString(ctx, str);
+        }
+    }
+    JS_FreeValue(ctx, v);
+    return ret;
+}
+
+static void kv_iter_free(JSRuntime *rt, KVIter *it)
+{
+    JS_FreeValueRT(rt, it->txn_obj);
+    js_free_rt(rt, it->start);
+    js_free_rt(rt, it->end);
+    js_free_rt(rt, it);
+}
+
+static JSValue kv_new_iter(JSContext *ctx, JSValueConst txn_obj,
+                           JSValueConst options, BOOL owns_txn)
+{
+    KVIter *it;
+    JSValue obj, v;
+    uint8_t *prefix = NULL;
+    size_t prefix_len = 0;
+    int64_t limit = -1;
+
+    it = js_mallocz(ctx, sizeof(*it));
+    if (!it)
+        return JS_EXCEPTION;
+    it->txn_obj = JS_DupValue(ctx, txn_obj);
+    it->owns_txn = owns_txn;
+    it->remaining = -1;
+    it->cursor.txn = JS_GetOpaque(txn_obj, js_kv_txn_class_id);
+    if (!JS_IsUndefined(options) && !JS_IsNull(options) && !JS_IsObject(options)) {
+        JS_ThrowTypeError(ctx, "range options must be an object");
+        goto fail;
+    }
+    if (kv_get_key_option(ctx, options, "start", &it->start, &it->start_len) ||
+        kv_get_key_option(ctx, options, "end", &it->end, &it->end_len) ||
+        kv_get_key_option(ctx, options, "prefix", &prefix, &prefix_len) ||
+        kv_get_bool_option(ctx, options, "reverse", &it->reverse) ||
+        kv_get_enum_option(ctx, options, "keys", "string", "buffer", &it->keys_as_buffer) ||
+        kv_get_enum_option(ctx, options, "values", "buffer", "string", &it->values_as_string) ||
+        kv_get_option(ctx, options, "limit", &v))
+        goto fail;
+    if (!JS_IsUndefined(v)) {
+        int ret = JS_ToInt64(ctx, &limit, v);
+        JS_FreeValue(ctx, v);
+        if (ret)
+            goto fail;
+        it->remaining = limit > 0 ? limit : 0;
+    }
+    if (prefix) {
+        /* keys starting with prefix are those in [prefix, successor) */
+        js_free(ctx, it->start);
+        js_free(ctx, it->end);
+        it->start = prefix;
+        it->start_len = prefix_len;
+        it->end = js_malloc(ctx, prefix_len);
+        if (!it->end)
+            goto fail;
+        memcpy(it->end, prefix, prefix_len);
+        it->end_len = prefix_len;
+        while (it->end_len > 0 && it->end[it->end_len - 1] == 0xff)
+            it->end_len--;
+        if (it->end_len == 0) {
+            js_free(ctx, it->end);
+            it->end = NULL;
+        } else {
+            it->end[it->end_len - 1]++;
+        }
+    }
+    obj = JS_NewObjectClass(ctx, js_kv_iter_class_id);
+    if (JS_IsException(obj))
+        goto fail;
+    JS_SetOpaque(obj, it);
+    return obj;
+ fail:
+    kv_iter_free(JS_GetRuntime(ctx), it);
+    return JS_EXCEPTION;
+}
+
+static int kv_iter_position(KVIter *it)
+{
+    KVCursor *c = &it->cursor;
+    const uint8_t *key;
+    size_t len;
+    uint8_t *val;
+    size_t vlen;
+    int ret;
+
+    if (!it->started) {
+        it->started = TRUE;
+        it->generation = c->txn->generation;
+        if (!it->reverse)
+            return it->start ? kv_cursor_seek(c, it->start, it->start_len)
+                : kv_cursor_first(c, FALSE);
+        if (!it->end)
+            return kv_cursor_first(c, TRUE);
+        ret = kv_cursor_seek(c, it->end, it->end_len);
+        if (ret)
+            return ret;
+        return c->valid ? kv_cursor_step(c, TRUE) : kv_cursor_first(c, TRUE);
+    }
+    if (it->generation != c->txn->generation) {
+        /* the transaction changed the tree: find our place again */
+        it->generation = c->txn->generation;
+        ret = kv_cursor_seek(c, it->last_key, it->last_len);
+        if (ret)
+            return ret;
+        if (it->reverse)
+            return c->valid ? kv_cursor_step(c, TRUE) : kv_cursor_first(c, TRUE);
+        if (!c->valid)
+            return KV_OK;
+        ret = kv_cursor_get(c, &key, &len, &val, &vlen);
+        if (ret)
+            return ret;
+        if (kv_cmp(key, len, it->last_key, it->last_len))
+            return KV_OK;
+    }
+    return kv_cursor_step(c, it->reverse);
+}
+
+static JSValue js_kv_iter_next(JSContext *ctx, JSValueConst this_val,
+                               int argc, JSValueConst *argv)
+{
+    KVIter *it = JS_GetOpaque2(ctx, this_val, js_kv_iter_class_id);
+    KVTxn *txn = NULL;
+    const uint8_t *key;
+    uint8_t *val;
+    size_t klen, vlen;
+    JSValue result, entry;
+    int ret;
+
+    if (!it)
+        return JS_EXCEPTION;
+    if (!it->done) {
+        txn = kv_get_txn(ctx, it->txn_obj);
+        if (!txn)
+            return JS_EXCEPTION;
+        if (it->remaining == 0) {
+            it->done = TRUE;
+        } else {
+            ret = kv_iter_position(it);
+            if (ret)
+                return kv_txn_throw(ctx, txn, ret);
+            it->done = !it->cursor.valid;
+        }
+        if (!it->done) {
+            ret = kv_cursor_get(&it->cursor, &key, &klen, &val, &vlen);
+            if (ret)
+                return kv_txn_throw(ctx, txn, ret);
+            if (it->reverse ? (it->start && kv_cmp(key, klen, it->start, it->start_len) < 0)
+                : (it->end && kv_cmp(key, klen, it->end, it->end_len) >= 0))
+                it->done = TRUE;
+        }
+        if (it->done && it->owns_txn)
+            kv_txn_end(txn);
+    }
+    result = JS_NewObject(ctx);
+    if (JS_IsException(result))
+        return result;
+    if (it->done) {
+        JS_SetPropertyStr(ctx, result, "value", JS_UNDEFINED);
+        JS_SetPropertyStr(ctx, result, "done", JS_TRUE);
+        return result;
+    }
+    memcpy(it->last_key, key, klen);
+    it->last_len = klen;
+    if (it->remaining > 0)
+        it->remaining--;
+    entry = JS_NewArray(ctx);
+    if (JS_IsException(entry))
+        goto fail;
+    JS_SetPropertyUint32(ctx, entry, 0, it->keys_as_buffer
+                         ? JS_NewArrayBufferCopy(ctx, key, klen)
+                         : JS_NewStringLen(ctx, (const char *)key, klen));
+    JS_SetPropertyUint32(ctx, entry, 1, kv_new_value(ctx, txn, val, vlen,
+                                                     it->values_as_string));
+    JS_SetPropertyStr(ctx, result, "value", entry);
+    JS_SetPropertyStr(ctx, result, "done", JS_FALSE);
+    return result;
+ fail:
+    JS_FreeValue(ctx, result);
+    return JS_EXCEPTION;
+}
+
+static JSValue js_kv_iter_iterator(JSContext *ctx, JSValueConst this_val,
+                                   int argc, JSValueConst *argv)
+{
+    return JS_DupValue(ctx, this_val);
+}
+
+static void js_kv_iter_finalizer(JSRuntime *rt, JSValue val)
+{
+    KVIter *it = JS_GetOpaque(val, js_kv_iter_class_id);
+
+    if (it)
+        kv_iter_free(rt, it);
+}
+
+static void js_kv_iter_mark(JSRuntime *rt, JSValueConst val,
+                            JS_MarkFunc *mark_func)
+{
+    KVIter *it = JS_GetOpaque(val, js_kv_iter_class_id);
+
+    if (it)
+        JS_MarkValue(rt, it->txn_obj, mark_func);
+}
+
+/* Transactions */
+
+static JSValue js_kv_txn_get(JSContext *ctx, JSValueConst this_val,
+                             int argc, JSValueConst *argv, int as_string)
+{
+    KVTxn *txn = kv_get_txn(ctx, this_val);
+
+    if (!txn)
+        return JS_EXCEPTION;
+    return kv_txn_get(ctx, txn, argv[0], as_string);
+}
+
+static JSValue js_kv_txn_put(JSContext *ctx, JSValueConst this_val,
+                             int argc, JSValueConst *argv)
+{
+    KVTxn *txn = kv_get_txn(ctx, this_val);
+
+    if (!txn)
+        return JS_EXCEPTION;
+    return kv_txn_put(ctx, txn, argv[0], argv[1]);
+}
+
+static JSValue js_kv_txn_delete(JSContext *ctx, JSValueConst this_val,
+                                int argc, JSValueConst *argv)
+{
+    KVTxn *txn = kv_get_txn(ctx, this_val);
+
+    if (!txn)
+        return JS_EXCEPTION;
+    return kv_txn_delete(ctx, txn, argv[0]);
+}
+
+static JSValue js_kv_txn_range(JSContext *ctx, JSValueConst this_val,
+                               int argc, JSValueConst *argv)
+{
+    if (!kv_get_txn(ctx, this_val))
+        return JS_EXCEPTION;
+    return kv_new_iter(ctx, this_val, argv[0], FALSE);
+}
+
+static JSValue js_kv_txn_commit(JSContext *ctx, JSValueConst this_val,
+                                int argc, JSValueConst *argv)
+{
+    KVTxn *txn = kv_get_txn(ctx, this_val);
+    int ret;
+
+    if (!txn)
+        return JS_EXCEPTION;
+    ret = kv_txn_commit(txn);
+    if (ret)
+        return kv_txn_throw(ctx, txn, ret);
+    return JS_UNDEFINED;
+}
+
+static JSValue js_kv_txn_abort(JSContext *ctx, JSValueConst this_val,
+                               int argc, JSValueConst *argv)
+{
+    KVTxn *txn = JS_GetOpaque2(ctx, this_val, js_kv_txn_class_id);
+
+    if (!txn)
+        return JS_EXCEPTION;
+    kv_txn_end(txn);
+    return JS_UNDEFINED;
+}
+
+/* Databases */
+
+static JSValue js_kv_open(JSContext *ctx, JSValueConst this_val,
+                          int argc, JSValueConst *argv)
+{
+    JSValueConst options = argc > 1 ? argv[1] : JS_UNDEFINED;
+    BOOL read_only = FALSE, sync = TRUE;
+    size_t map_size = KV_DEFAULT_MAP_SIZE;
+    const char *path;
+    KVEnv *env;
+    JSValue obj, v;
+    int ret, os_error = 0;
+
+    if (kv_get_bool_option(ctx, options, "readOnly", &read_only) ||
+        kv_get_bool_option(ctx, options, "sync", &sync) ||
+        kv_get_option(ctx, options, "mapSize", &v))
+        return JS_EXCEPTION;
+    if (!JS_IsUndefined(v)) {
+        uint64_t size;
+        ret = JS_ToIndex(ctx, &size, v);
+        JS_FreeValue(ctx, v);
+        if (ret)
+            return JS_EXCEPTION;
+        if (size > SIZE_MAX)
+            return JS_ThrowRangeError(ctx, "mapSize is too large");
+        map_size = size;
+    }
+    path = JS_ToCString(ctx, argv[0]);
+    if (!path)
+        return JS_EXCEPTION;
+    obj = JS_NewObjectClass(ctx, js_kv_db_class_id);
+    if (JS_IsException(obj)) {
+        JS_FreeCString(ctx, path);
+        return obj;
+    }
+    ret = kv_env_open(JS_GetRuntime(ctx), path, read_only, !sync, map_size,
+                      &env, &os_error);
+    if (ret) {
+        JS_FreeValue(ctx, obj);
+        if (ret == KV_EIO && os_error == EWOULDBLOCK)
+            obj = kv_throw(ctx, "%s: database is locked by another process", path);
+        else if (ret == KV_EIO)
+            obj = kv_throw(ctx, "%s: %s", path, strerror(os_error));
+        else if (ret == KV_ECORRUPT)
+            obj = kv_throw(ctx, "%s: not a qjsx:kv database or corrupted", path);
+        else
+            obj = JS_ThrowOutOfMemory(ctx);
+        JS_FreeCString(ctx, path);
+        return obj;
+    }
+    JS_FreeCString(ctx, path);
+    JS_SetOpaque(obj, env);
+    return obj;
+}
+
+static void kv_env_close(KVEnv *env)
+{
+    if (env->fd < 0)
+        return;
+    if (env->writer)
+        kv_txn_end(env->writer);
+    /* the map stays until the last view into it is gone */
+    close(env->fd);
+    env->fd = -1;
+}
+
+static void js_kv_db_finalizer(JSRuntime *rt, JSValue val)
+{
+    KVEnv *env = JS_GetOpaque(val, js_kv_db_class_id);
+
+    if (env) {
+        kv_env_close(env);
+        kv_env_release(env);
+    }
+}
+
+static JSValue js_kv_db_close(JSContext *ctx, JSValueConst this_val,
+                              int argc, JSValueConst *argv)
+{
+    KVEnv *env = JS_GetOpaque2(ctx, this_val, js_kv_db_class_id);
+
+    if (!env)
+        return JS_EXCEPTION;
+    kv_env_close(env);
+    return JS_UNDEFINED;
+}
+
+static JSValue js_kv_db_get(JSContext *ctx, JSValueConst this_val,
+                            int argc, JSValueConst *argv, int as_string)
+{
+    KVEnv *env = kv_get_env(ctx, this_val);
+    KVTxn *txn;
+    JSValue ret;
+    int status;
+
+    if (!env)
+        return JS_EXCEPTION;
+    status = kv_txn_begin(env, TRUE, &txn);
+    if (status)
+        return kv_throw_status(ctx, env, status, 0);
+    ret = kv_txn_get(ctx, txn, argv[0], as_string);
+    kv_txn_end(txn);
+    js_free(ctx, txn);
+    return ret;
+}
+
+/* db.put() and db.delete(): a write transaction of their own */
+static JSValue js_kv_db_write_op(JSContext *ctx, JSValueConst this_val,
+                                 int argc, JSValueConst *argv, int is_delete)
+{
+    KVEnv *env = kv_get_env(ctx, this_val);
+    KVTxn *txn;
+    JSValue ret;
+    int status;
+
+    if (!env)
+        return JS_EXCEPTION;
+    if (env->read_only)
+        return JS_ThrowTypeError(ctx, "database is read-only");
+    if (env->writer)
+        return JS_ThrowTypeError(ctx, "a write transaction is already active");
+    status = kv_txn_begin(env, FALSE, &txn);
+    if (status)
+        return kv_throw_status(ctx, env, status, 0);
+    if (is_delete)
+        ret = kv_txn_delete(ctx, txn, argv[0]);
+    else
+        ret = kv_txn_put(ctx, txn, argv[0], argv[1]);
+    if (!JS_IsException(ret)) {
+        status = kv_txn_commit(txn);
+        if (status) {
+            JS_FreeValue(ctx, ret);
+            ret = kv_txn_throw(ctx, txn, status);
+        }
+    }
+    kv_txn_end(txn);
+    js_free(ctx, txn);
+    return ret;
+}
+
+static JSValue js_kv_db_begin(JSContext *ctx, JSValueConst this_val,
+                              int argc, JSValueConst *argv)
+{
+    KVEnv *env = kv_get_env(ctx, this_val);
+    BOOL read_only = FALSE;
+
+    if (!env)
+        return JS_EXCEPTION;
+    if (kv_get_bool_option(ctx, argc > 0 ? argv[0] : JS_UNDEFINED,
+                           "readOnly", &read_only))
+        return JS_EXCEPTION;
+    return kv_new_txn_object(ctx, env, read_only || env->read_only);
+}
+
+/* db.read(fn) and db.write(fn) */
+static JSValue js_kv_db_run(JSContext *ctx, JSValueConst this_val,
+                            int argc, JSValueConst *argv, int read_only)
+{
+    KVEnv *env = kv_get_env(ctx, this_val);
+    JSValue txn_obj, ret;
+    KVTxn *txn;
+    int status;
+
+    if (!env)
+        return JS_EXCEPTION;
+    if (!JS_IsFunction(ctx, argv[0]))
+        return JS_ThrowTypeError(ctx, "not a function");
+    txn_obj = kv_new_txn_object(ctx, env, read_only);
+    if (JS_IsException(txn_obj))
+        return txn_obj;
+    txn = JS_GetOpaque(txn_obj, js_kv_txn_class_id);
+    ret = JS_Call(ctx, argv[0], JS_UNDEFINED, 1, (JSValueConst *)&txn_obj);
+    if (!JS_IsException(ret) && !txn->done && !txn->read_only) {
+        if (txn->failed) {
+            JS_FreeValue(ctx, ret);
+            ret = JS_ThrowTypeError(ctx, "transaction failed and must be aborted");
+        } else if ((status = kv_txn_commit(txn))) {
+            JS_FreeValue(ctx, ret);
+            ret = kv_txn_throw(ctx, txn, status);
+        }
+    }
+    kv_txn_end(txn);
+    JS_FreeValue(ctx, txn_obj);
+    return ret;
+}
+
+static JSValue js_kv_db_range(JSContext *ctx, JSValueConst this_val,
+                              int argc, JSValueConst *argv)
+{
+    KVEnv *env = kv_get_env(ctx, this_val);
+    JSValue txn_obj, ret;
+
+    if (!env)
+        return JS_EXCEPTION;
+    txn_obj = kv_new_txn_object(ctx, env, TRUE);
+    if (JS_IsException(txn_obj))
+        return txn_obj;
+    ret = kv_new_iter(ctx, txn_obj, argv[0], TRUE);
+    JS_FreeValue(ctx, txn_obj);
+    return ret;
+}
+
+static void kv_count_pages(KVTxn *txn, uint64_t pgno, int level,
+                           uint64_t counts[3])
+{
+    uint8_t *p = kv_txn_page(txn, pgno);
+    KVPage *h = (KVPage *)p;
+
+    if (!p || level >= KV_MAX_DEPTH)
+        return;
+    if (h->flags & KV_PAGE_BRANCH) {
+        counts[0]++;
+        for (int i = 0; i < h->nkeys; i++)
+            kv_count_pages(txn, kv_branch(p, i)->child, level + 1, counts);
+        return;
+    }
+    counts[1]++;
+    for (int i = 0; i < h->nkeys; i++) {
+        KVLeaf *n = kv_leaf(p, i);
+        uint8_t *op;
+        if ((n->flags & KV_NODE_BIG) && (op = kv_txn_page(txn, kv_big_pgno(n))))
+            counts[2] += ((KVPage *)op)->count;
+    }
+}
+
+static JSValue js_kv_db_stat(JSContext *ctx, JSValueConst this_val,
+                             int argc, JSValueConst *argv)
+{
+    KVEnv *env = kv_get_env(ctx, this_val);
+    uint64_t counts[3] = { 0, 0, 0 };
+    KVTxn *txn;
+    JSValue obj;
+    int status;
+
+    if (!env)
+        return JS_EXCEPTION;
+    status = kv_txn_begin(env, TRUE, &txn);
+    if (status)
+        return kv_throw_status(ctx, env, status, 0);
+    if (txn->meta.root)
+        kv_count_pages(txn, txn->meta.root, 0, counts);
+    obj = JS_NewObject(ctx);
+    if (!JS_IsException(obj)) {
+        JS_SetPropertyStr(ctx, obj, "entries", JS_NewInt64(ctx, txn->meta.entries));
+        JS_SetPropertyStr(ctx, obj, "depth", JS_NewInt32(ctx, txn->meta.depth));
+        JS_SetPropertyStr(ctx, obj, "pageSize", JS_NewInt32(ctx, env->psize));
+        JS_SetPropertyStr(ctx, obj, "branchPages", JS_NewInt64(ctx, counts[0]));
+        JS_SetPropertyStr(ctx, obj, "leafPages", JS_NewInt64(ctx, counts[1]));
+        JS_SetPropertyStr(ctx, obj, "overflowPages", JS_NewInt64(ctx, counts[2]));
+        JS_SetPropertyStr(ctx, obj, "freePages", JS_NewInt64(ctx, env->nfree));
+        JS_SetPropertyStr(ctx, obj, "lastPage", JS_NewInt64(ctx, txn->meta.npages - 1));
+        JS_SetPropertyStr(ctx, obj, "mapSize", JS_NewInt64(ctx, env->map_size));
+        JS_SetPropertyStr(ctx, obj, "txnId", JS_NewInt64(ctx, txn->meta.txnid));
+    }
+    kv_txn_end(txn);
+    js_free(ctx, txn);
+    return obj;
+}
+
+static JSClassDef js_kv_db_class = {
+    "Database",
+    .finalizer = js_kv_db_finalizer,
+};
+
+static JSClassDef js_kv_txn_class = {
+    "Transaction",
+    .finalizer = js_kv_txn_finalizer,
+};
+
+static JSClassDef js_kv_iter_class = {
+    "Iterator",
+    .finalizer = js_kv_iter_finalizer,
+    .gc_mark = js_kv_iter_mark,
+};
+
+static const JSCFunctionListEntry js_kv_db_proto_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("get", 1, js_kv_db_get, 0 ),
+    JS_CFUNC_MAGIC_DEF("getString", 1, js_kv_db_get, 1 ),
+    JS_CFUNC_MAGIC_DEF("put", 2, js_kv_db_write_op, 0 ),
+    JS_CFUNC_MAGIC_DEF("delete", 1, js_kv_db_write_op, 1 ),
+    JS_CFUNC_DEF("range", 1, js_kv_db_range ),
+    JS_CFUNC_DEF("begin", 1, js_kv_db_begin ),
+    JS_CFUNC_MAGIC_DEF("read", 1, js_kv_db_run, 1 ),
+    JS_CFUNC_MAGIC_DEF("write", 1, js_kv_db_run, 0 ),
+    JS_CFUNC_DEF("stat", 0, js_kv_db_stat ),
+    JS_CFUNC_DEF("close", 0, js_kv_db_close ),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Database", JS_PROP_CONFIGURABLE ),
+};
+
+static const JSCFunctionListEntry js_kv_txn_proto_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("get", 1, js_kv_txn_get, 0 ),
+    JS_CFUNC_MAGIC_DEF("getString", 1, js_kv_txn_get, 1 ),
+    JS_CFUNC_DEF("put", 2, js_kv_txn_put ),
+    JS_CFUNC_DEF("delete", 1, js_kv_txn_delete ),
+    JS_CFUNC_DEF("range", 1, js_kv_txn_range ),
+    JS_CFUNC_DEF("commit", 0, js_kv_txn_commit ),
+    JS_CFUNC_DEF("abort", 0, js_kv_txn_abort ),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Transaction", JS_PROP_CONFIGURABLE ),
+};
+
+static const JSCFunctionListEntry js_kv_iter_proto_funcs[] = {
+    JS_CFUNC_DEF("next", 0, js_kv_iter_next ),
+    JS_CFUNC_DEF("[Symbol.iterator]", 0, js_kv_iter_iterator ),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Database Iterator", JS_PROP_CONFIGURABLE ),
+};
+
+static const JSCFunctionListEntry js_kv_funcs[] = {
+    JS_CFUNC_DEF("open", 2, js_kv_open ),
+};
+
+static int js_kv_init(JSContext *ctx, JSModuleDef *m)
+{
+    JSRuntime *rt = JS_GetRuntime(ctx);
+    JSValue proto;
+
+    JS_NewClassID(rt, &js_kv_db_class_id);
+    JS_NewClass(rt, js_kv_db_class_id, &js_kv_db_class);
+    proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, proto, js_kv_db_proto_funcs,
+                               countof(js_kv_db_proto_funcs));
+    JS_SetClassProto(ctx, js_kv_db_class_id, proto);
+
+    JS_NewClassID(rt, &js_kv_txn_class_id);
+    JS_NewClass(rt, js_kv_txn_class_id, &js_kv_txn_class);
+    proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, proto, js_kv_txn_proto_funcs,
+                               countof(js_kv_txn_proto_funcs));
+    JS_SetClassProto(ctx, js_kv_txn_class_id, proto);
+
+    JS_NewClassID(rt, &js_kv_iter_class_id);
+    JS_NewClass(rt, js_kv_iter_class_id, &js_kv_iter_class);
+    proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, proto, js_kv_iter_proto_funcs,
+                               countof(js_kv_iter_proto_funcs));
+    JS_SetClassProto(ctx, js_kv_iter_class_id, proto);
+
+    return JS_SetModuleExportList(ctx, m, js_kv_funcs, countof(js_kv_funcs));
+}
+
+JSModuleDef *js_init_module_qjsx_kv(JSContext *ctx, const char *module_name)
+{
+    JSModuleDef *m;
+    m = JS_NewCModule(ctx, module_name, js_kv_init);
+    if (!m)
+        return NULL;
+    JS_AddModuleExportList(ctx, m, js_kv_funcs, countof(js_kv_funcs));
+    return m;
+}
@@ -0,0 +1,1205 @@
+/*
+ * QJSX qjsx:loop module
+ *
+ * The scheduling queues of Node.js, run by the event loop of quickjs-libc
+ * (see qjsx-loop.h):
+ *
+ *   import * as loop from "qjsx:loop";
+ *   loop.queueMicrotask(fn)             -> a job of the promise job queue
+ *   loop.nextTick(fn, ...args)          -> runs once the current callback
+ *                                          returns, before promise jobs
+ *   id = loop.setImmediate(fn, ...args) -> runs in the check phase, after
+ *                                          polling for timers and I/O
+ *   loop.clearImmediate(id)
+ *   loop.postTask(fn, priority)         -> promise of fn's result; fn runs
+ *                                          in the task phase, by priority
+ *                                          (0 user-blocking, 1 user-visible,
+ *                                          2 background)
+ *   loop.postContinuation(priority)     -> promise resolved ahead of the
+ *                                          tasks of priority
+ *   loop.currentPriority()              -> priority of the running task, -1
+ *   loop.runJobs(budget)                -> runs up to budget promise jobs
+ *                                          (all by default), returns how many
+ *   loop.stats()                        -> { poll, check, tasks, ticks,
+ *                                          jobs }: the callbacks run by each
+ *                                          phase so far
+ *   loop.utilization()                  -> { idle, active }: ms waiting in
+ *                                          select() and running JS so far
+ *   h = loop.monitorDelay(resolution)   -> histogram of the loop's delay
+ *                                          (node:perf_hooks), h.enable()
+ *   loop.monitorLongTasks(ms)           -> log callbacks running longer, with
+ *                                          their stack (QJSX_LONG_TASK_MS)
+ *
+ * qjsx-node installs them as globals and as process.nextTick. The order is
+ * Node's: after each callback of the loop (a timer, an I/O handler, an
+ * immediate) the nextTick queue is drained, then the promise jobs, then the
+ * ticks those jobs queued, and so on until both are empty. The immediates
+ * queued when a check phase starts run in it, each followed by its ticks and
+ * jobs; those queued by them wait for the next turn, after timers and I/O.
+ *
+ * Each call of the hook runs one phase of Node's loop: the checkpoint of
+ * the promise jobs js_std_await() is running, the check phase, the task
+ * phase of postTask() (node:timers/promises scheduler), or a poll of the
+ * os module. The timers and I/O phases are that one poll, which runs
+ * an expired timer or else one ready handler; there is no close phase, as
+ * qjsx closes handles synchronously. Promise jobs are run in batches by
+ * qjsx_loop_run_jobs() rather than by one poll per job in js_std_await().
+ *
+ * Ticks and immediates are ring buffers of (function, arguments) that grow
+ * by doubling, so queueing a callback without arguments allocates nothing,
+ * where a 0 ms os.setTimeout() allocates a timer and goes through the timer
+ * list. While immediates are pending the poll must not block: a pipe that
+ * is always readable is then registered as the last read handler, so
+ * select() returns at once and ready I/O handlers still run first.
+ *
+ * The task phase runs the highest priority first, for LOOP_TASK_SLICE_MS
+ * so that I/O handlers run between slices of a long run of tasks. A task
+ * of a lower priority that has waited more than loop_starvation_ms goes
+ * ahead of higher ones, every other task at most.
+ *
+ * The loop measures itself: the time blocked in select() (js_os_poll()
+ * calls qjsx_loop_select()) is idle, the rest active. The delay histograms
+ * are fed by a timer that needs no os timer: it is checked where those of
+ * the os module run, and after select() it records the runs that fell
+ * while the loop was idle. Long tasks are timed from the start of each
+ * callback to its return (with its ticks and jobs).
+ *
+ * The check phase starts by calling the PerformanceObserver callbacks
+ * (qjsx-perf.c) with the entries added since the last turn.
+ *
+ * The queues belong to the context that imported qjsx:loop first in a thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "quickjs/cutils.h"
+#include "quickjs/quickjs.h"
+#include "quickjs/quickjs-libc.h"
+#include "qjsx-loop.h"
+#include "qjsx-perf.h"
+
+typedef struct {
+    JSValue func;           /* undefined once cleared */
+    JSValue *argv;          /* NULL without arguments */
+    int argc;
+    int64_t queued;         /* ms, for scheduler tasks */
+} LoopTask;
+
+typedef struct {
+    LoopTask *tasks;
+    uint32_t head, count;
+    uint32_t size;          /* 0 or a power of 2 */
+} LoopQueue;
+
+/* scheduler.postTask() priorities; each has a queue of continuations
+   (scheduler.yield()) that goes before its queue of tasks */
+enum {
+    LOOP_USER_BLOCKING,
+    LOOP_USER_VISIBLE,
+    LOOP_BACKGROUND,
+    LOOP_PRIORITIES,
+};
+
+/* how long the oldest task of a priority may wait before it goes ahead of
+   higher priorities (every other task at most, see loop_pick_task()) */
+static const int64_t loop_starvation_ms[LOOP_PRIORITIES] = { 0, 100, 1000 };
+
+/* the task phase runs tasks for up to this long, then lets timers and I/O in */
+#define LOOP_TASK_SLICE_MS  5
+
+/* HDR histogram of nanoseconds: values below 2 * HIST_SUB exactly, larger
+   ones in HIST_SUB buckets per power of 2 (1.6% precision), up to 2^47 ns
+   (39 hours) */
+#define HIST_SUB_BITS   6
+#define HIST_SUB        (1 << HIST_SUB_BITS)
+#define HIST_MAX_SHIFT  (47 - HIST_SUB_BITS)
+#define HIST_BUCKETS    (2 * HIST_SUB + HIST_MAX_SHIFT * HIST_SUB)
+
+/* a monitorDelay() histogram, fed while enabled by a timer of the loop */
+typedef struct LoopHistogram {
+    struct LoopHistogram *next;     /* in the loop's list */
+    struct QJSXLoop *lp;            /* NULL once the loop is gone */
+    int enabled;
+    int64_t resolution;             /* ns between runs of the timer */
+    int64_t last, due;              /* ns, when it last ran and is due */
+    uint64_t count, exceeds;
+    int64_t min, max;
+    double sum, sum2;
+    uint64_t counts[HIST_BUCKETS];
+} LoopHistogram;
+
+typedef struct QJSXLoop {
+    JSContext *ctx;
+    LoopQueue ticks;
+    LoopQueue immediates;
+    LoopQueue tasks[LOOP_PRIORITIES * 2];   /* continuations, tasks */
+    int priority;               /* of the task running, or -1 */
+    int starved;                /* the last task ran because it was starved */
+    int tasks_due;              /* a task phase follows the last poll */
+    uint32_t first_immediate;   /* id of immediates.tasks[head] */
+    int check_due;              /* a check phase follows the last poll */
+    struct {
+        uint64_t poll;          /* polls for a timer or I/O callback */
+        uint64_t check;         /* immediates run */
+        uint64_t tasks;         /* scheduler tasks and continuations run */
+        uint64_t ticks, jobs;
+    } stats;
+    struct {
+        int64_t start;          /* ns, when the loop was created */
+        int64_t idle;           /* ns blocked in select() */
+        LoopHistogram *histograms;  /* of monitorDelay() */
+        int64_t long_task;      /* ns a callback may run, 0 if unchecked */
+        int64_t busy_since;     /* ns, start of the running callback, or 0 */
+        JSValue stack;          /* sampled while it ran too long */
+    } mon;
+    int wake[2];                /* readable pipe, -1 if unavailable */
+    int wake_armed;
+} QJSXLoop;
+
+static JSClassID js_loop_class_id, js_loop_histogram_class_id;
+
+/* the queues run by qjsx_loop_poll() in this thread */
+static __thread QJSXLoop *loop_current;
+
+/* the embedder's interrupt handler, see qjsx_loop_set_interrupt_handler();
+   monitor is the loop whose long-task handler is installed in its place */
+static __thread struct {
+    JSRuntime *rt;
+    JSInterruptHandler *cb;
+    void *opaque;
+    QJSXLoop *monitor;
+} loop_embedder_interrupt;
+
+static LoopTask *loop_at(LoopQueue *q, uint32_t i)
+{
+    return &q->tasks[(q->head + i) & (q->size - 1)];
+}
+
+static LoopTask *loop_push(JSContext *ctx, LoopQueue *q, JSValueConst func,
+                           int argc, JSValueConst *argv)
+{
+    LoopTask *t;
+    int i;
+
+    if (q->count == q->size) {
+        uint32_t size = q->size ? q->size * 2 : 16;
+        LoopTask *tasks = js_malloc(ctx, size * sizeof(*tasks));
+        if (!tasks)
+            return NULL;
+        if (q->size) {
+            /* unwrap the ring at the start of the new one */
+            memcpy(tasks, q->tasks + q->head, (q->size - q->head) * sizeof(*tasks));
+            memcpy(tasks + q->size - q->head, q->tasks, q->head * sizeof(*tasks));
+        }
+        js_free(ctx, q->tasks);
+        q->tasks = tasks;
+        q->head = 0;
+        q->size = size;
+    }
+    t = loop_at(q, q->count);
+    t->argv = NULL;
+    if (argc > 0) {
+        t->argv = js_malloc(ctx, argc * sizeof(*t->argv));
+        if (!t->argv)
+            return NULL;
+        for (i = 0; i < argc; i++)
+            t->argv[i] = JS_DupValue(ctx, argv[i]);
+    }
+    t->func = JS_DupValue(ctx, func);
+    t->argc = argc;
+    q->count++;
+    return t;
+}
+
+static void loop_shift(LoopQueue *q, LoopTask *t)
+{
+    *t = q->tasks[q->head];
+    q->head = (q->head + 1) & (q->size - 1);
+    q->count--;
+}
+
+static void loop_task_free(JSRuntime *rt, LoopTask *t)
+{
+    int i;
+
+    JS_FreeValueRT(rt, t->func);
+    for (i = 0; i < t->argc; i++)
+        JS_FreeValueRT(rt, t->argv[i]);
+    js_free_rt(rt, t->argv);
+    t->func = JS_UNDEFINED;
+    t->argv = NULL;
+    t->argc = 0;
+}
+
+/* call and free a task; exceptions are reported as those of the
+   os.setTimeout() callbacks */
+static void loop_run(JSContext *ctx, LoopTask *t)
+{
+    JSValue ret;
+
+    if (!JS_IsUndefined(t->func)) {
+        ret = JS_Call(ctx, t->func, JS_UNDEFINED, t->argc, (JSValueConst *)t->argv);
+        if (JS_IsException(ret))
+            js_std_dump_error(ctx);
+        JS_FreeValue(ctx, ret);
+    }
+    loop_task_free(JS_GetRuntime(ctx), t);
+}
+
+/* run ticks until the queue is empty, including those queued meanwhile */
+static void loop_run_ticks(QJSXLoop *lp)
+{
+    LoopTask t;
+
+    while (lp->ticks.count > 0) {
+        loop_shift(&lp->ticks, &t);
+        loop_run(lp->ctx, &t);
+        lp->stats.ticks++;
+    }
+}
+
+int qjsx_loop_run_jobs(JSRuntime *rt, int budget)
+{
+    JSContext *ctx1;
+    int n, err;
+
+    for (n = 0; budget <= 0 || n < budget; n++) {
+        err = JS_ExecutePendingJob(rt, &ctx1);
+        if (err == 0)
+            break;
+        if (err < 0)
+            js_std_dump_error(ctx1);
+    }
+    if (loop_current && JS_GetRuntime(loop_current->ctx) == rt)
+        loop_current->stats.jobs += n;
+    return n;
+}
+
+/* after a callback of the loop: its ticks, then the promise jobs, until
+   both queues are empty. Returns whether anything ran. */
+static int loop_checkpoint(QJSXLoop *lp)
+{
+    JSRuntime *rt = JS_GetRuntime(lp->ctx);
+    int ran = 0;
+
+    do {
+        ran |= lp->ticks.count > 0;
+        loop_run_ticks(lp);
+        ran |= qjsx_loop_run_jobs(rt, 0) > 0;
+    } while (lp->ticks.count > 0);
+    return ran;
+}
+
+static JSValue js_loop_wake(JSContext *ctx, JSValueConst this_val,
+                            int argc, JSValueConst *argv)
+{
+    return JS_UNDEFINED;    /* the check phase runs after the poll */
+}
+
+/* register the wake pipe as the last read handler (arm), or remove it */
+static void loop_set_wake(QJSXLoop *lp, int arm, JSCFunctionMagic *set_read_handler)
+{
+    JSContext *ctx = lp->ctx;
+    JSValue args[2];
+
+    args[0] = JS_NewInt32(ctx, lp->wake[0]);
+    if (lp->wake_armed) {
+        /* removed first, so that it goes after the handlers added since */
+        args[1] = JS_NULL;
+        JS_FreeValue(ctx, set_read_handler(ctx, JS_UNDEFINED, 2, args, 0));
+    }
+    if (arm) {
+        args[1] = JS_NewCFunction(ctx, js_loop_wake, "wake", 0);
+        JS_FreeValue(ctx, set_read_handler(ctx, JS_UNDEFINED, 2, args, 0));
+        JS_FreeValue(ctx, args[1]);
+    }
+    lp->wake_armed = arm;
+}
+
+static int64_t loop_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int64_t loop_now_ms(void)
+{
+    return loop_now_ns() / 1000000;
+}
+
+static int hist_index(int64_t v)
+{
+    int shift;
+
+    if (v < 2 * HIST_SUB)
+        return v;
+    shift = 63 - clz64(v) - HIST_SUB_BITS;
+    if (shift > HIST_MAX_SHIFT)
+        return -1;
+    return 2 * HIST_SUB + (shift - 1) * HIST_SUB + (int)(v >> shift) - HIST_SUB;
+}
+
+/* the largest value counted in bucket i */
+static int64_t hist_value(int i)
+{
+    int shift, sub;
+
+    if (i < 2 * HIST_SUB)
+        return i;
+    shift = (i - 2 * HIST_SUB) / HIST_SUB + 1;
+    sub = (i - 2 * HIST_SUB) % HIST_SUB + HIST_SUB;
+    return ((int64_t)(sub + 1) << shift) - 1;
+}
+
+/* record n samples of v ns */
+static void hist_record(LoopHistogram *h, int64_t v, uint64_t n)
+{
+    int i = hist_index(v);
+
+    if (i < 0) {
+        h->exceeds += n;
+        return;
+    }
+    h->counts[i] += n;
+    if (h->count == 0 || v < h->min)
+        h->min = v;
+    if (v > h->max)
+        h->max = v;
+    h->count += n;
+    h->sum += (double)v * n;
+    h->sum2 += (double)v * v * n;
+}
+
+static void hist_reset(LoopHistogram *h)
+{
+    memset(h->counts, 0, sizeof(h->counts));
+    h->count = h->exceeds = 0;
+    h->min = h->max = 0;
+    h->sum = h->sum2 = 0;
+}
+
+/* the timer of the delay histograms, checked when those of the os module
+   are and when select() returns. It runs late by as long as the callbacks
+   before it ran, and on time while the loop waits in select() (idle): each
+   run records the time since the last one, as in Node.js. */
+static void loop_delay_sample(QJSXLoop *lp, int64_t now, int idle)
+{
+    LoopHistogram *h;
+    int64_t n;
+
+    for (h = lp->mon.histograms; h; h = h->next) {
+        if (!h->enabled || now < h->due)
+            continue;
+        if (idle) {
+            n = (now - h->due) / h->resolution + 1;
+            hist_record(h, h->resolution, n);
+            h->last = h->due + (n - 1) * h->resolution;
+        } else {
+            hist_record(h, now - h->last, 1);
+            h->last = now;
+        }
+        h->due = h->last + h->resolution;
+    }
+}
+
+/* the stack of the running JS code, as that of an Error */
+static JSValue loop_stack(JSContext *ctx)
+{
+    JSValue err, stack;
+
+    JS_ThrowInternalError(ctx, "long task");
+    err = JS_GetException(ctx);
+    stack = JS_GetPropertyStr(ctx, err, "stack");
+    JS_FreeValue(ctx, err);
+    if (JS_IsException(stack)) {
+        JS_FreeValue(ctx, JS_GetException(ctx));
+        return JS_UNDEFINED;
+    }
+    return stack;
+}
+
+/* called every so many bytecodes: sample the stack of a callback once it
+   runs too long, as it is gone by the time it returns */
+static int loop_interrupt(JSRuntime *rt, void *opaque)
+{
+    QJSXLoop *lp = opaque;
+
+    if (lp->mon.busy_since && JS_IsUndefined(lp->mon.stack) &&
+        loop_now_ns() - lp->mon.busy_since >= lp->mon.long_task)
+        lp->mon.stack = loop_stack(lp->ctx);
+    if (loop_embedder_interrupt.rt == rt && loop_embedder_interrupt.cb)
+        return loop_embedder_interrupt.cb(rt, loop_embedder_interrupt.opaque);
+    return 0;
+}
+
+/* install the long-task handler of lp, or put the embedder's one back */
+static void loop_set_interrupt(JSRuntime *rt, QJSXLoop *lp)
+{
+    loop_embedder_interrupt.monitor = lp;
+    if (lp)
+        JS_SetInterruptHandler(rt, loop_interrupt, lp);
+    else if (loop_embedder_interrupt.rt == rt)
+        JS_SetInterruptHandler(rt, loop_embedder_interrupt.cb,
+                               loop_embedder_interrupt.opaque);
+    else
+        JS_SetInterruptHandler(rt, NULL, NULL);
+}
+
+void qjsx_loop_set_interrupt_handler(JSRuntime *rt, JSInterruptHandler *cb,
+                                     void *opaque)
+{
+    QJSXLoop *lp = loop_embedder_interrupt.monitor;
+
+    if (loop_embedder_interrupt.rt != rt)
+        lp = NULL;
+    loop_embedder_interrupt.rt = rt;
+    loop_embedder_interrupt.cb = cb;
+    loop_embedder_interrupt.opaque = opaque;
+    loop_set_interrupt(rt, lp);
+}
+
+/* a callback of the loop starts (busy) or has returned (idle) */
+static void loop_busy(QJSXLoop *lp)
+{
+    if (lp->mon.long_task)
+        lp->mon.busy_since = loop_now_ns();
+}
+
+static void loop_idle(QJSXLoop *lp)
+{
+    const char *stack = NULL;
+    int64_t ns;
+
+    if (!lp->mon.busy_since)
+        return;
+    ns = loop_now_ns() - lp->mon.busy_since;
+    lp->mon.busy_since = 0;
+    if (ns >= lp->mon.long_task) {
+        if (!JS_IsUndefined(lp->mon.stack))
+            stack = JS_ToCString(lp->ctx, lp->mon.stack);
+        fprintf(stderr, "(qjsx) Long task: a callback ran for %.1f ms (threshold %.1f ms)\n",
+                ns / 1e6, lp->mon.long_task / 1e6);
+        if (stack)
+            fprintf(stderr, "%s%s", stack, *stack && stack[strlen(stack) - 1] != '\n' ? "\n" : "");
+        JS_FreeCString(lp->ctx, stack);
+    }
+    JS_FreeValue(lp->ctx, lp->mon.stack);
+    lp->mon.stack = JS_UNDEFINED;
+}
+
+/* report callbacks running longer than ns, none if 0 */
+static void loop_monitor_long_tasks(QJSXLoop *lp, int64_t ns)
+{
+    JSRuntime *rt = JS_GetRuntime(lp->ctx);
+
+    /* the running callback is measured against the old threshold, then
+       the rest of it against the new one */
+    loop_idle(lp);
+    if (ns > 0)
+        loop_set_interrupt(rt, lp);
+    else if (loop_embedder_interrupt.monitor == lp)
+        loop_set_interrupt(rt, NULL);
+    lp->mon.long_task = ns;
+    loop_busy(lp);
+}
+
+int qjsx_loop_select(int nfds, fd_set *readfds, fd_set *writefds,
+                     fd_set *exceptfds, struct timeval *timeout)
+{
+    QJSXLoop *lp = loop_current;
+    int64_t start, now;
+    int ret;
+
+    if (!lp)
+        return select(nfds, readfds, writefds, exceptfds, timeout);
+    loop_idle(lp);
+    start = loop_now_ns();
+    loop_delay_sample(lp, start, FALSE);
+    ret = select(nfds, readfds, writefds, exceptfds, timeout);
+    now = loop_now_ns();
+    lp->mon.idle += now - start;
+    loop_delay_sample(lp, now, TRUE);
+    loop_busy(lp);
+    return ret;
+}
+
+static int loop_tasks_pending(QJSXLoop *lp)
+{
+    int i;
+
+    for (i = 0; i < LOOP_PRIORITIES * 2; i++) {
+        if (lp->tasks[i].count > 0)
+            return 1;
+    }
+    return 0;
+}
+
+/* the queue of the next task: the first non-empty one, unless a task or
+   continuation of a lower priority has waited too long and the last task
+   did not run for that reason already, so that starved ones take at most
+   every other turn */
+static LoopQueue *loop_pick_task(QJSXLoop *lp, int64_t now)
+{
+    LoopQueue *q;
+    int p;
+
+    if (!lp->starved) {
+        for (p = LOOP_USER_VISIBLE * 2; p < LOOP_PRIORITIES * 2; p++) {
+            q = &lp->tasks[p];
+            if (q->count > 0 && now - loop_at(q, 0)->queued > loop_starvation_ms[p / 2]) {
+                lp->starved = 1;
+                lp->priority = p / 2;
+                return q;
+            }
+        }
+    }
+    lp->starved = 0;
+    for (p = 0; p < LOOP_PRIORITIES * 2; p++) {
+        if (lp->tasks[p].count > 0) {
+            lp->priority = p / 2;
+            return &lp->tasks[p];
+        }
+    }
+    return NULL;
+}
+
+/* call a task and settle its promise (argv: resolve, reject) with the
+   result; a continuation has no function and resolves to undefined */
+static void loop_run_task(JSContext *ctx, LoopTask *t)
+{
+    JSValue ret = JS_UNDEFINED, res;
+    int failed = 0;
+
+    if (JS_IsFunction(ctx, t->func)) {
+        ret = JS_Call(ctx, t->func, JS_UNDEFINED, 0, NULL);
+        if (JS_IsException(ret)) {
+            ret = JS_GetException(ctx);
+            failed = 1;
+        }
+    }
+    res = JS_Call(ctx, t->argv[failed], JS_UNDEFINED, 1, (JSValueConst *)&ret);
+    JS_FreeValue(ctx, res);
+    JS_FreeValue(ctx, ret);
+    loop_task_free(JS_GetRuntime(ctx), t);
+}
+
+/* task phase: tasks by priority, each with its checkpoint, for up to
+   LOOP_TASK_SLICE_MS */
+static void loop_run_tasks(QJSXLoop *lp)
+{
+    int64_t start = loop_now_ms(), now = start;
+    LoopQueue *q;
+    LoopTask t;
+
+    while (now - start < LOOP_TASK_SLICE_MS && (q = loop_pick_task(lp, now))) {
+        loop_shift(q, &t);
+        loop_busy(lp);
+        loop_run_task(lp->ctx, &t);
+        lp->stats.tasks++;
+        loop_checkpoint(lp);
+        loop_idle(lp);
+        now = loop_now_ms();
+    }
+    lp->priority = -1;
+}
+
+static int loop_phase(QJSXLoop *lp, JSContext *ctx, int (*poll)(JSContext *ctx),
+                      JSCFunctionMagic *set_read_handler)
+{
+    LoopTask t;
+    uint32_t n;
+    int ret, ran, pending;
+
+    /* One phase per call, so that js_std_await() sees its promise settle
+       before the poll blocks. First finish the promise jobs being run
+       (js_std_await() polls between them) and what they queued. */
+    loop_busy(lp);
+    ran = qjsx_loop_run_jobs(JS_GetRuntime(ctx), 0) > 0;
+    ran |= loop_checkpoint(lp);
+    loop_idle(lp);
+    if (ran)
+        return 0;
+
+    /* check phase: the entries of the PerformanceObservers, then the
+       immediates queued so far, each with its checkpoint */
+    if (lp->check_due) {
+        lp->check_due = FALSE;
+        if (qjsx_perf_pending()) {
+            loop_busy(lp);
+            ran = qjsx_perf_deliver(ctx);
+            loop_checkpoint(lp);
+            loop_idle(lp);
+        }
+        if (lp->immediates.count > 0) {
+            for (n = lp->immediates.count; n > 0 && lp->immediates.count > 0; n--) {
+                lp->first_immediate++;
+                loop_shift(&lp->immediates, &t);
+                if (!JS_IsUndefined(t.func))
+                    lp->stats.check++;
+                loop_busy(lp);
+                loop_run(lp->ctx, &t);
+                loop_checkpoint(lp);
+                loop_idle(lp);
+            }
+            return 0;
+        }
+        if (ran)
+            return 0;
+    }
+
+    /* task phase: scheduler.postTask() tasks */
+    if (lp->tasks_due) {
+        lp->tasks_due = FALSE;
+        if (loop_tasks_pending(lp)) {
+            loop_run_tasks(lp);
+            return 0;
+        }
+    }
+
+    /* timers and I/O: one callback of the os module */
+    pending = lp->immediates.count > 0 || loop_tasks_pending(lp) || qjsx_perf_pending();
+    if (pending && lp->wake[0] < 0) {
+        /* without the pipe, timers and I/O wait for the queues */
+        lp->check_due = lp->tasks_due = TRUE;
+        return 0;
+    }
+    if (pending || lp->wake_armed)
+        loop_set_wake(lp, pending, set_read_handler);
+    if (lp->mon.histograms)
+        loop_delay_sample(lp, loop_now_ns(), FALSE);
+    loop_busy(lp);
+    ret = poll(ctx);
+    lp->stats.poll++;
+    lp->check_due = lp->tasks_due = TRUE;
+    loop_checkpoint(lp);
+    loop_idle(lp);
+    if (ret != 0 && !pending && lp->immediates.count == 0 && !loop_tasks_pending(lp) &&
+        !qjsx_perf_pending())
+        return ret;
+    return 0;
+}
+
+int qjsx_loop_poll(JSContext *ctx, int (*poll)(JSContext *ctx),
+                   JSCFunctionMagic *set_read_handler)
+{
+    QJSXLoop *lp = loop_current;
+    int ret;
+
+    if (!lp) {
+        /* without qjsx:loop observers are called before each poll */
+        if (qjsx_perf_deliver(ctx))
+            return 0;
+        return poll(ctx);
+    }
+    /* the JS code run since the last call was a callback too */
+    loop_idle(lp);
+    ret = loop_phase(lp, ctx, poll, set_read_handler);
+    loop_busy(lp);
+    return ret;
+}
+
+static JSValue loop_throw_not_function(JSContext *ctx)
+{
+    JSValue err;
+
+    JS_ThrowTypeError(ctx, "The \"callback\" argument must be of type function");
+    err = JS_GetException(ctx);
+    JS_DefinePropertyValueStr(ctx, err, "code", JS_NewString(ctx, "ERR_INVALID_ARG_TYPE"), JS_PROP_C_W_E);
+    return JS_Throw(ctx, err);
+}
+
+static JSValue js_loop_microtask(JSContext *ctx, int argc, JSValueConst *argv)
+{
+    return JS_Call(ctx, argv[0], JS_UNDEFINED, 0, NULL);
+}
+
+static JSValue js_loop_queue_microtask(JSContext *ctx, JSValueConst this_val,
+                                       int argc, JSValueConst *argv)
+{
+    if (!JS_IsFunction(ctx, argv[0]))
+        return loop_throw_not_function(ctx);
+    if (JS_EnqueueJob(ctx, js_loop_microtask, 1, argv) < 0)
+        return JS_EXCEPTION;
+    return JS_UNDEFINED;
+}
+
+/* nextTick(fn, ...args); func_data[0] holds the queues */
+static JSValue js_loop_next_tick(JSContext *ctx, JSValueConst this_val,
+                                 int argc, JSValueConst *argv, int magic, JSValue *func_data)
+{
+    QJSXLoop *lp = JS_GetOpaque(func_data[0], js_loop_class_id);
+
+    if (!JS_IsFunction(ctx, argv[0]))
+        return loop_throw_not_function(ctx);
+    if (!loop_push(ctx, &lp->ticks, argv[0], argc - 1, argv + 1))
+        return JS_EXCEPTION;
+    return JS_UNDEFINED;
+}
+
+static JSValue js_loop_set_immediate(JSContext *ctx, JSValueConst this_val,
+                                     int argc, JSValueConst *argv, int magic, JSValue *func_data)
+{
+    QJSXLoop *lp = JS_GetOpaque(func_data[0], js_loop_class_id);
+    uint32_t id = lp->first_immediate + lp->immediates.count;
+
+    if (!JS_IsFunction(ctx, argv[0]))
+        return loop_throw_not_function(ctx);
+    if (!loop_push(ctx, &lp->immediates, argv[0], argc - 1, argv + 1))
+        return JS_EXCEPTION;
+    return JS_NewInt64(ctx, id);
+}
+
+static JSValue js_loop_clear_immediate(JSContext *ctx, JSValueConst this_val,
+                                       int argc, JSValueConst *argv, int magic, JSValue *func_data)
+{
+    QJSXLoop *lp = JS_GetOpaque(func_data[0], js_loop_class_id);
+    int64_t id;
+    uint32_t i;
+
+    /* like Node.js, ignore anything that is not a pending immediate */
+    if (!JS_IsNumber(argv[0]) || JS_ToInt64(ctx, &id, argv[0]))
+        return JS_UNDEFINED;
+    i = (uint32_t)id - lp->first_immediate;
+    if (id > 0 && id <= UINT32_MAX && i < lp->immediates.count)
+        loop_task_free(JS_GetRuntime(ctx), loop_at(&lp->immediates, i));
+    return JS_UNDEFINED;
+}
+
+/* postTask(fn, priority) -> promise of fn's result, postContinuation(priority)
+   -> promise resolved once the continuations of priority come up (magic) */
+static JSValue js_loop_post_task(JSContext *ctx, JSValueConst this_val,
+                                 int argc, JSValueConst *argv, int magic, JSValue *func_data)
+{
+    QJSXLoop *lp = JS_GetOpaque(func_data[0], js_loop_class_id);
+    JSValueConst func = magic ? JS_NULL : argv[0];
+    JSValue promise, funcs[2];
+    LoopTask *t;
+    int priority;
+
+    if (!magic && !JS_IsFunction(ctx, func))
+        return loop_throw_not_function(ctx);
+    if (JS_ToInt32(ctx, &priority, argv[magic ? 0 : 1]))
+        return JS_EXCEPTION;
+    if (priority < 0 || priority >= LOOP_PRIORITIES)
+        return JS_ThrowRangeError(ctx, "invalid priority %d", priority);
+    promise = JS_NewPromiseCapability(ctx, funcs);
+    if (JS_IsException(promise))
+        return promise;
+    t = loop_push(ctx, &lp->tasks[priority * 2 + !magic], func, 2, (JSValueConst *)funcs);
+    JS_FreeValue(ctx, funcs[0]);
+    JS_FreeValue(ctx, funcs[1]);
+    if (!t) {
+        JS_FreeValue(ctx, promise);
+        return JS_EXCEPTION;
+    }
+    t->queued = loop_now_ms();
+    return promise;
+}
+
+/* currentPriority(): the priority of the task running, or -1 */
+static JSValue js_loop_current_priority(JSContext *ctx, JSValueConst this_val,
+                                        int argc, JSValueConst *argv, int magic, JSValue *func_data)
+{
+    QJSXLoop *lp = JS_GetOpaque(func_data[0], js_loop_class_id);
+
+    return JS_NewInt32(ctx, lp->priority);
+}
+
+/* runJobs(budget): run up to budget promise jobs (all by default) */
+static JSValue js_loop_run_jobs(JSContext *ctx, JSValueConst this_val,
+                                int argc, JSValueConst *argv)
+{
+    int budget = 0;
+
+    if (!JS_IsUndefined(argv[0]) && JS_ToInt32(ctx, &budget, argv[0]))
+        return JS_EXCEPTION;
+    return JS_NewInt32(ctx, qjsx_loop_run_jobs(JS_GetRuntime(ctx), budget));
+}
+
+static JSValue js_loop_stats(JSContext *ctx, JSValueConst this_val,
+                             int argc, JSValueConst *argv, int magic, JSValue *func_data)
+{
+    QJSXLoop *lp = JS_GetOpaque(func_data[0], js_loop_class_id);
+    JSValue obj = JS_NewObject(ctx);
+
+    if (JS_IsException(obj))
+        return obj;
+    JS_DefinePropertyValueStr(ctx, obj, "poll", JS_NewInt64(ctx, lp->stats.poll), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "check", JS_NewInt64(ctx, lp->stats.check), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "tasks", JS_NewInt64(ctx, lp->stats.tasks), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "ticks", JS_NewInt64(ctx, lp->stats.ticks), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "jobs", JS_NewInt64(ctx, lp->stats.jobs), JS_PROP_C_W_E);
+    return obj;
+}
+
+/* utilization() -> { idle, active }: ms waiting in select() and running
+   JS since the loop was created */
+static JSValue js_loop_utilization(JSContext *ctx, JSValueConst this_val,
+                                   int argc, JSValueConst *argv, int magic, JSValue *func_data)
+{
+    QJSXLoop *lp = JS_GetOpaque(func_data[0], js_loop_class_id);
+    int64_t total = loop_now_ns() - lp->mon.start;
+    JSValue obj = JS_NewObject(ctx);
+
+    if (JS_IsException(obj))
+        return obj;
+    JS_DefinePropertyValueStr(ctx, obj, "idle", JS_NewFloat64(ctx, lp->mon.idle / 1e6), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "active", JS_NewFloat64(ctx, (total - lp->mon.idle) / 1e6), JS_PROP_C_W_E);
+    return obj;
+}
+
+/* monitorLongTasks(ms): report the callbacks that run longer on stderr,
+   with the stack they were at when they passed ms; 0 turns it off */
+static JSValue js_loop_monitor_long_tasks(JSContext *ctx, JSValueConst this_val,
+                                          int argc, JSValueConst *argv, int magic, JSValue *func_data)
+{
+    QJSXLoop *lp = JS_GetOpaque(func_data[0], js_loop_class_id);
+    double ms;
+
+    if (JS_ToFloat64(ctx, &ms, argv[0]))
+        return JS_EXCEPTION;
+    if (!(ms >= 0) || ms > 1e9)
+        return JS_ThrowRangeError(ctx, "invalid threshold %g", ms);
+    loop_monitor_long_tasks(lp, (int64_t)(ms * 1e6));
+    return JS_UNDEFINED;
+}
+
+/* monitorDelay(resolution) -> a disabled histogram of the loop's delays
+   sampled every resolution ms */
+static JSValue js_loop_monitor_delay(JSContext *ctx, JSValueConst this_val,
+                                     int argc, JSValueConst *argv, int magic, JSValue *func_data)
+{
+    QJSXLoop *lp = JS_GetOpaque(func_data[0], js_loop_class_id);
+    LoopHistogram *h;
+    JSValue obj;
+    double ms;
+
+    if (JS_ToFloat64(ctx, &ms, argv[0]))
+        return JS_EXCEPTION;
+    if (!(ms >= 1) || ms > 1e9)
+        return JS_ThrowRangeError(ctx, "invalid resolution %g", ms);
+    obj = JS_NewObjectClass(ctx, js_loop_histogram_class_id);
+    if (JS_IsException(obj))
+        return obj;
+    h = js_mallocz(ctx, sizeof(*h));
+    if (!h) {
+        JS_FreeValue(ctx, obj);
+        return JS_EXCEPTION;
+    }
+    h->lp = lp;
+    h->resolution = (int64_t)(ms * 1e6);
+    h->next = lp->mon.histograms;
+    lp->mon.histograms = h;
+    JS_SetOpaque(obj, h);
+    return obj;
+}
+
+enum {
+    HIST_MIN,
+    HIST_MAX,
+    HIST_MEAN,
+    HIST_STDDEV,
+    HIST_COUNT,
+    HIST_EXCEEDS,
+};
+
+static JSValue js_loop_histogram_get(JSContext *ctx, JSValueConst this_val, int magic)
+{
+    LoopHistogram *h = JS_GetOpaque2(ctx, this_val, js_loop_histogram_class_id);
+    double mean;
+
+    if (!h)
+        return JS_EXCEPTION;
+    mean = h->count ? h->sum / h->count : NAN;
+    switch (magic) {
+    case HIST_MIN:
+        /* as Node.js: the highest value possible until there are samples */
+        return JS_NewFloat64(ctx, h->count ? h->min : (double)INT64_MAX);
+    case HIST_MAX:
+        return JS_NewFloat64(ctx, h->max);
+    case HIST_MEAN:
+        return JS_NewFloat64(ctx, mean);
+    case HIST_STDDEV:
+        return JS_NewFloat64(ctx, h->count ? sqrt(fmax(0, h->sum2 / h->count - mean * mean)) : NAN);
+    case HIST_COUNT:
+        return JS_NewFloat64(ctx, h->count);
+    default:
+        return JS_NewFloat64(ctx, h->exceeds);
+    }
+}
+
+/* percentile(p): the value below which p% of the samples fall */
+static JSValue js_loop_histogram_percentile(JSContext *ctx, JSValueConst this_val,
+                                            int argc, JSValueConst *argv)
+{
+    LoopHistogram *h = JS_GetOpaque2(ctx, this_val, js_loop_histogram_class_id);
+    uint64_t target, seen = 0;
+    double p;
+    int i;
+
+    if (!h || JS_ToFloat64(ctx, &p, argv[0]))
+        return JS_EXCEPTION;
+    if (!(p > 0 && p <= 100))
+        return JS_ThrowRangeError(ctx, "percentile must be > 0 and <= 100");
+    if (h->count == 0)
+        return JS_NewFloat64(ctx, 0);
+    target = (uint64_t)ceil(p / 100 * h->count);
+    if (target == 0)
+        target = 1;
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= target)
+            break;
+    }
+    return JS_NewFloat64(ctx, i < HIST_BUCKETS && hist_value(i) < h->max ? hist_value(i) : h->max);
+}
+
+/* enable() and disable() the timer feeding it; return whether that changed
+   anything. reset() clears the samples. */
+static JSValue js_loop_histogram_ctl(JSContext *ctx, JSValueConst this_val,
+                                     int argc, JSValueConst *argv, int magic)
+{
+    LoopHistogram *h = JS_GetOpaque2(ctx, this_val, js_loop_histogram_class_id);
+
+    if (!h)
+        return JS_EXCEPTION;
+    switch (magic) {
+    case 0:
+        if (h->enabled || !h->lp)
+            return JS_FALSE;
+        h->enabled = TRUE;
+        h->last = loop_now_ns();
+        h->due = h->last + h->resolution;
+        return JS_TRUE;
+    case 1:
+        if (!h->enabled)
+            return JS_FALSE;
+        h->enabled = FALSE;
+        return JS_TRUE;
+    default:
+        hist_reset(h);
+        return JS_UNDEFINED;
+    }
+}
+
+static void js_loop_histogram_finalizer(JSRuntime *rt, JSValue val)
+{
+    LoopHistogram *h = JS_GetOpaque(val, js_loop_histogram_class_id);
+    LoopHistogram **ph;
+
+    if (!h)
+        return;
+    for (ph = h->lp ? &h->lp->mon.histograms : NULL; ph && *ph; ph = &(*ph)->next) {
+        if (*ph == h) {
+            *ph = h->next;
+            break;
+        }
+    }
+    js_free_rt(rt, h);
+}
+
+static JSClassDef js_loop_histogram_class = {
+    "Histogram",
+    .finalizer = js_loop_histogram_finalizer,
+};
+
+static const JSCFunctionListEntry js_loop_histogram_proto_funcs[] = {
+    JS_CGETSET_MAGIC_DEF("min", js_loop_histogram_get, NULL, HIST_MIN ),
+    JS_CGETSET_MAGIC_DEF("max", js_loop_histogram_get, NULL, HIST_MAX ),
+    JS_CGETSET_MAGIC_DEF("mean", js_loop_histogram_get, NULL, HIST_MEAN ),
+    JS_CGETSET_MAGIC_DEF("stddev", js_loop_histogram_get, NULL, HIST_STDDEV ),
+    JS_CGETSET_MAGIC_DEF("count", js_loop_histogram_get, NULL, HIST_COUNT ),
+    JS_CGETSET_MAGIC_DEF("exceeds", js_loop_histogram_get, NULL, HIST_EXCEEDS ),
+    JS_CFUNC_DEF("percentile", 1, js_loop_histogram_percentile ),
+    JS_CFUNC_MAGIC_DEF("enable", 0, js_loop_histogram_ctl, 0 ),
+    JS_CFUNC_MAGIC_DEF("disable", 0, js_loop_histogram_ctl, 1 ),
+    JS_CFUNC_MAGIC_DEF("reset", 0, js_loop_histogram_ctl, 2 ),
+};
+
+static void loop_queue_mark(JSRuntime *rt, LoopQueue *q, JS_MarkFunc *mark_func)
+{
+    LoopTask *t;
+    uint32_t i;
+    int j;
+
+    for (i = 0; i < q->count; i++) {
+        t = loop_at(q, i);
+        JS_MarkValue(rt, t->func, mark_func);
+        for (j = 0; j < t->argc; j++)
+            JS_MarkValue(rt, t->argv[j], mark_func);
+    }
+}
+
+static void loop_queue_free(JSRuntime *rt, LoopQueue *q)
+{
+    while (q->count > 0)
+        loop_task_free(rt, loop_at(q, --q->count));
+    js_free_rt(rt, q->tasks);
+}
+
+static void js_loop_mark(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func)
+{
+    QJSXLoop *lp = JS_GetOpaque(val, js_loop_class_id);
+    int i;
+
+    if (lp) {
+        loop_queue_mark(rt, &lp->ticks, mark_func);
+        loop_queue_mark(rt, &lp->immediates, mark_func);
+        for (i = 0; i < LOOP_PRIORITIES * 2; i++)
+            loop_queue_mark(rt, &lp->tasks[i], mark_func);
+    }
+}
+
+static void js_loop_finalizer(JSRuntime *rt, JSValue val)
+{
+    QJSXLoop *lp = JS_GetOpaque(val, js_loop_class_id);
+    LoopHistogram *h, *next;
+    int i;
+
+    if (!lp)
+        return;
+    if (loop_current == lp)
+        loop_current = NULL;
+    if (loop_embedder_interrupt.monitor == lp)
+        loop_set_interrupt(rt, NULL);
+    JS_FreeValueRT(rt, lp->mon.stack);
+    for (h = lp->mon.histograms; h; h = next) {
+        next = h->next;
+        h->lp = NULL;
+        h->next = NULL;
+    }
+    loop_queue_free(rt, &lp->ticks);
+    loop_queue_free(rt, &lp->immediates);
+    for (i = 0; i < LOOP_PRIORITIES * 2; i++)
+        loop_queue_free(rt, &lp->tasks[i]);
+    if (lp->wake[0] >= 0) {
+        close(lp->wake[0]);
+        close(lp->wake[1]);
+    }
+    js_free_rt(rt, lp);
+}
+
+static JSClassDef js_loop_class = {
+    "Loop",
+    .finalizer = js_loop_finalizer,
+    .gc_mark = js_loop_mark,
+};
+
+static QJSXLoop *loop_new(JSContext *ctx)
+{
+    QJSXLoop *lp;
+    char c = 0;
+
+    lp = js_mallocz(ctx, sizeof(*lp));
+    if (!lp)
+        return NULL;
+    lp->ctx = ctx;
+    lp->first_immediate = 1;
+    lp->check_due = TRUE;
+    lp->tasks_due = TRUE;
+    lp->priority = -1;
+    lp->mon.start = loop_now_ns();
+    lp->mon.stack = JS_UNDEFINED;
+    /* a byte that is never read keeps the pipe readable */
+    if (pipe(lp->wake) < 0) {
+        lp->wake[0] = lp->wake[1] = -1;
+    } else if (write(lp->wake[1], &c, 1) != 1) {
+        close(lp->wake[0]);
+        close(lp->wake[1]);
+        lp->wake[0] = lp->wake[1] = -1;
+    } else {
+        fcntl(lp->wake[0], F_SETFD, FD_CLOEXEC);
+        fcntl(lp->wake[1], F_SETFD, FD_CLOEXEC);
+    }
+    return lp;
+}
+
+static int js_loop_init(JSContext *ctx, JSModuleDef *m)
+{
+    JSRuntime *rt = JS_GetRuntime(ctx);
+    QJSXLoop *lp;
+    JSValue obj, proto;
+    const char *env;
+
+    JS_NewClassID(rt, &js_loop_class_id);
+    JS_NewClass(rt, js_loop_class_id, &js_loop_class);
+    JS_NewClassID(rt, &js_loop_histogram_class_id);
+    JS_NewClass(rt, js_loop_histogram_class_id, &js_loop_histogram_class);
+    proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, proto, js_loop_histogram_proto_funcs,
+                               countof(js_loop_histogram_proto_funcs));
+    JS_SetClassProto(ctx, js_loop_histogram_class_id, proto);
+    obj = JS_NewObjectClass(ctx, js_loop_class_id);
+    if (JS_IsException(obj))
+        return -1;
+    lp = loop_new(ctx);
+    if (!lp) {
+        JS_FreeValue(ctx, obj);
+        return -1;
+    }
+    JS_SetOpaque(obj, lp);
+    if (!loop_current) {
+        loop_current = lp;
+        /* QJSX_LONG_TASK_MS reports long tasks without changing the code */
+        env = getenv("QJSX_LONG_TASK_MS");
+        if (env && atof(env) > 0)
+            loop_monitor_long_tasks(lp, (int64_t)(atof(env) * 1e6));
+    }
+
+    /* the functions own the queues, which go away with the context */
+    JS_SetModuleExport(ctx, m, "queueMicrotask",
+                       JS_NewCFunction(ctx, js_loop_queue_microtask, "queueMicrotask", 1));
+    JS_SetModuleExport(ctx, m, "nextTick",
+                       JS_NewCFunctionData(ctx, js_loop_next_tick, 1, 0, 1, &obj));
+    JS_SetModuleExport(ctx, m, "setImmediate",
+                       JS_NewCFunctionData(ctx, js_loop_set_immediate, 1, 0, 1, &obj));
+    JS_SetModuleExport(ctx, m, "clearImmediate",
+                       JS_NewCFunctionData(ctx, js_loop_clear_immediate, 1, 0, 1, &obj));
+    JS_SetModuleExport(ctx, m, "postTask",
+                       JS_NewCFunctionData(ctx, js_loop_post_task, 2, 0, 1, &obj));
+    JS_SetModuleExport(ctx, m, "postContinuation",
+                       JS_NewCFunctionData(ctx, js_loop_post_task, 1, 1, 1, &obj));
+    JS_SetModuleExport(ctx, m, "currentPriority",
+                       JS_NewCFunctionData(ctx, js_loop_current_priority, 0, 0, 1, &obj));
+    JS_SetModuleExport(ctx, m, "runJobs",
+                       JS_NewCFunction(ctx, js_loop_run_jobs, "runJobs", 1));
+    JS_SetModuleExport(ctx, m, "stats",
+                       JS_NewCFunctionData(ctx, js_loop_stats, 0, 0, 1, &obj));
+    JS_SetModuleExport(ctx, m, "utilization",
+                       JS_NewCFunctionData(ctx, js_loop_utilization, 0, 0, 1, &obj));
+    JS_SetModuleExport(ctx, m, "monitorDelay",
+                       JS_NewCFunctionData(ctx, js_loop_monitor_delay, 1, 0, 1, &obj));
+    JS_SetModuleExport(ctx, m, "monitorLongTasks",
+                       JS_NewCFunctionData(ctx, js_loop_monitor_long_tasks, 1, 0, 1, &obj));
+    JS_FreeValue(ctx, obj);
+    return 0;
+}
+
+JSModuleDef *js_init_module_qjsx_loop(JSContext *ctx, const char *module_name)
+{
+    JSModuleDef *m;
+
+    m = JS_NewCModule(ctx, module_name, js_loop_init);
+    if (!m)
+        return NULL;
+    JS_AddModuleExport(ctx, m, "queueMicrotask");
+    JS_AddModuleExport(ctx, m, "nextTick");
+    JS_AddModuleExport(ctx, m, "setImmediate");
+    JS_AddModuleExport(ctx, m, "clearImmediate");
+    JS_AddModuleExport(ctx, m, "postTask");
+    JS_AddModuleExport(ctx, m, "postContinuation");
+    JS_AddModuleExport(ctx, m, "currentPriority");
+    JS_AddModuleExport(ctx, m, "runJobs");
+    JS_AddModuleExport(ctx, m, "stats");
+    JS_AddModuleExport(ctx, m, "utilization");
+    JS_AddModuleExport(ctx, m, "monitorDelay");
+    JS_AddModuleExport(ctx, m, "monitorLongTasks");
+    return m;
+}
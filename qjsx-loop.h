@@ -0,0 +1,50 @@
+/*
+ * QJSX event loop hook
+ *
+ * quickjs-libc.patch routes every poll of js_std_loop() and js_std_await()
+ * through qjsx_loop_poll(), which runs the process.nextTick(),
+ * setImmediate() and scheduler.postTask() queues of the qjsx:loop module
+ * (qjsx-loop.c) around the timers and I/O handlers of the os module.
+ * Include after quickjs.h.
+ */
+
+#ifndef QJSX_LOOP_H
+#define QJSX_LOOP_H
+
+#include <sys/select.h>
+
+/*
+ * Poll once for the event loop in place of poll (js_os_poll), running one
+ * phase: the pending promise jobs and ticks, or the immediates of a check
+ * phase, or a slice of scheduler tasks, or else poll itself, which must not
+ * block while immediates or tasks are pending. set_read_handler
+ * is os.setReadHandler, used to make the poll return at once. Returns 0 to
+ * go on, or poll's non-zero result when nothing is left to run.
+ */
+int qjsx_loop_poll(JSContext *ctx, int (*poll)(JSContext *ctx),
+                   JSCFunctionMagic *set_read_handler);
+
+/*
+ * select() for js_os_poll(): the time blocked in it is the idle time of
+ * the loop, and the timer of the delay histograms runs when it returns.
+ */
+int qjsx_loop_select(int nfds, fd_set *readfds, fd_set *writefds,
+                     fd_set *exceptfds, struct timeval *timeout);
+
+/*
+ * Run up to budget pending promise jobs of rt (all of them, including
+ * those they queue, when budget <= 0) in one loop, reporting exceptions
+ * like js_std_loop(). Returns the number of jobs run.
+ */
+int qjsx_loop_run_jobs(JSRuntime *rt, int budget);
+
+/*
+ * JS_SetInterruptHandler() for embedders of a runtime that may monitor
+ * long tasks (loop.monitorLongTasks()). QuickJS cannot return the handler
+ * installed, so the monitor only knows of one set here: it calls it from
+ * its own handler and installs it again when monitoring stops.
+ */
+void qjsx_loop_set_interrupt_handler(JSRuntime *rt, JSInterruptHandler *cb,
+                                     void *opaque);
+
+#endif /* QJSX_LOOP_H */
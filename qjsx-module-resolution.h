@@ -7,7 +7,10 @@
  * Features:
  * - QJSXPATH environment variable support (like NODE_PATH)
  * - Node.js-style index.js resolution
+ * - Native addon resolution (name.so, name/index.so, platform builds)
  * - Colon-to-slash translation (e.g., "node:fs" -> "node/fs")
+ * - Normalized module paths (path primitives shared with node:path, see qjsx-path.h)
+ * - Built-in native "qjsx:*" modules
  */
 
 #ifndef QJSX_MODULE_RESOLUTION_H
@@ -18,8 +21,13 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
 #include "quickjs/cutils.h"
 #include "quickjs/quickjs-libc.h"
+#include "qjsx-addon.h"
+#include "qjsx-path.h"
 
 /* ========================================================================
  * CROSS-PLATFORM PATH SEPARATORS
@@ -62,6 +70,78 @@ static int file_exists(const char *path) {
     return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, R_OK) == 0;
 }
 
+/**
+ * Check if a resolved path names a native addon
+ *
+ * quickjs-libc's js_module_loader() dlopen()s any module whose name ends in
+ * ".so" (on every platform, including macOS), so that is the only suffix
+ * the resolver probes for.
+ */
+static int is_addon_path(const char *path) {
+    size_t len = strlen(path);
+    return len >= 3 && !strcmp(path + len - 3, ".so");
+}
+
+/*
+ * Native addon candidates, tried after the JavaScript ones so that adding a
+ * prebuilt library never shadows an existing .js module. A build tagged
+ * with the running platform (see QJSX_ADDON_PLATFORM in qjsx-addon.h) wins
+ * over an untagged one.
+ */
+static const char *const addon_suffixes[] = {
+#ifdef QJSX_ADDON_PLATFORM
+    "." QJSX_ADDON_PLATFORM ".so",
+#endif
+    ".so",
+#ifdef QJSX_ADDON_PLATFORM
+    DIR_SEP "index." QJSX_ADDON_PLATFORM ".so",
+#endif
+    DIR_SEP "index.so",
+};
+
+/**
+ * Resolve a native addon for a module path without extension
+ *
+ * @param ctx - QuickJS context (for memory allocation)
+ * @param base - The module path (e.g., "./my_modules/hello")
+ * @return Resolved library path (e.g., "./my_modules/hello.so"), or NULL
+ */
+static char *resolve_addon(JSContext *ctx, const char *base) {
+    size_t buflen = strlen(base) + 40;  // Room for the longest suffix
+    char *buf = js_malloc(ctx, buflen);
+    if (!buf) return NULL;
+
+    for (size_t i = 0; i < sizeof(addon_suffixes) / sizeof(addon_suffixes[0]); i++) {
+        snprintf(buf, buflen, "%s%s", base, addon_suffixes[i]);
+        if (file_exists(buf)) {
+            return buf;
+        }
+    }
+
+    js_free(ctx, buf);
+    return NULL;
+}
+
+/**
+ * Normalize a resolved module path in place
+ *
+ * @param path - A path allocated by the resolver (may be NULL)
+ * @return path, e.g. "./lib/util.js" for "./lib//x/../util.js"
+ *
+ * Modules are identified by their resolved path, so the same file reached
+ * through differently spelled QJSXPATH entries or imports gets one name
+ * (and one import.meta.filename). A leading "./" is kept: names starting
+ * with "." are resolved as paths, never through QJSXPATH.
+ */
+static char *normalize_resolved_path(char *path) {
+    if (!path) return NULL;
+
+    size_t skip = (path[0] == '.' && path[1] == '/') ? 2 : 0;
+    size_t len = qjsx_path_normalize(path + skip, path + skip, strlen(path + skip));
+    path[skip + len] = 0;
+    return path;
+}
+
 /* ========================================================================
  * MODULE RESOLUTION FUNCTIONS
  * ======================================================================== */
@@ -121,6 +201,8 @@ static char *resolve_qjsxpath(JSContext *ctx, const char *name) {
          * 1. path/name/index.js (package with index file)
          * 2. path/name.js (direct file with .js extension)
          * 3. path/name (direct file without extension)
+         *
+         * and then the native addons next to them (see resolve_addon()).
          */
 
         // Strategy 1: path/name/index.js
@@ -144,7 +226,10 @@ static char *resolve_qjsxpath(JSContext *ctx, const char *name) {
             break;
         }
 
-        // None of the strategies worked for this path, clean up and try next
+        // Strategy 4: path/name.so, path/name/index.so (native addons)
+        result = resolve_addon(ctx, buf);
+
+        // Done with the candidate buffer; the loop stops if an addon was found
         js_free(ctx, buf);
     }
 
@@ -152,7 +237,7 @@ static char *resolve_qjsxpath(JSContext *ctx, const char *name) {
     js_free(ctx, copy);
 
     // Return the resolved path (or NULL if nothing was found)
-    return result;
+    return normalize_resolved_path(result);
 }
 
 /**
@@ -166,13 +251,14 @@ static char *resolve_qjsxpath(JSContext *ctx, const char *name) {
  *   1. Try the exact path
  *   2. Try path.js
  *   3. Try path/index.js
+ *   4. Try the native addons path.so and path/index.so
  */
 static char *resolve_with_index(JSContext *ctx, const char *name) {
     size_t name_len = strlen(name);
 
     // Strategy 1: Try exact path first
     if (file_exists(name)) {
-        return js_strdup(ctx, name);
+        return normalize_resolved_path(js_strdup(ctx, name));
     }
 
     // Strategy 2: Try with .js extension
@@ -182,18 +268,51 @@ static char *resolve_with_index(JSContext *ctx, const char *name) {
 
     snprintf(buf, buflen, "%s.js", name);
     if (file_exists(buf)) {
-        return buf;  // Return the allocated buffer
+        return normalize_resolved_path(buf);  // Return the allocated buffer
     }
 
     // Strategy 3: Try path/index.js
     snprintf(buf, buflen, "%s" DIR_SEP "index.js", name);
     if (file_exists(buf)) {
-        return buf;  // Return the allocated buffer
+        return normalize_resolved_path(buf);  // Return the allocated buffer
     }
 
-    // Nothing found, clean up and return NULL
+    // Strategy 4: Try the native addons
     js_free(ctx, buf);
-    return NULL;
+    return normalize_resolved_path(resolve_addon(ctx, name));
+}
+
+/**
+ * Load a resolved module, checking native addons against the addon ABI
+ *
+ * @param ctx - QuickJS context
+ * @param path - A path returned by resolve_qjsxpath() or resolve_with_index()
+ * @return The module, or NULL with an exception pending
+ *
+ * Addons built with QJSX_ADDON() record the ABI they were compiled for; a
+ * mismatch is reported before quickjs-libc calls into the library. Plain
+ * QuickJS ".so" modules carry no version and are loaded as before.
+ */
+static inline JSModuleDef *qjsx_load_resolved(JSContext *ctx, const char *path,
+                                              void *opaque, JSValueConst attributes) {
+#ifndef _WIN32
+    if (is_addon_path(path)) {
+        // dlopen() is reference counted: js_module_loader() reuses this mapping
+        void *hd = dlopen(path, RTLD_LAZY | RTLD_LOCAL);
+        if (hd) {
+            const int *abi = dlsym(hd, "qjsx_addon_abi_version");
+            if (abi && *abi != QJSX_ADDON_ABI_VERSION) {
+                JS_ThrowReferenceError(ctx, "native module '%s' was built for addon ABI %d, expected %d",
+                                       path, *abi, QJSX_ADDON_ABI_VERSION);
+                dlclose(hd);
+                return NULL;
+            }
+            dlclose(hd);
+        }
+        // If dlopen() failed, js_module_loader() reports the error
+    }
+#endif
+    return js_module_loader(ctx, path, opaque, attributes);
 }
 
 /**
@@ -224,4 +343,60 @@ static char *translate_colons_to_slashes(JSContext *ctx, const char *name) {
     return translated;
 }
 
+/* ========================================================================
+ * BUILT-IN NATIVE MODULES
+ * ======================================================================== */
+
+/*
+ * Native "qjsx:*" modules are linked into qjsx, qjsxc and every executable
+ * built by qjsxc (the Makefile adds them to the libquickjs.a that qjsxc links
+ * against). Like "std" and "os" they are C modules, but they are only
+ * instantiated the first time a script imports them.
+ */
+typedef JSModuleDef *qjsx_module_init_func(JSContext *ctx, const char *module_name);
+
+JSModuleDef *js_init_module_qjsx_simd(JSContext *ctx, const char *module_name);
+JSModuleDef *js_init_module_qjsx_wasm(JSContext *ctx, const char *module_name);
+JSModuleDef *js_init_module_qjsx_ffi(JSContext *ctx, const char *module_name);
+JSModuleDef *js_init_module_qjsx_kv(JSContext *ctx, const char *module_name);
+JSModuleDef *js_init_module_qjsx_shm(JSContext *ctx, const char *module_name);
+JSModuleDef *js_init_module_qjsx_zlib(JSContext *ctx, const char *module_name);
+JSModuleDef *js_init_module_qjsx_tar(JSContext *ctx, const char *module_name);
+JSModuleDef *js_init_module_qjsx_path(JSContext *ctx, const char *module_name);
+JSModuleDef *js_init_module_qjsx_os(JSContext *ctx, const char *module_name);
+JSModuleDef *js_init_module_qjsx_events(JSContext *ctx, const char *module_name);
+JSModuleDef *js_init_module_qjsx_loop(JSContext *ctx, const char *module_name);
+
+/**
+ * Look up a built-in native module by name
+ *
+ * @param name - The module name as imported (e.g., "qjsx:simd")
+ * @return The module's init function, or NULL if it is not a built-in module
+ */
+static qjsx_module_init_func *qjsx_builtin_module(const char *name) {
+    static const struct {
+        const char *name;
+        qjsx_module_init_func *init;
+    } modules[] = {
+        { "qjsx:simd", js_init_module_qjsx_simd },
+        { "qjsx:wasm", js_init_module_qjsx_wasm },
+        { "qjsx:ffi", js_init_module_qjsx_ffi },
+        { "qjsx:kv", js_init_module_qjsx_kv },
+        { "qjsx:shm", js_init_module_qjsx_shm },
+        { "qjsx:zlib", js_init_module_qjsx_zlib },
+        { "qjsx:tar", js_init_module_qjsx_tar },
+        { "qjsx:path", js_init_module_qjsx_path },
+        { "qjsx:os", js_init_module_qjsx_os },
+        { "qjsx:events", js_init_module_qjsx_events },
+        { "qjsx:loop", js_init_module_qjsx_loop },
+    };
+
+    for (size_t i = 0; i < sizeof(modules) / sizeof(modules[0]); i++) {
+        if (!strcmp(name, modules[i].name)) {
+            return modules[i].init;
+        }
+    }
+    return NULL;
+}
+
 #endif /* QJSX_MODULE_RESOLUTION_H */
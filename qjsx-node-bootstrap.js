@@ -13,6 +13,20 @@
 
 import * as std from "std";
 import * as os from "os";
+import WebAssembly from "qjsx:wasm";
+import { setImmediate, clearImmediate, queueMicrotask } from "qjsx:loop";
+import { scheduler } from "node:timers/promises";
+// adds eventLoopUtilization() to the performance global
+import "node:perf_hooks";
+
+// Node.js scripts expect WebAssembly as a global
+globalThis.WebAssembly = WebAssembly;
+
+// ...and the scheduling functions (process.nextTick is in node:process)
+globalThis.setImmediate = setImmediate;
+globalThis.clearImmediate = clearImmediate;
+globalThis.queueMicrotask = queueMicrotask;
+globalThis.scheduler = scheduler;
 
 // Check if a script was provided
 if (scriptArgs.length < 2) {
@@ -0,0 +1,365 @@
+import * as std from 'std'
+import * as native from 'qjsx:events'
+
+/**
+ * node:events with emit() implemented natively (qjsx:events).
+ *
+ * Listeners live where Node.js keeps them: `_events` maps each event to its
+ * only listener, or to an array once there are several, so an emitter with
+ * one listener per event stores no arrays, and emit() with zero or one
+ * listener allocates nothing.
+ *
+ * Example usage:
+ * ```js
+ * import { EventEmitter, once, on, errorMonitor } from 'node:events'
+ * class Job extends EventEmitter {}
+ * const job = new Job()
+ * job.on('progress', (done, total) => ...)
+ * job.once('end', () => ...)
+ * job.on(errorMonitor, err => log(err))   // sees errors without handling them
+ * const [result] = await once(job, 'end')
+ * for await (const [line] of on(reader, 'line', { close: ['end'] })) ...
+ * ```
+ */
+
+export const errorMonitor = Symbol('events.errorMonitor')
+
+let defaultMaxListeners = 10
+
+function checkListener(listener) {
+	if (typeof listener !== 'function') {
+		const err = new TypeError(`The "listener" argument must be of type function. Received ${listener === null ? 'null' : typeof listener}`)
+		err.code = 'ERR_INVALID_ARG_TYPE'
+		throw err
+	}
+}
+
+function addListener(target, type, listener, prepend) {
+	checkListener(listener)
+	let events = target._events
+	if (events === undefined) {
+		events = target._events = Object.create(null)
+		target._eventsCount = 0
+	} else if (events.newListener !== undefined) {
+		target.emit('newListener', type, listener.listener ?? listener)
+		events = target._events
+	}
+
+	const existing = events[type]
+	if (existing === undefined) {
+		events[type] = listener
+		target._eventsCount++
+		return target
+	}
+	let list = existing
+	if (typeof existing === 'function')
+		list = events[type] = prepend ? [listener, existing] : [existing, listener]
+	else if (prepend)
+		list.unshift(listener)
+	else
+		list.push(listener)
+
+	const max = target.getMaxListeners()
+	if (max > 0 && list.length > max && !list.warned) {
+		list.warned = true
+		std.err.puts(`(qjsx) MaxListenersExceededWarning: Possible EventEmitter memory leak detected. ${list.length} ${String(type)} listeners added to ${target.constructor?.name ?? 'EventEmitter'}. MaxListeners is ${max}. Use emitter.setMaxListeners() to increase limit\n`)
+	}
+	return target
+}
+
+function onceWrapper(target, type, listener) {
+	let fired = false
+	const wrapped = function (...args) {
+		if (fired) return
+		fired = true
+		target.removeListener(type, wrapped)
+		return listener.apply(target, args)
+	}
+	wrapped.listener = listener
+	return wrapped
+}
+
+export class EventEmitter {
+	constructor() {
+		EventEmitter.init.call(this)
+	}
+
+	static init() {
+		if (this._events === undefined || this._events === Object.getPrototypeOf(this)._events) {
+			this._events = Object.create(null)
+			this._eventsCount = 0
+		}
+		this._maxListeners = this._maxListeners || undefined
+	}
+
+	static get defaultMaxListeners() {
+		return defaultMaxListeners
+	}
+
+	static set defaultMaxListeners(n) {
+		if (typeof n !== 'number' || n < 0 || Number.isNaN(n))
+			throw new RangeError(`The value of "defaultMaxListeners" is out of range. It must be a non-negative number. Received ${n}`)
+		defaultMaxListeners = n
+	}
+
+	setMaxListeners(n) {
+		if (typeof n !== 'number' || n < 0 || Number.isNaN(n))
+			throw new RangeError(`The value of "n" is out of range. It must be a non-negative number. Received ${n}`)
+		this._maxListeners = n
+		return this
+	}
+
+	getMaxListeners() {
+		return this._maxListeners === undefined ? defaultMaxListeners : this._maxListeners
+	}
+
+	on(type, listener) {
+		return addListener(this, type, listener, false)
+	}
+
+	prependListener(type, listener) {
+		return addListener(this, type, listener, true)
+	}
+
+	once(type, listener) {
+		checkListener(listener)
+		return this.on(type, onceWrapper(this, type, listener))
+	}
+
+	prependOnceListener(type, listener) {
+		checkListener(listener)
+		return this.prependListener(type, onceWrapper(this, type, listener))
+	}
+
+	removeListener(type, listener) {
+		checkListener(listener)
+		const events = this._events
+		if (events === undefined) return this
+		const list = events[type]
+		if (list === undefined) return this
+
+		if (list === listener || list.listener === listener) {
+			if (--this._eventsCount === 0)
+				this._events = Object.create(null)
+			else
+				delete events[type]
+			if (events.removeListener !== undefined)
+				this.emit('removeListener', type, list.listener ?? listener)
+			return this
+		}
+		if (typeof list === 'function') return this
+
+		let i = list.length - 1
+		while (i >= 0 && list[i] !== listener && list[i].listener !== listener) i--
+		if (i < 0) return this
+		if (i === 0) list.shift()
+		else list.splice(i, 1)
+		if (list.length === 1) events[type] = list[0]
+		if (events.removeListener !== undefined)
+			this.emit('removeListener', type, listener)
+		return this
+	}
+
+	removeAllListeners(type) {
+		const events = this._events
+		if (events === undefined) return this
+
+		// without 'removeListener' listeners nobody needs to hear about each one
+		if (events.removeListener === undefined) {
+			if (type === undefined) {
+				this._events = Object.create(null)
+				this._eventsCount = 0
+			} else if (events[type] !== undefined) {
+				if (--this._eventsCount === 0)
+					this._events = Object.create(null)
+				else
+					delete events[type]
+			}
+			return this
+		}
+
+		if (type === undefined) {
+			for (const key of Reflect.ownKeys(events)) {
+				if (key !== 'removeListener') this.removeAllListeners(key)
+			}
+			this.removeAllListeners('removeListener')
+			this._events = Object.create(null)
+			this._eventsCount = 0
+			return this
+		}
+
+		const listeners = events[type]
+		if (typeof listeners === 'function') {
+			this.removeListener(type, listeners)
+		} else if (listeners !== undefined) {
+			// LIFO order, as in Node.js
+			for (let i = listeners.length - 1; i >= 0; i--)
+				this.removeListener(type, listeners[i])
+		}
+		return this
+	}
+
+	listeners(type) {
+		return this.rawListeners(type).map(l => l.listener ?? l)
+	}
+
+	rawListeners(type) {
+		const list = this._events?.[type]
+		if (list === undefined) return []
+		return typeof list === 'function' ? [list] : list.slice()
+	}
+
+	listenerCount(type, listener) {
+		const list = this._events?.[type]
+		if (list === undefined) return 0
+		if (typeof list === 'function')
+			return listener === undefined || list === listener || list.listener === listener ? 1 : 0
+		if (listener === undefined) return list.length
+		return list.filter(l => l === listener || l.listener === listener).length
+	}
+
+	eventNames() {
+		return this._eventsCount > 0 ? Reflect.ownKeys(this._events) : []
+	}
+}
+
+EventEmitter.prototype.emit = native.emitter(errorMonitor)
+EventEmitter.prototype.addListener = EventEmitter.prototype.on
+EventEmitter.prototype.off = EventEmitter.prototype.removeListener
+EventEmitter.prototype._events = undefined
+EventEmitter.prototype._eventsCount = 0
+EventEmitter.prototype._maxListeners = undefined
+EventEmitter.EventEmitter = EventEmitter
+EventEmitter.errorMonitor = errorMonitor
+EventEmitter.once = once
+EventEmitter.on = on
+EventEmitter.listenerCount = listenerCount
+EventEmitter.getEventListeners = getEventListeners
+EventEmitter.setMaxListeners = setMaxListeners
+
+function abortError(signal) {
+	const err = new Error('The operation was aborted', { cause: signal?.reason })
+	err.name = 'AbortError'
+	err.code = 'ABORT_ERR'
+	return err
+}
+
+/**
+ * Resolves with the arguments of the next `name` event as an array, or
+ * rejects on an 'error' event before it.
+ */
+export function once(emitter, name, options = {}) {
+	const signal = options.signal
+	if (signal?.aborted) return Promise.reject(abortError(signal))
+	return new Promise((resolve, reject) => {
+		const onError = (err) => {
+			emitter.removeListener(name, onEvent)
+			signal?.removeEventListener?.('abort', onAbort)
+			reject(err)
+		}
+		const onEvent = (...args) => {
+			if (name !== 'error') emitter.removeListener('error', onError)
+			signal?.removeEventListener?.('abort', onAbort)
+			resolve(args)
+		}
+		const onAbort = () => {
+			emitter.removeListener(name, onEvent)
+			emitter.removeListener('error', onError)
+			reject(abortError(signal))
+		}
+		emitter.once(name, onEvent)
+		if (name !== 'error') emitter.once('error', onError)
+		signal?.addEventListener?.('abort', onAbort, { once: true })
+	})
+}
+
+/**
+ * Async iterator over the `event` events of emitter, yielding each one's
+ * arguments as an array. Events are queued until they are consumed; an
+ * 'error' event makes the next call throw, and the events named in
+ * `options.close` end the iteration. Breaking out of the loop removes the
+ * listeners.
+ */
+export function on(emitter, event, options = {}) {
+	const signal = options.signal
+	const close = options.close ?? []
+	const queue = []
+	const waiting = []
+	let error = null
+	let done = false
+
+	const finish = () => {
+		done = true
+		emitter.removeListener(event, onEvent)
+		emitter.removeListener('error', onError)
+		for (const name of close) emitter.removeListener(name, onClose)
+		signal?.removeEventListener?.('abort', onAbort)
+		while (waiting.length > 0) waiting.shift().resolve({ value: undefined, done: true })
+	}
+	const onEvent = (...args) => {
+		if (waiting.length > 0) waiting.shift().resolve({ value: args, done: false })
+		else queue.push(args)
+	}
+	const onError = (err) => {
+		if (waiting.length > 0) {
+			waiting.shift().reject(err)
+			finish()
+		} else {
+			error = err
+		}
+	}
+	const onClose = () => {
+		if (waiting.length > 0) finish()
+		else done = true
+	}
+	const onAbort = () => onError(abortError(signal))
+
+	if (signal?.aborted) throw abortError(signal)
+	emitter.on(event, onEvent)
+	if (event !== 'error') emitter.on('error', onError)
+	for (const name of close) emitter.on(name, onClose)
+	signal?.addEventListener?.('abort', onAbort, { once: true })
+
+	return {
+		next() {
+			if (queue.length > 0) return Promise.resolve({ value: queue.shift(), done: false })
+			if (error) {
+				const err = error
+				error = null
+				finish()
+				return Promise.reject(err)
+			}
+			if (done) {
+				finish()
+				return Promise.resolve({ value: undefined, done: true })
+			}
+			return new Promise((resolve, reject) => waiting.push({ resolve, reject }))
+		},
+		return() {
+			finish()
+			return Promise.resolve({ value: undefined, done: true })
+		},
+		throw(err) {
+			finish()
+			return Promise.reject(err)
+		},
+		[Symbol.asyncIterator]() {
+			return this
+		},
+	}
+}
+
+export function listenerCount(emitter, type) {
+	return emitter.listenerCount(type)
+}
+
+export function getEventListeners(emitter, type) {
+	return emitter.listeners(type)
+}
+
+export function setMaxListeners(n = defaultMaxListeners, ...emitters) {
+	if (emitters.length === 0) EventEmitter.defaultMaxListeners = n
+	for (const emitter of emitters) emitter.setMaxListeners(n)
+}
+
+export default EventEmitter
@@ -1,5 +1,6 @@
 import * as std from 'std';
 import * as os from 'os';
+import { dirname, join } from 'qjsx:path';
 
 
 export const writeFileSync = (path, data, options) => {
@@ -71,23 +72,30 @@ export const mkdirSync = (path, { mode = 0o777, recursive = false } = {}) => {
     return;
   }
 
-  const parts = path.split('/').filter(p => p.length > 0);
-  let currentPath = path.startsWith('/') ? '/' : '';
-
-  for (const part of parts) {
-    currentPath = currentPath === '/' ? `/${part}` : `${currentPath}/${part}`;
+  const isDirectory = (p) => {
+    const [st, err] = os.stat(p);
+    return err === 0 && (st.mode & os.S_IFMT) === os.S_IFDIR;
+  };
 
-    const [statResult, err] = os.stat(currentPath);
+  // walk up to the first existing ancestor, then create the missing ones
+  const missing = [];
+  for (let p = path; ; p = dirname(p)) {
+    const [statResult, err] = os.stat(p);
     if (err === 0) {
       if ((statResult.mode & os.S_IFMT) !== os.S_IFDIR) {
-        throw new Error(`Path exists but is not a directory: ${currentPath}`);
+        throw new Error(`Path exists but is not a directory: ${p}`);
       }
-      continue;
+      break;
     }
+    missing.push(p);
+    if (dirname(p) === p) break;
+  }
 
-    const result = os.mkdir(currentPath, mode);
-    if (result !== 0) {
-      throw new Error(`Failed to create directory: ${currentPath}`);
+  for (let i = missing.length - 1; i >= 0; i--) {
+    const result = os.mkdir(missing[i], mode);
+    // "a/.." exists once "a" does; a concurrent mkdir is fine too
+    if (result !== 0 && !isDirectory(missing[i])) {
+      throw new Error(`Failed to create directory: ${missing[i]}`);
     }
   }
 }
@@ -199,7 +207,7 @@ export function rmSync(path, options = {}) {
 		try {
 			const files = readdirSync(path);
 			for (const file of files) {
-				const fullPath = `${path}/${file}`;
+				const fullPath = join(path, file);
 				rmSync(fullPath, { recursive: true, force });
 			}
 		} catch (err) {
@@ -0,0 +1,75 @@
+import * as std from 'std'
+import * as os from 'os'
+import * as native from 'qjsx:os'
+
+/**
+ * node:os on top of the qjsx:os native module.
+ *
+ * availableParallelism(), totalmem() and freemem() describe what this
+ * process may use: the CPUs of its affinity mask capped by a cgroup CPU
+ * quota, and physical memory capped by a cgroup memory limit. Size worker
+ * pools with them rather than with cpus().length, which counts every
+ * online CPU of the machine.
+ *
+ * Example usage:
+ * ```js
+ * import os from 'node:os'
+ * const pool = Array.from({ length: os.availableParallelism() }, () => new Worker(url))
+ * const perWorker = Math.floor(os.totalmem() / pool.length)
+ * for (const node of os.numaNodes()) console.log(node.id, node.cpus, node.freemem)
+ * ```
+ *
+ * numaNodes() is not in Node.js: it lists the NUMA nodes with their CPU ids,
+ * memory and distances (a single node on machines without NUMA).
+ */
+
+const archs = {
+	x86_64: 'x64', amd64: 'x64', i386: 'ia32', i686: 'ia32',
+	aarch64: 'arm64', arm64: 'arm64', armv7l: 'arm', armv6l: 'arm',
+	ppc64le: 'ppc64', ppc64: 'ppc64', s390x: 's390x', riscv64: 'riscv64',
+	loongarch64: 'loong64', mips: 'mips', mipsel: 'mipsel',
+}
+
+const signalNames = [
+	'SIGHUP', 'SIGINT', 'SIGQUIT', 'SIGILL', 'SIGTRAP', 'SIGABRT', 'SIGBUS',
+	'SIGFPE', 'SIGKILL', 'SIGUSR1', 'SIGSEGV', 'SIGUSR2', 'SIGPIPE', 'SIGALRM',
+	'SIGTERM', 'SIGCHLD', 'SIGCONT', 'SIGSTOP', 'SIGTSTP', 'SIGTTIN', 'SIGTTOU',
+]
+
+export const EOL = '\n'
+export const devNull = '/dev/null'
+export const constants = {
+	signals: Object.fromEntries(signalNames.filter(name => name in os).map(name => [name, os[name]])),
+}
+
+export const cpus = native.cpus
+export const availableParallelism = native.availableParallelism
+export const totalmem = native.totalmem
+export const freemem = native.freemem
+export const loadavg = native.loadavg
+export const uptime = native.uptime
+export const numaNodes = native.numaNodes
+
+export const hostname = () => native.uname().nodename
+export const type = () => native.uname().sysname
+export const release = () => native.uname().release
+export const version = () => native.uname().version
+export const machine = () => native.uname().machine
+export const arch = () => {
+	const machine = native.uname().machine
+	return archs[machine] || machine
+}
+export const platform = () => os.platform
+export const endianness = () => new Uint8Array(new Uint16Array([1]).buffer)[0] === 1 ? 'LE' : 'BE'
+
+export const homedir = () => std.getenv('HOME') || '/'
+export const tmpdir = () => {
+	const dir = std.getenv('TMPDIR') || std.getenv('TMP') || std.getenv('TEMP') || '/tmp'
+	return dir.length > 1 && dir.endsWith('/') ? dir.slice(0, -1) : dir
+}
+
+export default {
+	EOL, devNull, constants, cpus, availableParallelism, totalmem, freemem,
+	loadavg, uptime, numaNodes, hostname, type, release, version, machine,
+	arch, platform, endianness, homedir, tmpdir,
+}
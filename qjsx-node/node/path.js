@@ -0,0 +1,20 @@
+import * as path from 'qjsx:path'
+
+/**
+ * node:path (POSIX flavour) backed by the qjsx:path native module.
+ *
+ * The native functions share their normalization with the module resolver
+ * (qjsx-path.h), so `path.resolve()` and `import` agree on what a path means.
+ *
+ * Example usage:
+ * ```js
+ * import path from 'node:path'
+ * path.join(import.meta.dirname, '..', 'lib/index.js')
+ * path.relative('/srv/app', '/srv/data/x.json')   // '../data/x.json'
+ * const { dir, name, ext } = path.parse(file)
+ * ```
+ */
+
+export * from 'qjsx:path'
+export const posix = path
+export default path
@@ -0,0 +1,121 @@
+import * as native from 'qjsx:loop'
+
+/**
+ * node:perf_hooks event loop monitoring, measured natively by the event
+ * loop (qjsx:loop).
+ *
+ * The loop counts the time it waits in select() as idle, and feeds the
+ * delay histograms from a timer checked where os.setTimeout() timers are,
+ * without allocating or keeping the process alive, so both can stay on.
+ *
+ * Example usage:
+ * ```js
+ * import { monitorEventLoopDelay, performance, monitorLongTasks } from 'node:perf_hooks'
+ * const h = monitorEventLoopDelay({ resolution: 10 })
+ * h.enable()
+ * ...
+ * console.log(h.percentile(99) / 1e6, 'ms')    // samples are in nanoseconds
+ * const elu = performance.eventLoopUtilization()
+ * ...
+ * performance.eventLoopUtilization(elu).utilization   // since elu, 0 to 1
+ * monitorLongTasks(50)   // log callbacks over 50 ms with their stack (or QJSX_LONG_TASK_MS=50)
+ * ```
+ *
+ * performance and PerformanceObserver are the globals, with marks and
+ * measures (see the Readme).
+ */
+
+function validateInteger(value, name, min) {
+	if (!Number.isInteger(value) || value < min) {
+		const err = new RangeError(`The value of "${name}" is out of range. It must be an integer >= ${min}. Received ${value}`)
+		err.code = 'ERR_OUT_OF_RANGE'
+		throw err
+	}
+}
+
+export class IntervalHistogram {
+	#h
+
+	constructor(h) {
+		this.#h = h
+	}
+
+	get min() { return this.#h.min }
+	get max() { return this.#h.max }
+	get mean() { return this.#h.mean }
+	get stddev() { return this.#h.stddev }
+	get count() { return this.#h.count }
+	get exceeds() { return this.#h.exceeds }
+
+	/** The values at 0, 50, 75, 87.5... percent, up to 100, as Node.js lists them. */
+	get percentiles() {
+		const map = new Map()
+		const h = this.#h
+		if (h.count === 0) {
+			map.set(100, 0)
+			return map
+		}
+		map.set(0, h.min)
+		for (let step = 50; step > 1e-9; step /= 2) {
+			const p = 100 - step
+			const value = h.percentile(p)
+			map.set(p, value)
+			if (value >= h.max) break
+		}
+		map.set(100, h.max)
+		return map
+	}
+
+	percentile(p) {
+		return this.#h.percentile(p)
+	}
+
+	enable() { return this.#h.enable() }
+	disable() { return this.#h.disable() }
+	reset() { this.#h.reset() }
+}
+
+/**
+ * A disabled histogram of the event loop's delay: a timer runs every
+ * options.resolution ms while it is enabled, and records the ns since it
+ * last ran, which grows by as long as callbacks keep the loop busy.
+ */
+export function monitorEventLoopDelay(options = {}) {
+	const resolution = options.resolution ?? 10
+	validateInteger(resolution, 'options.resolution', 1)
+	return new IntervalHistogram(native.monitorDelay(resolution))
+}
+
+/**
+ * { idle, active, utilization }: the ms the loop waited for timers and I/O
+ * and ran JS since it started, or between util1 and now, or util2 and
+ * util1; utilization is the share of active time.
+ */
+function eventLoopUtilization(util1, util2) {
+	let { idle, active } = native.utilization()
+	if (util2) {
+		idle = util1.idle - util2.idle
+		active = util1.active - util2.active
+	} else if (util1) {
+		idle -= util1.idle
+		active -= util1.active
+	}
+	return { idle, active, utilization: idle + active > 0 ? active / (idle + active) : 0 }
+}
+
+/**
+ * qjsx extension: log each callback of the loop running longer than
+ * threshold ms on stderr, with the JS stack it was at once it passed the
+ * threshold; 0 turns it off.
+ */
+export function monitorLongTasks(threshold) {
+	native.monitorLongTasks(threshold)
+}
+
+// the global of qjsx (qjsx-perf.c), with the measurements of the loop
+export const performance = globalThis.performance
+performance.eventLoopUtilization = eventLoopUtilization
+
+export const PerformanceObserver = globalThis.PerformanceObserver
+
+export default { performance, PerformanceObserver, monitorEventLoopDelay, monitorLongTasks, IntervalHistogram }
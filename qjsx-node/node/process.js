@@ -1,5 +1,7 @@
 import * as std from 'std';
 import * as os from 'os';
+import { EventEmitter } from 'node:events';
+import { nextTick } from 'qjsx:loop';
 
 // Create stream-like objects for stdin, stdout, stderr
 const createStream = (fd) => {
@@ -36,9 +38,6 @@ const createStream = (fd) => {
   return stream;
 };
 
-// Event handlers storage
-const eventHandlers = new Map();
-
 // Signal name to number mapping
 const signalMap = {
   'SIGINT': os.SIGINT,
@@ -68,6 +67,9 @@ const process = {
   // Process control
   exit: std.exit,
 
+  // Runs fn(...args) once the current callback returns, before promise jobs
+  nextTick,
+
   // Current working directory
   cwd: () => {
     let [dir, error] = os.getcwd()
@@ -97,48 +99,46 @@ const process = {
   versions: {
     node: '1.0.0-quickjs',
     quickjs: '1.0.0'
-  },
+  }
+};
 
-  // Event emitter methods for signal handling
-  on(event, handler) {
-    if (!eventHandlers.has(event)) {
-      eventHandlers.set(event, []);
-    }
-    eventHandlers.get(event).push(handler);
-
-    // Register signal handler with os.signal if it's a signal event
-    const signum = signalMap[event];
-    if (signum !== undefined) {
-      // Only register if this is the first handler for this signal
-      if (eventHandlers.get(event).length === 1) {
-        os.signal(signum, () => {
-          const handlers = eventHandlers.get(event);
-          if (handlers) {
-            handlers.forEach(h => h());
-          }
-        });
-      }
-    }
+// process is an EventEmitter; signal events install an os.signal handler
+// while they have listeners. The handlers follow the listeners from
+// process's own add and remove methods, so no public 'newListener' or
+// 'removeListener' listener is needed (removeAllListeners() would drop it).
+Object.setPrototypeOf(process, EventEmitter.prototype);
+EventEmitter.init.call(process);
+
+const installedSignals = new Set();
+
+const syncSignal = (event) => {
+  const signum = signalMap[event];
+  if (signum === undefined) return;
+  const listening = process.listenerCount(event) > 0;
+  if (listening && !installedSignals.has(event)) {
+    installedSignals.add(event);
+    os.signal(signum, () => process.emit(event, event, signum));
+  } else if (!listening && installedSignals.has(event)) {
+    installedSignals.delete(event);
+    // Restore the default signal handler
+    os.signal(signum, null);
+  }
+};
 
+for (const name of ['on', 'addListener', 'prependListener', 'removeListener', 'off']) {
+  const method = EventEmitter.prototype[name];
+  process[name] = function (event, listener) {
+    method.call(this, event, listener);
+    syncSignal(event);
     return this;
-  },
+  };
+}
 
-  removeAllListeners(event) {
-    if (event) {
-      eventHandlers.delete(event);
-      // Restore default signal handler
-      const signum = signalMap[event];
-      if (signum !== undefined) {
-        os.signal(signum, null);
-      }
-    } else {
-      // Remove all event handlers
-      for (const [evt] of eventHandlers) {
-        this.removeAllListeners(evt);
-      }
-    }
-    return this;
-  }
+process.removeAllListeners = function (event) {
+  EventEmitter.prototype.removeAllListeners.call(this, event);
+  for (const name of event === undefined ? [...installedSignals] : [event])
+    syncSignal(name);
+  return this;
 };
 
 // Export as default for `import process from 'node:process'`
@@ -146,4 +146,5 @@ export default process;
 
 // Also export individual properties for named imports
 export const { argv, exit, cwd, pid, platform, version, versions, stdin, stdout, stderr } = process;
-export const env = process.env;  // Export env separately to preserve the Proxy
\ No newline at end of file
+export const env = process.env;  // Export env separately to preserve the Proxy
+export { nextTick };
@@ -0,0 +1,134 @@
+import * as os from 'os'
+import * as native from 'qjsx:loop'
+
+/**
+ * node:timers/promises, with the prioritized task scheduler of the web
+ * (scheduler.postTask() and scheduler.yield()) run by the event loop
+ * (qjsx:loop).
+ *
+ * Tasks wait in one queue per priority: 'user-blocking', 'user-visible'
+ * (the default) and 'background'. The loop runs them between polls for
+ * timers and I/O, highest priority first, in slices of a few milliseconds,
+ * and a task that waited too long (100 ms for user-visible, 1 s for
+ * background) goes ahead of higher priorities every other task, so
+ * background work is never starved. scheduler.yield() resumes ahead of the
+ * tasks of its priority, which is that of the task it is called from.
+ *
+ * Example usage:
+ * ```js
+ * import { scheduler, setTimeout } from 'node:timers/promises'
+ * await scheduler.postTask(refreshCache, { priority: 'background' })
+ * for (const batch of batches) {
+ *   ship(batch)
+ *   await scheduler.yield()                // let requests in between batches
+ * }
+ * const value = await setTimeout(100, 'done', { signal })
+ * ```
+ */
+
+const priorities = { 'user-blocking': 0, 'user-visible': 1, 'background': 2 }
+const USER_VISIBLE = 1
+
+function toPriority(priority) {
+	const p = priorities[priority]
+	if (p === undefined) {
+		const err = new TypeError(`The provided value '${String(priority)}' is not a valid enum value of type TaskPriority.`)
+		err.code = 'ERR_INVALID_ARG_VALUE'
+		throw err
+	}
+	return p
+}
+
+function abortError(signal) {
+	const err = new Error('The operation was aborted', { cause: signal?.reason })
+	err.name = 'AbortError'
+	err.code = 'ABORT_ERR'
+	return err
+}
+
+/* settle like promise, or reject once signal aborts */
+function abortable(promise, signal, onAbort) {
+	if (!signal) return promise
+	return new Promise((resolve, reject) => {
+		const abort = () => {
+			onAbort?.()
+			reject(abortError(signal))
+		}
+		signal.addEventListener?.('abort', abort, { once: true })
+		promise.then(value => {
+			signal.removeEventListener?.('abort', abort)
+			resolve(value)
+		}, err => {
+			signal.removeEventListener?.('abort', abort)
+			reject(err)
+		})
+	})
+}
+
+function sleep(delay, value, signal) {
+	let timer
+	const promise = new Promise(resolve => {
+		timer = os.setTimeout(() => resolve(value), Math.max(0, Number(delay) || 0))
+	})
+	return abortable(promise, signal, () => os.clearTimeout(timer))
+}
+
+export function setTimeout(delay, value, options = {}) {
+	if (options.signal?.aborted) return Promise.reject(abortError(options.signal))
+	return sleep(delay, value, options.signal)
+}
+
+export function setImmediate(value, options = {}) {
+	const signal = options.signal
+	if (signal?.aborted) return Promise.reject(abortError(signal))
+	let id
+	const promise = new Promise(resolve => {
+		id = native.setImmediate(resolve, value)
+	})
+	return abortable(promise, signal, () => native.clearImmediate(id))
+}
+
+export const scheduler = {
+	/**
+	 * Runs callback as a task of options.priority (or the signal's, or
+	 * 'user-visible') after options.delay ms, resolving with its result.
+	 * Aborting options.signal rejects the promise and drops the task if it
+	 * has not run yet.
+	 */
+	postTask(callback, options = {}) {
+		if (typeof callback !== 'function') {
+			const err = new TypeError('The "callback" argument must be of type function')
+			err.code = 'ERR_INVALID_ARG_TYPE'
+			throw err
+		}
+		const signal = options.signal
+		const priority = toPriority(options.priority ?? signal?.priority ?? 'user-visible')
+		if (signal?.aborted) return Promise.reject(abortError(signal))
+		const delay = Number(options.delay) || 0
+		if (!signal && delay <= 0) return native.postTask(callback, priority)
+
+		const task = () => {
+			if (signal?.aborted) throw abortError(signal)
+			return callback()
+		}
+		if (delay <= 0) return abortable(native.postTask(task, priority), signal)
+		return abortable(sleep(delay).then(() => native.postTask(task, priority)), signal)
+	},
+
+	/**
+	 * Resolves once the tasks of a priority are run next: options.priority,
+	 * or that of the task yield() is called from, or 'user-visible'.
+	 */
+	yield(options = {}) {
+		let priority = native.currentPriority()
+		if (options.priority !== undefined) priority = toPriority(options.priority)
+		else if (priority < 0) priority = USER_VISIBLE
+		return native.postContinuation(priority)
+	},
+
+	wait(delay, options = {}) {
+		return setTimeout(delay, undefined, options)
+	},
+}
+
+export default { setTimeout, setImmediate, scheduler }
@@ -0,0 +1,296 @@
+import * as os from 'os'
+import * as native from 'qjsx:zlib'
+import { EventEmitter } from 'node:events'
+
+/**
+ * node:zlib on top of the qjsx:zlib native module (system zlib and libzstd).
+ *
+ * Inputs may be strings, ArrayBuffers or any typed array / DataView and are
+ * passed to the native code without copying; results are Uint8Arrays.
+ *
+ * Example usage:
+ * ```js
+ * import * as zlib from 'node:zlib'
+ * const packed = zlib.gzipSync(data, { level: 9 })
+ * const data2 = await zlib.promises.gunzip(packed)   // runs on a thread
+ * zlib.deflate(data, (err, result) => { ... })
+ * const gz = zlib.createGzip()
+ * gz.on('data', chunk => ...).on('end', () => ...)
+ * gz.write(part1); gz.end(part2)
+ * ```
+ *
+ * Inputs of 4 MiB and more are compressed on all CPUs unless `threads` is
+ * given in the options; zstd accepts `level` or node's `params`.
+ */
+
+export const constants = {
+	Z_NO_FLUSH: 0,
+	Z_PARTIAL_FLUSH: 1,
+	Z_SYNC_FLUSH: 2,
+	Z_FULL_FLUSH: 3,
+	Z_FINISH: 4,
+	Z_OK: 0,
+	Z_STREAM_END: 1,
+	Z_NEED_DICT: 2,
+	Z_ERRNO: -1,
+	Z_STREAM_ERROR: -2,
+	Z_DATA_ERROR: -3,
+	Z_MEM_ERROR: -4,
+	Z_BUF_ERROR: -5,
+	Z_VERSION_ERROR: -6,
+	Z_NO_COMPRESSION: 0,
+	Z_BEST_SPEED: 1,
+	Z_BEST_COMPRESSION: 9,
+	Z_DEFAULT_COMPRESSION: -1,
+	Z_FILTERED: 1,
+	Z_HUFFMAN_ONLY: 2,
+	Z_RLE: 3,
+	Z_FIXED: 4,
+	Z_DEFAULT_STRATEGY: 0,
+	Z_MIN_WINDOWBITS: 8,
+	Z_MAX_WINDOWBITS: 15,
+	Z_DEFAULT_WINDOWBITS: 15,
+	Z_MIN_LEVEL: -1,
+	Z_MAX_LEVEL: 9,
+	Z_DEFAULT_LEVEL: -1,
+	Z_MIN_MEMLEVEL: 1,
+	Z_MAX_MEMLEVEL: 9,
+	Z_DEFAULT_MEMLEVEL: 8,
+	Z_DEFAULT_CHUNK: 16384,
+	ZSTD_e_continue: 0,
+	ZSTD_e_flush: 1,
+	ZSTD_e_end: 2,
+	ZSTD_c_compressionLevel: 100,
+	ZSTD_c_checksumFlag: 201,
+	ZSTD_c_nbWorkers: 400,
+	ZSTD_CLEVEL_DEFAULT: 3,
+}
+
+// node flush constants -> the three modes the native streams implement
+const flushMode = (flush) => {
+	if (flush === undefined || flush === constants.Z_NO_FLUSH) return native.FLUSH_NONE
+	if (flush === constants.Z_FINISH) return native.FLUSH_FINISH
+	return native.FLUSH_SYNC
+}
+
+const run = (kind, buffer, options) => new Promise((resolve, reject) => {
+	const job = native.start(kind, buffer, options)
+	os.setReadHandler(job.fd, () => {
+		os.setReadHandler(job.fd, null)
+		try {
+			resolve(new Uint8Array(job.result()))
+		} catch (e) {
+			reject(e)
+		}
+	})
+})
+
+const makeSync = (kind) => (buffer, options) =>
+	new Uint8Array(native.process(kind, buffer, options))
+
+const makeAsync = (kind) => (buffer, options, callback) => {
+	if (typeof options === 'function') {
+		callback = options
+		options = undefined
+	}
+	if (typeof callback !== 'function') {
+		throw new TypeError('callback must be a function')
+	}
+	run(kind, buffer, options).then((result) => callback(null, result), (err) => callback(err))
+}
+
+const makePromise = (kind) => (buffer, options) => run(kind, buffer, options)
+
+/**
+ * A compression or decompression stream with the subset of the Node.js
+ * stream interface that piping code relies on: write(), end(), flush(),
+ * pipe(), destroy() and the 'data', 'end', 'finish', 'close' and 'error'
+ * events. Like a paused readable, output is kept until a 'data' listener
+ * is added; events are delivered from a microtask.
+ */
+export class ZlibStream extends EventEmitter {
+	constructor(kind, options) {
+		super()
+		this._handle = new native.Stream(kind, options)
+		this._queue = []
+		this._scheduled = false
+		this._ending = false
+		this._finished = false
+		this._ended = false
+		this.destroyed = false
+		this.bytesWritten = 0
+	}
+
+	on(event, listener) {
+		super.on(event, listener)
+		if (event === 'data') this._schedule()
+		return this
+	}
+
+	_push(chunk, flush, callback) {
+		if (this.destroyed || this._ending) {
+			const err = new Error('write after end')
+			err.code = 'ERR_STREAM_WRITE_AFTER_END'
+			this._fail(err)
+			return false
+		}
+		try {
+			const out = this._handle.write(chunk, flush)
+			if (chunk != null) this.bytesWritten += chunk.byteLength ?? chunk.length
+			if (out.byteLength > 0) this._queue.push(new Uint8Array(out))
+		} catch (e) {
+			this._fail(e)
+			if (callback) callback(e)
+			return false
+		}
+		if (flush === native.FLUSH_FINISH) {
+			this._ending = true
+			this._handle.close()
+		}
+		this._schedule()
+		if (callback) Promise.resolve().then(() => callback(null))
+		return true
+	}
+
+	write(chunk, encoding, callback) {
+		if (typeof encoding === 'function') callback = encoding
+		return this._push(chunk, native.FLUSH_NONE, callback)
+	}
+
+	flush(kind, callback) {
+		if (typeof kind === 'function') {
+			callback = kind
+			kind = undefined
+		}
+		return this._push(null, flushMode(kind ?? constants.Z_FULL_FLUSH), callback)
+	}
+
+	end(chunk, encoding, callback) {
+		if (typeof chunk === 'function') {
+			callback = chunk
+			chunk = null
+		} else if (typeof encoding === 'function') {
+			callback = encoding
+		}
+		if (callback) this.once('finish', callback)
+		this._push(chunk, native.FLUSH_FINISH)
+		return this
+	}
+
+	pipe(dest) {
+		this.on('data', (chunk) => dest.write(chunk))
+		this.on('end', () => {
+			if (typeof dest.end === 'function') dest.end()
+		})
+		return dest
+	}
+
+	destroy(err) {
+		if (this.destroyed) return this
+		this.destroyed = true
+		this._handle.close()
+		this._queue = []
+		Promise.resolve().then(() => {
+			if (err) this.emit('error', err)
+			this.emit('close')
+		})
+		return this
+	}
+
+	_fail(err) {
+		if (this.destroyed) return
+		this.destroy(err)
+	}
+
+	_schedule() {
+		if (this._scheduled) return
+		this._scheduled = true
+		Promise.resolve().then(() => this._drain())
+	}
+
+	_drain() {
+		this._scheduled = false
+		if (this.destroyed) return
+		if (this._ending && !this._finished) {
+			this._finished = true
+			this.emit('finish')
+		}
+		if (this.listenerCount('data') === 0) return
+		while (this._queue.length > 0) this.emit('data', this._queue.shift())
+		if (this._ending && !this._ended) {
+			this._ended = true
+			this.emit('end')
+			this.emit('close')
+		}
+	}
+
+	async *[Symbol.asyncIterator]() {
+		const chunks = []
+		let done = false
+		let error = null
+		let wake = null
+		this.on('data', (chunk) => { chunks.push(chunk); wake?.() })
+		this.on('end', () => { done = true; wake?.() })
+		this.on('error', (e) => { error = e; wake?.() })
+		for (;;) {
+			if (error) throw error
+			if (chunks.length > 0) {
+				yield chunks.shift()
+			} else if (done) {
+				return
+			} else {
+				await new Promise((resolve) => { wake = resolve })
+				wake = null
+			}
+		}
+	}
+}
+
+ZlibStream.prototype.addListener = ZlibStream.prototype.on
+
+export const gzipSync = makeSync('gzip')
+export const gunzipSync = makeSync('gunzip')
+export const deflateSync = makeSync('deflate')
+export const inflateSync = makeSync('inflate')
+export const deflateRawSync = makeSync('deflateRaw')
+export const inflateRawSync = makeSync('inflateRaw')
+export const unzipSync = makeSync('unzip')
+export const zstdCompressSync = makeSync('zstdCompress')
+export const zstdDecompressSync = makeSync('zstdDecompress')
+
+export const gzip = makeAsync('gzip')
+export const gunzip = makeAsync('gunzip')
+export const deflate = makeAsync('deflate')
+export const inflate = makeAsync('inflate')
+export const deflateRaw = makeAsync('deflateRaw')
+export const inflateRaw = makeAsync('inflateRaw')
+export const unzip = makeAsync('unzip')
+export const zstdCompress = makeAsync('zstdCompress')
+export const zstdDecompress = makeAsync('zstdDecompress')
+
+export const promises = {
+	gzip: makePromise('gzip'),
+	gunzip: makePromise('gunzip'),
+	deflate: makePromise('deflate'),
+	inflate: makePromise('inflate'),
+	deflateRaw: makePromise('deflateRaw'),
+	inflateRaw: makePromise('inflateRaw'),
+	unzip: makePromise('unzip'),
+	zstdCompress: makePromise('zstdCompress'),
+	zstdDecompress: makePromise('zstdDecompress'),
+}
+
+export const createGzip = (options) => new ZlibStream('gzip', options)
+export const createGunzip = (options) => new ZlibStream('gunzip', options)
+export const createDeflate = (options) => new ZlibStream('deflate', options)
+export const createInflate = (options) => new ZlibStream('inflate', options)
+export const createDeflateRaw = (options) => new ZlibStream('deflateRaw', options)
+export const createInflateRaw = (options) => new ZlibStream('inflateRaw', options)
+export const createUnzip = (options) => new ZlibStream('unzip', options)
+export const createZstdCompress = (options) => new ZlibStream('zstdCompress', options)
+export const createZstdDecompress = (options) => new ZlibStream('zstdDecompress', options)
+
+/**
+ * CRC-32 of a string or buffer, optionally continuing from a previous value.
+ */
+export const crc32 = (data, value = 0) => native.crc32(data, value)
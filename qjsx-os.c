@@ -0,0 +1,769 @@
+/*
+ * QJSX qjsx:os module
+ *
+ * CPU, memory and NUMA information for sizing worker pools, the backend of
+ * node:os in qjsx-node. Unlike the machine-wide numbers, the counts that
+ * decide how much work to start honor the limits of the process: its
+ * sched_setaffinity() mask and the CPU quota and memory limit of its cgroup
+ * (v1 or v2, a limit on any parent group applies too), so they are right
+ * inside containers.
+ *
+ *   import * as os from "qjsx:os";
+ *   const workers = os.availableParallelism();
+ *
+ *   os.availableParallelism() -> CPUs in the affinity mask, capped by the
+ *                                cgroup quota rounded up; at least 1
+ *   os.cpus()      -> [{ model, speed (MHz), times: { user, nice, sys, idle,
+ *                      irq } (ms) }] for the online CPUs
+ *   os.totalmem()  -> physical memory, or the cgroup limit if lower (bytes)
+ *   os.freemem()   -> available memory, or what is left below the cgroup
+ *                     limit if less (bytes)
+ *   os.loadavg()   -> [1, 5, 15 minute load averages]
+ *   os.uptime()    -> seconds since boot
+ *   os.uname()     -> { sysname, nodename, release, version, machine }
+ *   os.numaNodes() -> [{ id, cpus: [cpu ids], totalmem, freemem,
+ *                      distances: [to node 0, 1, ...] }]
+ *
+ * On Linux the numbers come from /proc, /sys/fs/cgroup and
+ * /sys/devices/system; elsewhere cpus() reports no model, speed or times,
+ * there are no cgroup limits, and numaNodes() returns a single node with
+ * every CPU.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <dirent.h>
+#include <sys/utsname.h>
+#include "quickjs/cutils.h"
+#include "quickjs/quickjs.h"
+#include "qjsx-path.h"
+#include "qjsx-os.h"
+
+#ifndef OS_CGROUP_ROOT
+#define OS_CGROUP_ROOT      "/sys/fs/cgroup"
+#endif
+#ifndef OS_PROC_CGROUP
+#define OS_PROC_CGROUP      "/proc/self/cgroup"
+#endif
+#define OS_NODE_DIR         "/sys/devices/system/node"
+#define OS_PATH_MAX         4096
+#define OS_NO_LIMIT         ((uint64_t)1 << 62)   /* v1 reports "unlimited" as ~2^63 */
+
+/* read a small file into buf, NUL-terminated; returns the length or -1 */
+static ssize_t os_read_small(const char *path, char *buf, size_t size)
+{
+    ssize_t n, len = 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return -1;
+    while ((size_t)len < size - 1) {
+        n = read(fd, buf + len, size - 1 - len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        len += n;
+    }
+    close(fd);
+    buf[len] = '\0';
+    return len;
+}
+
+/* read a whole file of any size (/proc/cpuinfo); free() the result */
+static char *os_load_file(const char *path)
+{
+    size_t len = 0, size = 16384;
+    char *buf = NULL, *p;
+    ssize_t n;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return NULL;
+    for (;;) {
+        if (!buf || len == size - 1) {
+            if (buf)
+                size *= 2;
+            p = realloc(buf, size);
+            if (!p) {
+                free(buf);
+                buf = NULL;
+                break;
+            }
+            buf = p;
+        }
+        n = read(fd, buf + len, size - 1 - len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            buf[len] = '\0';
+            break;
+        }
+        len += n;
+    }
+    close(fd);
+    return buf;
+}
+
+/* the number after "key" in a /proc/meminfo style file, times 1024 */
+static uint64_t os_meminfo_kb(const char *text, const char *key)
+{
+    const char *p = strstr(text, key);
+
+    return p ? strtoull(p + strlen(key), NULL, 10) * 1024 : 0;
+}
+
+static void os_physical_memory(uint64_t *total, uint64_t *avail)
+{
+    char buf[4096];
+    long page = sysconf(_SC_PAGESIZE);
+
+    *total = *avail = 0;
+    if (os_read_small("/proc/meminfo", buf, sizeof(buf)) > 0) {
+        *total = os_meminfo_kb(buf, "MemTotal:");
+        *avail = os_meminfo_kb(buf, "MemAvailable:");
+        if (!*avail)    /* kernels before 3.14 */
+            *avail = os_meminfo_kb(buf, "MemFree:") + os_meminfo_kb(buf, "Cached:");
+    }
+    if (!*total && page > 0)
+        *total = (uint64_t)sysconf(_SC_PHYS_PAGES) * page;
+#ifdef _SC_AVPHYS_PAGES
+    if (!*avail && page > 0)
+        *avail = (uint64_t)sysconf(_SC_AVPHYS_PAGES) * page;
+#endif
+}
+
+/* cgroups */
+
+typedef struct OSCgroup {
+    int version;                    /* 0: not in a cgroup we can read */
+    char cpu[OS_PATH_MAX];          /* group directory with the cpu controller */
+    char memory[OS_PATH_MAX];       /* ... and with the memory controller */
+    size_t cpu_root, memory_root;   /* length of their mount points */
+} OSCgroup;
+
+/* dir = mount + group, or just the mount when the group is not visible in it */
+static size_t os_cgroup_dir(char *dir, const char *mount, const char *group, size_t group_len)
+{
+    size_t root = strlen(mount);
+
+    if (group_len == 1)     /* "/" */
+        group_len = 0;
+    snprintf(dir, OS_PATH_MAX, "%s%.*s", mount, (int)group_len, group);
+    if (group_len && access(dir, F_OK) != 0)
+        dir[root] = '\0';
+    return root;
+}
+
+/* find the cgroup directories of the calling process from /proc/self/cgroup */
+static void os_cgroup_find(OSCgroup *cg)
+{
+    char buf[4096], mount[OS_PATH_MAX];
+    char *line, *next, *controllers, *group;
+    int have_cpu = 0, have_memory = 0;
+
+    cg->version = 0;
+    if (os_read_small(OS_PROC_CGROUP, buf, sizeof(buf)) <= 0)
+        return;
+    for (line = buf; *line; line = next) {
+        next = strchr(line, '\n');
+        next = next ? (*next = '\0', next + 1) : line + strlen(line);
+        /* hierarchy-ID:controller-list:group */
+        controllers = strchr(line, ':');
+        group = controllers ? strchr(controllers + 1, ':') : NULL;
+        if (!group)
+            continue;
+        *group++ = '\0';
+        controllers++;
+        if (!*controllers) {
+            /* the v2 hierarchy; v1 controllers take precedence (hybrid mode) */
+            if (!have_cpu && !have_memory) {
+                cg->version = 2;
+                cg->cpu_root = os_cgroup_dir(cg->cpu, OS_CGROUP_ROOT, group, strlen(group));
+                cg->memory_root = cg->cpu_root;
+                strcpy(cg->memory, cg->cpu);
+            }
+            continue;
+        }
+        for (char *c = controllers, *end; *c; c = *end ? end + 1 : end) {
+            size_t n = strcspn(c, ",");
+            char *dir = NULL;
+            size_t *root = NULL;
+            end = c + n;
+            if (n == 3 && !memcmp(c, "cpu", 3) && !have_cpu) {
+                dir = cg->cpu;
+                root = &cg->cpu_root;
+                have_cpu = 1;
+            } else if (n == 6 && !memcmp(c, "memory", 6) && !have_memory) {
+                dir = cg->memory;
+                root = &cg->memory_root;
+                have_memory = 1;
+            }
+            if (!dir)
+                continue;
+            if (cg->version == 2) {
+                /* a v2 line came first: start over with v1 */
+                cg->cpu[0] = cg->memory[0] = '\0';
+                cg->cpu_root = cg->memory_root = 0;
+            }
+            cg->version = 1;
+            snprintf(mount, sizeof(mount), "%s/%s", OS_CGROUP_ROOT, controllers);
+            *root = os_cgroup_dir(dir, mount, group, strlen(group));
+        }
+    }
+    if (cg->version == 1) {
+        if (!have_cpu)
+            cg->cpu[0] = '\0';
+        if (!have_memory)
+            cg->memory[0] = '\0';
+    }
+}
+
+/* the limit a group sets itself (CPU quota in thousandths of a CPU, or bytes), 0 if none */
+typedef uint64_t OSLimitFunc(const char *dir);
+
+static uint64_t os_file_number(const char *dir, const char *name, int *unlimited)
+{
+    char path[OS_PATH_MAX + 32], buf[64];
+
+    *unlimited = 1;
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    if (os_read_small(path, buf, sizeof(buf)) <= 0 || !strncmp(buf, "max", 3) || buf[0] == '-')
+        return 0;
+    *unlimited = 0;
+    return strtoull(buf, NULL, 10);
+}
+
+static uint64_t os_cpu_quota_v1(const char *dir)
+{
+    int unlimited;
+    uint64_t quota = os_file_number(dir, "cpu.cfs_quota_us", &unlimited);
+    uint64_t period = os_file_number(dir, "cpu.cfs_period_us", &unlimited);
+
+    return quota && period ? quota * 1000 / period : 0;
+}
+
+static uint64_t os_cpu_quota_v2(const char *dir)
+{
+    char path[OS_PATH_MAX + 32], buf[64];
+    unsigned long long quota, period;
+
+    /* "max 100000" or "<quota> <period>" */
+    snprintf(path, sizeof(path), "%s/cpu.max", dir);
+    if (os_read_small(path, buf, sizeof(buf)) <= 0 ||
+        sscanf(buf, "%llu %llu", &quota, &period) != 2 || !period)
+        return 0;
+    return quota * 1000 / period;
+}
+
+static uint64_t os_memory_limit_v1(const char *dir)
+{
+    int unlimited;
+    uint64_t limit = os_file_number(dir, "memory.limit_in_bytes", &unlimited);
+
+    return limit >= OS_NO_LIMIT ? 0 : limit;
+}
+
+static uint64_t os_memory_limit_v2(const char *dir)
+{
+    int unlimited;
+    uint64_t max = os_file_number(dir, "memory.max", &unlimited);
+    uint64_t high = os_file_number(dir, "memory.high", &unlimited);
+
+    return !max || (high && high < max) ? high : max;
+}
+
+/* smallest limit set on dir or one of its parents up to the mount point */
+static uint64_t os_cgroup_limit(const char *leaf, size_t root_len, OSLimitFunc *get)
+{
+    char dir[OS_PATH_MAX];
+    size_t len = strlen(leaf);
+    uint64_t limit = 0, v;
+
+    if (!len)
+        return 0;
+    memcpy(dir, leaf, len + 1);
+    for (;;) {
+        v = get(dir);
+        if (v && (!limit || v < limit))
+            limit = v;
+        if (len <= root_len)
+            break;
+        len = qjsx_path_dirname(dir, len);
+        dir[len] = '\0';
+    }
+    return limit;
+}
+
+/* CPU quota of the process in thousandths of a CPU, 0 if there is none */
+static uint64_t os_cgroup_cpu_quota(void)
+{
+    OSCgroup cg;
+
+    os_cgroup_find(&cg);
+    if (!cg.version)
+        return 0;
+    return os_cgroup_limit(cg.cpu, cg.cpu_root,
+                           cg.version == 2 ? os_cpu_quota_v2 : os_cpu_quota_v1);
+}
+
+/* memory limit of the process and its group's current usage, 0 if no limit */
+static uint64_t os_cgroup_memory(uint64_t *usage)
+{
+    OSCgroup cg;
+    uint64_t limit;
+    int unlimited;
+
+    *usage = 0;
+    os_cgroup_find(&cg);
+    if (!cg.version)
+        return 0;
+    limit = os_cgroup_limit(cg.memory, cg.memory_root,
+                            cg.version == 2 ? os_memory_limit_v2 : os_memory_limit_v1);
+    if (limit)
+        *usage = os_file_number(cg.memory, cg.version == 2 ? "memory.current" :
+                                "memory.usage_in_bytes", &unlimited);
+    return limit;
+}
+
+static int os_online_cpus(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n < 1 ? 1 : n;
+}
+
+static int os_affinity_count(void)
+{
+#if defined(__linux__)
+    /* the mask may be larger than cpu_set_t on machines with > 1024 CPUs */
+    for (int n = 1024; n <= (1 << 16); n *= 2) {
+        cpu_set_t *set = CPU_ALLOC(n);
+        size_t size = CPU_ALLOC_SIZE(n);
+        int count;
+
+        if (!set)
+            break;
+        if (sched_getaffinity(0, size, set) == 0) {
+            count = CPU_COUNT_S(size, set);
+            CPU_FREE(set);
+            return count > 0 ? count : 1;
+        }
+        CPU_FREE(set);
+        if (errno != EINVAL)
+            break;
+    }
+#endif
+    return os_online_cpus();
+}
+
+int qjsx_available_parallelism(void)
+{
+    int n = os_affinity_count();
+    uint64_t quota = os_cgroup_cpu_quota();
+
+    if (quota && (quota + 999) / 1000 < (uint64_t)n)
+        n = (quota + 999) / 1000;
+    return n > 0 ? n : 1;
+}
+
+uint64_t qjsx_total_memory(void)
+{
+    uint64_t total, avail, usage, limit;
+
+    os_physical_memory(&total, &avail);
+    limit = os_cgroup_memory(&usage);
+    return limit && limit < total ? limit : total;
+}
+
+uint64_t qjsx_free_memory(void)
+{
+    uint64_t total, avail, usage, limit, room;
+
+    os_physical_memory(&total, &avail);
+    limit = os_cgroup_memory(&usage);
+    if (!limit)
+        return avail;
+    room = limit > usage ? limit - usage : 0;
+    return room < avail ? room : avail;
+}
+
+/* cpus() */
+
+typedef struct OSCpu {
+    int id;
+    uint64_t user, nice, sys, idle, irq;    /* clock ticks */
+    const char *model;
+    int model_len;
+    double mhz;
+} OSCpu;
+
+/* the value of a "key\t: value" line of /proc/cpuinfo, or NULL */
+static const char *os_cpuinfo_value(const char *line, const char *key)
+{
+    size_t n = strlen(key);
+
+    if (strncmp(line, key, n) || (line[n] != ' ' && line[n] != '\t' && line[n] != ':'))
+        return NULL;
+    line = strchr(line, ':');
+    if (!line)
+        return NULL;
+    line++;
+    while (*line == ' ' || *line == '\t')
+        line++;
+    return line;
+}
+
+/* fill cpus[] from /proc/stat and /proc/cpuinfo; returns the count or -1 */
+static int os_linux_cpus(OSCpu **pcpus, char **pcpuinfo)
+{
+    char *stat = os_load_file("/proc/stat"), *info, *line, *next;
+    OSCpu *cpus = NULL, *cur = NULL, *p;
+    const char *last_model = NULL, *v;
+    int n = 0, size = 0, last_model_len = 0;
+
+    *pcpus = NULL;
+    *pcpuinfo = NULL;
+    if (!stat)
+        return -1;
+    for (line = stat; *line; line = next) {
+        OSCpu c = { 0 };
+        unsigned long long t[7];
+        next = strchr(line, '\n');
+        next = next ? next + 1 : line + strlen(line);
+        /* cpuN user nice system idle iowait irq softirq ... */
+        if (strncmp(line, "cpu", 3) || line[3] < '0' || line[3] > '9')
+            continue;
+        if (sscanf(line + 3, "%d %llu %llu %llu %llu %llu %llu %llu", &c.id,
+                   &t[0], &t[1], &t[2], &t[3], &t[4], &t[5], &t[6]) < 7)
+            continue;
+        c.user = t[0];
+        c.nice = t[1];
+        c.sys = t[2];
+        c.idle = t[3];
+        c.irq = t[5];
+        if (n == size) {
+            size = size ? size * 2 : 64;
+            p = realloc(cpus, size * sizeof(*cpus));
+            if (!p) {
+                free(cpus);
+                free(stat);
+                return -1;
+            }
+            cpus = p;
+        }
+        cpus[n++] = c;
+    }
+    free(stat);
+
+    info = os_load_file("/proc/cpuinfo");
+    for (line = info; line && *line; line = next) {
+        next = strchr(line, '\n');
+        next = next ? (*next = '\0', next + 1) : line + strlen(line);
+        if ((v = os_cpuinfo_value(line, "processor"))) {
+            int id = atoi(v);
+            cur = NULL;
+            for (int i = 0; i < n; i++) {
+                if (cpus[i].id == id) {
+                    cur = &cpus[i];
+                    break;
+                }
+            }
+        } else if ((v = os_cpuinfo_value(line, "model name")) ||
+                   (v = os_cpuinfo_value(line, "Processor")) ||
+                   (v = os_cpuinfo_value(line, "cpu model"))) {
+            last_model = v;
+            last_model_len = strlen(v);
+            if (cur) {
+                cur->model = v;
+                cur->model_len = last_model_len;
+            }
+        } else if ((v = os_cpuinfo_value(line, "cpu MHz")) && cur) {
+            cur->mhz = strtod(v, NULL);
+        }
+    }
+    /* some architectures name the CPU once for all of them */
+    for (int i = 0; i < n; i++) {
+        if (!cpus[i].model) {
+            cpus[i].model = last_model;
+            cpus[i].model_len = last_model_len;
+        }
+    }
+    *pcpus = cpus;
+    *pcpuinfo = info;
+    return n;
+}
+
+static int os_cpu_speed(const OSCpu *c)
+{
+    char path[96], buf[32];
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", c->id);
+    if (os_read_small(path, buf, sizeof(buf)) > 0)
+        return strtoul(buf, NULL, 10) / 1000;   /* kHz */
+    return (int)c->mhz;
+}
+
+static JSValue js_os_cpus(JSContext *ctx, JSValueConst this_val,
+                          int argc, JSValueConst *argv)
+{
+    OSCpu *cpus = NULL;
+    char *cpuinfo = NULL;
+    JSValue arr, obj, times;
+    long hz = sysconf(_SC_CLK_TCK);
+    double ms = hz > 0 ? 1000.0 / hz : 10;
+    int n = -1;
+
+#if defined(__linux__)
+    n = os_linux_cpus(&cpus, &cpuinfo);
+#endif
+    arr = JS_NewArray(ctx);
+    if (JS_IsException(arr))
+        goto done;
+    if (n < 0) {
+        /* count only */
+        n = os_online_cpus();
+        for (int i = 0; i < n; i++) {
+            obj = JS_NewObject(ctx);
+            times = JS_NewObject(ctx);
+            JS_DefinePropertyValueStr(ctx, obj, "model", JS_NewString(ctx, "unknown"), JS_PROP_C_W_E);
+            JS_DefinePropertyValueStr(ctx, obj, "speed", JS_NewInt32(ctx, 0), JS_PROP_C_W_E);
+            JS_DefinePropertyValueStr(ctx, times, "user", JS_NewInt32(ctx, 0), JS_PROP_C_W_E);
+            JS_DefinePropertyValueStr(ctx, times, "nice", JS_NewInt32(ctx, 0), JS_PROP_C_W_E);
+            JS_DefinePropertyValueStr(ctx, times, "sys", JS_NewInt32(ctx, 0), JS_PROP_C_W_E);
+            JS_DefinePropertyValueStr(ctx, times, "idle", JS_NewInt32(ctx, 0), JS_PROP_C_W_E);
+            JS_DefinePropertyValueStr(ctx, times, "irq", JS_NewInt32(ctx, 0), JS_PROP_C_W_E);
+            JS_DefinePropertyValueStr(ctx, obj, "times", times, JS_PROP_C_W_E);
+            JS_SetPropertyUint32(ctx, arr, i, obj);
+        }
+        goto done;
+    }
+    for (int i = 0; i < n; i++) {
+        const OSCpu *c = &cpus[i];
+        obj = JS_NewObject(ctx);
+        times = JS_NewObject(ctx);
+        JS_DefinePropertyValueStr(ctx, obj, "model",
+                                  c->model ? JS_NewStringLen(ctx, c->model, c->model_len)
+                                           : JS_NewString(ctx, "unknown"),
+                                  JS_PROP_C_W_E);
+        JS_DefinePropertyValueStr(ctx, obj, "speed", JS_NewInt32(ctx, os_cpu_speed(c)), JS_PROP_C_W_E);
+        JS_DefinePropertyValueStr(ctx, times, "user", JS_NewFloat64(ctx, c->user * ms), JS_PROP_C_W_E);
+        JS_DefinePropertyValueStr(ctx, times, "nice", JS_NewFloat64(ctx, c->nice * ms), JS_PROP_C_W_E);
+        JS_DefinePropertyValueStr(ctx, times, "sys", JS_NewFloat64(ctx, c->sys * ms), JS_PROP_C_W_E);
+        JS_DefinePropertyValueStr(ctx, times, "idle", JS_NewFloat64(ctx, c->idle * ms), JS_PROP_C_W_E);
+        JS_DefinePropertyValueStr(ctx, times, "irq", JS_NewFloat64(ctx, c->irq * ms), JS_PROP_C_W_E);
+        JS_DefinePropertyValueStr(ctx, obj, "times", times, JS_PROP_C_W_E);
+        JS_SetPropertyUint32(ctx, arr, i, obj);
+    }
+ done:
+    free(cpus);
+    free(cpuinfo);
+    return arr;
+}
+
+static JSValue js_os_available_parallelism(JSContext *ctx, JSValueConst this_val,
+                                           int argc, JSValueConst *argv)
+{
+    return JS_NewInt32(ctx, qjsx_available_parallelism());
+}
+
+static JSValue js_os_totalmem(JSContext *ctx, JSValueConst this_val,
+                              int argc, JSValueConst *argv)
+{
+    return JS_NewInt64(ctx, qjsx_total_memory());
+}
+
+static JSValue js_os_freemem(JSContext *ctx, JSValueConst this_val,
+                             int argc, JSValueConst *argv)
+{
+    return JS_NewInt64(ctx, qjsx_free_memory());
+}
+
+static JSValue js_os_loadavg(JSContext *ctx, JSValueConst this_val,
+                             int argc, JSValueConst *argv)
+{
+    double load[3] = { 0, 0, 0 };
+    JSValue arr = JS_NewArray(ctx);
+
+    if (JS_IsException(arr))
+        return arr;
+    if (getloadavg(load, 3) < 0)
+        load[0] = load[1] = load[2] = 0;
+    for (int i = 0; i < 3; i++)
+        JS_SetPropertyUint32(ctx, arr, i, JS_NewFloat64(ctx, load[i]));
+    return arr;
+}
+
+static JSValue js_os_uptime(JSContext *ctx, JSValueConst this_val,
+                            int argc, JSValueConst *argv)
+{
+    struct timespec ts;
+
+#ifdef CLOCK_BOOTTIME
+    if (clock_gettime(CLOCK_BOOTTIME, &ts) == 0)
+        return JS_NewFloat64(ctx, ts.tv_sec + ts.tv_nsec / 10000000 / 100.0);
+#endif
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return JS_NewFloat64(ctx, ts.tv_sec + ts.tv_nsec / 10000000 / 100.0);
+    return JS_NewInt32(ctx, 0);
+}
+
+static JSValue js_os_uname(JSContext *ctx, JSValueConst this_val,
+                           int argc, JSValueConst *argv)
+{
+    struct utsname u;
+    JSValue obj;
+
+    if (uname(&u) < 0)
+        return JS_ThrowTypeError(ctx, "uname: %s", strerror(errno));
+    obj = JS_NewObject(ctx);
+    if (JS_IsException(obj))
+        return obj;
+    JS_DefinePropertyValueStr(ctx, obj, "sysname", JS_NewString(ctx, u.sysname), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "nodename", JS_NewString(ctx, u.nodename), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "release", JS_NewString(ctx, u.release), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "version", JS_NewString(ctx, u.version), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "machine", JS_NewString(ctx, u.machine), JS_PROP_C_W_E);
+    return obj;
+}
+
+/* numaNodes() */
+
+static int os_cmp_int(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+/* append the CPUs of a "0-3,8,10-11" list to arr */
+static void os_cpu_list(JSContext *ctx, JSValue arr, const char *list)
+{
+    uint32_t k = 0;
+    char *end;
+
+    while (*list >= '0' && *list <= '9') {
+        long lo = strtol(list, &end, 10), hi = lo;
+        if (*end == '-')
+            hi = strtol(end + 1, &end, 10);
+        for (long c = lo; c <= hi; c++)
+            JS_SetPropertyUint32(ctx, arr, k++, JS_NewInt32(ctx, c));
+        list = *end == ',' ? end + 1 : end;
+    }
+}
+
+static JSValue os_numa_node(JSContext *ctx, int id, uint64_t total, uint64_t free_mem,
+                            JSValue cpus, JSValue distances)
+{
+    JSValue obj = JS_NewObject(ctx);
+
+    JS_DefinePropertyValueStr(ctx, obj, "id", JS_NewInt32(ctx, id), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "cpus", cpus, JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "totalmem", JS_NewInt64(ctx, total), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "freemem", JS_NewInt64(ctx, free_mem), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "distances", distances, JS_PROP_C_W_E);
+    return obj;
+}
+
+static JSValue js_os_numa_nodes(JSContext *ctx, JSValueConst this_val,
+                                int argc, JSValueConst *argv)
+{
+    char path[sizeof(OS_NODE_DIR) + 64], buf[4096], *end;
+    int *ids = NULL, *p, n = 0, size = 0;
+    DIR *dir = opendir(OS_NODE_DIR);
+    struct dirent *d;
+    JSValue arr = JS_NewArray(ctx);
+
+    if (JS_IsException(arr)) {
+        if (dir)
+            closedir(dir);
+        return arr;
+    }
+    while (dir && (d = readdir(dir))) {
+        if (strncmp(d->d_name, "node", 4) || d->d_name[4] < '0' || d->d_name[4] > '9')
+            continue;
+        if (n == size) {
+            size = size ? size * 2 : 16;
+            p = realloc(ids, size * sizeof(*ids));
+            if (!p)
+                break;
+            ids = p;
+        }
+        ids[n++] = atoi(d->d_name + 4);
+    }
+    if (dir)
+        closedir(dir);
+
+    if (!n) {
+        /* no NUMA information: one node with everything */
+        uint64_t total, avail;
+        JSValue cpus = JS_NewArray(ctx), distances = JS_NewArray(ctx);
+        os_physical_memory(&total, &avail);
+        for (int c = 0, count = os_online_cpus(); c < count; c++)
+            JS_SetPropertyUint32(ctx, cpus, c, JS_NewInt32(ctx, c));
+        JS_SetPropertyUint32(ctx, distances, 0, JS_NewInt32(ctx, 10));
+        JS_SetPropertyUint32(ctx, arr, 0, os_numa_node(ctx, 0, total, avail, cpus, distances));
+        free(ids);
+        return arr;
+    }
+
+    qsort(ids, n, sizeof(*ids), os_cmp_int);
+    for (int i = 0; i < n; i++) {
+        JSValue cpus = JS_NewArray(ctx), distances = JS_NewArray(ctx);
+        uint64_t total = 0, free_mem = 0;
+        const char *s;
+        uint32_t k = 0;
+
+        snprintf(path, sizeof(path), "%s/node%d/cpulist", OS_NODE_DIR, ids[i]);
+        if (os_read_small(path, buf, sizeof(buf)) > 0)
+            os_cpu_list(ctx, cpus, buf);
+        snprintf(path, sizeof(path), "%s/node%d/meminfo", OS_NODE_DIR, ids[i]);
+        if (os_read_small(path, buf, sizeof(buf)) > 0) {
+            /* "Node 0 MemTotal:       16316412 kB" */
+            total = os_meminfo_kb(buf, "MemTotal:");
+            free_mem = os_meminfo_kb(buf, "MemFree:");
+        }
+        snprintf(path, sizeof(path), "%s/node%d/distance", OS_NODE_DIR, ids[i]);
+        if (os_read_small(path, buf, sizeof(buf)) > 0) {
+            for (s = buf; *s >= '0' && *s <= '9'; s = end + strspn(end, " ")) {
+                long v = strtol(s, &end, 10);
+                JS_SetPropertyUint32(ctx, distances, k++, JS_NewInt32(ctx, v));
+            }
+        }
+        JS_SetPropertyUint32(ctx, arr, i, os_numa_node(ctx, ids[i], total, free_mem, cpus, distances));
+    }
+    free(ids);
+    return arr;
+}
+
+static const JSCFunctionListEntry js_os_funcs[] = {
+    JS_CFUNC_DEF("cpus", 0, js_os_cpus ),
+    JS_CFUNC_DEF("availableParallelism", 0, js_os_available_parallelism ),
+    JS_CFUNC_DEF("totalmem", 0, js_os_totalmem ),
+    JS_CFUNC_DEF("freemem", 0, js_os_freemem ),
+    JS_CFUNC_DEF("loadavg", 0, js_os_loadavg ),
+    JS_CFUNC_DEF("uptime", 0, js_os_uptime ),
+    JS_CFUNC_DEF("uname", 0, js_os_uname ),
+    JS_CFUNC_DEF("numaNodes", 0, js_os_numa_nodes ),
+};
+
+static int js_os_init(JSContext *ctx, JSModuleDef *m)
+{
+    return JS_SetModuleExportList(ctx, m, js_os_funcs, countof(js_os_funcs));
+}
+
+JSModuleDef *js_init_module_qjsx_os(JSContext *ctx, const char *module_name)
+{
+    JSModuleDef *m;
+
+    m = JS_NewCModule(ctx, module_name, js_os_init);
+    if (!m)
+        return NULL;
+    JS_AddModuleExportList(ctx, m, js_os_funcs, countof(js_os_funcs));
+    return m;
+}
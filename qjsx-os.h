@@ -0,0 +1,32 @@
+/*
+ * QJSX CPU and memory limits for native modules
+ *
+ * What the process may actually use, as opposed to what the machine has:
+ * the CPU count honors the scheduler affinity mask and a cgroup CPU quota,
+ * the memory sizes honor a cgroup memory limit (v1 and v2, including the
+ * limits of parent groups). Implemented in qjsx-os.c, which also exposes
+ * them to JavaScript as qjsx:os, the backend of node:os.
+ */
+
+#ifndef QJSX_OS_H
+#define QJSX_OS_H
+
+#include <stdint.h>
+
+/*
+ * Number of CPUs worth of work the process can run in parallel: the CPUs
+ * in its affinity mask, or fewer when a cgroup quota allows less CPU time
+ * (a quota of 1.5 CPUs counts as 2). Always at least 1.
+ */
+int qjsx_available_parallelism(void);
+
+/* Physical memory, or the cgroup memory limit if it is lower (bytes) */
+uint64_t qjsx_total_memory(void);
+
+/*
+ * Memory available for new allocations (MemAvailable), or what is left
+ * below the cgroup limit if that is less (bytes)
+ */
+uint64_t qjsx_free_memory(void);
+
+#endif /* QJSX_OS_H */
@@ -0,0 +1,547 @@
+/*
+ * QJSX qjsx:path module
+ *
+ * The POSIX flavour of Node's path module in C, the implementation of
+ * node:path in qjsx-node. Results match Node's path.posix; paths are
+ * handled as byte strings, built in one buffer per call.
+ *
+ *   import * as path from "qjsx:path";
+ *   path.join("a", "../b", "c/")        -> "b/c/"
+ *   path.resolve("src", "main.js")      -> "/cwd/src/main.js"
+ *   path.relative("/a/b/c", "/a/d")     -> "../../d"
+ *   path.normalize("/a//b/./c/..")      -> "/a/b"
+ *   path.dirname("/a/b.txt"), path.basename("/a/b.txt", ".txt"),
+ *   path.extname("b.tar.gz")            -> "/a", "b", ".gz"
+ *   path.parse("/a/b.txt")              -> { root, dir, base, ext, name }
+ *   path.format({ dir, base }), path.isAbsolute(p), path.sep, path.delimiter
+ *
+ * The primitives shared with the module resolver live in qjsx-path.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include "quickjs/cutils.h"
+#include "quickjs/quickjs.h"
+#include "qjsx-path.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+#define PATH_MAX_ARGS_ON_STACK 16
+
+typedef struct PathArg {
+    const char *s;
+    size_t len;
+} PathArg;
+
+/* path.resolve() of args, with cwd used if none of them is absolute: dst
+   needs the sum of the lengths of args and cwd plus n + 2 bytes */
+static size_t path_resolve(char *dst, size_t dst_size, const PathArg *args,
+                           int n, const char *cwd, size_t cwd_len)
+{
+    size_t pos = dst_size, res;
+    int absolute = 0;
+
+    /* prepend from the right until a path is absolute */
+    for (int i = n - 1; i >= -1 && !absolute; i--) {
+        const char *s = i >= 0 ? args[i].s : cwd;
+        size_t len = i >= 0 ? args[i].len : cwd_len;
+        if (len == 0)
+            continue;
+        dst[--pos] = '/';
+        pos -= len;
+        memcpy(dst + pos, s, len);
+        absolute = s[0] == '/';
+    }
+    res = qjsx_path_normalize_segments(dst + absolute, dst + pos,
+                                       dst_size - pos, !absolute);
+    if (absolute) {
+        dst[0] = '/';
+        return res + 1;
+    }
+    if (res == 0)
+        dst[res++] = '.';
+    return res;
+}
+
+/* path.join(): dst needs the sum of the lengths of args plus n + 1 bytes */
+static size_t path_join(char *dst, const PathArg *args, int n)
+{
+    size_t len = 0;
+
+    for (int i = 0; i < n; i++) {
+        if (args[i].len == 0)
+            continue;
+        if (len > 0)
+            dst[len++] = '/';
+        memcpy(dst + len, args[i].s, args[i].len);
+        len += args[i].len;
+    }
+    return qjsx_path_normalize(dst, dst, len);
+}
+
+/* path.relative() of two resolved paths: dst needs 3 * from_len + to_len */
+static size_t path_relative(char *dst, const char *from, size_t from_len,
+                            const char *to, size_t to_len)
+{
+    size_t from_start = 1, to_start = 1, i, len = 0;
+    size_t fl = from_len - from_start, tl = to_len - to_start;
+    size_t length = fl < tl ? fl : tl;
+    ptrdiff_t last_common_sep = -1;
+
+    if (from_len == to_len && !memcmp(from, to, from_len))
+        return 0;
+    for (i = 0; i < length; i++) {
+        char c = from[from_start + i];
+        if (c != to[to_start + i])
+            break;
+        if (c == '/')
+            last_common_sep = i;
+    }
+    if (i == length) {
+        if (tl > length) {
+            if (to[to_start + i] == '/') {
+                /* from is a prefix of to: "/a" -> "/a/b" */
+                memcpy(dst, to + to_start + i + 1, tl - i - 1);
+                return tl - i - 1;
+            }
+            if (i == 0) {
+                /* from is the root */
+                memcpy(dst, to + to_start, tl);
+                return tl;
+            }
+        } else if (fl > length) {
+            if (from[from_start + i] == '/')
+                last_common_sep = i;
+            else if (i == 0)
+                last_common_sep = 0;
+        }
+    }
+    /* one ".." for each segment of from after the common part */
+    for (i = from_start + last_common_sep + 1; i <= from_len; i++) {
+        if (i == from_len || from[i] == '/') {
+            if (len > 0)
+                dst[len++] = '/';
+            dst[len++] = '.';
+            dst[len++] = '.';
+        }
+    }
+    memcpy(dst + len, to + to_start + last_common_sep,
+           to_len - to_start - last_common_sep);
+    return len + to_len - to_start - last_common_sep;
+}
+
+/* JavaScript bindings */
+
+static int js_path_get(JSContext *ctx, PathArg *a, JSValueConst val,
+                       const char *name)
+{
+    if (!JS_IsString(val)) {
+        JS_ThrowTypeError(ctx, "The \"%s\" argument must be of type string", name);
+        return -1;
+    }
+    a->s = JS_ToCStringLen(ctx, &a->len, val);
+    return a->s ? 0 : -1;
+}
+
+static void js_path_free_args(JSContext *ctx, PathArg *args, int n,
+                              PathArg *stack_args)
+{
+    for (int i = 0; i < n; i++)
+        JS_FreeCString(ctx, args[i].s);
+    if (args != stack_args)
+        js_free(ctx, args);
+}
+
+/* the arguments as byte strings, and the sum of their lengths */
+static PathArg *js_path_get_args(JSContext *ctx, int argc, JSValueConst *argv,
+                                 PathArg *stack_args, size_t *total)
+{
+    PathArg *args = stack_args;
+
+    if (argc > PATH_MAX_ARGS_ON_STACK) {
+        args = js_malloc(ctx, sizeof(*args) * argc);
+        if (!args)
+            return NULL;
+    }
+    *total = 0;
+    for (int i = 0; i < argc; i++) {
+        if (js_path_get(ctx, &args[i], argv[i], "path")) {
+            js_path_free_args(ctx, args, i, stack_args);
+            return NULL;
+        }
+        *total += args[i].len;
+    }
+    return args;
+}
+
+static char *js_path_buffer(JSContext *ctx, char *stack_buf, size_t stack_size,
+                            size_t size)
+{
+    return size <= stack_size ? stack_buf : js_malloc(ctx, size);
+}
+
+static JSValue js_path_result(JSContext *ctx, char *buf, size_t len,
+                              char *stack_buf)
+{
+    JSValue val = JS_NewStringLen(ctx, buf, len);
+
+    if (buf != stack_buf)
+        js_free(ctx, buf);
+    return val;
+}
+
+/* cwd if none of args is absolute, "" otherwise */
+static int js_path_cwd(JSContext *ctx, const PathArg *args, int n,
+                       char *cwd, size_t *cwd_len)
+{
+    *cwd_len = 0;
+    for (int i = 0; i < n; i++) {
+        if (args[i].len > 0 && args[i].s[0] == '/')
+            return 0;
+    }
+    if (!getcwd(cwd, PATH_MAX)) {
+        JS_ThrowInternalError(ctx, "getcwd: %s", strerror(errno));
+        return -1;
+    }
+    *cwd_len = strlen(cwd);
+    return 0;
+}
+
+static JSValue js_path_join_resolve(JSContext *ctx, JSValueConst this_val,
+                                    int argc, JSValueConst *argv, int resolve)
+{
+    PathArg stack_args[PATH_MAX_ARGS_ON_STACK], *args;
+    char stack_buf[512], *buf, cwd[PATH_MAX];
+    size_t total, size, len, cwd_len = 0;
+
+    args = js_path_get_args(ctx, argc, argv, stack_args, &total);
+    if (!args)
+        return JS_EXCEPTION;
+    if (resolve && js_path_cwd(ctx, args, argc, cwd, &cwd_len)) {
+        js_path_free_args(ctx, args, argc, stack_args);
+        return JS_EXCEPTION;
+    }
+    size = total + cwd_len + argc + 2;
+    buf = js_path_buffer(ctx, stack_buf, sizeof(stack_buf), size);
+    if (!buf) {
+        js_path_free_args(ctx, args, argc, stack_args);
+        return JS_EXCEPTION;
+    }
+    if (resolve)
+        len = path_resolve(buf, size, args, argc, cwd, cwd_len);
+    else
+        len = path_join(buf, args, argc);
+    js_path_free_args(ctx, args, argc, stack_args);
+    return js_path_result(ctx, buf, len, stack_buf);
+}
+
+static JSValue js_path_normalize(JSContext *ctx, JSValueConst this_val,
+                                 int argc, JSValueConst *argv)
+{
+    char stack_buf[512], *buf;
+    PathArg a;
+    size_t len;
+
+    if (js_path_get(ctx, &a, argv[0], "path"))
+        return JS_EXCEPTION;
+    buf = js_path_buffer(ctx, stack_buf, sizeof(stack_buf), a.len + 1);
+    if (!buf) {
+        JS_FreeCString(ctx, a.s);
+        return JS_EXCEPTION;
+    }
+    len = qjsx_path_normalize(buf, a.s, a.len);
+    JS_FreeCString(ctx, a.s);
+    return js_path_result(ctx, buf, len, stack_buf);
+}
+
+static JSValue js_path_relative(JSContext *ctx, JSValueConst this_val,
+                                int argc, JSValueConst *argv)
+{
+    PathArg a[2];
+    char stack_buf[1024], *buf, *from, *to, cwd[PATH_MAX];
+    size_t from_size, to_size, from_len, to_len, cwd_len, len;
+
+    if (js_path_get(ctx, &a[0], argv[0], "from"))
+        return JS_EXCEPTION;
+    if (js_path_get(ctx, &a[1], argv[1], "to")) {
+        JS_FreeCString(ctx, a[0].s);
+        return JS_EXCEPTION;
+    }
+    if (a[0].len == a[1].len && !memcmp(a[0].s, a[1].s, a[0].len)) {
+        len = 0;
+        buf = stack_buf;
+        goto done;
+    }
+    cwd_len = 0;
+    if ((a[0].len == 0 || a[0].s[0] != '/' || a[1].len == 0 || a[1].s[0] != '/') &&
+        js_path_cwd(ctx, NULL, 0, cwd, &cwd_len)) {
+        JS_FreeCString(ctx, a[0].s);
+        JS_FreeCString(ctx, a[1].s);
+        return JS_EXCEPTION;
+    }
+    /* both resolved paths and the result in one buffer */
+    from_size = a[0].len + cwd_len + 3;
+    to_size = a[1].len + cwd_len + 3;
+    buf = js_path_buffer(ctx, stack_buf, sizeof(stack_buf),
+                         from_size + to_size + 3 * from_size + to_size);
+    if (!buf) {
+        JS_FreeCString(ctx, a[0].s);
+        JS_FreeCString(ctx, a[1].s);
+        return JS_EXCEPTION;
+    }
+    from = buf + 3 * from_size + to_size;
+    to = from + from_size;
+    from_len = path_resolve(from, from_size, &a[0], 1, cwd, cwd_len);
+    to_len = path_resolve(to, to_size, &a[1], 1, cwd, cwd_len);
+    len = path_relative(buf, from, from_len, to, to_len);
+ done:
+    JS_FreeCString(ctx, a[0].s);
+    JS_FreeCString(ctx, a[1].s);
+    return js_path_result(ctx, buf, len, stack_buf);
+}
+
+static JSValue js_path_dirname(JSContext *ctx, JSValueConst this_val,
+                               int argc, JSValueConst *argv)
+{
+    PathArg a;
+    size_t len;
+    JSValue val;
+
+    if (js_path_get(ctx, &a, argv[0], "path"))
+        return JS_EXCEPTION;
+    len = qjsx_path_dirname(a.s, a.len);
+    val = len ? JS_NewStringLen(ctx, a.s, len) : JS_NewString(ctx, ".");
+    JS_FreeCString(ctx, a.s);
+    return val;
+}
+
+static JSValue js_path_basename(JSContext *ctx, JSValueConst this_val,
+                                int argc, JSValueConst *argv)
+{
+    PathArg a, suffix = { NULL, 0 };
+    size_t start, len;
+    JSValue val;
+
+    if (js_path_get(ctx, &a, argv[0], "path"))
+        return JS_EXCEPTION;
+    if (argc > 1 && !JS_IsUndefined(argv[1]) &&
+        js_path_get(ctx, &suffix, argv[1], "suffix")) {
+        JS_FreeCString(ctx, a.s);
+        return JS_EXCEPTION;
+    }
+    len = qjsx_path_basename(a.s, a.len, suffix.s, suffix.len, &start);
+    val = JS_NewStringLen(ctx, a.s + start, len);
+    JS_FreeCString(ctx, a.s);
+    if (suffix.s)
+        JS_FreeCString(ctx, suffix.s);
+    return val;
+}
+
+static JSValue js_path_extname(JSContext *ctx, JSValueConst this_val,
+                               int argc, JSValueConst *argv)
+{
+    PathArg a;
+    size_t start, end;
+    JSValue val;
+
+    if (js_path_get(ctx, &a, argv[0], "path"))
+        return JS_EXCEPTION;
+    start = qjsx_path_extname(a.s, a.len, &end);
+    val = JS_NewStringLen(ctx, a.s + start, end - start);
+    JS_FreeCString(ctx, a.s);
+    return val;
+}
+
+static JSValue js_path_is_absolute(JSContext *ctx, JSValueConst this_val,
+                                   int argc, JSValueConst *argv)
+{
+    PathArg a;
+    BOOL absolute;
+
+    if (js_path_get(ctx, &a, argv[0], "path"))
+        return JS_EXCEPTION;
+    absolute = a.len > 0 && a.s[0] == '/';
+    JS_FreeCString(ctx, a.s);
+    return JS_NewBool(ctx, absolute);
+}
+
+/* path.parse(): { root, dir, base, ext, name } */
+static JSValue js_path_parse(JSContext *ctx, JSValueConst this_val,
+                             int argc, JSValueConst *argv)
+{
+    ptrdiff_t i, start, start_dot = -1, start_part = 0, end = -1;
+    size_t base_start = 0, base_len = 0, name_len = 0, ext_len = 0, dir_len = 0;
+    int matched_slash = 1, pre_dot_state = 0, absolute;
+    const char *s;
+    PathArg a;
+    JSValue obj;
+
+    if (js_path_get(ctx, &a, argv[0], "path"))
+        return JS_EXCEPTION;
+    s = a.s;
+    absolute = a.len > 0 && s[0] == '/';
+    start = absolute;
+    for (i = (ptrdiff_t)a.len - 1; i >= start; i--) {
+        if (s[i] == '/') {
+            if (!matched_slash) {
+                start_part = i + 1;
+                break;
+            }
+            continue;
+        }
+        if (end == -1) {
+            matched_slash = 0;
+            end = i + 1;
+        }
+        if (s[i] == '.') {
+            if (start_dot == -1)
+                start_dot = i;
+            else if (pre_dot_state != 1)
+                pre_dot_state = 1;
+        } else if (start_dot != -1) {
+            pre_dot_state = -1;
+        }
+    }
+    if (end != -1) {
+        base_start = start_part == 0 && absolute ? 1 : start_part;
+        base_len = name_len = end - base_start;
+        if (start_dot != -1 && pre_dot_state != 0 &&
+            !(pre_dot_state == 1 && start_dot == end - 1 &&
+              start_dot == start_part + 1)) {
+            name_len = start_dot - base_start;
+            ext_len = end - start_dot;
+        }
+    }
+    if (start_part > 0)
+        dir_len = start_part - 1;
+    else if (absolute)
+        dir_len = 1;
+
+    obj = JS_NewObject(ctx);
+    if (!JS_IsException(obj)) {
+        JS_DefinePropertyValueStr(ctx, obj, "root", JS_NewStringLen(ctx, s, absolute), JS_PROP_C_W_E);
+        JS_DefinePropertyValueStr(ctx, obj, "dir", JS_NewStringLen(ctx, s, dir_len), JS_PROP_C_W_E);
+        JS_DefinePropertyValueStr(ctx, obj, "base", JS_NewStringLen(ctx, s + base_start, base_len), JS_PROP_C_W_E);
+        JS_DefinePropertyValueStr(ctx, obj, "ext", JS_NewStringLen(ctx, s + base_start + name_len, ext_len), JS_PROP_C_W_E);
+        JS_DefinePropertyValueStr(ctx, obj, "name", JS_NewStringLen(ctx, s + base_start, name_len), JS_PROP_C_W_E);
+    }
+    JS_FreeCString(ctx, a.s);
+    return obj;
+}
+
+/* a string property of the path.format() argument, "" when missing */
+static int js_path_get_field(JSContext *ctx, PathArg *a, JSValueConst obj,
+                             const char *name)
+{
+    JSValue v = JS_GetPropertyStr(ctx, obj, name);
+
+    a->s = NULL;
+    a->len = 0;
+    if (JS_IsException(v))
+        return -1;
+    if (!JS_IsUndefined(v) && !JS_IsNull(v)) {
+        a->s = JS_ToCStringLen(ctx, &a->len, v);
+        if (!a->s) {
+            JS_FreeValue(ctx, v);
+            return -1;
+        }
+    }
+    JS_FreeValue(ctx, v);
+    return 0;
+}
+
+/* path.format({ root, dir, base, name, ext }) */
+static JSValue js_path_format(JSContext *ctx, JSValueConst this_val,
+                              int argc, JSValueConst *argv)
+{
+    static const char *const names[] = { "root", "dir", "base", "name", "ext" };
+    enum { ROOT, DIR, BASE, NAME, EXT };
+    PathArg f[5];
+    char stack_buf[512], *buf = NULL;
+    const PathArg *dir;
+    size_t len = 0;
+    JSValue val = JS_EXCEPTION;
+    int i, n = 0;
+
+    if (!JS_IsObject(argv[0]))
+        return JS_ThrowTypeError(ctx, "The \"pathObject\" argument must be of type object");
+    for (n = 0; n < 5; n++) {
+        if (js_path_get_field(ctx, &f[n], argv[0], names[n]))
+            goto done;
+    }
+    dir = f[DIR].len ? &f[DIR] : &f[ROOT];
+    buf = js_path_buffer(ctx, stack_buf, sizeof(stack_buf),
+                         dir->len + f[BASE].len + f[NAME].len + f[EXT].len + 2);
+    if (!buf)
+        goto done;
+    if (dir->len) {
+        memcpy(buf, dir->s, dir->len);
+        len = dir->len;
+        /* no separator after the root itself */
+        if (!(dir->len == f[ROOT].len && !memcmp(dir->s, f[ROOT].s, dir->len)))
+            buf[len++] = '/';
+    }
+    if (f[BASE].len) {
+        memcpy(buf + len, f[BASE].s, f[BASE].len);
+        len += f[BASE].len;
+    } else {
+        memcpy(buf + len, f[NAME].s, f[NAME].len);
+        len += f[NAME].len;
+        if (f[EXT].len && f[EXT].s[0] != '.')
+            buf[len++] = '.';
+        memcpy(buf + len, f[EXT].s, f[EXT].len);
+        len += f[EXT].len;
+    }
+    val = js_path_result(ctx, buf, len, stack_buf);
+    buf = NULL;
+ done:
+    for (i = 0; i < n; i++) {
+        if (f[i].s)
+            JS_FreeCString(ctx, f[i].s);
+    }
+    if (buf && buf != stack_buf)
+        js_free(ctx, buf);
+    return val;
+}
+
+static JSValue js_path_identity(JSContext *ctx, JSValueConst this_val,
+                                int argc, JSValueConst *argv)
+{
+    return JS_DupValue(ctx, argv[0]);
+}
+
+static const JSCFunctionListEntry js_path_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("join", 0, js_path_join_resolve, 0 ),
+    JS_CFUNC_MAGIC_DEF("resolve", 0, js_path_join_resolve, 1 ),
+    JS_CFUNC_DEF("normalize", 1, js_path_normalize ),
+    JS_CFUNC_DEF("relative", 2, js_path_relative ),
+    JS_CFUNC_DEF("dirname", 1, js_path_dirname ),
+    JS_CFUNC_DEF("basename", 2, js_path_basename ),
+    JS_CFUNC_DEF("extname", 1, js_path_extname ),
+    JS_CFUNC_DEF("isAbsolute", 1, js_path_is_absolute ),
+    JS_CFUNC_DEF("parse", 1, js_path_parse ),
+    JS_CFUNC_DEF("format", 1, js_path_format ),
+    JS_CFUNC_DEF("toNamespacedPath", 1, js_path_identity ),
+    JS_PROP_STRING_DEF("sep", "/", 0 ),
+    JS_PROP_STRING_DEF("delimiter", ":", 0 ),
+};
+
+static int js_path_init(JSContext *ctx, JSModuleDef *m)
+{
+    return JS_SetModuleExportList(ctx, m, js_path_funcs, countof(js_path_funcs));
+}
+
+JSModuleDef *js_init_module_qjsx_path(JSContext *ctx, const char *module_name)
+{
+    JSModuleDef *m;
+    m = JS_NewCModule(ctx, module_name, js_path_init);
+    if (!m)
+        return NULL;
+    JS_AddModuleExportList(ctx, m, js_path_funcs, countof(js_path_funcs));
+    return m;
+}
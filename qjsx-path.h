@@ -0,0 +1,249 @@
+/*
+ * QJSX path manipulation
+ *
+ * POSIX path primitives with the semantics of Node.js's path module, shared
+ * by the module resolver (qjsx-module-resolution.h), import.meta.dirname
+ * (quickjs-libc.patch) and the qjsx:path module behind node:path. They work
+ * on byte strings of known length and write into caller-provided buffers,
+ * so none of them allocates.
+ */
+
+#ifndef QJSX_PATH_H
+#define QJSX_PATH_H
+
+#include <stddef.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define QJSX_PATH_IS_SEP(c) ((c) == '/' || (c) == '\\')
+#else
+#define QJSX_PATH_IS_SEP(c) ((c) == '/')
+#endif
+
+/*
+ * Collapse "//", "." and ".." in path[0..len) into dst, without the leading
+ * and trailing separators (Node's normalizeString()). ".." segments that
+ * would go above the start are kept when allow_above_root is set and dropped
+ * otherwise. dst may be path itself; the result is never longer than the
+ * input. Returns the length written.
+ */
+static inline size_t qjsx_path_normalize_segments(char *dst, const char *path,
+                                                  size_t len, int allow_above_root) {
+    size_t res = 0, last_segment = 0, i;
+    ptrdiff_t last_slash = -1;
+    int dots = 0;
+    char c = 0;
+
+    for (i = 0; i <= len; i++) {
+        if (i < len)
+            c = path[i];
+        else if (QJSX_PATH_IS_SEP(c))
+            break;
+        else
+            c = '/';
+        if (QJSX_PATH_IS_SEP(c)) {
+            if (last_slash == (ptrdiff_t)i - 1 || dots == 1) {
+                /* empty or "." segment */
+            } else if (dots == 2) {
+                if (res < 2 || last_segment != 2 || dst[res - 1] != '.' ||
+                    dst[res - 2] != '.') {
+                    if (res > 2) {
+                        /* drop the last segment */
+                        while (res > 0 && dst[res - 1] != '/')
+                            res--;
+                        res = res > 0 ? res - 1 : 0;
+                        last_segment = res;
+                        for (size_t j = res; j > 0; j--) {
+                            if (dst[j - 1] == '/') {
+                                last_segment = res - j;
+                                break;
+                            }
+                        }
+                        last_slash = i;
+                        dots = 0;
+                        continue;
+                    } else if (res != 0) {
+                        res = 0;
+                        last_segment = 0;
+                        last_slash = i;
+                        dots = 0;
+                        continue;
+                    }
+                }
+                if (allow_above_root) {
+                    if (res > 0)
+                        dst[res++] = '/';
+                    dst[res++] = '.';
+                    dst[res++] = '.';
+                    last_segment = 2;
+                }
+            } else {
+                size_t seg = i - last_slash - 1;
+                if (res > 0)
+                    dst[res++] = '/';
+                memmove(dst + res, path + last_slash + 1, seg);
+                res += seg;
+                last_segment = seg;
+            }
+            last_slash = i;
+            dots = 0;
+        } else if (c == '.' && dots != -1) {
+            dots++;
+        } else {
+            dots = -1;
+        }
+    }
+    return res;
+}
+
+/*
+ * path.normalize(): dst needs room for len + 1 bytes (an empty path becomes
+ * "."), and may be path itself. Returns the length of the result.
+ */
+static inline size_t qjsx_path_normalize(char *dst, const char *path, size_t len) {
+    int absolute, trailing;
+    size_t res;
+
+    if (len == 0) {
+        dst[0] = '.';
+        return 1;
+    }
+    absolute = QJSX_PATH_IS_SEP(path[0]);
+    trailing = QJSX_PATH_IS_SEP(path[len - 1]);
+    res = qjsx_path_normalize_segments(dst + absolute, path, len, !absolute);
+    if (absolute && res == 0)
+        trailing = 0;   /* "/" */
+    if (absolute)
+        dst[0] = '/';
+    else if (res == 0)
+        dst[res++] = '.';
+    res += absolute;
+    if (trailing)
+        dst[res++] = '/';
+    return res;
+}
+
+/*
+ * Length of path.dirname(path) as a prefix of path, or 0 when it is "."
+ * (a relative path without a directory part).
+ */
+static inline size_t qjsx_path_dirname(const char *path, size_t len) {
+    int has_root, matched_slash = 1;
+    size_t i;
+
+    if (len == 0)
+        return 0;
+    has_root = QJSX_PATH_IS_SEP(path[0]);
+    for (i = len - 1; i >= 1; i--) {
+        if (QJSX_PATH_IS_SEP(path[i])) {
+            if (!matched_slash)
+                return has_root && i == 1 ? 2 : i;
+        } else {
+            matched_slash = 0;
+        }
+    }
+    return has_root;
+}
+
+/*
+ * path.basename(path, suffix): sets *start and returns the length of the
+ * last segment, without suffix when it ends in it (suffix may be NULL).
+ */
+static inline size_t qjsx_path_basename(const char *path, size_t len,
+                                        const char *suffix, size_t suffix_len,
+                                        size_t *start) {
+    ptrdiff_t i, s = 0, e = -1, ext_idx, first_non_slash_end = -1;
+    int matched_slash = 1;
+
+    if (suffix && suffix_len > 0 && suffix_len <= len) {
+        if (suffix_len == len && !memcmp(suffix, path, len)) {
+            *start = 0;
+            return 0;
+        }
+        ext_idx = suffix_len - 1;
+        for (i = len - 1; i >= 0; i--) {
+            if (QJSX_PATH_IS_SEP(path[i])) {
+                if (!matched_slash) {
+                    s = i + 1;
+                    break;
+                }
+            } else {
+                if (first_non_slash_end == -1) {
+                    matched_slash = 0;
+                    first_non_slash_end = i + 1;
+                }
+                if (ext_idx >= 0) {
+                    if (path[i] == suffix[ext_idx]) {
+                        if (--ext_idx == -1)
+                            e = i;
+                    } else {
+                        ext_idx = -1;
+                        e = first_non_slash_end;
+                    }
+                }
+            }
+        }
+        if (s == e)
+            e = first_non_slash_end;
+        else if (e == -1)
+            e = len;
+    } else {
+        for (i = len - 1; i >= 0; i--) {
+            if (QJSX_PATH_IS_SEP(path[i])) {
+                if (!matched_slash) {
+                    s = i + 1;
+                    break;
+                }
+            } else if (e == -1) {
+                matched_slash = 0;
+                e = i + 1;
+            }
+        }
+        if (e == -1)
+            e = s;
+    }
+    *start = s;
+    return e > s ? e - s : 0;
+}
+
+/*
+ * path.extname(): the extension of the last segment is path[start..*end),
+ * where start is the return value; *end is 0 when there is none (no dot,
+ * or only a leading one as in ".profile").
+ */
+static inline size_t qjsx_path_extname(const char *path, size_t len, size_t *end) {
+    ptrdiff_t i, start_dot = -1, e = -1, start_part = 0;
+    int matched_slash = 1, pre_dot_state = 0;
+
+    for (i = (ptrdiff_t)len - 1; i >= 0; i--) {
+        char c = path[i];
+        if (QJSX_PATH_IS_SEP(c)) {
+            if (!matched_slash) {
+                start_part = i + 1;
+                break;
+            }
+            continue;
+        }
+        if (e == -1) {
+            matched_slash = 0;
+            e = i + 1;
+        }
+        if (c == '.') {
+            if (start_dot == -1)
+                start_dot = i;
+            else if (pre_dot_state != 1)
+                pre_dot_state = 1;
+        } else if (start_dot != -1) {
+            pre_dot_state = -1;
+        }
+    }
+    if (start_dot == -1 || e == -1 || pre_dot_state == 0 ||
+        (pre_dot_state == 1 && start_dot == e - 1 && start_dot == start_part + 1)) {
+        *end = 0;
+        return 0;
+    }
+    *end = e;
+    return start_dot;
+}
+
+#endif /* QJSX_PATH_H */
@@ -0,0 +1,942 @@
+/*
+ * QJSX performance global
+ *
+ * The User Timing part of the web's performance API, installed as globals
+ * of every context by js_std_add_helpers() (see qjsx-perf.h), in qjsx,
+ * qjsx-node and the programs of qjsxc:
+ *
+ *   performance.now()                     -> ms since timeOrigin, monotonic,
+ *                                            to the nanosecond
+ *   performance.timeOrigin                -> ms since the epoch when the
+ *                                            process started
+ *   performance.mark(name, { startTime, detail })
+ *   performance.measure(name, startMark, endMark)
+ *   performance.measure(name, { start, end, duration, detail })
+ *   performance.getEntries(), getEntriesByName(name, type),
+ *   getEntriesByType(type)                -> entries by startTime
+ *   performance.clearMarks(name), clearMeasures(name)
+ *
+ *   new PerformanceObserver((list, observer) => ...)
+ *   observer.observe({ entryTypes: ["mark", "measure"] })
+ *   observer.observe({ type: "mark", buffered: true })
+ *   observer.takeRecords(), observer.disconnect()
+ *
+ * mark() and measure() are meant for hot paths: they read the clock and
+ * append (name atom, type, times, detail) to a ring buffer of at most
+ * PERF_BUFFER_SIZE entries, dropping the oldest, and return undefined
+ * where the web returns the entry. Entry objects are only made by
+ * getEntries*() and for observers.
+ *
+ * An observer collects the entries of its types as they are added; the
+ * event loop (qjsx_loop_poll()) calls it once a turn with those collected
+ * since, as Node.js does from an immediate.
+ *
+ * The buffer belongs to the first context of a thread; workers do not get
+ * the globals.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "quickjs/cutils.h"
+#include "quickjs/quickjs.h"
+#include "quickjs/quickjs-libc.h"
+#include "qjsx-perf.h"
+
+/* entries kept by the performance object, a power of 2 */
+#define PERF_BUFFER_SIZE  16384
+
+/* entry types, as bits of the types an observer observes */
+enum {
+    PERF_MARK = 1,
+    PERF_MEASURE = 2,
+};
+
+typedef struct {
+    JSAtom name;
+    int type;
+    double start, duration;     /* ms since timeOrigin */
+    JSValue detail;
+} PerfEntry;
+
+/* a growable array of entries, the records of an observer */
+typedef struct {
+    PerfEntry *entries;
+    uint32_t count, size;
+} PerfList;
+
+/* an entry to return, with the order it was added in */
+typedef struct {
+    PerfEntry *e;
+    uint32_t order;
+} PerfRef;
+
+typedef struct PerfObserver {
+    struct PerfObserver *next;  /* in the list of perf while observing */
+    struct QJSXPerf *perf;      /* NULL once it is gone */
+    JSValue perf_obj;
+    JSValue obj;                /* held while observing */
+    JSValue callback;
+    int types;
+    PerfList records;
+} PerfObserver;
+
+typedef struct QJSXPerf {
+    JSContext *ctx;
+    PerfEntry *entries;         /* ring of size entries */
+    uint32_t head, count, size;
+    PerfObserver *observers;
+    int pending;                /* observers have records to deliver */
+} QJSXPerf;
+
+static JSClassID js_perf_class_id, js_perf_observer_class_id, js_perf_list_class_id;
+
+/* the buffer qjsx_perf_deliver() delivers in this thread */
+static __thread QJSXPerf *perf_current;
+
+/* timeOrigin, as CLOCK_MONOTONIC ns and ms since the epoch */
+static int64_t perf_origin;
+static double perf_origin_epoch;
+
+static const char *const perf_type_names[] = { NULL, "mark", "measure" };
+
+static int64_t perf_clock(clockid_t id)
+{
+    struct timespec ts;
+
+    clock_gettime(id, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static double perf_now(void)
+{
+    return (perf_clock(CLOCK_MONOTONIC) - perf_origin) / 1e6;
+}
+
+static int perf_type(JSContext *ctx, JSValueConst val)
+{
+    const char *s = JS_ToCString(ctx, val);
+    int type = 0;
+
+    if (!s)
+        return -1;
+    if (!strcmp(s, "mark"))
+        type = PERF_MARK;
+    else if (!strcmp(s, "measure"))
+        type = PERF_MEASURE;
+    JS_FreeCString(ctx, s);
+    return type;
+}
+
+static void perf_entry_free(JSRuntime *rt, PerfEntry *e)
+{
+    JS_FreeAtomRT(rt, e->name);
+    JS_FreeValueRT(rt, e->detail);
+}
+
+static PerfEntry *perf_at(QJSXPerf *p, uint32_t i)
+{
+    return &p->entries[(p->head + i) & (p->size - 1)];
+}
+
+static int perf_list_push(JSContext *ctx, PerfList *l, const PerfEntry *e)
+{
+    PerfEntry *entries;
+    uint32_t size;
+
+    if (l->count == l->size) {
+        size = l->size ? l->size * 2 : 16;
+        entries = js_realloc(ctx, l->entries, size * sizeof(*entries));
+        if (!entries)
+            return -1;
+        l->entries = entries;
+        l->size = size;
+    }
+    l->entries[l->count] = *e;
+    l->entries[l->count].name = JS_DupAtom(ctx, e->name);
+    l->entries[l->count].detail = JS_DupValue(ctx, e->detail);
+    l->count++;
+    return 0;
+}
+
+static void perf_list_free(JSRuntime *rt, PerfList *l)
+{
+    uint32_t i;
+
+    for (i = 0; i < l->count; i++)
+        perf_entry_free(rt, &l->entries[i]);
+    js_free_rt(rt, l->entries);
+    l->entries = NULL;
+    l->count = l->size = 0;
+}
+
+static void perf_list_mark(JSRuntime *rt, PerfList *l, JS_MarkFunc *mark_func)
+{
+    uint32_t i;
+
+    for (i = 0; i < l->count; i++)
+        JS_MarkValue(rt, l->entries[i].detail, mark_func);
+}
+
+/* append an entry, taking name and detail, and hand it to the observers */
+static int perf_append(JSContext *ctx, QJSXPerf *p, JSAtom name, int type,
+                       double start, double duration, JSValue detail)
+{
+    PerfObserver *obs;
+    PerfEntry *e, *entries;
+    uint32_t size;
+
+    if (p->count == p->size) {
+        if (p->size == PERF_BUFFER_SIZE) {
+            /* full: the oldest entry makes room */
+            perf_entry_free(JS_GetRuntime(ctx), perf_at(p, 0));
+            p->head = (p->head + 1) & (p->size - 1);
+            p->count--;
+        } else {
+            size = p->size ? p->size * 2 : 64;
+            entries = js_malloc(ctx, size * sizeof(*entries));
+            if (!entries) {
+                JS_FreeAtom(ctx, name);
+                JS_FreeValue(ctx, detail);
+                return -1;
+            }
+            if (p->size) {
+                /* unwrap the ring at the start of the new one */
+                memcpy(entries, p->entries + p->head, (p->size - p->head) * sizeof(*entries));
+                memcpy(entries + p->size - p->head, p->entries, p->head * sizeof(*entries));
+                js_free(ctx, p->entries);
+            }
+            p->entries = entries;
+            p->head = 0;
+            p->size = size;
+        }
+    }
+    e = perf_at(p, p->count++);
+    e->name = name;
+    e->type = type;
+    e->start = start;
+    e->duration = duration;
+    e->detail = detail;
+    for (obs = p->observers; obs; obs = obs->next) {
+        if ((obs->types & type) && perf_list_push(ctx, &obs->records, e) == 0)
+            p->pending = TRUE;
+    }
+    return 0;
+}
+
+/* the start of the last mark called name, or name itself if it is a
+   number and numbers are timestamps */
+static int perf_mark_time(JSContext *ctx, QJSXPerf *p, JSValueConst name,
+                          int timestamps, double *t)
+{
+    const char *s;
+    JSAtom atom;
+    uint32_t i;
+
+    if (timestamps && JS_IsNumber(name)) {
+        if (JS_ToFloat64(ctx, t, name))
+            return -1;
+        if (*t < 0) {
+            JS_ThrowTypeError(ctx, "%g is a negative timestamp", *t);
+            return -1;
+        }
+        return 0;
+    }
+    atom = JS_ValueToAtom(ctx, name);
+    if (atom == JS_ATOM_NULL)
+        return -1;
+    for (i = p->count; i-- > 0;) {
+        PerfEntry *e = perf_at(p, i);
+        if (e->type == PERF_MARK && e->name == atom) {
+            *t = e->start;
+            JS_FreeAtom(ctx, atom);
+            return 0;
+        }
+    }
+    JS_FreeAtom(ctx, atom);
+    s = JS_ToCString(ctx, name);
+    JS_ThrowSyntaxError(ctx, "The \"%s\" performance mark has not been set", s ? s : "?");
+    JS_FreeCString(ctx, s);
+    return -1;
+}
+
+static JSAtom perf_name(JSContext *ctx, JSValueConst name)
+{
+    if (JS_IsSymbol(name)) {
+        JS_ThrowTypeError(ctx, "Cannot convert a Symbol value to a string");
+        return JS_ATOM_NULL;
+    }
+    return JS_ValueToAtom(ctx, name);
+}
+
+/* an optional property of options: 1 if set, 0 if undefined, -1 on error */
+static int perf_option(JSContext *ctx, JSValueConst options, const char *prop, JSValue *val)
+{
+    *val = JS_GetPropertyStr(ctx, options, prop);
+    if (JS_IsException(*val))
+        return -1;
+    return !JS_IsUndefined(*val);
+}
+
+static JSValue js_perf_now(JSContext *ctx, JSValueConst this_val,
+                           int argc, JSValueConst *argv)
+{
+    return JS_NewFloat64(ctx, perf_now());
+}
+
+/* mark(name, { startTime, detail }) */
+static JSValue js_perf_mark(JSContext *ctx, JSValueConst this_val,
+                            int argc, JSValueConst *argv, int magic, JSValue *func_data)
+{
+    QJSXPerf *p = JS_GetOpaque(func_data[0], js_perf_class_id);
+    JSValue detail = JS_NULL, val;
+    double start = perf_now();
+    JSAtom name;
+    int ret;
+
+    name = perf_name(ctx, argv[0]);
+    if (name == JS_ATOM_NULL)
+        return JS_EXCEPTION;
+    if (argc > 1 && JS_IsObject(argv[1])) {
+        ret = perf_option(ctx, argv[1], "startTime", &val);
+        if (ret > 0) {
+            ret = JS_ToFloat64(ctx, &start, val) ? -1 : 0;
+            if (!ret && start < 0) {
+                JS_ThrowTypeError(ctx, "%g is a negative startTime", start);
+                ret = -1;
+            }
+        }
+        JS_FreeValue(ctx, val);
+        if (ret >= 0 && perf_option(ctx, argv[1], "detail", &val) > 0)
+            detail = val;
+        else if (ret >= 0 && JS_IsException(val))
+            ret = -1;
+        if (ret < 0) {
+            JS_FreeAtom(ctx, name);
+            return JS_EXCEPTION;
+        }
+    }
+    if (perf_append(ctx, p, name, PERF_MARK, start, 0, detail))
+        return JS_EXCEPTION;
+    return JS_UNDEFINED;
+}
+
+/* measure(name, startMark, endMark) or measure(name, { start, end,
+   duration, detail }); start and end are names of marks or timestamps,
+   startMark and endMark names of marks */
+static JSValue js_perf_measure(JSContext *ctx, JSValueConst this_val,
+                               int argc, JSValueConst *argv, int magic, JSValue *func_data)
+{
+    QJSXPerf *p = JS_GetOpaque(func_data[0], js_perf_class_id);
+    JSValueConst start_or_options = argc > 1 ? argv[1] : JS_UNDEFINED;
+    JSValueConst end_mark = argc > 2 ? argv[2] : JS_UNDEFINED;
+    JSValue start_val = JS_UNDEFINED, end_val = JS_UNDEFINED;
+    JSValue duration_val = JS_UNDEFINED, detail = JS_NULL;
+    double start = 0, end = 0, duration = 0;
+    int has_start = 0, has_end = 0, has_duration = 0, has_detail = 0;
+    JSAtom name;
+
+    name = perf_name(ctx, argv[0]);
+    if (name == JS_ATOM_NULL)
+        return JS_EXCEPTION;
+    if (JS_IsObject(start_or_options)) {
+        if ((has_start = perf_option(ctx, start_or_options, "start", &start_val)) < 0 ||
+            (has_end = perf_option(ctx, start_or_options, "end", &end_val)) < 0 ||
+            (has_duration = perf_option(ctx, start_or_options, "duration", &duration_val)) < 0 ||
+            (has_detail = perf_option(ctx, start_or_options, "detail", &detail)) < 0)
+            goto fail;
+        if (!has_detail)
+            detail = JS_NULL;
+        if (has_start || has_end || has_duration || has_detail) {
+            /* non-empty options, as on the web */
+            if (!JS_IsUndefined(end_mark)) {
+                JS_ThrowTypeError(ctx, "endMark must be undefined when options are given");
+                goto fail;
+            }
+            if (!has_start && !has_end) {
+                JS_ThrowTypeError(ctx, "options must have start or end");
+                goto fail;
+            }
+        }
+        if (has_start && has_end && has_duration) {
+            JS_ThrowTypeError(ctx, "options cannot have start, end and duration");
+            goto fail;
+        }
+        if ((has_duration && JS_ToFloat64(ctx, &duration, duration_val)) ||
+            (has_start && perf_mark_time(ctx, p, start_val, TRUE, &start)) ||
+            (has_end && perf_mark_time(ctx, p, end_val, TRUE, &end)))
+            goto fail;
+        if (!has_end && !has_duration && !JS_IsUndefined(end_mark)) {
+            if (perf_mark_time(ctx, p, end_mark, FALSE, &end))
+                goto fail;
+        } else if (!has_end) {
+            end = has_duration ? start + duration : perf_now();
+        }
+        if (!has_start)
+            start = has_duration ? end - duration : 0;
+    } else {
+        if (!JS_IsUndefined(start_or_options) &&
+            perf_mark_time(ctx, p, start_or_options, FALSE, &start))
+            goto fail;
+        if (JS_IsUndefined(end_mark))
+            end = perf_now();
+        else if (perf_mark_time(ctx, p, end_mark, FALSE, &end))
+            goto fail;
+    }
+    JS_FreeValue(ctx, start_val);
+    JS_FreeValue(ctx, end_val);
+    JS_FreeValue(ctx, duration_val);
+    if (perf_append(ctx, p, name, PERF_MEASURE, start, end - start, detail))
+        return JS_EXCEPTION;
+    return JS_UNDEFINED;
+ fail:
+    JS_FreeAtom(ctx, name);
+    JS_FreeValue(ctx, start_val);
+    JS_FreeValue(ctx, end_val);
+    JS_FreeValue(ctx, duration_val);
+    JS_FreeValue(ctx, detail);
+    return JS_EXCEPTION;
+}
+
+static JSValue perf_entry_object(JSContext *ctx, const PerfEntry *e)
+{
+    JSValue obj = JS_NewObject(ctx);
+
+    if (JS_IsException(obj))
+        return obj;
+    JS_DefinePropertyValueStr(ctx, obj, "name", JS_AtomToString(ctx, e->name), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "entryType", JS_NewString(ctx, perf_type_names[e->type]), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "startTime", JS_NewFloat64(ctx, e->start), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "duration", JS_NewFloat64(ctx, e->duration), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "detail", JS_DupValue(ctx, e->detail), JS_PROP_C_W_E);
+    return obj;
+}
+
+static int perf_entry_cmp(const void *a, const void *b)
+{
+    const PerfRef *x = a, *y = b;
+
+    if (x->e->start != y->e->start)
+        return x->e->start < y->e->start ? -1 : 1;
+    return x->order < y->order ? -1 : x->order > y->order;
+}
+
+/* the entries of list (n of them, in the order they were added) that match
+   getEntries() (magic 0), getEntriesByName(name, type) (1) or
+   getEntriesByType(type) (2), as an array sorted by startTime */
+static JSValue perf_entries(JSContext *ctx, PerfRef *list, uint32_t n,
+                            int magic, int argc, JSValueConst *argv)
+{
+    JSAtom name = JS_ATOM_NULL;
+    JSValue arr, obj;
+    uint32_t i, j;
+    int type = 0;
+
+    if (magic == 1) {
+        name = perf_name(ctx, argv[0]);
+        if (name == JS_ATOM_NULL)
+            return JS_EXCEPTION;
+    }
+    if ((magic == 1 && argc > 1 && !JS_IsUndefined(argv[1])) || magic == 2) {
+        type = perf_type(ctx, argv[magic == 1 ? 1 : 0]);
+        if (type < 0) {
+            JS_FreeAtom(ctx, name);
+            return JS_EXCEPTION;
+        }
+        if (type == 0)
+            n = 0;      /* an entry type without entries */
+    }
+    for (i = j = 0; i < n; i++) {
+        if ((!type || list[i].e->type == type) && (name == JS_ATOM_NULL || list[i].e->name == name))
+            list[j++] = list[i];
+    }
+    JS_FreeAtom(ctx, name);
+    /* (entries are mostly added in order already) */
+    qsort(list, j, sizeof(*list), perf_entry_cmp);
+    arr = JS_NewArray(ctx);
+    for (i = 0; i < j && !JS_IsException(arr); i++) {
+        obj = perf_entry_object(ctx, list[i].e);
+        if (JS_IsException(obj) || JS_SetPropertyUint32(ctx, arr, i, obj) < 0) {
+            JS_FreeValue(ctx, arr);
+            arr = JS_EXCEPTION;
+        }
+    }
+    return arr;
+}
+
+/* getEntries(), getEntriesByName(name, type), getEntriesByType(type) */
+static JSValue js_perf_get_entries(JSContext *ctx, JSValueConst this_val,
+                                   int argc, JSValueConst *argv, int magic, JSValue *func_data)
+{
+    QJSXPerf *p = JS_GetOpaque(func_data[0], js_perf_class_id);
+    PerfRef *list;
+    JSValue arr;
+    uint32_t i;
+
+    list = js_malloc(ctx, (p->count + 1) * sizeof(*list));
+    if (!list)
+        return JS_EXCEPTION;
+    for (i = 0; i < p->count; i++)
+        list[i] = (PerfRef){ perf_at(p, i), i };
+    arr = perf_entries(ctx, list, p->count, magic, argc, argv);
+    js_free(ctx, list);
+    return arr;
+}
+
+/* clearMarks(name), clearMeasures(name): all of them without a name */
+static JSValue js_perf_clear(JSContext *ctx, JSValueConst this_val,
+                             int argc, JSValueConst *argv, int magic, JSValue *func_data)
+{
+    QJSXPerf *p = JS_GetOpaque(func_data[0], js_perf_class_id);
+    JSAtom name = JS_ATOM_NULL;
+    uint32_t i, n = 0;
+    PerfEntry *e;
+
+    if (argc > 0 && !JS_IsUndefined(argv[0])) {
+        name = perf_name(ctx, argv[0]);
+        if (name == JS_ATOM_NULL)
+            return JS_EXCEPTION;
+    }
+    for (i = 0; i < p->count; i++) {
+        e = perf_at(p, i);
+        if (e->type == magic && (name == JS_ATOM_NULL || e->name == name))
+            perf_entry_free(JS_GetRuntime(ctx), e);
+        else
+            *perf_at(p, n++) = *e;
+    }
+    p->count = n;
+    JS_FreeAtom(ctx, name);
+    return JS_UNDEFINED;
+}
+
+static JSValue js_perf_to_json(JSContext *ctx, JSValueConst this_val,
+                               int argc, JSValueConst *argv)
+{
+    JSValue obj = JS_NewObject(ctx);
+
+    if (JS_IsException(obj))
+        return obj;
+    JS_DefinePropertyValueStr(ctx, obj, "timeOrigin", JS_NewFloat64(ctx, perf_origin_epoch), JS_PROP_C_W_E);
+    return obj;
+}
+
+/* the entries of an observer's callback */
+static void js_perf_list_finalizer(JSRuntime *rt, JSValue val)
+{
+    PerfList *l = JS_GetOpaque(val, js_perf_list_class_id);
+
+    if (l) {
+        perf_list_free(rt, l);
+        js_free_rt(rt, l);
+    }
+}
+
+static void js_perf_list_mark(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func)
+{
+    PerfList *l = JS_GetOpaque(val, js_perf_list_class_id);
+
+    if (l)
+        perf_list_mark(rt, l, mark_func);
+}
+
+static JSValue js_perf_list_get_entries(JSContext *ctx, JSValueConst this_val,
+                                        int argc, JSValueConst *argv, int magic)
+{
+    PerfList *l = JS_GetOpaque2(ctx, this_val, js_perf_list_class_id);
+    PerfRef *list;
+    JSValue arr;
+    uint32_t i;
+
+    if (!l)
+        return JS_EXCEPTION;
+    list = js_malloc(ctx, (l->count + 1) * sizeof(*list));
+    if (!list)
+        return JS_EXCEPTION;
+    for (i = 0; i < l->count; i++)
+        list[i] = (PerfRef){ &l->entries[i], i };
+    arr = perf_entries(ctx, list, l->count, magic, argc, argv);
+    js_free(ctx, list);
+    return arr;
+}
+
+static void perf_observer_unlink(PerfObserver *obs)
+{
+    PerfObserver **pobs;
+
+    if (!obs->perf || JS_IsUndefined(obs->obj))
+        return;
+    for (pobs = &obs->perf->observers; *pobs; pobs = &(*pobs)->next) {
+        if (*pobs == obs) {
+            *pobs = obs->next;
+            break;
+        }
+    }
+    obs->next = NULL;
+}
+
+/* new PerformanceObserver(callback); func_data[0] is the performance object */
+static JSValue js_perf_observer_constructor(JSContext *ctx, JSValueConst new_target,
+                                            int argc, JSValueConst *argv, int magic, JSValue *func_data)
+{
+    QJSXPerf *p = JS_GetOpaque(func_data[0], js_perf_class_id);
+    PerfObserver *obs;
+    JSValue obj, proto;
+
+    if (!JS_IsFunction(ctx, argv[0]))
+        return JS_ThrowTypeError(ctx, "The \"callback\" argument must be of type function");
+    proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+    if (JS_IsException(proto))
+        return proto;
+    obj = JS_NewObjectProtoClass(ctx, proto, js_perf_observer_class_id);
+    JS_FreeValue(ctx, proto);
+    if (JS_IsException(obj))
+        return obj;
+    obs = js_mallocz(ctx, sizeof(*obs));
+    if (!obs) {
+        JS_FreeValue(ctx, obj);
+        return JS_EXCEPTION;
+    }
+    obs->perf = p;
+    obs->perf_obj = JS_DupValue(ctx, func_data[0]);
+    obs->obj = JS_UNDEFINED;
+    obs->callback = JS_DupValue(ctx, argv[0]);
+    JS_SetOpaque(obj, obs);
+    return obj;
+}
+
+/* observe({ entryTypes }) observes those types only, observe({ type,
+   buffered }) one more, with the entries already buffered */
+static JSValue js_perf_observer_observe(JSContext *ctx, JSValueConst this_val,
+                                        int argc, JSValueConst *argv)
+{
+    PerfObserver *obs = JS_GetOpaque2(ctx, this_val, js_perf_observer_class_id);
+    JSValue types, type_val, buffered, val;
+    int type, has_types, has_type, types_mask = 0;
+    uint32_t i, n;
+    QJSXPerf *p;
+
+    if (!obs)
+        return JS_EXCEPTION;
+    p = obs->perf;
+    if (!JS_IsObject(argv[0]))
+        return JS_ThrowTypeError(ctx, "options must be an object");
+    has_types = perf_option(ctx, argv[0], "entryTypes", &types);
+    if (has_types < 0)
+        return JS_EXCEPTION;
+    has_type = perf_option(ctx, argv[0], "type", &type_val);
+    if (has_type < 0 || has_type == has_types) {
+        JS_FreeValue(ctx, types);
+        JS_FreeValue(ctx, type_val);
+        if (has_type < 0)
+            return JS_EXCEPTION;
+        return JS_ThrowTypeError(ctx, "options must have either entryTypes or type");
+    }
+    if (has_types) {
+        /* unknown types are ignored, as on the web */
+        val = JS_GetPropertyStr(ctx, types, "length");
+        if (JS_ToUint32(ctx, &n, val)) {
+            JS_FreeValue(ctx, val);
+            JS_FreeValue(ctx, types);
+            return JS_EXCEPTION;
+        }
+        JS_FreeValue(ctx, val);
+        for (i = 0; i < n; i++) {
+            val = JS_GetPropertyUint32(ctx, types, i);
+            type = JS_IsException(val) ? -1 : perf_type(ctx, val);
+            JS_FreeValue(ctx, val);
+            if (type < 0) {
+                JS_FreeValue(ctx, types);
+                return JS_EXCEPTION;
+            }
+            types_mask |= type;
+        }
+        JS_FreeValue(ctx, types);
+        obs->types = types_mask;
+    } else {
+        type = perf_type(ctx, type_val);
+        JS_FreeValue(ctx, type_val);
+        if (type < 0)
+            return JS_EXCEPTION;
+        obs->types |= type;
+        buffered = JS_GetPropertyStr(ctx, argv[0], "buffered");
+        if (JS_ToBool(ctx, buffered) > 0 && type && p) {
+            for (i = 0; i < p->count; i++) {
+                if (perf_at(p, i)->type == type && perf_list_push(ctx, &obs->records, perf_at(p, i)) == 0)
+                    p->pending = TRUE;
+            }
+        }
+        JS_FreeValue(ctx, buffered);
+    }
+    if (p && obs->types && JS_IsUndefined(obs->obj)) {
+        /* an observer lives as long as it observes */
+        obs->obj = JS_DupValue(ctx, this_val);
+        obs->next = p->observers;
+        p->observers = obs;
+    }
+    return JS_UNDEFINED;
+}
+
+static JSValue js_perf_observer_disconnect(JSContext *ctx, JSValueConst this_val,
+                                           int argc, JSValueConst *argv)
+{
+    PerfObserver *obs = JS_GetOpaque2(ctx, this_val, js_perf_observer_class_id);
+    JSValue obj;
+
+    if (!obs)
+        return JS_EXCEPTION;
+    perf_list_free(JS_GetRuntime(ctx), &obs->records);
+    obs->types = 0;
+    if (!JS_IsUndefined(obs->obj)) {
+        perf_observer_unlink(obs);
+        obj = obs->obj;
+        obs->obj = JS_UNDEFINED;
+        JS_FreeValue(ctx, obj);
+    }
+    return JS_UNDEFINED;
+}
+
+/* takeRecords(): the entries not delivered yet */
+static JSValue js_perf_observer_take_records(JSContext *ctx, JSValueConst this_val,
+                                             int argc, JSValueConst *argv)
+{
+    PerfObserver *obs = JS_GetOpaque2(ctx, this_val, js_perf_observer_class_id);
+    PerfRef *list;
+    JSValue arr;
+    uint32_t i;
+
+    if (!obs)
+        return JS_EXCEPTION;
+    list = js_malloc(ctx, (obs->records.count + 1) * sizeof(*list));
+    if (!list)
+        return JS_EXCEPTION;
+    for (i = 0; i < obs->records.count; i++)
+        list[i] = (PerfRef){ &obs->records.entries[i], i };
+    arr = perf_entries(ctx, list, obs->records.count, 0, 0, NULL);
+    js_free(ctx, list);
+    perf_list_free(JS_GetRuntime(ctx), &obs->records);
+    return arr;
+}
+
+static void js_perf_observer_finalizer(JSRuntime *rt, JSValue val)
+{
+    PerfObserver *obs = JS_GetOpaque(val, js_perf_observer_class_id);
+
+    if (!obs)
+        return;
+    perf_observer_unlink(obs);
+    JS_FreeValueRT(rt, obs->perf_obj);
+    JS_FreeValueRT(rt, obs->callback);
+    perf_list_free(rt, &obs->records);
+    js_free_rt(rt, obs);
+}
+
+static void js_perf_observer_mark(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func)
+{
+    PerfObserver *obs = JS_GetOpaque(val, js_perf_observer_class_id);
+
+    if (obs) {
+        JS_MarkValue(rt, obs->perf_obj, mark_func);
+        JS_MarkValue(rt, obs->callback, mark_func);
+        perf_list_mark(rt, &obs->records, mark_func);
+    }
+}
+
+int qjsx_perf_pending(void)
+{
+    return perf_current && perf_current->pending;
+}
+
+int qjsx_perf_deliver(JSContext *ctx)
+{
+    QJSXPerf *p = perf_current;
+    JSValue *objs, list, args[2], ret;
+    PerfObserver *obs;
+    PerfList *l;
+    int i, n = 0;
+
+    if (!p || !p->pending)
+        return 0;
+    p->pending = FALSE;
+    ctx = p->ctx;
+    /* the callbacks may disconnect and observe: call those of now */
+    for (obs = p->observers; obs; obs = obs->next)
+        n++;
+    objs = js_malloc(ctx, (n + 1) * sizeof(*objs));
+    if (!objs)
+        return 0;
+    for (obs = p->observers, n = 0; obs; obs = obs->next) {
+        if (obs->records.count > 0)
+            objs[n++] = JS_DupValue(ctx, obs->obj);
+    }
+    for (i = 0; i < n; i++) {
+        obs = JS_GetOpaque(objs[i], js_perf_observer_class_id);
+        if (obs->records.count == 0)
+            continue;   /* taken or disconnected by a callback before */
+        list = JS_NewObjectClass(ctx, js_perf_list_class_id);
+        l = js_mallocz(ctx, sizeof(*l));
+        if (JS_IsException(list) || !l) {
+            JS_FreeValue(ctx, list);
+            js_free(ctx, l);
+            js_std_dump_error(ctx);
+            continue;
+        }
+        *l = obs->records;
+        memset(&obs->records, 0, sizeof(obs->records));
+        JS_SetOpaque(list, l);
+        args[0] = list;
+        args[1] = objs[i];
+        ret = JS_Call(ctx, obs->callback, objs[i], 2, (JSValueConst *)args);
+        if (JS_IsException(ret))
+            js_std_dump_error(ctx);
+        JS_FreeValue(ctx, ret);
+        JS_FreeValue(ctx, list);
+    }
+    for (i = 0; i < n; i++)
+        JS_FreeValue(ctx, objs[i]);
+    js_free(ctx, objs);
+    return n > 0;
+}
+
+static void js_perf_finalizer(JSRuntime *rt, JSValue val)
+{
+    QJSXPerf *p = JS_GetOpaque(val, js_perf_class_id);
+    PerfObserver *obs, *next;
+
+    if (!p)
+        return;
+    if (perf_current == p)
+        perf_current = NULL;
+    for (obs = p->observers; obs; obs = next) {
+        next = obs->next;
+        obs->next = NULL;
+        obs->perf = NULL;
+        JS_FreeValueRT(rt, obs->obj);
+        obs->obj = JS_UNDEFINED;
+    }
+    while (p->count > 0)
+        perf_entry_free(rt, perf_at(p, --p->count));
+    js_free_rt(rt, p->entries);
+    js_free_rt(rt, p);
+}
+
+static void js_perf_mark_values(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func)
+{
+    QJSXPerf *p = JS_GetOpaque(val, js_perf_class_id);
+    PerfObserver *obs;
+    uint32_t i;
+
+    if (!p)
+        return;
+    for (i = 0; i < p->count; i++)
+        JS_MarkValue(rt, perf_at(p, i)->detail, mark_func);
+    for (obs = p->observers; obs; obs = obs->next)
+        JS_MarkValue(rt, obs->obj, mark_func);
+}
+
+static JSClassDef js_perf_class = {
+    "Performance",
+    .finalizer = js_perf_finalizer,
+    .gc_mark = js_perf_mark_values,
+};
+
+static JSClassDef js_perf_observer_class = {
+    "PerformanceObserver",
+    .finalizer = js_perf_observer_finalizer,
+    .gc_mark = js_perf_observer_mark,
+};
+
+static JSClassDef js_perf_list_class = {
+    "PerformanceObserverEntryList",
+    .finalizer = js_perf_list_finalizer,
+    .gc_mark = js_perf_list_mark,
+};
+
+static const JSCFunctionListEntry js_perf_observer_proto_funcs[] = {
+    JS_CFUNC_DEF("observe", 1, js_perf_observer_observe ),
+    JS_CFUNC_DEF("disconnect", 0, js_perf_observer_disconnect ),
+    JS_CFUNC_DEF("takeRecords", 0, js_perf_observer_take_records ),
+};
+
+static const JSCFunctionListEntry js_perf_list_proto_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("getEntries", 0, js_perf_list_get_entries, 0 ),
+    JS_CFUNC_MAGIC_DEF("getEntriesByName", 1, js_perf_list_get_entries, 1 ),
+    JS_CFUNC_MAGIC_DEF("getEntriesByType", 1, js_perf_list_get_entries, 2 ),
+};
+
+static const JSCFunctionListEntry js_perf_funcs[] = {
+    JS_CFUNC_DEF("now", 0, js_perf_now ),
+    JS_CFUNC_DEF("toJSON", 0, js_perf_to_json ),
+};
+
+/* define performance and PerformanceObserver on the global object */
+static int perf_add_globals(JSContext *ctx)
+{
+    JSRuntime *rt = JS_GetRuntime(ctx);
+    JSValue global, perf, proto, ctor, types;
+    QJSXPerf *p;
+
+    if (!perf_origin) {
+        perf_origin = perf_clock(CLOCK_MONOTONIC);
+        perf_origin_epoch = perf_clock(CLOCK_REALTIME) / 1e6;
+    }
+    JS_NewClassID(rt, &js_perf_class_id);
+    JS_NewClass(rt, js_perf_class_id, &js_perf_class);
+    JS_NewClassID(rt, &js_perf_observer_class_id);
+    JS_NewClass(rt, js_perf_observer_class_id, &js_perf_observer_class);
+    JS_NewClassID(rt, &js_perf_list_class_id);
+    JS_NewClass(rt, js_perf_list_class_id, &js_perf_list_class);
+    proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, proto, js_perf_list_proto_funcs,
+                               countof(js_perf_list_proto_funcs));
+    JS_SetClassProto(ctx, js_perf_list_class_id, proto);
+
+    perf = JS_NewObjectClass(ctx, js_perf_class_id);
+    if (JS_IsException(perf))
+        return -1;
+    p = js_mallocz(ctx, sizeof(*p));
+    if (!p) {
+        JS_FreeValue(ctx, perf);
+        return -1;
+    }
+    p->ctx = ctx;
+    JS_SetOpaque(perf, p);
+    if (!perf_current)
+        perf_current = p;
+
+    /* the functions hold the buffer */
+    JS_SetPropertyFunctionList(ctx, perf, js_perf_funcs, countof(js_perf_funcs));
+    JS_DefinePropertyValueStr(ctx, perf, "timeOrigin", JS_NewFloat64(ctx, perf_origin_epoch), JS_PROP_ENUMERABLE);
+    JS_SetPropertyStr(ctx, perf, "mark", JS_NewCFunctionData(ctx, js_perf_mark, 1, 0, 1, &perf));
+    JS_SetPropertyStr(ctx, perf, "measure", JS_NewCFunctionData(ctx, js_perf_measure, 1, 0, 1, &perf));
+    JS_SetPropertyStr(ctx, perf, "getEntries", JS_NewCFunctionData(ctx, js_perf_get_entries, 0, 0, 1, &perf));
+    JS_SetPropertyStr(ctx, perf, "getEntriesByName", JS_NewCFunctionData(ctx, js_perf_get_entries, 1, 1, 1, &perf));
+    JS_SetPropertyStr(ctx, perf, "getEntriesByType", JS_NewCFunctionData(ctx, js_perf_get_entries, 1, 2, 1, &perf));
+    JS_SetPropertyStr(ctx, perf, "clearMarks", JS_NewCFunctionData(ctx, js_perf_clear, 0, PERF_MARK, 1, &perf));
+    JS_SetPropertyStr(ctx, perf, "clearMeasures", JS_NewCFunctionData(ctx, js_perf_clear, 0, PERF_MEASURE, 1, &perf));
+
+    proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, proto, js_perf_observer_proto_funcs,
+                               countof(js_perf_observer_proto_funcs));
+    ctor = JS_NewCFunctionData(ctx, js_perf_observer_constructor, 1, 0, 1, &perf);
+    JS_SetConstructorBit(ctx, ctor, TRUE);
+    JS_SetConstructor(ctx, ctor, proto);
+    JS_SetClassProto(ctx, js_perf_observer_class_id, proto);
+    types = JS_NewArray(ctx);
+    JS_SetPropertyUint32(ctx, types, 0, JS_NewString(ctx, "mark"));
+    JS_SetPropertyUint32(ctx, types, 1, JS_NewString(ctx, "measure"));
+    JS_DefinePropertyValueStr(ctx, ctor, "supportedEntryTypes", types, JS_PROP_CONFIGURABLE);
+
+    global = JS_GetGlobalObject(ctx);
+    JS_SetPropertyStr(ctx, global, "performance", perf);
+    JS_SetPropertyStr(ctx, global, "PerformanceObserver", ctor);
+    JS_FreeValue(ctx, global);
+    return 0;
+}
+
+void js_std_add_helpers(JSContext *ctx, int argc, char **argv)
+{
+    js_std_add_helpers_libc(ctx, argc, argv);
+    if (perf_add_globals(ctx) < 0)
+        js_std_dump_error(ctx);
+}
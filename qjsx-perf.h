@@ -0,0 +1,28 @@
+/*
+ * QJSX performance global
+ *
+ * quickjs-libc.patch renames the js_std_add_helpers() of quickjs-libc.c to
+ * js_std_add_helpers_libc(); the js_std_add_helpers() of qjsx-perf.c calls
+ * it, then defines the performance and PerformanceObserver globals, so
+ * every program that sets up its context with it has them. The event loop
+ * (qjsx-loop.c) delivers the entries of the observers once a turn.
+ * Include after quickjs.h.
+ */
+
+#ifndef QJSX_PERF_H
+#define QJSX_PERF_H
+
+/* the js_std_add_helpers() of quickjs-libc.c */
+void js_std_add_helpers_libc(JSContext *ctx, int argc, char **argv);
+
+/* whether PerformanceObserver callbacks have entries to deliver */
+int qjsx_perf_pending(void);
+
+/*
+ * Call each PerformanceObserver callback with the entries it collected
+ * since the last call, reporting exceptions like js_std_loop(). Returns
+ * whether any callback was called.
+ */
+int qjsx_perf_deliver(JSContext *ctx);
+
+#endif /* QJSX_PERF_H */
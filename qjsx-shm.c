@@ -0,0 +1,923 @@
+/*
+ * QJSX qjsx:shm module
+ *
+ * Shared memory between processes: POSIX shared memory segments and memfds
+ * mapped as SharedArrayBuffers, and a fixed-slot hash table cache that any
+ * number of processes can use concurrently without locks.
+ *
+ *   import * as shm from "qjsx:shm";
+ *   const sab = shm.open("/tables", { size: 1 << 20 });
+ *   const counters = new Int32Array(sab);
+ *   Atomics.add(counters, 0, 1);            // visible to every process
+ *
+ *   const cache = new shm.Cache("/lookup", { size: 4 << 30, valueSize: 200 });
+ *   cache.set("user:42", JSON.stringify(user));
+ *   cache.getString("user:42");
+ *
+ *   shm.open(name, { size, create, exclusive, readOnly }) -> SharedArrayBuffer
+ *   shm.unlink(name)
+ *   shm.memfd(size[, name])  -> file descriptor (Linux), inherited by children
+ *   shm.map(fd, { readOnly }) -> SharedArrayBuffer of the whole file
+ *   new shm.Cache(nameOrBuffer, { keySize = 64, valueSize = 256, size })
+ *   cache.get(key) -> ArrayBuffer copy, or undefined
+ *   cache.getString(key), cache.has(key), cache.set(key, value) -> bool,
+ *   cache.delete(key) -> bool, cache.clear(), cache.count()
+ *   cache.capacity, cache.keySize, cache.valueSize
+ *
+ * Atomics.load/store/add/compareExchange on these buffers work across
+ * processes; Atomics.wait and notify only wake threads of the calling
+ * process. SharedArrayBuffers are limited to 2 GiB; a Cache opened by
+ * segment name maps the segment itself and has no such limit. These
+ * buffers cannot be posted to a Worker: open the segment in the worker.
+ *
+ * The cache stores each entry in one slot of a fixed size (keySize +
+ * valueSize bytes), at one of the 8 slots following the key's hash.
+ * Every slot has a sequence number: a writer makes it odd with a
+ * compare-and-swap, writes, and makes it even again, and readers copy the
+ * slot and retry if the number changed. When all 8 slots are taken, set()
+ * replaces one of them, so entries may be evicted at any time. A process
+ * killed inside set() leaves that one slot unusable until clear(), which
+ * takes it back once kill(pid, 0) reports the writer gone. Processes
+ * sharing a cache must therefore be in the same PID namespace.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "quickjs/cutils.h"
+#include "quickjs/quickjs.h"
+
+#define SHM_CACHE_MAGIC     0x68736a71 /* "qjsh" */
+#define SHM_CACHE_INIT      1          /* header being written */
+#define SHM_CACHE_VERSION   2
+#define SHM_PROBE           8          /* slots a key can live in */
+#define SHM_SPIN            1000       /* attempts before a slot counts as busy */
+#define SHM_MAX_SAB         ((uint64_t)INT32_MAX)
+
+typedef struct ShmCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t key_size;
+    uint32_t value_size;
+    uint64_t nslots;
+    uint8_t unused[40];     /* keep the slots on their own cache line */
+} ShmCacheHeader;
+
+typedef struct ShmSlot {
+    uint32_t seq;           /* odd while a writer owns the slot */
+    uint32_t hash;
+    uint32_t klen;          /* 0: empty */
+    uint32_t vlen;
+    uint32_t pid;           /* last process to own the slot */
+    /* key_size bytes of key, then value_size bytes of value */
+} ShmSlot;
+
+typedef struct ShmCache {
+    JSValue buffer;         /* the mapped SharedArrayBuffer, or undefined */
+    uint8_t *map;           /* mapping owned by the cache, or NULL */
+    size_t map_size;
+    ShmCacheHeader *header;
+    uint8_t *slots;
+    uint64_t nslots;
+    uint32_t key_size;
+    uint32_t value_size;
+    size_t slot_size;
+} ShmCache;
+
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    const char *str;
+} ShmBytes;
+
+static JSClassID js_shm_cache_class_id;
+
+static inline void shm_relax(int spin)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+    if (spin > 100)
+        sched_yield();
+}
+
+static inline uint32_t shm_load(const uint32_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline uint32_t shm_load_relaxed(const uint32_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+static inline void shm_store_relaxed(uint32_t *p, uint32_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELAXED);
+}
+
+static uint64_t shm_hash(const uint8_t *p, size_t len)
+{
+    uint64_t h = UINT64_C(0xcbf29ce484222325);
+
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ p[i]) * UINT64_C(0x100000001b3);
+    return h ^ (h >> 29);
+}
+
+static JSValue js_shm_throw_errno(JSContext *ctx, const char *what,
+                                  const char *name)
+{
+    if (name)
+        return JS_ThrowTypeError(ctx, "%s %s: %s", what, name, strerror(errno));
+    return JS_ThrowTypeError(ctx, "%s: %s", what, strerror(errno));
+}
+
+/* Segments */
+
+static void shm_unmap(JSRuntime *rt, void *opaque, void *ptr)
+{
+    munmap(ptr, (size_t)(uintptr_t)opaque);
+}
+
+static JSValue shm_new_buffer(JSContext *ctx, int fd, BOOL read_only,
+                              const char *name)
+{
+    struct stat st;
+    void *p;
+
+    if (fstat(fd, &st) < 0)
+        return js_shm_throw_errno(ctx, "cannot stat", name);
+    if (st.st_size == 0)
+        return JS_ThrowRangeError(ctx, "shared memory segment is empty");
+    if ((uint64_t)st.st_size > SHM_MAX_SAB)
+        return JS_ThrowRangeError(ctx, "SharedArrayBuffers are limited to 2 GiB, "
+                                  "use a Cache opened by name for larger segments");
+    p = mmap(NULL, st.st_size, read_only ? PROT_READ : PROT_READ | PROT_WRITE,
+             MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        return js_shm_throw_errno(ctx, "cannot map", name);
+    return JS_NewArrayBuffer(ctx, p, st.st_size, shm_unmap,
+                             (void *)(uintptr_t)st.st_size, TRUE);
+}
+
+static int shm_get_size(JSContext *ctx, JSValueConst options, uint64_t *psize)
+{
+    JSValue v;
+    int ret = 0;
+
+    *psize = 0;
+    if (!JS_IsObject(options))
+        return 0;
+    v = JS_GetPropertyStr(ctx, options, "size");
+    if (JS_IsException(v))
+        return -1;
+    if (!JS_IsUndefined(v))
+        ret = JS_ToIndex(ctx, psize, v);
+    JS_FreeValue(ctx, v);
+    return ret;
+}
+
+static int shm_get_bool(JSContext *ctx, JSValueConst options,
+                        const char *name, BOOL *pval)
+{
+    JSValue v;
+
+    if (!JS_IsObject(options))
+        return 0;
+    v = JS_GetPropertyStr(ctx, options, name);
+    if (JS_IsException(v))
+        return -1;
+    if (!JS_IsUndefined(v))
+        *pval = JS_ToBool(ctx, v);
+    JS_FreeValue(ctx, v);
+    return 0;
+}
+
+/* shm_open() the segment, creating or growing it to size if needed */
+static int shm_open_segment(JSContext *ctx, const char *name, uint64_t size,
+                            BOOL create, BOOL exclusive, BOOL read_only)
+{
+    char path[256];
+    struct stat st;
+    int fd, flags;
+
+    /* POSIX names have exactly one slash, at the start */
+    snprintf(path, sizeof(path), "%s%s", name[0] == '/' ? "" : "/", name);
+    if (strchr(path + 1, '/') || strlen(path) < 2) {
+        JS_ThrowTypeError(ctx, "invalid shared memory name: %s", name);
+        return -1;
+    }
+    flags = read_only ? O_RDONLY : O_RDWR;
+    if (create && !read_only)
+        flags |= O_CREAT | (exclusive ? O_EXCL : 0);
+    fd = shm_open(path, flags, 0600);
+    if (fd < 0) {
+        js_shm_throw_errno(ctx, "cannot open shared memory", path);
+        return -1;
+    }
+    if (fstat(fd, &st) < 0)
+        goto fail;
+    if (!read_only && size > (uint64_t)st.st_size && ftruncate(fd, size) < 0)
+        goto fail;
+    if (st.st_size == 0 && size == 0) {
+        close(fd);
+        if (!read_only && create)
+            shm_unlink(path);
+        JS_ThrowTypeError(ctx, "shared memory %s does not exist yet, "
+                          "a size is needed to create it", path);
+        return -1;
+    }
+    return fd;
+ fail:
+    js_shm_throw_errno(ctx, "cannot size shared memory", path);
+    close(fd);
+    return -1;
+}
+
+static JSValue js_shm_open(JSContext *ctx, JSValueConst this_val,
+                           int argc, JSValueConst *argv)
+{
+    JSValueConst options = argc > 1 ? argv[1] : JS_UNDEFINED;
+    BOOL create = TRUE, exclusive = FALSE, read_only = FALSE;
+    const char *name;
+    uint64_t size;
+    JSValue ret;
+    int fd;
+
+    if (shm_get_size(ctx, options, &size) ||
+        shm_get_bool(ctx, options, "create", &create) ||
+        shm_get_bool(ctx, options, "exclusive", &exclusive) ||
+        shm_get_bool(ctx, options, "readOnly", &read_only))
+        return JS_EXCEPTION;
+    if (size > SHM_MAX_SAB)
+        return JS_ThrowRangeError(ctx, "SharedArrayBuffers are limited to 2 GiB, "
+                                  "use a Cache opened by name for larger segments");
+    name = JS_ToCString(ctx, argv[0]);
+    if (!name)
+        return JS_EXCEPTION;
+    fd = shm_open_segment(ctx, name, size, create, exclusive, read_only);
+    if (fd < 0) {
+        JS_FreeCString(ctx, name);
+        return JS_EXCEPTION;
+    }
+    ret = shm_new_buffer(ctx, fd, read_only, name);
+    /* the mapping keeps the segment alive */
+    close(fd);
+    JS_FreeCString(ctx, name);
+    return ret;
+}
+
+static JSValue js_shm_unlink(JSContext *ctx, JSValueConst this_val,
+                             int argc, JSValueConst *argv)
+{
+    char path[256];
+    const char *name = JS_ToCString(ctx, argv[0]);
+    int ret;
+
+    if (!name)
+        return JS_EXCEPTION;
+    snprintf(path, sizeof(path), "%s%s", name[0] == '/' ? "" : "/", name);
+    JS_FreeCString(ctx, name);
+    ret = shm_unlink(path);
+    if (ret < 0 && errno != ENOENT)
+        return js_shm_throw_errno(ctx, "cannot unlink shared memory", path);
+    return JS_NewBool(ctx, ret == 0);
+}
+
+static JSValue js_shm_memfd(JSContext *ctx, JSValueConst this_val,
+                            int argc, JSValueConst *argv)
+{
+#ifdef __linux__
+    const char *name = "qjsx-shm";
+    uint64_t size;
+    int fd;
+
+    if (JS_ToIndex(ctx, &size, argv[0]))
+        return JS_EXCEPTION;
+    if (argc > 1 && !JS_IsUndefined(argv[1])) {
+        name = JS_ToCString(ctx, argv[1]);
+        if (!name)
+            return JS_EXCEPTION;
+    }
+    /* no MFD_CLOEXEC: the descriptor is meant to be inherited */
+    fd = memfd_create(name, 0);
+    if (argc > 1 && !JS_IsUndefined(argv[1]))
+        JS_FreeCString(ctx, name);
+    if (fd < 0)
+        return js_shm_throw_errno(ctx, "memfd_create", NULL);
+    if (ftruncate(fd, size) < 0) {
+        close(fd);
+        return js_shm_throw_errno(ctx, "cannot size memfd", NULL);
+    }
+    return JS_NewInt32(ctx, fd);
+#else
+    return JS_ThrowTypeError(ctx, "memfd is only available on Linux");
+#endif
+}
+
+static JSValue js_shm_map(JSContext *ctx, JSValueConst this_val,
+                          int argc, JSValueConst *argv)
+{
+    BOOL read_only = FALSE;
+    int fd;
+
+    if (JS_ToInt32(ctx, &fd, argv[0]) ||
+        shm_get_bool(ctx, argc > 1 ? argv[1] : JS_UNDEFINED, "readOnly", &read_only))
+        return JS_EXCEPTION;
+    return shm_new_buffer(ctx, fd, read_only, NULL);
+}
+
+/* Cache */
+
+static inline ShmSlot *shm_slot(ShmCache *c, uint64_t i)
+{
+    return (ShmSlot *)(c->slots + i * c->slot_size);
+}
+
+static inline uint8_t *shm_slot_key(ShmSlot *s)
+{
+    return (uint8_t *)(s + 1);
+}
+
+static inline uint8_t *shm_slot_value(ShmCache *c, ShmSlot *s)
+{
+    return (uint8_t *)(s + 1) + c->key_size;
+}
+
+/*
+ * Check whether slot s holds key, copying its value to out if so.
+ * Returns 1 if it does, 0 if not and -1 if writers kept it busy.
+ */
+static int shm_slot_lookup(ShmCache *c, ShmSlot *s, uint32_t hash,
+                           const uint8_t *key, size_t klen,
+                           uint8_t *out, uint32_t *pvlen)
+{
+    for (int spin = 0; spin < SHM_SPIN; spin++) {
+        uint32_t seq = shm_load(&s->seq), vlen;
+        int match;
+
+        if (seq & 1) {
+            shm_relax(spin);
+            continue;
+        }
+        match = shm_load_relaxed(&s->hash) == hash &&
+            shm_load_relaxed(&s->klen) == klen &&
+            !memcmp(shm_slot_key(s), key, klen);
+        vlen = min_uint32(shm_load_relaxed(&s->vlen), c->value_size);
+        if (match && out)
+            memcpy(out, shm_slot_value(c, s), vlen);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (shm_load_relaxed(&s->seq) == seq) {
+            if (match && pvlen)
+                *pvlen = vlen;
+            return match;
+        }
+    }
+    return -1;
+}
+
+static BOOL shm_slot_lock(ShmSlot *s, uint32_t *pseq)
+{
+    uint32_t seq = shm_load_relaxed(&s->seq);
+
+    for (int spin = 0; spin < SHM_SPIN; spin++) {
+        if (!(seq & 1) &&
+            __atomic_compare_exchange_n(&s->seq, &seq, seq + 1, FALSE,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            /* the odd seq must be visible before any of the slot stores */
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+            shm_store_relaxed(&s->pid, getpid());
+            *pseq = seq;
+            return TRUE;
+        }
+        shm_relax(spin);
+        seq = shm_load_relaxed(&s->seq);
+    }
+    return FALSE;
+}
+
+static inline void shm_slot_unlock(ShmSlot *s, uint32_t seq)
+{
+    __atomic_store_n(&s->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/*
+ * Take back a slot whose seq stayed odd because its writer died. Only a
+ * slot whose recorded owner no longer exists is touched: a live writer
+ * copying a large value may hold a slot for a long time. A writer killed
+ * before recording its pid leaves the previous owner's pid there, and
+ * the slot stays busy if that process is still running.
+ */
+static BOOL shm_slot_reclaim(ShmSlot *s)
+{
+    uint32_t seq = shm_load(&s->seq);
+    pid_t pid = shm_load_relaxed(&s->pid);
+
+    if (!(seq & 1) || pid <= 0 || kill(pid, 0) == 0 || errno != ESRCH)
+        return FALSE;
+    /* stay odd while emptying it, so readers keep retrying */
+    if (!__atomic_compare_exchange_n(&s->seq, &seq, seq + 2, FALSE,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return FALSE;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    shm_store_relaxed(&s->pid, getpid());
+    shm_store_relaxed(&s->klen, 0);
+    shm_store_relaxed(&s->hash, 0);
+    shm_slot_unlock(s, seq + 1);
+    return TRUE;
+}
+
+static inline BOOL shm_slot_holds(ShmSlot *s, uint32_t hash,
+                                  const uint8_t *key, size_t klen)
+{
+    return s->hash == hash && s->klen == klen &&
+        !memcmp(shm_slot_key(s), key, klen);
+}
+
+static inline uint64_t shm_home(ShmCache *c, uint64_t h)
+{
+    return h % c->nslots;
+}
+
+static inline int shm_window(ShmCache *c)
+{
+    return c->nslots < SHM_PROBE ? c->nslots : SHM_PROBE;
+}
+
+static int shm_cache_get(ShmCache *c, const uint8_t *key, size_t klen,
+                         uint8_t *out, uint32_t *pvlen)
+{
+    uint64_t h = shm_hash(key, klen), home = shm_home(c, h);
+    uint32_t hash = (uint32_t)h | 1;
+
+    for (int i = 0; i < shm_window(c); i++) {
+        ShmSlot *s = shm_slot(c, (home + i) % c->nslots);
+        if (shm_slot_lookup(c, s, hash, key, klen, out, pvlen) > 0)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* empty every other slot of the window that holds key */
+static BOOL shm_cache_remove(ShmCache *c, uint64_t h, const uint8_t *key,
+                             size_t klen, ShmSlot *keep)
+{
+    uint64_t home = shm_home(c, h);
+    uint32_t hash = (uint32_t)h | 1, seq;
+    BOOL found = FALSE;
+
+    for (int i = 0; i < shm_window(c); i++) {
+        ShmSlot *s = shm_slot(c, (home + i) % c->nslots);
+        if (s == keep || shm_slot_lookup(c, s, hash, key, klen, NULL, NULL) <= 0 ||
+            !shm_slot_lock(s, &seq))
+            continue;
+        if (shm_slot_holds(s, hash, key, klen)) {
+            shm_store_relaxed(&s->klen, 0);
+            shm_store_relaxed(&s->hash, 0);
+            found = TRUE;
+        }
+        shm_slot_unlock(s, seq);
+    }
+    return found;
+}
+
+/*
+ * Store key in the slot that already holds it, else in an empty slot of
+ * its window, else over the slot the hash picks as the victim. Two
+ * processes adding the same key at once can both find empty slots: the
+ * copies other than the one just written are removed afterwards.
+ */
+static BOOL shm_cache_set(ShmCache *c, const uint8_t *key, size_t klen,
+                          const uint8_t *val, size_t vlen)
+{
+    uint64_t h = shm_hash(key, klen), home = shm_home(c, h);
+    uint32_t hash = (uint32_t)h | 1, seq;
+    int window = shm_window(c);
+
+    for (int attempt = 0; attempt < SHM_SPIN; attempt++) {
+        ShmSlot *match = NULL, *empty = NULL, *target;
+
+        for (int i = 0; i < window && !match; i++) {
+            ShmSlot *s = shm_slot(c, (home + i) % c->nslots);
+            if (shm_slot_lookup(c, s, hash, key, klen, NULL, NULL) > 0)
+                match = s;
+            else if (!empty && !shm_load_relaxed(&s->klen) &&
+                     !(shm_load_relaxed(&s->seq) & 1))
+                empty = s;
+        }
+        target = match ? match : empty ? empty
+            : shm_slot(c, (home + (h >> 40) % window) % c->nslots);
+        if (!shm_slot_lock(target, &seq))
+            continue;
+        /* someone else may have used the slot since we looked */
+        if ((match && !shm_slot_holds(target, hash, key, klen)) ||
+            (!match && empty && target->klen)) {
+            shm_slot_unlock(target, seq);
+            shm_relax(attempt);
+            continue;
+        }
+        shm_store_relaxed(&target->hash, hash);
+        shm_store_relaxed(&target->klen, klen);
+        shm_store_relaxed(&target->vlen, vlen);
+        memcpy(shm_slot_key(target), key, klen);
+        memcpy(shm_slot_value(c, target), val, vlen);
+        shm_slot_unlock(target, seq);
+        if (!match)
+            shm_cache_remove(c, h, key, klen, target);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/* lay out the cache in a zero-filled buffer, or check the existing one */
+static int shm_cache_attach(JSContext *ctx, ShmCache *c, uint8_t *p,
+                            size_t len, uint32_t key_size, uint32_t value_size,
+                            BOOL explicit_sizes)
+{
+    ShmCacheHeader *hdr = (ShmCacheHeader *)p;
+    uint32_t magic = 0;
+
+    if ((uintptr_t)p % 8 || len < sizeof(ShmCacheHeader)) {
+        JS_ThrowRangeError(ctx, "buffer is too small for a cache");
+        return -1;
+    }
+    if (__atomic_compare_exchange_n(&hdr->magic, &magic, SHM_CACHE_INIT, FALSE,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+        size_t slot_size = (sizeof(ShmSlot) + key_size + value_size + 7) & ~(size_t)7;
+        hdr->version = SHM_CACHE_VERSION;
+        hdr->key_size = key_size;
+        hdr->value_size = value_size;
+        hdr->nslots = (len - sizeof(ShmCacheHeader)) / slot_size;
+        __atomic_store_n(&hdr->magic, SHM_CACHE_MAGIC, __ATOMIC_RELEASE);
+        magic = SHM_CACHE_MAGIC;
+    }
+    /* another process is creating the cache */
+    for (int spin = 0; magic == SHM_CACHE_INIT && spin < 100 * SHM_SPIN; spin++) {
+        shm_relax(SHM_SPIN);
+        magic = shm_load(&hdr->magic);
+    }
+    if (magic != SHM_CACHE_MAGIC || hdr->version != SHM_CACHE_VERSION) {
+        JS_ThrowTypeError(ctx, "buffer does not hold a qjsx:shm cache");
+        return -1;
+    }
+    if (explicit_sizes &&
+        (hdr->key_size != key_size || hdr->value_size != value_size)) {
+        JS_ThrowRangeError(ctx, "cache was created with keySize %u and valueSize %u",
+                           hdr->key_size, hdr->value_size);
+        return -1;
+    }
+    c->header = hdr;
+    c->key_size = hdr->key_size;
+    c->value_size = hdr->value_size;
+    c->slot_size = (sizeof(ShmSlot) + c->key_size + c->value_size + 7) & ~(size_t)7;
+    c->nslots = hdr->nslots;
+    c->slots = p + sizeof(ShmCacheHeader);
+    if (c->nslots == 0 ||
+        c->nslots > (len - sizeof(ShmCacheHeader)) / c->slot_size) {
+        JS_ThrowRangeError(ctx, "buffer is too small for a cache");
+        return -1;
+    }
+    return 0;
+}
+
+static int shm_get_uint32(JSContext *ctx, JSValueConst options,
+                          const char *name, uint32_t *pval, BOOL *pset)
+{
+    JSValue v;
+    int ret = 0;
+
+    if (!JS_IsObject(options))
+        return 0;
+    v = JS_GetPropertyStr(ctx, options, name);
+    if (JS_IsException(v))
+        return -1;
+    if (!JS_IsUndefined(v)) {
+        ret = JS_ToUint32(ctx, pval, v);
+        *pset = TRUE;
+    }
+    JS_FreeValue(ctx, v);
+    return ret;
+}
+
+static void js_shm_cache_finalizer(JSRuntime *rt, JSValue val)
+{
+    ShmCache *c = JS_GetOpaque(val, js_shm_cache_class_id);
+
+    if (c) {
+        JS_FreeValueRT(rt, c->buffer);
+        if (c->map)
+            munmap(c->map, c->map_size);
+        js_free_rt(rt, c);
+    }
+}
+
+static void js_shm_cache_mark(JSRuntime *rt, JSValueConst val,
+                              JS_MarkFunc *mark_func)
+{
+    ShmCache *c = JS_GetOpaque(val, js_shm_cache_class_id);
+
+    if (c)
+        JS_MarkValue(rt, c->buffer, mark_func);
+}
+
+static JSValue js_shm_cache_constructor(JSContext *ctx, JSValueConst new_target,
+                                        int argc, JSValueConst *argv)
+{
+    JSValueConst options = argc > 1 ? argv[1] : JS_UNDEFINED;
+    uint32_t key_size = 64, value_size = 256;
+    BOOL explicit_sizes = FALSE;
+    ShmCache *c;
+    JSValue obj, proto;
+    uint8_t *p;
+    size_t len;
+    uint64_t size;
+
+    if (shm_get_uint32(ctx, options, "keySize", &key_size, &explicit_sizes) ||
+        shm_get_uint32(ctx, options, "valueSize", &value_size, &explicit_sizes) ||
+        shm_get_size(ctx, options, &size))
+        return JS_EXCEPTION;
+    if (key_size == 0 || key_size > 65536 || value_size > (1 << 24))
+        return JS_ThrowRangeError(ctx, "keySize must be 1 to 65536 and "
+                                  "valueSize at most 16 MiB");
+
+    proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+    if (JS_IsException(proto))
+        return proto;
+    obj = JS_NewObjectProtoClass(ctx, proto, js_shm_cache_class_id);
+    JS_FreeValue(ctx, proto);
+    if (JS_IsException(obj))
+        return obj;
+    c = js_mallocz(ctx, sizeof(*c));
+    if (!c)
+        goto fail;
+    c->buffer = JS_UNDEFINED;
+    JS_SetOpaque(obj, c);
+
+    if (JS_IsString(argv[0])) {
+        const char *name = JS_ToCString(ctx, argv[0]);
+        struct stat st;
+        int fd;
+
+        if (!name)
+            goto fail;
+        fd = shm_open_segment(ctx, name, size, TRUE, FALSE, FALSE);
+        JS_FreeCString(ctx, name);
+        if (fd < 0)
+            goto fail;
+        if (fstat(fd, &st) < 0) {
+            js_shm_throw_errno(ctx, "cannot stat shared memory", NULL);
+            close(fd);
+            goto fail;
+        }
+        p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            js_shm_throw_errno(ctx, "cannot map shared memory", NULL);
+            goto fail;
+        }
+        c->map = p;
+        c->map_size = len = st.st_size;
+    } else {
+        p = JS_GetArrayBuffer(ctx, &len, argv[0]);
+        if (!p)
+            goto fail;
+        c->buffer = JS_DupValue(ctx, argv[0]);
+    }
+    if (shm_cache_attach(ctx, c, p, len, key_size, value_size, explicit_sizes))
+        goto fail;
+    return obj;
+ fail:
+    JS_FreeValue(ctx, obj);
+    return JS_EXCEPTION;
+}
+
+static int shm_get_bytes(JSContext *ctx, ShmBytes *b, JSValueConst val,
+                         const char *what, size_t min_len, size_t max_len)
+{
+    size_t offset, length, elem_size, size;
+    JSValue buf;
+
+    b->str = NULL;
+    if (JS_IsString(val)) {
+        b->str = JS_ToCStringLen(ctx, &b->len, val);
+        if (!b->str)
+            return -1;
+        b->data = (const uint8_t *)b->str;
+    } else if (JS_IsObject(val) && JS_GetTypedArrayType(val) >= 0) {
+        buf = JS_GetTypedArrayBuffer(ctx, val, &offset, &length, &elem_size);
+        if (JS_IsException(buf))
+            return -1;
+        b->data = JS_GetArrayBuffer(ctx, &size, buf);
+        JS_FreeValue(ctx, buf);
+        if (!b->data)
+            return -1;
+        b->data += offset;
+        b->len = length;
+    } else if (JS_IsObject(val)) {
+        b->data = JS_GetArrayBuffer(ctx, &b->len, val);
+        if (!b->data)
+            return -1;
+    } else {
+        JS_ThrowTypeError(ctx, "%s must be a string, ArrayBuffer or typed array", what);
+        return -1;
+    }
+    if (b->len < min_len || b->len > max_len) {
+        if (b->str)
+            JS_FreeCString(ctx, b->str);
+        JS_ThrowRangeError(ctx, "%s must be %zu to %zu bytes", what, min_len, max_len);
+        return -1;
+    }
+    return 0;
+}
+
+static void shm_free_bytes(JSContext *ctx, ShmBytes *b)
+{
+    if (b->str)
+        JS_FreeCString(ctx, b->str);
+}
+
+static JSValue js_shm_cache_get(JSContext *ctx, JSValueConst this_val,
+                                int argc, JSValueConst *argv, int magic)
+{
+    ShmCache *c = JS_GetOpaque2(ctx, this_val, js_shm_cache_class_id);
+    uint8_t small[1024], *out;
+    uint32_t vlen;
+    ShmBytes key;
+    JSValue ret;
+    BOOL found;
+
+    if (!c || shm_get_bytes(ctx, &key, argv[0], "key", 1, c->key_size))
+        return JS_EXCEPTION;
+    if (magic == 2) {
+        found = shm_cache_get(c, key.data, key.len, NULL, NULL);
+        shm_free_bytes(ctx, &key);
+        return JS_NewBool(ctx, found);
+    }
+    out = c->value_size <= sizeof(small) ? small : js_malloc(ctx, c->value_size);
+    if (!out) {
+        shm_free_bytes(ctx, &key);
+        return JS_EXCEPTION;
+    }
+    found = shm_cache_get(c, key.data, key.len, out, &vlen);
+    shm_free_bytes(ctx, &key);
+    if (!found)
+        ret = JS_UNDEFINED;
+    else if (magic == 1)
+        ret = JS_NewStringLen(ctx, (const char *)out, vlen);
+    else
+        ret = JS_NewArrayBufferCopy(ctx, out, vlen);
+    if (out != small)
+        js_free(ctx, out);
+    return ret;
+}
+
+static JSValue js_shm_cache_set(JSContext *ctx, JSValueConst this_val,
+                                int argc, JSValueConst *argv)
+{
+    ShmCache *c = JS_GetOpaque2(ctx, this_val, js_shm_cache_class_id);
+    ShmBytes key, val;
+    BOOL stored;
+
+    if (!c || shm_get_bytes(ctx, &key, argv[0], "key", 1, c->key_size))
+        return JS_EXCEPTION;
+    if (shm_get_bytes(ctx, &val, argv[1], "value", 0, c->value_size)) {
+        shm_free_bytes(ctx, &key);
+        return JS_EXCEPTION;
+    }
+    stored = shm_cache_set(c, key.data, key.len, val.data, val.len);
+    shm_free_bytes(ctx, &key);
+    shm_free_bytes(ctx, &val);
+    return JS_NewBool(ctx, stored);
+}
+
+static JSValue js_shm_cache_delete(JSContext *ctx, JSValueConst this_val,
+                                   int argc, JSValueConst *argv)
+{
+    ShmCache *c = JS_GetOpaque2(ctx, this_val, js_shm_cache_class_id);
+    ShmBytes key;
+    BOOL found;
+
+    if (!c || shm_get_bytes(ctx, &key, argv[0], "key", 1, c->key_size))
+        return JS_EXCEPTION;
+    found = shm_cache_remove(c, shm_hash(key.data, key.len), key.data, key.len, NULL);
+    shm_free_bytes(ctx, &key);
+    return JS_NewBool(ctx, found);
+}
+
+static JSValue js_shm_cache_clear(JSContext *ctx, JSValueConst this_val,
+                                  int argc, JSValueConst *argv)
+{
+    ShmCache *c = JS_GetOpaque2(ctx, this_val, js_shm_cache_class_id);
+    uint32_t seq;
+
+    if (!c)
+        return JS_EXCEPTION;
+    for (uint64_t i = 0; i < c->nslots; i++) {
+        ShmSlot *s = shm_slot(c, i);
+        if (!shm_load_relaxed(&s->klen) && !(shm_load_relaxed(&s->seq) & 1))
+            continue;
+        if (shm_slot_lock(s, &seq)) {
+            shm_store_relaxed(&s->klen, 0);
+            shm_store_relaxed(&s->hash, 0);
+            shm_slot_unlock(s, seq);
+        } else {
+            shm_slot_reclaim(s);
+        }
+    }
+    return JS_UNDEFINED;
+}
+
+static JSValue js_shm_cache_count(JSContext *ctx, JSValueConst this_val,
+                                  int argc, JSValueConst *argv)
+{
+    ShmCache *c = JS_GetOpaque2(ctx, this_val, js_shm_cache_class_id);
+    int64_t n = 0;
+
+    if (!c)
+        return JS_EXCEPTION;
+    for (uint64_t i = 0; i < c->nslots; i++)
+        n += shm_load_relaxed(&shm_slot(c, i)->klen) != 0;
+    return JS_NewInt64(ctx, n);
+}
+
+static JSValue js_shm_cache_get_info(JSContext *ctx, JSValueConst this_val,
+                                     int magic)
+{
+    ShmCache *c = JS_GetOpaque2(ctx, this_val, js_shm_cache_class_id);
+
+    if (!c)
+        return JS_EXCEPTION;
+    switch (magic) {
+    case 0:
+        return JS_NewInt64(ctx, c->nslots);
+    case 1:
+        return JS_NewUint32(ctx, c->key_size);
+    default:
+        return JS_NewUint32(ctx, c->value_size);
+    }
+}
+
+static JSClassDef js_shm_cache_class = {
+    "Cache",
+    .finalizer = js_shm_cache_finalizer,
+    .gc_mark = js_shm_cache_mark,
+};
+
+static const JSCFunctionListEntry js_shm_cache_proto_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("get", 1, js_shm_cache_get, 0 ),
+    JS_CFUNC_MAGIC_DEF("getString", 1, js_shm_cache_get, 1 ),
+    JS_CFUNC_MAGIC_DEF("has", 1, js_shm_cache_get, 2 ),
+    JS_CFUNC_DEF("set", 2, js_shm_cache_set ),
+    JS_CFUNC_DEF("delete", 1, js_shm_cache_delete ),
+    JS_CFUNC_DEF("clear", 0, js_shm_cache_clear ),
+    JS_CFUNC_DEF("count", 0, js_shm_cache_count ),
+    JS_CGETSET_MAGIC_DEF("capacity", js_shm_cache_get_info, NULL, 0 ),
+    JS_CGETSET_MAGIC_DEF("keySize", js_shm_cache_get_info, NULL, 1 ),
+    JS_CGETSET_MAGIC_DEF("valueSize", js_shm_cache_get_info, NULL, 2 ),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Cache", JS_PROP_CONFIGURABLE ),
+};
+
+static const JSCFunctionListEntry js_shm_funcs[] = {
+    JS_CFUNC_DEF("open", 2, js_shm_open ),
+    JS_CFUNC_DEF("unlink", 1, js_shm_unlink ),
+    JS_CFUNC_DEF("memfd", 2, js_shm_memfd ),
+    JS_CFUNC_DEF("map", 2, js_shm_map ),
+};
+
+static int js_shm_init(JSContext *ctx, JSModuleDef *m)
+{
+    JSRuntime *rt = JS_GetRuntime(ctx);
+    JSValue proto, ctor;
+
+    JS_NewClassID(rt, &js_shm_cache_class_id);
+    JS_NewClass(rt, js_shm_cache_class_id, &js_shm_cache_class);
+    proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, proto, js_shm_cache_proto_funcs,
+                               countof(js_shm_cache_proto_funcs));
+    ctor = JS_NewCFunction2(ctx, js_shm_cache_constructor, "Cache", 2,
+                            JS_CFUNC_constructor, 0);
+    JS_SetConstructor(ctx, ctor, proto);
+    JS_SetClassProto(ctx, js_shm_cache_class_id, proto);
+    JS_SetModuleExport(ctx, m, "Cache", ctor);
+    return JS_SetModuleExportList(ctx, m, js_shm_funcs, countof(js_shm_funcs));
+}
+
+JSModuleDef *js_init_module_qjsx_shm(JSContext *ctx, const char *module_name)
+{
+    JSModuleDef *m;
+    m = JS_NewCModule(ctx, module_name, js_shm_init);
+    if (!m)
+        return NULL;
+    JS_AddModuleExportList(ctx, m, js_shm_funcs, countof(js_shm_funcs));
+    JS_AddModuleExport(ctx, m, "Cache");
+    return m;
+}
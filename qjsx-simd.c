@@ -0,0 +1,1072 @@
+/*
+ * QJSX qjsx:simd module
+ *
+ * Vectorized kernels over typed arrays, so numeric aggregation over columns
+ * doesn't pay interpreter overhead per element:
+ *
+ *   import * as simd from "qjsx:simd";
+ *   simd.sum(f64)                  -> Number
+ *   simd.min(a), simd.max(a)       -> Number (NaN if any element is NaN)
+ *   simd.dot(a, b)                 -> Number
+ *   simd.add(dst, a, b)            -> dst    (also sub, mul, div)
+ *   simd.gt(mask, a, b)            -> mask   (also ge, lt, le, eq, ne)
+ *   simd.gather(dst, src, idx)     -> dst    dst[i] = src[idx[i]]
+ *   simd.scatter(dst, idx, src)    -> dst    dst[idx[i]] = src[i]
+ *   simd.prefixSum(dst, src)       -> dst    inclusive scan
+ *   simd.histogram(a, bins[, lo, hi]) -> Uint32Array(bins)
+ *   simd.sort(a)                   -> a      in place, radix sort
+ *   simd.isa                       -> "avx2", "sse2" or "generic"
+ *
+ * `b` may be a typed array of the same type and length as `a`, or a number.
+ * `dst` may be null, in which case a new array of the type of `a` (a
+ * Uint8Array for masks) is allocated. `dst` may alias the inputs.
+ *
+ * Results match the equivalent plain JS loop, with two exceptions: sums and
+ * dot products are accumulated in several lanes so rounding may differ from
+ * a sequential loop, and Int32/Uint32 `mul` wraps like Math.imul.
+ *
+ * On x86-64 Linux the hot kernels are compiled twice (AVX2 and baseline SSE2)
+ * and the CPU picks one at load time via GCC's target_clones; elsewhere the
+ * generic vector code is lowered to whatever the target provides.
+ * BigInt64/BigUint64 arrays are not supported.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "quickjs/cutils.h"
+#include "quickjs/quickjs.h"
+
+#if defined(__x86_64__) && defined(__linux__) && defined(__GNUC__)
+#define SIMD_DISPATCH __attribute__((target_clones("avx2", "default")))
+#else
+#define SIMD_DISPATCH
+#endif
+
+/* Element types we handle, independent of the JSTypedArrayEnum numbering
+   (which differs between QuickJS versions) */
+typedef enum {
+    SIMD_I8,
+    SIMD_U8,
+    SIMD_U8C,
+    SIMD_I16,
+    SIMD_U16,
+    SIMD_I32,
+    SIMD_U32,
+    SIMD_F32,
+    SIMD_F64,
+    SIMD_TYPE_COUNT,
+} SIMDType;
+
+typedef double v4df __attribute__((vector_size(32)));
+typedef int64_t v4di __attribute__((vector_size(32)));
+
+/* JS conversion of a double to an integer element (ToInt32 and friends):
+   truncate, then wrap modulo 2^64; the caller narrows to the element type */
+static inline uint64_t js_double_to_uint64(double d)
+{
+    if (!isfinite(d))
+        return 0;
+    d = fmod(trunc(d), 18446744073709551616.0);
+    return d < 0 ? -(uint64_t)-d : (uint64_t)d;
+}
+
+static inline uint8_t js_double_to_uint8_clamp(double d)
+{
+    if (!(d > 0))
+        return 0;
+    if (d >= 255)
+        return 255;
+    return lrint(d);
+}
+
+#define TO_INT(T, d) ((T)js_double_to_uint64(d))
+#define TO_FLOAT(T, d) ((T)(d))
+#define TO_CLAMP(T, d) js_double_to_uint8_clamp(d)
+
+/* ------------------------------------------------------------------------
+ * Kernels, instantiated once per element type
+ * ------------------------------------------------------------------------ */
+
+enum {
+    SIMD_OP_ADD,
+    SIMD_OP_SUB,
+    SIMD_OP_MUL,
+    SIMD_OP_DIV,
+};
+
+enum {
+    SIMD_CMP_GT,
+    SIMD_CMP_GE,
+    SIMD_CMP_LT,
+    SIMD_CMP_LE,
+    SIMD_CMP_EQ,
+    SIMD_CMP_NE,
+};
+
+/* NaN is sticky like in Math.min/Math.max: the blend below never picks a
+   NaN lane, so NaNs are tracked separately */
+#define DEF_MINMAX(name, sfx, T, OP, INIT)                              \
+SIMD_DISPATCH static double name##_##sfx(const void *pa, size_t n)      \
+{                                                                       \
+    const T *a = pa;                                                    \
+    v4df m, x;                                                          \
+    v4di nan = { 0 }, sel;                                              \
+    v4_##sfx v;                                                         \
+    size_t i = 0;                                                       \
+    double r = INIT, d;                                                 \
+    int k;                                                              \
+                                                                        \
+    if (n >= 4) {                                                       \
+        memcpy(&v, a, sizeof(v));                                       \
+        m = __builtin_convertvector(v, v4df);                           \
+        nan |= (v4di)(m != m);                                          \
+        for (i = 4; i + 4 <= n; i += 4) {                               \
+            memcpy(&v, a + i, sizeof(v));                               \
+            x = __builtin_convertvector(v, v4df);                       \
+            nan |= (v4di)(x != x);                                      \
+            sel = (v4di)(x OP m);                                       \
+            m = (v4df)(((v4di)x & sel) | ((v4di)m & ~sel));             \
+        }                                                               \
+        if (nan[0] | nan[1] | nan[2] | nan[3])                          \
+            return NAN;                                                 \
+        for (k = 0; k < 4; k++) {                                       \
+            if (m[k] OP r)                                              \
+                r = m[k];                                               \
+        }                                                               \
+    }                                                                   \
+    for (; i < n; i++) {                                                \
+        d = a[i];                                                       \
+        if (d != d)                                                     \
+            return NAN;                                                 \
+        if (d OP r)                                                     \
+            r = d;                                                      \
+    }                                                                   \
+    return r;                                                           \
+}
+
+#define DEF_REDUCE(sfx, T)                                              \
+typedef T v4_##sfx __attribute__((vector_size(4 * sizeof(T))));         \
+                                                                        \
+SIMD_DISPATCH static double sum_##sfx(const void *pa, size_t n)         \
+{                                                                       \
+    const T *a = pa;                                                    \
+    v4df acc0 = { 0 }, acc1 = { 0 };                                    \
+    v4_##sfx x, y;                                                      \
+    size_t i = 0;                                                       \
+    double s;                                                           \
+                                                                        \
+    for (; i + 8 <= n; i += 8) {                                        \
+        memcpy(&x, a + i, sizeof(x));                                   \
+        memcpy(&y, a + i + 4, sizeof(y));                               \
+        acc0 += __builtin_convertvector(x, v4df);                       \
+        acc1 += __builtin_convertvector(y, v4df);                       \
+    }                                                                   \
+    acc0 += acc1;                                                       \
+    s = (acc0[0] + acc0[1]) + (acc0[2] + acc0[3]);                      \
+    for (; i < n; i++)                                                  \
+        s += a[i];                                                      \
+    return s;                                                           \
+}                                                                       \
+                                                                        \
+SIMD_DISPATCH static double dot_##sfx(const void *pa, const void *pb,   \
+                                      size_t n)                         \
+{                                                                       \
+    const T *a = pa, *b = pb;                                           \
+    v4df acc0 = { 0 }, acc1 = { 0 };                                    \
+    v4_##sfx x0, x1, y0, y1;                                            \
+    size_t i = 0;                                                       \
+    double s;                                                           \
+                                                                        \
+    for (; i + 8 <= n; i += 8) {                                        \
+        memcpy(&x0, a + i, sizeof(x0));                                 \
+        memcpy(&x1, a + i + 4, sizeof(x1));                             \
+        memcpy(&y0, b + i, sizeof(y0));                                 \
+        memcpy(&y1, b + i + 4, sizeof(y1));                             \
+        acc0 += __builtin_convertvector(x0, v4df) *                     \
+            __builtin_convertvector(y0, v4df);                          \
+        acc1 += __builtin_convertvector(x1, v4df) *                     \
+            __builtin_convertvector(y1, v4df);                          \
+    }                                                                   \
+    acc0 += acc1;                                                       \
+    s = (acc0[0] + acc0[1]) + (acc0[2] + acc0[3]);                      \
+    for (; i < n; i++)                                                  \
+        s += (double)a[i] * (double)b[i];                               \
+    return s;                                                           \
+}                                                                       \
+                                                                        \
+DEF_MINMAX(min, sfx, T, <, INFINITY)                                    \
+DEF_MINMAX(max, sfx, T, >, -INFINITY)
+
+/* Elementwise arithmetic in the element domain. Only used when that gives
+   the same result as computing in double and converting back, see
+   simd_arith_fast() */
+#define DEF_ARITH_OP(name, sfx, T, OP)                                  \
+SIMD_DISPATCH static void name##_##sfx(void *pd, const void *pa,        \
+                                       const void *pb, size_t n)        \
+{                                                                       \
+    T *d = pd;                                                          \
+    const T *a = pa, *b = pb;                                           \
+    vw_##sfx x, y;                                                      \
+    size_t i = 0;                                                       \
+                                                                        \
+    for (; i + sizeof(x) / sizeof(T) <= n; i += sizeof(x) / sizeof(T)) { \
+        memcpy(&x, a + i, sizeof(x));                                   \
+        memcpy(&y, b + i, sizeof(y));                                   \
+        x = x OP y;                                                     \
+        memcpy(d + i, &x, sizeof(x));                                   \
+    }                                                                   \
+    for (; i < n; i++)                                                  \
+        d[i] = a[i] OP b[i];                                            \
+}                                                                       \
+                                                                        \
+SIMD_DISPATCH static void name##s_##sfx(void *pd, const void *pa,       \
+                                        double s, size_t n)             \
+{                                                                       \
+    T *d = pd;                                                          \
+    const T *a = pa;                                                    \
+    T t = (T)s;                                                         \
+    vw_##sfx x;                                                         \
+    size_t i = 0;                                                       \
+                                                                        \
+    for (; i + sizeof(x) / sizeof(T) <= n; i += sizeof(x) / sizeof(T)) { \
+        memcpy(&x, a + i, sizeof(x));                                   \
+        x = x OP t;                                                     \
+        memcpy(d + i, &x, sizeof(x));                                   \
+    }                                                                   \
+    for (; i < n; i++)                                                  \
+        d[i] = a[i] OP t;                                               \
+}
+
+#define DEF_ARITH(sfx, T)                                               \
+typedef T vw_##sfx __attribute__((vector_size(32)));                    \
+DEF_ARITH_OP(add, sfx, T, +)                                            \
+DEF_ARITH_OP(sub, sfx, T, -)                                            \
+DEF_ARITH_OP(mul, sfx, T, *)
+
+/* Reference path: compute in double and store with the JS conversion of
+   the element type. Used for integer division, Uint8ClampedArray, and
+   scalars that are not exactly representable in the element type */
+#define DEF_ARITH_DOUBLE(sfx, T, CONV)                                  \
+static void arith_double_##sfx(void *pd, const void *pa, const void *pb, \
+                               double s, size_t n, int op)              \
+{                                                                       \
+    T *d = pd;                                                          \
+    const T *a = pa, *b = pb;                                           \
+    double x, y, r;                                                     \
+    size_t i;                                                           \
+                                                                        \
+    for (i = 0; i < n; i++) {                                           \
+        x = a[i];                                                       \
+        y = b ? (double)b[i] : s;                                       \
+        switch (op) {                                                   \
+        case SIMD_OP_ADD: r = x + y; break;                             \
+        case SIMD_OP_SUB: r = x - y; break;                             \
+        case SIMD_OP_MUL: r = x * y; break;                             \
+        default: r = x / y; break;                                      \
+        }                                                               \
+        d[i] = CONV(T, r);                                              \
+    }                                                                   \
+}
+
+#define CMP_LOOP(OP)                                                    \
+    if (b) {                                                            \
+        for (i = 0; i < n; i++)                                         \
+            m[i] = (double)a[i] OP (double)b[i];                        \
+    } else {                                                            \
+        for (i = 0; i < n; i++)                                         \
+            m[i] = (double)a[i] OP s;                                   \
+    }                                                                   \
+    break;
+
+#define DEF_MISC(sfx, T, ACC, CONV)                                     \
+SIMD_DISPATCH static void cmp_##sfx(uint8_t *m, const void *pa,         \
+                                    const void *pb, double s, size_t n, \
+                                    int op)                             \
+{                                                                       \
+    const T *a = pa, *b = pb;                                           \
+    size_t i;                                                           \
+                                                                        \
+    switch (op) {                                                       \
+    case SIMD_CMP_GT: CMP_LOOP(>)                                       \
+    case SIMD_CMP_GE: CMP_LOOP(>=)                                      \
+    case SIMD_CMP_LT: CMP_LOOP(<)                                       \
+    case SIMD_CMP_LE: CMP_LOOP(<=)                                      \
+    case SIMD_CMP_EQ: CMP_LOOP(==)                                      \
+    default: CMP_LOOP(!=)                                               \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static void prefix_sum_##sfx(void *pd, const void *pa, size_t n)        \
+{                                                                       \
+    T *d = pd;                                                          \
+    const T *a = pa;                                                    \
+    ACC acc = 0;                                                        \
+    size_t i;                                                           \
+                                                                        \
+    for (i = 0; i < n; i++) {                                           \
+        acc += a[i];                                                    \
+        d[i] = CONV(T, acc);                                            \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static void histogram_##sfx(uint32_t *counts, uint32_t bins,            \
+                            const void *pa, size_t n,                   \
+                            double lo, double hi)                       \
+{                                                                       \
+    const T *a = pa;                                                    \
+    double scale = bins / (hi - lo), x;                                 \
+    int64_t k;                                                          \
+    size_t i;                                                           \
+                                                                        \
+    for (i = 0; i < n; i++) {                                           \
+        x = a[i];                                                       \
+        if (!(x >= lo && x <= hi))                                      \
+            continue;                                                   \
+        k = (int64_t)((x - lo) * scale);                                \
+        if (k >= bins)                                                  \
+            k = bins - 1;                                               \
+        counts[k]++;                                                    \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static void minmax_##sfx(const void *pa, size_t n, double *plo,         \
+                         double *phi)                                   \
+{                                                                       \
+    *plo = min_##sfx(pa, n);                                            \
+    *phi = max_##sfx(pa, n);                                            \
+}
+
+/* Integer prefix sums are exact in int64 and then wrap, which is what a
+   JS loop storing into the array does as long as it stays below 2^53 */
+#define STORE_WRAP(T, acc) ((T)(acc))
+
+DEF_REDUCE(i8, int8_t)
+DEF_REDUCE(u8, uint8_t)
+DEF_REDUCE(i16, int16_t)
+DEF_REDUCE(u16, uint16_t)
+DEF_REDUCE(i32, int32_t)
+DEF_REDUCE(u32, uint32_t)
+DEF_REDUCE(f32, float)
+DEF_REDUCE(f64, double)
+
+DEF_ARITH(i8, int8_t)
+DEF_ARITH(u8, uint8_t)
+DEF_ARITH(i16, int16_t)
+DEF_ARITH(u16, uint16_t)
+DEF_ARITH(i32, int32_t)
+DEF_ARITH(u32, uint32_t)
+DEF_ARITH(f32, float)
+DEF_ARITH(f64, double)
+DEF_ARITH_OP(div, f32, float, /)
+DEF_ARITH_OP(div, f64, double, /)
+
+DEF_ARITH_DOUBLE(i8, int8_t, TO_INT)
+DEF_ARITH_DOUBLE(u8, uint8_t, TO_INT)
+DEF_ARITH_DOUBLE(u8c, uint8_t, TO_CLAMP)
+DEF_ARITH_DOUBLE(i16, int16_t, TO_INT)
+DEF_ARITH_DOUBLE(u16, uint16_t, TO_INT)
+DEF_ARITH_DOUBLE(i32, int32_t, TO_INT)
+DEF_ARITH_DOUBLE(u32, uint32_t, TO_INT)
+DEF_ARITH_DOUBLE(f32, float, TO_FLOAT)
+DEF_ARITH_DOUBLE(f64, double, TO_FLOAT)
+
+DEF_MISC(i8, int8_t, int64_t, STORE_WRAP)
+DEF_MISC(u8, uint8_t, int64_t, STORE_WRAP)
+DEF_MISC(i16, int16_t, int64_t, STORE_WRAP)
+DEF_MISC(u16, uint16_t, int64_t, STORE_WRAP)
+DEF_MISC(i32, int32_t, int64_t, STORE_WRAP)
+DEF_MISC(u32, uint32_t, int64_t, STORE_WRAP)
+DEF_MISC(f32, float, double, TO_FLOAT)
+DEF_MISC(f64, double, double, TO_FLOAT)
+
+/* Uint8ClampedArray reads like Uint8Array; only stores differ */
+#define sum_u8c sum_u8
+#define dot_u8c dot_u8
+#define min_u8c min_u8
+#define max_u8c max_u8
+#define cmp_u8c cmp_u8
+#define histogram_u8c histogram_u8
+#define minmax_u8c minmax_u8
+
+static void prefix_sum_u8c(void *pd, const void *pa, size_t n)
+{
+    uint8_t *d = pd;
+    const uint8_t *a = pa;
+    double acc = 0;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        acc += a[i];
+        d[i] = js_double_to_uint8_clamp(acc);
+    }
+}
+
+typedef struct {
+    int size;               /* bytes per element */
+    JSTypedArrayEnum js_type;
+    BOOL is_float;
+    double (*sum)(const void *a, size_t n);
+    double (*dot)(const void *a, const void *b, size_t n);
+    double (*min)(const void *a, size_t n);
+    double (*max)(const void *a, size_t n);
+    /* add, sub, mul, div; NULL where the double path must be used */
+    void (*arith[4])(void *d, const void *a, const void *b, size_t n);
+    void (*arith_scalar[4])(void *d, const void *a, double s, size_t n);
+    void (*arith_double)(void *d, const void *a, const void *b, double s,
+                         size_t n, int op);
+    void (*cmp)(uint8_t *m, const void *a, const void *b, double s,
+                size_t n, int op);
+    void (*prefix_sum)(void *d, const void *a, size_t n);
+    void (*histogram)(uint32_t *counts, uint32_t bins, const void *a,
+                      size_t n, double lo, double hi);
+    void (*minmax)(const void *a, size_t n, double *plo, double *phi);
+} SIMDKernels;
+
+#define KERNELS_COMMON(sfx)                                             \
+    .sum = sum_##sfx, .dot = dot_##sfx, .min = min_##sfx,               \
+    .max = max_##sfx, .arith_double = arith_double_##sfx,               \
+    .cmp = cmp_##sfx, .prefix_sum = prefix_sum_##sfx,                   \
+    .histogram = histogram_##sfx, .minmax = minmax_##sfx
+
+static const SIMDKernels simd_kernels[SIMD_TYPE_COUNT] = {
+    [SIMD_I8] = { 1, JS_TYPED_ARRAY_INT8, FALSE, KERNELS_COMMON(i8),
+                  .arith = { add_i8, sub_i8, mul_i8, NULL },
+                  .arith_scalar = { adds_i8, subs_i8, muls_i8, NULL } },
+    [SIMD_U8] = { 1, JS_TYPED_ARRAY_UINT8, FALSE, KERNELS_COMMON(u8),
+                  .arith = { add_u8, sub_u8, mul_u8, NULL },
+                  .arith_scalar = { adds_u8, subs_u8, muls_u8, NULL } },
+    [SIMD_U8C] = { 1, JS_TYPED_ARRAY_UINT8C, FALSE, KERNELS_COMMON(u8c) },
+    [SIMD_I16] = { 2, JS_TYPED_ARRAY_INT16, FALSE, KERNELS_COMMON(i16),
+                   .arith = { add_i16, sub_i16, mul_i16, NULL },
+                   .arith_scalar = { adds_i16, subs_i16, muls_i16, NULL } },
+    [SIMD_U16] = { 2, JS_TYPED_ARRAY_UINT16, FALSE, KERNELS_COMMON(u16),
+                   .arith = { add_u16, sub_u16, mul_u16, NULL },
+                   .arith_scalar = { adds_u16, subs_u16, muls_u16, NULL } },
+    [SIMD_I32] = { 4, JS_TYPED_ARRAY_INT32, FALSE, KERNELS_COMMON(i32),
+                   .arith = { add_i32, sub_i32, mul_i32, NULL },
+                   .arith_scalar = { adds_i32, subs_i32, muls_i32, NULL } },
+    [SIMD_U32] = { 4, JS_TYPED_ARRAY_UINT32, FALSE, KERNELS_COMMON(u32),
+                   .arith = { add_u32, sub_u32, mul_u32, NULL },
+                   .arith_scalar = { adds_u32, subs_u32, muls_u32, NULL } },
+    [SIMD_F32] = { 4, JS_TYPED_ARRAY_FLOAT32, TRUE, KERNELS_COMMON(f32),
+                   .arith = { add_f32, sub_f32, mul_f32, div_f32 },
+                   .arith_scalar = { adds_f32, subs_f32, muls_f32, divs_f32 } },
+    [SIMD_F64] = { 8, JS_TYPED_ARRAY_FLOAT64, TRUE, KERNELS_COMMON(f64),
+                   .arith = { add_f64, sub_f64, mul_f64, div_f64 },
+                   .arith_scalar = { adds_f64, subs_f64, muls_f64, divs_f64 } },
+};
+
+/* ------------------------------------------------------------------------
+ * JS bindings
+ * ------------------------------------------------------------------------ */
+
+typedef struct {
+    uint8_t *data;
+    size_t len;             /* in elements */
+    SIMDType type;
+    const SIMDKernels *k;
+} SIMDArray;
+
+static int simd_type_from_js(int js_type)
+{
+    switch (js_type) {
+    case JS_TYPED_ARRAY_INT8: return SIMD_I8;
+    case JS_TYPED_ARRAY_UINT8: return SIMD_U8;
+    case JS_TYPED_ARRAY_UINT8C: return SIMD_U8C;
+    case JS_TYPED_ARRAY_INT16: return SIMD_I16;
+    case JS_TYPED_ARRAY_UINT16: return SIMD_U16;
+    case JS_TYPED_ARRAY_INT32: return SIMD_I32;
+    case JS_TYPED_ARRAY_UINT32: return SIMD_U32;
+    case JS_TYPED_ARRAY_FLOAT32: return SIMD_F32;
+    case JS_TYPED_ARRAY_FLOAT64: return SIMD_F64;
+    default: return -1;
+    }
+}
+
+/* Must be called after any conversion that can run user code (valueOf),
+   since that could detach or resize the buffer */
+static int simd_get_array(JSContext *ctx, SIMDArray *a, JSValueConst obj)
+{
+    size_t byte_offset, byte_length, bytes_per_element, size;
+    JSValue buf;
+    uint8_t *data;
+    int type;
+
+    type = simd_type_from_js(JS_GetTypedArrayType(obj));
+    if (type < 0) {
+        JS_ThrowTypeError(ctx, "expecting a non-BigInt typed array");
+        return -1;
+    }
+    buf = JS_GetTypedArrayBuffer(ctx, obj, &byte_offset, &byte_length,
+                                 &bytes_per_element);
+    if (JS_IsException(buf))
+        return -1;
+    data = JS_GetArrayBuffer(ctx, &size, buf);
+    JS_FreeValue(ctx, buf);
+    if (!data)
+        return -1;
+    a->data = data + byte_offset;
+    a->len = byte_length / bytes_per_element;
+    a->type = type;
+    a->k = &simd_kernels[type];
+    return 0;
+}
+
+static JSValue simd_new_array(JSContext *ctx, JSTypedArrayEnum js_type,
+                              size_t len)
+{
+    JSValue arg = JS_NewInt64(ctx, len);
+    JSValue obj = JS_NewTypedArray(ctx, 1, &arg, js_type);
+    JS_FreeValue(ctx, arg);
+    return obj;
+}
+
+/* Resolve the destination argument: reuse it if given, otherwise allocate
+   an array of the requested type. Returns a new reference. */
+static JSValue simd_get_dst(JSContext *ctx, SIMDArray *d, JSValueConst obj,
+                            JSTypedArrayEnum js_type, size_t len)
+{
+    JSValue ret;
+
+    if (JS_IsUndefined(obj) || JS_IsNull(obj))
+        ret = simd_new_array(ctx, js_type, len);
+    else
+        ret = JS_DupValue(ctx, obj);
+    if (JS_IsException(ret))
+        return ret;
+    if (simd_get_array(ctx, d, ret))
+        goto fail;
+    if (d->len < len) {
+        JS_ThrowRangeError(ctx, "destination array is too short");
+        goto fail;
+    }
+    return ret;
+ fail:
+    JS_FreeValue(ctx, ret);
+    return JS_EXCEPTION;
+}
+
+static int simd_check_same(JSContext *ctx, const SIMDArray *a,
+                           const SIMDArray *b)
+{
+    if (a->type != b->type) {
+        JS_ThrowTypeError(ctx, "typed arrays must have the same type");
+        return -1;
+    }
+    if (a->len != b->len) {
+        JS_ThrowRangeError(ctx, "typed arrays must have the same length");
+        return -1;
+    }
+    return 0;
+}
+
+static JSValue js_simd_sum(JSContext *ctx, JSValueConst this_val,
+                           int argc, JSValueConst *argv)
+{
+    SIMDArray a;
+
+    if (simd_get_array(ctx, &a, argv[0]))
+        return JS_EXCEPTION;
+    return JS_NewFloat64(ctx, a.k->sum(a.data, a.len));
+}
+
+static JSValue js_simd_minmax(JSContext *ctx, JSValueConst this_val,
+                              int argc, JSValueConst *argv, int is_max)
+{
+    SIMDArray a;
+
+    if (simd_get_array(ctx, &a, argv[0]))
+        return JS_EXCEPTION;
+    if (is_max)
+        return JS_NewFloat64(ctx, a.k->max(a.data, a.len));
+    else
+        return JS_NewFloat64(ctx, a.k->min(a.data, a.len));
+}
+
+static JSValue js_simd_dot(JSContext *ctx, JSValueConst this_val,
+                           int argc, JSValueConst *argv)
+{
+    SIMDArray a, b;
+
+    if (simd_get_array(ctx, &a, argv[0]) ||
+        simd_get_array(ctx, &b, argv[1]) ||
+        simd_check_same(ctx, &a, &b))
+        return JS_EXCEPTION;
+    return JS_NewFloat64(ctx, a.k->dot(a.data, b.data, a.len));
+}
+
+/* The element-domain kernels are exact for floats (a single IEEE operation
+   rounded to float equals the double result rounded to float) and for
+   integer add/sub/mul by a value representable in the element type */
+static BOOL simd_scalar_is_exact(const SIMDArray *a, double s)
+{
+    switch (a->type) {
+    case SIMD_I8: return s == (int8_t)s;
+    case SIMD_U8: return s == (uint8_t)s;
+    case SIMD_I16: return s == (int16_t)s;
+    case SIMD_U16: return s == (uint16_t)s;
+    case SIMD_I32: return s == (int32_t)s;
+    case SIMD_U32: return s == (uint32_t)s;
+    case SIMD_F32: return s == (float)s || s != s;
+    case SIMD_F64: return TRUE;
+    default: return FALSE;
+    }
+}
+
+static JSValue js_simd_arith(JSContext *ctx, JSValueConst this_val,
+                             int argc, JSValueConst *argv, int op)
+{
+    SIMDArray d, a, b;
+    JSValue ret;
+    double s = 0;
+    BOOL is_scalar;
+
+    is_scalar = (JS_GetTypedArrayType(argv[2]) < 0);
+    if (is_scalar && JS_ToFloat64(ctx, &s, argv[2]))
+        return JS_EXCEPTION;
+    if (simd_get_array(ctx, &a, argv[1]))
+        return JS_EXCEPTION;
+    ret = simd_get_dst(ctx, &d, argv[0], a.k->js_type, a.len);
+    if (JS_IsException(ret))
+        return ret;
+    if (d.type != a.type) {
+        JS_ThrowTypeError(ctx, "typed arrays must have the same type");
+        goto fail;
+    }
+    if (is_scalar) {
+        if (a.k->arith_scalar[op] && simd_scalar_is_exact(&a, s))
+            a.k->arith_scalar[op](d.data, a.data, s, a.len);
+        else
+            a.k->arith_double(d.data, a.data, NULL, s, a.len, op);
+    } else {
+        if (simd_get_array(ctx, &b, argv[2]) || simd_check_same(ctx, &a, &b))
+            goto fail;
+        if (a.k->arith[op])
+            a.k->arith[op](d.data, a.data, b.data, a.len);
+        else
+            a.k->arith_double(d.data, a.data, b.data, 0, a.len, op);
+    }
+    return ret;
+ fail:
+    JS_FreeValue(ctx, ret);
+    return JS_EXCEPTION;
+}
+
+static JSValue js_simd_cmp(JSContext *ctx, JSValueConst this_val,
+                           int argc, JSValueConst *argv, int op)
+{
+    SIMDArray m, a, b;
+    JSValue ret;
+    double s = 0;
+    BOOL is_scalar;
+
+    is_scalar = (JS_GetTypedArrayType(argv[2]) < 0);
+    if (is_scalar && JS_ToFloat64(ctx, &s, argv[2]))
+        return JS_EXCEPTION;
+    if (simd_get_array(ctx, &a, argv[1]))
+        return JS_EXCEPTION;
+    ret = simd_get_dst(ctx, &m, argv[0], JS_TYPED_ARRAY_UINT8, a.len);
+    if (JS_IsException(ret))
+        return ret;
+    if (m.k->size != 1) {
+        JS_ThrowTypeError(ctx, "mask must be a Uint8Array");
+        goto fail;
+    }
+    if (is_scalar) {
+        a.k->cmp(m.data, a.data, NULL, s, a.len, op);
+    } else {
+        if (simd_get_array(ctx, &b, argv[2]) || simd_check_same(ctx, &a, &b))
+            goto fail;
+        a.k->cmp(m.data, a.data, b.data, 0, a.len, op);
+    }
+    return ret;
+ fail:
+    JS_FreeValue(ctx, ret);
+    return JS_EXCEPTION;
+}
+
+/* gather/scatter only move elements, so they are typed by element size */
+#define DEF_MOVE(bits)                                                  \
+static int gather##bits(void *pd, const void *ps, size_t src_len,      \
+                        const uint32_t *idx, size_t n)                  \
+{                                                                       \
+    uint##bits##_t *d = pd;                                             \
+    const uint##bits##_t *s = ps;                                       \
+    size_t i;                                                           \
+                                                                        \
+    for (i = 0; i < n; i++) {                                           \
+        if (unlikely(idx[i] >= src_len))                                \
+            return -1;                                                  \
+        d[i] = s[idx[i]];                                               \
+    }                                                                   \
+    return 0;                                                           \
+}                                                                       \
+                                                                        \
+static int scatter##bits(void *pd, size_t dst_len, const uint32_t *idx, \
+                         const void *ps, size_t n)                      \
+{                                                                       \
+    uint##bits##_t *d = pd;                                             \
+    const uint##bits##_t *s = ps;                                       \
+    size_t i;                                                           \
+                                                                        \
+    for (i = 0; i < n; i++) {                                           \
+        if (unlikely(idx[i] >= dst_len))                                \
+            return -1;                                                  \
+        d[idx[i]] = s[i];                                               \
+    }                                                                   \
+    return 0;                                                           \
+}
+
+DEF_MOVE(8)
+DEF_MOVE(16)
+DEF_MOVE(32)
+DEF_MOVE(64)
+
+static int simd_get_indices(JSContext *ctx, SIMDArray *idx, JSValueConst obj)
+{
+    if (simd_get_array(ctx, idx, obj))
+        return -1;
+    if (idx->type != SIMD_I32 && idx->type != SIMD_U32) {
+        JS_ThrowTypeError(ctx, "indices must be an Int32Array or Uint32Array");
+        return -1;
+    }
+    return 0;
+}
+
+static JSValue js_simd_gather(JSContext *ctx, JSValueConst this_val,
+                              int argc, JSValueConst *argv)
+{
+    SIMDArray d, s, idx;
+    JSValue ret;
+    int res;
+
+    if (simd_get_array(ctx, &s, argv[1]) ||
+        simd_get_indices(ctx, &idx, argv[2]))
+        return JS_EXCEPTION;
+    ret = simd_get_dst(ctx, &d, argv[0], s.k->js_type, idx.len);
+    if (JS_IsException(ret))
+        return ret;
+    if (d.k->size != s.k->size) {
+        JS_ThrowTypeError(ctx, "typed arrays must have the same type");
+        goto fail;
+    }
+    switch (s.k->size) {
+    case 1: res = gather8(d.data, s.data, s.len, (uint32_t *)idx.data, idx.len); break;
+    case 2: res = gather16(d.data, s.data, s.len, (uint32_t *)idx.data, idx.len); break;
+    case 4: res = gather32(d.data, s.data, s.len, (uint32_t *)idx.data, idx.len); break;
+    default: res = gather64(d.data, s.data, s.len, (uint32_t *)idx.data, idx.len); break;
+    }
+    if (res) {
+        JS_ThrowRangeError(ctx, "index out of range");
+        goto fail;
+    }
+    return ret;
+ fail:
+    JS_FreeValue(ctx, ret);
+    return JS_EXCEPTION;
+}
+
+static JSValue js_simd_scatter(JSContext *ctx, JSValueConst this_val,
+                               int argc, JSValueConst *argv)
+{
+    SIMDArray d, s, idx;
+    int res;
+
+    if (simd_get_array(ctx, &d, argv[0]) ||
+        simd_get_indices(ctx, &idx, argv[1]) ||
+        simd_get_array(ctx, &s, argv[2]))
+        return JS_EXCEPTION;
+    if (d.k->size != s.k->size) {
+        JS_ThrowTypeError(ctx, "typed arrays must have the same type");
+        return JS_EXCEPTION;
+    }
+    if (idx.len > s.len) {
+        JS_ThrowRangeError(ctx, "source array is shorter than the indices");
+        return JS_EXCEPTION;
+    }
+    switch (s.k->size) {
+    case 1: res = scatter8(d.data, d.len, (uint32_t *)idx.data, s.data, idx.len); break;
+    case 2: res = scatter16(d.data, d.len, (uint32_t *)idx.data, s.data, idx.len); break;
+    case 4: res = scatter32(d.data, d.len, (uint32_t *)idx.data, s.data, idx.len); break;
+    default: res = scatter64(d.data, d.len, (uint32_t *)idx.data, s.data, idx.len); break;
+    }
+    if (res)
+        return JS_ThrowRangeError(ctx, "index out of range");
+    return JS_DupValue(ctx, argv[0]);
+}
+
+static JSValue js_simd_prefix_sum(JSContext *ctx, JSValueConst this_val,
+                                  int argc, JSValueConst *argv)
+{
+    SIMDArray d, a;
+    JSValue ret;
+
+    if (simd_get_array(ctx, &a, argv[1]))
+        return JS_EXCEPTION;
+    ret = simd_get_dst(ctx, &d, argv[0], a.k->js_type, a.len);
+    if (JS_IsException(ret))
+        return ret;
+    if (d.type != a.type) {
+        JS_ThrowTypeError(ctx, "typed arrays must have the same type");
+        goto fail;
+    }
+    a.k->prefix_sum(d.data, a.data, a.len);
+    return ret;
+ fail:
+    JS_FreeValue(ctx, ret);
+    return JS_EXCEPTION;
+}
+
+static JSValue js_simd_histogram(JSContext *ctx, JSValueConst this_val,
+                                 int argc, JSValueConst *argv)
+{
+    SIMDArray a, c;
+    JSValue ret;
+    uint32_t bins;
+    double lo = NAN, hi = NAN;
+
+    if (JS_ToUint32(ctx, &bins, argv[1]))
+        return JS_EXCEPTION;
+    if (bins == 0)
+        return JS_ThrowRangeError(ctx, "bins must be positive");
+    if (argc > 2 && !JS_IsUndefined(argv[2]) && JS_ToFloat64(ctx, &lo, argv[2]))
+        return JS_EXCEPTION;
+    if (argc > 3 && !JS_IsUndefined(argv[3]) && JS_ToFloat64(ctx, &hi, argv[3]))
+        return JS_EXCEPTION;
+    ret = simd_new_array(ctx, JS_TYPED_ARRAY_UINT32, bins);
+    if (JS_IsException(ret))
+        return ret;
+    if (simd_get_array(ctx, &c, ret) || simd_get_array(ctx, &a, argv[0]))
+        goto fail;
+    if (isnan(lo) || isnan(hi)) {
+        double dlo, dhi;
+        a.k->minmax(a.data, a.len, &dlo, &dhi);
+        if (isnan(lo))
+            lo = dlo;
+        if (isnan(hi))
+            hi = dhi;
+    }
+    /* empty input or a NaN range: all bins stay zero */
+    if (!(lo <= hi) || !isfinite(lo) || !isfinite(hi))
+        return ret;
+    if (lo == hi)
+        hi = lo + 1;
+    a.k->histogram((uint32_t *)c.data, bins, a.data, a.len, lo, hi);
+    return ret;
+ fail:
+    JS_FreeValue(ctx, ret);
+    return JS_EXCEPTION;
+}
+
+/* ------------------------------------------------------------------------
+ * Sorting
+ * ------------------------------------------------------------------------ */
+
+/*
+ * LSD radix sort over order-preserving unsigned keys. Floats map to keys by
+ * flipping all bits of negatives and the sign bit of positives, which puts
+ * -0 before +0; every NaN maps to the largest key so NaNs end up last. That
+ * is the order of TypedArray.prototype.sort() without a comparator. Digits
+ * on which all keys agree are skipped, so e.g. small positive Int32 values
+ * only take one or two passes.
+ */
+#define DEF_RADIX(bits)                                                 \
+static void radix_sort##bits(uint##bits##_t *a, uint##bits##_t *tmp,    \
+                             size_t n)                                  \
+{                                                                       \
+    size_t counts[bits / 8][256], sum, c, i, j;                         \
+    uint##bits##_t *src = a, *dst = tmp, *t, k;                         \
+    int d, shift;                                                       \
+                                                                        \
+    if (n < 64) {                                                       \
+        for (i = 1; i < n; i++) {                                       \
+            k = a[i];                                                   \
+            for (j = i; j > 0 && a[j - 1] > k; j--)                     \
+                a[j] = a[j - 1];                                        \
+            a[j] = k;                                                   \
+        }                                                               \
+        return;                                                         \
+    }                                                                   \
+    memset(counts, 0, sizeof(counts));                                  \
+    for (i = 0; i < n; i++) {                                           \
+        k = a[i];                                                       \
+        for (d = 0; d < bits / 8; d++)                                  \
+            counts[d][(k >> (d * 8)) & 0xff]++;                         \
+    }                                                                   \
+    for (d = 0; d < bits / 8; d++) {                                    \
+        shift = d * 8;                                                  \
+        if (counts[d][(src[0] >> shift) & 0xff] == n)                   \
+            continue;                                                   \
+        sum = 0;                                                        \
+        for (j = 0; j < 256; j++) {                                     \
+            c = counts[d][j];                                           \
+            counts[d][j] = sum;                                         \
+            sum += c;                                                   \
+        }                                                               \
+        for (i = 0; i < n; i++) {                                       \
+            k = src[i];                                                 \
+            dst[counts[d][(k >> shift) & 0xff]++] = k;                  \
+        }                                                               \
+        t = src;                                                        \
+        src = dst;                                                      \
+        dst = t;                                                        \
+    }                                                                   \
+    if (src != a)                                                       \
+        memcpy(a, src, n * sizeof(*a));                                 \
+}
+
+DEF_RADIX(16)
+DEF_RADIX(32)
+DEF_RADIX(64)
+
+static void counting_sort8(uint8_t *a, size_t n, uint8_t flip)
+{
+    size_t counts[256] = { 0 }, i, j, c;
+
+    for (i = 0; i < n; i++)
+        counts[a[i] ^ flip]++;
+    for (i = 0, j = 0; j < 256; j++) {
+        for (c = counts[j]; c > 0; c--)
+            a[i++] = j ^ flip;
+    }
+}
+
+static inline uint32_t f32_to_key(uint32_t u)
+{
+    if ((u & 0x7fffffff) > 0x7f800000)
+        return 0xffffffff;
+    return (u & 0x80000000) ? ~u : u | 0x80000000;
+}
+
+static inline uint32_t key_to_f32(uint32_t k)
+{
+    return (k & 0x80000000) ? k & 0x7fffffff : ~k;
+}
+
+static inline uint64_t f64_to_key(uint64_t u)
+{
+    const uint64_t sign = (uint64_t)1 << 63;
+    if ((u & ~sign) > 0x7ff0000000000000)
+        return UINT64_MAX;
+    return (u & sign) ? ~u : u | sign;
+}
+
+static inline uint64_t key_to_f64(uint64_t k)
+{
+    const uint64_t sign = (uint64_t)1 << 63;
+    return (k & sign) ? k & ~sign : ~k;
+}
+
+static JSValue js_simd_sort(JSContext *ctx, JSValueConst this_val,
+                            int argc, JSValueConst *argv)
+{
+    SIMDArray a;
+    void *tmp;
+    size_t i, n;
+
+    if (simd_get_array(ctx, &a, argv[0]))
+        return JS_EXCEPTION;
+    n = a.len;
+    if (a.k->size == 1) {
+        counting_sort8(a.data, n, a.type == SIMD_I8 ? 0x80 : 0);
+        return JS_DupValue(ctx, argv[0]);
+    }
+    tmp = js_malloc(ctx, n * a.k->size + 1);
+    if (!tmp)
+        return JS_EXCEPTION;
+    switch (a.type) {
+    case SIMD_I16:
+    case SIMD_U16: {
+        uint16_t *p = (uint16_t *)a.data, flip = (a.type == SIMD_I16) ? 0x8000 : 0;
+        for (i = 0; i < n; i++)
+            p[i] ^= flip;
+        radix_sort16(p, tmp, n);
+        for (i = 0; i < n; i++)
+            p[i] ^= flip;
+        break;
+    }
+    case SIMD_I32:
+    case SIMD_U32: {
+        uint32_t *p = (uint32_t *)a.data, flip = (a.type == SIMD_I32) ? 0x80000000 : 0;
+        for (i = 0; i < n; i++)
+            p[i] ^= flip;
+        radix_sort32(p, tmp, n);
+        for (i = 0; i < n; i++)
+            p[i] ^= flip;
+        break;
+    }
+    case SIMD_F32: {
+        uint32_t *p = (uint32_t *)a.data;
+        for (i = 0; i < n; i++)
+            p[i] = f32_to_key(p[i]);
+        radix_sort32(p, tmp, n);
+        for (i = 0; i < n; i++)
+            p[i] = key_to_f32(p[i]);
+        break;
+    }
+    default: {
+        uint64_t *p = (uint64_t *)a.data;
+        for (i = 0; i < n; i++)
+            p[i] = f64_to_key(p[i]);
+        radix_sort64(p, tmp, n);
+        for (i = 0; i < n; i++)
+            p[i] = key_to_f64(p[i]);
+        break;
+    }
+    }
+    js_free(ctx, tmp);
+    return JS_DupValue(ctx, argv[0]);
+}
+
+static const char *simd_isa(void)
+{
+#if defined(__x86_64__) && defined(__linux__) && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return "avx2";
+    return "sse2";
+#else
+    return "generic";
+#endif
+}
+
+static const JSCFunctionListEntry js_simd_funcs[] = {
+    JS_CFUNC_DEF("sum", 1, js_simd_sum ),
+    JS_CFUNC_MAGIC_DEF("min", 1, js_simd_minmax, 0 ),
+    JS_CFUNC_MAGIC_DEF("max", 1, js_simd_minmax, 1 ),
+    JS_CFUNC_DEF("dot", 2, js_simd_dot ),
+    JS_CFUNC_MAGIC_DEF("add", 3, js_simd_arith, SIMD_OP_ADD ),
+    JS_CFUNC_MAGIC_DEF("sub", 3, js_simd_arith, SIMD_OP_SUB ),
+    JS_CFUNC_MAGIC_DEF("mul", 3, js_simd_arith, SIMD_OP_MUL ),
+    JS_CFUNC_MAGIC_DEF("div", 3, js_simd_arith, SIMD_OP_DIV ),
+    JS_CFUNC_MAGIC_DEF("gt", 3, js_simd_cmp, SIMD_CMP_GT ),
+    JS_CFUNC_MAGIC_DEF("ge", 3, js_simd_cmp, SIMD_CMP_GE ),
+    JS_CFUNC_MAGIC_DEF("lt", 3, js_simd_cmp, SIMD_CMP_LT ),
+    JS_CFUNC_MAGIC_DEF("le", 3, js_simd_cmp, SIMD_CMP_LE ),
+    JS_CFUNC_MAGIC_DEF("eq", 3, js_simd_cmp, SIMD_CMP_EQ ),
+    JS_CFUNC_MAGIC_DEF("ne", 3, js_simd_cmp, SIMD_CMP_NE ),
+    JS_CFUNC_DEF("gather", 3, js_simd_gather ),
+    JS_CFUNC_DEF("scatter", 3, js_simd_scatter ),
+    JS_CFUNC_DEF("prefixSum", 2, js_simd_prefix_sum ),
+    JS_CFUNC_DEF("histogram", 4, js_simd_histogram ),
+    JS_CFUNC_DEF("sort", 1, js_simd_sort ),
+};
+
+static int js_simd_init(JSContext *ctx, JSModuleDef *m)
+{
+    JS_SetModuleExport(ctx, m, "isa", JS_NewString(ctx, simd_isa()));
+    return JS_SetModuleExportList(ctx, m, js_simd_funcs,
+                                  countof(js_simd_funcs));
+}
+
+JSModuleDef *js_init_module_qjsx_simd(JSContext *ctx, const char *module_name)
+{
+    JSModuleDef *m;
+    m = JS_NewCModule(ctx, module_name, js_simd_init);
+    if (!m)
+        return NULL;
+    JS_AddModuleExportList(ctx, m, js_simd_funcs, countof(js_simd_funcs));
+    JS_AddModuleExport(ctx, m, "isa");
+    return m;
+}
@@ -0,0 +1,2258 @@
+/*
+ * QJSX qjsx:tar module
+ *
+ * Streaming tar archives (ustar, with pax and GNU long-name extensions),
+ * read from and written to file descriptors in process. Archives compressed
+ * with gzip or zstd are recognized by their magic number and decompressed
+ * as they are read; written archives are compressed through the same codecs
+ * (qjsx-zlib.h).
+ *
+ *   import * as tar from "qjsx:tar";
+ *   for (const entry of tar.open("dist.tar.gz")) {       // path or fd
+ *       entry.name, entry.type, entry.size, entry.mode, entry.mtime, ...
+ *       entry.read()           -> ArrayBuffer with the entry data
+ *       entry.readString()     -> the data as UTF-8
+ *       entry.extract(path)    -> writes a file, directory or symlink
+ *   }
+ *   tar.list(archive)          -> array of entries
+ *   tar.extract(archive, dir, { strip }) -> number of entries extracted
+ *
+ *   const w = tar.create("dist.tar.gz", { compress, level });  // path or fd
+ *   w.add(name, data, { mode, mtime, uid, gid, uname, gname })
+ *   w.addFile(name, path, options)    // a file, symlink or empty directory
+ *   w.addDirectory(name, options), w.addSymlink(name, target, options)
+ *   w.addTree(name, dir, options)     // recursively, in sorted order
+ *   w.close()
+ *
+ * Entry types are "file", "directory", "symlink", "link" (hard link),
+ * "character", "block", "fifo" and "other"; mtime is in seconds.
+ *
+ * An uncompressed archive in a regular file is memory-mapped: read()
+ * returns a copy-on-write view into the mapping, valid at any time, and
+ * file data is extracted with copy_file_range() (sendfile() on older
+ * kernels), so it never passes through user space. Other archives are read
+ * sequentially: an entry's data can be read once, before the next entry,
+ * and is decoded straight into the returned buffer. Writers copy files into
+ * uncompressed archives with copy_file_range() or sendfile() as well.
+ *
+ * Extraction refuses absolute names and ".." components and does not
+ * follow symlinks: a parent directory that is a symlink is an error, and
+ * an existing file or symlink at an entry's name is replaced.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+#include "quickjs/cutils.h"
+#include "quickjs/quickjs.h"
+#include "qjsx-zlib.h"
+
+#define TAR_BLOCK           512
+#define TAR_BUF             (128 * 1024)
+#define TAR_MAX_META        (1024 * 1024)   /* pax and long-name records */
+#define TAR_MAX_ARRAY       ((uint64_t)INT32_MAX)
+#define TAR_OCTAL_MAX(n)    ((UINT64_C(1) << (3 * ((n) - 1))) - 1)
+
+typedef struct TarHeader {
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char chksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6];
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char pad[12];
+} TarHeader;
+
+typedef struct TarInfo {
+    char *name;
+    char *linkname;
+    char uname[33];
+    char gname[33];
+    char type;              /* ustar typeflag */
+    uint32_t mode;
+    uint32_t uid, gid;
+    int64_t mtime;
+    uint64_t size;          /* bytes of data following the header */
+} TarInfo;
+
+/* the mapping of an uncompressed archive, shared with the views into it */
+typedef struct TarMap {
+    int refs;
+    uint8_t *base;
+    size_t size;
+} TarMap;
+
+typedef struct TarReader {
+    int fd;
+    BOOL own_fd;
+    BOOL is_fifo;
+    TarMap *map;
+    QJSXCodec *codec;
+    BOOL codec_ended;
+    uint8_t *raw;           /* compressed input not decoded yet */
+    size_t raw_pos, raw_len;
+    BOOL raw_eof;
+    uint8_t *buf;           /* decoded bytes ahead of offset */
+    size_t buf_pos, buf_len;
+    BOOL try_copy_range, try_splice;
+    uint64_t offset;        /* position in the uncompressed archive */
+    uint64_t data_offset;   /* where the current entry's data starts */
+    uint64_t data_left;     /* data of the current entry not consumed yet */
+    uint64_t seq;           /* number of the current entry */
+    BOOL done;
+    TarInfo cur;
+    char err[256];
+} TarReader;
+
+typedef struct TarWriter {
+    int fd;
+    BOOL own_fd;
+    BOOL closed;
+    QJSXCodec *codec;
+    uint8_t *out;           /* pending output: archive or compressed bytes */
+    size_t out_len;
+    uint8_t *scratch;
+    BOOL try_copy_range, try_sendfile;
+    uint64_t offset;        /* bytes of uncompressed archive written */
+    char err[256];
+} TarWriter;
+
+typedef struct TarEntry {
+    JSValue reader;
+    uint64_t seq;
+    uint64_t data_offset;
+    TarInfo info;
+} TarEntry;
+
+typedef struct TarAddOptions {
+    int64_t mtime;          /* -1: from the file, or now */
+    int64_t uid, gid;       /* -1: from the file, or 0 */
+    int32_t mode;           /* -1: from the file, or the default */
+    char uname[33];
+    char gname[33];
+} TarAddOptions;
+
+static JSClassID js_tar_reader_class_id;
+static JSClassID js_tar_entry_class_id;
+static JSClassID js_tar_writer_class_id;
+
+static int __attribute__((format(printf, 2, 3)))
+tar_error(char *err, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(err, 256, fmt, ap);
+    va_end(ap);
+    return -1;
+}
+
+static int tar_errno(char *err, const char *what, const char *name)
+{
+    if (name)
+        return tar_error(err, "%s %s: %s", what, name, strerror(errno));
+    return tar_error(err, "%s: %s", what, strerror(errno));
+}
+
+static inline uint64_t tar_min(uint64_t a, uint64_t b)
+{
+    return a < b ? a : b;
+}
+
+static inline uint64_t tar_padding(uint64_t n)
+{
+    return (TAR_BLOCK - n % TAR_BLOCK) % TAR_BLOCK;
+}
+
+static void tar_info_free(TarInfo *info)
+{
+    free(info->name);
+    free(info->linkname);
+    info->name = NULL;
+    info->linkname = NULL;
+}
+
+static int tar_info_copy(TarInfo *dst, const TarInfo *src)
+{
+    *dst = *src;
+    dst->name = strdup(src->name);
+    dst->linkname = src->linkname ? strdup(src->linkname) : NULL;
+    if (!dst->name || (src->linkname && !dst->linkname)) {
+        tar_info_free(dst);
+        return -1;
+    }
+    return 0;
+}
+
+static const char *tar_type_name(char type)
+{
+    switch (type) {
+    case '0': case '\0': case '7':
+        return "file";
+    case '1':
+        return "link";
+    case '2':
+        return "symlink";
+    case '3':
+        return "character";
+    case '4':
+        return "block";
+    case '5':
+        return "directory";
+    case '6':
+        return "fifo";
+    default:
+        return "other";
+    }
+}
+
+static void tar_map_unref(TarMap *m)
+{
+    if (--m->refs == 0) {
+        munmap(m->base, m->size);
+        free(m);
+    }
+}
+
+static void tar_map_free(JSRuntime *rt, void *opaque, void *ptr)
+{
+    tar_map_unref(opaque);
+}
+
+static ssize_t tar_read_fd(int fd, void *buf, size_t len)
+{
+    ssize_t n;
+
+    do {
+        n = read(fd, buf, len);
+    } while (n < 0 && errno == EINTR);
+    return n;
+}
+
+static int tar_write_fd(int fd, const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* copy_file_range/sendfile/splice failures that mean "use read/write" */
+static BOOL tar_copy_unsupported(int err)
+{
+    return err == EINVAL || err == EXDEV || err == ENOSYS || err == EBADF ||
+        err == EOPNOTSUPP || err == ESPIPE;
+}
+
+/* Reading */
+
+/* read up to len decoded bytes from the archive source, bypassing buf */
+static ssize_t tr_source_read(TarReader *r, uint8_t *dst, size_t len)
+{
+    const uint8_t *p;
+    size_t left;
+    ptrdiff_t n;
+    int ended;
+    ssize_t got;
+
+    if (!r->codec) {
+        got = tar_read_fd(r->fd, dst, len);
+        if (got < 0)
+            return tar_errno(r->err, "read", NULL);
+        return got;
+    }
+    for (;;) {
+        if (r->codec_ended)
+            return 0;
+        if (r->raw_pos == r->raw_len && !r->raw_eof) {
+            got = tar_read_fd(r->fd, r->raw, TAR_BUF);
+            if (got < 0)
+                return tar_errno(r->err, "read", NULL);
+            r->raw_pos = 0;
+            r->raw_len = got;
+            r->raw_eof = got == 0;
+        }
+        p = r->raw + r->raw_pos;
+        left = r->raw_len - r->raw_pos;
+        n = qjsx_codec_run(r->codec, &p, &left, dst, len, r->raw_eof, &ended,
+                           r->err, sizeof(r->err));
+        if (n < 0)
+            return -1;
+        r->raw_pos = r->raw_len - left;
+        r->codec_ended = ended;
+        if (n > 0)
+            return n;
+        if (ended || (r->raw_eof && left == 0))
+            return 0;
+    }
+}
+
+/* read up to len bytes of the archive; returns less only at its end */
+static ssize_t tr_read(TarReader *r, uint8_t *dst, size_t len)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    if (r->map) {
+        if (r->offset >= r->map->size)
+            return 0;
+        done = tar_min(len, r->map->size - r->offset);
+        memcpy(dst, r->map->base + r->offset, done);
+        r->offset += done;
+        return done;
+    }
+    while (done < len) {
+        if (r->buf_pos < r->buf_len) {
+            n = tar_min(len - done, r->buf_len - r->buf_pos);
+            memcpy(dst + done, r->buf + r->buf_pos, n);
+            r->buf_pos += n;
+        } else if (len - done >= TAR_BUF / 2) {
+            /* large reads go straight to the destination */
+            n = tr_source_read(r, dst + done, len - done);
+        } else {
+            n = tr_source_read(r, r->buf, TAR_BUF);
+            if (n > 0) {
+                r->buf_pos = 0;
+                r->buf_len = n;
+                continue;
+            }
+        }
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        done += n;
+    }
+    r->offset += done;
+    return done;
+}
+
+static int tr_skip(TarReader *r, uint64_t len)
+{
+    uint64_t n;
+    ssize_t got;
+
+    if (r->map) {
+        if (len > r->map->size - tar_min(r->offset, r->map->size))
+            return tar_error(r->err, "unexpected end of archive");
+        r->offset += len;
+        return 0;
+    }
+    n = tar_min(len, r->buf_len - r->buf_pos);
+    r->buf_pos += n;
+    r->offset += n;
+    len -= n;
+    if (len > 0 && !r->codec && !r->is_fifo) {
+        if (lseek(r->fd, len, SEEK_CUR) >= 0) {
+            r->offset += len;
+            return 0;
+        }
+        r->is_fifo = TRUE;
+    }
+    while (len > 0) {
+        got = tr_source_read(r, r->buf, TAR_BUF);
+        if (got < 0)
+            return -1;
+        if (got == 0)
+            return tar_error(r->err, "unexpected end of archive");
+        n = tar_min(len, got);
+        r->buf_pos = n;
+        r->buf_len = got;
+        r->offset += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* numeric header field: octal, or base-256 (GNU) when the top bit is set */
+static uint64_t tar_parse_number(const char *field, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)field;
+    uint64_t v = 0;
+    size_t i = 0;
+
+    if (p[0] & 0x80) {
+        v = p[0] & 0x3f;
+        for (i = 1; i < len; i++)
+            v = v << 8 | p[i];
+        return v;
+    }
+    while (i < len && (p[i] == ' ' || p[i] == '\0'))
+        i++;
+    for (; i < len && p[i] >= '0' && p[i] <= '7'; i++)
+        v = v << 3 | (p[i] - '0');
+    return v;
+}
+
+static char *tar_strndup(const char *s, size_t max)
+{
+    size_t len = strnlen(s, max);
+    char *p = malloc(len + 1);
+
+    if (p) {
+        memcpy(p, s, len);
+        p[len] = '\0';
+    }
+    return p;
+}
+
+static BOOL tar_checksum_ok(const uint8_t *blk)
+{
+    const TarHeader *h = (const TarHeader *)blk;
+    uint64_t stored = tar_parse_number(h->chksum, sizeof(h->chksum));
+    uint32_t usum = 0;
+    int32_t ssum = 0;
+
+    for (int i = 0; i < TAR_BLOCK; i++) {
+        uint8_t c = i >= 148 && i < 156 ? ' ' : blk[i];
+        usum += c;
+        ssum += (int8_t)c;
+    }
+    return stored == usum || stored == (uint32_t)ssum;
+}
+
+typedef struct TarPax {
+    char *path;
+    char *linkpath;
+    char uname[33];
+    char gname[33];
+    BOOL has_size, has_mtime, has_uid, has_gid, has_uname, has_gname;
+    uint64_t size;
+    int64_t mtime;
+    uint64_t uid, gid;
+} TarPax;
+
+static void tar_pax_free(TarPax *pax)
+{
+    free(pax->path);
+    free(pax->linkpath);
+    memset(pax, 0, sizeof(*pax));
+}
+
+/* apply "<len> <key>=<value>\n" records */
+static int tar_parse_pax(TarReader *r, TarPax *pax, char *data, size_t len)
+{
+    size_t pos = 0;
+
+    while (pos < len) {
+        char *rec = data + pos, *end, *key, *eq;
+        unsigned long rlen = strtoul(rec, &end, 10);
+
+        if (end == rec || *end != ' ' || rlen == 0 || rlen > len - pos ||
+            rec[rlen - 1] != '\n')
+            return tar_error(r->err, "invalid pax header at offset %llu",
+                             (unsigned long long)r->offset);
+        rec[rlen - 1] = '\0';
+        key = end + 1;
+        eq = strchr(key, '=');
+        pos += rlen;
+        if (!eq)
+            continue;
+        *eq++ = '\0';
+        if (!strcmp(key, "path")) {
+            free(pax->path);
+            pax->path = strdup(eq);
+        } else if (!strcmp(key, "linkpath")) {
+            free(pax->linkpath);
+            pax->linkpath = strdup(eq);
+        } else if (!strcmp(key, "size")) {
+            pax->size = strtoull(eq, NULL, 10);
+            pax->has_size = TRUE;
+        } else if (!strcmp(key, "mtime")) {
+            pax->mtime = strtoll(eq, NULL, 10);
+            pax->has_mtime = TRUE;
+        } else if (!strcmp(key, "uid")) {
+            pax->uid = strtoull(eq, NULL, 10);
+            pax->has_uid = TRUE;
+        } else if (!strcmp(key, "gid")) {
+            pax->gid = strtoull(eq, NULL, 10);
+            pax->has_gid = TRUE;
+        } else if (!strcmp(key, "uname")) {
+            snprintf(pax->uname, sizeof(pax->uname), "%s", eq);
+            pax->has_uname = TRUE;
+        } else if (!strcmp(key, "gname")) {
+            snprintf(pax->gname, sizeof(pax->gname), "%s", eq);
+            pax->has_gname = TRUE;
+        }
+    }
+    return 0;
+}
+
+/* read the data of a metadata entry (pax, GNU long name) */
+static char *tr_read_meta(TarReader *r, uint64_t size)
+{
+    char *data;
+
+    if (size > TAR_MAX_META) {
+        tar_error(r->err, "tar metadata entry too large (%llu bytes)",
+                  (unsigned long long)size);
+        return NULL;
+    }
+    data = malloc(size + 1);
+    if (!data) {
+        tar_error(r->err, "out of memory");
+        return NULL;
+    }
+    if (tr_read(r, (uint8_t *)data, size) != (ssize_t)size ||
+        tr_skip(r, tar_padding(size))) {
+        if (!r->err[0])
+            tar_error(r->err, "unexpected end of archive");
+        free(data);
+        return NULL;
+    }
+    data[size] = '\0';
+    return data;
+}
+
+/* advance to the next entry: 1 when there is one, 0 at the end, -1 on error */
+static int tr_next(TarReader *r)
+{
+    uint8_t blk[TAR_BLOCK];
+    const TarHeader *h = (const TarHeader *)blk;
+    TarPax pax = { 0 };
+    char *long_name = NULL, *long_link = NULL, *data;
+    uint64_t size;
+    ssize_t n;
+
+    if (r->done)
+        return 0;
+    tar_info_free(&r->cur);
+    r->err[0] = '\0';
+    if (r->seq > 0 &&
+        (tr_skip(r, r->map ? r->data_offset + r->cur.size - r->offset
+                 : r->data_left) ||
+         tr_skip(r, tar_padding(r->offset))))
+        goto fail;
+    r->data_left = 0;
+    for (;;) {
+        n = tr_read(r, blk, TAR_BLOCK);
+        if (n < 0)
+            goto fail;
+        if (n == 0)
+            break; /* no end-of-archive blocks: accept */
+        if (n < TAR_BLOCK) {
+            tar_error(r->err, "unexpected end of archive");
+            goto fail;
+        }
+        for (n = 0; n < TAR_BLOCK && blk[n] == 0; n++)
+            continue;
+        if (n == TAR_BLOCK)
+            break;
+        if (!tar_checksum_ok(blk)) {
+            tar_error(r->err, "invalid tar header at offset %llu",
+                      (unsigned long long)(r->offset - TAR_BLOCK));
+            goto fail;
+        }
+        size = tar_parse_number(h->size, sizeof(h->size));
+        switch (h->typeflag) {
+        case 'L':
+        case 'K':
+        case 'x':
+        case 'g':
+            data = tr_read_meta(r, size);
+            if (!data)
+                goto fail;
+            if (h->typeflag == 'L') {
+                free(long_name);
+                long_name = data;
+            } else if (h->typeflag == 'K') {
+                free(long_link);
+                long_link = data;
+            } else {
+                /* global headers only carry defaults nobody relies on */
+                int ret = h->typeflag == 'x'
+                    ? tar_parse_pax(r, &pax, data, size) : 0;
+                free(data);
+                if (ret)
+                    goto fail;
+            }
+            continue;
+        default:
+            break;
+        }
+
+        memset(&r->cur, 0, sizeof(r->cur));
+        r->cur.type = h->typeflag;
+        r->cur.mode = tar_parse_number(h->mode, sizeof(h->mode)) & 07777;
+        r->cur.uid = pax.has_uid ? pax.uid : tar_parse_number(h->uid, sizeof(h->uid));
+        r->cur.gid = pax.has_gid ? pax.gid : tar_parse_number(h->gid, sizeof(h->gid));
+        r->cur.mtime = pax.has_mtime ? pax.mtime
+            : (int64_t)tar_parse_number(h->mtime, sizeof(h->mtime));
+        r->cur.size = pax.has_size ? pax.size : size;
+        if (h->typeflag >= '1' && h->typeflag <= '6')
+            r->cur.size = 0;
+        if (pax.has_uname)
+            snprintf(r->cur.uname, sizeof(r->cur.uname), "%s", pax.uname);
+        else
+            memcpy(r->cur.uname, h->uname, strnlen(h->uname, sizeof(h->uname)));
+        if (pax.has_gname)
+            snprintf(r->cur.gname, sizeof(r->cur.gname), "%s", pax.gname);
+        else
+            memcpy(r->cur.gname, h->gname, strnlen(h->gname, sizeof(h->gname)));
+
+        if (pax.path) {
+            r->cur.name = pax.path;
+            pax.path = NULL;
+        } else if (long_name) {
+            r->cur.name = long_name;
+            long_name = NULL;
+        } else if (h->prefix[0] && !memcmp(h->magic, "ustar", 5)) {
+            size_t plen = strnlen(h->prefix, sizeof(h->prefix));
+            size_t nlen = strnlen(h->name, sizeof(h->name));
+            r->cur.name = malloc(plen + nlen + 2);
+            if (r->cur.name) {
+                memcpy(r->cur.name, h->prefix, plen);
+                r->cur.name[plen] = '/';
+                memcpy(r->cur.name + plen + 1, h->name, nlen);
+                r->cur.name[plen + nlen + 1] = '\0';
+            }
+        } else {
+            r->cur.name = tar_strndup(h->name, sizeof(h->name));
+        }
+        if (pax.linkpath) {
+            r->cur.linkname = pax.linkpath;
+            pax.linkpath = NULL;
+        } else if (long_link) {
+            r->cur.linkname = long_link;
+            long_link = NULL;
+        } else if (h->linkname[0]) {
+            r->cur.linkname = tar_strndup(h->linkname, sizeof(h->linkname));
+        }
+        if (!r->cur.name || (h->linkname[0] && !r->cur.linkname)) {
+            tar_error(r->err, "out of memory");
+            goto fail;
+        }
+        r->data_offset = r->offset;
+        r->data_left = r->cur.size;
+        r->seq++;
+        tar_pax_free(&pax);
+        free(long_name);
+        free(long_link);
+        return 1;
+    }
+    r->done = TRUE;
+    tar_pax_free(&pax);
+    free(long_name);
+    free(long_link);
+    return 0;
+ fail:
+    r->done = TRUE;
+    tar_pax_free(&pax);
+    free(long_name);
+    free(long_link);
+    return -1;
+}
+
+static void tr_close(TarReader *r)
+{
+    if (r->map) {
+        tar_map_unref(r->map);
+        r->map = NULL;
+    }
+    qjsx_codec_free(r->codec);
+    r->codec = NULL;
+    if (r->own_fd && r->fd >= 0)
+        close(r->fd);
+    r->fd = -1;
+    free(r->raw);
+    free(r->buf);
+    r->raw = r->buf = NULL;
+    tar_info_free(&r->cur);
+    r->done = TRUE;
+}
+
+static int tr_open(TarReader *r, int fd, BOOL own_fd)
+{
+    static const uint8_t gzip_magic[2] = { 0x1f, 0x8b };
+    static const uint8_t zstd_magic[4] = { 0x28, 0xb5, 0x2f, 0xfd };
+    struct stat st;
+    ssize_t n;
+    uint8_t *tmp;
+
+    memset(r, 0, sizeof(*r));
+    r->fd = fd;
+    r->own_fd = own_fd;
+    r->try_copy_range = r->try_splice = TRUE;
+    if (fstat(fd, &st) < 0)
+        return tar_errno(r->err, "stat", NULL);
+    r->is_fifo = !S_ISREG(st.st_mode);
+
+    /* an uncompressed archive file is mapped as a whole */
+    if (S_ISREG(st.st_mode) && st.st_size >= TAR_BLOCK &&
+        lseek(fd, 0, SEEK_CUR) == 0) {
+        uint8_t magic[4];
+        if (pread(fd, magic, sizeof(magic), 0) == sizeof(magic) &&
+            memcmp(magic, gzip_magic, 2) && memcmp(magic, zstd_magic, 4)) {
+            void *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE, fd, 0);
+            if (base != MAP_FAILED) {
+                r->map = malloc(sizeof(TarMap));
+                if (!r->map) {
+                    munmap(base, st.st_size);
+                    return tar_error(r->err, "out of memory");
+                }
+                r->map->refs = 1;
+                r->map->base = base;
+                r->map->size = st.st_size;
+                return 0;
+            }
+        }
+    }
+
+    r->raw = malloc(TAR_BUF);
+    r->buf = malloc(TAR_BUF);
+    if (!r->raw || !r->buf)
+        return tar_error(r->err, "out of memory");
+    while (r->raw_len < sizeof(zstd_magic)) {
+        n = tar_read_fd(fd, r->raw + r->raw_len, TAR_BUF - r->raw_len);
+        if (n < 0)
+            return tar_errno(r->err, "read", NULL);
+        if (n == 0) {
+            r->raw_eof = TRUE;
+            break;
+        }
+        r->raw_len += n;
+    }
+    if (r->raw_len >= 2 && !memcmp(r->raw, gzip_magic, 2))
+        r->codec = qjsx_codec_new("gunzip", -1, r->err, sizeof(r->err));
+    else if (r->raw_len >= 4 && !memcmp(r->raw, zstd_magic, 4))
+        r->codec = qjsx_codec_new("zstdDecompress", -1, r->err, sizeof(r->err));
+    else {
+        /* plain stream: what was read is archive data */
+        tmp = r->buf;
+        r->buf = r->raw;
+        r->raw = tmp;
+        r->buf_len = r->raw_len;
+        r->raw_len = 0;
+        return 0;
+    }
+    return r->codec ? 0 : -1;
+}
+
+/* Extraction */
+
+/* write the current entry's data (at data_offset, size bytes) to out */
+static int tr_copy_data(TarReader *r, uint64_t data_offset, uint64_t size,
+                        int out)
+{
+    uint64_t left = size;
+    ssize_t n;
+
+    if (r->map) {
+        off_t off = data_offset;
+#if defined(__linux__)
+        while (left > 0 && r->try_copy_range) {
+            n = copy_file_range(r->fd, &off, out, NULL, tar_min(left, 1 << 30), 0);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n == 0 || tar_copy_unsupported(errno)) {
+                    r->try_copy_range = FALSE;
+                    break;
+                }
+                return tar_errno(r->err, "copy_file_range", NULL);
+            }
+            left -= n;
+        }
+        while (left > 0) {
+            n = sendfile(out, r->fd, &off, tar_min(left, 1 << 30));
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n == 0 || tar_copy_unsupported(errno))
+                    break;
+                return tar_errno(r->err, "sendfile", NULL);
+            }
+            left -= n;
+        }
+#endif
+        if (left > 0 && tar_write_fd(out, r->map->base + data_offset + size - left, left))
+            return tar_errno(r->err, "write", NULL);
+        return 0;
+    }
+
+    n = tar_min(left, r->buf_len - r->buf_pos);
+    if (n > 0 && tar_write_fd(out, r->buf + r->buf_pos, n))
+        return tar_errno(r->err, "write", NULL);
+    r->buf_pos += n;
+    left -= n;
+#if defined(__linux__)
+    /* uncompressed input: let the kernel move the data */
+    while (left > 0 && !r->codec && r->try_copy_range) {
+        n = copy_file_range(r->fd, NULL, out, NULL, tar_min(left, 1 << 30), 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n == 0 || tar_copy_unsupported(errno)) {
+                r->try_copy_range = FALSE;
+                break;
+            }
+            return tar_errno(r->err, "copy_file_range", NULL);
+        }
+        left -= n;
+    }
+    while (left > 0 && !r->codec && r->is_fifo && r->try_splice) {
+        n = splice(r->fd, NULL, out, NULL, tar_min(left, 1 << 30), SPLICE_F_MOVE);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n == 0 || tar_copy_unsupported(errno)) {
+                r->try_splice = FALSE;
+                break;
+            }
+            return tar_errno(r->err, "splice", NULL);
+        }
+        left -= n;
+    }
+#endif
+    while (left > 0) {
+        n = tr_source_read(r, r->buf, TAR_BUF);
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            return tar_error(r->err, "unexpected end of archive");
+        r->buf_pos = tar_min(left, n);
+        r->buf_len = n;
+        if (tar_write_fd(out, r->buf, r->buf_pos))
+            return tar_errno(r->err, "write", NULL);
+        left -= r->buf_pos;
+    }
+    r->offset += size;
+    return 0;
+}
+
+/* name relative to the destination, after strip; NULL to skip the entry */
+static const char *tar_safe_name(char *err, const char *name, int strip,
+                                 int *perr)
+{
+    const char *p;
+
+    *perr = 0;
+    while (*name == '/')
+        name++;
+    for (; strip > 0; strip--) {
+        p = strchr(name, '/');
+        if (!p)
+            return NULL;
+        name = p + 1;
+        while (*name == '/')
+            name++;
+    }
+    for (p = name; *p;) {
+        size_t len = strcspn(p, "/");
+        if (len == 2 && p[0] == '.' && p[1] == '.') {
+            *perr = tar_error(err, "unsafe path in archive: %s", name);
+            return NULL;
+        }
+        p += len;
+        while (*p == '/')
+            p++;
+    }
+    return *name ? name : NULL;
+}
+
+/*
+ * Check that no parent of path below its first skip bytes is a symlink,
+ * creating the missing ones if create is set.
+ */
+static int tar_check_parents(char *err, char *path, size_t skip, BOOL create)
+{
+    struct stat st;
+    char *p;
+
+    for (p = path + skip; (p = strchr(p + 1, '/')) != NULL;) {
+        *p = '\0';
+        if (lstat(path, &st) == 0) {
+            if (S_ISLNK(st.st_mode)) {
+                tar_error(err, "refusing to extract through symlink %s", path);
+                *p = '/';
+                return -1;
+            }
+            if (!S_ISDIR(st.st_mode)) {
+                errno = ENOTDIR;
+                tar_errno(err, "mkdir", path);
+                *p = '/';
+                return -1;
+            }
+        } else if (!create) {
+            *p = '/';
+            return 0;
+        } else if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+            tar_errno(err, "mkdir", path);
+            *p = '/';
+            return -1;
+        }
+        *p = '/';
+    }
+    return 0;
+}
+
+/* remove a file or symlink standing where an entry goes */
+static int tar_replace(char *err, const char *path, BOOL keep_dir)
+{
+    struct stat st;
+
+    if (lstat(path, &st) < 0 || (S_ISDIR(st.st_mode) && keep_dir))
+        return 0;
+    if (unlink(path) < 0 && errno != ENOENT)
+        return tar_errno(err, "unlink", path);
+    return 0;
+}
+
+/*
+ * Extract the current entry to path. link_base is the destination directory
+ * for hard links (their targets are archive names), or NULL.
+ */
+static int tr_extract(TarReader *r, const TarInfo *info, uint64_t data_offset,
+                      const char *path, const char *link_base, int strip)
+{
+    struct timespec times[2];
+    char *target;
+    int fd, ret, e;
+
+    times[0].tv_sec = times[1].tv_sec = info->mtime;
+    times[0].tv_nsec = times[1].tv_nsec = 0;
+    switch (info->type) {
+    case '5':
+        if (tar_replace(r->err, path, TRUE))
+            return -1;
+        if (mkdir(path, (info->mode & 0777) | 0700) < 0 && errno != EEXIST)
+            return tar_errno(r->err, "mkdir", path);
+        return 0;
+    case '2':
+        if (tar_replace(r->err, path, FALSE))
+            return -1;
+        if (symlink(info->linkname ? info->linkname : "", path) < 0)
+            return tar_errno(r->err, "symlink", path);
+        utimensat(AT_FDCWD, path, times, AT_SYMLINK_NOFOLLOW);
+        return 0;
+    case '1':
+        if (!link_base)
+            return tar_error(r->err, "hard links can only be extracted by tar.extract()");
+        if (!info->linkname ||
+            !tar_safe_name(r->err, info->linkname, strip, &e)) {
+            if (e)
+                return -1;
+            return tar_error(r->err, "invalid hard link target for %s", info->name);
+        }
+        target = malloc(strlen(link_base) + strlen(info->linkname) + 2);
+        if (!target)
+            return tar_error(r->err, "out of memory");
+        sprintf(target, "%s/%s", link_base,
+                tar_safe_name(r->err, info->linkname, strip, &e));
+        /* the target must not be reached through an extracted symlink */
+        ret = tar_check_parents(r->err, target, strlen(link_base), FALSE);
+        if (!ret)
+            ret = tar_replace(r->err, path, FALSE);
+        if (!ret && link(target, path) < 0)
+            ret = tar_errno(r->err, "link", path);
+        free(target);
+        return ret;
+    case '6':
+        if (tar_replace(r->err, path, FALSE))
+            return -1;
+        if (mkfifo(path, info->mode & 0777) < 0)
+            return tar_errno(r->err, "mkfifo", path);
+        utimensat(AT_FDCWD, path, times, AT_SYMLINK_NOFOLLOW);
+        return 0;
+    case '3':
+    case '4':
+        return 0; /* device nodes are not recreated */
+    default:
+        break;
+    }
+    if (tar_replace(r->err, path, FALSE))
+        return -1;
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC,
+              info->mode & 0777);
+    if (fd < 0)
+        return tar_errno(r->err, "open", path);
+    ret = tr_copy_data(r, data_offset, info->size, fd);
+    if (!r->map && !ret)
+        r->data_left = 0;
+    if (!ret)
+        futimens(fd, times);
+    if (close(fd) < 0 && !ret)
+        ret = tar_errno(r->err, "close", path);
+    return ret;
+}
+
+/* Writing */
+
+static int tw_flush(TarWriter *w)
+{
+    if (w->out_len > 0 && tar_write_fd(w->fd, w->out, w->out_len))
+        return tar_errno(w->err, "write", NULL);
+    w->out_len = 0;
+    return 0;
+}
+
+/* append archive bytes, compressing them when needed */
+static int tw_put(TarWriter *w, const void *data, size_t len, BOOL finish)
+{
+    const uint8_t *p = data;
+    ptrdiff_t n;
+    int ended = 0;
+
+    w->offset += len;
+    if (!w->codec) {
+        if (w->out_len + len > TAR_BUF) {
+            if (tw_flush(w))
+                return -1;
+            if (len >= TAR_BUF) {
+                if (tar_write_fd(w->fd, p, len))
+                    return tar_errno(w->err, "write", NULL);
+                return 0;
+            }
+        }
+        memcpy(w->out + w->out_len, p, len);
+        w->out_len += len;
+        return 0;
+    }
+    while (len > 0 || (finish && !ended)) {
+        n = qjsx_codec_run(w->codec, &p, &len, w->out + w->out_len,
+                           TAR_BUF - w->out_len, finish, &ended, w->err,
+                           sizeof(w->err));
+        if (n < 0)
+            return -1;
+        w->out_len += n;
+        if (w->out_len == TAR_BUF && tw_flush(w))
+            return -1;
+    }
+    return 0;
+}
+
+static int tw_zeros(TarWriter *w, uint64_t len)
+{
+    static const uint8_t zeros[TAR_BLOCK * 2];
+
+    while (len > 0) {
+        size_t n = tar_min(len, sizeof(zeros));
+        if (tw_put(w, zeros, n, FALSE))
+            return -1;
+        len -= n;
+    }
+    return 0;
+}
+
+/* copy len bytes of a file into the archive */
+static int tw_copy_fd(TarWriter *w, int in, uint64_t len, const char *path)
+{
+    uint64_t left = len;
+    ssize_t n;
+
+    if (!w->codec) {
+        if (tw_flush(w))
+            return -1;
+#if defined(__linux__)
+        while (left > 0 && w->try_copy_range) {
+            n = copy_file_range(in, NULL, w->fd, NULL, tar_min(left, 1 << 30), 0);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n == 0)
+                    break;
+                if (tar_copy_unsupported(errno)) {
+                    w->try_copy_range = FALSE;
+                    break;
+                }
+                return tar_errno(w->err, "copy_file_range", path);
+            }
+            left -= n;
+            w->offset += n;
+        }
+        /* pipes and sockets */
+        while (left > 0 && w->try_sendfile) {
+            n = sendfile(w->fd, in, NULL, tar_min(left, 1 << 30));
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n == 0)
+                    break;
+                if (tar_copy_unsupported(errno)) {
+                    w->try_sendfile = FALSE;
+                    break;
+                }
+                return tar_errno(w->err, "sendfile", path);
+            }
+            left -= n;
+            w->offset += n;
+        }
+#endif
+    }
+    while (left > 0) {
+        n = tar_read_fd(in, w->scratch, tar_min(left, TAR_BUF));
+        if (n < 0)
+            return tar_errno(w->err, "read", path);
+        if (n == 0)
+            break;
+        if (tw_put(w, w->scratch, n, FALSE))
+            return -1;
+        left -= n;
+    }
+    if (left > 0) {
+        /* keep the archive consistent with the header we wrote */
+        if (tw_zeros(w, left))
+            return -1;
+        return tar_error(w->err, "%s shrank while it was being archived", path);
+    }
+    return 0;
+}
+
+static void tw_octal(char *field, size_t width, uint64_t v)
+{
+    snprintf(field, width, "%0*llo", (int)width - 1, (unsigned long long)v);
+}
+
+static int tw_pax_record(char **buf, size_t *len, size_t *size,
+                         const char *key, const char *value)
+{
+    size_t n = strlen(key) + strlen(value) + 3, digits = 1, total;
+    char *p;
+
+    for (size_t t = n + 1; t >= 10; t /= 10)
+        digits++;
+    total = n + digits;
+    if (snprintf(NULL, 0, "%zu", total) != (int)digits)
+        total++;
+    if (*len + total + 1 > *size) {
+        size_t new_size = (*len + total + 1) * 2;
+        p = realloc(*buf, new_size);
+        if (!p)
+            return -1;
+        *buf = p;
+        *size = new_size;
+    }
+    *len += snprintf(*buf + *len, total + 1, "%zu %s=%s\n", total, key, value);
+    return 0;
+}
+
+static int tw_header_block(TarWriter *w, const char *name, char type,
+                           uint64_t size, const TarInfo *info,
+                           const char *linkname)
+{
+    uint8_t blk[TAR_BLOCK];
+    TarHeader *h = (TarHeader *)blk;
+    size_t len = strlen(name), split = 0;
+    uint32_t sum = 0;
+
+    memset(blk, 0, sizeof(blk));
+    /* ustar splits long names at a '/' into prefix and name */
+    if (len > sizeof(h->name)) {
+        for (size_t i = len - sizeof(h->name) - 1; i < len && i <= sizeof(h->prefix); i++) {
+            if (name[i] == '/' && i > 0) {
+                split = i;
+                break;
+            }
+        }
+    }
+    if (split) {
+        memcpy(h->prefix, name, split);
+        memcpy(h->name, name + split + 1, len - split - 1);
+    } else {
+        memcpy(h->name, name, tar_min(len, sizeof(h->name)));
+    }
+    tw_octal(h->mode, sizeof(h->mode), info->mode & 07777);
+    tw_octal(h->uid, sizeof(h->uid), tar_min(info->uid, TAR_OCTAL_MAX(8)));
+    tw_octal(h->gid, sizeof(h->gid), tar_min(info->gid, TAR_OCTAL_MAX(8)));
+    tw_octal(h->size, sizeof(h->size), tar_min(size, TAR_OCTAL_MAX(12)));
+    tw_octal(h->mtime, sizeof(h->mtime),
+             info->mtime < 0 ? 0 : tar_min(info->mtime, TAR_OCTAL_MAX(12)));
+    h->typeflag = type;
+    if (linkname)
+        memcpy(h->linkname, linkname, tar_min(strlen(linkname), sizeof(h->linkname)));
+    memcpy(h->magic, "ustar", 6);
+    memcpy(h->version, "00", 2);
+    memcpy(h->uname, info->uname, strnlen(info->uname, sizeof(h->uname)));
+    memcpy(h->gname, info->gname, strnlen(info->gname, sizeof(h->gname)));
+    tw_octal(h->devmajor, sizeof(h->devmajor), 0);
+    tw_octal(h->devminor, sizeof(h->devminor), 0);
+    memset(h->chksum, ' ', sizeof(h->chksum));
+    for (int i = 0; i < TAR_BLOCK; i++)
+        sum += blk[i];
+    snprintf(h->chksum, sizeof(h->chksum), "%06o", sum);
+    h->chksum[7] = ' ';
+    return tw_put(w, blk, TAR_BLOCK, FALSE);
+}
+
+static BOOL tw_name_fits(const char *name)
+{
+    size_t len = strlen(name);
+
+    if (len <= 100)
+        return TRUE;
+    for (size_t i = len - 101; i < len && i <= 155; i++) {
+        if (name[i] == '/' && i > 0)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* write the header(s) of an entry: a pax header first if ustar can't hold it */
+static int tw_header(TarWriter *w, const TarInfo *info, uint64_t size)
+{
+    char *pax = NULL, num[32];
+    size_t pax_len = 0, pax_size = 0;
+    int ret = 0;
+
+    if (!tw_name_fits(info->name))
+        ret |= tw_pax_record(&pax, &pax_len, &pax_size, "path", info->name);
+    if (info->linkname && strlen(info->linkname) > 100)
+        ret |= tw_pax_record(&pax, &pax_len, &pax_size, "linkpath", info->linkname);
+    if (size > TAR_OCTAL_MAX(12)) {
+        snprintf(num, sizeof(num), "%llu", (unsigned long long)size);
+        ret |= tw_pax_record(&pax, &pax_len, &pax_size, "size", num);
+    }
+    if (info->mtime < 0 || (uint64_t)info->mtime > TAR_OCTAL_MAX(12)) {
+        snprintf(num, sizeof(num), "%lld", (long long)info->mtime);
+        ret |= tw_pax_record(&pax, &pax_len, &pax_size, "mtime", num);
+    }
+    if (info->uid > TAR_OCTAL_MAX(8)) {
+        snprintf(num, sizeof(num), "%u", info->uid);
+        ret |= tw_pax_record(&pax, &pax_len, &pax_size, "uid", num);
+    }
+    if (info->gid > TAR_OCTAL_MAX(8)) {
+        snprintf(num, sizeof(num), "%u", info->gid);
+        ret |= tw_pax_record(&pax, &pax_len, &pax_size, "gid", num);
+    }
+    if (ret) {
+        free(pax);
+        return tar_error(w->err, "out of memory");
+    }
+    if (pax) {
+        TarInfo pi = *info;
+        const char *base = strrchr(info->name, '/');
+        char pname[100];
+
+        base = base && base[1] ? base + 1 : info->name;
+        snprintf(pname, sizeof(pname), "PaxHeaders/%.80s", base);
+        pi.mtime = info->mtime < 0 ? 0 : tar_min(info->mtime, TAR_OCTAL_MAX(12));
+        ret = tw_header_block(w, pname, 'x', pax_len, &pi, NULL) ||
+            tw_put(w, pax, pax_len, FALSE) ||
+            tw_zeros(w, tar_padding(pax_len));
+        free(pax);
+        if (ret)
+            return -1;
+    }
+    return tw_header_block(w, info->name, info->type, size, info, info->linkname);
+}
+
+static int tw_add_data(TarWriter *w, const TarInfo *info, const uint8_t *data,
+                       uint64_t len)
+{
+    if (tw_header(w, info, len) || tw_put(w, data, len, FALSE))
+        return -1;
+    return tw_zeros(w, tar_padding(w->offset));
+}
+
+static void tw_fill_info(TarInfo *info, const char *name, char type,
+                         const struct stat *st, const TarAddOptions *o)
+{
+    memset(info, 0, sizeof(*info));
+    info->name = (char *)name;
+    info->type = type;
+    info->mode = o->mode >= 0 ? o->mode : st ? st->st_mode & 07777
+        : type == '5' ? 0755 : type == '2' ? 0777 : 0644;
+    info->mtime = o->mtime >= 0 ? o->mtime : st ? st->st_mtime : time(NULL);
+    info->uid = o->uid >= 0 ? o->uid : st ? st->st_uid : 0;
+    info->gid = o->gid >= 0 ? o->gid : st ? st->st_gid : 0;
+    memcpy(info->uname, o->uname, sizeof(info->uname));
+    memcpy(info->gname, o->gname, sizeof(info->gname));
+}
+
+/* add one file system object; directories recursively when recurse is set */
+static int tw_add_path(TarWriter *w, const char *name, const char *path,
+                       const TarAddOptions *o, BOOL recurse, int *count)
+{
+    struct stat st;
+    TarInfo info;
+    char *dname = NULL, *target = NULL;
+    int ret = 0, fd;
+
+    if (lstat(path, &st) < 0)
+        return tar_errno(w->err, "stat", path);
+    if (S_ISREG(st.st_mode)) {
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return tar_errno(w->err, "open", path);
+        tw_fill_info(&info, name, '0', &st, o);
+        ret = tw_header(w, &info, st.st_size) ||
+            tw_copy_fd(w, fd, st.st_size, path) ||
+            tw_zeros(w, tar_padding(w->offset));
+        close(fd);
+    } else if (S_ISLNK(st.st_mode)) {
+        size_t size = st.st_size > 0 ? st.st_size + 1 : 4096;
+        ssize_t n;
+        target = malloc(size);
+        if (!target)
+            return tar_error(w->err, "out of memory");
+        n = readlink(path, target, size);
+        if (n < 0 || (size_t)n >= size) {
+            free(target);
+            return tar_errno(w->err, "readlink", path);
+        }
+        target[n] = '\0';
+        tw_fill_info(&info, name, '2', &st, o);
+        info.linkname = target;
+        ret = tw_header(w, &info, 0);
+        free(target);
+    } else if (S_ISDIR(st.st_mode)) {
+        size_t len = strlen(name);
+        dname = malloc(len + 2);
+        if (!dname)
+            return tar_error(w->err, "out of memory");
+        memcpy(dname, name, len);
+        strcpy(dname + len, len > 0 && name[len - 1] == '/' ? "" : "/");
+        tw_fill_info(&info, dname, '5', &st, o);
+        ret = len > 0 ? tw_header(w, &info, 0) : 0;
+        if (!ret && recurse) {
+            struct dirent **list;
+            int n = scandir(path, &list, NULL, alphasort);
+            if (n < 0) {
+                ret = tar_errno(w->err, "opendir", path);
+            } else {
+                for (int i = 0; i < n; i++) {
+                    const char *c = list[i]->d_name;
+                    char *cpath, *cname;
+                    if (!ret && strcmp(c, ".") && strcmp(c, "..")) {
+                        cpath = malloc(strlen(path) + strlen(c) + 2);
+                        cname = malloc(strlen(dname) + strlen(c) + 1);
+                        if (!cpath || !cname) {
+                            ret = tar_error(w->err, "out of memory");
+                        } else {
+                            sprintf(cpath, "%s/%s", path, c);
+                            sprintf(cname, "%s%s", len > 0 ? dname : "", c);
+                            ret = tw_add_path(w, cname, cpath, o, TRUE, count);
+                        }
+                        free(cpath);
+                        free(cname);
+                    }
+                    free(list[i]);
+                }
+                free(list);
+            }
+        }
+        free(dname);
+        if (len == 0)
+            return ret;
+    } else if (S_ISFIFO(st.st_mode)) {
+        tw_fill_info(&info, name, '6', &st, o);
+        ret = tw_header(w, &info, 0);
+    } else {
+        return 0; /* sockets and device nodes are left out */
+    }
+    if (!ret)
+        (*count)++;
+    return ret ? -1 : 0;
+}
+
+static int tw_close(TarWriter *w)
+{
+    int ret = 0;
+
+    if (w->closed)
+        return 0;
+    w->closed = TRUE;
+    /* end of archive: two zero blocks */
+    if (tw_zeros(w, 2 * TAR_BLOCK) || (w->codec && tw_put(w, NULL, 0, TRUE)) ||
+        tw_flush(w))
+        ret = -1;
+    if (w->own_fd && close(w->fd) < 0 && !ret)
+        ret = tar_errno(w->err, "close", NULL);
+    return ret;
+}
+
+static void tw_free(TarWriter *w)
+{
+    if (!w->closed && w->own_fd)
+        close(w->fd);
+    w->closed = TRUE;
+    qjsx_codec_free(w->codec);
+    free(w->out);
+    free(w->scratch);
+    w->codec = NULL;
+    w->out = w->scratch = NULL;
+}
+
+/* JavaScript bindings */
+
+static JSValue js_tar_throw(JSContext *ctx, const char *err)
+{
+    return JS_ThrowTypeError(ctx, "%s", err);
+}
+
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    const char *str;
+} TarBytes;
+
+static int tar_get_bytes(JSContext *ctx, TarBytes *b, JSValueConst val)
+{
+    size_t offset, length, elem_size, size;
+    JSValue buf;
+
+    b->str = NULL;
+    if (JS_IsString(val)) {
+        b->str = JS_ToCStringLen(ctx, &b->len, val);
+        if (!b->str)
+            return -1;
+        b->data = (const uint8_t *)b->str;
+    } else if (JS_IsObject(val) && JS_GetTypedArrayType(val) >= 0) {
+        buf = JS_GetTypedArrayBuffer(ctx, val, &offset, &length, &elem_size);
+        if (JS_IsException(buf))
+            return -1;
+        /* the typed array keeps the buffer alive */
+        b->data = JS_GetArrayBuffer(ctx, &size, buf);
+        JS_FreeValue(ctx, buf);
+        if (!b->data)
+            return -1;
+        b->data += offset;
+        b->len = length;
+    } else if (JS_IsObject(val)) {
+        b->data = JS_GetArrayBuffer(ctx, &b->len, val);
+        if (!b->data)
+            return -1;
+    } else {
+        JS_ThrowTypeError(ctx, "data must be a string, ArrayBuffer or typed array");
+        return -1;
+    }
+    return 0;
+}
+
+/* a path to open, or a file descriptor owned by the caller */
+static int tar_get_fd(JSContext *ctx, JSValueConst val, int flags, BOOL *own,
+                      char *err)
+{
+    const char *path;
+    int32_t fd;
+
+    if (JS_IsNumber(val)) {
+        if (JS_ToInt32(ctx, &fd, val))
+            return -1;
+        *own = FALSE;
+        return fd;
+    }
+    path = JS_ToCString(ctx, val);
+    if (!path)
+        return -1;
+    fd = open(path, flags | O_CLOEXEC, 0644);
+    if (fd < 0)
+        js_tar_throw(ctx, (tar_errno(err, "open", path), err));
+    JS_FreeCString(ctx, path);
+    *own = TRUE;
+    return fd;
+}
+
+static int tar_get_int64(JSContext *ctx, JSValueConst obj, const char *name,
+                         int64_t *pval)
+{
+    JSValue v = JS_GetPropertyStr(ctx, obj, name);
+    int ret = 0;
+
+    if (JS_IsException(v))
+        return -1;
+    if (!JS_IsUndefined(v))
+        ret = JS_ToInt64(ctx, pval, v);
+    JS_FreeValue(ctx, v);
+    return ret;
+}
+
+static int tar_get_name(JSContext *ctx, JSValueConst obj, const char *name,
+                        char *buf, size_t size)
+{
+    JSValue v = JS_GetPropertyStr(ctx, obj, name);
+    const char *s;
+
+    if (JS_IsException(v))
+        return -1;
+    if (!JS_IsUndefined(v)) {
+        s = JS_ToCString(ctx, v);
+        JS_FreeValue(ctx, v);
+        if (!s)
+            return -1;
+        snprintf(buf, size, "%s", s);
+        JS_FreeCString(ctx, s);
+    }
+    return 0;
+}
+
+static int tar_get_add_options(JSContext *ctx, JSValueConst obj, TarAddOptions *o)
+{
+    int64_t mode = -1;
+
+    memset(o, 0, sizeof(*o));
+    o->mtime = o->uid = o->gid = o->mode = -1;
+    if (JS_IsUndefined(obj) || JS_IsNull(obj))
+        return 0;
+    if (!JS_IsObject(obj)) {
+        JS_ThrowTypeError(ctx, "options must be an object");
+        return -1;
+    }
+    if (tar_get_int64(ctx, obj, "mtime", &o->mtime) ||
+        tar_get_int64(ctx, obj, "uid", &o->uid) ||
+        tar_get_int64(ctx, obj, "gid", &o->gid) ||
+        tar_get_int64(ctx, obj, "mode", &mode) ||
+        tar_get_name(ctx, obj, "uname", o->uname, sizeof(o->uname)) ||
+        tar_get_name(ctx, obj, "gname", o->gname, sizeof(o->gname)))
+        return -1;
+    if (o->uid > UINT32_MAX || o->gid > UINT32_MAX || mode > 07777) {
+        JS_ThrowRangeError(ctx, "uid, gid or mode out of range");
+        return -1;
+    }
+    o->mode = mode;
+    return 0;
+}
+
+static JSValue tar_new_entry_object(JSContext *ctx, JSValueConst reader,
+                                    TarReader *r)
+{
+    TarEntry *e;
+    JSValue obj;
+    const TarInfo *i = &r->cur;
+
+    obj = JS_NewObjectClass(ctx, js_tar_entry_class_id);
+    if (JS_IsException(obj))
+        return obj;
+    e = js_mallocz(ctx, sizeof(*e));
+    if (!e)
+        goto fail;
+    e->reader = JS_UNDEFINED;
+    JS_SetOpaque(obj, e);
+    if (tar_info_copy(&e->info, i)) {
+        JS_ThrowOutOfMemory(ctx);
+        goto fail;
+    }
+    e->reader = JS_DupValue(ctx, reader);
+    e->seq = r->seq;
+    e->data_offset = r->data_offset;
+    JS_DefinePropertyValueStr(ctx, obj, "name", JS_NewString(ctx, i->name), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "type", JS_NewString(ctx, tar_type_name(i->type)), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "size", JS_NewInt64(ctx, i->size), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "mode", JS_NewInt32(ctx, i->mode), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "uid", JS_NewInt64(ctx, i->uid), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "gid", JS_NewInt64(ctx, i->gid), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "mtime", JS_NewInt64(ctx, i->mtime), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "linkname", i->linkname
+                              ? JS_NewString(ctx, i->linkname) : JS_NULL, JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "uname", JS_NewString(ctx, i->uname), JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "gname", JS_NewString(ctx, i->gname), JS_PROP_C_W_E);
+    return obj;
+ fail:
+    JS_FreeValue(ctx, obj);
+    return JS_EXCEPTION;
+}
+
+/* Reader */
+
+static void js_tar_reader_finalizer(JSRuntime *rt, JSValue val)
+{
+    TarReader *r = JS_GetOpaque(val, js_tar_reader_class_id);
+
+    if (r) {
+        tr_close(r);
+        js_free_rt(rt, r);
+    }
+}
+
+static JSValue tar_open_reader(JSContext *ctx, JSValueConst target)
+{
+    TarReader *r;
+    JSValue obj;
+    char err[256];
+    BOOL own;
+    int fd;
+
+    fd = tar_get_fd(ctx, target, O_RDONLY, &own, err);
+    if (fd < 0)
+        return JS_EXCEPTION;
+    obj = JS_NewObjectClass(ctx, js_tar_reader_class_id);
+    if (JS_IsException(obj))
+        goto fail_fd;
+    r = js_mallocz(ctx, sizeof(*r));
+    if (!r) {
+        JS_FreeValue(ctx, obj);
+        goto fail_fd;
+    }
+    if (tr_open(r, fd, own)) {
+        js_tar_throw(ctx, r->err);
+        tr_close(r);
+        js_free(ctx, r);
+        JS_FreeValue(ctx, obj);
+        return JS_EXCEPTION;
+    }
+    JS_SetOpaque(obj, r);
+    return obj;
+ fail_fd:
+    if (own)
+        close(fd);
+    return JS_EXCEPTION;
+}
+
+static JSValue js_tar_open(JSContext *ctx, JSValueConst this_val,
+                           int argc, JSValueConst *argv)
+{
+    return tar_open_reader(ctx, argv[0]);
+}
+
+/* reader.next() -> iterator result with the next entry */
+static JSValue js_tar_reader_next(JSContext *ctx, JSValueConst this_val,
+                                  int argc, JSValueConst *argv)
+{
+    TarReader *r = JS_GetOpaque2(ctx, this_val, js_tar_reader_class_id);
+    JSValue result, entry;
+    int ret;
+
+    if (!r)
+        return JS_EXCEPTION;
+    ret = tr_next(r);
+    if (ret < 0)
+        return js_tar_throw(ctx, r->err);
+    result = JS_NewObject(ctx);
+    if (JS_IsException(result))
+        return result;
+    if (ret == 0) {
+        JS_SetPropertyStr(ctx, result, "value", JS_UNDEFINED);
+        JS_SetPropertyStr(ctx, result, "done", JS_TRUE);
+        return result;
+    }
+    entry = tar_new_entry_object(ctx, this_val, r);
+    if (JS_IsException(entry)) {
+        JS_FreeValue(ctx, result);
+        return entry;
+    }
+    JS_SetPropertyStr(ctx, result, "value", entry);
+    JS_SetPropertyStr(ctx, result, "done", JS_FALSE);
+    return result;
+}
+
+static JSValue js_tar_reader_iterator(JSContext *ctx, JSValueConst this_val,
+                                      int argc, JSValueConst *argv)
+{
+    return JS_DupValue(ctx, this_val);
+}
+
+static JSValue js_tar_reader_close(JSContext *ctx, JSValueConst this_val,
+                                   int argc, JSValueConst *argv)
+{
+    TarReader *r = JS_GetOpaque2(ctx, this_val, js_tar_reader_class_id);
+
+    if (!r)
+        return JS_EXCEPTION;
+    tr_close(r);
+    return JS_UNDEFINED;
+}
+
+/* Entries */
+
+static void js_tar_entry_finalizer(JSRuntime *rt, JSValue val)
+{
+    TarEntry *e = JS_GetOpaque(val, js_tar_entry_class_id);
+
+    if (e) {
+        JS_FreeValueRT(rt, e->reader);
+        tar_info_free(&e->info);
+        js_free_rt(rt, e);
+    }
+}
+
+static void js_tar_entry_mark(JSRuntime *rt, JSValueConst val,
+                              JS_MarkFunc *mark_func)
+{
+    TarEntry *e = JS_GetOpaque(val, js_tar_entry_class_id);
+
+    if (e)
+        JS_MarkValue(rt, e->reader, mark_func);
+}
+
+/* the entry and its reader, if the entry data can still be read */
+static TarEntry *tar_entry_get(JSContext *ctx, JSValueConst this_val,
+                               TarReader **pr)
+{
+    TarEntry *e = JS_GetOpaque2(ctx, this_val, js_tar_entry_class_id);
+    TarReader *r;
+
+    if (!e)
+        return NULL;
+    r = JS_GetOpaque(e->reader, js_tar_reader_class_id);
+    if (!r || (!r->map && (r->fd < 0 || r->seq != e->seq))) {
+        JS_ThrowTypeError(ctx, "the data of %s is no longer available: entries "
+                          "of a compressed or streamed archive must be read "
+                          "before the next one", e->info.name);
+        return NULL;
+    }
+    if (!r->map && r->data_left != e->info.size) {
+        JS_ThrowTypeError(ctx, "the data of %s was already read", e->info.name);
+        return NULL;
+    }
+    *pr = r;
+    return e;
+}
+
+static void js_tar_free_buffer(JSRuntime *rt, void *opaque, void *ptr)
+{
+    js_free_rt(rt, ptr);
+}
+
+static JSValue tar_entry_data(JSContext *ctx, JSValueConst this_val,
+                              BOOL as_string)
+{
+    TarReader *r;
+    TarEntry *e = tar_entry_get(ctx, this_val, &r);
+    uint8_t *data;
+    JSValue val;
+
+    if (!e)
+        return JS_EXCEPTION;
+    if (e->info.size > TAR_MAX_ARRAY)
+        return JS_ThrowRangeError(ctx, "%s is too large to read into memory, "
+                                  "extract it instead", e->info.name);
+    if (r->map) {
+        if (e->data_offset + e->info.size > r->map->size)
+            return JS_ThrowTypeError(ctx, "unexpected end of archive");
+        data = r->map->base + e->data_offset;
+        if (as_string)
+            return JS_NewStringLen(ctx, (const char *)data, e->info.size);
+        /* a view into the mapping, which stays until the view is freed */
+        r->map->refs++;
+        val = JS_NewArrayBuffer(ctx, data, e->info.size, tar_map_free, r->map, FALSE);
+        if (JS_IsException(val))
+            r->map->refs--;
+        return val;
+    }
+    data = js_malloc(ctx, e->info.size + 1);
+    if (!data)
+        return JS_EXCEPTION;
+    if (tr_read(r, data, e->info.size) != (ssize_t)e->info.size) {
+        js_free(ctx, data);
+        r->data_left = 0;
+        return js_tar_throw(ctx, r->err[0] ? r->err : "unexpected end of archive");
+    }
+    r->data_left = 0;
+    if (as_string) {
+        val = JS_NewStringLen(ctx, (const char *)data, e->info.size);
+        js_free(ctx, data);
+        return val;
+    }
+    val = JS_NewArrayBuffer(ctx, data, e->info.size, js_tar_free_buffer, NULL, FALSE);
+    if (JS_IsException(val))
+        js_free(ctx, data);
+    return val;
+}
+
+/* entry.read() -> ArrayBuffer, entry.readString() */
+static JSValue js_tar_entry_read(JSContext *ctx, JSValueConst this_val,
+                                 int argc, JSValueConst *argv, int magic)
+{
+    return tar_entry_data(ctx, this_val, magic);
+}
+
+/* entry.extract(path) */
+static JSValue js_tar_entry_extract(JSContext *ctx, JSValueConst this_val,
+                                    int argc, JSValueConst *argv)
+{
+    TarReader *r;
+    TarEntry *e = tar_entry_get(ctx, this_val, &r);
+    const char *path;
+    int ret;
+
+    if (!e)
+        return JS_EXCEPTION;
+    path = JS_ToCString(ctx, argv[0]);
+    if (!path)
+        return JS_EXCEPTION;
+    ret = tr_extract(r, &e->info, e->data_offset, path, NULL, 0);
+    JS_FreeCString(ctx, path);
+    if (ret)
+        return js_tar_throw(ctx, r->err);
+    return JS_UNDEFINED;
+}
+
+/* tar.list(archive) -> array of entries */
+static JSValue js_tar_list(JSContext *ctx, JSValueConst this_val,
+                           int argc, JSValueConst *argv)
+{
+    JSValue reader, list, entry;
+    TarReader *r;
+    uint32_t i = 0;
+    int ret;
+
+    reader = tar_open_reader(ctx, argv[0]);
+    if (JS_IsException(reader))
+        return reader;
+    r = JS_GetOpaque(reader, js_tar_reader_class_id);
+    list = JS_NewArray(ctx);
+    if (JS_IsException(list))
+        goto fail;
+    while ((ret = tr_next(r)) > 0) {
+        entry = tar_new_entry_object(ctx, reader, r);
+        if (JS_IsException(entry))
+            goto fail;
+        JS_SetPropertyUint32(ctx, list, i++, entry);
+    }
+    if (ret < 0) {
+        js_tar_throw(ctx, r->err);
+        goto fail;
+    }
+    JS_FreeValue(ctx, reader);
+    return list;
+ fail:
+    JS_FreeValue(ctx, list);
+    JS_FreeValue(ctx, reader);
+    return JS_EXCEPTION;
+}
+
+/* tar.extract(archive, dir[, { strip }]) -> number of entries extracted */
+static JSValue js_tar_extract(JSContext *ctx, JSValueConst this_val,
+                              int argc, JSValueConst *argv)
+{
+    JSValue reader = JS_UNDEFINED, v;
+    TarReader *r;
+    const char *dest, *name;
+    char *path = NULL;
+    size_t dest_len, len;
+    int32_t strip = 0;
+    int64_t count = 0;
+    int ret, err = 0;
+
+    if (argc > 2 && JS_IsObject(argv[2])) {
+        v = JS_GetPropertyStr(ctx, argv[2], "strip");
+        if (JS_IsException(v))
+            return v;
+        ret = JS_IsUndefined(v) ? 0 : JS_ToInt32(ctx, &strip, v);
+        JS_FreeValue(ctx, v);
+        if (ret)
+            return JS_EXCEPTION;
+        if (strip < 0)
+            return JS_ThrowRangeError(ctx, "strip must not be negative");
+    }
+    dest = JS_ToCString(ctx, argv[1]);
+    if (!dest)
+        return JS_EXCEPTION;
+    dest_len = strlen(dest);
+    while (dest_len > 1 && dest[dest_len - 1] == '/')
+        dest_len--;
+    if (mkdir(dest, 0755) < 0 && errno != EEXIST) {
+        char msg[256];
+        tar_errno(msg, "mkdir", dest);
+        js_tar_throw(ctx, msg);
+        goto fail;
+    }
+    reader = tar_open_reader(ctx, argv[0]);
+    if (JS_IsException(reader))
+        goto fail;
+    r = JS_GetOpaque(reader, js_tar_reader_class_id);
+    while ((ret = tr_next(r)) > 0) {
+        name = tar_safe_name(r->err, r->cur.name, strip, &err);
+        if (!name) {
+            if (err)
+                break;
+            continue;
+        }
+        len = strlen(name);
+        while (len > 0 && name[len - 1] == '/')
+            len--;
+        if (len == 0)
+            continue;
+        free(path);
+        path = malloc(dest_len + len + 2);
+        if (!path) {
+            JS_ThrowOutOfMemory(ctx);
+            goto fail;
+        }
+        memcpy(path, dest, dest_len);
+        path[dest_len] = '/';
+        memcpy(path + dest_len + 1, name, len);
+        path[dest_len + len + 1] = '\0';
+        if (tar_check_parents(r->err, path, dest_len, TRUE) ||
+            tr_extract(r, &r->cur, r->data_offset, path, dest, strip)) {
+            ret = -1;
+            break;
+        }
+        count++;
+    }
+    if (ret < 0 || err) {
+        js_tar_throw(ctx, r->err);
+        goto fail;
+    }
+    free(path);
+    JS_FreeValue(ctx, reader);
+    JS_FreeCString(ctx, dest);
+    return JS_NewInt64(ctx, count);
+ fail:
+    free(path);
+    JS_FreeValue(ctx, reader);
+    JS_FreeCString(ctx, dest);
+    return JS_EXCEPTION;
+}
+
+/* Writer */
+
+static void js_tar_writer_finalizer(JSRuntime *rt, JSValue val)
+{
+    TarWriter *w = JS_GetOpaque(val, js_tar_writer_class_id);
+
+    if (w) {
+        tw_free(w);
+        js_free_rt(rt, w);
+    }
+}
+
+static TarWriter *tar_writer_get(JSContext *ctx, JSValueConst this_val)
+{
+    TarWriter *w = JS_GetOpaque2(ctx, this_val, js_tar_writer_class_id);
+
+    if (w && w->closed) {
+        JS_ThrowTypeError(ctx, "tar writer is closed");
+        return NULL;
+    }
+    return w;
+}
+
+static BOOL tar_has_suffix(const char *s, const char *suffix)
+{
+    size_t len = strlen(s), slen = strlen(suffix);
+
+    return len >= slen && !strcmp(s + len - slen, suffix);
+}
+
+/* tar.create(pathOrFd[, { compress, level }]) -> Writer */
+static JSValue js_tar_create(JSContext *ctx, JSValueConst this_val,
+                             int argc, JSValueConst *argv)
+{
+    const char *kind = NULL, *compress = NULL, *path;
+    TarWriter *w = NULL;
+    JSValue obj = JS_UNDEFINED, v;
+    int32_t level = -1;
+    char err[256];
+    BOOL own = FALSE;
+    int fd = -1;
+
+    if (argc > 1 && JS_IsObject(argv[1])) {
+        v = JS_GetPropertyStr(ctx, argv[1], "level");
+        if (JS_IsException(v))
+            return v;
+        if (!JS_IsUndefined(v) && JS_ToInt32(ctx, &level, v)) {
+            JS_FreeValue(ctx, v);
+            return JS_EXCEPTION;
+        }
+        JS_FreeValue(ctx, v);
+        v = JS_GetPropertyStr(ctx, argv[1], "compress");
+        if (JS_IsException(v))
+            return v;
+        if (!JS_IsUndefined(v) && !JS_IsNull(v) && !JS_IsBool(v)) {
+            compress = JS_ToCString(ctx, v);
+            JS_FreeValue(ctx, v);
+            if (!compress)
+                return JS_EXCEPTION;
+        } else {
+            if (JS_IsBool(v) || JS_IsNull(v))
+                kind = JS_ToBool(ctx, v) ? "gzip" : "";
+            JS_FreeValue(ctx, v);
+        }
+    }
+    if (compress) {
+        if (!strcmp(compress, "gzip"))
+            kind = "gzip";
+        else if (!strcmp(compress, "zstd"))
+            kind = "zstdCompress";
+        else if (!strcmp(compress, "none"))
+            kind = "";
+        JS_FreeCString(ctx, compress);
+        if (!kind)
+            return JS_ThrowTypeError(ctx, "compress must be \"gzip\", \"zstd\" or \"none\"");
+    } else if (!kind && JS_IsString(argv[0])) {
+        path = JS_ToCString(ctx, argv[0]);
+        if (!path)
+            return JS_EXCEPTION;
+        if (tar_has_suffix(path, ".gz") || tar_has_suffix(path, ".tgz"))
+            kind = "gzip";
+        else if (tar_has_suffix(path, ".zst") || tar_has_suffix(path, ".tzst"))
+            kind = "zstdCompress";
+        JS_FreeCString(ctx, path);
+    }
+
+    fd = tar_get_fd(ctx, argv[0], O_WRONLY | O_CREAT | O_TRUNC, &own, err);
+    if (fd < 0)
+        return JS_EXCEPTION;
+    obj = JS_NewObjectClass(ctx, js_tar_writer_class_id);
+    if (JS_IsException(obj))
+        goto fail;
+    w = js_mallocz(ctx, sizeof(*w));
+    if (!w)
+        goto fail;
+    w->fd = fd;
+    w->own_fd = own;
+    w->try_copy_range = w->try_sendfile = TRUE;
+    JS_SetOpaque(obj, w);
+    fd = -1;
+    w->out = malloc(TAR_BUF);
+    w->scratch = malloc(TAR_BUF);
+    if (!w->out || !w->scratch) {
+        JS_ThrowOutOfMemory(ctx);
+        goto fail;
+    }
+    if (kind && kind[0]) {
+        w->codec = qjsx_codec_new(kind, level, err, sizeof(err));
+        if (!w->codec) {
+            js_tar_throw(ctx, err);
+            goto fail;
+        }
+    }
+    return obj;
+ fail:
+    if (fd >= 0 && own)
+        close(fd);
+    JS_FreeValue(ctx, obj);
+    return JS_EXCEPTION;
+}
+
+/* entry name, with a trailing slash for directories */
+static char *tar_get_entry_name(JSContext *ctx, JSValueConst val, BOOL dir)
+{
+    const char *s = JS_ToCString(ctx, val);
+    size_t len;
+    char *name;
+
+    if (!s)
+        return NULL;
+    len = strlen(s);
+    if (len == 0) {
+        JS_FreeCString(ctx, s);
+        JS_ThrowTypeError(ctx, "entry name must not be empty");
+        return NULL;
+    }
+    name = malloc(len + 2);
+    if (name) {
+        memcpy(name, s, len + 1);
+        if (dir && name[len - 1] != '/')
+            strcpy(name + len, "/");
+    } else {
+        JS_ThrowOutOfMemory(ctx);
+    }
+    JS_FreeCString(ctx, s);
+    return name;
+}
+
+/* writer.add(name, data[, options]) */
+static JSValue js_tar_writer_add(JSContext *ctx, JSValueConst this_val,
+                                 int argc, JSValueConst *argv)
+{
+    TarWriter *w = tar_writer_get(ctx, this_val);
+    TarAddOptions o;
+    TarBytes b;
+    TarInfo info;
+    char *name;
+    int ret;
+
+    if (!w || tar_get_add_options(ctx, argc > 2 ? argv[2] : JS_UNDEFINED, &o))
+        return JS_EXCEPTION;
+    name = tar_get_entry_name(ctx, argv[0], FALSE);
+    if (!name)
+        return JS_EXCEPTION;
+    if (tar_get_bytes(ctx, &b, argv[1])) {
+        free(name);
+        return JS_EXCEPTION;
+    }
+    tw_fill_info(&info, name, '0', NULL, &o);
+    ret = tw_add_data(w, &info, b.data, b.len);
+    if (b.str)
+        JS_FreeCString(ctx, b.str);
+    free(name);
+    if (ret)
+        return js_tar_throw(ctx, w->err);
+    return JS_UNDEFINED;
+}
+
+/* writer.addDirectory(name[, options]), writer.addSymlink(name, target[, options]) */
+static JSValue js_tar_writer_add_special(JSContext *ctx, JSValueConst this_val,
+                                         int argc, JSValueConst *argv, int magic)
+{
+    TarWriter *w = tar_writer_get(ctx, this_val);
+    const char *target = NULL;
+    TarAddOptions o;
+    TarInfo info;
+    char *name;
+    int ret;
+
+    if (!w || tar_get_add_options(ctx, argc > 1 + magic ? argv[1 + magic]
+                                  : JS_UNDEFINED, &o))
+        return JS_EXCEPTION;
+    name = tar_get_entry_name(ctx, argv[0], !magic);
+    if (!name)
+        return JS_EXCEPTION;
+    if (magic) {
+        target = JS_ToCString(ctx, argv[1]);
+        if (!target) {
+            free(name);
+            return JS_EXCEPTION;
+        }
+    }
+    tw_fill_info(&info, name, magic ? '2' : '5', NULL, &o);
+    info.linkname = (char *)target;
+    ret = tw_header(w, &info, 0);
+    JS_FreeCString(ctx, target);
+    free(name);
+    if (ret)
+        return js_tar_throw(ctx, w->err);
+    return JS_UNDEFINED;
+}
+
+/* writer.addFile(name, path[, options]), writer.addTree(name, dir[, options]) */
+static JSValue js_tar_writer_add_path(JSContext *ctx, JSValueConst this_val,
+                                      int argc, JSValueConst *argv, int recurse)
+{
+    TarWriter *w = tar_writer_get(ctx, this_val);
+    const char *s, *path;
+    TarAddOptions o;
+    char *name;
+    int count = 0, ret;
+
+    if (!w || tar_get_add_options(ctx, argc > 2 ? argv[2] : JS_UNDEFINED, &o))
+        return JS_EXCEPTION;
+    /* addTree("", dir) adds the contents of dir at the top of the archive */
+    s = JS_ToCString(ctx, argv[0]);
+    if (!s)
+        return JS_EXCEPTION;
+    name = recurse || s[0] ? strdup(s) : NULL;
+    JS_FreeCString(ctx, s);
+    if (!name)
+        return recurse ? JS_ThrowOutOfMemory(ctx)
+            : JS_ThrowTypeError(ctx, "entry name must not be empty");
+    path = JS_ToCString(ctx, argv[1]);
+    if (!path) {
+        free(name);
+        return JS_EXCEPTION;
+    }
+    ret = tw_add_path(w, name, path, &o, recurse, &count);
+    JS_FreeCString(ctx, path);
+    free(name);
+    if (ret)
+        return js_tar_throw(ctx, w->err);
+    return recurse ? JS_NewInt32(ctx, count) : JS_UNDEFINED;
+}
+
+static JSValue js_tar_writer_close(JSContext *ctx, JSValueConst this_val,
+                                   int argc, JSValueConst *argv)
+{
+    TarWriter *w = JS_GetOpaque2(ctx, this_val, js_tar_writer_class_id);
+    int ret;
+
+    if (!w)
+        return JS_EXCEPTION;
+    ret = tw_close(w);
+    if (ret)
+        return js_tar_throw(ctx, w->err);
+    return JS_UNDEFINED;
+}
+
+static JSClassDef js_tar_reader_class = {
+    "TarReader",
+    .finalizer = js_tar_reader_finalizer,
+};
+
+static JSClassDef js_tar_entry_class = {
+    "TarEntry",
+    .finalizer = js_tar_entry_finalizer,
+    .gc_mark = js_tar_entry_mark,
+};
+
+static JSClassDef js_tar_writer_class = {
+    "TarWriter",
+    .finalizer = js_tar_writer_finalizer,
+};
+
+static const JSCFunctionListEntry js_tar_reader_proto_funcs[] = {
+    JS_CFUNC_DEF("next", 0, js_tar_reader_next ),
+    JS_CFUNC_DEF("[Symbol.iterator]", 0, js_tar_reader_iterator ),
+    JS_CFUNC_DEF("close", 0, js_tar_reader_close ),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "TarReader", JS_PROP_CONFIGURABLE ),
+};
+
+static const JSCFunctionListEntry js_tar_entry_proto_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("read", 0, js_tar_entry_read, 0 ),
+    JS_CFUNC_MAGIC_DEF("readString", 0, js_tar_entry_read, 1 ),
+    JS_CFUNC_DEF("extract", 1, js_tar_entry_extract ),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "TarEntry", JS_PROP_CONFIGURABLE ),
+};
+
+static const JSCFunctionListEntry js_tar_writer_proto_funcs[] = {
+    JS_CFUNC_DEF("add", 3, js_tar_writer_add ),
+    JS_CFUNC_MAGIC_DEF("addFile", 3, js_tar_writer_add_path, 0 ),
+    JS_CFUNC_MAGIC_DEF("addTree", 3, js_tar_writer_add_path, 1 ),
+    JS_CFUNC_MAGIC_DEF("addDirectory", 2, js_tar_writer_add_special, 0 ),
+    JS_CFUNC_MAGIC_DEF("addSymlink", 3, js_tar_writer_add_special, 1 ),
+    JS_CFUNC_DEF("close", 0, js_tar_writer_close ),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "TarWriter", JS_PROP_CONFIGURABLE ),
+};
+
+static const JSCFunctionListEntry js_tar_funcs[] = {
+    JS_CFUNC_DEF("open", 1, js_tar_open ),
+    JS_CFUNC_DEF("list", 1, js_tar_list ),
+    JS_CFUNC_DEF("extract", 3, js_tar_extract ),
+    JS_CFUNC_DEF("create", 2, js_tar_create ),
+};
+
+static void js_tar_new_class(JSContext *ctx, JSClassID *id, JSClassDef *def,
+                             const JSCFunctionListEntry *funcs, int len)
+{
+    JSRuntime *rt = JS_GetRuntime(ctx);
+    JSValue proto;
+
+    JS_NewClassID(rt, id);
+    JS_NewClass(rt, *id, def);
+    proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, proto, funcs, len);
+    JS_SetClassProto(ctx, *id, proto);
+}
+
+static int js_tar_init(JSContext *ctx, JSModuleDef *m)
+{
+    js_tar_new_class(ctx, &js_tar_reader_class_id, &js_tar_reader_class,
+                     js_tar_reader_proto_funcs, countof(js_tar_reader_proto_funcs));
+    js_tar_new_class(ctx, &js_tar_entry_class_id, &js_tar_entry_class,
+                     js_tar_entry_proto_funcs, countof(js_tar_entry_proto_funcs));
+    js_tar_new_class(ctx, &js_tar_writer_class_id, &js_tar_writer_class,
+                     js_tar_writer_proto_funcs, countof(js_tar_writer_proto_funcs));
+    return JS_SetModuleExportList(ctx, m, js_tar_funcs, countof(js_tar_funcs));
+}
+
+JSModuleDef *js_init_module_qjsx_tar(JSContext *ctx, const char *module_name)
+{
+    JSModuleDef *m;
+    m = JS_NewCModule(ctx, module_name, js_tar_init);
+    if (!m)
+        return NULL;
+    JS_AddModuleExportList(ctx, m, js_tar_funcs, countof(js_tar_funcs));
+    return m;
+}
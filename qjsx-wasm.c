@@ -0,0 +1,5113 @@
+/*
+ * QJSX qjsx:wasm module
+ *
+ * A WebAssembly implementation for running compute kernels compiled from C
+ * without spawning a subprocess:
+ *
+ *   import WebAssembly from "qjsx:wasm";   // qjsx-node also sets the global
+ *   const { instance } = await WebAssembly.instantiate(bytes, imports);
+ *   instance.exports.run(...);
+ *
+ * The JS API follows the WebAssembly JS API (Module, Instance, Memory,
+ * Table, Global, validate, compile, instantiate and the CompileError,
+ * LinkError and RuntimeError classes). Memory.buffer is an ArrayBuffer over
+ * the linear memory itself, so data can be exchanged without copies.
+ *
+ * Supported: the MVP plus what C toolchains emit by default today:
+ * multi-value, sign-extension, non-trapping float-to-int conversions, bulk
+ * memory, reference types (funcref only) and fixed-width SIMD (v128 and the
+ * 0xfd opcodes, as emitted with -msimd128). Not supported: relaxed SIMD,
+ * threads, exceptions, tail calls, memory64, multi-memory and externref.
+ * As in the JS API, v128 values can't cross into JavaScript: calling a
+ * function with v128 in its signature from JS (or a JS import from
+ * WebAssembly) throws a TypeError.
+ *
+ * Execution is an in-place interpreter: function bodies are executed
+ * straight from the binary. Validation computes a side table with one entry
+ * per branch (target offset, values to keep and to drop), consumed in
+ * program order, so control flow never has to scan for a matching `end`.
+ * Calls between WebAssembly functions don't recurse on the C stack.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include "quickjs/cutils.h"
+#include "quickjs/quickjs.h"
+
+#define WASM_PAGE_SIZE 65536
+#define WASM_MAX_PAGES 65536
+#define WASM_MAX_TABLE_SIZE 10000000
+#define WASM_STACK_SLOTS (1 << 20)
+#define WASM_MAX_FRAMES 20000
+
+enum {
+    WASM_I32 = 0x7f,
+    WASM_I64 = 0x7e,
+    WASM_F32 = 0x7d,
+    WASM_F64 = 0x7c,
+    WASM_V128 = 0x7b,
+    WASM_FUNCREF = 0x70,
+};
+
+enum {
+    WASM_EXTERN_FUNC = 0,
+    WASM_EXTERN_TABLE = 1,
+    WASM_EXTERN_MEMORY = 2,
+    WASM_EXTERN_GLOBAL = 3,
+};
+
+struct WasmFunction;
+
+/* v128 lanes as GCC vector types, so that most SIMD opcodes are a single
+   operator. They are only 8-byte aligned to keep WasmValue (and the value
+   stack) aligned like the scalars. Lane 0 is at the lowest address, which
+   like the scalar loads assumes a little-endian host. */
+#define WASM_VEC(T) __attribute__((vector_size(16), aligned(8))) T
+typedef WASM_VEC(int8_t) wasm_i8x16;
+typedef WASM_VEC(uint8_t) wasm_u8x16;
+typedef WASM_VEC(int16_t) wasm_i16x8;
+typedef WASM_VEC(uint16_t) wasm_u16x8;
+typedef WASM_VEC(int32_t) wasm_i32x4;
+typedef WASM_VEC(uint32_t) wasm_u32x4;
+typedef WASM_VEC(int64_t) wasm_i64x2;
+typedef WASM_VEC(uint64_t) wasm_u64x2;
+typedef WASM_VEC(float) wasm_f32x4;
+typedef WASM_VEC(double) wasm_f64x2;
+#undef WASM_VEC
+
+typedef union {
+    int32_t i32;
+    uint32_t u32;
+    int64_t i64;
+    uint64_t u64;
+    float f32;
+    double f64;
+    struct WasmFunction *ref;
+    wasm_i8x16 i8x16;
+    wasm_u8x16 u8x16;
+    wasm_i16x8 i16x8;
+    wasm_u16x8 u16x8;
+    wasm_i32x4 i32x4;
+    wasm_u32x4 u32x4;
+    wasm_i64x2 i64x2;
+    wasm_u64x2 u64x2;
+    wasm_f32x4 f32x4;
+    wasm_f64x2 f64x2;
+} WasmValue;
+
+typedef struct {
+    uint32_t nparams;
+    uint32_t nresults;
+    uint8_t *types;         /* params followed by results */
+} WasmFuncType;
+
+typedef struct {
+    uint32_t min, max;      /* max is UINT32_MAX if absent */
+} WasmLimits;
+
+typedef struct {
+    char *module;
+    char *name;
+    uint8_t kind;
+    uint32_t type_idx;      /* function imports */
+    WasmLimits limits;      /* table and memory imports */
+    uint8_t val_type;       /* global imports */
+    uint8_t mutable;
+} WasmImport;
+
+typedef struct {
+    char *name;
+    uint8_t kind;
+    uint32_t index;
+} WasmExport;
+
+/* Constant expressions are kept as offsets into the module bytes and
+   evaluated at instantiation time */
+typedef struct {
+    uint32_t offset;
+} WasmConstExpr;
+
+typedef struct {
+    uint8_t val_type;
+    uint8_t mutable;
+    WasmConstExpr init;
+} WasmGlobalDef;
+
+/* One entry per branch instruction, see the header comment */
+typedef struct {
+    int32_t pc_delta;       /* relative to the branch opcode */
+    int32_t stp_delta;      /* relative to this entry */
+    uint32_t keep;          /* values carried to the target */
+    uint32_t drop;          /* values discarded below them */
+} WasmSideEntry;
+
+typedef struct {
+    uint32_t body;          /* offset of the first instruction */
+    uint32_t end;           /* offset after the final `end` */
+    uint32_t nlocals;       /* params + declared locals */
+    uint32_t max_height;    /* operand stack size */
+    uint8_t *local_types;
+    WasmSideEntry *side;
+} WasmCode;
+
+enum {
+    WASM_SEG_ACTIVE,
+    WASM_SEG_PASSIVE,
+    WASM_SEG_DECLARATIVE,
+};
+
+typedef struct {
+    uint8_t mode;
+    uint32_t table_idx;
+    WasmConstExpr offset;
+    uint32_t count;
+    int32_t *funcs;         /* function index, -1 for ref.null */
+} WasmElem;
+
+typedef struct {
+    uint8_t mode;
+    WasmConstExpr offset;
+    uint32_t data;          /* offset in the module bytes */
+    uint32_t size;
+} WasmData;
+
+typedef struct {
+    char *name;
+    uint32_t data;
+    uint32_t size;
+} WasmCustomSection;
+
+typedef struct WasmModule {
+    int ref_count;
+    uint8_t *bytes;
+    size_t size;
+    WasmFuncType *types;
+    uint32_t ntypes;
+    WasmImport *imports;
+    uint32_t nimports;
+    /* index spaces, imports first */
+    uint32_t nfuncs, nfunc_imports;
+    uint32_t *func_types;
+    WasmCode *code;         /* indexed by function index - nfunc_imports */
+    uint32_t ntables, ntable_imports;
+    WasmLimits *tables;
+    uint32_t nmemories, nmemory_imports;
+    WasmLimits memory;
+    uint32_t nglobals, nglobal_imports;
+    WasmGlobalDef *globals;
+    WasmExport *exports;
+    uint32_t nexports;
+    int32_t start;
+    WasmElem *elems;
+    uint32_t nelems;
+    WasmData *datas;
+    uint32_t ndatas;
+    int32_t data_count;     /* -1 if there is no DataCount section */
+    uint8_t *declared_funcs; /* functions that may be referenced by ref.func */
+    WasmCustomSection *customs;
+    uint32_t ncustoms;
+} WasmModule;
+
+/* ------------------------------------------------------------------------
+ * Decoding
+ * ------------------------------------------------------------------------ */
+
+typedef struct {
+    const uint8_t *base;
+    const uint8_t *p;
+    const uint8_t *end;
+    char error[128];
+} WasmReader;
+
+static int wasm_error(WasmReader *r, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static int wasm_error(WasmReader *r, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    if (r->error[0])
+        return -1;
+    n = snprintf(r->error, sizeof(r->error), "at offset %u: ",
+                 (unsigned)(r->p - r->base));
+    va_start(ap, fmt);
+    vsnprintf(r->error + n, sizeof(r->error) - n, fmt, ap);
+    va_end(ap);
+    return -1;
+}
+
+static int read_u8(WasmReader *r, uint8_t *pv)
+{
+    if (r->p >= r->end)
+        return wasm_error(r, "unexpected end");
+    *pv = *r->p++;
+    return 0;
+}
+
+static int read_leb(WasmReader *r, uint64_t *pv, int bits, BOOL is_signed)
+{
+    uint64_t v = 0;
+    int shift = 0;
+    uint8_t b;
+
+    for (;;) {
+        if (r->p >= r->end)
+            return wasm_error(r, "unexpected end");
+        b = *r->p++;
+        if (shift + 7 >= bits) {
+            /* last byte: the unused bits must be a sign/zero extension */
+            int used = bits - shift;
+            if (b & 0x80)
+                return wasm_error(r, "integer representation too long");
+            if (is_signed) {
+                uint8_t hi = (b & 0x7f) >> (used - 1);
+                if (hi != 0 && hi != (0x7f >> (used - 1)))
+                    return wasm_error(r, "integer too large");
+            } else if (used < 7 && (b >> used)) {
+                return wasm_error(r, "integer too large");
+            }
+        }
+        v |= (uint64_t)(b & 0x7f) << shift;
+        shift += 7;
+        if (!(b & 0x80))
+            break;
+    }
+    if (is_signed && shift < 64 && (b & 0x40))
+        v |= ~(uint64_t)0 << shift;
+    *pv = v;
+    return 0;
+}
+
+static int read_u32(WasmReader *r, uint32_t *pv)
+{
+    uint64_t v = 0;
+    if (read_leb(r, &v, 32, FALSE))
+        return -1;
+    *pv = v;
+    return 0;
+}
+
+static int read_s32(WasmReader *r, int32_t *pv)
+{
+    uint64_t v = 0;
+    if (read_leb(r, &v, 32, TRUE))
+        return -1;
+    *pv = v;
+    return 0;
+}
+
+static int read_s64(WasmReader *r, int64_t *pv)
+{
+    uint64_t v = 0;
+    if (read_leb(r, &v, 64, TRUE))
+        return -1;
+    *pv = v;
+    return 0;
+}
+
+/* LEB decoding during execution: the code was validated already */
+static inline uint32_t leb_u32(const uint8_t **pp)
+{
+    const uint8_t *p = *pp;
+    uint32_t v = *p & 0x7f;
+    int shift = 7;
+
+    while (*p++ & 0x80) {
+        v |= (uint32_t)(*p & 0x7f) << shift;
+        shift += 7;
+    }
+    *pp = p;
+    return v;
+}
+
+static inline int64_t leb_s64(const uint8_t **pp)
+{
+    const uint8_t *p = *pp;
+    uint64_t v = 0;
+    int shift = 0;
+    uint8_t b;
+
+    do {
+        b = *p++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    if (shift < 64 && (b & 0x40))
+        v |= ~(uint64_t)0 << shift;
+    *pp = p;
+    return v;
+}
+
+static inline void skip_leb(const uint8_t **pp)
+{
+    const uint8_t *p = *pp;
+    while (*p++ & 0x80)
+        continue;
+    *pp = p;
+}
+
+static int read_name(WasmReader *r, char **pname)
+{
+    uint32_t len;
+    char *s;
+
+    if (read_u32(r, &len))
+        return -1;
+    if (len > r->end - r->p)
+        return wasm_error(r, "unexpected end");
+    s = malloc(len + 1);
+    if (!s)
+        return wasm_error(r, "out of memory");
+    memcpy(s, r->p, len);
+    s[len] = '\0';
+    r->p += len;
+    *pname = s;
+    return 0;
+}
+
+static BOOL is_num_type(uint8_t t)
+{
+    return t == WASM_I32 || t == WASM_I64 || t == WASM_F32 || t == WASM_F64;
+}
+
+static int read_val_type(WasmReader *r, uint8_t *pt)
+{
+    if (read_u8(r, pt))
+        return -1;
+    if (is_num_type(*pt) || *pt == WASM_V128 || *pt == WASM_FUNCREF)
+        return 0;
+    if (*pt == 0x6f)
+        return wasm_error(r, "externref is not supported");
+    return wasm_error(r, "invalid value type 0x%02x", *pt);
+}
+
+static int read_limits(WasmReader *r, WasmLimits *l, uint32_t max_allowed)
+{
+    uint8_t flags = 0;
+
+    if (read_u8(r, &flags) || read_u32(r, &l->min))
+        return -1;
+    if (flags > 1)
+        return wasm_error(r, flags & 2 ? "shared memories are not supported"
+                          : "invalid limits flags");
+    l->max = UINT32_MAX;
+    if (flags & 1) {
+        if (read_u32(r, &l->max))
+            return -1;
+        if (l->max < l->min)
+            return wasm_error(r, "size minimum must not be greater than maximum");
+    }
+    if (l->min > max_allowed || (l->max != UINT32_MAX && l->max > max_allowed))
+        return wasm_error(r, "limits out of range");
+    return 0;
+}
+
+static int read_table_type(WasmReader *r, WasmLimits *l)
+{
+    uint8_t t = 0;
+    if (read_val_type(r, &t))
+        return -1;
+    if (t != WASM_FUNCREF)
+        return wasm_error(r, "invalid table element type");
+    return read_limits(r, l, WASM_MAX_TABLE_SIZE);
+}
+
+static int read_global_type(WasmReader *r, uint8_t *ptype, uint8_t *pmut)
+{
+    if (read_val_type(r, ptype) || read_u8(r, pmut))
+        return -1;
+    if (*pmut > 1)
+        return wasm_error(r, "invalid mutability");
+    return 0;
+}
+
+static uint8_t *func_params(const WasmFuncType *t)
+{
+    return t->types;
+}
+
+static uint8_t *func_results(const WasmFuncType *t)
+{
+    return t->types + t->nparams;
+}
+
+static BOOL func_type_equal(const WasmFuncType *a, const WasmFuncType *b)
+{
+    return a == b ||
+        (a->nparams == b->nparams && a->nresults == b->nresults &&
+         !memcmp(a->types, b->types, a->nparams + a->nresults));
+}
+
+/* such functions can't be called from or call into JS */
+static BOOL func_type_has_v128(const WasmFuncType *t)
+{
+    return memchr(t->types, WASM_V128, t->nparams + t->nresults) != NULL;
+}
+
+static uint8_t global_type(const WasmModule *m, uint32_t idx)
+{
+    uint32_t i, k = 0;
+
+    if (idx >= m->nglobal_imports)
+        return m->globals[idx - m->nglobal_imports].val_type;
+    for (i = 0; i < m->nimports; i++) {
+        if (m->imports[i].kind == WASM_EXTERN_GLOBAL && k++ == idx)
+            return m->imports[i].val_type;
+    }
+    return 0;
+}
+
+static BOOL global_is_mutable(const WasmModule *m, uint32_t idx)
+{
+    uint32_t i, k = 0;
+
+    if (idx >= m->nglobal_imports)
+        return m->globals[idx - m->nglobal_imports].mutable;
+    for (i = 0; i < m->nimports; i++) {
+        if (m->imports[i].kind == WASM_EXTERN_GLOBAL && k++ == idx)
+            return m->imports[i].mutable;
+    }
+    return FALSE;
+}
+
+/* Constant expressions: a single constant (v128.const included), global.get
+   of an imported global, ref.null or ref.func, followed by `end` */
+static int read_const_expr(WasmReader *r, WasmModule *m, WasmConstExpr *e,
+                           uint8_t expected, uint32_t nglobals_visible)
+{
+    uint8_t op = 0, t = 0, rt = 0;
+    uint32_t idx, simd_op;
+    int32_t v32;
+    int64_t v64;
+
+    e->offset = r->p - r->base;
+    if (read_u8(r, &op))
+        return -1;
+    switch (op) {
+    case 0x41:
+        if (read_s32(r, &v32))
+            return -1;
+        t = WASM_I32;
+        break;
+    case 0x42:
+        if (read_s64(r, &v64))
+            return -1;
+        t = WASM_I64;
+        break;
+    case 0x43:
+        if (r->end - r->p < 4)
+            return wasm_error(r, "unexpected end");
+        r->p += 4;
+        t = WASM_F32;
+        break;
+    case 0x44:
+        if (r->end - r->p < 8)
+            return wasm_error(r, "unexpected end");
+        r->p += 8;
+        t = WASM_F64;
+        break;
+    case 0xfd:
+        if (read_u32(r, &simd_op))
+            return -1;
+        if (simd_op != 12)
+            return wasm_error(r, "constant expression required");
+        if (r->end - r->p < 16)
+            return wasm_error(r, "unexpected end");
+        r->p += 16;
+        t = WASM_V128;
+        break;
+    case 0x23:
+        if (read_u32(r, &idx))
+            return -1;
+        if (idx >= nglobals_visible)
+            return wasm_error(r, "unknown global %u", idx);
+        if (global_is_mutable(m, idx))
+            return wasm_error(r, "constant expression required");
+        t = global_type(m, idx);
+        break;
+    case 0xd0:
+        if (read_u8(r, &rt))
+            return -1;
+        if (rt != WASM_FUNCREF)
+            return wasm_error(r, "invalid reference type");
+        t = WASM_FUNCREF;
+        break;
+    case 0xd2:
+        if (read_u32(r, &idx))
+            return -1;
+        if (idx >= m->nfuncs)
+            return wasm_error(r, "unknown function %u", idx);
+        m->declared_funcs[idx] = 1;
+        t = WASM_FUNCREF;
+        break;
+    default:
+        return wasm_error(r, "constant expression required");
+    }
+    if (t != expected)
+        return wasm_error(r, "type mismatch in constant expression");
+    if (read_u8(r, &op))
+        return -1;
+    if (op != 0x0b)
+        return wasm_error(r, "constant expression required");
+    return 0;
+}
+
+static void wasm_module_free(WasmModule *m)
+{
+    uint32_t i;
+
+    if (--m->ref_count > 0)
+        return;
+    for (i = 0; i < m->ntypes; i++)
+        free(m->types[i].types);
+    free(m->types);
+    for (i = 0; i < m->nimports; i++) {
+        free(m->imports[i].module);
+        free(m->imports[i].name);
+    }
+    free(m->imports);
+    free(m->func_types);
+    if (m->code) {
+        for (i = 0; i < m->nfuncs - m->nfunc_imports; i++) {
+            free(m->code[i].local_types);
+            free(m->code[i].side);
+        }
+        free(m->code);
+    }
+    free(m->tables);
+    free(m->globals);
+    for (i = 0; i < m->nexports; i++)
+        free(m->exports[i].name);
+    free(m->exports);
+    for (i = 0; i < m->nelems; i++)
+        free(m->elems[i].funcs);
+    free(m->elems);
+    free(m->datas);
+    free(m->declared_funcs);
+    for (i = 0; i < m->ncustoms; i++)
+        free(m->customs[i].name);
+    free(m->customs);
+    free(m->bytes);
+    free(m);
+}
+
+static int wasm_validate_code(WasmReader *r, WasmModule *m, uint32_t func_idx);
+
+#define ALLOC_ARRAY(ptr, n)                                             \
+    (((ptr) = calloc((n) ? (n) : 1, sizeof(*(ptr)))) ? 0 :              \
+     wasm_error(r, "out of memory"))
+
+/* Counts in the binary are untrusted: every entry needs at least one byte */
+#define CHECK_COUNT(n)                                                  \
+    do {                                                                \
+        if ((n) > (uint32_t)(r->end - r->p))                            \
+            return wasm_error(r, "unexpected end");                     \
+    } while (0)
+
+static int decode_types(WasmReader *r, WasmModule *m)
+{
+    uint32_t n, i, j, np, nr;
+    uint8_t form;
+    WasmFuncType *t;
+
+    if (read_u32(r, &n))
+        return -1;
+    CHECK_COUNT(n);
+    if (ALLOC_ARRAY(m->types, n))
+        return -1;
+    m->ntypes = n;
+    for (i = 0; i < n; i++) {
+        t = &m->types[i];
+        if (read_u8(r, &form))
+            return -1;
+        if (form != 0x60)
+            return wasm_error(r, "invalid function type");
+        if (read_u32(r, &np))
+            return -1;
+        CHECK_COUNT(np);
+        t->types = malloc(np + 1);
+        if (!t->types)
+            return wasm_error(r, "out of memory");
+        t->nparams = np;
+        for (j = 0; j < np; j++) {
+            if (read_val_type(r, &t->types[j]))
+                return -1;
+        }
+        if (read_u32(r, &nr))
+            return -1;
+        CHECK_COUNT(nr);
+        t->types = realloc(t->types, np + nr + 1);
+        if (!t->types)
+            return wasm_error(r, "out of memory");
+        t->nresults = nr;
+        for (j = 0; j < nr; j++) {
+            if (read_val_type(r, &t->types[np + j]))
+                return -1;
+        }
+    }
+    return 0;
+}
+
+static int decode_imports(WasmReader *r, WasmModule *m)
+{
+    uint32_t n, i;
+    WasmImport *im;
+
+    if (read_u32(r, &n))
+        return -1;
+    CHECK_COUNT(n);
+    if (ALLOC_ARRAY(m->imports, n))
+        return -1;
+    m->nimports = n;
+    for (i = 0; i < n; i++) {
+        im = &m->imports[i];
+        if (read_name(r, &im->module) || read_name(r, &im->name) ||
+            read_u8(r, &im->kind))
+            return -1;
+        switch (im->kind) {
+        case WASM_EXTERN_FUNC:
+            if (read_u32(r, &im->type_idx))
+                return -1;
+            if (im->type_idx >= m->ntypes)
+                return wasm_error(r, "unknown type %u", im->type_idx);
+            m->nfunc_imports++;
+            break;
+        case WASM_EXTERN_TABLE:
+            if (read_table_type(r, &im->limits))
+                return -1;
+            m->ntable_imports++;
+            break;
+        case WASM_EXTERN_MEMORY:
+            if (read_limits(r, &im->limits, WASM_MAX_PAGES))
+                return -1;
+            m->nmemory_imports++;
+            m->memory = im->limits;
+            break;
+        case WASM_EXTERN_GLOBAL:
+            if (read_global_type(r, &im->val_type, &im->mutable))
+                return -1;
+            m->nglobal_imports++;
+            break;
+        default:
+            return wasm_error(r, "invalid import kind");
+        }
+    }
+    if (m->nmemory_imports > 1)
+        return wasm_error(r, "multiple memories");
+    return 0;
+}
+
+static int decode_functions(WasmReader *r, WasmModule *m)
+{
+    uint32_t n, i, k = 0;
+
+    if (read_u32(r, &n))
+        return -1;
+    CHECK_COUNT(n);
+    m->nfuncs = m->nfunc_imports + n;
+    if (ALLOC_ARRAY(m->func_types, m->nfuncs) ||
+        ALLOC_ARRAY(m->code, n) ||
+        ALLOC_ARRAY(m->declared_funcs, m->nfuncs))
+        return -1;
+    for (i = 0; i < m->nimports; i++) {
+        if (m->imports[i].kind == WASM_EXTERN_FUNC)
+            m->func_types[k++] = m->imports[i].type_idx;
+    }
+    for (i = 0; i < n; i++) {
+        if (read_u32(r, &m->func_types[k]))
+            return -1;
+        if (m->func_types[k] >= m->ntypes)
+            return wasm_error(r, "unknown type %u", m->func_types[k]);
+        k++;
+    }
+    return 0;
+}
+
+static int decode_tables(WasmReader *r, WasmModule *m)
+{
+    uint32_t n, i, k = 0;
+
+    if (read_u32(r, &n))
+        return -1;
+    CHECK_COUNT(n);
+    m->ntables = m->ntable_imports + n;
+    if (ALLOC_ARRAY(m->tables, m->ntables))
+        return -1;
+    for (i = 0; i < m->nimports; i++) {
+        if (m->imports[i].kind == WASM_EXTERN_TABLE)
+            m->tables[k++] = m->imports[i].limits;
+    }
+    for (i = 0; i < n; i++) {
+        if (read_table_type(r, &m->tables[k++]))
+            return -1;
+    }
+    return 0;
+}
+
+static int decode_memory(WasmReader *r, WasmModule *m)
+{
+    uint32_t n;
+
+    if (read_u32(r, &n))
+        return -1;
+    if (n + m->nmemory_imports > 1)
+        return wasm_error(r, "multiple memories");
+    m->nmemories = m->nmemory_imports + n;
+    if (n && read_limits(r, &m->memory, WASM_MAX_PAGES))
+        return -1;
+    return 0;
+}
+
+static int decode_globals(WasmReader *r, WasmModule *m)
+{
+    uint32_t n, i;
+    WasmGlobalDef *g;
+
+    if (read_u32(r, &n))
+        return -1;
+    CHECK_COUNT(n);
+    m->nglobals = m->nglobal_imports + n;
+    if (ALLOC_ARRAY(m->globals, n))
+        return -1;
+    for (i = 0; i < n; i++) {
+        g = &m->globals[i];
+        if (read_global_type(r, &g->val_type, &g->mutable) ||
+            read_const_expr(r, m, &g->init, g->val_type, m->nglobal_imports))
+            return -1;
+    }
+    return 0;
+}
+
+static int decode_exports(WasmReader *r, WasmModule *m)
+{
+    uint32_t n, i, j, limit;
+    WasmExport *e;
+
+    if (read_u32(r, &n))
+        return -1;
+    CHECK_COUNT(n);
+    if (ALLOC_ARRAY(m->exports, n))
+        return -1;
+    m->nexports = n;
+    for (i = 0; i < n; i++) {
+        e = &m->exports[i];
+        if (read_name(r, &e->name) || read_u8(r, &e->kind) ||
+            read_u32(r, &e->index))
+            return -1;
+        switch (e->kind) {
+        case WASM_EXTERN_FUNC: limit = m->nfuncs; break;
+        case WASM_EXTERN_TABLE: limit = m->ntables; break;
+        case WASM_EXTERN_MEMORY: limit = m->nmemories; break;
+        case WASM_EXTERN_GLOBAL: limit = m->nglobals; break;
+        default: return wasm_error(r, "invalid export kind");
+        }
+        if (e->index >= limit)
+            return wasm_error(r, "unknown export index %u", e->index);
+        if (e->kind == WASM_EXTERN_FUNC)
+            m->declared_funcs[e->index] = 1;
+        for (j = 0; j < i; j++) {
+            if (!strcmp(m->exports[j].name, e->name))
+                return wasm_error(r, "duplicate export name");
+        }
+    }
+    return 0;
+}
+
+static int decode_start(WasmReader *r, WasmModule *m)
+{
+    uint32_t idx;
+    const WasmFuncType *t;
+
+    if (read_u32(r, &idx))
+        return -1;
+    if (idx >= m->nfuncs)
+        return wasm_error(r, "unknown function %u", idx);
+    t = &m->types[m->func_types[idx]];
+    if (t->nparams || t->nresults)
+        return wasm_error(r, "start function must have type [] -> []");
+    m->start = idx;
+    return 0;
+}
+
+static int decode_elems(WasmReader *r, WasmModule *m)
+{
+    uint32_t n, i, j, flags;
+    uint8_t kind = 0, op, rt;
+    WasmElem *e;
+    WasmConstExpr expr;
+    const uint8_t *p;
+
+    if (read_u32(r, &n))
+        return -1;
+    CHECK_COUNT(n);
+    if (ALLOC_ARRAY(m->elems, n))
+        return -1;
+    m->nelems = n;
+    for (i = 0; i < n; i++) {
+        e = &m->elems[i];
+        if (read_u32(r, &flags))
+            return -1;
+        if (flags > 7)
+            return wasm_error(r, "invalid element segment flags");
+        if (flags & 1)
+            e->mode = (flags & 2) ? WASM_SEG_DECLARATIVE : WASM_SEG_PASSIVE;
+        else
+            e->mode = WASM_SEG_ACTIVE;
+        e->table_idx = 0;
+        if ((flags & 3) == 2 && read_u32(r, &e->table_idx))
+            return -1;
+        if (e->mode == WASM_SEG_ACTIVE) {
+            if (e->table_idx >= m->ntables)
+                return wasm_error(r, "unknown table %u", e->table_idx);
+            if (read_const_expr(r, m, &e->offset, WASM_I32, m->nglobal_imports))
+                return -1;
+        }
+        if (flags & 3) {
+            /* elemkind (0 = funcref) or reftype */
+            if (read_u8(r, &kind))
+                return -1;
+            if (kind != ((flags & 4) ? WASM_FUNCREF : 0))
+                return wasm_error(r, "invalid element kind");
+        }
+        if (read_u32(r, &e->count))
+            return -1;
+        CHECK_COUNT(e->count);
+        if (ALLOC_ARRAY(e->funcs, e->count))
+            return -1;
+        for (j = 0; j < e->count; j++) {
+            if (!(flags & 4)) {
+                uint32_t idx;
+                if (read_u32(r, &idx))
+                    return -1;
+                if (idx >= m->nfuncs)
+                    return wasm_error(r, "unknown function %u", idx);
+                m->declared_funcs[idx] = 1;
+                e->funcs[j] = idx;
+            } else {
+                if (read_const_expr(r, m, &expr, WASM_FUNCREF,
+                                    m->nglobal_imports))
+                    return -1;
+                p = r->base + expr.offset;
+                op = *p++;
+                if (op == 0xd2) {
+                    e->funcs[j] = leb_u32(&p);
+                } else if (op == 0xd0) {
+                    rt = *p;
+                    (void)rt;
+                    e->funcs[j] = -1;
+                } else {
+                    return wasm_error(r, "unsupported element expression");
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static int decode_code(WasmReader *r, WasmModule *m)
+{
+    uint32_t n, i, size, ngroups, j, count, k;
+    uint64_t total;
+    uint8_t t = 0;
+    const uint8_t *end;
+    WasmCode *c;
+    const WasmFuncType *ft;
+
+    if (read_u32(r, &n))
+        return -1;
+    if (n != m->nfuncs - m->nfunc_imports)
+        return wasm_error(r, "function and code section have inconsistent lengths");
+    for (i = 0; i < n; i++) {
+        c = &m->code[i];
+        ft = &m->types[m->func_types[m->nfunc_imports + i]];
+        if (read_u32(r, &size))
+            return -1;
+        if (size > r->end - r->p)
+            return wasm_error(r, "unexpected end");
+        end = r->p + size;
+        if (read_u32(r, &ngroups))
+            return -1;
+        /* first pass to size the locals */
+        {
+            WasmReader r1 = *r;
+            total = ft->nparams;
+            for (j = 0; j < ngroups; j++) {
+                if (read_u32(&r1, &count) || read_u8(&r1, &t))
+                    return wasm_error(r, "%s", r1.error);
+                total += count;
+                if (total > 50000)
+                    return wasm_error(r, "too many locals");
+            }
+        }
+        c->nlocals = total;
+        c->local_types = malloc(total + 1);
+        if (!c->local_types)
+            return wasm_error(r, "out of memory");
+        memcpy(c->local_types, func_params(ft), ft->nparams);
+        k = ft->nparams;
+        for (j = 0; j < ngroups; j++) {
+            if (read_u32(r, &count) || read_val_type(r, &t))
+                return -1;
+            memset(c->local_types + k, t, count);
+            k += count;
+        }
+        c->body = r->p - r->base;
+        c->end = end - r->base;
+        /* validation happens once all sections are known (data count) */
+        r->p = end;
+    }
+    return 0;
+}
+
+static int decode_datas(WasmReader *r, WasmModule *m)
+{
+    uint32_t n, i, flags, mem_idx;
+    WasmData *d;
+
+    if (read_u32(r, &n))
+        return -1;
+    CHECK_COUNT(n);
+    if (m->data_count >= 0 && n != (uint32_t)m->data_count)
+        return wasm_error(r, "data count and data section have inconsistent lengths");
+    if (ALLOC_ARRAY(m->datas, n))
+        return -1;
+    m->ndatas = n;
+    for (i = 0; i < n; i++) {
+        d = &m->datas[i];
+        if (read_u32(r, &flags))
+            return -1;
+        if (flags > 2)
+            return wasm_error(r, "invalid data segment flags");
+        d->mode = (flags == 1) ? WASM_SEG_PASSIVE : WASM_SEG_ACTIVE;
+        mem_idx = 0;
+        if (flags == 2 && read_u32(r, &mem_idx))
+            return -1;
+        if (d->mode == WASM_SEG_ACTIVE) {
+            if (mem_idx != 0 || m->nmemories == 0)
+                return wasm_error(r, "unknown memory %u", mem_idx);
+            if (read_const_expr(r, m, &d->offset, WASM_I32, m->nglobal_imports))
+                return -1;
+        }
+        if (read_u32(r, &d->size))
+            return -1;
+        if (d->size > r->end - r->p)
+            return wasm_error(r, "unexpected end");
+        d->data = r->p - r->base;
+        r->p += d->size;
+    }
+    return 0;
+}
+
+static int decode_custom(WasmReader *r, WasmModule *m, const uint8_t *end)
+{
+    WasmCustomSection *cs;
+    char *name;
+
+    if (read_name(r, &name))
+        return -1;
+    if (r->p > end) {
+        free(name);
+        return wasm_error(r, "unexpected end");
+    }
+    cs = realloc(m->customs, (m->ncustoms + 1) * sizeof(*cs));
+    if (!cs) {
+        free(name);
+        return wasm_error(r, "out of memory");
+    }
+    m->customs = cs;
+    cs = &m->customs[m->ncustoms++];
+    cs->name = name;
+    cs->data = r->p - r->base;
+    cs->size = end - r->p;
+    r->p = end;
+    return 0;
+}
+
+/* Sections may be absent: make sure the index spaces declared by the
+   sections before `id` exist, with imports only */
+static int wasm_init_index_spaces(WasmReader *r, WasmModule *m, int id)
+{
+    uint32_t i, k;
+
+    if (id > 3 && !m->func_types) {
+        m->nfuncs = m->nfunc_imports;
+        if (ALLOC_ARRAY(m->func_types, m->nfuncs) ||
+            ALLOC_ARRAY(m->declared_funcs, m->nfuncs))
+            return -1;
+        for (i = 0, k = 0; i < m->nimports; i++) {
+            if (m->imports[i].kind == WASM_EXTERN_FUNC)
+                m->func_types[k++] = m->imports[i].type_idx;
+        }
+    }
+    if (id > 4 && !m->tables) {
+        m->ntables = m->ntable_imports;
+        if (ALLOC_ARRAY(m->tables, m->ntables))
+            return -1;
+        for (i = 0, k = 0; i < m->nimports; i++) {
+            if (m->imports[i].kind == WASM_EXTERN_TABLE)
+                m->tables[k++] = m->imports[i].limits;
+        }
+    }
+    if (id > 5 && !m->nmemories)
+        m->nmemories = m->nmemory_imports;
+    if (id > 6 && !m->globals) {
+        m->nglobals = m->nglobal_imports;
+        if (ALLOC_ARRAY(m->globals, 0))
+            return -1;
+    }
+    return 0;
+}
+
+/* Decode and validate a module. The bytes are copied. Returns NULL and
+   fills `error` on failure. */
+static WasmModule *wasm_module_new(const uint8_t *bytes, size_t size,
+                                   char *error, size_t error_size)
+{
+    WasmReader rs, *r = &rs;
+    WasmModule *m;
+    uint8_t id, rank, last_rank = 0;
+    uint32_t len, i, dc = 0;
+    const uint8_t *end;
+    BOOL has_code = FALSE;
+    int ret;
+    /* section order, with DataCount (12) between Element (9) and Code (10) */
+    static const uint8_t section_rank[13] = {
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 11, 12, 10
+    };
+
+    m = calloc(1, sizeof(*m));
+    if (!m)
+        goto oom;
+    m->ref_count = 1;
+    m->start = -1;
+    m->data_count = -1;
+    m->bytes = malloc(size ? size : 1);
+    if (!m->bytes) {
+        free(m);
+        goto oom;
+    }
+    memcpy(m->bytes, bytes, size);
+    m->size = size;
+
+    memset(r, 0, sizeof(*r));
+    r->base = m->bytes;
+    r->p = m->bytes;
+    r->end = m->bytes + size;
+
+    if (size < 4 || memcmp(r->p, "\0asm", 4)) {
+        wasm_error(r, "magic header not detected");
+        goto fail;
+    }
+    if (size < 8 || memcmp(r->p + 4, "\1\0\0\0", 4)) {
+        wasm_error(r, "unknown binary version");
+        goto fail;
+    }
+    r->p += 8;
+    while (r->p < r->end) {
+        if (read_u8(r, &id) || read_u32(r, &len))
+            goto fail;
+        if (len > r->end - r->p) {
+            wasm_error(r, "section size mismatch");
+            goto fail;
+        }
+        end = r->p + len;
+        if (id > 12) {
+            wasm_error(r, "malformed section id %u", id);
+            goto fail;
+        }
+        if (id != 0) {
+            rank = section_rank[id];
+            if (rank <= last_rank) {
+                wasm_error(r, "unexpected section %u", id);
+                goto fail;
+            }
+            last_rank = rank;
+            if (wasm_init_index_spaces(r, m, id == 12 ? 10 : id))
+                goto fail;
+        }
+        {
+            /* sections must be consumed exactly */
+            WasmReader sub = *r;
+            sub.end = end;
+            switch (id) {
+            case 0: ret = decode_custom(&sub, m, end); break;
+            case 1: ret = decode_types(&sub, m); break;
+            case 2: ret = decode_imports(&sub, m); break;
+            case 3: ret = decode_functions(&sub, m); break;
+            case 4: ret = decode_tables(&sub, m); break;
+            case 5: ret = decode_memory(&sub, m); break;
+            case 6: ret = decode_globals(&sub, m); break;
+            case 7: ret = decode_exports(&sub, m); break;
+            case 8: ret = decode_start(&sub, m); break;
+            case 9: ret = decode_elems(&sub, m); break;
+            case 10: ret = decode_code(&sub, m); has_code = TRUE; break;
+            case 11: ret = decode_datas(&sub, m); break;
+            default:
+                ret = read_u32(&sub, &dc);
+                m->data_count = dc;
+                break;
+            }
+            if (ret == 0 && sub.p != end)
+                ret = wasm_error(&sub, "section size mismatch");
+            if (ret) {
+                memcpy(r->error, sub.error, sizeof(r->error));
+                goto fail;
+            }
+            r->p = end;
+        }
+    }
+    if (wasm_init_index_spaces(r, m, 12))
+        goto fail;
+    if (!has_code && m->nfuncs > m->nfunc_imports) {
+        wasm_error(r, "function and code section have inconsistent lengths");
+        goto fail;
+    }
+    if (m->data_count > 0 && !m->datas) {
+        wasm_error(r, "data count and data section have inconsistent lengths");
+        goto fail;
+    }
+    for (i = m->nfunc_imports; i < m->nfuncs; i++) {
+        if (wasm_validate_code(r, m, i))
+            goto fail;
+    }
+    return m;
+ fail:
+    snprintf(error, error_size, "%s", r->error[0] ? r->error : "invalid module");
+    wasm_module_free(m);
+    return NULL;
+ oom:
+    snprintf(error, error_size, "out of memory");
+    return NULL;
+}
+
+/* ------------------------------------------------------------------------
+ * Validation
+ * ------------------------------------------------------------------------ */
+
+#define WASM_UNKNOWN 0  /* operand type in unreachable code */
+
+typedef struct {
+    uint8_t opcode;         /* 0x02 block, 0x03 loop, 0x04 if, 0x05 else,
+                               0 for the function body */
+    uint8_t unreachable;
+    uint32_t height;        /* operand stack height below the params */
+    uint32_t nparams, nresults;
+    const uint8_t *params, *results;
+    uint32_t loop_pc, loop_stp;
+    int32_t if_entry;       /* `if` entry to patch at else/end, -1 if none */
+    int32_t fixups;         /* entries branching to the end of this block */
+} WasmCtrl;
+
+typedef struct {
+    WasmReader *r;
+    WasmModule *m;
+    WasmCode *code;
+    uint8_t *stack;
+    uint32_t sp, stack_size, max_height;
+    WasmCtrl *ctrls;
+    uint32_t nctrls, ctrls_size;
+    WasmSideEntry *side;
+    uint32_t *side_pc;      /* offset of the branch opcode */
+    int32_t *side_link;     /* next pending entry of the same block */
+    uint32_t nside, side_size;
+} WasmValidator;
+
+/* Block types with a single result point into this array */
+static const uint8_t wasm_single_types[] = {
+    WASM_I32, WASM_I64, WASM_F32, WASM_F64, WASM_V128, WASM_FUNCREF,
+};
+
+/* From/to types of the conversion opcodes 0xa7-0xbf */
+static const uint8_t wasm_conv_types[25][2] = {
+    { WASM_I64, WASM_I32 }, { WASM_F32, WASM_I32 }, { WASM_F32, WASM_I32 },
+    { WASM_F64, WASM_I32 }, { WASM_F64, WASM_I32 }, { WASM_I32, WASM_I64 },
+    { WASM_I32, WASM_I64 }, { WASM_F32, WASM_I64 }, { WASM_F32, WASM_I64 },
+    { WASM_F64, WASM_I64 }, { WASM_F64, WASM_I64 }, { WASM_I32, WASM_F32 },
+    { WASM_I32, WASM_F32 }, { WASM_I64, WASM_F32 }, { WASM_I64, WASM_F32 },
+    { WASM_F64, WASM_F32 }, { WASM_I32, WASM_F64 }, { WASM_I32, WASM_F64 },
+    { WASM_I64, WASM_F64 }, { WASM_I64, WASM_F64 }, { WASM_F32, WASM_F64 },
+    { WASM_F32, WASM_I32 }, { WASM_F64, WASM_I64 }, { WASM_I32, WASM_F32 },
+    { WASM_I64, WASM_F64 },
+};
+
+/* log2 of the access size and value type of loads (0x28-0x35) and stores
+   (0x36-0x3e) */
+static const uint8_t wasm_mem_log2[23] = {
+    2, 3, 2, 3, 0, 0, 1, 1, 0, 0, 1, 1, 2, 2,
+    2, 3, 2, 3, 0, 1, 0, 1, 2,
+};
+
+static const uint8_t wasm_mem_type[23] = {
+    WASM_I32, WASM_I64, WASM_F32, WASM_F64, WASM_I32, WASM_I32, WASM_I32,
+    WASM_I32, WASM_I64, WASM_I64, WASM_I64, WASM_I64, WASM_I64, WASM_I64,
+    WASM_I32, WASM_I64, WASM_F32, WASM_F64, WASM_I32, WASM_I32, WASM_I64,
+    WASM_I64, WASM_I64,
+};
+
+static const char *wasm_type_name(uint8_t t)
+{
+    switch (t) {
+    case WASM_I32: return "i32";
+    case WASM_I64: return "i64";
+    case WASM_F32: return "f32";
+    case WASM_F64: return "f64";
+    case WASM_V128: return "v128";
+    case WASM_FUNCREF: return "funcref";
+    default: return "unknown";
+    }
+}
+
+static int v_push(WasmValidator *v, uint8_t t)
+{
+    if (v->sp >= v->stack_size) {
+        uint32_t new_size = v->stack_size * 2 + 16;
+        uint8_t *s;
+        if (new_size > 1000000)
+            return wasm_error(v->r, "operand stack too deep");
+        s = realloc(v->stack, new_size);
+        if (!s)
+            return wasm_error(v->r, "out of memory");
+        v->stack = s;
+        v->stack_size = new_size;
+    }
+    v->stack[v->sp++] = t;
+    if (v->sp > v->max_height)
+        v->max_height = v->sp;
+    return 0;
+}
+
+/* Pop a value of type `t` (WASM_UNKNOWN for any). The popped type is
+   stored in `*pt` if not NULL. */
+static int v_pop(WasmValidator *v, uint8_t t, uint8_t *pt)
+{
+    WasmCtrl *c = &v->ctrls[v->nctrls - 1];
+    uint8_t a;
+
+    if (v->sp == c->height) {
+        if (c->unreachable) {
+            if (pt)
+                *pt = t;
+            return 0;
+        }
+        return wasm_error(v->r, "type mismatch: expected %s but nothing on stack",
+                          wasm_type_name(t));
+    }
+    a = v->stack[--v->sp];
+    if (a != t && a != WASM_UNKNOWN && t != WASM_UNKNOWN)
+        return wasm_error(v->r, "type mismatch: expected %s, got %s",
+                          wasm_type_name(t), wasm_type_name(a));
+    if (pt)
+        *pt = a != WASM_UNKNOWN ? a : t;
+    return 0;
+}
+
+static int v_pop_types(WasmValidator *v, const uint8_t *types, uint32_t n)
+{
+    while (n-- > 0) {
+        if (v_pop(v, types[n], NULL))
+            return -1;
+    }
+    return 0;
+}
+
+static int v_push_types(WasmValidator *v, const uint8_t *types, uint32_t n)
+{
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        if (v_push(v, types[i]))
+            return -1;
+    }
+    return 0;
+}
+
+static void v_set_unreachable(WasmValidator *v)
+{
+    WasmCtrl *c = &v->ctrls[v->nctrls - 1];
+    v->sp = c->height;
+    c->unreachable = 1;
+}
+
+static int v_push_ctrl(WasmValidator *v, uint8_t opcode,
+                       const uint8_t *params, uint32_t nparams,
+                       const uint8_t *results, uint32_t nresults)
+{
+    WasmCtrl *c;
+
+    if (v->nctrls >= v->ctrls_size) {
+        uint32_t new_size = v->ctrls_size * 2 + 8;
+        WasmCtrl *p = realloc(v->ctrls, new_size * sizeof(*p));
+        if (!p)
+            return wasm_error(v->r, "out of memory");
+        v->ctrls = p;
+        v->ctrls_size = new_size;
+    }
+    c = &v->ctrls[v->nctrls++];
+    memset(c, 0, sizeof(*c));
+    c->opcode = opcode;
+    c->height = v->sp;
+    c->params = params;
+    c->nparams = nparams;
+    c->results = results;
+    c->nresults = nresults;
+    c->if_entry = -1;
+    c->fixups = -1;
+    return v_push_types(v, params, nparams);
+}
+
+/* Add a side table entry for the branch opcode at `pc` */
+static int v_add_entry(WasmValidator *v, const uint8_t *pc)
+{
+    if (v->nside >= v->side_size) {
+        uint32_t new_size = v->side_size * 2 + 16;
+        WasmSideEntry *s = realloc(v->side, new_size * sizeof(*s));
+        uint32_t *spc;
+        int32_t *link;
+        if (s)
+            v->side = s;
+        spc = realloc(v->side_pc, new_size * sizeof(*spc));
+        if (spc)
+            v->side_pc = spc;
+        link = realloc(v->side_link, new_size * sizeof(*link));
+        if (link)
+            v->side_link = link;
+        if (!s || !spc || !link)
+            return wasm_error(v->r, "out of memory");
+        v->side_size = new_size;
+    }
+    memset(&v->side[v->nside], 0, sizeof(v->side[0]));
+    v->side_pc[v->nside] = pc - v->r->base;
+    v->side_link[v->nside] = -1;
+    return v->nside++;
+}
+
+static void v_patch_entry(WasmValidator *v, int32_t e, uint32_t target_pc,
+                          uint32_t target_stp)
+{
+    v->side[e].pc_delta = (int32_t)(target_pc - v->side_pc[e]);
+    v->side[e].stp_delta = (int32_t)(target_stp - e);
+}
+
+static uint32_t v_label_arity(WasmCtrl *c, const uint8_t **ptypes)
+{
+    if (c->opcode == 0x03) {
+        *ptypes = c->params;
+        return c->nparams;
+    }
+    *ptypes = c->results;
+    return c->nresults;
+}
+
+/* Type check a branch to `depth` and record its side table entry. The
+   label values stay on the validation stack. */
+static int v_branch(WasmValidator *v, uint32_t depth, const uint8_t *pc,
+                    uint32_t *parity)
+{
+    WasmCtrl *c;
+    const uint8_t *types;
+    uint32_t arity, height;
+    int32_t e;
+
+    if (depth >= v->nctrls)
+        return wasm_error(v->r, "unknown label %u", depth);
+    c = &v->ctrls[v->nctrls - 1 - depth];
+    arity = v_label_arity(c, &types);
+    if (v_pop_types(v, types, arity))
+        return -1;
+    height = v->sp;
+    if (v_push_types(v, types, arity))
+        return -1;
+    e = v_add_entry(v, pc);
+    if (e < 0)
+        return -1;
+    v->side[e].keep = arity;
+    v->side[e].drop = height > c->height ? height - c->height : 0;
+    if (c->opcode == 0x03) {
+        v_patch_entry(v, e, c->loop_pc, c->loop_stp);
+    } else {
+        v->side_link[e] = c->fixups;
+        c->fixups = e;
+    }
+    if (parity)
+        *parity = arity;
+    return 0;
+}
+
+static int v_read_block_type(WasmValidator *v, const uint8_t **pparams,
+                             uint32_t *pnparams, const uint8_t **presults,
+                             uint32_t *pnresults)
+{
+    WasmReader *r = v->r;
+    uint8_t b;
+    int64_t idx;
+    const WasmFuncType *t;
+
+    if (r->p >= r->end)
+        return wasm_error(r, "unexpected end");
+    b = *r->p;
+    *pnparams = 0;
+    *pparams = NULL;
+    if (b == 0x40) {
+        r->p++;
+        *pnresults = 0;
+        *presults = NULL;
+        return 0;
+    }
+    if (b >= 0x40 && !(b & 0x80)) {
+        /* a single byte negative s33: a value type */
+        r->p++;
+        switch (b) {
+        case WASM_I32: *presults = &wasm_single_types[0]; break;
+        case WASM_I64: *presults = &wasm_single_types[1]; break;
+        case WASM_F32: *presults = &wasm_single_types[2]; break;
+        case WASM_F64: *presults = &wasm_single_types[3]; break;
+        case WASM_V128: *presults = &wasm_single_types[4]; break;
+        case WASM_FUNCREF: *presults = &wasm_single_types[5]; break;
+        default:
+            r->p--;
+            return read_val_type(r, &b) ? -1 : wasm_error(r, "invalid block type");
+        }
+        *pnresults = 1;
+        return 0;
+    }
+    /* s33 type index */
+    if (read_s64(r, &idx))
+        return -1;
+    if (idx < 0 || idx >= v->m->ntypes)
+        return wasm_error(r, "unknown type %" PRId64, idx);
+    t = &v->m->types[idx];
+    *pparams = func_params(t);
+    *pnparams = t->nparams;
+    *presults = func_results(t);
+    *pnresults = t->nresults;
+    return 0;
+}
+
+static int v_memarg(WasmValidator *v, int log2_size)
+{
+    uint32_t align, offset;
+
+    if (read_u32(v->r, &align) || read_u32(v->r, &offset))
+        return -1;
+    if (align > log2_size)
+        return wasm_error(v->r, "alignment must not be larger than natural");
+    if (v->m->nmemories == 0)
+        return wasm_error(v->r, "unknown memory 0");
+    return 0;
+}
+
+static int v_memory_zero(WasmValidator *v)
+{
+    uint8_t b = 0;
+    if (read_u8(v->r, &b))
+        return -1;
+    if (b != 0)
+        return wasm_error(v->r, "zero byte expected");
+    if (v->m->nmemories == 0)
+        return wasm_error(v->r, "unknown memory 0");
+    return 0;
+}
+
+static int v_table(WasmValidator *v, uint32_t *pidx)
+{
+    if (read_u32(v->r, pidx))
+        return -1;
+    if (*pidx >= v->m->ntables)
+        return wasm_error(v->r, "unknown table %u", *pidx);
+    return 0;
+}
+
+static int v_elem(WasmValidator *v, uint32_t *pidx)
+{
+    if (read_u32(v->r, pidx))
+        return -1;
+    if (*pidx >= v->m->nelems)
+        return wasm_error(v->r, "unknown elem segment %u", *pidx);
+    return 0;
+}
+
+static int v_data(WasmValidator *v, uint32_t *pidx)
+{
+    if (read_u32(v->r, pidx))
+        return -1;
+    if (v->m->data_count < 0)
+        return wasm_error(v->r, "data count section required");
+    if (*pidx >= (uint32_t)v->m->data_count)
+        return wasm_error(v->r, "unknown data segment %u", *pidx);
+    return 0;
+}
+
+static int v_unop(WasmValidator *v, uint8_t from, uint8_t to)
+{
+    if (v_pop(v, from, NULL))
+        return -1;
+    return v_push(v, to);
+}
+
+static int v_binop(WasmValidator *v, uint8_t from, uint8_t to)
+{
+    if (v_pop(v, from, NULL) || v_pop(v, from, NULL))
+        return -1;
+    return v_push(v, to);
+}
+
+static int v_prefixed(WasmValidator *v)
+{
+    WasmReader *r = v->r;
+    uint32_t op, idx, idx2;
+    static const uint8_t sat_types[8][2] = {
+        { WASM_F32, WASM_I32 }, { WASM_F32, WASM_I32 },
+        { WASM_F64, WASM_I32 }, { WASM_F64, WASM_I32 },
+        { WASM_F32, WASM_I64 }, { WASM_F32, WASM_I64 },
+        { WASM_F64, WASM_I64 }, { WASM_F64, WASM_I64 },
+    };
+
+    if (read_u32(r, &op))
+        return -1;
+    switch (op) {
+    case 0 ... 7:
+        return v_unop(v, sat_types[op][0], sat_types[op][1]);
+    case 8: /* memory.init */
+        if (v_data(v, &idx) || v_memory_zero(v))
+            return -1;
+        goto pop3_i32;
+    case 9: /* data.drop */
+        return v_data(v, &idx);
+    case 10: /* memory.copy */
+        if (v_memory_zero(v) || v_memory_zero(v))
+            return -1;
+        goto pop3_i32;
+    case 11: /* memory.fill */
+        if (v_memory_zero(v))
+            return -1;
+        goto pop3_i32;
+    case 12: /* table.init */
+        if (v_elem(v, &idx) || v_table(v, &idx2))
+            return -1;
+        goto pop3_i32;
+    case 13: /* elem.drop */
+        return v_elem(v, &idx);
+    case 14: /* table.copy */
+        if (v_table(v, &idx) || v_table(v, &idx2))
+            return -1;
+        goto pop3_i32;
+    case 15: /* table.grow */
+        if (v_table(v, &idx) || v_pop(v, WASM_I32, NULL) ||
+            v_pop(v, WASM_FUNCREF, NULL))
+            return -1;
+        return v_push(v, WASM_I32);
+    case 16: /* table.size */
+        if (v_table(v, &idx))
+            return -1;
+        return v_push(v, WASM_I32);
+    case 17: /* table.fill */
+        if (v_table(v, &idx) || v_pop(v, WASM_I32, NULL) ||
+            v_pop(v, WASM_FUNCREF, NULL) || v_pop(v, WASM_I32, NULL))
+            return -1;
+        return 0;
+    default:
+        return wasm_error(r, "invalid opcode 0xfc %u", op);
+    }
+ pop3_i32:
+    if (v_pop(v, WASM_I32, NULL) || v_pop(v, WASM_I32, NULL) ||
+        v_pop(v, WASM_I32, NULL))
+        return -1;
+    return 0;
+}
+
+/* log2 of the access size of the v128 loads 0xfd 0-10 (load, the extending
+   loads and the splats) */
+static const uint8_t wasm_simd_load_log2[11] = {
+    4, 3, 3, 3, 3, 3, 3, 0, 1, 2, 3,
+};
+
+/* Scalar type of the splats 0xfd 15-20 */
+static const uint8_t wasm_simd_splat_type[6] = {
+    WASM_I32, WASM_I32, WASM_I32, WASM_I64, WASM_F32, WASM_F64,
+};
+
+/* Lane count and scalar type of extract_lane and replace_lane (0xfd 21-34) */
+static const uint8_t wasm_simd_lane_count[14] = {
+    16, 16, 16, 8, 8, 8, 4, 4, 2, 2, 4, 4, 2, 2,
+};
+
+static const uint8_t wasm_simd_lane_type[14] = {
+    WASM_I32, WASM_I32, WASM_I32, WASM_I32, WASM_I32, WASM_I32, WASM_I32,
+    WASM_I32, WASM_I64, WASM_I64, WASM_F32, WASM_F32, WASM_F64, WASM_F64,
+};
+
+static int v_simd(WasmValidator *v)
+{
+    WasmReader *r = v->r;
+    uint32_t op, i;
+    uint8_t lane = 0, t;
+
+    if (read_u32(r, &op))
+        return -1;
+    switch (op) {
+    case 0 ... 10: /* v128.load, extending and splatting loads */
+        if (v_memarg(v, wasm_simd_load_log2[op]))
+            return -1;
+        return v_unop(v, WASM_I32, WASM_V128);
+    case 11: /* v128.store */
+        if (v_memarg(v, 4) || v_pop(v, WASM_V128, NULL) ||
+            v_pop(v, WASM_I32, NULL))
+            return -1;
+        return 0;
+    case 12: /* v128.const */
+        if (r->end - r->p < 16)
+            return wasm_error(r, "unexpected end");
+        r->p += 16;
+        return v_push(v, WASM_V128);
+    case 13: /* i8x16.shuffle */
+        for (i = 0; i < 16; i++) {
+            if (read_u8(r, &lane))
+                return -1;
+            if (lane >= 32)
+                return wasm_error(r, "invalid lane index");
+        }
+        return v_binop(v, WASM_V128, WASM_V128);
+    case 15 ... 20: /* splat */
+        return v_unop(v, wasm_simd_splat_type[op - 15], WASM_V128);
+    case 21 ... 34: /* extract_lane, replace_lane */
+        if (read_u8(r, &lane))
+            return -1;
+        if (lane >= wasm_simd_lane_count[op - 21])
+            return wasm_error(r, "invalid lane index");
+        t = wasm_simd_lane_type[op - 21];
+        if (op == 23 || op == 26 || (op >= 28 && !(op & 1))) {
+            if (v_pop(v, t, NULL))
+                return -1;
+            return v_unop(v, WASM_V128, WASM_V128);
+        }
+        return v_unop(v, WASM_V128, t);
+    case 82: /* v128.bitselect */
+        if (v_pop(v, WASM_V128, NULL))
+            return -1;
+        return v_binop(v, WASM_V128, WASM_V128);
+    case 84 ... 91: /* load_lane, store_lane */
+        if (v_memarg(v, (op - 84) & 3) || read_u8(r, &lane))
+            return -1;
+        if (lane >= 16 >> ((op - 84) & 3))
+            return wasm_error(r, "invalid lane index");
+        if (v_pop(v, WASM_V128, NULL) || v_pop(v, WASM_I32, NULL))
+            return -1;
+        return op < 88 ? v_push(v, WASM_V128) : 0;
+    case 92: /* v128.load32_zero */
+    case 93: /* v128.load64_zero */
+        if (v_memarg(v, op == 92 ? 2 : 3))
+            return -1;
+        return v_unop(v, WASM_I32, WASM_V128);
+    case 83: /* v128.any_true */
+    case 99 ... 100: /* i8x16.all_true, bitmask */
+    case 131 ... 132:
+    case 163 ... 164:
+    case 195 ... 196:
+        return v_unop(v, WASM_V128, WASM_I32);
+    case 107 ... 109: /* shl, shr_s, shr_u */
+    case 139 ... 141:
+    case 171 ... 173:
+    case 203 ... 205:
+        if (v_pop(v, WASM_I32, NULL))
+            return -1;
+        return v_unop(v, WASM_V128, WASM_V128);
+    case 77:
+    case 94 ... 98:
+    case 103 ... 106:
+    case 116 ... 117:
+    case 122:
+    case 124 ... 129:
+    case 135 ... 138:
+    case 148:
+    case 160 ... 161:
+    case 167 ... 170:
+    case 192 ... 193:
+    case 199 ... 202:
+    case 224 ... 225:
+    case 227:
+    case 236 ... 237:
+    case 239:
+    case 248 ... 255:
+        return v_unop(v, WASM_V128, WASM_V128);
+    case 14:
+    case 35 ... 76:
+    case 78 ... 81:
+    case 101 ... 102:
+    case 110 ... 115:
+    case 118 ... 121:
+    case 123:
+    case 130:
+    case 133 ... 134:
+    case 142 ... 147:
+    case 149 ... 153:
+    case 155 ... 159:
+    case 174:
+    case 177:
+    case 181 ... 186:
+    case 188 ... 191:
+    case 206:
+    case 209:
+    case 213 ... 223:
+    case 228 ... 235:
+    case 240 ... 247:
+        return v_binop(v, WASM_V128, WASM_V128);
+    default:
+        return wasm_error(r, "invalid opcode 0xfd %u", op);
+    }
+}
+
+static int wasm_validate_code(WasmReader *r0, WasmModule *m, uint32_t func_idx)
+{
+    WasmCode *code = &m->code[func_idx - m->nfunc_imports];
+    const WasmFuncType *ft = &m->types[m->func_types[func_idx]];
+    WasmValidator vs, *v = &vs;
+    WasmReader rs, *r = &rs;
+    WasmCtrl *c;
+    const uint8_t *op_pc, *params = NULL, *results = NULL;
+    uint32_t nparams = 0, nresults = 0, idx, idx2, n, i, arity, arity2 = 0;
+    uint8_t op = 0, t, t2;
+    int32_t e = -1, s32;
+    int64_t s64;
+    const WasmFuncType *ct;
+    int ret = -1;
+
+    memset(v, 0, sizeof(*v));
+    *r = *r0;
+    r->p = m->bytes + code->body;
+    r->end = m->bytes + code->end;
+    v->r = r;
+    v->m = m;
+    v->code = code;
+
+    if (v_push_ctrl(v, 0, NULL, 0, func_results(ft), ft->nresults))
+        goto done;
+    while (v->nctrls > 0) {
+        op_pc = r->p;
+        if (read_u8(r, &op))
+            goto done;
+        switch (op) {
+        case 0x00: /* unreachable */
+            v_set_unreachable(v);
+            break;
+        case 0x01: /* nop */
+            break;
+        case 0x02: /* block */
+        case 0x03: /* loop */
+        case 0x04: /* if */
+            if (v_read_block_type(v, &params, &nparams, &results, &nresults))
+                goto done;
+            if (op == 0x04) {
+                if (v_pop(v, WASM_I32, NULL))
+                    goto done;
+                e = v_add_entry(v, op_pc);
+                if (e < 0)
+                    goto done;
+            }
+            if (v_pop_types(v, params, nparams) ||
+                v_push_ctrl(v, op, params, nparams, results, nresults))
+                goto done;
+            c = &v->ctrls[v->nctrls - 1];
+            if (op == 0x03) {
+                c->loop_pc = r->p - m->bytes;
+                c->loop_stp = v->nside;
+            } else if (op == 0x04) {
+                c->if_entry = e;
+            }
+            break;
+        case 0x05: /* else */
+            c = &v->ctrls[v->nctrls - 1];
+            if (c->opcode != 0x04) {
+                wasm_error(r, "else without matching if");
+                goto done;
+            }
+            if (v_pop_types(v, c->results, c->nresults))
+                goto done;
+            if (v->sp != c->height) {
+                wasm_error(r, "type mismatch: values remaining on stack at end of block");
+                goto done;
+            }
+            /* the then branch jumps over the else branch */
+            e = v_add_entry(v, op_pc);
+            if (e < 0)
+                goto done;
+            v->side_link[e] = c->fixups;
+            c->fixups = e;
+            v_patch_entry(v, c->if_entry, r->p - m->bytes, v->nside);
+            c->if_entry = -1;
+            c->opcode = 0x05;
+            c->unreachable = 0;
+            if (v_push_types(v, c->params, c->nparams))
+                goto done;
+            break;
+        case 0x0b: /* end */
+            c = &v->ctrls[v->nctrls - 1];
+            if (v_pop_types(v, c->results, c->nresults))
+                goto done;
+            if (v->sp != c->height) {
+                wasm_error(r, "type mismatch: values remaining on stack at end of block");
+                goto done;
+            }
+            if (c->if_entry >= 0) {
+                /* if without else: the params must match the results */
+                if (c->nparams != c->nresults ||
+                    (c->nparams && memcmp(c->params, c->results, c->nparams))) {
+                    wasm_error(r, "type mismatch in if false branch");
+                    goto done;
+                }
+                v_patch_entry(v, c->if_entry, op_pc - m->bytes, v->nside);
+            }
+            /* forward branches land on the `end` opcode itself */
+            for (e = c->fixups; e >= 0; e = v->side_link[e])
+                v_patch_entry(v, e, op_pc - m->bytes, v->nside);
+            v->nctrls--;
+            if (v->nctrls > 0 && v_push_types(v, c->results, c->nresults))
+                goto done;
+            break;
+        case 0x0c: /* br */
+            if (read_u32(r, &idx) || v_branch(v, idx, op_pc, NULL))
+                goto done;
+            v_set_unreachable(v);
+            break;
+        case 0x0d: /* br_if */
+            if (read_u32(r, &idx) || v_pop(v, WASM_I32, NULL) ||
+                v_branch(v, idx, op_pc, NULL))
+                goto done;
+            break;
+        case 0x0e: /* br_table */
+            if (read_u32(r, &n) || v_pop(v, WASM_I32, NULL))
+                goto done;
+            if (n > r->end - r->p) {
+                wasm_error(r, "unexpected end");
+                goto done;
+            }
+            for (i = 0; i <= n; i++) {
+                if (read_u32(r, &idx) || v_branch(v, idx, op_pc, &arity))
+                    goto done;
+                if (i > 0 && arity != arity2) {
+                    wasm_error(r, "type mismatch: br_table targets have inconsistent arity");
+                    goto done;
+                }
+                arity2 = arity;
+            }
+            v_set_unreachable(v);
+            break;
+        case 0x0f: /* return */
+            if (v_pop_types(v, func_results(ft), ft->nresults))
+                goto done;
+            v_set_unreachable(v);
+            break;
+        case 0x10: /* call */
+            if (read_u32(r, &idx))
+                goto done;
+            if (idx >= m->nfuncs) {
+                wasm_error(r, "unknown function %u", idx);
+                goto done;
+            }
+            ct = &m->types[m->func_types[idx]];
+            goto do_call;
+        case 0x11: /* call_indirect */
+            if (read_u32(r, &idx) || v_table(v, &idx2))
+                goto done;
+            if (idx >= m->ntypes) {
+                wasm_error(r, "unknown type %u", idx);
+                goto done;
+            }
+            ct = &m->types[idx];
+            if (v_pop(v, WASM_I32, NULL))
+                goto done;
+        do_call:
+            if (v_pop_types(v, func_params(ct), ct->nparams) ||
+                v_push_types(v, func_results(ct), ct->nresults))
+                goto done;
+            break;
+        case 0x1a: /* drop */
+            if (v_pop(v, WASM_UNKNOWN, NULL))
+                goto done;
+            break;
+        case 0x1b: /* select */
+            if (v_pop(v, WASM_I32, NULL) || v_pop(v, WASM_UNKNOWN, &t) ||
+                v_pop(v, t, &t2))
+                goto done;
+            if (t2 == WASM_FUNCREF) {
+                wasm_error(r, "type mismatch: select requires a type for references");
+                goto done;
+            }
+            if (v_push(v, t2))
+                goto done;
+            break;
+        case 0x1c: /* select t */
+            if (read_u32(r, &n))
+                goto done;
+            if (n != 1) {
+                wasm_error(r, "invalid result arity");
+                goto done;
+            }
+            if (read_val_type(r, &t) || v_pop(v, WASM_I32, NULL) ||
+                v_pop(v, t, NULL) || v_pop(v, t, NULL) || v_push(v, t))
+                goto done;
+            break;
+        case 0x20: /* local.get */
+        case 0x21: /* local.set */
+        case 0x22: /* local.tee */
+            if (read_u32(r, &idx))
+                goto done;
+            if (idx >= code->nlocals) {
+                wasm_error(r, "unknown local %u", idx);
+                goto done;
+            }
+            t = code->local_types[idx];
+            if (op != 0x20 && v_pop(v, t, NULL))
+                goto done;
+            if (op != 0x21 && v_push(v, t))
+                goto done;
+            break;
+        case 0x23: /* global.get */
+        case 0x24: /* global.set */
+            if (read_u32(r, &idx))
+                goto done;
+            if (idx >= m->nglobals) {
+                wasm_error(r, "unknown global %u", idx);
+                goto done;
+            }
+            t = global_type(m, idx);
+            if (op == 0x23) {
+                if (v_push(v, t))
+                    goto done;
+            } else {
+                if (!global_is_mutable(m, idx)) {
+                    wasm_error(r, "global is immutable");
+                    goto done;
+                }
+                if (v_pop(v, t, NULL))
+                    goto done;
+            }
+            break;
+        case 0x25: /* table.get */
+            if (v_table(v, &idx) || v_unop(v, WASM_I32, WASM_FUNCREF))
+                goto done;
+            break;
+        case 0x26: /* table.set */
+            if (v_table(v, &idx) || v_pop(v, WASM_FUNCREF, NULL) ||
+                v_pop(v, WASM_I32, NULL))
+                goto done;
+            break;
+        case 0x28 ... 0x35: /* loads */
+            if (v_memarg(v, wasm_mem_log2[op - 0x28]) ||
+                v_unop(v, WASM_I32, wasm_mem_type[op - 0x28]))
+                goto done;
+            break;
+        case 0x36 ... 0x3e: /* stores */
+            if (v_memarg(v, wasm_mem_log2[op - 0x28]) ||
+                v_pop(v, wasm_mem_type[op - 0x28], NULL) ||
+                v_pop(v, WASM_I32, NULL))
+                goto done;
+            break;
+        case 0x3f: /* memory.size */
+            if (v_memory_zero(v) || v_push(v, WASM_I32))
+                goto done;
+            break;
+        case 0x40: /* memory.grow */
+            if (v_memory_zero(v) || v_unop(v, WASM_I32, WASM_I32))
+                goto done;
+            break;
+        case 0x41:
+            if (read_s32(r, &s32) || v_push(v, WASM_I32))
+                goto done;
+            break;
+        case 0x42:
+            if (read_s64(r, &s64) || v_push(v, WASM_I64))
+                goto done;
+            break;
+        case 0x43:
+        case 0x44:
+            n = op == 0x43 ? 4 : 8;
+            if (n > r->end - r->p) {
+                wasm_error(r, "unexpected end");
+                goto done;
+            }
+            r->p += n;
+            if (v_push(v, op == 0x43 ? WASM_F32 : WASM_F64))
+                goto done;
+            break;
+        case 0x45:
+            ret = v_unop(v, WASM_I32, WASM_I32);
+            goto check;
+        case 0x46 ... 0x4f:
+            ret = v_binop(v, WASM_I32, WASM_I32);
+            goto check;
+        case 0x50:
+            ret = v_unop(v, WASM_I64, WASM_I32);
+            goto check;
+        case 0x51 ... 0x5a:
+            ret = v_binop(v, WASM_I64, WASM_I32);
+            goto check;
+        case 0x5b ... 0x60:
+            ret = v_binop(v, WASM_F32, WASM_I32);
+            goto check;
+        case 0x61 ... 0x66:
+            ret = v_binop(v, WASM_F64, WASM_I32);
+            goto check;
+        case 0x67 ... 0x69:
+        case 0xc0 ... 0xc1:
+            ret = v_unop(v, WASM_I32, WASM_I32);
+            goto check;
+        case 0x6a ... 0x78:
+            ret = v_binop(v, WASM_I32, WASM_I32);
+            goto check;
+        case 0x79 ... 0x7b:
+        case 0xc2 ... 0xc4:
+            ret = v_unop(v, WASM_I64, WASM_I64);
+            goto check;
+        case 0x7c ... 0x8a:
+            ret = v_binop(v, WASM_I64, WASM_I64);
+            goto check;
+        case 0x8b ... 0x91:
+            ret = v_unop(v, WASM_F32, WASM_F32);
+            goto check;
+        case 0x92 ... 0x98:
+            ret = v_binop(v, WASM_F32, WASM_F32);
+            goto check;
+        case 0x99 ... 0x9f:
+            ret = v_unop(v, WASM_F64, WASM_F64);
+            goto check;
+        case 0xa0 ... 0xa6:
+            ret = v_binop(v, WASM_F64, WASM_F64);
+            goto check;
+        case 0xa7 ... 0xbf:
+            ret = v_unop(v, wasm_conv_types[op - 0xa7][0],
+                         wasm_conv_types[op - 0xa7][1]);
+        check:
+            if (ret)
+                goto done;
+            ret = -1;
+            break;
+        case 0xd0: /* ref.null */
+            if (read_val_type(r, &t))
+                goto done;
+            if (t != WASM_FUNCREF) {
+                wasm_error(r, "invalid reference type");
+                goto done;
+            }
+            if (v_push(v, WASM_FUNCREF))
+                goto done;
+            break;
+        case 0xd1: /* ref.is_null */
+            if (v_pop(v, WASM_FUNCREF, NULL) || v_push(v, WASM_I32))
+                goto done;
+            break;
+        case 0xd2: /* ref.func */
+            if (read_u32(r, &idx))
+                goto done;
+            if (idx >= m->nfuncs) {
+                wasm_error(r, "unknown function %u", idx);
+                goto done;
+            }
+            if (!m->declared_funcs[idx]) {
+                wasm_error(r, "undeclared function reference");
+                goto done;
+            }
+            if (v_push(v, WASM_FUNCREF))
+                goto done;
+            break;
+        case 0xfc:
+            if (v_prefixed(v))
+                goto done;
+            break;
+        case 0xfd:
+            if (v_simd(v))
+                goto done;
+            break;
+        default:
+            wasm_error(r, "invalid opcode 0x%02x", op);
+            goto done;
+        }
+    }
+    if (r->p != r->end) {
+        wasm_error(r, "operators remaining after end of function");
+        goto done;
+    }
+    code->max_height = v->max_height;
+    code->side = v->side;
+    v->side = NULL;
+    ret = 0;
+ done:
+    if (ret)
+        memcpy(r0->error, r->error, sizeof(r0->error));
+    free(v->stack);
+    free(v->ctrls);
+    free(v->side);
+    free(v->side_pc);
+    free(v->side_link);
+    return ret;
+}
+
+/* ------------------------------------------------------------------------
+ * Runtime objects
+ * ------------------------------------------------------------------------ */
+
+typedef struct WasmInstance WasmInstance;
+
+typedef struct WasmFunction {
+    WasmInstance *inst;
+    uint32_t index;
+    const WasmFuncType *type;
+    struct WasmFunction *target; /* imported WebAssembly function */
+    JSValue host;           /* imported JS function */
+    JSValue obj;            /* function object, created on demand */
+} WasmFunction;
+
+/* The linear memory is shared between the Memory object and its current
+   ArrayBuffer, either may outlive the other */
+typedef struct {
+    int ref_count;
+    uint8_t *data;
+    uint64_t size;
+    uint32_t max_pages;
+    JSValue buffer;         /* owned by the Memory object */
+} WasmMemory;
+
+typedef struct {
+    uint32_t size, max;
+    WasmFunction **elems;
+    JSValue *objs;          /* function objects keeping `elems` alive */
+} WasmTable;
+
+typedef struct {
+    uint8_t type;
+    uint8_t mutable;
+    WasmValue v;
+    JSValue ref_obj;        /* function object keeping a funcref alive */
+} WasmGlobal;
+
+struct WasmInstance {
+    WasmModule *mod;
+    JSValue obj;            /* the Instance object itself, not counted */
+    WasmFunction *funcs;
+    JSValue memory_obj;
+    WasmMemory *mem;
+    JSValue *table_objs;
+    WasmTable **tables;
+    JSValue *global_objs;
+    WasmGlobal **globals;
+    uint8_t *elem_dropped;
+    uint8_t *data_dropped;
+    JSValue exports;
+};
+
+typedef struct {
+    JSValue inst_obj;
+    WasmFunction *func;
+} WasmFuncObj;
+
+static JSClassID js_wasm_module_class_id;
+static JSClassID js_wasm_instance_class_id;
+static JSClassID js_wasm_memory_class_id;
+static JSClassID js_wasm_table_class_id;
+static JSClassID js_wasm_global_class_id;
+static JSClassID js_wasm_function_class_id;
+/* the error classes are only registered to keep their prototypes per
+   context */
+static JSClassID js_wasm_error_class_ids[3];
+
+enum {
+    WASM_COMPILE_ERROR,
+    WASM_LINK_ERROR,
+    WASM_RUNTIME_ERROR,
+};
+
+static const char *wasm_error_names[3] = {
+    "CompileError", "LinkError", "RuntimeError",
+};
+
+static JSValue __attribute__((format(printf, 3, 4)))
+wasm_throw(JSContext *ctx, int error_kind, const char *fmt, ...)
+{
+    char buf[256];
+    va_list ap;
+    JSValue err, proto;
+
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    err = JS_NewError(ctx);
+    if (JS_IsException(err))
+        return err;
+    proto = JS_GetClassProto(ctx, js_wasm_error_class_ids[error_kind]);
+    JS_SetPrototype(ctx, err, proto);
+    JS_FreeValue(ctx, proto);
+    JS_DefinePropertyValueStr(ctx, err, "message", JS_NewString(ctx, buf),
+                              JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE);
+    return JS_Throw(ctx, err);
+}
+
+static JSValue wasm_func_object(JSContext *ctx, WasmFunction *f)
+{
+    WasmFuncObj *fo;
+    JSValue obj;
+    char name[16];
+
+    if (JS_IsUndefined(f->obj)) {
+        obj = JS_NewObjectClass(ctx, js_wasm_function_class_id);
+        if (JS_IsException(obj))
+            return obj;
+        fo = js_mallocz(ctx, sizeof(*fo));
+        if (!fo) {
+            JS_FreeValue(ctx, obj);
+            return JS_EXCEPTION;
+        }
+        fo->inst_obj = JS_DupValue(ctx, f->inst->obj);
+        fo->func = f;
+        JS_SetOpaque(obj, fo);
+        snprintf(name, sizeof(name), "%u", f->index);
+        JS_DefinePropertyValueStr(ctx, obj, "name", JS_NewString(ctx, name),
+                                  JS_PROP_CONFIGURABLE);
+        JS_DefinePropertyValueStr(ctx, obj, "length",
+                                  JS_NewInt32(ctx, f->type->nparams),
+                                  JS_PROP_CONFIGURABLE);
+        f->obj = obj;
+    }
+    return JS_DupValue(ctx, f->obj);
+}
+
+static JSValue wasm_to_js(JSContext *ctx, uint8_t type, WasmValue v)
+{
+    switch (type) {
+    case WASM_I32:
+        return JS_NewInt32(ctx, v.i32);
+    case WASM_I64:
+        return JS_NewBigInt64(ctx, v.i64);
+    case WASM_F32:
+        return JS_NewFloat64(ctx, v.f32);
+    case WASM_F64:
+        return JS_NewFloat64(ctx, v.f64);
+    case WASM_V128:
+        return JS_ThrowTypeError(ctx, "v128 values can't be passed to JavaScript");
+    default:
+        return v.ref ? wasm_func_object(ctx, v.ref) : JS_NULL;
+    }
+}
+
+static int wasm_from_js(JSContext *ctx, uint8_t type, JSValueConst val,
+                        WasmValue *pv)
+{
+    WasmFuncObj *fo;
+    double d;
+
+    pv->u64 = 0;
+    switch (type) {
+    case WASM_I32:
+        return JS_ToInt32(ctx, &pv->i32, val);
+    case WASM_I64:
+        return JS_ToBigInt64(ctx, &pv->i64, val);
+    case WASM_F32:
+        if (JS_ToFloat64(ctx, &d, val))
+            return -1;
+        pv->f32 = d;
+        return 0;
+    case WASM_F64:
+        return JS_ToFloat64(ctx, &pv->f64, val);
+    case WASM_V128:
+        JS_ThrowTypeError(ctx, "v128 values can't be passed from JavaScript");
+        return -1;
+    default:
+        if (JS_IsNull(val)) {
+            pv->ref = NULL;
+            return 0;
+        }
+        fo = JS_GetOpaque(val, js_wasm_function_class_id);
+        if (!fo) {
+            JS_ThrowTypeError(ctx, "not an exported WebAssembly function");
+            return -1;
+        }
+        pv->ref = fo->func;
+        return 0;
+    }
+}
+
+static void wasm_memory_unref(WasmMemory *mem)
+{
+    if (--mem->ref_count == 0) {
+        free(mem->data);
+        free(mem);
+    }
+}
+
+static void wasm_memory_buffer_free(JSRuntime *rt, void *opaque, void *ptr)
+{
+    /* also called with NULL when a detached buffer is finalized */
+    if (ptr)
+        wasm_memory_unref(opaque);
+}
+
+static JSValue wasm_memory_buffer(JSContext *ctx, WasmMemory *mem)
+{
+    JSValue buf;
+
+    if (JS_IsUndefined(mem->buffer)) {
+        buf = JS_NewArrayBuffer(ctx, mem->data, mem->size,
+                                wasm_memory_buffer_free, mem, FALSE);
+        if (JS_IsException(buf))
+            return buf;
+        mem->ref_count++;
+        mem->buffer = buf;
+    }
+    return JS_DupValue(ctx, mem->buffer);
+}
+
+/* Returns the previous size in pages, or -1 */
+static int64_t wasm_memory_grow(JSContext *ctx, WasmMemory *mem, uint32_t delta)
+{
+    uint64_t old_pages = mem->size / WASM_PAGE_SIZE;
+    uint64_t new_size;
+    uint8_t *data;
+
+    if (old_pages + delta > mem->max_pages)
+        return -1;
+    new_size = (old_pages + delta) * WASM_PAGE_SIZE;
+    if (delta) {
+        /* the data always has at least one byte so it is never NULL */
+        data = realloc(mem->data, new_size ? new_size : 1);
+        if (!data)
+            return -1;
+        memset(data + mem->size, 0, new_size - mem->size);
+        mem->data = data;
+    }
+    /* the buffer is replaced by one of the new size, even if delta is 0 */
+    if (!JS_IsUndefined(mem->buffer)) {
+        JS_DetachArrayBuffer(ctx, mem->buffer);
+        JS_FreeValue(ctx, mem->buffer);
+        mem->buffer = JS_UNDEFINED;
+    }
+    mem->size = new_size;
+    return old_pages;
+}
+
+static JSValue wasm_new_object(JSContext *ctx, JSValueConst new_target,
+                               JSClassID class_id)
+{
+    JSValue proto, obj;
+
+    if (JS_IsUndefined(new_target))
+        return JS_NewObjectClass(ctx, class_id);
+    proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+    if (JS_IsException(proto))
+        return proto;
+    obj = JS_NewObjectProtoClass(ctx, proto, class_id);
+    JS_FreeValue(ctx, proto);
+    return obj;
+}
+
+static JSValue wasm_memory_new(JSContext *ctx, JSValueConst new_target,
+                               uint32_t initial, uint32_t max_pages)
+{
+    WasmMemory *mem;
+    JSValue obj;
+
+    obj = wasm_new_object(ctx, new_target, js_wasm_memory_class_id);
+    if (JS_IsException(obj))
+        return obj;
+    mem = calloc(1, sizeof(*mem));
+    if (mem) {
+        mem->data = calloc(1, (size_t)initial * WASM_PAGE_SIZE + 1);
+        if (!mem->data) {
+            free(mem);
+            mem = NULL;
+        }
+    }
+    if (!mem) {
+        JS_FreeValue(ctx, obj);
+        return JS_ThrowRangeError(ctx, "could not allocate memory");
+    }
+    mem->ref_count = 1;
+    mem->size = (uint64_t)initial * WASM_PAGE_SIZE;
+    mem->max_pages = max_pages;
+    mem->buffer = JS_UNDEFINED;
+    JS_SetOpaque(obj, mem);
+    return obj;
+}
+
+static int wasm_table_set(JSContext *ctx, WasmTable *t, uint32_t i,
+                          WasmFunction *f)
+{
+    JSValue obj = JS_NULL;
+
+    if (f) {
+        obj = wasm_func_object(ctx, f);
+        if (JS_IsException(obj))
+            return -1;
+    }
+    JS_FreeValue(ctx, t->objs[i]);
+    t->objs[i] = obj;
+    t->elems[i] = f;
+    return 0;
+}
+
+/* Returns the previous size, -1 if the table cannot grow or -2 if an
+   exception is pending */
+static int64_t wasm_table_grow(JSContext *ctx, WasmTable *t, uint32_t delta,
+                               WasmFunction *init)
+{
+    uint32_t old_size = t->size, i;
+    WasmFunction **elems;
+    JSValue *objs;
+
+    if ((uint64_t)old_size + delta > min_uint32(t->max, WASM_MAX_TABLE_SIZE))
+        return -1;
+    if (delta == 0)
+        return old_size;
+    elems = realloc(t->elems, (old_size + delta) * sizeof(*elems));
+    if (!elems)
+        return -1;
+    t->elems = elems;
+    objs = realloc(t->objs, (old_size + delta) * sizeof(*objs));
+    if (!objs)
+        return -1;
+    t->objs = objs;
+    for (i = old_size; i < old_size + delta; i++) {
+        t->elems[i] = NULL;
+        t->objs[i] = JS_NULL;
+    }
+    t->size = old_size + delta;
+    if (init) {
+        for (i = old_size; i < t->size; i++) {
+            if (wasm_table_set(ctx, t, i, init))
+                return -2;
+        }
+    }
+    return old_size;
+}
+
+static JSValue wasm_table_new(JSContext *ctx, JSValueConst new_target,
+                              uint32_t initial, uint32_t max)
+{
+    WasmTable *t;
+    JSValue obj;
+
+    obj = wasm_new_object(ctx, new_target, js_wasm_table_class_id);
+    if (JS_IsException(obj))
+        return obj;
+    t = calloc(1, sizeof(*t));
+    if (!t) {
+        JS_FreeValue(ctx, obj);
+        return JS_ThrowOutOfMemory(ctx);
+    }
+    t->max = max;
+    JS_SetOpaque(obj, t);
+    if (wasm_table_grow(ctx, t, initial, NULL) < 0) {
+        JS_FreeValue(ctx, obj);
+        return JS_ThrowRangeError(ctx, "could not allocate table");
+    }
+    return obj;
+}
+
+static int wasm_global_set(JSContext *ctx, WasmGlobal *g, WasmValue v)
+{
+    JSValue obj = JS_UNDEFINED;
+
+    if (g->type == WASM_FUNCREF && v.ref) {
+        obj = wasm_func_object(ctx, v.ref);
+        if (JS_IsException(obj))
+            return -1;
+    }
+    JS_FreeValue(ctx, g->ref_obj);
+    g->ref_obj = obj;
+    g->v = v;
+    return 0;
+}
+
+static JSValue wasm_global_new(JSContext *ctx, JSValueConst new_target,
+                               uint8_t type, BOOL mutable, WasmValue v)
+{
+    WasmGlobal *g;
+    JSValue obj;
+
+    obj = wasm_new_object(ctx, new_target, js_wasm_global_class_id);
+    if (JS_IsException(obj))
+        return obj;
+    g = calloc(1, sizeof(*g));
+    if (!g) {
+        JS_FreeValue(ctx, obj);
+        return JS_ThrowOutOfMemory(ctx);
+    }
+    g->type = type;
+    g->mutable = mutable;
+    g->ref_obj = JS_UNDEFINED;
+    JS_SetOpaque(obj, g);
+    if (wasm_global_set(ctx, g, v)) {
+        JS_FreeValue(ctx, obj);
+        return JS_EXCEPTION;
+    }
+    return obj;
+}
+
+/* ------------------------------------------------------------------------
+ * Interpreter
+ * ------------------------------------------------------------------------ */
+
+typedef struct {
+    WasmFunction *func;     /* NULL for the entry from JS */
+    const uint8_t *pc;
+    const WasmSideEntry *stp;
+    WasmValue *fp;
+} WasmFrame;
+
+/* One value stack per thread, shared by nested JS -> wasm -> JS -> wasm
+   calls */
+typedef struct {
+    WasmValue *stack;
+    WasmValue *top;         /* first slot not used by a running call */
+    WasmFrame *frames;
+    uint32_t depth;
+} WasmStack;
+
+static pthread_key_t wasm_stack_key;
+static pthread_once_t wasm_stack_once = PTHREAD_ONCE_INIT;
+
+static void wasm_stack_free(void *opaque)
+{
+    WasmStack *s = opaque;
+    free(s->stack);
+    free(s->frames);
+    free(s);
+}
+
+static void wasm_stack_key_init(void)
+{
+    pthread_key_create(&wasm_stack_key, wasm_stack_free);
+}
+
+static WasmStack *wasm_get_stack(JSContext *ctx)
+{
+    WasmStack *s;
+
+    pthread_once(&wasm_stack_once, wasm_stack_key_init);
+    s = pthread_getspecific(wasm_stack_key);
+    if (!s) {
+        s = calloc(1, sizeof(*s));
+        if (s) {
+            s->stack = malloc(WASM_STACK_SLOTS * sizeof(WasmValue));
+            s->frames = malloc(WASM_MAX_FRAMES * sizeof(WasmFrame));
+            if (!s->stack || !s->frames) {
+                wasm_stack_free(s);
+                s = NULL;
+            }
+        }
+        if (!s) {
+            JS_ThrowOutOfMemory(ctx);
+            return NULL;
+        }
+        s->top = s->stack;
+        pthread_setspecific(wasm_stack_key, s);
+    }
+    return s;
+}
+
+/* Call an imported JS function. The arguments are replaced by the
+   results. */
+static int wasm_call_host(JSContext *ctx, WasmFunction *f, WasmValue *args)
+{
+    const WasmFuncType *t = f->type;
+    JSValue argv_buf[8], *argv = argv_buf, ret, v;
+    uint32_t i;
+    int res = -1;
+
+    if (func_type_has_v128(t)) {
+        JS_ThrowTypeError(ctx, "can't call a JavaScript function with v128 in its signature");
+        return -1;
+    }
+    if (t->nparams > countof(argv_buf)) {
+        argv = js_malloc(ctx, t->nparams * sizeof(*argv));
+        if (!argv)
+            return -1;
+    }
+    for (i = 0; i < t->nparams; i++)
+        argv[i] = wasm_to_js(ctx, t->types[i], args[i]);
+    ret = JS_Call(ctx, f->host, JS_UNDEFINED, t->nparams, (JSValueConst *)argv);
+    for (i = 0; i < t->nparams; i++)
+        JS_FreeValue(ctx, argv[i]);
+    if (argv != argv_buf)
+        js_free(ctx, argv);
+    if (JS_IsException(ret))
+        return -1;
+    if (t->nresults == 1) {
+        res = wasm_from_js(ctx, func_results(t)[0], ret, &args[0]);
+    } else {
+        /* multiple results are returned as an array */
+        res = 0;
+        for (i = 0; i < t->nresults && res == 0; i++) {
+            v = JS_GetPropertyUint32(ctx, ret, i);
+            if (JS_IsException(v))
+                res = -1;
+            else
+                res = wasm_from_js(ctx, func_results(t)[i], v, &args[i]);
+            JS_FreeValue(ctx, v);
+        }
+    }
+    JS_FreeValue(ctx, ret);
+    return res;
+}
+
+static inline float wasm_fminf(float a, float b)
+{
+    if (isnan(a) || isnan(b))
+        return a + b;
+    if (a == b)
+        return signbit(a) ? a : b;
+    return a < b ? a : b;
+}
+
+static inline float wasm_fmaxf(float a, float b)
+{
+    if (isnan(a) || isnan(b))
+        return a + b;
+    if (a == b)
+        return signbit(a) ? b : a;
+    return a > b ? a : b;
+}
+
+static inline double wasm_fmin(double a, double b)
+{
+    if (isnan(a) || isnan(b))
+        return a + b;
+    if (a == b)
+        return signbit(a) ? a : b;
+    return a < b ? a : b;
+}
+
+static inline double wasm_fmax(double a, double b)
+{
+    if (isnan(a) || isnan(b))
+        return a + b;
+    if (a == b)
+        return signbit(a) ? b : a;
+    return a > b ? a : b;
+}
+
+/* float to integer conversions: bounds are exclusive and exact in double */
+#define WASM_I32_MIN_BOUND -2147483649.0
+#define WASM_I32_MAX_BOUND 2147483648.0
+#define WASM_U32_MAX_BOUND 4294967296.0
+#define WASM_I64_MAX_BOUND 9223372036854775808.0
+#define WASM_U64_MAX_BOUND 18446744073709551616.0
+
+static inline int32_t sat_i32(double x)
+{
+    if (isnan(x))
+        return 0;
+    if (x <= WASM_I32_MIN_BOUND)
+        return INT32_MIN;
+    if (x >= WASM_I32_MAX_BOUND)
+        return INT32_MAX;
+    return (int32_t)x;
+}
+
+static inline uint32_t sat_u32(double x)
+{
+    if (isnan(x) || x <= -1.0)
+        return 0;
+    if (x >= WASM_U32_MAX_BOUND)
+        return UINT32_MAX;
+    return (uint32_t)x;
+}
+
+static inline int64_t sat_i64(double x)
+{
+    if (isnan(x))
+        return 0;
+    if (x < -WASM_I64_MAX_BOUND)
+        return INT64_MIN;
+    if (x >= WASM_I64_MAX_BOUND)
+        return INT64_MAX;
+    return (int64_t)x;
+}
+
+static inline uint64_t sat_u64(double x)
+{
+    if (isnan(x) || x <= -1.0)
+        return 0;
+    if (x >= WASM_U64_MAX_BOUND)
+        return UINT64_MAX;
+    return (uint64_t)x;
+}
+
+/* saturating narrowing for the SIMD lane arithmetic */
+static inline int8_t sat_s8(int x)
+{
+    return x < INT8_MIN ? INT8_MIN : x > INT8_MAX ? INT8_MAX : x;
+}
+
+static inline uint8_t sat_u8(int x)
+{
+    return x < 0 ? 0 : x > UINT8_MAX ? UINT8_MAX : x;
+}
+
+static inline int16_t sat_s16(int x)
+{
+    return x < INT16_MIN ? INT16_MIN : x > INT16_MAX ? INT16_MAX : x;
+}
+
+static inline uint16_t sat_u16(int x)
+{
+    return x < 0 ? 0 : x > UINT16_MAX ? UINT16_MAX : x;
+}
+
+static int wasm_run(JSContext *ctx, WasmStack *s, WasmFunction *f,
+                    WasmValue *args)
+{
+    WasmFunction *cur = NULL, *callee;
+    WasmInstance *inst = NULL;
+    const WasmModule *m;
+    const WasmCode *code = NULL;
+    const WasmSideEntry *stp = NULL;
+    const WasmFuncType *ct;
+    const uint8_t *pc = NULL, *op_pc, *code_end = NULL;
+    WasmValue *fp = NULL, *sp, *stack_end = s->stack + WASM_STACK_SLOTS;
+    WasmValue *saved_top = s->top;
+    uint32_t base_depth = s->depth;
+    uint8_t *mem_base = NULL;
+    uint64_t mem_size = 0, ea;
+    uint32_t idx, n, offset, i, src, dst;
+    const char *trap_msg = NULL;
+    WasmTable *tab, *tab2;
+    WasmGlobal *g;
+    WasmFrame *fr;
+    int64_t r64;
+    uint8_t op;
+
+#define RELOAD_MEMORY()                                                 \
+    do {                                                                \
+        mem_base = inst->mem ? inst->mem->data : NULL;                  \
+        mem_size = inst->mem ? inst->mem->size : 0;                     \
+    } while (0)
+
+#define TRAP(msg)                                                       \
+    do {                                                                \
+        trap_msg = msg;                                                 \
+        goto trap;                                                      \
+    } while (0)
+
+#define TAKE_BRANCH(entry)                                              \
+    do {                                                                \
+        const WasmSideEntry *e_ = (entry);                              \
+        if (e_->drop) {                                                 \
+            memmove(sp - e_->keep - e_->drop, sp - e_->keep,            \
+                    e_->keep * sizeof(WasmValue));                      \
+            sp -= e_->drop;                                             \
+        }                                                               \
+        pc = op_pc + e_->pc_delta;                                      \
+        stp = e_ + e_->stp_delta;                                       \
+    } while (0)
+
+#define MEMARG()                                                        \
+    do {                                                                \
+        skip_leb(&pc);                                                  \
+        offset = leb_u32(&pc);                                          \
+    } while (0)
+
+#define LOAD(opcode, ctype, member)                                     \
+    case opcode: {                                                      \
+        ctype v_;                                                       \
+        MEMARG();                                                       \
+        ea = (uint64_t)sp[-1].u32 + offset;                             \
+        if (unlikely(ea + sizeof(ctype) > mem_size))                    \
+            TRAP("out of bounds memory access");                        \
+        memcpy(&v_, mem_base + ea, sizeof(ctype));                      \
+        sp[-1].member = v_;                                             \
+        break;                                                          \
+    }
+
+#define STORE(opcode, ctype, member)                                    \
+    case opcode: {                                                      \
+        ctype v_ = sp[-1].member;                                       \
+        MEMARG();                                                       \
+        ea = (uint64_t)sp[-2].u32 + offset;                             \
+        if (unlikely(ea + sizeof(ctype) > mem_size))                    \
+            TRAP("out of bounds memory access");                        \
+        memcpy(mem_base + ea, &v_, sizeof(ctype));                      \
+        sp -= 2;                                                        \
+        break;                                                          \
+    }
+
+#define UNOP(opcode, member, expr)                                      \
+    case opcode: {                                                      \
+        __typeof__(sp->member) a = sp[-1].member;                       \
+        (void)a;                                                        \
+        expr;                                                           \
+        break;                                                          \
+    }
+
+#define BINOP(opcode, member, res_member, expr)                         \
+    case opcode: {                                                      \
+        __typeof__(sp->member) a = sp[-2].member, b = sp[-1].member;    \
+        sp--;                                                           \
+        sp[-1].res_member = (expr);                                     \
+        break;                                                          \
+    }
+
+#define TRUNC(opcode, from, to, lo_ok, hi_bound, ctype)                 \
+    case opcode: {                                                      \
+        double x_ = sp[-1].from;                                        \
+        if (isnan(x_))                                                  \
+            TRAP("invalid conversion to integer");                      \
+        if (!(lo_ok) || x_ >= (hi_bound))                               \
+            TRAP("integer overflow");                                   \
+        sp[-1].to = (ctype)x_;                                          \
+        break;                                                          \
+    }
+
+/* v128 loads and stores, `ctype` being the memory element */
+#define V_LOAD_EXTEND(opcode, ctype, res)                               \
+    case opcode: {                                                      \
+        ctype v_[8 / sizeof(ctype)];                                    \
+        MEMARG();                                                       \
+        ea = (uint64_t)sp[-1].u32 + offset;                             \
+        if (unlikely(ea + 8 > mem_size))                                \
+            TRAP("out of bounds memory access");                        \
+        memcpy(v_, mem_base + ea, 8);                                   \
+        for (i = 0; i < countof(v_); i++)                               \
+            sp[-1].res[i] = v_[i];                                      \
+        break;                                                          \
+    }
+
+#define V_LOAD_SPLAT(opcode, ctype, res)                                \
+    case opcode: {                                                      \
+        ctype v_;                                                       \
+        MEMARG();                                                       \
+        ea = (uint64_t)sp[-1].u32 + offset;                             \
+        if (unlikely(ea + sizeof(ctype) > mem_size))                    \
+            TRAP("out of bounds memory access");                        \
+        memcpy(&v_, mem_base + ea, sizeof(ctype));                      \
+        for (i = 0; i < 16 / sizeof(ctype); i++)                        \
+            sp[-1].res[i] = v_;                                         \
+        break;                                                          \
+    }
+
+#define V_LOAD_LANE(opcode, ctype, res)                                 \
+    case opcode: {                                                      \
+        ctype v_;                                                       \
+        MEMARG();                                                       \
+        idx = *pc++;                                                    \
+        ea = (uint64_t)sp[-2].u32 + offset;                             \
+        if (unlikely(ea + sizeof(ctype) > mem_size))                    \
+            TRAP("out of bounds memory access");                        \
+        memcpy(&v_, mem_base + ea, sizeof(ctype));                      \
+        sp--;                                                           \
+        sp[-1] = sp[0];                                                 \
+        sp[-1].res[idx] = v_;                                           \
+        break;                                                          \
+    }
+
+#define V_STORE_LANE(opcode, ctype, res)                                \
+    case opcode: {                                                      \
+        ctype v_;                                                       \
+        MEMARG();                                                       \
+        v_ = sp[-1].res[*pc++];                                         \
+        ea = (uint64_t)sp[-2].u32 + offset;                             \
+        if (unlikely(ea + sizeof(ctype) > mem_size))                    \
+            TRAP("out of bounds memory access");                        \
+        memcpy(mem_base + ea, &v_, sizeof(ctype));                      \
+        sp -= 2;                                                        \
+        break;                                                          \
+    }
+
+#define V_LOAD_ZERO(opcode, ctype, res)                                 \
+    case opcode: {                                                      \
+        ctype v_;                                                       \
+        MEMARG();                                                       \
+        ea = (uint64_t)sp[-1].u32 + offset;                             \
+        if (unlikely(ea + sizeof(ctype) > mem_size))                    \
+            TRAP("out of bounds memory access");                        \
+        memcpy(&v_, mem_base + ea, sizeof(ctype));                      \
+        memset(&sp[-1], 0, sizeof(WasmValue));                          \
+        sp[-1].res[0] = v_;                                             \
+        break;                                                          \
+    }
+
+/* v128 lanes: `scalar` is the member of the scalar operand or result */
+#define V_SPLAT(opcode, scalar, res)                                    \
+    case opcode: {                                                      \
+        __typeof__(sp->scalar) a = sp[-1].scalar;                       \
+        for (i = 0; i < 16 / sizeof(sp->res[0]); i++)                   \
+            sp[-1].res[i] = a;                                          \
+        break;                                                          \
+    }
+
+#define V_EXTRACT(opcode, member, scalar)                               \
+    case opcode: {                                                      \
+        __typeof__(sp->scalar) a = sp[-1].member[*pc++];                \
+        sp[-1].scalar = a;                                              \
+        break;                                                          \
+    }
+
+#define V_REPLACE(opcode, member, scalar)                               \
+    case opcode:                                                        \
+        sp--;                                                           \
+        sp[-1].member[*pc++] = sp[0].scalar;                            \
+        break;
+
+/* v128 results computed lane by lane from the operands `x` (and `y`) */
+#define V_MAP(opcode, res, n, expr)                                     \
+    case opcode: {                                                      \
+        WasmValue x = sp[-1];                                           \
+        for (i = 0; i < (n); i++)                                       \
+            sp[-1].res[i] = (expr);                                     \
+        break;                                                          \
+    }
+
+#define V_ZIP(opcode, res, n, expr)                                     \
+    case opcode: {                                                      \
+        WasmValue x = sp[-2], y = sp[-1];                               \
+        for (i = 0; i < (n); i++)                                       \
+            sp[-2].res[i] = (expr);                                     \
+        sp--;                                                           \
+        break;                                                          \
+    }
+
+#define V_SHIFT(opcode, member, shift_op)                               \
+    case opcode:                                                        \
+        n = sp[-1].u32 & (sizeof(sp->member[0]) * 8 - 1);               \
+        sp--;                                                           \
+        sp[-1].member = sp[-1].member shift_op (int)n;                  \
+        break;
+
+#define V_ALL_TRUE(opcode, member)                                      \
+    case opcode: {                                                      \
+        WasmValue x = sp[-1];                                           \
+        for (i = 0; i < 16 / sizeof(x.member[0]) && x.member[i]; i++)   \
+            ;                                                           \
+        sp[-1].u32 = i == 16 / sizeof(x.member[0]);                     \
+        break;                                                          \
+    }
+
+#define V_BITMASK(opcode, member)                                       \
+    case opcode: {                                                      \
+        WasmValue x = sp[-1];                                           \
+        for (i = 0, n = 0; i < 16 / sizeof(x.member[0]); i++)           \
+            n |= (uint32_t)(x.member[i] < 0) << i;                      \
+        sp[-1].u32 = n;                                                 \
+        break;                                                          \
+    }
+
+    callee = f;
+    sp = args + f->type->nparams;
+
+ call:
+    /* `callee` with its arguments below `sp` */
+    while (callee->target)
+        callee = callee->target;
+    ct = callee->type;
+    if (!JS_IsUndefined(callee->host)) {
+        s->top = sp;
+        if (wasm_call_host(ctx, callee, sp - ct->nparams))
+            goto exception;
+        sp = sp - ct->nparams + ct->nresults;
+        if (!cur)
+            goto done;
+        RELOAD_MEMORY();
+        goto next;
+    }
+    if (s->depth >= WASM_MAX_FRAMES)
+        goto stack_overflow;
+    fr = &s->frames[s->depth++];
+    fr->func = cur;
+    fr->pc = pc;
+    fr->stp = stp;
+    fr->fp = fp;
+    m = callee->inst->mod;
+    code = &m->code[callee->index - m->nfunc_imports];
+    fp = sp - ct->nparams;
+    if (fp + code->nlocals + code->max_height > stack_end) {
+        s->depth--;
+        goto stack_overflow;
+    }
+    memset(sp, 0, (code->nlocals - ct->nparams) * sizeof(WasmValue));
+    sp = fp + code->nlocals;
+    cur = callee;
+    inst = cur->inst;
+    pc = m->bytes + code->body;
+    code_end = m->bytes + code->end;
+    stp = code->side;
+    RELOAD_MEMORY();
+
+ next:
+    for (;;) {
+        op_pc = pc;
+        op = *pc++;
+        switch (op) {
+        case 0x00: /* unreachable */
+            TRAP("unreachable");
+        case 0x01: /* nop */
+            break;
+        case 0x02: /* block */
+        case 0x03: /* loop */
+            skip_leb(&pc);
+            break;
+        case 0x04: /* if */
+            skip_leb(&pc);
+            if ((--sp)->i32)
+                stp++;
+            else
+                TAKE_BRANCH(stp);
+            break;
+        case 0x05: /* else: end of the then branch */
+            TAKE_BRANCH(stp);
+            break;
+        case 0x0b: /* end */
+            if (pc == code_end)
+                goto do_return;
+            break;
+        case 0x0c: /* br */
+            TAKE_BRANCH(stp);
+            break;
+        case 0x0d: /* br_if */
+            skip_leb(&pc);
+            if ((--sp)->i32)
+                TAKE_BRANCH(stp);
+            else
+                stp++;
+            break;
+        case 0x0e: /* br_table */
+            n = leb_u32(&pc);
+            idx = (--sp)->u32;
+            TAKE_BRANCH(stp + (idx < n ? idx : n));
+            break;
+        case 0x0f: /* return */
+            goto do_return;
+        case 0x10: /* call */
+            idx = leb_u32(&pc);
+            callee = &inst->funcs[idx];
+            goto call;
+        case 0x11: /* call_indirect */
+            idx = leb_u32(&pc);
+            tab = inst->tables[leb_u32(&pc)];
+            i = (--sp)->u32;
+            if (i >= tab->size)
+                TRAP("undefined element");
+            callee = tab->elems[i];
+            if (!callee)
+                TRAP("uninitialized element");
+            if (!func_type_equal(callee->type, &inst->mod->types[idx]))
+                TRAP("indirect call type mismatch");
+            goto call;
+        case 0x1a: /* drop */
+            sp--;
+            break;
+        case 0x1c: /* select t */
+            skip_leb(&pc);
+            pc++;
+            /* fall through */
+        case 0x1b: /* select */
+            sp -= 2;
+            if (!sp[1].i32)
+                sp[-1] = sp[0];
+            break;
+        case 0x20: /* local.get */
+            idx = leb_u32(&pc);
+            *sp++ = fp[idx];
+            break;
+        case 0x21: /* local.set */
+            idx = leb_u32(&pc);
+            fp[idx] = *--sp;
+            break;
+        case 0x22: /* local.tee */
+            idx = leb_u32(&pc);
+            fp[idx] = sp[-1];
+            break;
+        case 0x23: /* global.get */
+            idx = leb_u32(&pc);
+            *sp++ = inst->globals[idx]->v;
+            break;
+        case 0x24: /* global.set */
+            idx = leb_u32(&pc);
+            g = inst->globals[idx];
+            sp--;
+            if (g->type == WASM_FUNCREF) {
+                if (wasm_global_set(ctx, g, *sp))
+                    goto exception;
+            } else {
+                g->v = *sp;
+            }
+            break;
+        case 0x25: /* table.get */
+            tab = inst->tables[leb_u32(&pc)];
+            i = sp[-1].u32;
+            if (i >= tab->size)
+                TRAP("out of bounds table access");
+            sp[-1].ref = tab->elems[i];
+            break;
+        case 0x26: /* table.set */
+            tab = inst->tables[leb_u32(&pc)];
+            sp -= 2;
+            i = sp[0].u32;
+            if (i >= tab->size)
+                TRAP("out of bounds table access");
+            if (wasm_table_set(ctx, tab, i, sp[1].ref))
+                goto exception;
+            break;
+
+        LOAD(0x28, uint32_t, u32)
+        LOAD(0x29, uint64_t, u64)
+        LOAD(0x2a, float, f32)
+        LOAD(0x2b, double, f64)
+        LOAD(0x2c, int8_t, i32)
+        LOAD(0x2d, uint8_t, u32)
+        LOAD(0x2e, int16_t, i32)
+        LOAD(0x2f, uint16_t, u32)
+        LOAD(0x30, int8_t, i64)
+        LOAD(0x31, uint8_t, u64)
+        LOAD(0x32, int16_t, i64)
+        LOAD(0x33, uint16_t, u64)
+        LOAD(0x34, int32_t, i64)
+        LOAD(0x35, uint32_t, u64)
+        STORE(0x36, uint32_t, u32)
+        STORE(0x37, uint64_t, u64)
+        STORE(0x38, float, f32)
+        STORE(0x39, double, f64)
+        STORE(0x3a, uint8_t, u32)
+        STORE(0x3b, uint16_t, u32)
+        STORE(0x3c, uint8_t, u64)
+        STORE(0x3d, uint16_t, u64)
+        STORE(0x3e, uint32_t, u64)
+
+        case 0x3f: /* memory.size */
+            pc++;
+            sp->u64 = 0;
+            (sp++)->u32 = mem_size / WASM_PAGE_SIZE;
+            break;
+        case 0x40: /* memory.grow */
+            pc++;
+            sp[-1].i32 = wasm_memory_grow(ctx, inst->mem, sp[-1].u32);
+            RELOAD_MEMORY();
+            break;
+        case 0x41: /* i32.const */
+            sp->u64 = 0;
+            (sp++)->i32 = leb_s64(&pc);
+            break;
+        case 0x42: /* i64.const */
+            (sp++)->i64 = leb_s64(&pc);
+            break;
+        case 0x43: /* f32.const */
+            sp->u64 = 0;
+            memcpy(&(sp++)->f32, pc, 4);
+            pc += 4;
+            break;
+        case 0x44: /* f64.const */
+            memcpy(&(sp++)->f64, pc, 8);
+            pc += 8;
+            break;
+
+        UNOP(0x45, u32, sp[-1].u32 = a == 0)
+        BINOP(0x46, u32, u32, a == b)
+        BINOP(0x47, u32, u32, a != b)
+        BINOP(0x48, i32, u32, a < b)
+        BINOP(0x49, u32, u32, a < b)
+        BINOP(0x4a, i32, u32, a > b)
+        BINOP(0x4b, u32, u32, a > b)
+        BINOP(0x4c, i32, u32, a <= b)
+        BINOP(0x4d, u32, u32, a <= b)
+        BINOP(0x4e, i32, u32, a >= b)
+        BINOP(0x4f, u32, u32, a >= b)
+
+        UNOP(0x50, u64, sp[-1].u32 = a == 0)
+        BINOP(0x51, u64, u32, a == b)
+        BINOP(0x52, u64, u32, a != b)
+        BINOP(0x53, i64, u32, a < b)
+        BINOP(0x54, u64, u32, a < b)
+        BINOP(0x55, i64, u32, a > b)
+        BINOP(0x56, u64, u32, a > b)
+        BINOP(0x57, i64, u32, a <= b)
+        BINOP(0x58, u64, u32, a <= b)
+        BINOP(0x59, i64, u32, a >= b)
+        BINOP(0x5a, u64, u32, a >= b)
+
+        BINOP(0x5b, f32, u32, a == b)
+        BINOP(0x5c, f32, u32, a != b)
+        BINOP(0x5d, f32, u32, a < b)
+        BINOP(0x5e, f32, u32, a > b)
+        BINOP(0x5f, f32, u32, a <= b)
+        BINOP(0x60, f32, u32, a >= b)
+        BINOP(0x61, f64, u32, a == b)
+        BINOP(0x62, f64, u32, a != b)
+        BINOP(0x63, f64, u32, a < b)
+        BINOP(0x64, f64, u32, a > b)
+        BINOP(0x65, f64, u32, a <= b)
+        BINOP(0x66, f64, u32, a >= b)
+
+        UNOP(0x67, u32, sp[-1].u32 = a ? __builtin_clz(a) : 32)
+        UNOP(0x68, u32, sp[-1].u32 = a ? __builtin_ctz(a) : 32)
+        UNOP(0x69, u32, sp[-1].u32 = __builtin_popcount(a))
+        BINOP(0x6a, u32, u32, a + b)
+        BINOP(0x6b, u32, u32, a - b)
+        BINOP(0x6c, u32, u32, a * b)
+        case 0x6d: /* i32.div_s */
+            if (sp[-1].i32 == 0)
+                TRAP("integer divide by zero");
+            if (sp[-2].i32 == INT32_MIN && sp[-1].i32 == -1)
+                TRAP("integer overflow");
+            sp[-2].i32 /= sp[-1].i32;
+            sp--;
+            break;
+        case 0x6e: /* i32.div_u */
+            if (sp[-1].u32 == 0)
+                TRAP("integer divide by zero");
+            sp[-2].u32 /= sp[-1].u32;
+            sp--;
+            break;
+        case 0x6f: /* i32.rem_s */
+            if (sp[-1].i32 == 0)
+                TRAP("integer divide by zero");
+            sp[-2].i32 = sp[-1].i32 == -1 ? 0 : sp[-2].i32 % sp[-1].i32;
+            sp--;
+            break;
+        case 0x70: /* i32.rem_u */
+            if (sp[-1].u32 == 0)
+                TRAP("integer divide by zero");
+            sp[-2].u32 %= sp[-1].u32;
+            sp--;
+            break;
+        BINOP(0x71, u32, u32, a & b)
+        BINOP(0x72, u32, u32, a | b)
+        BINOP(0x73, u32, u32, a ^ b)
+        BINOP(0x74, u32, u32, a << (b & 31))
+        BINOP(0x75, i32, i32, a >> (b & 31))
+        BINOP(0x76, u32, u32, a >> (b & 31))
+        BINOP(0x77, u32, u32, (a << (b & 31)) | (a >> (-b & 31)))
+        BINOP(0x78, u32, u32, (a >> (b & 31)) | (a << (-b & 31)))
+
+        UNOP(0x79, u64, sp[-1].u64 = a ? __builtin_clzll(a) : 64)
+        UNOP(0x7a, u64, sp[-1].u64 = a ? __builtin_ctzll(a) : 64)
+        UNOP(0x7b, u64, sp[-1].u64 = __builtin_popcountll(a))
+        BINOP(0x7c, u64, u64, a + b)
+        BINOP(0x7d, u64, u64, a - b)
+        BINOP(0x7e, u64, u64, a * b)
+        case 0x7f: /* i64.div_s */
+            if (sp[-1].i64 == 0)
+                TRAP("integer divide by zero");
+            if (sp[-2].i64 == INT64_MIN && sp[-1].i64 == -1)
+                TRAP("integer overflow");
+            sp[-2].i64 /= sp[-1].i64;
+            sp--;
+            break;
+        case 0x80: /* i64.div_u */
+            if (sp[-1].u64 == 0)
+                TRAP("integer divide by zero");
+            sp[-2].u64 /= sp[-1].u64;
+            sp--;
+            break;
+        case 0x81: /* i64.rem_s */
+            if (sp[-1].i64 == 0)
+                TRAP("integer divide by zero");
+            sp[-2].i64 = sp[-1].i64 == -1 ? 0 : sp[-2].i64 % sp[-1].i64;
+            sp--;
+            break;
+        case 0x82: /* i64.rem_u */
+            if (sp[-1].u64 == 0)
+                TRAP("integer divide by zero");
+            sp[-2].u64 %= sp[-1].u64;
+            sp--;
+            break;
+        BINOP(0x83, u64, u64, a & b)
+        BINOP(0x84, u64, u64, a | b)
+        BINOP(0x85, u64, u64, a ^ b)
+        BINOP(0x86, u64, u64, a << (b & 63))
+        BINOP(0x87, i64, i64, a >> (b & 63))
+        BINOP(0x88, u64, u64, a >> (b & 63))
+        BINOP(0x89, u64, u64, (a << (b & 63)) | (a >> (-b & 63)))
+        BINOP(0x8a, u64, u64, (a >> (b & 63)) | (a << (-b & 63)))
+
+        UNOP(0x8b, u32, sp[-1].u32 = a & 0x7fffffff)
+        UNOP(0x8c, u32, sp[-1].u32 = a ^ 0x80000000)
+        UNOP(0x8d, f32, sp[-1].f32 = ceilf(a))
+        UNOP(0x8e, f32, sp[-1].f32 = floorf(a))
+        UNOP(0x8f, f32, sp[-1].f32 = truncf(a))
+        UNOP(0x90, f32, sp[-1].f32 = nearbyintf(a))
+        UNOP(0x91, f32, sp[-1].f32 = sqrtf(a))
+        BINOP(0x92, f32, f32, a + b)
+        BINOP(0x93, f32, f32, a - b)
+        BINOP(0x94, f32, f32, a * b)
+        BINOP(0x95, f32, f32, a / b)
+        BINOP(0x96, f32, f32, wasm_fminf(a, b))
+        BINOP(0x97, f32, f32, wasm_fmaxf(a, b))
+        BINOP(0x98, u32, u32, (a & 0x7fffffff) | (b & 0x80000000))
+
+        UNOP(0x99, u64, sp[-1].u64 = a & ~((uint64_t)1 << 63))
+        UNOP(0x9a, u64, sp[-1].u64 = a ^ ((uint64_t)1 << 63))
+        UNOP(0x9b, f64, sp[-1].f64 = ceil(a))
+        UNOP(0x9c, f64, sp[-1].f64 = floor(a))
+        UNOP(0x9d, f64, sp[-1].f64 = trunc(a))
+        UNOP(0x9e, f64, sp[-1].f64 = nearbyint(a))
+        UNOP(0x9f, f64, sp[-1].f64 = sqrt(a))
+        BINOP(0xa0, f64, f64, a + b)
+        BINOP(0xa1, f64, f64, a - b)
+        BINOP(0xa2, f64, f64, a * b)
+        BINOP(0xa3, f64, f64, a / b)
+        BINOP(0xa4, f64, f64, wasm_fmin(a, b))
+        BINOP(0xa5, f64, f64, wasm_fmax(a, b))
+        BINOP(0xa6, u64, u64, (a & ~((uint64_t)1 << 63)) | (b & ((uint64_t)1 << 63)))
+
+        UNOP(0xa7, u64, sp[-1].u64 = (uint32_t)a)
+        TRUNC(0xa8, f32, i32, x_ > WASM_I32_MIN_BOUND, WASM_I32_MAX_BOUND, int32_t)
+        TRUNC(0xa9, f32, u32, x_ > -1.0, WASM_U32_MAX_BOUND, uint32_t)
+        TRUNC(0xaa, f64, i32, x_ > WASM_I32_MIN_BOUND, WASM_I32_MAX_BOUND, int32_t)
+        TRUNC(0xab, f64, u32, x_ > -1.0, WASM_U32_MAX_BOUND, uint32_t)
+        UNOP(0xac, i32, sp[-1].i64 = a)
+        UNOP(0xad, u32, sp[-1].u64 = a)
+        TRUNC(0xae, f32, i64, x_ >= -WASM_I64_MAX_BOUND, WASM_I64_MAX_BOUND, int64_t)
+        TRUNC(0xaf, f32, u64, x_ > -1.0, WASM_U64_MAX_BOUND, uint64_t)
+        TRUNC(0xb0, f64, i64, x_ >= -WASM_I64_MAX_BOUND, WASM_I64_MAX_BOUND, int64_t)
+        TRUNC(0xb1, f64, u64, x_ > -1.0, WASM_U64_MAX_BOUND, uint64_t)
+        UNOP(0xb2, i32, sp[-1].f32 = (float)a)
+        UNOP(0xb3, u32, sp[-1].f32 = (float)a)
+        UNOP(0xb4, i64, sp[-1].f32 = (float)a)
+        UNOP(0xb5, u64, sp[-1].f32 = (float)a)
+        UNOP(0xb6, f64, sp[-1].f32 = (float)a)
+        UNOP(0xb7, i32, sp[-1].f64 = (double)a)
+        UNOP(0xb8, u32, sp[-1].f64 = (double)a)
+        UNOP(0xb9, i64, sp[-1].f64 = (double)a)
+        UNOP(0xba, u64, sp[-1].f64 = (double)a)
+        UNOP(0xbb, f32, sp[-1].f64 = (double)a)
+        case 0xbc ... 0xbf: /* reinterpret: the slot already has the bits */
+            break;
+
+        UNOP(0xc0, u32, sp[-1].i32 = (int8_t)a)
+        UNOP(0xc1, u32, sp[-1].i32 = (int16_t)a)
+        UNOP(0xc2, u64, sp[-1].i64 = (int8_t)a)
+        UNOP(0xc3, u64, sp[-1].i64 = (int16_t)a)
+        UNOP(0xc4, u64, sp[-1].i64 = (int32_t)a)
+
+        case 0xd0: /* ref.null */
+            pc++;
+            (sp++)->ref = NULL;
+            break;
+        case 0xd1: /* ref.is_null */
+            sp[-1].u64 = sp[-1].ref == NULL;
+            break;
+        case 0xd2: /* ref.func */
+            (sp++)->ref = &inst->funcs[leb_u32(&pc)];
+            break;
+
+        case 0xfc:
+            switch (leb_u32(&pc)) {
+            UNOP(0, f32, sp[-1].i32 = sat_i32(a))
+            UNOP(1, f32, sp[-1].u32 = sat_u32(a))
+            UNOP(2, f64, sp[-1].i32 = sat_i32(a))
+            UNOP(3, f64, sp[-1].u32 = sat_u32(a))
+            UNOP(4, f32, sp[-1].i64 = sat_i64(a))
+            UNOP(5, f32, sp[-1].u64 = sat_u64(a))
+            UNOP(6, f64, sp[-1].i64 = sat_i64(a))
+            UNOP(7, f64, sp[-1].u64 = sat_u64(a))
+            case 8: { /* memory.init */
+                const WasmData *d;
+                idx = leb_u32(&pc);
+                pc++;
+                sp -= 3;
+                d = &inst->mod->datas[idx];
+                dst = sp[0].u32;
+                src = sp[1].u32;
+                n = sp[2].u32;
+                if ((uint64_t)src + n > (inst->data_dropped[idx] ? 0 : d->size) ||
+                    (uint64_t)dst + n > mem_size)
+                    TRAP("out of bounds memory access");
+                memcpy(mem_base + dst, inst->mod->bytes + d->data + src, n);
+                break;
+            }
+            case 9: /* data.drop */
+                inst->data_dropped[leb_u32(&pc)] = 1;
+                break;
+            case 10: /* memory.copy */
+                pc += 2;
+                sp -= 3;
+                dst = sp[0].u32;
+                src = sp[1].u32;
+                n = sp[2].u32;
+                if ((uint64_t)src + n > mem_size || (uint64_t)dst + n > mem_size)
+                    TRAP("out of bounds memory access");
+                memmove(mem_base + dst, mem_base + src, n);
+                break;
+            case 11: /* memory.fill */
+                pc++;
+                sp -= 3;
+                dst = sp[0].u32;
+                n = sp[2].u32;
+                if ((uint64_t)dst + n > mem_size)
+                    TRAP("out of bounds memory access");
+                memset(mem_base + dst, sp[1].u32 & 0xff, n);
+                break;
+            case 12: { /* table.init */
+                const WasmElem *el;
+                idx = leb_u32(&pc);
+                tab = inst->tables[leb_u32(&pc)];
+                sp -= 3;
+                el = &inst->mod->elems[idx];
+                dst = sp[0].u32;
+                src = sp[1].u32;
+                n = sp[2].u32;
+                if ((uint64_t)src + n > (inst->elem_dropped[idx] ? 0 : el->count) ||
+                    (uint64_t)dst + n > tab->size)
+                    TRAP("out of bounds table access");
+                for (i = 0; i < n; i++) {
+                    int32_t fi = el->funcs[src + i];
+                    if (wasm_table_set(ctx, tab, dst + i,
+                                       fi < 0 ? NULL : &inst->funcs[fi]))
+                        goto exception;
+                }
+                break;
+            }
+            case 13: /* elem.drop */
+                inst->elem_dropped[leb_u32(&pc)] = 1;
+                break;
+            case 14: /* table.copy */
+                tab = inst->tables[leb_u32(&pc)];
+                tab2 = inst->tables[leb_u32(&pc)];
+                sp -= 3;
+                dst = sp[0].u32;
+                src = sp[1].u32;
+                n = sp[2].u32;
+                if ((uint64_t)src + n > tab2->size || (uint64_t)dst + n > tab->size)
+                    TRAP("out of bounds table access");
+                if (tab == tab2 && dst > src) {
+                    for (i = n; i-- > 0;) {
+                        if (wasm_table_set(ctx, tab, dst + i, tab2->elems[src + i]))
+                            goto exception;
+                    }
+                } else {
+                    for (i = 0; i < n; i++) {
+                        if (wasm_table_set(ctx, tab, dst + i, tab2->elems[src + i]))
+                            goto exception;
+                    }
+                }
+                break;
+            case 15: /* table.grow */
+                tab = inst->tables[leb_u32(&pc)];
+                sp--;
+                r64 = wasm_table_grow(ctx, tab, sp[0].u32, sp[-1].ref);
+                if (r64 == -2)
+                    goto exception;
+                sp[-1].u64 = 0;
+                sp[-1].i32 = r64;
+                break;
+            case 16: /* table.size */
+                tab = inst->tables[leb_u32(&pc)];
+                sp->u64 = 0;
+                (sp++)->u32 = tab->size;
+                break;
+            case 17: /* table.fill */
+                tab = inst->tables[leb_u32(&pc)];
+                sp -= 3;
+                dst = sp[0].u32;
+                n = sp[2].u32;
+                if ((uint64_t)dst + n > tab->size)
+                    TRAP("out of bounds table access");
+                for (i = 0; i < n; i++) {
+                    if (wasm_table_set(ctx, tab, dst + i, sp[1].ref))
+                        goto exception;
+                }
+                break;
+            default:
+                abort(); /* rejected by the validator */
+            }
+            break;
+
+        case 0xfd:
+            switch (leb_u32(&pc)) {
+            case 0: /* v128.load */
+                MEMARG();
+                ea = (uint64_t)sp[-1].u32 + offset;
+                if (unlikely(ea + 16 > mem_size))
+                    TRAP("out of bounds memory access");
+                memcpy(&sp[-1], mem_base + ea, 16);
+                break;
+            V_LOAD_EXTEND(1, int8_t, i16x8)
+            V_LOAD_EXTEND(2, uint8_t, u16x8)
+            V_LOAD_EXTEND(3, int16_t, i32x4)
+            V_LOAD_EXTEND(4, uint16_t, u32x4)
+            V_LOAD_EXTEND(5, int32_t, i64x2)
+            V_LOAD_EXTEND(6, uint32_t, u64x2)
+            V_LOAD_SPLAT(7, uint8_t, u8x16)
+            V_LOAD_SPLAT(8, uint16_t, u16x8)
+            V_LOAD_SPLAT(9, uint32_t, u32x4)
+            V_LOAD_SPLAT(10, uint64_t, u64x2)
+            case 11: /* v128.store */
+                MEMARG();
+                ea = (uint64_t)sp[-2].u32 + offset;
+                if (unlikely(ea + 16 > mem_size))
+                    TRAP("out of bounds memory access");
+                memcpy(mem_base + ea, &sp[-1], 16);
+                sp -= 2;
+                break;
+            case 12: /* v128.const */
+                memcpy(sp++, pc, 16);
+                pc += 16;
+                break;
+            case 13: { /* i8x16.shuffle */
+                WasmValue x = sp[-2], y = sp[-1];
+                for (i = 0; i < 16; i++)
+                    sp[-2].u8x16[i] = pc[i] < 16 ? x.u8x16[pc[i]] : y.u8x16[pc[i] - 16];
+                pc += 16;
+                sp--;
+                break;
+            }
+            V_ZIP(14, u8x16, 16, y.u8x16[i] < 16 ? x.u8x16[y.u8x16[i]] : 0)
+            V_SPLAT(15, u32, u8x16)
+            V_SPLAT(16, u32, u16x8)
+            V_SPLAT(17, u32, u32x4)
+            V_SPLAT(18, u64, u64x2)
+            V_SPLAT(19, f32, f32x4)
+            V_SPLAT(20, f64, f64x2)
+            V_EXTRACT(21, i8x16, i32)
+            V_EXTRACT(22, u8x16, u32)
+            V_REPLACE(23, u8x16, u32)
+            V_EXTRACT(24, i16x8, i32)
+            V_EXTRACT(25, u16x8, u32)
+            V_REPLACE(26, u16x8, u32)
+            V_EXTRACT(27, u32x4, u32)
+            V_REPLACE(28, u32x4, u32)
+            V_EXTRACT(29, u64x2, u64)
+            V_REPLACE(30, u64x2, u64)
+            V_EXTRACT(31, f32x4, f32)
+            V_REPLACE(32, f32x4, f32)
+            V_EXTRACT(33, f64x2, f64)
+            V_REPLACE(34, f64x2, f64)
+
+            /* comparisons: vector operators give all-ones lanes for true */
+            BINOP(35, i8x16, i8x16, a == b)
+            BINOP(36, i8x16, i8x16, a != b)
+            BINOP(37, i8x16, i8x16, a < b)
+            BINOP(38, u8x16, i8x16, a < b)
+            BINOP(39, i8x16, i8x16, a > b)
+            BINOP(40, u8x16, i8x16, a > b)
+            BINOP(41, i8x16, i8x16, a <= b)
+            BINOP(42, u8x16, i8x16, a <= b)
+            BINOP(43, i8x16, i8x16, a >= b)
+            BINOP(44, u8x16, i8x16, a >= b)
+            BINOP(45, i16x8, i16x8, a == b)
+            BINOP(46, i16x8, i16x8, a != b)
+            BINOP(47, i16x8, i16x8, a < b)
+            BINOP(48, u16x8, i16x8, a < b)
+            BINOP(49, i16x8, i16x8, a > b)
+            BINOP(50, u16x8, i16x8, a > b)
+            BINOP(51, i16x8, i16x8, a <= b)
+            BINOP(52, u16x8, i16x8, a <= b)
+            BINOP(53, i16x8, i16x8, a >= b)
+            BINOP(54, u16x8, i16x8, a >= b)
+            BINOP(55, i32x4, i32x4, a == b)
+            BINOP(56, i32x4, i32x4, a != b)
+            BINOP(57, i32x4, i32x4, a < b)
+            BINOP(58, u32x4, i32x4, a < b)
+            BINOP(59, i32x4, i32x4, a > b)
+            BINOP(60, u32x4, i32x4, a > b)
+            BINOP(61, i32x4, i32x4, a <= b)
+            BINOP(62, u32x4, i32x4, a <= b)
+            BINOP(63, i32x4, i32x4, a >= b)
+            BINOP(64, u32x4, i32x4, a >= b)
+            BINOP(65, f32x4, i32x4, a == b)
+            BINOP(66, f32x4, i32x4, a != b)
+            BINOP(67, f32x4, i32x4, a < b)
+            BINOP(68, f32x4, i32x4, a > b)
+            BINOP(69, f32x4, i32x4, a <= b)
+            BINOP(70, f32x4, i32x4, a >= b)
+            BINOP(71, f64x2, i64x2, a == b)
+            BINOP(72, f64x2, i64x2, a != b)
+            BINOP(73, f64x2, i64x2, a < b)
+            BINOP(74, f64x2, i64x2, a > b)
+            BINOP(75, f64x2, i64x2, a <= b)
+            BINOP(76, f64x2, i64x2, a >= b)
+
+            UNOP(77, u64x2, sp[-1].u64x2 = ~a)
+            BINOP(78, u64x2, u64x2, a & b)
+            BINOP(79, u64x2, u64x2, a & ~b)
+            BINOP(80, u64x2, u64x2, a | b)
+            BINOP(81, u64x2, u64x2, a ^ b)
+            case 82: /* v128.bitselect */
+                sp -= 2;
+                sp[-1].u64x2 = (sp[-1].u64x2 & sp[1].u64x2) |
+                    (sp[0].u64x2 & ~sp[1].u64x2);
+                break;
+            UNOP(83, u64x2, sp[-1].u32 = (a[0] | a[1]) != 0)
+            V_LOAD_LANE(84, uint8_t, u8x16)
+            V_LOAD_LANE(85, uint16_t, u16x8)
+            V_LOAD_LANE(86, uint32_t, u32x4)
+            V_LOAD_LANE(87, uint64_t, u64x2)
+            V_STORE_LANE(88, uint8_t, u8x16)
+            V_STORE_LANE(89, uint16_t, u16x8)
+            V_STORE_LANE(90, uint32_t, u32x4)
+            V_STORE_LANE(91, uint64_t, u64x2)
+            V_LOAD_ZERO(92, uint32_t, u32x4)
+            V_LOAD_ZERO(93, uint64_t, u64x2)
+            V_MAP(94, f32x4, 4, i < 2 ? (float)x.f64x2[i] : 0)
+            V_MAP(95, f64x2, 2, x.f32x4[i])
+
+            V_MAP(96, u8x16, 16, x.i8x16[i] < 0 ? -x.u8x16[i] : x.u8x16[i])
+            UNOP(97, u8x16, sp[-1].u8x16 = -a)
+            V_MAP(98, u8x16, 16, __builtin_popcount(x.u8x16[i]))
+            V_ALL_TRUE(99, u8x16)
+            V_BITMASK(100, i8x16)
+            V_ZIP(101, i8x16, 16, sat_s8(i < 8 ? x.i16x8[i] : y.i16x8[i - 8]))
+            V_ZIP(102, u8x16, 16, sat_u8(i < 8 ? x.i16x8[i] : y.i16x8[i - 8]))
+            V_MAP(103, f32x4, 4, ceilf(x.f32x4[i]))
+            V_MAP(104, f32x4, 4, floorf(x.f32x4[i]))
+            V_MAP(105, f32x4, 4, truncf(x.f32x4[i]))
+            V_MAP(106, f32x4, 4, nearbyintf(x.f32x4[i]))
+            V_SHIFT(107, u8x16, <<)
+            V_SHIFT(108, i8x16, >>)
+            V_SHIFT(109, u8x16, >>)
+            BINOP(110, u8x16, u8x16, a + b)
+            V_ZIP(111, i8x16, 16, sat_s8(x.i8x16[i] + y.i8x16[i]))
+            V_ZIP(112, u8x16, 16, sat_u8(x.u8x16[i] + y.u8x16[i]))
+            BINOP(113, u8x16, u8x16, a - b)
+            V_ZIP(114, i8x16, 16, sat_s8(x.i8x16[i] - y.i8x16[i]))
+            V_ZIP(115, u8x16, 16, sat_u8(x.u8x16[i] - y.u8x16[i]))
+            V_MAP(116, f64x2, 2, ceil(x.f64x2[i]))
+            V_MAP(117, f64x2, 2, floor(x.f64x2[i]))
+            V_ZIP(118, i8x16, 16, min_int(x.i8x16[i], y.i8x16[i]))
+            V_ZIP(119, u8x16, 16, min_int(x.u8x16[i], y.u8x16[i]))
+            V_ZIP(120, i8x16, 16, max_int(x.i8x16[i], y.i8x16[i]))
+            V_ZIP(121, u8x16, 16, max_int(x.u8x16[i], y.u8x16[i]))
+            V_MAP(122, f64x2, 2, trunc(x.f64x2[i]))
+            V_ZIP(123, u8x16, 16, (x.u8x16[i] + y.u8x16[i] + 1) >> 1)
+            V_MAP(124, i16x8, 8, x.i8x16[2 * i] + x.i8x16[2 * i + 1])
+            V_MAP(125, u16x8, 8, x.u8x16[2 * i] + x.u8x16[2 * i + 1])
+            V_MAP(126, i32x4, 4, x.i16x8[2 * i] + x.i16x8[2 * i + 1])
+            V_MAP(127, u32x4, 4, x.u16x8[2 * i] + x.u16x8[2 * i + 1])
+
+            V_MAP(128, u16x8, 8, x.i16x8[i] < 0 ? -x.u16x8[i] : x.u16x8[i])
+            UNOP(129, u16x8, sp[-1].u16x8 = -a)
+            V_ZIP(130, i16x8, 8, sat_s16((x.i16x8[i] * y.i16x8[i] + 0x4000) >> 15))
+            V_ALL_TRUE(131, u16x8)
+            V_BITMASK(132, i16x8)
+            V_ZIP(133, i16x8, 8, sat_s16(i < 4 ? x.i32x4[i] : y.i32x4[i - 4]))
+            V_ZIP(134, u16x8, 8, sat_u16(i < 4 ? x.i32x4[i] : y.i32x4[i - 4]))
+            V_MAP(135, i16x8, 8, x.i8x16[i])
+            V_MAP(136, i16x8, 8, x.i8x16[i + 8])
+            V_MAP(137, u16x8, 8, x.u8x16[i])
+            V_MAP(138, u16x8, 8, x.u8x16[i + 8])
+            V_SHIFT(139, u16x8, <<)
+            V_SHIFT(140, i16x8, >>)
+            V_SHIFT(141, u16x8, >>)
+            BINOP(142, u16x8, u16x8, a + b)
+            V_ZIP(143, i16x8, 8, sat_s16(x.i16x8[i] + y.i16x8[i]))
+            V_ZIP(144, u16x8, 8, sat_u16(x.u16x8[i] + y.u16x8[i]))
+            BINOP(145, u16x8, u16x8, a - b)
+            V_ZIP(146, i16x8, 8, sat_s16(x.i16x8[i] - y.i16x8[i]))
+            V_ZIP(147, u16x8, 8, sat_u16(x.u16x8[i] - y.u16x8[i]))
+            V_MAP(148, f64x2, 2, nearbyint(x.f64x2[i]))
+            BINOP(149, u16x8, u16x8, a * b)
+            V_ZIP(150, i16x8, 8, min_int(x.i16x8[i], y.i16x8[i]))
+            V_ZIP(151, u16x8, 8, min_int(x.u16x8[i], y.u16x8[i]))
+            V_ZIP(152, i16x8, 8, max_int(x.i16x8[i], y.i16x8[i]))
+            V_ZIP(153, u16x8, 8, max_int(x.u16x8[i], y.u16x8[i]))
+            V_ZIP(155, u16x8, 8, (x.u16x8[i] + y.u16x8[i] + 1) >> 1)
+            V_ZIP(156, i16x8, 8, x.i8x16[i] * y.i8x16[i])
+            V_ZIP(157, i16x8, 8, x.i8x16[i + 8] * y.i8x16[i + 8])
+            V_ZIP(158, u16x8, 8, x.u8x16[i] * y.u8x16[i])
+            V_ZIP(159, u16x8, 8, x.u8x16[i + 8] * y.u8x16[i + 8])
+
+            V_MAP(160, u32x4, 4, x.i32x4[i] < 0 ? -x.u32x4[i] : x.u32x4[i])
+            UNOP(161, u32x4, sp[-1].u32x4 = -a)
+            V_ALL_TRUE(163, u32x4)
+            V_BITMASK(164, i32x4)
+            V_MAP(167, i32x4, 4, x.i16x8[i])
+            V_MAP(168, i32x4, 4, x.i16x8[i + 4])
+            V_MAP(169, u32x4, 4, x.u16x8[i])
+            V_MAP(170, u32x4, 4, x.u16x8[i + 4])
+            V_SHIFT(171, u32x4, <<)
+            V_SHIFT(172, i32x4, >>)
+            V_SHIFT(173, u32x4, >>)
+            BINOP(174, u32x4, u32x4, a + b)
+            BINOP(177, u32x4, u32x4, a - b)
+            BINOP(181, u32x4, u32x4, a * b)
+            V_ZIP(182, i32x4, 4, min_int(x.i32x4[i], y.i32x4[i]))
+            V_ZIP(183, u32x4, 4, min_uint32(x.u32x4[i], y.u32x4[i]))
+            V_ZIP(184, i32x4, 4, max_int(x.i32x4[i], y.i32x4[i]))
+            V_ZIP(185, u32x4, 4, max_uint32(x.u32x4[i], y.u32x4[i]))
+            /* the products fit an int, their sum only wraps in 32 bits */
+            V_ZIP(186, u32x4, 4, (uint32_t)(x.i16x8[2 * i] * y.i16x8[2 * i]) +
+                  (uint32_t)(x.i16x8[2 * i + 1] * y.i16x8[2 * i + 1]))
+            V_ZIP(188, i32x4, 4, x.i16x8[i] * y.i16x8[i])
+            V_ZIP(189, i32x4, 4, x.i16x8[i + 4] * y.i16x8[i + 4])
+            V_ZIP(190, u32x4, 4, (uint32_t)x.u16x8[i] * y.u16x8[i])
+            V_ZIP(191, u32x4, 4, (uint32_t)x.u16x8[i + 4] * y.u16x8[i + 4])
+
+            V_MAP(192, u64x2, 2, x.i64x2[i] < 0 ? -x.u64x2[i] : x.u64x2[i])
+            UNOP(193, u64x2, sp[-1].u64x2 = -a)
+            V_ALL_TRUE(195, u64x2)
+            V_BITMASK(196, i64x2)
+            V_MAP(199, i64x2, 2, x.i32x4[i])
+            V_MAP(200, i64x2, 2, x.i32x4[i + 2])
+            V_MAP(201, u64x2, 2, x.u32x4[i])
+            V_MAP(202, u64x2, 2, x.u32x4[i + 2])
+            V_SHIFT(203, u64x2, <<)
+            V_SHIFT(204, i64x2, >>)
+            V_SHIFT(205, u64x2, >>)
+            BINOP(206, u64x2, u64x2, a + b)
+            BINOP(209, u64x2, u64x2, a - b)
+            BINOP(213, u64x2, u64x2, a * b)
+            BINOP(214, i64x2, i64x2, a == b)
+            BINOP(215, i64x2, i64x2, a != b)
+            BINOP(216, i64x2, i64x2, a < b)
+            BINOP(217, i64x2, i64x2, a > b)
+            BINOP(218, i64x2, i64x2, a <= b)
+            BINOP(219, i64x2, i64x2, a >= b)
+            V_ZIP(220, i64x2, 2, (int64_t)x.i32x4[i] * y.i32x4[i])
+            V_ZIP(221, i64x2, 2, (int64_t)x.i32x4[i + 2] * y.i32x4[i + 2])
+            V_ZIP(222, u64x2, 2, (uint64_t)x.u32x4[i] * y.u32x4[i])
+            V_ZIP(223, u64x2, 2, (uint64_t)x.u32x4[i + 2] * y.u32x4[i + 2])
+
+            UNOP(224, u32x4, sp[-1].u32x4 = a & 0x7fffffff)
+            UNOP(225, u32x4, sp[-1].u32x4 = a ^ 0x80000000)
+            V_MAP(227, f32x4, 4, sqrtf(x.f32x4[i]))
+            BINOP(228, f32x4, f32x4, a + b)
+            BINOP(229, f32x4, f32x4, a - b)
+            BINOP(230, f32x4, f32x4, a * b)
+            BINOP(231, f32x4, f32x4, a / b)
+            V_ZIP(232, f32x4, 4, wasm_fminf(x.f32x4[i], y.f32x4[i]))
+            V_ZIP(233, f32x4, 4, wasm_fmaxf(x.f32x4[i], y.f32x4[i]))
+            V_ZIP(234, f32x4, 4, y.f32x4[i] < x.f32x4[i] ? y.f32x4[i] : x.f32x4[i])
+            V_ZIP(235, f32x4, 4, x.f32x4[i] < y.f32x4[i] ? y.f32x4[i] : x.f32x4[i])
+            UNOP(236, u64x2, sp[-1].u64x2 = a & ~((uint64_t)1 << 63))
+            UNOP(237, u64x2, sp[-1].u64x2 = a ^ ((uint64_t)1 << 63))
+            V_MAP(239, f64x2, 2, sqrt(x.f64x2[i]))
+            BINOP(240, f64x2, f64x2, a + b)
+            BINOP(241, f64x2, f64x2, a - b)
+            BINOP(242, f64x2, f64x2, a * b)
+            BINOP(243, f64x2, f64x2, a / b)
+            V_ZIP(244, f64x2, 2, wasm_fmin(x.f64x2[i], y.f64x2[i]))
+            V_ZIP(245, f64x2, 2, wasm_fmax(x.f64x2[i], y.f64x2[i]))
+            V_ZIP(246, f64x2, 2, y.f64x2[i] < x.f64x2[i] ? y.f64x2[i] : x.f64x2[i])
+            V_ZIP(247, f64x2, 2, x.f64x2[i] < y.f64x2[i] ? y.f64x2[i] : x.f64x2[i])
+            V_MAP(248, i32x4, 4, sat_i32(x.f32x4[i]))
+            V_MAP(249, u32x4, 4, sat_u32(x.f32x4[i]))
+            V_MAP(250, f32x4, 4, (float)x.i32x4[i])
+            V_MAP(251, f32x4, 4, (float)x.u32x4[i])
+            V_MAP(252, i32x4, 4, i < 2 ? sat_i32(x.f64x2[i]) : 0)
+            V_MAP(253, u32x4, 4, i < 2 ? sat_u32(x.f64x2[i]) : 0)
+            V_MAP(254, f64x2, 2, (double)x.i32x4[i])
+            V_MAP(255, f64x2, 2, (double)x.u32x4[i])
+            default:
+                abort(); /* rejected by the validator */
+            }
+            break;
+        default:
+            abort(); /* rejected by the validator */
+        }
+        continue;
+
+    do_return:
+        n = cur->type->nresults;
+        memmove(fp, sp - n, n * sizeof(WasmValue));
+        sp = fp + n;
+        fr = &s->frames[--s->depth];
+        cur = fr->func;
+        if (!cur)
+            goto done;
+        pc = fr->pc;
+        stp = fr->stp;
+        fp = fr->fp;
+        inst = cur->inst;
+        m = inst->mod;
+        code = &m->code[cur->index - m->nfunc_imports];
+        code_end = m->bytes + code->end;
+        RELOAD_MEMORY();
+    }
+
+ stack_overflow:
+    JS_ThrowRangeError(ctx, "Maximum call stack size exceeded");
+    goto exception;
+ trap:
+    wasm_throw(ctx, WASM_RUNTIME_ERROR, "%s", trap_msg);
+ exception:
+    s->depth = base_depth;
+    s->top = saved_top;
+    return -1;
+ done:
+    s->top = saved_top;
+    return 0;
+
+#undef RELOAD_MEMORY
+#undef TRAP
+#undef TAKE_BRANCH
+#undef MEMARG
+#undef LOAD
+#undef STORE
+#undef UNOP
+#undef BINOP
+#undef TRUNC
+#undef V_LOAD_EXTEND
+#undef V_LOAD_SPLAT
+#undef V_LOAD_LANE
+#undef V_STORE_LANE
+#undef V_LOAD_ZERO
+#undef V_SPLAT
+#undef V_EXTRACT
+#undef V_REPLACE
+#undef V_MAP
+#undef V_ZIP
+#undef V_SHIFT
+#undef V_ALL_TRUE
+#undef V_BITMASK
+}
+
+/* ------------------------------------------------------------------------
+ * JS API
+ * ------------------------------------------------------------------------ */
+
+static JSValue wasm_invoke(JSContext *ctx, WasmFunction *f, int argc,
+                           JSValueConst *argv)
+{
+    const WasmFuncType *t = f->type;
+    WasmStack *s = wasm_get_stack(ctx);
+    WasmValue *args;
+    JSValue ret;
+    uint32_t i, n;
+
+    if (!s)
+        return JS_EXCEPTION;
+    if (func_type_has_v128(t))
+        return JS_ThrowTypeError(ctx, "can't call a function with v128 in its signature from JavaScript");
+    n = max_int(t->nparams, t->nresults);
+    args = s->top;
+    if (args + n > s->stack + WASM_STACK_SLOTS)
+        return JS_ThrowRangeError(ctx, "Maximum call stack size exceeded");
+    /* argument conversions may call back into WebAssembly */
+    s->top = args + n;
+    for (i = 0; i < t->nparams; i++) {
+        if (wasm_from_js(ctx, t->types[i], i < argc ? argv[i] : JS_UNDEFINED,
+                         &args[i])) {
+            s->top = args;
+            return JS_EXCEPTION;
+        }
+    }
+    if (wasm_run(ctx, s, f, args)) {
+        s->top = args;
+        return JS_EXCEPTION;
+    }
+    s->top = args;
+    if (t->nresults == 0)
+        return JS_UNDEFINED;
+    if (t->nresults == 1)
+        return wasm_to_js(ctx, func_results(t)[0], args[0]);
+    ret = JS_NewArray(ctx);
+    for (i = 0; i < t->nresults && !JS_IsException(ret); i++) {
+        JSValue v = wasm_to_js(ctx, func_results(t)[i], args[i]);
+        if (JS_IsException(v) || JS_SetPropertyUint32(ctx, ret, i, v) < 0) {
+            JS_FreeValue(ctx, ret);
+            ret = JS_EXCEPTION;
+        }
+    }
+    return ret;
+}
+
+static JSValue js_wasm_function_call(JSContext *ctx, JSValueConst func_obj,
+                                     JSValueConst this_val, int argc,
+                                     JSValueConst *argv, int flags)
+{
+    WasmFuncObj *fo = JS_GetOpaque(func_obj, js_wasm_function_class_id);
+
+    if (flags & JS_CALL_FLAG_CONSTRUCTOR)
+        return JS_ThrowTypeError(ctx, "not a constructor");
+    return wasm_invoke(ctx, fo->func, argc, argv);
+}
+
+static void js_wasm_function_finalizer(JSRuntime *rt, JSValue val)
+{
+    WasmFuncObj *fo = JS_GetOpaque(val, js_wasm_function_class_id);
+
+    if (fo) {
+        JS_FreeValueRT(rt, fo->inst_obj);
+        js_free_rt(rt, fo);
+    }
+}
+
+static void js_wasm_function_mark(JSRuntime *rt, JSValueConst val,
+                                  JS_MarkFunc *mark_func)
+{
+    WasmFuncObj *fo = JS_GetOpaque(val, js_wasm_function_class_id);
+
+    if (fo)
+        JS_MarkValue(rt, fo->inst_obj, mark_func);
+}
+
+/* Bytes of an ArrayBuffer or a typed array */
+static uint8_t *wasm_get_bytes(JSContext *ctx, size_t *psize, JSValueConst val)
+{
+    size_t offset, length, elem_size, size;
+    uint8_t *data;
+    JSValue buf;
+
+    if (JS_GetTypedArrayType(val) >= 0) {
+        buf = JS_GetTypedArrayBuffer(ctx, val, &offset, &length, &elem_size);
+        if (JS_IsException(buf))
+            return NULL;
+        /* the typed array keeps the buffer alive */
+        data = JS_GetArrayBuffer(ctx, &size, buf);
+        JS_FreeValue(ctx, buf);
+        if (!data)
+            return NULL;
+        *psize = length;
+        return data + offset;
+    }
+    return JS_GetArrayBuffer(ctx, psize, val);
+}
+
+static JSValue wasm_compile(JSContext *ctx, JSValueConst new_target,
+                            JSValueConst bytes)
+{
+    WasmModule *m;
+    JSValue obj;
+    uint8_t *data;
+    size_t size;
+    char error[160];
+
+    data = wasm_get_bytes(ctx, &size, bytes);
+    if (!data)
+        return JS_EXCEPTION;
+    m = wasm_module_new(data, size, error, sizeof(error));
+    if (!m)
+        return wasm_throw(ctx, WASM_COMPILE_ERROR, "%s", error);
+    obj = wasm_new_object(ctx, new_target, js_wasm_module_class_id);
+    if (JS_IsException(obj)) {
+        wasm_module_free(m);
+        return obj;
+    }
+    JS_SetOpaque(obj, m);
+    return obj;
+}
+
+static JSValue js_wasm_module_constructor(JSContext *ctx, JSValueConst new_target,
+                                          int argc, JSValueConst *argv)
+{
+    return wasm_compile(ctx, new_target, argv[0]);
+}
+
+static void js_wasm_module_finalizer(JSRuntime *rt, JSValue val)
+{
+    WasmModule *m = JS_GetOpaque(val, js_wasm_module_class_id);
+
+    if (m)
+        wasm_module_free(m);
+}
+
+static const char *wasm_kind_names[4] = {
+    "function", "table", "memory", "global",
+};
+
+/* Module.exports(module) and Module.imports(module) */
+static JSValue js_wasm_module_descriptors(JSContext *ctx, JSValueConst this_val,
+                                          int argc, JSValueConst *argv,
+                                          int is_imports)
+{
+    WasmModule *m = JS_GetOpaque2(ctx, argv[0], js_wasm_module_class_id);
+    JSValue arr, desc;
+    uint32_t i, n;
+
+    if (!m)
+        return JS_EXCEPTION;
+    arr = JS_NewArray(ctx);
+    n = is_imports ? m->nimports : m->nexports;
+    for (i = 0; i < n && !JS_IsException(arr); i++) {
+        desc = JS_NewObject(ctx);
+        if (is_imports) {
+            JS_SetPropertyStr(ctx, desc, "module",
+                              JS_NewString(ctx, m->imports[i].module));
+            JS_SetPropertyStr(ctx, desc, "name",
+                              JS_NewString(ctx, m->imports[i].name));
+            JS_SetPropertyStr(ctx, desc, "kind",
+                              JS_NewString(ctx, wasm_kind_names[m->imports[i].kind]));
+        } else {
+            JS_SetPropertyStr(ctx, desc, "name",
+                              JS_NewString(ctx, m->exports[i].name));
+            JS_SetPropertyStr(ctx, desc, "kind",
+                              JS_NewString(ctx, wasm_kind_names[m->exports[i].kind]));
+        }
+        if (JS_SetPropertyUint32(ctx, arr, i, desc) < 0) {
+            JS_FreeValue(ctx, arr);
+            arr = JS_EXCEPTION;
+        }
+    }
+    return arr;
+}
+
+static JSValue js_wasm_module_custom_sections(JSContext *ctx, JSValueConst this_val,
+                                              int argc, JSValueConst *argv)
+{
+    WasmModule *m = JS_GetOpaque2(ctx, argv[0], js_wasm_module_class_id);
+    JSValue arr, buf;
+    const char *name;
+    uint32_t i, k = 0;
+
+    if (!m)
+        return JS_EXCEPTION;
+    name = JS_ToCString(ctx, argv[1]);
+    if (!name)
+        return JS_EXCEPTION;
+    arr = JS_NewArray(ctx);
+    for (i = 0; i < m->ncustoms && !JS_IsException(arr); i++) {
+        if (strcmp(m->customs[i].name, name))
+            continue;
+        buf = JS_NewArrayBufferCopy(ctx, m->bytes + m->customs[i].data,
+                                    m->customs[i].size);
+        if (JS_IsException(buf) || JS_SetPropertyUint32(ctx, arr, k++, buf) < 0) {
+            JS_FreeValue(ctx, arr);
+            arr = JS_EXCEPTION;
+        }
+    }
+    JS_FreeCString(ctx, name);
+    return arr;
+}
+
+static void js_wasm_instance_finalizer(JSRuntime *rt, JSValue val)
+{
+    WasmInstance *inst = JS_GetOpaque(val, js_wasm_instance_class_id);
+    uint32_t i;
+
+    if (!inst)
+        return;
+    if (inst->funcs) {
+        for (i = 0; i < inst->mod->nfuncs; i++) {
+            JS_FreeValueRT(rt, inst->funcs[i].host);
+            JS_FreeValueRT(rt, inst->funcs[i].obj);
+        }
+    }
+    JS_FreeValueRT(rt, inst->memory_obj);
+    if (inst->table_objs) {
+        for (i = 0; i < inst->mod->ntables; i++)
+            JS_FreeValueRT(rt, inst->table_objs[i]);
+    }
+    if (inst->global_objs) {
+        for (i = 0; i < inst->mod->nglobals; i++)
+            JS_FreeValueRT(rt, inst->global_objs[i]);
+    }
+    JS_FreeValueRT(rt, inst->exports);
+    js_free_rt(rt, inst->funcs);
+    js_free_rt(rt, inst->table_objs);
+    js_free_rt(rt, inst->tables);
+    js_free_rt(rt, inst->global_objs);
+    js_free_rt(rt, inst->globals);
+    js_free_rt(rt, inst->elem_dropped);
+    js_free_rt(rt, inst->data_dropped);
+    wasm_module_free(inst->mod);
+    js_free_rt(rt, inst);
+}
+
+static void js_wasm_instance_mark(JSRuntime *rt, JSValueConst val,
+                                  JS_MarkFunc *mark_func)
+{
+    WasmInstance *inst = JS_GetOpaque(val, js_wasm_instance_class_id);
+    uint32_t i;
+
+    if (!inst)
+        return;
+    if (inst->funcs) {
+        for (i = 0; i < inst->mod->nfuncs; i++) {
+            JS_MarkValue(rt, inst->funcs[i].host, mark_func);
+            JS_MarkValue(rt, inst->funcs[i].obj, mark_func);
+        }
+    }
+    JS_MarkValue(rt, inst->memory_obj, mark_func);
+    if (inst->table_objs) {
+        for (i = 0; i < inst->mod->ntables; i++)
+            JS_MarkValue(rt, inst->table_objs[i], mark_func);
+    }
+    if (inst->global_objs) {
+        for (i = 0; i < inst->mod->nglobals; i++)
+            JS_MarkValue(rt, inst->global_objs[i], mark_func);
+    }
+    JS_MarkValue(rt, inst->exports, mark_func);
+}
+
+static WasmValue wasm_eval_const(WasmInstance *inst, WasmConstExpr e)
+{
+    const uint8_t *p = inst->mod->bytes + e.offset;
+    WasmValue v;
+
+    v.u64 = 0;
+    switch (*p++) {
+    case 0x41:
+        v.i32 = leb_s64(&p);
+        break;
+    case 0x42:
+        v.i64 = leb_s64(&p);
+        break;
+    case 0x43:
+        memcpy(&v.f32, p, 4);
+        break;
+    case 0x44:
+        memcpy(&v.f64, p, 8);
+        break;
+    case 0xfd: /* v128.const */
+        skip_leb(&p);
+        memcpy(&v, p, 16);
+        break;
+    case 0x23:
+        v = inst->globals[leb_u32(&p)]->v;
+        break;
+    case 0xd2:
+        v.ref = &inst->funcs[leb_u32(&p)];
+        break;
+    }
+    return v;
+}
+
+static BOOL wasm_limits_match(uint64_t size, uint32_t max, const WasmLimits *l)
+{
+    if (size < l->min)
+        return FALSE;
+    if (l->max != UINT32_MAX && (max == UINT32_MAX || max > l->max))
+        return FALSE;
+    return TRUE;
+}
+
+static int wasm_link_import(JSContext *ctx, WasmInstance *inst,
+                            const WasmImport *im, JSValue v,
+                            uint32_t *counts)
+{
+    WasmFunction *f;
+    WasmFuncObj *fo;
+    WasmTable *t;
+    WasmMemory *mem;
+    WasmGlobal *g;
+    WasmValue gv;
+    uint32_t idx = counts[im->kind]++;
+
+    switch (im->kind) {
+    case WASM_EXTERN_FUNC:
+        if (!JS_IsFunction(ctx, v))
+            goto link_error;
+        f = &inst->funcs[idx];
+        fo = JS_GetOpaque(v, js_wasm_function_class_id);
+        if (fo) {
+            if (!func_type_equal(fo->func->type, f->type)) {
+                wasm_throw(ctx, WASM_LINK_ERROR,
+                           "import %s.%s: imported function does not match the expected type",
+                           im->module, im->name);
+                goto fail;
+            }
+            f->target = fo->func;
+            f->obj = v;
+        } else {
+            f->host = v;
+        }
+        return 0;
+    case WASM_EXTERN_TABLE:
+        t = JS_GetOpaque(v, js_wasm_table_class_id);
+        if (!t)
+            goto link_error;
+        if (!wasm_limits_match(t->size, t->max, &im->limits)) {
+            wasm_throw(ctx, WASM_LINK_ERROR, "import %s.%s: table import has incompatible limits",
+                       im->module, im->name);
+            goto fail;
+        }
+        inst->table_objs[idx] = v;
+        inst->tables[idx] = t;
+        return 0;
+    case WASM_EXTERN_MEMORY:
+        mem = JS_GetOpaque(v, js_wasm_memory_class_id);
+        if (!mem)
+            goto link_error;
+        if (!wasm_limits_match(mem->size / WASM_PAGE_SIZE,
+                               mem->max_pages == WASM_MAX_PAGES ? UINT32_MAX : mem->max_pages,
+                               &im->limits)) {
+            wasm_throw(ctx, WASM_LINK_ERROR, "import %s.%s: memory import has incompatible limits",
+                       im->module, im->name);
+            goto fail;
+        }
+        inst->memory_obj = v;
+        inst->mem = mem;
+        return 0;
+    default:
+        g = JS_GetOpaque(v, js_wasm_global_class_id);
+        if (g) {
+            if (g->type != im->val_type || g->mutable != im->mutable) {
+                wasm_throw(ctx, WASM_LINK_ERROR, "import %s.%s: imported global does not match the expected type",
+                           im->module, im->name);
+                goto fail;
+            }
+        } else {
+            /* a plain value makes a new immutable global */
+            if (im->mutable || im->val_type == WASM_V128 ||
+                (im->val_type == WASM_I64 ? JS_IsNumber(v) :
+                 im->val_type != WASM_FUNCREF && !JS_IsNumber(v)))
+                goto link_error;
+            if (wasm_from_js(ctx, im->val_type, v, &gv))
+                goto fail;
+            JS_FreeValue(ctx, v);
+            v = wasm_global_new(ctx, JS_UNDEFINED, im->val_type, FALSE, gv);
+            if (JS_IsException(v))
+                return -1;
+            g = JS_GetOpaque(v, js_wasm_global_class_id);
+        }
+        inst->global_objs[idx] = v;
+        inst->globals[idx] = g;
+        return 0;
+    }
+ link_error:
+    wasm_throw(ctx, WASM_LINK_ERROR, "import %s.%s: %s import requires a %s",
+               im->module, im->name, wasm_kind_names[im->kind],
+               im->kind == WASM_EXTERN_FUNC ? "callable" :
+               im->kind == WASM_EXTERN_TABLE ? "WebAssembly.Table" :
+               im->kind == WASM_EXTERN_MEMORY ? "WebAssembly.Memory" :
+               "WebAssembly.Global or a value of the matching type");
+ fail:
+    JS_FreeValue(ctx, v);
+    return -1;
+}
+
+static JSValue wasm_instantiate(JSContext *ctx, JSValueConst new_target,
+                                WasmModule *m, JSValueConst imports)
+{
+    WasmInstance *inst;
+    JSValue obj, ns, v;
+    uint32_t i, counts[4] = { 0 }, offset;
+    WasmValue gv;
+    const WasmExport *ex;
+
+    obj = wasm_new_object(ctx, new_target, js_wasm_instance_class_id);
+    if (JS_IsException(obj))
+        return obj;
+    inst = js_mallocz(ctx, sizeof(*inst));
+    if (!inst)
+        goto fail;
+    inst->mod = m;
+    m->ref_count++;
+    inst->obj = obj;
+    inst->memory_obj = JS_UNDEFINED;
+    inst->exports = JS_UNDEFINED;
+    JS_SetOpaque(obj, inst);
+    inst->funcs = js_mallocz(ctx, (m->nfuncs + 1) * sizeof(*inst->funcs));
+    inst->table_objs = js_mallocz(ctx, (m->ntables + 1) * sizeof(JSValue));
+    inst->tables = js_mallocz(ctx, (m->ntables + 1) * sizeof(WasmTable *));
+    inst->global_objs = js_mallocz(ctx, (m->nglobals + 1) * sizeof(JSValue));
+    inst->globals = js_mallocz(ctx, (m->nglobals + 1) * sizeof(WasmGlobal *));
+    inst->elem_dropped = js_mallocz(ctx, m->nelems + 1);
+    inst->data_dropped = js_mallocz(ctx, m->ndatas + 1);
+    if (!inst->funcs || !inst->table_objs || !inst->tables ||
+        !inst->global_objs || !inst->globals || !inst->elem_dropped ||
+        !inst->data_dropped)
+        goto fail;
+    for (i = 0; i < m->nfuncs; i++) {
+        inst->funcs[i].inst = inst;
+        inst->funcs[i].index = i;
+        inst->funcs[i].type = &m->types[m->func_types[i]];
+        inst->funcs[i].host = JS_UNDEFINED;
+        inst->funcs[i].obj = JS_UNDEFINED;
+    }
+    for (i = 0; i < m->ntables; i++)
+        inst->table_objs[i] = JS_UNDEFINED;
+    for (i = 0; i < m->nglobals; i++)
+        inst->global_objs[i] = JS_UNDEFINED;
+
+    /* imports */
+    if (m->nimports > 0 && !JS_IsObject(imports)) {
+        JS_ThrowTypeError(ctx, "imports argument must be present and must be an object");
+        goto fail;
+    }
+    for (i = 0; i < m->nimports; i++) {
+        const WasmImport *im = &m->imports[i];
+        ns = JS_GetPropertyStr(ctx, imports, im->module);
+        if (JS_IsException(ns))
+            goto fail;
+        if (!JS_IsObject(ns)) {
+            JS_FreeValue(ctx, ns);
+            JS_ThrowTypeError(ctx, "import %s.%s: module is not an object or function",
+                              im->module, im->name);
+            goto fail;
+        }
+        v = JS_GetPropertyStr(ctx, ns, im->name);
+        JS_FreeValue(ctx, ns);
+        if (JS_IsException(v) || wasm_link_import(ctx, inst, im, v, counts))
+            goto fail;
+    }
+
+    /* definitions */
+    for (i = m->ntable_imports; i < m->ntables; i++) {
+        v = wasm_table_new(ctx, JS_UNDEFINED, m->tables[i].min, m->tables[i].max);
+        if (JS_IsException(v))
+            goto fail;
+        inst->table_objs[i] = v;
+        inst->tables[i] = JS_GetOpaque(v, js_wasm_table_class_id);
+    }
+    if (m->nmemories > m->nmemory_imports) {
+        v = wasm_memory_new(ctx, JS_UNDEFINED, m->memory.min,
+                            m->memory.max == UINT32_MAX ? WASM_MAX_PAGES : m->memory.max);
+        if (JS_IsException(v))
+            goto fail;
+        inst->memory_obj = v;
+        inst->mem = JS_GetOpaque(v, js_wasm_memory_class_id);
+    }
+    for (i = m->nglobal_imports; i < m->nglobals; i++) {
+        const WasmGlobalDef *gd = &m->globals[i - m->nglobal_imports];
+        gv = wasm_eval_const(inst, gd->init);
+        v = wasm_global_new(ctx, JS_UNDEFINED, gd->val_type, gd->mutable, gv);
+        if (JS_IsException(v))
+            goto fail;
+        inst->global_objs[i] = v;
+        inst->globals[i] = JS_GetOpaque(v, js_wasm_global_class_id);
+    }
+
+    /* exports */
+    inst->exports = JS_NewObjectProto(ctx, JS_NULL);
+    if (JS_IsException(inst->exports))
+        goto fail;
+    for (i = 0; i < m->nexports; i++) {
+        ex = &m->exports[i];
+        switch (ex->kind) {
+        case WASM_EXTERN_FUNC:
+            v = wasm_func_object(ctx, &inst->funcs[ex->index]);
+            break;
+        case WASM_EXTERN_TABLE:
+            v = JS_DupValue(ctx, inst->table_objs[ex->index]);
+            break;
+        case WASM_EXTERN_MEMORY:
+            v = JS_DupValue(ctx, inst->memory_obj);
+            break;
+        default:
+            v = JS_DupValue(ctx, inst->global_objs[ex->index]);
+            break;
+        }
+        if (JS_IsException(v) ||
+            JS_DefinePropertyValueStr(ctx, inst->exports, ex->name, v,
+                                      JS_PROP_ENUMERABLE) < 0)
+            goto fail;
+    }
+
+    /* segments */
+    for (i = 0; i < m->nelems; i++) {
+        const WasmElem *el = &m->elems[i];
+        WasmTable *t;
+        uint32_t k;
+
+        if (el->mode == WASM_SEG_PASSIVE)
+            continue;
+        inst->elem_dropped[i] = 1;
+        if (el->mode == WASM_SEG_DECLARATIVE)
+            continue;
+        t = inst->tables[el->table_idx];
+        offset = wasm_eval_const(inst, el->offset).u32;
+        if ((uint64_t)offset + el->count > t->size) {
+            wasm_throw(ctx, WASM_RUNTIME_ERROR, "out of bounds table access");
+            goto fail;
+        }
+        for (k = 0; k < el->count; k++) {
+            if (wasm_table_set(ctx, t, offset + k, el->funcs[k] < 0 ? NULL :
+                               &inst->funcs[el->funcs[k]]))
+                goto fail;
+        }
+    }
+    for (i = 0; i < m->ndatas; i++) {
+        const WasmData *d = &m->datas[i];
+
+        if (d->mode == WASM_SEG_PASSIVE)
+            continue;
+        inst->data_dropped[i] = 1;
+        offset = wasm_eval_const(inst, d->offset).u32;
+        if ((uint64_t)offset + d->size > inst->mem->size) {
+            wasm_throw(ctx, WASM_RUNTIME_ERROR, "out of bounds memory access");
+            goto fail;
+        }
+        memcpy(inst->mem->data + offset, m->bytes + d->data, d->size);
+    }
+
+    if (m->start >= 0) {
+        v = wasm_invoke(ctx, &inst->funcs[m->start], 0, NULL);
+        if (JS_IsException(v))
+            goto fail;
+        JS_FreeValue(ctx, v);
+    }
+    return obj;
+ fail:
+    JS_FreeValue(ctx, obj);
+    return JS_EXCEPTION;
+}
+
+static JSValue js_wasm_instance_constructor(JSContext *ctx, JSValueConst new_target,
+                                            int argc, JSValueConst *argv)
+{
+    WasmModule *m = JS_GetOpaque2(ctx, argv[0], js_wasm_module_class_id);
+
+    if (!m)
+        return JS_EXCEPTION;
+    return wasm_instantiate(ctx, new_target, m, argv[1]);
+}
+
+static JSValue js_wasm_instance_get_exports(JSContext *ctx, JSValueConst this_val)
+{
+    WasmInstance *inst = JS_GetOpaque2(ctx, this_val, js_wasm_instance_class_id);
+
+    if (!inst)
+        return JS_EXCEPTION;
+    return JS_DupValue(ctx, inst->exports);
+}
+
+/* Read an optional [EnforceRange] unsigned long property: returns 1 if
+   present, 0 if absent and -1 on exception */
+static int wasm_get_u32_prop(JSContext *ctx, JSValueConst obj, const char *name,
+                             uint32_t *pv)
+{
+    JSValue v;
+    double d;
+    int ret;
+
+    v = JS_GetPropertyStr(ctx, obj, name);
+    if (JS_IsException(v))
+        return -1;
+    if (JS_IsUndefined(v))
+        return 0;
+    ret = JS_ToFloat64(ctx, &d, v);
+    JS_FreeValue(ctx, v);
+    if (ret)
+        return -1;
+    d = trunc(d);
+    if (!(d >= 0 && d <= UINT32_MAX)) {
+        JS_ThrowTypeError(ctx, "invalid '%s' value", name);
+        return -1;
+    }
+    *pv = d;
+    return 1;
+}
+
+static int wasm_get_limits(JSContext *ctx, JSValueConst desc, uint32_t limit,
+                           uint32_t *pinitial, uint32_t *pmax)
+{
+    int ret;
+
+    if (!JS_IsObject(desc)) {
+        JS_ThrowTypeError(ctx, "descriptor must be an object");
+        return -1;
+    }
+    ret = wasm_get_u32_prop(ctx, desc, "initial", pinitial);
+    if (ret < 0)
+        return -1;
+    if (ret == 0) {
+        JS_ThrowTypeError(ctx, "'initial' is required");
+        return -1;
+    }
+    *pmax = UINT32_MAX;
+    ret = wasm_get_u32_prop(ctx, desc, "maximum", pmax);
+    if (ret < 0)
+        return -1;
+    if (*pinitial > limit || (ret > 0 && (*pmax < *pinitial || *pmax > limit))) {
+        JS_ThrowRangeError(ctx, "invalid limits");
+        return -1;
+    }
+    return 0;
+}
+
+static JSValue js_wasm_memory_constructor(JSContext *ctx, JSValueConst new_target,
+                                          int argc, JSValueConst *argv)
+{
+    uint32_t initial, max;
+
+    if (wasm_get_limits(ctx, argv[0], WASM_MAX_PAGES, &initial, &max))
+        return JS_EXCEPTION;
+    return wasm_memory_new(ctx, new_target, initial,
+                           max == UINT32_MAX ? WASM_MAX_PAGES : max);
+}
+
+static void js_wasm_memory_finalizer(JSRuntime *rt, JSValue val)
+{
+    WasmMemory *mem = JS_GetOpaque(val, js_wasm_memory_class_id);
+
+    if (mem) {
+        JS_FreeValueRT(rt, mem->buffer);
+        mem->buffer = JS_UNDEFINED;
+        wasm_memory_unref(mem);
+    }
+}
+
+static void js_wasm_memory_mark(JSRuntime *rt, JSValueConst val,
+                                JS_MarkFunc *mark_func)
+{
+    WasmMemory *mem = JS_GetOpaque(val, js_wasm_memory_class_id);
+
+    if (mem)
+        JS_MarkValue(rt, mem->buffer, mark_func);
+}
+
+static JSValue js_wasm_memory_get_buffer(JSContext *ctx, JSValueConst this_val)
+{
+    WasmMemory *mem = JS_GetOpaque2(ctx, this_val, js_wasm_memory_class_id);
+
+    if (!mem)
+        return JS_EXCEPTION;
+    return wasm_memory_buffer(ctx, mem);
+}
+
+static JSValue js_wasm_memory_grow(JSContext *ctx, JSValueConst this_val,
+                                   int argc, JSValueConst *argv)
+{
+    WasmMemory *mem = JS_GetOpaque2(ctx, this_val, js_wasm_memory_class_id);
+    uint32_t delta;
+    int64_t ret;
+
+    if (!mem || JS_ToUint32(ctx, &delta, argv[0]))
+        return JS_EXCEPTION;
+    ret = wasm_memory_grow(ctx, mem, delta);
+    if (ret < 0)
+        return JS_ThrowRangeError(ctx, "could not grow memory");
+    return JS_NewInt64(ctx, ret);
+}
+
+static JSValue js_wasm_table_constructor(JSContext *ctx, JSValueConst new_target,
+                                         int argc, JSValueConst *argv)
+{
+    uint32_t initial, max;
+    const char *element;
+    WasmValue init;
+    JSValue obj, v;
+    BOOL ok;
+    int64_t ret;
+
+    if (!JS_IsObject(argv[0]))
+        return JS_ThrowTypeError(ctx, "descriptor must be an object");
+    v = JS_GetPropertyStr(ctx, argv[0], "element");
+    if (JS_IsException(v))
+        return v;
+    element = JS_ToCString(ctx, v);
+    JS_FreeValue(ctx, v);
+    if (!element)
+        return JS_EXCEPTION;
+    ok = !strcmp(element, "anyfunc") || !strcmp(element, "funcref");
+    JS_FreeCString(ctx, element);
+    if (!ok)
+        return JS_ThrowTypeError(ctx, "invalid table element type");
+    if (wasm_get_limits(ctx, argv[0], WASM_MAX_TABLE_SIZE, &initial, &max))
+        return JS_EXCEPTION;
+    init.ref = NULL;
+    if (argc > 1 && !JS_IsUndefined(argv[1]) &&
+        wasm_from_js(ctx, WASM_FUNCREF, argv[1], &init))
+        return JS_EXCEPTION;
+    obj = wasm_table_new(ctx, new_target, 0, max);
+    if (JS_IsException(obj))
+        return obj;
+    ret = wasm_table_grow(ctx, JS_GetOpaque(obj, js_wasm_table_class_id),
+                          initial, init.ref);
+    if (ret < 0) {
+        JS_FreeValue(ctx, obj);
+        return ret == -2 ? JS_EXCEPTION :
+            JS_ThrowRangeError(ctx, "could not allocate table");
+    }
+    return obj;
+}
+
+static void js_wasm_table_finalizer(JSRuntime *rt, JSValue val)
+{
+    WasmTable *t = JS_GetOpaque(val, js_wasm_table_class_id);
+    uint32_t i;
+
+    if (t) {
+        for (i = 0; i < t->size; i++)
+            JS_FreeValueRT(rt, t->objs[i]);
+        free(t->objs);
+        free(t->elems);
+        free(t);
+    }
+}
+
+static void js_wasm_table_mark(JSRuntime *rt, JSValueConst val,
+                               JS_MarkFunc *mark_func)
+{
+    WasmTable *t = JS_GetOpaque(val, js_wasm_table_class_id);
+    uint32_t i;
+
+    if (t) {
+        for (i = 0; i < t->size; i++)
+            JS_MarkValue(rt, t->objs[i], mark_func);
+    }
+}
+
+static JSValue js_wasm_table_get_length(JSContext *ctx, JSValueConst this_val)
+{
+    WasmTable *t = JS_GetOpaque2(ctx, this_val, js_wasm_table_class_id);
+
+    if (!t)
+        return JS_EXCEPTION;
+    return JS_NewUint32(ctx, t->size);
+}
+
+static WasmTable *wasm_table_index(JSContext *ctx, JSValueConst this_val,
+                                   JSValueConst index, uint32_t *pidx)
+{
+    WasmTable *t = JS_GetOpaque2(ctx, this_val, js_wasm_table_class_id);
+
+    if (!t || JS_ToUint32(ctx, pidx, index))
+        return NULL;
+    if (*pidx >= t->size) {
+        JS_ThrowRangeError(ctx, "table index out of bounds");
+        return NULL;
+    }
+    return t;
+}
+
+static JSValue js_wasm_table_get(JSContext *ctx, JSValueConst this_val,
+                                 int argc, JSValueConst *argv)
+{
+    WasmTable *t;
+    uint32_t idx;
+
+    t = wasm_table_index(ctx, this_val, argv[0], &idx);
+    if (!t)
+        return JS_EXCEPTION;
+    return JS_DupValue(ctx, t->objs[idx]);
+}
+
+static JSValue js_wasm_table_set(JSContext *ctx, JSValueConst this_val,
+                                 int argc, JSValueConst *argv)
+{
+    WasmTable *t;
+    WasmValue v;
+    uint32_t idx;
+
+    t = wasm_table_index(ctx, this_val, argv[0], &idx);
+    if (!t)
+        return JS_EXCEPTION;
+    v.ref = NULL;
+    if (argc > 1 && !JS_IsUndefined(argv[1]) &&
+        wasm_from_js(ctx, WASM_FUNCREF, argv[1], &v))
+        return JS_EXCEPTION;
+    if (wasm_table_set(ctx, t, idx, v.ref))
+        return JS_EXCEPTION;
+    return JS_UNDEFINED;
+}
+
+static JSValue js_wasm_table_grow(JSContext *ctx, JSValueConst this_val,
+                                  int argc, JSValueConst *argv)
+{
+    WasmTable *t = JS_GetOpaque2(ctx, this_val, js_wasm_table_class_id);
+    uint32_t delta;
+    WasmValue v;
+    int64_t ret;
+
+    if (!t || JS_ToUint32(ctx, &delta, argv[0]))
+        return JS_EXCEPTION;
+    v.ref = NULL;
+    if (argc > 1 && !JS_IsUndefined(argv[1]) &&
+        wasm_from_js(ctx, WASM_FUNCREF, argv[1], &v))
+        return JS_EXCEPTION;
+    ret = wasm_table_grow(ctx, t, delta, v.ref);
+    if (ret == -2)
+        return JS_EXCEPTION;
+    if (ret < 0)
+        return JS_ThrowRangeError(ctx, "could not grow table");
+    return JS_NewInt64(ctx, ret);
+}
+
+static int wasm_parse_type(JSContext *ctx, JSValueConst val, uint8_t *ptype)
+{
+    static const struct { const char *name; uint8_t type; } types[] = {
+        { "i32", WASM_I32 }, { "i64", WASM_I64 }, { "f32", WASM_F32 },
+        { "f64", WASM_F64 }, { "anyfunc", WASM_FUNCREF },
+        { "funcref", WASM_FUNCREF },
+    };
+    const char *str;
+    size_t i;
+
+    str = JS_ToCString(ctx, val);
+    if (!str)
+        return -1;
+    for (i = 0; i < countof(types); i++) {
+        if (!strcmp(str, types[i].name)) {
+            *ptype = types[i].type;
+            JS_FreeCString(ctx, str);
+            return 0;
+        }
+    }
+    JS_FreeCString(ctx, str);
+    JS_ThrowTypeError(ctx, "invalid value type");
+    return -1;
+}
+
+static JSValue js_wasm_global_constructor(JSContext *ctx, JSValueConst new_target,
+                                          int argc, JSValueConst *argv)
+{
+    JSValue v;
+    uint8_t type;
+    int mutable;
+    WasmValue gv;
+
+    if (!JS_IsObject(argv[0]))
+        return JS_ThrowTypeError(ctx, "descriptor must be an object");
+    v = JS_GetPropertyStr(ctx, argv[0], "mutable");
+    if (JS_IsException(v))
+        return v;
+    mutable = JS_ToBool(ctx, v);
+    JS_FreeValue(ctx, v);
+    v = JS_GetPropertyStr(ctx, argv[0], "value");
+    if (JS_IsException(v))
+        return v;
+    if (wasm_parse_type(ctx, v, &type)) {
+        JS_FreeValue(ctx, v);
+        return JS_EXCEPTION;
+    }
+    JS_FreeValue(ctx, v);
+    gv.u64 = 0;
+    if (argc > 1 && !JS_IsUndefined(argv[1]) &&
+        wasm_from_js(ctx, type, argv[1], &gv))
+        return JS_EXCEPTION;
+    return wasm_global_new(ctx, new_target, type, mutable, gv);
+}
+
+static void js_wasm_global_finalizer(JSRuntime *rt, JSValue val)
+{
+    WasmGlobal *g = JS_GetOpaque(val, js_wasm_global_class_id);
+
+    if (g) {
+        JS_FreeValueRT(rt, g->ref_obj);
+        free(g);
+    }
+}
+
+static void js_wasm_global_mark(JSRuntime *rt, JSValueConst val,
+                                JS_MarkFunc *mark_func)
+{
+    WasmGlobal *g = JS_GetOpaque(val, js_wasm_global_class_id);
+
+    if (g)
+        JS_MarkValue(rt, g->ref_obj, mark_func);
+}
+
+static JSValue js_wasm_global_get_value(JSContext *ctx, JSValueConst this_val)
+{
+    WasmGlobal *g = JS_GetOpaque2(ctx, this_val, js_wasm_global_class_id);
+
+    if (!g)
+        return JS_EXCEPTION;
+    return wasm_to_js(ctx, g->type, g->v);
+}
+
+static JSValue js_wasm_global_set_value(JSContext *ctx, JSValueConst this_val,
+                                        JSValueConst val)
+{
+    WasmGlobal *g = JS_GetOpaque2(ctx, this_val, js_wasm_global_class_id);
+    WasmValue v;
+
+    if (!g)
+        return JS_EXCEPTION;
+    if (!g->mutable)
+        return JS_ThrowTypeError(ctx, "can't set the value of an immutable global");
+    if (wasm_from_js(ctx, g->type, val, &v) || wasm_global_set(ctx, g, v))
+        return JS_EXCEPTION;
+    return JS_UNDEFINED;
+}
+
+static JSValue js_wasm_global_value_of(JSContext *ctx, JSValueConst this_val,
+                                       int argc, JSValueConst *argv)
+{
+    return js_wasm_global_get_value(ctx, this_val);
+}
+
+static JSValue js_wasm_error_constructor(JSContext *ctx, JSValueConst new_target,
+                                         int argc, JSValueConst *argv, int magic)
+{
+    JSValue obj, proto, msg;
+
+    if (JS_IsUndefined(new_target))
+        proto = JS_GetClassProto(ctx, js_wasm_error_class_ids[magic]);
+    else
+        proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+    if (JS_IsException(proto))
+        return proto;
+    obj = JS_NewError(ctx);
+    if (JS_IsException(obj) || JS_SetPrototype(ctx, obj, proto) < 0)
+        goto fail;
+    JS_FreeValue(ctx, proto);
+    if (argc > 0 && !JS_IsUndefined(argv[0])) {
+        msg = JS_ToString(ctx, argv[0]);
+        if (JS_IsException(msg)) {
+            JS_FreeValue(ctx, obj);
+            return msg;
+        }
+        JS_DefinePropertyValueStr(ctx, obj, "message", msg,
+                                  JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE);
+    }
+    return obj;
+ fail:
+    JS_FreeValue(ctx, proto);
+    JS_FreeValue(ctx, obj);
+    return JS_EXCEPTION;
+}
+
+/* Settle a new promise with `result`, or with the pending exception */
+static JSValue wasm_promise(JSContext *ctx, JSValue result)
+{
+    JSValue funcs[2], promise, arg, ret;
+    BOOL rejected = JS_IsException(result);
+
+    arg = rejected ? JS_GetException(ctx) : result;
+    promise = JS_NewPromiseCapability(ctx, funcs);
+    if (JS_IsException(promise)) {
+        JS_FreeValue(ctx, arg);
+        return promise;
+    }
+    ret = JS_Call(ctx, funcs[rejected], JS_UNDEFINED, 1, (JSValueConst *)&arg);
+    JS_FreeValue(ctx, ret);
+    JS_FreeValue(ctx, arg);
+    JS_FreeValue(ctx, funcs[0]);
+    JS_FreeValue(ctx, funcs[1]);
+    return promise;
+}
+
+static JSValue js_wasm_validate(JSContext *ctx, JSValueConst this_val,
+                                int argc, JSValueConst *argv)
+{
+    WasmModule *m;
+    uint8_t *data;
+    size_t size;
+    char error[160];
+
+    data = wasm_get_bytes(ctx, &size, argv[0]);
+    if (!data)
+        return JS_EXCEPTION;
+    m = wasm_module_new(data, size, error, sizeof(error));
+    if (!m)
+        return JS_FALSE;
+    wasm_module_free(m);
+    return JS_TRUE;
+}
+
+static JSValue js_wasm_compile(JSContext *ctx, JSValueConst this_val,
+                               int argc, JSValueConst *argv)
+{
+    return wasm_promise(ctx, wasm_compile(ctx, JS_UNDEFINED, argv[0]));
+}
+
+/* instantiate(module, imports) resolves to an Instance, instantiate(bytes,
+   imports) to { module, instance } */
+static JSValue js_wasm_instantiate(JSContext *ctx, JSValueConst this_val,
+                                   int argc, JSValueConst *argv)
+{
+    WasmModule *m = JS_GetOpaque(argv[0], js_wasm_module_class_id);
+    JSValueConst imports = argc > 1 ? argv[1] : JS_UNDEFINED;
+    JSValue module, inst, ret;
+
+    if (m)
+        return wasm_promise(ctx, wasm_instantiate(ctx, JS_UNDEFINED, m, imports));
+    module = wasm_compile(ctx, JS_UNDEFINED, argv[0]);
+    if (JS_IsException(module))
+        return wasm_promise(ctx, module);
+    inst = wasm_instantiate(ctx, JS_UNDEFINED,
+                            JS_GetOpaque(module, js_wasm_module_class_id), imports);
+    if (JS_IsException(inst)) {
+        JS_FreeValue(ctx, module);
+        return wasm_promise(ctx, inst);
+    }
+    ret = JS_NewObject(ctx);
+    if (!JS_IsException(ret)) {
+        JS_SetPropertyStr(ctx, ret, "module", module);
+        JS_SetPropertyStr(ctx, ret, "instance", inst);
+    } else {
+        JS_FreeValue(ctx, module);
+        JS_FreeValue(ctx, inst);
+    }
+    return wasm_promise(ctx, ret);
+}
+
+static JSClassDef js_wasm_module_class = {
+    "Module",
+    .finalizer = js_wasm_module_finalizer,
+};
+
+static JSClassDef js_wasm_instance_class = {
+    "Instance",
+    .finalizer = js_wasm_instance_finalizer,
+    .gc_mark = js_wasm_instance_mark,
+};
+
+static JSClassDef js_wasm_memory_class = {
+    "Memory",
+    .finalizer = js_wasm_memory_finalizer,
+    .gc_mark = js_wasm_memory_mark,
+};
+
+static JSClassDef js_wasm_table_class = {
+    "Table",
+    .finalizer = js_wasm_table_finalizer,
+    .gc_mark = js_wasm_table_mark,
+};
+
+static JSClassDef js_wasm_global_class = {
+    "Global",
+    .finalizer = js_wasm_global_finalizer,
+    .gc_mark = js_wasm_global_mark,
+};
+
+static JSClassDef js_wasm_function_class = {
+    "Function",
+    .finalizer = js_wasm_function_finalizer,
+    .gc_mark = js_wasm_function_mark,
+    .call = js_wasm_function_call,
+};
+
+static const JSCFunctionListEntry js_wasm_module_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("exports", 1, js_wasm_module_descriptors, 0),
+    JS_CFUNC_MAGIC_DEF("imports", 1, js_wasm_module_descriptors, 1),
+    JS_CFUNC_DEF("customSections", 2, js_wasm_module_custom_sections),
+};
+
+static const JSCFunctionListEntry js_wasm_module_proto_funcs[] = {
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "WebAssembly.Module", JS_PROP_CONFIGURABLE),
+};
+
+static const JSCFunctionListEntry js_wasm_instance_proto_funcs[] = {
+    JS_CGETSET_DEF("exports", js_wasm_instance_get_exports, NULL),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "WebAssembly.Instance", JS_PROP_CONFIGURABLE),
+};
+
+static const JSCFunctionListEntry js_wasm_memory_proto_funcs[] = {
+    JS_CGETSET_DEF("buffer", js_wasm_memory_get_buffer, NULL),
+    JS_CFUNC_DEF("grow", 1, js_wasm_memory_grow),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "WebAssembly.Memory", JS_PROP_CONFIGURABLE),
+};
+
+static const JSCFunctionListEntry js_wasm_table_proto_funcs[] = {
+    JS_CGETSET_DEF("length", js_wasm_table_get_length, NULL),
+    JS_CFUNC_DEF("get", 1, js_wasm_table_get),
+    JS_CFUNC_DEF("set", 1, js_wasm_table_set),
+    JS_CFUNC_DEF("grow", 1, js_wasm_table_grow),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "WebAssembly.Table", JS_PROP_CONFIGURABLE),
+};
+
+static const JSCFunctionListEntry js_wasm_global_proto_funcs[] = {
+    JS_CGETSET_DEF("value", js_wasm_global_get_value, js_wasm_global_set_value),
+    JS_CFUNC_DEF("valueOf", 0, js_wasm_global_value_of),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "WebAssembly.Global", JS_PROP_CONFIGURABLE),
+};
+
+static const JSCFunctionListEntry js_wasm_funcs[] = {
+    JS_CFUNC_DEF("validate", 1, js_wasm_validate),
+    JS_CFUNC_DEF("compile", 1, js_wasm_compile),
+    JS_CFUNC_DEF("instantiate", 1, js_wasm_instantiate),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "WebAssembly", JS_PROP_CONFIGURABLE),
+};
+
+static const struct {
+    JSClassID *class_id;
+    const JSClassDef *class_def;
+    JSCFunction *constructor;
+    int length;
+    const JSCFunctionListEntry *proto_funcs;
+    int proto_funcs_len;
+} js_wasm_classes[] = {
+    { &js_wasm_module_class_id, &js_wasm_module_class,
+      (JSCFunction *)js_wasm_module_constructor, 1,
+      js_wasm_module_proto_funcs, countof(js_wasm_module_proto_funcs) },
+    { &js_wasm_instance_class_id, &js_wasm_instance_class,
+      (JSCFunction *)js_wasm_instance_constructor, 1,
+      js_wasm_instance_proto_funcs, countof(js_wasm_instance_proto_funcs) },
+    { &js_wasm_memory_class_id, &js_wasm_memory_class,
+      (JSCFunction *)js_wasm_memory_constructor, 1,
+      js_wasm_memory_proto_funcs, countof(js_wasm_memory_proto_funcs) },
+    { &js_wasm_table_class_id, &js_wasm_table_class,
+      (JSCFunction *)js_wasm_table_constructor, 1,
+      js_wasm_table_proto_funcs, countof(js_wasm_table_proto_funcs) },
+    { &js_wasm_global_class_id, &js_wasm_global_class,
+      (JSCFunction *)js_wasm_global_constructor, 1,
+      js_wasm_global_proto_funcs, countof(js_wasm_global_proto_funcs) },
+};
+
+static const char *js_wasm_export_names[] = {
+    "Module", "Instance", "Memory", "Table", "Global",
+    "CompileError", "LinkError", "RuntimeError",
+    "validate", "compile", "instantiate",
+};
+
+static JSValue js_wasm_namespace(JSContext *ctx)
+{
+    JSRuntime *rt = JS_GetRuntime(ctx);
+    JSValue ns, proto, ctor, global, error_ctor, error_proto, func_ctor;
+    JSClassDef error_class;
+    size_t i;
+
+    ns = JS_NewObject(ctx);
+    if (JS_IsException(ns))
+        return ns;
+    for (i = 0; i < countof(js_wasm_classes); i++) {
+        /* the class ID is created once, the class once per runtime */
+        JS_NewClassID(rt, js_wasm_classes[i].class_id);
+        JS_NewClass(rt, *js_wasm_classes[i].class_id, js_wasm_classes[i].class_def);
+        proto = JS_NewObject(ctx);
+        JS_SetPropertyFunctionList(ctx, proto, js_wasm_classes[i].proto_funcs,
+                                   js_wasm_classes[i].proto_funcs_len);
+        ctor = JS_NewCFunction2(ctx, js_wasm_classes[i].constructor,
+                                js_wasm_classes[i].class_def->class_name,
+                                js_wasm_classes[i].length, JS_CFUNC_constructor, 0);
+        JS_SetConstructor(ctx, ctor, proto);
+        JS_SetClassProto(ctx, *js_wasm_classes[i].class_id, proto);
+        if (js_wasm_classes[i].class_id == &js_wasm_module_class_id)
+            JS_SetPropertyFunctionList(ctx, ctor, js_wasm_module_funcs,
+                                       countof(js_wasm_module_funcs));
+        JS_DefinePropertyValueStr(ctx, ns, js_wasm_classes[i].class_def->class_name,
+                                  ctor, JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE);
+    }
+
+    global = JS_GetGlobalObject(ctx);
+
+    /* exported functions are callable objects inheriting from
+       Function.prototype */
+    JS_NewClassID(rt, &js_wasm_function_class_id);
+    JS_NewClass(rt, js_wasm_function_class_id, &js_wasm_function_class);
+    func_ctor = JS_GetPropertyStr(ctx, global, "Function");
+    JS_SetClassProto(ctx, js_wasm_function_class_id,
+                     JS_GetPropertyStr(ctx, func_ctor, "prototype"));
+    JS_FreeValue(ctx, func_ctor);
+
+    error_ctor = JS_GetPropertyStr(ctx, global, "Error");
+    error_proto = JS_GetPropertyStr(ctx, error_ctor, "prototype");
+    for (i = 0; i < countof(wasm_error_names); i++) {
+        memset(&error_class, 0, sizeof(error_class));
+        error_class.class_name = wasm_error_names[i];
+        JS_NewClassID(rt, &js_wasm_error_class_ids[i]);
+        JS_NewClass(rt, js_wasm_error_class_ids[i], &error_class);
+        proto = JS_NewObjectProto(ctx, error_proto);
+        JS_DefinePropertyValueStr(ctx, proto, "name",
+                                  JS_NewString(ctx, wasm_error_names[i]),
+                                  JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE);
+        ctor = JS_NewCFunctionMagic(ctx, (JSCFunctionMagic *)js_wasm_error_constructor,
+                                    wasm_error_names[i], 1,
+                                    JS_CFUNC_constructor_or_func_magic, i);
+        JS_SetConstructor(ctx, ctor, proto);
+        JS_SetPrototype(ctx, ctor, error_ctor);
+        JS_SetClassProto(ctx, js_wasm_error_class_ids[i], proto);
+        JS_DefinePropertyValueStr(ctx, ns, wasm_error_names[i], ctor,
+                                  JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE);
+    }
+    JS_FreeValue(ctx, error_proto);
+    JS_FreeValue(ctx, error_ctor);
+    JS_FreeValue(ctx, global);
+
+    JS_SetPropertyFunctionList(ctx, ns, js_wasm_funcs, countof(js_wasm_funcs));
+    return ns;
+}
+
+static int js_wasm_init(JSContext *ctx, JSModuleDef *m)
+{
+    JSValue ns;
+    size_t i;
+
+    ns = js_wasm_namespace(ctx);
+    if (JS_IsException(ns))
+        return -1;
+    for (i = 0; i < countof(js_wasm_export_names); i++) {
+        JS_SetModuleExport(ctx, m, js_wasm_export_names[i],
+                           JS_GetPropertyStr(ctx, ns, js_wasm_export_names[i]));
+    }
+    return JS_SetModuleExport(ctx, m, "default", ns);
+}
+
+JSModuleDef *js_init_module_qjsx_wasm(JSContext *ctx, const char *module_name)
+{
+    JSModuleDef *m;
+    size_t i;
+
+    m = JS_NewCModule(ctx, module_name, js_wasm_init);
+    if (!m)
+        return NULL;
+    for (i = 0; i < countof(js_wasm_export_names); i++)
+        JS_AddModuleExport(ctx, m, js_wasm_export_names[i]);
+    JS_AddModuleExport(ctx, m, "default");
+    return m;
+}
@@ -0,0 +1,1509 @@
+/*
+ * QJSX qjsx:zlib module
+ *
+ * Native gzip/deflate and zstd compression for node:zlib, on top of the
+ * system zlib and libzstd. The libraries are loaded with dlopen() the first
+ * time they are needed, so qjsx and the programs built by qjsxc do not link
+ * against them and still run where they are missing.
+ *
+ *   import * as zlib from "qjsx:zlib";
+ *   zlib.process("gzip", data, { level: 6 })     -> ArrayBuffer
+ *   const job = zlib.start("gunzip", data, {})   // runs on its own thread
+ *   os.setReadHandler(job.fd, () => ... job.result() ...)
+ *   const s = new zlib.Stream("deflate", {})
+ *   s.write(chunk, zlib.FLUSH_NONE | FLUSH_SYNC | FLUSH_FINISH) -> ArrayBuffer
+ *   zlib.crc32(data[, value]), zlib.available("zstd")
+ *
+ * Kinds are the node:zlib names: gzip, gunzip, deflate, inflate, deflateRaw,
+ * inflateRaw, unzip (gzip or zlib, detected), zstdCompress, zstdDecompress.
+ * Options: level, windowBits, memLevel, strategy, maxOutputLength, threads
+ * and params (zstd parameters by number, as in node:zlib).
+ *
+ * Inputs are strings (UTF-8), ArrayBuffers or typed arrays and are read in
+ * place; outputs are ArrayBuffers that take over the buffer they were
+ * produced in. process() and start() compress inputs of 4 MiB or more on
+ * several threads ("threads", by default as many as the process has CPUs,
+ * see qjsx-os.h): gzip/deflate split the input in 1 MiB blocks, each primed
+ * with the 32 KiB before it and ended with a sync flush, as pigz does, which
+ * still yields one gzip member; zstd uses its own worker threads when
+ * libzstd has them.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include "quickjs/cutils.h"
+#include "quickjs/quickjs.h"
+#include "qjsx-zlib.h"
+#include "qjsx-os.h"
+
+#define ZL_MIN_OUTPUT       (64 * 1024)
+#define ZL_PARALLEL_MIN     (4 * 1024 * 1024)
+#define ZL_PARALLEL_BLOCK   (1024 * 1024)
+#define ZL_MAX_OUTPUT       ((size_t)INT32_MAX) /* largest ArrayBuffer */
+
+enum {
+    ZL_FLUSH_NONE,
+    ZL_FLUSH_SYNC,
+    ZL_FLUSH_FINISH,
+};
+
+typedef enum {
+    ZL_GZIP,
+    ZL_GUNZIP,
+    ZL_DEFLATE,
+    ZL_INFLATE,
+    ZL_DEFLATE_RAW,
+    ZL_INFLATE_RAW,
+    ZL_UNZIP,
+    ZL_ZSTD_COMPRESS,
+    ZL_ZSTD_DECOMPRESS,
+} ZLKind;
+
+static const char *const zl_kind_names[] = {
+    "gzip", "gunzip", "deflate", "inflate", "deflateRaw", "inflateRaw",
+    "unzip", "zstdCompress", "zstdDecompress",
+};
+
+/* The parts of zlib.h and zstd.h used here; both are stable ABIs */
+
+#define Z_OK            0
+#define Z_STREAM_END    1
+#define Z_NEED_DICT     2
+#define Z_STREAM_ERROR  (-2)
+#define Z_DATA_ERROR    (-3)
+#define Z_MEM_ERROR     (-4)
+#define Z_BUF_ERROR     (-5)
+#define Z_NO_FLUSH      0
+#define Z_SYNC_FLUSH    2
+#define Z_FINISH        4
+#define Z_DEFLATED      8
+
+typedef struct ZLStream {
+    const uint8_t *next_in;
+    unsigned avail_in;
+    unsigned long total_in;
+    uint8_t *next_out;
+    unsigned avail_out;
+    unsigned long total_out;
+    const char *msg;
+    void *state;
+    void *zalloc;
+    void *zfree;
+    void *opaque;
+    int data_type;
+    unsigned long adler;
+    unsigned long reserved;
+} ZLStream;
+
+typedef struct {
+    const void *src;
+    size_t size;
+    size_t pos;
+} ZSTDInBuffer;
+
+typedef struct {
+    void *dst;
+    size_t size;
+    size_t pos;
+} ZSTDOutBuffer;
+
+#define ZSTD_c_compressionLevel 100
+#define ZSTD_c_checksumFlag     201
+#define ZSTD_c_nbWorkers        400
+#define ZSTD_e_continue         0
+#define ZSTD_e_flush            1
+#define ZSTD_e_end              2
+#define ZSTD_CONTENTSIZE_ERROR  (0ULL - 2)
+
+static struct {
+    int (*deflateInit2_)(ZLStream *, int, int, int, int, int, const char *, int);
+    int (*deflate)(ZLStream *, int);
+    int (*deflateEnd)(ZLStream *);
+    unsigned long (*deflateBound)(ZLStream *, unsigned long);
+    int (*deflateSetDictionary)(ZLStream *, const uint8_t *, unsigned);
+    int (*inflateInit2_)(ZLStream *, int, const char *, int);
+    int (*inflate)(ZLStream *, int);
+    int (*inflateEnd)(ZLStream *);
+    int (*inflateReset)(ZLStream *);
+    unsigned long (*crc32)(unsigned long, const uint8_t *, unsigned);
+    unsigned long (*crc32_combine)(unsigned long, unsigned long, long);
+    unsigned long (*adler32)(unsigned long, const uint8_t *, unsigned);
+    unsigned long (*adler32_combine)(unsigned long, unsigned long, long);
+} zlib;
+
+static struct {
+    void *(*createCCtx)(void);
+    size_t (*freeCCtx)(void *);
+    size_t (*CCtx_setParameter)(void *, int, int);
+    size_t (*compressStream2)(void *, ZSTDOutBuffer *, ZSTDInBuffer *, int);
+    void *(*createDCtx)(void);
+    size_t (*freeDCtx)(void *);
+    size_t (*decompressStream)(void *, ZSTDOutBuffer *, ZSTDInBuffer *);
+    unsigned (*isError)(size_t);
+    const char *(*getErrorName)(size_t);
+    size_t (*compressBound)(size_t);
+    unsigned long long (*getFrameContentSize)(const void *, size_t);
+} zstd;
+
+static pthread_once_t zlib_once = PTHREAD_ONCE_INIT;
+static pthread_once_t zstd_once = PTHREAD_ONCE_INIT;
+static BOOL zlib_loaded, zstd_loaded;
+
+static void *zl_dlopen(const char *const *names)
+{
+    for (; *names; names++) {
+        void *h = dlopen(*names, RTLD_NOW | RTLD_LOCAL);
+        if (h)
+            return h;
+    }
+    return NULL;
+}
+
+/* resolve the symbols listed in names into the consecutive pointers at fns */
+static BOOL zl_dlsym(void *h, const char *const *names, void **fns)
+{
+    for (; *names; names++, fns++) {
+        *fns = dlsym(h, *names);
+        if (!*fns)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+static void zl_load_zlib(void)
+{
+    static const char *const libs[] = {
+        "libz.so.1", "libz.so", "libz.1.dylib", "libz.dylib", NULL
+    };
+    static const char *const syms[] = {
+        "deflateInit2_", "deflate", "deflateEnd", "deflateBound",
+        "deflateSetDictionary", "inflateInit2_", "inflate", "inflateEnd",
+        "inflateReset", "crc32", "crc32_combine", "adler32",
+        "adler32_combine", NULL
+    };
+    void *h = zl_dlopen(libs);
+
+    zlib_loaded = h && zl_dlsym(h, syms, (void **)&zlib);
+}
+
+static void zl_load_zstd(void)
+{
+    static const char *const libs[] = {
+        "libzstd.so.1", "libzstd.so", "libzstd.1.dylib", "libzstd.dylib", NULL
+    };
+    static const char *const syms[] = {
+        "ZSTD_createCCtx", "ZSTD_freeCCtx", "ZSTD_CCtx_setParameter",
+        "ZSTD_compressStream2", "ZSTD_createDCtx", "ZSTD_freeDCtx",
+        "ZSTD_decompressStream", "ZSTD_isError", "ZSTD_getErrorName",
+        "ZSTD_compressBound", "ZSTD_getFrameContentSize", NULL
+    };
+    void *h = zl_dlopen(libs);
+
+    zstd_loaded = h && zl_dlsym(h, syms, (void **)&zstd);
+}
+
+static BOOL zl_is_zstd(ZLKind kind)
+{
+    return kind == ZL_ZSTD_COMPRESS || kind == ZL_ZSTD_DECOMPRESS;
+}
+
+static BOOL zl_is_compress(ZLKind kind)
+{
+    return kind == ZL_GZIP || kind == ZL_DEFLATE || kind == ZL_DEFLATE_RAW ||
+        kind == ZL_ZSTD_COMPRESS;
+}
+
+static BOOL zl_load(ZLKind kind)
+{
+    if (zl_is_zstd(kind)) {
+        pthread_once(&zstd_once, zl_load_zstd);
+        return zstd_loaded;
+    }
+    pthread_once(&zlib_once, zl_load_zlib);
+    return zlib_loaded;
+}
+
+/* Compression core: plain C, usable from any thread */
+
+typedef struct ZLOptions {
+    int level;
+    int window_bits;
+    int mem_level;
+    int strategy;
+    int threads;
+    int zstd_checksum;
+    size_t max_output;
+} ZLOptions;
+
+typedef struct ZLError {
+    const char *code;       /* node:zlib error code, e.g. "Z_DATA_ERROR" */
+    char msg[128];
+} ZLError;
+
+typedef struct ZLOut {
+    uint8_t *buf;           /* malloc()ed, handed over to an ArrayBuffer */
+    size_t len, size, limit;
+} ZLOut;
+
+typedef struct ZLCodec {
+    ZLKind kind;
+    ZLStream z;
+    void *zstd_ctx;
+    size_t zstd_pending;    /* decompression: non-zero inside a frame */
+    BOOL initialized;
+    BOOL ended;
+} ZLCodec;
+
+static inline size_t zl_min(size_t a, size_t b)
+{
+    return a < b ? a : b;
+}
+
+static inline size_t zl_max(size_t a, size_t b)
+{
+    return a > b ? a : b;
+}
+
+static int __attribute__((format(printf, 3, 4)))
+zl_error(ZLError *err, const char *code, const char *fmt, ...)
+{
+    va_list ap;
+
+    err->code = code;
+    va_start(ap, fmt);
+    vsnprintf(err->msg, sizeof(err->msg), fmt, ap);
+    va_end(ap);
+    return -1;
+}
+
+static int zl_zlib_error(ZLError *err, ZLStream *z, int ret)
+{
+    switch (ret) {
+    case Z_NEED_DICT:
+        return zl_error(err, "Z_NEED_DICT", "Missing dictionary");
+    case Z_DATA_ERROR:
+        return zl_error(err, "Z_DATA_ERROR", "%s", z->msg ? z->msg : "invalid data");
+    case Z_MEM_ERROR:
+        return zl_error(err, "Z_MEM_ERROR", "out of memory");
+    case Z_BUF_ERROR:
+        return zl_error(err, "Z_BUF_ERROR", "unexpected end of file");
+    default:
+        return zl_error(err, "Z_STREAM_ERROR", "%s", z->msg ? z->msg : "stream error");
+    }
+}
+
+/* make room for at least one more byte, preferably for need */
+static int zl_reserve(ZLOut *out, size_t need, ZLError *err)
+{
+    size_t size;
+    uint8_t *buf;
+
+    if (out->size - out->len >= need && out->size > out->len)
+        return 0;
+    size = zl_max(ZL_MIN_OUTPUT, out->size * 2);
+    if (size - out->len < need)
+        size = out->len + need;
+    if (size > out->limit)
+        size = out->limit;
+    if (size <= out->len)
+        return zl_error(err, "ERR_BUFFER_TOO_LARGE",
+                        "Cannot create a buffer larger than %zu bytes", out->limit);
+    buf = realloc(out->buf, size);
+    if (!buf)
+        return zl_error(err, "Z_MEM_ERROR", "out of memory");
+    out->buf = buf;
+    out->size = size;
+    return 0;
+}
+
+static inline unsigned zl_avail_out(ZLOut *out)
+{
+    size_t n = out->size - out->len;
+    return n > UINT_MAX ? UINT_MAX : n;
+}
+
+static int zl_window_bits(ZLKind kind, int bits)
+{
+    switch (kind) {
+    case ZL_GZIP:
+    case ZL_GUNZIP:
+        return bits + 16;
+    case ZL_DEFLATE_RAW:
+    case ZL_INFLATE_RAW:
+        return -bits;
+    case ZL_UNZIP:
+        return bits + 32; /* detect gzip or zlib headers */
+    default:
+        return bits;
+    }
+}
+
+static int zl_codec_init(ZLCodec *c, ZLKind kind, const ZLOptions *o,
+                         ZLError *err)
+{
+    int ret;
+
+    memset(c, 0, sizeof(*c));
+    c->kind = kind;
+    if (!zl_load(kind))
+        return zl_error(err, "ERR_ZLIB_INITIALIZATION_FAILED", "%s is not available: "
+                        "cannot load %s", zl_kind_names[kind],
+                        zl_is_zstd(kind) ? "libzstd" : "libz");
+    switch (kind) {
+    case ZL_ZSTD_COMPRESS:
+        c->zstd_ctx = zstd.createCCtx();
+        if (!c->zstd_ctx)
+            return zl_error(err, "Z_MEM_ERROR", "out of memory");
+        zstd.CCtx_setParameter(c->zstd_ctx, ZSTD_c_compressionLevel, o->level);
+        zstd.CCtx_setParameter(c->zstd_ctx, ZSTD_c_checksumFlag, o->zstd_checksum);
+        break;
+    case ZL_ZSTD_DECOMPRESS:
+        c->zstd_ctx = zstd.createDCtx();
+        if (!c->zstd_ctx)
+            return zl_error(err, "Z_MEM_ERROR", "out of memory");
+        break;
+    case ZL_GZIP:
+    case ZL_DEFLATE:
+    case ZL_DEFLATE_RAW:
+        ret = zlib.deflateInit2_(&c->z, o->level, Z_DEFLATED,
+                                 zl_window_bits(kind, o->window_bits),
+                                 o->mem_level, o->strategy, "1.2.11",
+                                 sizeof(ZLStream));
+        if (ret != Z_OK)
+            return zl_zlib_error(err, &c->z, ret);
+        break;
+    default:
+        ret = zlib.inflateInit2_(&c->z, zl_window_bits(kind, o->window_bits),
+                                 "1.2.11", sizeof(ZLStream));
+        if (ret != Z_OK)
+            return zl_zlib_error(err, &c->z, ret);
+        break;
+    }
+    c->initialized = TRUE;
+    return 0;
+}
+
+static void zl_codec_end(ZLCodec *c)
+{
+    if (!c->initialized)
+        return;
+    c->initialized = FALSE;
+    if (c->kind == ZL_ZSTD_COMPRESS)
+        zstd.freeCCtx(c->zstd_ctx);
+    else if (c->kind == ZL_ZSTD_DECOMPRESS)
+        zstd.freeDCtx(c->zstd_ctx);
+    else if (zl_is_compress(c->kind))
+        zlib.deflateEnd(&c->z);
+    else
+        zlib.inflateEnd(&c->z);
+}
+
+static int zl_deflate_write(ZLCodec *c, const uint8_t *in, size_t len,
+                            int flush, ZLOut *out, ZLError *err)
+{
+    size_t off = 0;
+    int ret;
+
+    do {
+        size_t piece = zl_min(len - off, UINT_MAX);
+        int f;
+
+        c->z.next_in = in + off;
+        c->z.avail_in = piece;
+        off += piece;
+        f = off < len ? Z_NO_FLUSH : flush == ZL_FLUSH_FINISH ? Z_FINISH
+            : flush == ZL_FLUSH_SYNC ? Z_SYNC_FLUSH : Z_NO_FLUSH;
+        do {
+            if (zl_reserve(out, 1, err))
+                return -1;
+            c->z.next_out = out->buf + out->len;
+            c->z.avail_out = zl_avail_out(out);
+            ret = zlib.deflate(&c->z, f);
+            out->len = c->z.next_out - out->buf;
+            if (ret == Z_STREAM_ERROR)
+                return zl_zlib_error(err, &c->z, ret);
+        } while (c->z.avail_out == 0 || (f == Z_FINISH && ret != Z_STREAM_END));
+    } while (off < len);
+    if (flush == ZL_FLUSH_FINISH)
+        c->ended = TRUE;
+    return 0;
+}
+
+static int zl_inflate_write(ZLCodec *c, const uint8_t *in, size_t len,
+                            int flush, ZLOut *out, ZLError *err)
+{
+    size_t off = 0;
+    int ret;
+
+    /* a gzip member that ended exactly at the end of the previous write */
+    if (c->ended && (c->kind == ZL_GUNZIP || c->kind == ZL_UNZIP) &&
+        c->z.avail_in == 0 && len > 0 && in[0] == 0x1f) {
+        zlib.inflateReset(&c->z);
+        c->ended = FALSE;
+    }
+    while (off < len && !c->ended) {
+        size_t piece = zl_min(len - off, UINT_MAX);
+
+        c->z.next_in = in + off;
+        c->z.avail_in = piece;
+        for (;;) {
+            if (zl_reserve(out, 1, err))
+                return -1;
+            c->z.next_out = out->buf + out->len;
+            c->z.avail_out = zl_avail_out(out);
+            ret = zlib.inflate(&c->z, Z_NO_FLUSH);
+            out->len = c->z.next_out - out->buf;
+            if (ret == Z_STREAM_END) {
+                /* concatenated gzip members are decoded as one stream,
+                   anything else after the end is ignored */
+                if ((c->kind == ZL_GUNZIP || c->kind == ZL_UNZIP) &&
+                    c->z.avail_in > 0 && c->z.next_in[0] == 0x1f) {
+                    zlib.inflateReset(&c->z);
+                    continue;
+                }
+                c->ended = TRUE;
+                break;
+            }
+            if (ret != Z_OK && ret != Z_BUF_ERROR)
+                return zl_zlib_error(err, &c->z, ret);
+            if (c->z.avail_in == 0 && c->z.avail_out != 0)
+                break;
+            if (ret == Z_BUF_ERROR && c->z.avail_out != 0)
+                break;
+        }
+        off += piece - c->z.avail_in;
+        if (c->z.avail_in && !c->ended)
+            return zl_zlib_error(err, &c->z, Z_STREAM_ERROR);
+    }
+    if (flush == ZL_FLUSH_FINISH && !c->ended)
+        return zl_error(err, "Z_BUF_ERROR", "unexpected end of file");
+    return 0;
+}
+
+static int zl_zstd_write(ZLCodec *c, const uint8_t *in, size_t len,
+                         int flush, ZLOut *out, ZLError *err)
+{
+    ZSTDInBuffer ib = { in, len, 0 };
+    ZSTDOutBuffer ob;
+    size_t ret;
+
+    /* decompression never leaves output behind in the context, and an
+       empty call would only report the header size of a next frame */
+    while (c->kind == ZL_ZSTD_COMPRESS || len > 0) {
+        if (zl_reserve(out, ZL_MIN_OUTPUT, err))
+            return -1;
+        ob = (ZSTDOutBuffer){ out->buf, out->size, out->len };
+        if (c->kind == ZL_ZSTD_COMPRESS) {
+            ret = zstd.compressStream2(c->zstd_ctx, &ob, &ib,
+                                       flush == ZL_FLUSH_FINISH ? ZSTD_e_end
+                                       : flush == ZL_FLUSH_SYNC ? ZSTD_e_flush
+                                       : ZSTD_e_continue);
+        } else {
+            ret = zstd.decompressStream(c->zstd_ctx, &ob, &ib);
+            if (!zstd.isError(ret))
+                c->zstd_pending = ret;
+        }
+        out->len = ob.pos;
+        if (zstd.isError(ret))
+            return zl_error(err, "Z_DATA_ERROR", "%s", zstd.getErrorName(ret));
+        if (c->kind == ZL_ZSTD_COMPRESS) {
+            /* done once the input is consumed and, when flushing, the
+               frame is written out */
+            if (ib.pos == ib.size && (flush == ZL_FLUSH_NONE || ret == 0))
+                break;
+        } else if (ib.pos == ib.size && ob.pos < ob.size) {
+            break;
+        }
+    }
+    if (flush == ZL_FLUSH_FINISH) {
+        if (c->kind == ZL_ZSTD_DECOMPRESS && c->zstd_pending)
+            return zl_error(err, "Z_BUF_ERROR", "unexpected end of file");
+        c->ended = TRUE;
+    }
+    return 0;
+}
+
+static int zl_codec_write(ZLCodec *c, const uint8_t *in, size_t len, int flush,
+                          ZLOut *out, ZLError *err)
+{
+    if (c->ended && zl_is_compress(c->kind)) {
+        if (len == 0)
+            return 0;
+        return zl_error(err, "ERR_STREAM_WRITE_AFTER_END", "write after end");
+    }
+    if (zl_is_zstd(c->kind))
+        return zl_zstd_write(c, in, len, flush, out, err);
+    if (zl_is_compress(c->kind))
+        return zl_deflate_write(c, in, len, flush, out, err);
+    return zl_inflate_write(c, in, len, flush, out, err);
+}
+
+/* Parallel deflate */
+
+typedef struct ZLBlock {
+    ZLOut out;
+    unsigned long check;    /* crc32 (gzip) or adler32 (zlib) of the block */
+    int failed;
+    ZLError err;
+} ZLBlock;
+
+typedef struct ZLParallel {
+    ZLKind kind;
+    const ZLOptions *opts;
+    const uint8_t *in;
+    size_t len;
+    size_t nblocks;
+    size_t next;            /* next block to compress, taken atomically */
+    ZLBlock *blocks;
+} ZLParallel;
+
+static void zl_deflate_block(ZLParallel *p, size_t i)
+{
+    ZLBlock *b = &p->blocks[i];
+    size_t start = i * ZL_PARALLEL_BLOCK;
+    size_t len = zl_min(p->len - start, ZL_PARALLEL_BLOCK);
+    BOOL last = i == p->nblocks - 1;
+    ZLStream z;
+    int ret;
+
+    memset(&z, 0, sizeof(z));
+    b->out.limit = ZL_MAX_OUTPUT;
+    /* raw blocks with the window the header announces: an inflater with a
+       smaller window than the encoder's cannot follow its matches */
+    ret = zlib.deflateInit2_(&z, p->opts->level, Z_DEFLATED, -p->opts->window_bits,
+                             p->opts->mem_level, p->opts->strategy, "1.2.11",
+                             sizeof(ZLStream));
+    if (ret != Z_OK) {
+        b->failed = zl_zlib_error(&b->err, &z, ret);
+        return;
+    }
+    /* prime the window with the end of the previous block so matches
+       can reach across the boundary */
+    if (i > 0) {
+        size_t dict = zl_min(start, (size_t)1 << p->opts->window_bits);
+        zlib.deflateSetDictionary(&z, p->in + start - dict, dict);
+    }
+    if (zl_reserve(&b->out, zlib.deflateBound(&z, len) + 16, &b->err)) {
+        b->failed = -1;
+        zlib.deflateEnd(&z);
+        return;
+    }
+    z.next_in = p->in + start;
+    z.avail_in = len;
+    do {
+        if (zl_reserve(&b->out, 1, &b->err)) {
+            b->failed = -1;
+            break;
+        }
+        z.next_out = b->out.buf + b->out.len;
+        z.avail_out = zl_avail_out(&b->out);
+        ret = zlib.deflate(&z, last ? Z_FINISH : Z_SYNC_FLUSH);
+        b->out.len = z.next_out - b->out.buf;
+    } while (z.avail_out == 0 || (last && ret != Z_STREAM_END));
+    zlib.deflateEnd(&z);
+    if (p->kind == ZL_GZIP)
+        b->check = zlib.crc32(0, p->in + start, len);
+    else
+        b->check = zlib.adler32(1, p->in + start, len);
+}
+
+static void *zl_parallel_worker(void *arg)
+{
+    ZLParallel *p = arg;
+    size_t i;
+
+    while ((i = __atomic_fetch_add(&p->next, 1, __ATOMIC_RELAXED)) < p->nblocks)
+        zl_deflate_block(p, i);
+    return NULL;
+}
+
+static void zl_put32(uint8_t *p, uint32_t v, BOOL big_endian)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = v >> (big_endian ? 24 - 8 * i : 8 * i);
+}
+
+static int zl_deflate_parallel(ZLKind kind, const ZLOptions *o,
+                               const uint8_t *in, size_t len, ZLOut *out,
+                               ZLError *err)
+{
+    ZLParallel p = { kind, o, in, len };
+    pthread_t threads[64];
+    int nthreads = 0, ret = 0;
+    unsigned long check;
+    uint8_t hdr[10];
+    size_t hdr_len = 0, total;
+
+    p.nblocks = (len + ZL_PARALLEL_BLOCK - 1) / ZL_PARALLEL_BLOCK;
+    p.blocks = calloc(p.nblocks, sizeof(ZLBlock));
+    if (!p.blocks)
+        return zl_error(err, "Z_MEM_ERROR", "out of memory");
+    /* the calling thread compresses blocks too */
+    while (nthreads < o->threads - 1 && nthreads < (int)countof(threads) &&
+           (size_t)nthreads + 1 < p.nblocks &&
+           !pthread_create(&threads[nthreads], NULL, zl_parallel_worker, &p))
+        nthreads++;
+    zl_parallel_worker(&p);
+    for (int i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+
+    check = p.blocks[0].check;
+    total = 0;
+    for (size_t i = 0; i < p.nblocks; i++) {
+        size_t blen = zl_min(len - i * ZL_PARALLEL_BLOCK, ZL_PARALLEL_BLOCK);
+        if (p.blocks[i].failed) {
+            *err = p.blocks[i].err;
+            ret = -1;
+            goto done;
+        }
+        if (i > 0)
+            check = kind == ZL_GZIP
+                ? zlib.crc32_combine(check, p.blocks[i].check, blen)
+                : zlib.adler32_combine(check, p.blocks[i].check, blen);
+        total += p.blocks[i].out.len;
+    }
+
+    if (kind == ZL_GZIP) {
+        static const uint8_t gz[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+        memcpy(hdr, gz, sizeof(gz));
+        hdr[8] = o->level == 9 ? 2 : o->level == 1 ? 4 : 0;
+        hdr_len = 10;
+    } else if (kind == ZL_DEFLATE) {
+        int flags = o->level < 2 || o->strategy >= 2 ? 0 : o->level < 6 ? 1
+            : o->level == 6 || o->level < 0 ? 2 : 3;
+        unsigned h = ((Z_DEFLATED + ((o->window_bits - 8) << 4)) << 8) | (flags << 6);
+        h += 31 - h % 31;
+        hdr[0] = h >> 8;
+        hdr[1] = h;
+        hdr_len = 2;
+    }
+    if (zl_reserve(out, hdr_len + total + 8, err)) {
+        ret = -1;
+        goto done;
+    }
+    if (out->size - out->len < hdr_len + total + 8) {
+        ret = zl_error(err, "ERR_BUFFER_TOO_LARGE",
+                       "Cannot create a buffer larger than %zu bytes", out->limit);
+        goto done;
+    }
+    memcpy(out->buf + out->len, hdr, hdr_len);
+    out->len += hdr_len;
+    for (size_t i = 0; i < p.nblocks; i++) {
+        memcpy(out->buf + out->len, p.blocks[i].out.buf, p.blocks[i].out.len);
+        out->len += p.blocks[i].out.len;
+    }
+    if (kind == ZL_GZIP) {
+        zl_put32(out->buf + out->len, check, FALSE);
+        zl_put32(out->buf + out->len + 4, len, FALSE);
+        out->len += 8;
+    } else if (kind == ZL_DEFLATE) {
+        zl_put32(out->buf + out->len, check, TRUE);
+        out->len += 4;
+    }
+ done:
+    for (size_t i = 0; i < p.nblocks; i++)
+        free(p.blocks[i].out.buf);
+    free(p.blocks);
+    return ret;
+}
+
+/* the CPUs this process may use, honoring affinity and cgroup quotas */
+static int zl_cpu_count(void)
+{
+    int n = qjsx_available_parallelism();
+    return n > 64 ? 64 : n;
+}
+
+/* compress or decompress a whole buffer */
+static int zl_process(ZLKind kind, const ZLOptions *o, const uint8_t *in,
+                      size_t len, ZLOut *out, ZLError *err)
+{
+    ZLCodec c;
+    size_t hint;
+    int ret;
+
+    out->limit = o->max_output;
+    if (!zl_load(kind))
+        return zl_codec_init(&c, kind, o, err);
+    if ((kind == ZL_GZIP || kind == ZL_DEFLATE || kind == ZL_DEFLATE_RAW) &&
+        o->threads > 1 && len >= ZL_PARALLEL_MIN)
+        return zl_deflate_parallel(kind, o, in, len, out, err);
+
+    if (zl_codec_init(&c, kind, o, err))
+        return -1;
+    if (kind == ZL_ZSTD_COMPRESS && o->threads > 1 && len >= ZL_PARALLEL_MIN)
+        zstd.CCtx_setParameter(c.zstd_ctx, ZSTD_c_nbWorkers, o->threads);
+
+    /* size the output once when the result size is known or bounded */
+    if (kind == ZL_ZSTD_COMPRESS) {
+        hint = zstd.compressBound(len);
+    } else if (zl_is_compress(kind)) {
+        hint = zlib.deflateBound(&c.z, len) + 32;
+    } else if (kind == ZL_ZSTD_DECOMPRESS) {
+        unsigned long long n = zstd.getFrameContentSize(in, len);
+        hint = n < ZSTD_CONTENTSIZE_ERROR && n < out->limit ? n + 1 : len * 4;
+    } else if (kind == ZL_GUNZIP && len >= 18) {
+        /* ISIZE of the last member: the size modulo 4 GiB */
+        hint = in[len - 4] | in[len - 3] << 8 | in[len - 2] << 16 |
+            (uint32_t)in[len - 1] << 24;
+        hint = zl_max(hint + 1, len);
+    } else {
+        hint = len * 4;
+    }
+    hint = zl_min(hint, out->limit);
+    if (hint > ZL_MIN_OUTPUT && zl_reserve(out, hint, err)) {
+        zl_codec_end(&c);
+        return -1;
+    }
+    ret = zl_codec_write(&c, in, len, ZL_FLUSH_FINISH, out, err);
+    zl_codec_end(&c);
+    return ret;
+}
+
+/* Codecs on caller buffers, for other native modules (see qjsx-zlib.h) */
+
+struct QJSXCodec {
+    ZLCodec codec;
+};
+
+static int zl_step_zlib(ZLCodec *c, const uint8_t **in, size_t *in_len,
+                        uint8_t *out, size_t out_size, size_t *pn, int finish,
+                        ZLError *err)
+{
+    BOOL compress = zl_is_compress(c->kind);
+    size_t n = 0;
+    int ret;
+
+    for (;;) {
+        size_t avail = zl_min(*in_len, UINT_MAX);
+
+        if (c->ended) {
+            /* decode concatenated gzip members as one stream */
+            if (compress || (c->kind != ZL_GUNZIP && c->kind != ZL_UNZIP) ||
+                *in_len == 0 || (*in)[0] != 0x1f)
+                break;
+            zlib.inflateReset(&c->z);
+            c->ended = FALSE;
+        }
+        c->z.next_in = *in;
+        c->z.avail_in = avail;
+        c->z.next_out = out + n;
+        c->z.avail_out = zl_min(out_size - n, UINT_MAX);
+        if (compress)
+            ret = zlib.deflate(&c->z, finish && avail == *in_len ? Z_FINISH
+                               : Z_NO_FLUSH);
+        else
+            ret = zlib.inflate(&c->z, Z_NO_FLUSH);
+        *in += avail - c->z.avail_in;
+        *in_len -= avail - c->z.avail_in;
+        n = c->z.next_out - out;
+        if (ret == Z_STREAM_END) {
+            c->ended = TRUE;
+            continue;
+        }
+        if (ret != Z_OK && ret != Z_BUF_ERROR)
+            return zl_zlib_error(err, &c->z, ret);
+        if (n == out_size || ret == Z_BUF_ERROR || (*in_len == 0 && !finish))
+            break;
+        if (*in_len == 0 && !compress)
+            break;
+    }
+    *pn = n;
+    if (finish && !c->ended && !compress && *in_len == 0 && n < out_size)
+        return zl_error(err, "Z_BUF_ERROR", "unexpected end of file");
+    return 0;
+}
+
+static int zl_step_zstd(ZLCodec *c, const uint8_t **in, size_t *in_len,
+                        uint8_t *out, size_t out_size, size_t *pn, int finish,
+                        ZLError *err)
+{
+    ZSTDInBuffer ib = { *in, *in_len, 0 };
+    ZSTDOutBuffer ob = { out, out_size, 0 };
+    size_t ret;
+
+    for (;;) {
+        if (c->kind == ZL_ZSTD_COMPRESS) {
+            if (c->ended)
+                break;
+            ret = zstd.compressStream2(c->zstd_ctx, &ob, &ib, finish
+                                       ? ZSTD_e_end : ZSTD_e_continue);
+        } else {
+            if (ib.pos == ib.size)
+                break;
+            ret = zstd.decompressStream(c->zstd_ctx, &ob, &ib);
+            if (!zstd.isError(ret))
+                c->zstd_pending = ret;
+        }
+        if (zstd.isError(ret))
+            return zl_error(err, "Z_DATA_ERROR", "%s", zstd.getErrorName(ret));
+        if (c->kind == ZL_ZSTD_COMPRESS && finish && ret == 0)
+            c->ended = TRUE;
+        else if (c->kind == ZL_ZSTD_DECOMPRESS)
+            c->ended = c->zstd_pending == 0;
+        if (ob.pos == ob.size || (ib.pos == ib.size && !finish))
+            break;
+    }
+    *in += ib.pos;
+    *in_len -= ib.pos;
+    *pn = ob.pos;
+    if (finish && c->kind == ZL_ZSTD_DECOMPRESS && !c->ended &&
+        *in_len == 0 && ob.pos < ob.size)
+        return zl_error(err, "Z_BUF_ERROR", "unexpected end of file");
+    return 0;
+}
+
+QJSXCodec *qjsx_codec_new(const char *kind, int level, char *err, size_t err_size)
+{
+    ZLOptions o = { .window_bits = 15, .mem_level = 8 };
+    QJSXCodec *c;
+    ZLError e;
+    size_t k;
+
+    for (k = 0; k < countof(zl_kind_names); k++) {
+        if (!strcmp(kind, zl_kind_names[k]))
+            break;
+    }
+    if (k == countof(zl_kind_names)) {
+        snprintf(err, err_size, "unknown compression kind: %s", kind);
+        return NULL;
+    }
+    o.level = level != -1 ? level : zl_is_zstd(k) ? 3 : -1;
+    c = malloc(sizeof(*c));
+    if (!c) {
+        snprintf(err, err_size, "out of memory");
+        return NULL;
+    }
+    if (zl_codec_init(&c->codec, k, &o, &e)) {
+        zl_codec_end(&c->codec);
+        free(c);
+        snprintf(err, err_size, "%s", e.msg);
+        return NULL;
+    }
+    return c;
+}
+
+ptrdiff_t qjsx_codec_run(QJSXCodec *c, const uint8_t **in, size_t *in_len,
+                         uint8_t *out, size_t out_size, int finish,
+                         int *ended, char *err, size_t err_size)
+{
+    ZLError e;
+    size_t n = 0;
+    int ret;
+
+    if (zl_is_zstd(c->codec.kind))
+        ret = zl_step_zstd(&c->codec, in, in_len, out, out_size, &n, finish, &e);
+    else
+        ret = zl_step_zlib(&c->codec, in, in_len, out, out_size, &n, finish, &e);
+    if (ret) {
+        snprintf(err, err_size, "%s", e.msg);
+        return -1;
+    }
+    *ended = c->codec.ended;
+    return n;
+}
+
+void qjsx_codec_free(QJSXCodec *c)
+{
+    if (c) {
+        zl_codec_end(&c->codec);
+        free(c);
+    }
+}
+
+/* JavaScript bindings */
+
+static JSClassID js_zlib_stream_class_id;
+static JSClassID js_zlib_job_class_id;
+
+typedef struct ZLJob {
+    pthread_t thread;
+    int fds[2];             /* the thread writes to fds[1] when it is done */
+    BOOL joined;
+    ZLKind kind;
+    ZLOptions opts;
+    uint8_t *input;
+    size_t input_len;
+    ZLOut out;
+    ZLError err;
+    int ret;
+} ZLJob;
+
+typedef struct ZLStreamObj {
+    ZLCodec codec;
+    ZLOptions opts;
+} ZLStreamObj;
+
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    const char *str;
+} ZLBytes;
+
+static JSValue zl_throw(JSContext *ctx, const ZLError *err)
+{
+    JSValue e = JS_NewError(ctx);
+
+    if (JS_IsException(e))
+        return e;
+    JS_DefinePropertyValueStr(ctx, e, "message", JS_NewString(ctx, err->msg),
+                              JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE);
+    JS_DefinePropertyValueStr(ctx, e, "code", JS_NewString(ctx, err->code),
+                              JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE);
+    return JS_Throw(ctx, e);
+}
+
+/* DataViews have no accessor in the C API: go through buffer/byteOffset */
+static int zl_get_data_view(JSContext *ctx, ZLBytes *b, JSValueConst val)
+{
+    JSValue buf, v;
+    uint64_t offset, length;
+    size_t size;
+    int ret = -1;
+
+    buf = JS_GetPropertyStr(ctx, val, "buffer");
+    if (JS_IsException(buf))
+        goto fail;
+    b->data = JS_GetArrayBuffer(ctx, &size, buf);
+    if (!b->data)
+        goto fail;
+    v = JS_GetPropertyStr(ctx, val, "byteOffset");
+    if (JS_ToIndex(ctx, &offset, v)) {
+        JS_FreeValue(ctx, v);
+        goto fail;
+    }
+    JS_FreeValue(ctx, v);
+    v = JS_GetPropertyStr(ctx, val, "byteLength");
+    if (JS_ToIndex(ctx, &length, v)) {
+        JS_FreeValue(ctx, v);
+        goto fail;
+    }
+    JS_FreeValue(ctx, v);
+    if (offset > size || length > size - offset)
+        goto fail;
+    /* the view keeps the buffer alive */
+    b->data += offset;
+    b->len = length;
+    ret = 0;
+ fail:
+    if (ret)
+        JS_FreeValue(ctx, JS_GetException(ctx));
+    JS_FreeValue(ctx, buf);
+    return ret;
+}
+
+static int zl_get_bytes(JSContext *ctx, ZLBytes *b, JSValueConst val)
+{
+    size_t offset, length, elem_size, size;
+    JSValue buf;
+
+    b->str = NULL;
+    if (JS_IsString(val)) {
+        b->str = JS_ToCStringLen(ctx, &b->len, val);
+        if (!b->str)
+            return -1;
+        b->data = (const uint8_t *)b->str;
+        return 0;
+    }
+    if (JS_IsObject(val) && JS_GetTypedArrayType(val) >= 0) {
+        buf = JS_GetTypedArrayBuffer(ctx, val, &offset, &length, &elem_size);
+        if (JS_IsException(buf))
+            return -1;
+        b->data = JS_GetArrayBuffer(ctx, &size, buf);
+        JS_FreeValue(ctx, buf);
+        if (!b->data)
+            return -1;
+        b->data += offset;
+        b->len = length;
+        return 0;
+    }
+    if (JS_IsObject(val)) {
+        b->data = JS_GetArrayBuffer(ctx, &b->len, val);
+        if (b->data)
+            return 0;
+        JS_FreeValue(ctx, JS_GetException(ctx));
+        if (zl_get_data_view(ctx, b, val) == 0)
+            return 0;
+    }
+    JS_ThrowTypeError(ctx, "data must be a string, ArrayBuffer, typed array or DataView");
+    return -1;
+}
+
+static void zl_free_bytes(JSContext *ctx, ZLBytes *b)
+{
+    if (b->str)
+        JS_FreeCString(ctx, b->str);
+}
+
+static int zl_get_kind(JSContext *ctx, JSValueConst val, ZLKind *pkind)
+{
+    const char *name = JS_ToCString(ctx, val);
+
+    if (!name)
+        return -1;
+    for (size_t i = 0; i < countof(zl_kind_names); i++) {
+        if (!strcmp(name, zl_kind_names[i])) {
+            *pkind = i;
+            JS_FreeCString(ctx, name);
+            return 0;
+        }
+    }
+    JS_ThrowTypeError(ctx, "unknown compression kind: %s", name);
+    JS_FreeCString(ctx, name);
+    return -1;
+}
+
+static int zl_get_int(JSContext *ctx, JSValueConst obj, const char *name,
+                      uint32_t index, int min, int max, int *pval)
+{
+    JSValue v;
+    int32_t n;
+
+    if (name)
+        v = JS_GetPropertyStr(ctx, obj, name);
+    else
+        v = JS_GetPropertyUint32(ctx, obj, index);
+    if (JS_IsException(v))
+        return -1;
+    if (JS_IsUndefined(v))
+        return 0;
+    if (JS_ToInt32(ctx, &n, v)) {
+        JS_FreeValue(ctx, v);
+        return -1;
+    }
+    JS_FreeValue(ctx, v);
+    if (n < min || n > max) {
+        if (name)
+            JS_ThrowRangeError(ctx, "The value of \"options.%s\" is out of range. "
+                               "It must be >= %d and <= %d. Received %d",
+                               name, min, max, n);
+        else
+            JS_ThrowRangeError(ctx, "zstd parameter %u is out of range", index);
+        return -1;
+    }
+    *pval = n;
+    return 0;
+}
+
+static int zl_get_options(JSContext *ctx, ZLKind kind, JSValueConst obj,
+                          ZLOptions *o)
+{
+    JSValue v, params;
+    int ret = 0;
+
+    memset(o, 0, sizeof(*o));
+    o->level = zl_is_zstd(kind) ? 3 : -1;
+    o->window_bits = 15;
+    o->mem_level = 8;
+    o->threads = zl_cpu_count();
+    o->max_output = ZL_MAX_OUTPUT;
+    if (JS_IsUndefined(obj) || JS_IsNull(obj))
+        return 0;
+    if (!JS_IsObject(obj)) {
+        JS_ThrowTypeError(ctx, "options must be an object");
+        return -1;
+    }
+    if (zl_is_zstd(kind)) {
+        if (zl_get_int(ctx, obj, "level", 0, -131072, 22, &o->level))
+            return -1;
+        params = JS_GetPropertyStr(ctx, obj, "params");
+        if (JS_IsException(params))
+            return -1;
+        if (JS_IsObject(params))
+            ret = zl_get_int(ctx, params, NULL, ZSTD_c_compressionLevel,
+                             -131072, 22, &o->level) ||
+                zl_get_int(ctx, params, NULL, ZSTD_c_checksumFlag, 0, 1,
+                           &o->zstd_checksum) ||
+                zl_get_int(ctx, params, NULL, ZSTD_c_nbWorkers, 0, 64,
+                           &o->threads);
+        JS_FreeValue(ctx, params);
+        if (ret)
+            return -1;
+    } else if (zl_get_int(ctx, obj, "level", 0, -1, 9, &o->level) ||
+               zl_get_int(ctx, obj, "windowBits", 0,
+                          zl_is_compress(kind) ? 9 : 0, 15, &o->window_bits) ||
+               zl_get_int(ctx, obj, "memLevel", 0, 1, 9, &o->mem_level) ||
+               zl_get_int(ctx, obj, "strategy", 0, 0, 4, &o->strategy)) {
+        return -1;
+    }
+    if (o->window_bits == 0)
+        o->window_bits = 15; /* inflate: use the window size in the header */
+    if (zl_get_int(ctx, obj, "threads", 0, 1, 64, &o->threads))
+        return -1;
+    v = JS_GetPropertyStr(ctx, obj, "maxOutputLength");
+    if (JS_IsException(v))
+        return -1;
+    if (!JS_IsUndefined(v)) {
+        uint64_t n;
+        ret = JS_ToIndex(ctx, &n, v);
+        if (!ret && (n < 1 || n > ZL_MAX_OUTPUT)) {
+            JS_ThrowRangeError(ctx, "The value of \"options.maxOutputLength\" "
+                               "is out of range");
+            ret = -1;
+        }
+        o->max_output = n;
+    }
+    JS_FreeValue(ctx, v);
+    return ret;
+}
+
+static void zl_free_output(JSRuntime *rt, void *opaque, void *ptr)
+{
+    free(ptr);
+}
+
+static JSValue zl_new_output(JSContext *ctx, ZLOut *out)
+{
+    JSValue ab;
+
+    /* give back what the size estimate over-allocated */
+    if (out->len < out->size / 2) {
+        uint8_t *buf = realloc(out->buf, zl_max(out->len, 1));
+        if (buf)
+            out->buf = buf;
+    }
+    ab = JS_NewArrayBuffer(ctx, out->buf, out->len, zl_free_output, NULL, FALSE);
+    if (JS_IsException(ab))
+        free(out->buf);
+    out->buf = NULL;
+    return ab;
+}
+
+static JSValue js_zlib_process(JSContext *ctx, JSValueConst this_val,
+                               int argc, JSValueConst *argv)
+{
+    ZLOut out = { 0 };
+    ZLOptions opts;
+    ZLError err;
+    ZLBytes in;
+    ZLKind kind;
+    int ret;
+
+    if (zl_get_kind(ctx, argv[0], &kind) ||
+        zl_get_options(ctx, kind, argc > 2 ? argv[2] : JS_UNDEFINED, &opts) ||
+        zl_get_bytes(ctx, &in, argv[1]))
+        return JS_EXCEPTION;
+    ret = zl_process(kind, &opts, in.data, in.len, &out, &err);
+    zl_free_bytes(ctx, &in);
+    if (ret) {
+        free(out.buf);
+        return zl_throw(ctx, &err);
+    }
+    return zl_new_output(ctx, &out);
+}
+
+static JSValue js_zlib_crc32(JSContext *ctx, JSValueConst this_val,
+                             int argc, JSValueConst *argv)
+{
+    uint32_t crc = 0;
+    ZLBytes in;
+
+    if (argc > 1 && JS_ToUint32(ctx, &crc, argv[1]))
+        return JS_EXCEPTION;
+    if (!zl_load(ZL_GZIP)) {
+        ZLError err;
+        zl_error(&err, "ERR_ZLIB_INITIALIZATION_FAILED", "cannot load libz");
+        return zl_throw(ctx, &err);
+    }
+    if (zl_get_bytes(ctx, &in, argv[0]))
+        return JS_EXCEPTION;
+    for (size_t off = 0; off < in.len; off += UINT_MAX)
+        crc = zlib.crc32(crc, in.data + off, zl_min(in.len - off, UINT_MAX));
+    zl_free_bytes(ctx, &in);
+    return JS_NewUint32(ctx, crc);
+}
+
+static JSValue js_zlib_available(JSContext *ctx, JSValueConst this_val,
+                                 int argc, JSValueConst *argv)
+{
+    ZLKind kind;
+
+    if (zl_get_kind(ctx, argv[0], &kind))
+        return JS_EXCEPTION;
+    return JS_NewBool(ctx, zl_load(kind));
+}
+
+/* Streams */
+
+static void js_zlib_stream_finalizer(JSRuntime *rt, JSValue val)
+{
+    ZLStreamObj *s = JS_GetOpaque(val, js_zlib_stream_class_id);
+
+    if (s) {
+        zl_codec_end(&s->codec);
+        js_free_rt(rt, s);
+    }
+}
+
+static JSValue js_zlib_stream_constructor(JSContext *ctx, JSValueConst new_target,
+                                          int argc, JSValueConst *argv)
+{
+    ZLStreamObj *s;
+    JSValue obj, proto;
+    ZLError err;
+    ZLKind kind;
+
+    proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+    if (JS_IsException(proto))
+        return proto;
+    obj = JS_NewObjectProtoClass(ctx, proto, js_zlib_stream_class_id);
+    JS_FreeValue(ctx, proto);
+    if (JS_IsException(obj))
+        return obj;
+    s = js_mallocz(ctx, sizeof(*s));
+    if (!s)
+        goto fail;
+    JS_SetOpaque(obj, s);
+    if (zl_get_kind(ctx, argv[0], &kind) ||
+        zl_get_options(ctx, kind, argc > 1 ? argv[1] : JS_UNDEFINED, &s->opts))
+        goto fail;
+    if (zl_codec_init(&s->codec, kind, &s->opts, &err)) {
+        zl_throw(ctx, &err);
+        goto fail;
+    }
+    return obj;
+ fail:
+    JS_FreeValue(ctx, obj);
+    return JS_EXCEPTION;
+}
+
+/* stream.write(chunk, flush) -> the output produced so far */
+static JSValue js_zlib_stream_write(JSContext *ctx, JSValueConst this_val,
+                                    int argc, JSValueConst *argv)
+{
+    ZLStreamObj *s = JS_GetOpaque2(ctx, this_val, js_zlib_stream_class_id);
+    ZLOut out = { 0 };
+    ZLBytes in = { (const uint8_t *)"", 0, NULL };
+    ZLError err;
+    int flush = ZL_FLUSH_NONE, ret;
+
+    if (!s)
+        return JS_EXCEPTION;
+    if (!s->codec.initialized)
+        return JS_ThrowTypeError(ctx, "stream is closed");
+    if (argc > 1 && JS_ToInt32(ctx, &flush, argv[1]))
+        return JS_EXCEPTION;
+    if (flush < ZL_FLUSH_NONE || flush > ZL_FLUSH_FINISH)
+        return JS_ThrowRangeError(ctx, "invalid flush mode %d", flush);
+    if (!JS_IsUndefined(argv[0]) && !JS_IsNull(argv[0]) &&
+        zl_get_bytes(ctx, &in, argv[0]))
+        return JS_EXCEPTION;
+    out.limit = s->opts.max_output;
+    ret = zl_codec_write(&s->codec, in.data, in.len, flush, &out, &err);
+    zl_free_bytes(ctx, &in);
+    if (ret) {
+        free(out.buf);
+        return zl_throw(ctx, &err);
+    }
+    return zl_new_output(ctx, &out);
+}
+
+static JSValue js_zlib_stream_close(JSContext *ctx, JSValueConst this_val,
+                                    int argc, JSValueConst *argv)
+{
+    ZLStreamObj *s = JS_GetOpaque2(ctx, this_val, js_zlib_stream_class_id);
+
+    if (!s)
+        return JS_EXCEPTION;
+    zl_codec_end(&s->codec);
+    return JS_UNDEFINED;
+}
+
+static JSValue js_zlib_stream_get_ended(JSContext *ctx, JSValueConst this_val)
+{
+    ZLStreamObj *s = JS_GetOpaque2(ctx, this_val, js_zlib_stream_class_id);
+
+    if (!s)
+        return JS_EXCEPTION;
+    return JS_NewBool(ctx, s->codec.ended);
+}
+
+/* Background jobs */
+
+static void *zl_job_thread(void *arg)
+{
+    ZLJob *job = arg;
+    char c = 1;
+
+    job->ret = zl_process(job->kind, &job->opts, job->input, job->input_len,
+                          &job->out, &job->err);
+    while (write(job->fds[1], &c, 1) < 0 && errno == EINTR)
+        continue;
+    return NULL;
+}
+
+static void zl_job_join(ZLJob *job)
+{
+    if (job->joined)
+        return;
+    pthread_join(job->thread, NULL);
+    job->joined = TRUE;
+    close(job->fds[0]);
+    close(job->fds[1]);
+    free(job->input);
+    job->input = NULL;
+}
+
+static void js_zlib_job_finalizer(JSRuntime *rt, JSValue val)
+{
+    ZLJob *job = JS_GetOpaque(val, js_zlib_job_class_id);
+
+    if (job) {
+        zl_job_join(job);
+        free(job->out.buf);
+        js_free_rt(rt, job);
+    }
+}
+
+static JSValue js_zlib_start(JSContext *ctx, JSValueConst this_val,
+                             int argc, JSValueConst *argv)
+{
+    ZLJob *job;
+    ZLBytes in;
+    JSValue obj;
+
+    obj = JS_NewObjectClass(ctx, js_zlib_job_class_id);
+    if (JS_IsException(obj))
+        return obj;
+    job = js_mallocz(ctx, sizeof(*job));
+    if (!job)
+        goto fail;
+    job->joined = TRUE;
+    JS_SetOpaque(obj, job);
+    if (zl_get_kind(ctx, argv[0], &job->kind) ||
+        zl_get_options(ctx, job->kind, argc > 2 ? argv[2] : JS_UNDEFINED, &job->opts) ||
+        zl_get_bytes(ctx, &in, argv[1]))
+        goto fail;
+    /* the thread works on a copy: the caller may change or detach the
+       buffer before the job is done */
+    job->input = malloc(zl_max(in.len, 1));
+    if (!job->input) {
+        zl_free_bytes(ctx, &in);
+        JS_ThrowOutOfMemory(ctx);
+        goto fail;
+    }
+    memcpy(job->input, in.data, in.len);
+    job->input_len = in.len;
+    zl_free_bytes(ctx, &in);
+    if (pipe(job->fds) < 0) {
+        JS_ThrowTypeError(ctx, "pipe: %s", strerror(errno));
+        goto fail;
+    }
+    if (pthread_create(&job->thread, NULL, zl_job_thread, job)) {
+        close(job->fds[0]);
+        close(job->fds[1]);
+        JS_ThrowTypeError(ctx, "cannot start a compression thread");
+        goto fail;
+    }
+    job->joined = FALSE;
+    return obj;
+ fail:
+    JS_FreeValue(ctx, obj);
+    return JS_EXCEPTION;
+}
+
+static JSValue js_zlib_job_get_fd(JSContext *ctx, JSValueConst this_val)
+{
+    ZLJob *job = JS_GetOpaque2(ctx, this_val, js_zlib_job_class_id);
+
+    if (!job)
+        return JS_EXCEPTION;
+    return job->joined ? JS_NULL : JS_NewInt32(ctx, job->fds[0]);
+}
+
+/* job.result(): waits for the job if needed */
+static JSValue js_zlib_job_result(JSContext *ctx, JSValueConst this_val,
+                                  int argc, JSValueConst *argv)
+{
+    ZLJob *job = JS_GetOpaque2(ctx, this_val, js_zlib_job_class_id);
+
+    if (!job)
+        return JS_EXCEPTION;
+    if (job->joined && !job->out.buf && !job->ret)
+        return JS_ThrowTypeError(ctx, "job result was already taken");
+    zl_job_join(job);
+    if (job->ret) {
+        free(job->out.buf);
+        job->out.buf = NULL;
+        job->ret = 0;
+        return zl_throw(ctx, &job->err);
+    }
+    return zl_new_output(ctx, &job->out);
+}
+
+static JSClassDef js_zlib_stream_class = {
+    "Stream",
+    .finalizer = js_zlib_stream_finalizer,
+};
+
+static JSClassDef js_zlib_job_class = {
+    "Job",
+    .finalizer = js_zlib_job_finalizer,
+};
+
+static const JSCFunctionListEntry js_zlib_stream_proto_funcs[] = {
+    JS_CFUNC_DEF("write", 2, js_zlib_stream_write ),
+    JS_CFUNC_DEF("close", 0, js_zlib_stream_close ),
+    JS_CGETSET_DEF("ended", js_zlib_stream_get_ended, NULL ),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Stream", JS_PROP_CONFIGURABLE ),
+};
+
+static const JSCFunctionListEntry js_zlib_job_proto_funcs[] = {
+    JS_CGETSET_DEF("fd", js_zlib_job_get_fd, NULL ),
+    JS_CFUNC_DEF("result", 0, js_zlib_job_result ),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Job", JS_PROP_CONFIGURABLE ),
+};
+
+static const JSCFunctionListEntry js_zlib_funcs[] = {
+    JS_CFUNC_DEF("process", 3, js_zlib_process ),
+    JS_CFUNC_DEF("start", 3, js_zlib_start ),
+    JS_CFUNC_DEF("crc32", 2, js_zlib_crc32 ),
+    JS_CFUNC_DEF("available", 1, js_zlib_available ),
+    JS_PROP_INT32_DEF("FLUSH_NONE", ZL_FLUSH_NONE, JS_PROP_CONFIGURABLE ),
+    JS_PROP_INT32_DEF("FLUSH_SYNC", ZL_FLUSH_SYNC, JS_PROP_CONFIGURABLE ),
+    JS_PROP_INT32_DEF("FLUSH_FINISH", ZL_FLUSH_FINISH, JS_PROP_CONFIGURABLE ),
+};
+
+static int js_zlib_init(JSContext *ctx, JSModuleDef *m)
+{
+    JSRuntime *rt = JS_GetRuntime(ctx);
+    JSValue proto, ctor;
+
+    JS_NewClassID(rt, &js_zlib_stream_class_id);
+    JS_NewClass(rt, js_zlib_stream_class_id, &js_zlib_stream_class);
+    proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, proto, js_zlib_stream_proto_funcs,
+                               countof(js_zlib_stream_proto_funcs));
+    ctor = JS_NewCFunction2(ctx, js_zlib_stream_constructor, "Stream", 2,
+                            JS_CFUNC_constructor, 0);
+    JS_SetConstructor(ctx, ctor, proto);
+    JS_SetClassProto(ctx, js_zlib_stream_class_id, proto);
+    JS_SetModuleExport(ctx, m, "Stream", ctor);
+
+    JS_NewClassID(rt, &js_zlib_job_class_id);
+    JS_NewClass(rt, js_zlib_job_class_id, &js_zlib_job_class);
+    proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, proto, js_zlib_job_proto_funcs,
+                               countof(js_zlib_job_proto_funcs));
+    JS_SetClassProto(ctx, js_zlib_job_class_id, proto);
+
+    return JS_SetModuleExportList(ctx, m, js_zlib_funcs, countof(js_zlib_funcs));
+}
+
+JSModuleDef *js_init_module_qjsx_zlib(JSContext *ctx, const char *module_name)
+{
+    JSModuleDef *m;
+    m = JS_NewCModule(ctx, module_name, js_zlib_init);
+    if (!m)
+        return NULL;
+    JS_AddModuleExportList(ctx, m, js_zlib_funcs, countof(js_zlib_funcs));
+    JS_AddModuleExport(ctx, m, "Stream");
+    return m;
+}
@@ -0,0 +1,41 @@
+/*
+ * QJSX zlib/zstd codecs for native modules
+ *
+ * Incremental compression and decompression between caller-provided
+ * buffers, for native modules that compress what they read or write
+ * themselves (qjsx:tar). Implemented in qjsx-zlib.c, which loads the
+ * system zlib and libzstd on first use.
+ */
+
+#ifndef QJSX_ZLIB_H
+#define QJSX_ZLIB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct QJSXCodec QJSXCodec;
+
+/*
+ * Create a codec. kind is a node:zlib name ("gzip", "gunzip", "deflate",
+ * "zstdCompress", "zstdDecompress", ...); level is ignored when
+ * decompressing, -1 selects the default. Returns NULL with a message in err
+ * if the kind is unknown or its library cannot be loaded.
+ */
+QJSXCodec *qjsx_codec_new(const char *kind, int level, char *err, size_t err_size);
+
+/*
+ * Run the codec on *in_len bytes at *in, advancing both past the input it
+ * consumed, and write at most out_size bytes to out. Stops when out is full
+ * or the input is used up; with finish set (no more input will follow) a
+ * compressor also writes the end of the stream. *ended is set once the end
+ * of the stream was written or, when decompressing, reached: bytes after
+ * it are left in *in. Returns the number of bytes written to out, or -1
+ * with a message in err.
+ */
+ptrdiff_t qjsx_codec_run(QJSXCodec *c, const uint8_t **in, size_t *in_len,
+                         uint8_t *out, size_t out_size, int finish,
+                         int *ended, char *err, size_t err_size);
+
+void qjsx_codec_free(QJSXCodec *c);
+
+#endif /* QJSX_ZLIB_H */
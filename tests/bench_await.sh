@@ -0,0 +1,64 @@
+#!/bin/sh
+# Microbenchmark: await throughput, after checking that await still orders
+# its continuations as the spec says (not part of run_all.sh, run with
+# `make bench-await`)
+
+set -e
+cd "$(dirname "$0")/.."
+
+TEMP_DIR=$(mktemp -d)
+trap "rm -rf $TEMP_DIR" EXIT
+
+cat > "$TEMP_DIR/bench_await.js" << 'EOF'
+const N = 500000;
+
+// Spec ordering of await against then() chains: an await on a native
+// promise takes one job, on a thenable three, and a fast path must keep it so
+async function order() {
+    const log = [];
+    const settled = Promise.resolve();
+    const thenable = { then(resolve) { log.push("then"); resolve(); } };
+    const a = (async () => { log.push("a0"); await 1; log.push("a1"); await settled; log.push("a2"); })();
+    const b = (async () => { log.push("b0"); await thenable; log.push("b1"); })();
+    const rejected = Promise.reject(new Error("x"));
+    const c = (async () => { try { await rejected; } catch { log.push("c1"); } })();
+    settled.then(() => log.push("p1")).then(() => log.push("p2")).then(() => log.push("p3"));
+    await Promise.all([a, b, c]);
+    return log.join(" ");
+}
+const expected = "a0 b0 a1 then c1 p1 a2 b1 p2 p3";
+
+async function bench(name, fn) {
+    await fn(1000);  // warm up
+    const start = Date.now();
+    await fn(N);
+    const ns = (Date.now() - start) * 1e6 / N;
+    console.log(`${name.padEnd(36)} ${ns.toFixed(1).padStart(7)} ns/await`);
+}
+
+const got = await order();
+if (got !== expected) {
+    console.log(`await ordering changed:\n  got      ${got}\n  expected ${expected}`);
+    throw new Error("await ordering");
+}
+console.log("await ordering matches the spec");
+
+const resolved = Promise.resolve(42);
+const thenable = { then(resolve) { resolve(42); } };
+const identity = async x => x;
+
+await bench("await value", async n => { let s = 0; for (let i = 0; i < n; i++) s += await i; return s; });
+await bench("await resolved promise", async n => { let s = 0; for (let i = 0; i < n; i++) s += await resolved; return s; });
+await bench("await async call", async n => { let s = 0; for (let i = 0; i < n; i++) s += await identity(i); return s; });
+await bench("await thenable", async n => { let s = 0; for (let i = 0; i < n; i++) s += await thenable; return s; });
+await bench("then() chain (baseline)", n => {
+    let p = resolved;
+    for (let i = 0; i < n; i++) p = p.then(x => x);
+    return p;
+});
+EOF
+
+for BIN in qjsx qjsx-node; do
+    echo "== $BIN"
+    ${QJSX_BIN_DIR}/$BIN "$TEMP_DIR/bench_await.js"
+done
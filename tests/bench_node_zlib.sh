@@ -0,0 +1,102 @@
+#!/bin/sh
+# Benchmark: node:zlib compared with running gzip/zstd as subprocesses
+# (not part of run_all.sh, run with `make bench-zlib`; BENCH_MB sets the
+# input size, 100 by default)
+
+set -e
+cd "$(dirname "$0")/.."
+
+TEMP_DIR=$(mktemp -d)
+trap "rm -rf $TEMP_DIR" EXIT
+
+BENCH_MB=${BENCH_MB:-100}
+
+# Log-like text, compresses about 4:1 like typical service logs
+awk -v mb="$BENCH_MB" 'BEGIN {
+    srand(42);
+    split("GET POST PUT DELETE", m, " ");
+    split("/api/items /api/users /static/app.js /health /api/orders", p, " ");
+    while (n < mb * 1048576) {
+        s = sprintf("2024-01-%02d %02d:%02d:%02d %s %s?id=%d %d %dms\n",
+                    1 + int(rand() * 28), int(rand() * 24), int(rand() * 60), int(rand() * 60),
+                    m[1 + int(rand() * 4)], p[1 + int(rand() * 5)], int(rand() * 1000000),
+                    rand() < 0.95 ? 200 : 500, int(rand() * 900));
+        printf "%s", s;
+        n += length(s);
+    }
+}' > "$TEMP_DIR/input.txt"
+
+cat > "$TEMP_DIR/bench_zlib.js" << 'EOF'
+import * as zlib from "node:zlib";
+import * as std from "std";
+import * as os from "os";
+
+const dir = scriptArgs[1];
+const has = (cmd) => os.exec(["sh", "-c", `command -v ${cmd} >/dev/null`]) === 0;
+
+const readFile = (path) => {
+    const f = std.open(path, "rb");
+    f.seek(0, std.SEEK_END);
+    const size = f.tell();
+    f.seek(0, std.SEEK_SET);
+    const buf = new ArrayBuffer(size);
+    f.read(buf, 0, size);
+    f.close();
+    return new Uint8Array(buf);
+};
+
+const writeFile = (path, data) => {
+    const f = std.open(path, "wb");
+    f.write(data.buffer, data.byteOffset, data.length);
+    f.close();
+};
+
+// what scripts do without a native module: hand the data to a subprocess
+// through files and read the result back in
+const subprocess = (argv, data) => {
+    writeFile(dir + "/sub.in", data);
+    const out = os.open(dir + "/sub.out", os.O_WRONLY | os.O_CREAT | os.O_TRUNC, 0o644);
+    const input = os.open(dir + "/sub.in", os.O_RDONLY);
+    const status = os.exec(argv, { stdin: input, stdout: out });
+    os.close(input);
+    os.close(out);
+    if (status !== 0) throw new Error(argv[0] + " exited with " + status);
+    return readFile(dir + "/sub.out");
+};
+
+const input = readFile(dir + "/input.txt");
+const mb = input.length / 1048576;
+
+const bench = async (name, fn, size = mb) => {
+    const start = Date.now();
+    const out = await fn();
+    const secs = (Date.now() - start) / 1000;
+    console.log(`${name.padEnd(40)} ${(size / secs).toFixed(0).padStart(6)} MB/s ${(out.length / 1048576).toFixed(1).padStart(8)} MB`);
+    return out;
+};
+
+console.log(`input: ${mb.toFixed(0)} MB`);
+const gz = await bench("gzip -6 subprocess", () => subprocess(["gzip", "-6", "-c"], input));
+await bench("gzipSync level 6, 1 thread", () => zlib.gzipSync(input, { level: 6, threads: 1 }));
+await bench("gzipSync level 6, all CPUs", () => zlib.gzipSync(input, { level: 6 }));
+await bench("promises.gzip level 6, all CPUs", () => zlib.promises.gzip(input, { level: 6 }));
+await bench("gzip -d subprocess", () => subprocess(["gzip", "-d", "-c"], gz));
+await bench("gunzipSync", () => zlib.gunzipSync(gz));
+
+if (has("zstd")) {
+    let ok = true;
+    try { zlib.zstdCompressSync("x"); } catch (e) { ok = false; }
+    if (ok) {
+        const zs = await bench("zstd -3 subprocess", () => subprocess(["zstd", "-3", "-q", "-c"], input));
+        await bench("zstdCompressSync level 3, 1 thread", () => zlib.zstdCompressSync(input, { level: 3, threads: 1 }));
+        await bench("zstdCompressSync level 3, all CPUs", () => zlib.zstdCompressSync(input, { level: 3 }));
+        await bench("zstd -d subprocess", () => subprocess(["zstd", "-d", "-q", "-c"], zs));
+        await bench("zstdDecompressSync", () => zlib.zstdDecompressSync(zs));
+    }
+}
+EOF
+
+for BIN in qjsx qjsx-node; do
+    echo "== $BIN"
+    QJSXPATH=./qjsx-node ${QJSX_BIN_DIR}/$BIN "$TEMP_DIR/bench_zlib.js" "$TEMP_DIR"
+done
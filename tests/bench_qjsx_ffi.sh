@@ -0,0 +1,55 @@
+#!/bin/sh
+# Microbenchmark: qjsx:ffi call overhead compared with plain JS calls
+# (not part of run_all.sh, run with `make bench-ffi`)
+
+set -e
+cd "$(dirname "$0")/.."
+
+TEMP_DIR=$(mktemp -d)
+trap "rm -rf $TEMP_DIR" EXIT
+
+cat > "$TEMP_DIR/bench_ffi.js" << 'EOF'
+import * as ffi from "qjsx:ffi";
+
+const N = 2000000;
+const libc = ffi.dlopen(null);
+const libm = ffi.dlopen(`libm.${ffi.suffix}.6`);
+
+function bench(name, fn) {
+    fn(1000);  // warm up
+    const start = Date.now();
+    fn(N);
+    const ns = (Date.now() - start) * 1e6 / N;
+    console.log(`${name.padEnd(36)} ${ns.toFixed(1).padStart(7)} ns/call`);
+}
+
+const jsAbs = x => x < 0 ? -x : x;
+const abs = libc.func("abs", "i32", ["i32"]);
+const sqrt = libm.func("sqrt", "f64", ["f64"]);
+const memset = libc.func("memset", "ptr", ["ptr", "i32", "u64"]);
+const strlen = libc.func("strlen", "u64", ["string"]);
+const buf = new Uint8Array(64);
+
+bench("JS function (baseline)", n => { let s = 0; for (let i = 0; i < n; i++) s += jsAbs(-i); return s; });
+bench("Math.sqrt (builtin)", n => { let s = 0; for (let i = 0; i < n; i++) s += Math.sqrt(i); return s; });
+bench("ffi abs(i32)", n => { let s = 0; for (let i = 0; i < n; i++) s += abs(-i); return s; });
+bench("ffi sqrt(f64)", n => { let s = 0; for (let i = 0; i < n; i++) s += sqrt(i); return s; });
+bench("ffi memset(Uint8Array, i32, u64)", n => { for (let i = 0; i < n; i++) memset(buf, i, 64); });
+bench("ffi strlen(string)", n => { for (let i = 0; i < n; i++) strlen("hello, world"); });
+
+// qsort of 1000 ints: one JS callback per comparison
+const cmp = ffi.callback("i32", ["ptr", "ptr"], (a, b) => 0);
+const qsort = libc.func("qsort", "void", ["ptr", "u64", "u64", "ptr"]);
+const ints = new Int32Array(1000);
+let calls = 0;
+const counting = ffi.callback("i32", ["ptr", "ptr"], () => { calls++; return 0; });
+qsort(ints, ints.length, 4, counting);
+const start = Date.now();
+for (let i = 0; i < 200; i++) qsort(ints, ints.length, 4, cmp);
+console.log(`${"ffi callback (qsort comparator)".padEnd(36)} ${((Date.now() - start) * 1e6 / (200 * calls)).toFixed(1).padStart(7)} ns/call`);
+EOF
+
+for BIN in qjsx qjsx-node; do
+    echo "== $BIN"
+    ${QJSX_BIN_DIR}/$BIN "$TEMP_DIR/bench_ffi.js"
+done
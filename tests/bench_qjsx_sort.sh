@@ -0,0 +1,62 @@
+#!/bin/sh
+# Microbenchmark: simd.sort() against TypedArray.prototype.sort() across
+# sizes and distributions (not part of run_all.sh, run with `make bench-sort`)
+
+set -e
+cd "$(dirname "$0")/.."
+
+TEMP_DIR=$(mktemp -d)
+trap "rm -rf $TEMP_DIR" EXIT
+
+cat > "$TEMP_DIR/bench_sort.js" << 'EOF'
+import * as simd from "qjsx:simd";
+
+const SIZES = [1e3, 1e4, 1e5, 1e6, 1e7];
+
+// a deterministic generator, so both sorts see the same input
+let seed = 1;
+const random = () => ((seed = Math.imul(seed ^ (seed >>> 15), 0x2c1b3c6d) + 0x9e3779b9 | 0) >>> 0) / 2 ** 32;
+
+const distributions = {
+    uniform: (T, n) => T.from({ length: n }, () => T === Float64Array ? (random() - 0.5) * 1e9 : (random() * 2 ** 32) | 0),
+    sorted: (T, n) => distributions.uniform(T, n).sort(),
+    reversed: (T, n) => distributions.uniform(T, n).sort().reverse(),
+    "few-unique": (T, n) => T.from({ length: n }, () => (random() * 16 | 0) - 8),
+    // Float64Array: NaN and both zeros among the values; Int32Array has
+    // neither, so its special values are the extremes
+    special: (T, n) => {
+        const special = T === Float64Array ? [NaN, 0, -0, Infinity, -Infinity] : [0, -1, 2147483647, -2147483648];
+        return T.from({ length: n }, (_, i) => i % 3 ? special[i % special.length] : (random() - 0.5) * 1e6);
+    },
+};
+
+const same = (a, b) => a.length === b.length && a.every((x, i) => Object.is(x, b[i]));
+
+function time(fn, input, reps) {
+    const copies = Array.from({ length: reps }, () => input.slice());
+    const start = Date.now();
+    for (const a of copies) fn(a);
+    return (Date.now() - start) / reps;
+}
+
+for (const T of [Int32Array, Float64Array]) {
+    console.log(`== ${T.name}`);
+    console.log(`${"distribution".padEnd(12)} ${"n".padStart(9)} ${"simd ms".padStart(10)} ${"sort() ms".padStart(10)} ${"speedup".padStart(8)}`);
+    for (const [name, make] of Object.entries(distributions)) {
+        for (const n of SIZES) {
+            const input = make(T, n);
+            if (!same(simd.sort(input.slice()), input.slice().sort()))
+                throw new Error(`simd.sort() and sort() disagree on ${T.name} ${name} ${n}`);
+            const reps = Math.max(1, Math.min(100, 1e6 / n | 0));
+            const a = time(x => simd.sort(x), input, reps);
+            const b = time(x => x.sort(), input, reps);
+            console.log(`${name.padEnd(12)} ${String(n).padStart(9)} ${a.toFixed(2).padStart(10)} ${b.toFixed(2).padStart(10)} ${(b / Math.max(a, 0.01)).toFixed(1).padStart(7)}x`);
+        }
+    }
+}
+EOF
+
+for BIN in qjsx qjsx-node; do
+    echo "== $BIN"
+    ${QJSX_BIN_DIR}/$BIN "$TEMP_DIR/bench_sort.js"
+done
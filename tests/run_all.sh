@@ -49,6 +49,21 @@ run_test "test_qjsx_node.sh" "qjsx-node Node.js Compatibility"
 run_test "test_qjsxc.sh" "qjsxc Compiler with QJSXPATH"
 run_test "test_qjsxc_dynamic.sh" "qjsxc Dynamic Script Loading"
 run_test "test_import_meta.sh" "import.meta (dirname, filename)"
+run_test "test_qjsx_simd.sh" "qjsx:simd Typed-Array Kernels"
+run_test "test_qjsx_wasm.sh" "qjsx:wasm WebAssembly Interpreter"
+run_test "test_qjsx_ffi.sh" "qjsx:ffi Native Calls"
+run_test "test_qjsx_kv.sh" "qjsx:kv Key-Value Store"
+run_test "test_qjsx_shm.sh" "qjsx:shm Shared Memory"
+run_test "test_node_zlib.sh" "node:zlib Compression"
+run_test "test_qjsx_tar.sh" "qjsx:tar Archives"
+run_test "test_node_path.sh" "node:path Paths"
+run_test "test_node_os.sh" "node:os System Info"
+run_test "test_node_events.sh" "node:events EventEmitter"
+run_test "test_node_loop.sh" "setImmediate, nextTick and queueMicrotask"
+run_test "test_node_scheduler.sh" "scheduler.postTask Priorities"
+run_test "test_node_perf_hooks.sh" "Event Loop Monitoring"
+run_test "test_performance.sh" "performance Marks, Measures and Observers"
+run_test "test_native_addons.sh" "Native .so Addon Resolution"
 
 # Summary
 echo ""
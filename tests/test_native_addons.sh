@@ -0,0 +1,120 @@
+#!/bin/sh
+# Test native .so addon resolution through QJSXPATH (qjsx-addon.h)
+
+set -e
+cd "$(dirname "$0")/.."
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+NC='\033[0m' # No Color
+
+printf "%b\n" "${BLUE}Testing native addon resolution...${NC}"
+
+TEMP_DIR=$(mktemp -d)
+trap "rm -rf $TEMP_DIR" EXIT
+
+CC=${CC:-cc}
+mkdir -p "$TEMP_DIR/modules/pkg"
+
+# A minimal addon, built against the headers qjsxc ships next to libquickjs.a
+cat > "$TEMP_DIR/hello.c" << 'EOF'
+#include <stdio.h>
+#include "qjsx-addon.h"
+
+static JSValue js_hello_greet(JSContext *ctx, JSValueConst this_val,
+                              int argc, JSValueConst *argv)
+{
+    char buf[256];
+    const char *name = JS_ToCString(ctx, argv[0]);
+    if (!name)
+        return JS_EXCEPTION;
+    snprintf(buf, sizeof(buf), "Hello, %s!", name);
+    JS_FreeCString(ctx, name);
+    return JS_NewString(ctx, buf);
+}
+
+static const JSCFunctionListEntry js_hello_funcs[] = {
+    JS_CFUNC_DEF("greet", 1, js_hello_greet),
+};
+
+static int js_hello_init(JSContext *ctx, JSModuleDef *m)
+{
+    return JS_SetModuleExportList(ctx, m, js_hello_funcs, 1);
+}
+
+QJSX_ADDON(hello)
+{
+    JSModuleDef *m = JS_NewCModule(ctx, module_name, js_hello_init);
+    if (!m)
+        return NULL;
+    JS_AddModuleExportList(ctx, m, js_hello_funcs, 1);
+    return m;
+}
+EOF
+
+# An addon recording a different ABI version must be rejected, not called
+cat > "$TEMP_DIR/stale.c" << 'EOF'
+#include <stdlib.h>
+const int qjsx_addon_abi_version = 999;
+void *js_init_module(void *ctx, const char *module_name) { abort(); }
+EOF
+
+$CC -shared -fPIC -I"${QJSX_BIN_DIR}" -o "$TEMP_DIR/modules/hello.so" "$TEMP_DIR/hello.c"
+$CC -shared -fPIC -I"${QJSX_BIN_DIR}" -o "$TEMP_DIR/modules/pkg/index.so" "$TEMP_DIR/hello.c"
+$CC -shared -fPIC -o "$TEMP_DIR/modules/stale.so" "$TEMP_DIR/stale.c"
+
+cat > "$TEMP_DIR/app.js" << 'EOF'
+import { greet } from "hello";      // modules/hello.so
+import * as pkg from "pkg";         // modules/pkg/index.so
+console.log(greet("addon"), pkg.greet("index"));
+EOF
+
+cat > "$TEMP_DIR/relative.js" << 'EOF'
+import { greet } from "./modules/hello";
+console.log(greet("relative"));
+EOF
+
+cat > "$TEMP_DIR/stale.js" << 'EOF'
+import "stale";
+EOF
+
+STATUS=0
+check() {
+    if echo "$2" | grep -q "$3"; then
+        printf "%b\n" "${GREEN}✅ $1${NC}"
+    else
+        echo "$2"
+        printf "%b\n" "${RED}❌ $1 failed!${NC}"
+        STATUS=1
+    fi
+}
+
+OUTPUT=$(QJSXPATH="$TEMP_DIR/modules" ${QJSX_BIN_DIR}/qjsx "$TEMP_DIR/app.js" 2>&1 || true)
+check "qjsx resolves name.so and name/index.so" "$OUTPUT" "Hello, addon! Hello, index!"
+
+OUTPUT=$(${QJSX_BIN_DIR}/qjsx "$TEMP_DIR/relative.js" 2>&1 || true)
+check "qjsx resolves relative addon imports" "$OUTPUT" "Hello, relative!"
+
+OUTPUT=$(QJSXPATH="$TEMP_DIR/modules" ${QJSX_BIN_DIR}/qjsx "$TEMP_DIR/stale.js" 2>&1 || true)
+check "qjsx rejects an addon built for another ABI" "$OUTPUT" "built for addon ABI 999"
+
+# qjsxc: an addon found through QJSXPATH is loaded at runtime...
+QJSXPATH="$TEMP_DIR/modules" ${QJSX_BIN_DIR}/qjsxc -o "$TEMP_DIR/app_dynamic" "$TEMP_DIR/app.js" 2>&1
+OUTPUT=$(QJSXPATH="$TEMP_DIR/modules" "$TEMP_DIR/app_dynamic" 2>&1 || true)
+check "qjsxc executable loads addons through QJSXPATH" "$OUTPUT" "Hello, addon! Hello, index!"
+
+# ...or linked in statically with -M
+$CC -c -DQJSX_ADDON_STATIC -I"${QJSX_BIN_DIR}" -o "$TEMP_DIR/hello.o" "$TEMP_DIR/hello.c"
+cat > "$TEMP_DIR/static.js" << 'EOF'
+import { greet } from "hello";
+console.log(greet("static"));
+EOF
+${QJSX_BIN_DIR}/qjsxc -e -M hello -o "$TEMP_DIR/static.c" "$TEMP_DIR/static.js"
+$CC -O2 -D_GNU_SOURCE -I"${QJSX_BIN_DIR}" -o "$TEMP_DIR/app_static" "$TEMP_DIR/static.c" \
+    "$TEMP_DIR/hello.o" "${QJSX_BIN_DIR}/libquickjs.a" -lm -ldl -lpthread
+OUTPUT=$("$TEMP_DIR/app_static" 2>&1 || true)
+check "qjsxc -M links an addon statically" "$OUTPUT" "Hello, static!"
+
+exit $STATUS
@@ -0,0 +1,116 @@
+#!/bin/sh
+# Test node:events (qjsx-node/node/events.js with emit() from the qjsx:events native module)
+
+set -e
+cd "$(dirname "$0")/.."
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+NC='\033[0m' # No Color
+
+printf "%b\n" "${BLUE}Testing node:events...${NC}"
+
+TEMP_DIR=$(mktemp -d)
+trap "rm -rf $TEMP_DIR" EXIT
+
+cat > "$TEMP_DIR/test_events.js" << 'EOF'
+import EventEmitter, { once, on, errorMonitor } from "node:events";
+import process from "node:process";
+import * as os from "os";
+
+const assert = (cond, msg) => { if (!cond) throw new Error(msg); };
+
+// the order of calls, as node:events produces it
+const out = [];
+const e = new EventEmitter();
+const a = x => out.push("a" + x), b = x => out.push("b" + x), c = x => out.push("c" + x);
+e.on("newListener", t => out.push("new:" + String(t)));
+e.on("removeListener", t => out.push("rm:" + String(t)));
+out.push(e.emit("x", 1));
+e.on("x", a); out.push(e.emit("x", 2));
+e.prependListener("x", b); e.emit("x", 3);
+e.once("x", c); e.emit("x", 4); e.emit("x", 5);
+e.on("x", function self(v) { out.push("s" + v); e.off("x", self); e.on("x", c); });
+e.emit("x", 6); e.emit("x", 7);
+out.push(e.listenerCount("x"), e.listeners("x").length, JSON.stringify(e.eventNames().map(String)));
+e.removeListener("x", a); e.emit("x", 8);
+e.removeAllListeners("x"); out.push(e.emit("x", 9), e.listenerCount("x"));
+e.on(errorMonitor, er => out.push("mon:" + er.message));
+try { e.emit("error", new Error("boom")); } catch (er) { out.push("threw:" + er.message); }
+try { e.emit("error", "str"); } catch (er) { out.push("threw:" + er.code); }
+e.on("error", er => out.push("handled:" + er.message)); e.emit("error", new Error("ok"));
+const expected = "new:removeListener false new:x a2 true new:x b3 a3 new:x b4 a4 rm:x c4 b5 a5 " +
+    "new:x b6 a6 s6 rm:x new:x b7 a7 c7 3 3 [\"newListener\",\"removeListener\",\"x\"] rm:x b8 c8 " +
+    "rm:x rm:x false 0 new:Symbol(events.errorMonitor) mon:boom threw:boom mon:undefined " +
+    "threw:ERR_UNHANDLED_ERROR new:error mon:ok handled:ok";
+assert(out.join(" ") === expected, "call order: " + out.join(" "));
+console.log("✅ on, once, prependListener, removeListener and errorMonitor");
+
+// arguments, this, more listeners than emit() keeps on the stack, and exceptions
+class Sub extends EventEmitter {}
+const s = new Sub();
+let seen = 0;
+s.on("n", function (x, y, z) { assert(this === s && x === 1 && y === "2" && z === undefined, "arguments"); seen++; });
+s.setMaxListeners(0);
+for (let i = 0; i < 40; i++) s.on("m", () => seen++);
+assert(s.emit("n", 1, "2") && s.emit("m") && seen === 41, "40 listeners");
+s.on("t", () => { throw new Error("from listener"); });
+s.on("t", () => seen++);
+let threw = false;
+try { s.emit("t"); } catch (er) { threw = er.message === "from listener"; }
+assert(threw && seen === 41, "an exception stops emit()");
+assert(new EventEmitter().emit("nothing") === false, "no listeners");
+console.log("✅ arguments, many listeners and exceptions");
+
+// events.once() and events.on()
+const [x, y] = await Promise.all([once(e, "y"), Promise.resolve().then(() => e.emit("y", 1, 2))]).then(r => r[0]);
+assert(x === 1 && y === 2, "once() resolves with the arguments");
+e.removeAllListeners("error");
+const pending = once(e, "z");
+e.emit("error", new Error("zz"));
+assert(await pending.then(() => "", er => er.message) === "zz", "once() rejects on error");
+const it = on(e, "q", { close: ["done"] });
+e.emit("q", 1); e.emit("q", 2);
+setTimeout(() => { e.emit("q", 3); e.emit("done"); }, 1);
+const got = [];
+for await (const [v] of it) got.push(v);
+assert(got.join() === "1,2,3" && e.listenerCount("q") === 0, "on() iterates until close");
+console.log("✅ events.once and events.on");
+
+// process is an EventEmitter with signal events
+assert(process instanceof EventEmitter, "process is an EventEmitter");
+const signal = new Promise(resolve => process.once("SIGTERM", (name) => resolve(name)));
+os.kill(os.getpid(), os.SIGTERM);
+const timer = os.setTimeout(() => {}, 2000);
+assert(await signal === "SIGTERM" && process.listenerCount("SIGTERM") === 0, "SIGTERM listener");
+os.clearTimeout(timer);
+// removeAllListeners() does not unhook signal handling
+process.removeAllListeners();
+assert(process.listenerCount("newListener") === 0 && process.listenerCount("removeListener") === 0,
+       "no internal listeners");
+const again = new Promise(resolve => process.on("SIGTERM", (name) => resolve(name)));
+os.kill(os.getpid(), os.SIGTERM);
+const timer2 = os.setTimeout(() => {}, 2000);
+assert(await again === "SIGTERM", "SIGTERM listener after removeAllListeners()");
+os.clearTimeout(timer2);
+process.removeAllListeners("SIGTERM");
+console.log("✅ process signals");
+
+console.log("All node:events tests passed");
+EOF
+
+STATUS=0
+for BIN in qjsx qjsx-node; do
+    OUTPUT=$(QJSXPATH=./qjsx-node ${QJSX_BIN_DIR}/$BIN "$TEMP_DIR/test_events.js" 2>&1 || true)
+    echo "$OUTPUT"
+    if echo "$OUTPUT" | grep -q "All node:events tests passed"; then
+        printf "%b\n" "${GREEN}✅ node:events tests passed with $BIN${NC}"
+    else
+        printf "%b\n" "${RED}❌ node:events tests failed with $BIN${NC}"
+        STATUS=1
+    fi
+done
+
+exit $STATUS
@@ -0,0 +1,148 @@
+#!/bin/sh
+# Test setImmediate, process.nextTick and queueMicrotask (the qjsx:loop native module)
+
+set -e
+cd "$(dirname "$0")/.."
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+NC='\033[0m' # No Color
+
+printf "%b\n" "${BLUE}Testing setImmediate, nextTick and queueMicrotask...${NC}"
+
+TEMP_DIR=$(mktemp -d)
+trap "rm -rf $TEMP_DIR" EXIT
+
+cat > "$TEMP_DIR/test_loop.js" << 'EOF'
+import process from "node:process";
+import { setImmediate, clearImmediate, queueMicrotask, runJobs, stats } from "qjsx:loop";
+import * as os from "os";
+
+const setTimeout = os.setTimeout;
+const assert = (cond, msg) => { if (!cond) throw new Error(msg); };
+const tick = () => new Promise(resolve => setImmediate(resolve));
+
+// after the main module: promise jobs, then ticks, then immediates
+const log = [];
+setImmediate(() => log.push("immediate"));
+process.nextTick(() => log.push("tick"));
+Promise.resolve().then(() => log.push("promise"));
+queueMicrotask(() => log.push("microtask"));
+await tick();
+assert(log.join() === "promise,microtask,tick,immediate", "main order: " + log.join());
+console.log("✅ main module order");
+
+// each immediate is followed by its ticks and promise jobs; immediates
+// queued by the check phase run in the next one
+log.length = 0;
+await new Promise(resolve => {
+    setImmediate(() => {
+        log.push("A");
+        process.nextTick(() => log.push("tickA"));
+        Promise.resolve().then(() => {
+            log.push("promiseA");
+            process.nextTick(() => log.push("tickFromPromiseA"));
+        });
+        setImmediate(() => { log.push("C"); resolve(); });
+    });
+    setImmediate(() => log.push("B"));
+});
+assert(log.join() === "A,tickA,promiseA,tickFromPromiseA,B,C", "check phase order: " + log.join());
+console.log("✅ check phase order");
+
+// ticks run before the promise jobs of the callback that queued them, and
+// ticks queued by ticks in the same drain
+log.length = 0;
+await new Promise(resolve => {
+    setTimeout(() => {
+        Promise.resolve().then(() => log.push("promise"));
+        process.nextTick(() => {
+            log.push("tick1");
+            process.nextTick(() => log.push("tick2"));
+        });
+        setImmediate(() => log.push("immediate"));
+        setTimeout(() => { log.push("timeout"); resolve(); }, 0);
+    }, 0);
+});
+assert(log.join() === "tick1,tick2,promise,immediate,timeout", "timer callback order: " + log.join());
+console.log("✅ timer callback order");
+
+// arguments, clearImmediate and errors
+log.length = 0;
+process.nextTick((a, b) => log.push(a + b), 1, 2);
+const id = setImmediate(() => log.push("cleared"));
+setImmediate((x) => log.push(x), "kept");
+clearImmediate(id);
+clearImmediate(undefined);
+await tick();
+assert(log.join() === "3,kept", "arguments and clearImmediate: " + log.join());
+for (const f of [setImmediate, process.nextTick, queueMicrotask]) {
+    let code;
+    try { f("nope"); } catch (e) { code = e.code; }
+    assert(code === "ERR_INVALID_ARG_TYPE", f.name + " rejects a non-function");
+}
+console.log("✅ arguments, clearImmediate and validation");
+
+// a chain of immediates neither blocks nor starves timers
+let n = 0, fired = false;
+const t0 = Date.now();
+setTimeout(() => { fired = true; }, 5);
+await new Promise(resolve => {
+    const step = () => (++n < 100000 && !fired) ? setImmediate(step) : resolve();
+    setImmediate(step);
+});
+assert(fired, `the 5 ms timer fired during ${n} immediates`);
+n = 0;
+await new Promise(resolve => {
+    const step = () => ++n < 100000 ? setImmediate(step) : resolve();
+    setImmediate(step);
+});
+assert(Date.now() - t0 < 5000, "100000 immediates take " + (Date.now() - t0) + " ms");
+console.log("✅ immediate chains");
+
+// runJobs() drains promise jobs in one batch, up to a budget
+log.length = 0;
+Promise.resolve().then(() => log.push(1)).then(() => log.push(2));
+queueMicrotask(() => log.push("m"));
+assert(runJobs(1) === 1 && log.join() === "1", "runJobs(1): " + log.join());
+assert(runJobs() === 2 && log.join() === "1,m,2", "runJobs(): " + log.join());
+assert(runJobs() === 0, "no jobs left");
+console.log("✅ runJobs");
+
+// per-phase counters
+const before = stats();
+for (let i = 0; i < 3; i++) setImmediate(() => {});
+process.nextTick(() => {});
+process.nextTick(() => {});
+await tick();
+const after = stats();
+assert(after.check - before.check === 4, "check phase ran 4 immediates, got " + (after.check - before.check));
+assert(after.ticks - before.ticks === 2, "2 ticks, got " + (after.ticks - before.ticks));
+assert(after.jobs > before.jobs && after.poll >= before.poll, "jobs and polls are counted");
+assert(after.tasks === before.tasks, "no scheduler tasks");
+console.log("✅ stats");
+
+// qjsx-node installs them as globals
+if (globalThis.setImmediate === setImmediate && globalThis.clearImmediate === clearImmediate &&
+    globalThis.queueMicrotask === queueMicrotask)
+    console.log("✅ globals installed");
+
+console.log("All loop tests passed");
+EOF
+
+STATUS=0
+for BIN in qjsx qjsx-node; do
+    OUTPUT=$(QJSXPATH=./qjsx-node ${QJSX_BIN_DIR}/$BIN "$TEMP_DIR/test_loop.js" 2>&1 || true)
+    echo "$OUTPUT"
+    if echo "$OUTPUT" | grep -q "All loop tests passed" &&
+       { [ "$BIN" = qjsx ] || echo "$OUTPUT" | grep -q "globals installed"; }; then
+        printf "%b\n" "${GREEN}✅ loop tests passed with $BIN${NC}"
+    else
+        printf "%b\n" "${RED}❌ loop tests failed with $BIN${NC}"
+        STATUS=1
+    fi
+done
+
+exit $STATUS
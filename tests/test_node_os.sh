@@ -0,0 +1,103 @@
+#!/bin/sh
+# Test node:os (qjsx-node/node/os.js on top of the qjsx:os native module)
+
+set -e
+cd "$(dirname "$0")/.."
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+NC='\033[0m' # No Color
+
+printf "%b\n" "${BLUE}Testing node:os...${NC}"
+
+TEMP_DIR=$(mktemp -d)
+trap "rm -rf $TEMP_DIR" EXIT
+
+cat > "$TEMP_DIR/test_os.js" << 'EOF'
+import os, { availableParallelism, cpus } from "node:os";
+import * as native from "qjsx:os";
+import * as std from "std";
+
+const assert = (cond, msg) => { if (!cond) throw new Error(msg); };
+const [online, affinity] = scriptArgs.slice(1).map(Number);
+
+const list = cpus();
+assert(Array.isArray(list) && list.length === online, `cpus() has the ${online} online CPUs, got ${list.length}`);
+for (const c of list) {
+    assert(typeof c.model === "string" && Number.isInteger(c.speed), "model and speed");
+    for (const k of ["user", "nice", "sys", "idle", "irq"])
+        assert(c.times[k] >= 0, "times." + k);
+}
+const n = availableParallelism();
+assert(Number.isInteger(n) && n >= 1 && n <= affinity, `availableParallelism() ${n} within the affinity mask of ${affinity}`);
+assert(os.availableParallelism === native.availableParallelism, "backed by qjsx:os");
+console.log("✅ cpus and availableParallelism");
+
+const total = os.totalmem(), free = os.freemem();
+assert(total > 0 && free > 0 && free <= total, `totalmem ${total}, freemem ${free}`);
+const meminfo = std.loadFile("/proc/meminfo");
+if (meminfo) {
+    const kb = key => Number(meminfo.match(new RegExp(key + ":\\s+(\\d+)"))[1]) * 1024;
+    assert(total <= kb("MemTotal"), "totalmem is at most the physical memory");
+}
+const load = os.loadavg();
+assert(load.length === 3 && load.every(x => x >= 0), "loadavg");
+assert(os.uptime() > 0, "uptime");
+console.log("✅ memory, loadavg and uptime");
+
+const nodes = os.numaNodes();
+assert(nodes.length >= 1 && nodes[0].id === 0, "at least node 0");
+const ids = nodes.flatMap(node => node.cpus);
+assert(new Set(ids).size === ids.length, "a CPU belongs to one node");
+assert(ids.length >= online, "every CPU is on a node");
+for (const node of nodes)
+    assert(node.totalmem >= node.freemem && node.distances.length === nodes.length, "node memory and distances");
+console.log("✅ numaNodes");
+
+assert(os.hostname().length > 0 && os.type() === std.popen("uname -s", "r").getline(), "hostname and type");
+assert(os.release() === std.popen("uname -r", "r").getline(), "release");
+assert(["x64", "arm64", "ia32", "arm"].includes(os.arch()) || os.arch() === os.machine(), "arch");
+assert(os.platform() === "linux" || os.platform() === "darwin", "platform");
+assert(os.endianness() === "LE" || os.endianness() === "BE", "endianness");
+assert(os.EOL === "\n" && os.constants.signals.SIGTERM === 15, "EOL and signals");
+assert(!os.tmpdir().endsWith("/") || os.tmpdir() === "/", "tmpdir");
+console.log("✅ system information");
+
+console.log("All node:os tests passed");
+EOF
+
+ONLINE=$(getconf _NPROCESSORS_ONLN)
+AFFINITY=$(nproc)
+
+run() {
+    OUTPUT=$(QJSXPATH=./qjsx-node "$@" 2>&1 || true)
+    echo "$OUTPUT"
+    echo "$OUTPUT" | grep -q "$EXPECTED"
+}
+
+STATUS=0
+for BIN in qjsx qjsx-node; do
+    EXPECTED="All node:os tests passed"
+    if run ${QJSX_BIN_DIR}/$BIN "$TEMP_DIR/test_os.js" "$ONLINE" "$AFFINITY"; then
+        printf "%b\n" "${GREEN}✅ node:os tests passed with $BIN${NC}"
+    else
+        printf "%b\n" "${RED}❌ node:os tests failed with $BIN${NC}"
+        STATUS=1
+    fi
+done
+
+# availableParallelism() follows the affinity mask
+if command -v taskset >/dev/null 2>&1; then
+    echo 'import os from "node:os"; console.log("parallelism", os.availableParallelism());' > "$TEMP_DIR/affinity.js"
+    EXPECTED="parallelism 1$"
+    if run taskset -c 0 ${QJSX_BIN_DIR}/qjsx-node "$TEMP_DIR/affinity.js"; then
+        printf "%b\n" "${GREEN}✅ availableParallelism() honors taskset${NC}"
+    else
+        printf "%b\n" "${RED}❌ availableParallelism() ignores taskset${NC}"
+        STATUS=1
+    fi
+fi
+
+exit $STATUS
@@ -0,0 +1,118 @@
+#!/bin/sh
+# Test node:path (qjsx-node/node/path.js on top of the qjsx:path native module)
+
+set -e
+cd "$(dirname "$0")/.."
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+NC='\033[0m' # No Color
+
+printf "%b\n" "${BLUE}Testing node:path...${NC}"
+
+TEMP_DIR=$(mktemp -d)
+trap "rm -rf $TEMP_DIR" EXIT
+
+mkdir -p "$TEMP_DIR/lib/util"
+echo 'export const where = "lib/util";' > "$TEMP_DIR/lib/util/index.js"
+
+cat > "$TEMP_DIR/test_path.js" << 'EOF'
+import path, { join, resolve, relative, posix } from "node:path";
+import * as native from "qjsx:path";
+import * as fs from "node:fs";
+import * as os from "os";
+import { where } from "./lib/../lib/./util";
+
+const assert = (cond, msg) => { if (!cond) throw new Error(msg); };
+const eq = (got, want, msg) => assert(got === want, `${msg}: got ${JSON.stringify(got)}, want ${JSON.stringify(want)}`);
+const tmp = scriptArgs[1];
+
+// expected values as printed by node's path.posix
+const cases = [
+    ["join", ["/a/b", "../c", "./d"], "/a/c/d"],
+    ["join", ["a", "", "b/"], "a/b/"],
+    ["join", [], "."],
+    ["join", ["", ""], "."],
+    ["join", ["..", "../a"], "../../a"],
+    ["normalize", ["/a//b/../../../c/."], "/c"],
+    ["normalize", ["./"], "./"],
+    ["normalize", ["a/.."], "."],
+    ["normalize", ["//a"], "/a"],
+    ["normalize", ["../a/b/../.."], ".."],
+    ["resolve", ["/a", "b", "../c"], "/a/c"],
+    ["resolve", ["/a/", "/b//"], "/b"],
+    ["relative", ["/srv/app", "/srv/data/x.json"], "../data/x.json"],
+    ["relative", ["/a/b", "/a/b"], ""],
+    ["relative", ["/a/b", "/"], "../.."],
+    ["relative", ["/", "/a"], "a"],
+    ["relative", ["/foo/bar", "/foo/barbaz"], "../barbaz"],
+    ["dirname", ["/a/b/"], "/a"],
+    ["dirname", ["a"], "."],
+    ["dirname", ["//a"], "//"],
+    ["dirname", ["/"], "/"],
+    ["basename", ["/a/b.js", ".js"], "b"],
+    ["basename", ["/a/b/"], "b"],
+    ["basename", ["b.js", "b.js"], ""],
+    ["basename", ["aaa", "a"], "aa"],
+    ["extname", ["index.coffee.md"], ".md"],
+    ["extname", [".profile"], ""],
+    ["extname", ["a."], "."],
+    ["extname", ["..."], "."],
+    ["extname", ["a/.b.c/"], ".c"],
+];
+for (const [fn, args, want] of cases)
+    eq(path[fn](...args), want, `${fn}(${args.map(a => JSON.stringify(a)).join(", ")})`);
+console.log("✅ join, resolve, normalize, relative, dirname, basename, extname");
+
+eq(resolve(), os.getcwd()[0], "resolve() is the cwd");
+eq(resolve("x"), os.getcwd()[0] + "/x", "relative to the cwd");
+assert(path.isAbsolute("/a") && !path.isAbsolute("a") && !path.isAbsolute(""), "isAbsolute");
+eq(JSON.stringify(path.parse("/home/u/file.tar.gz")),
+   '{"root":"/","dir":"/home/u","base":"file.tar.gz","ext":".gz","name":"file.tar"}', "parse");
+eq(JSON.stringify(path.parse("./.bashrc")), '{"root":"","dir":".","base":".bashrc","ext":"","name":".bashrc"}', "parse dotfile");
+eq(path.format({ root: "/", dir: "/home/u", base: "f.txt" }), "/home/u/f.txt", "format dir + base");
+eq(path.format({ root: "/", name: "f", ext: "txt" }), "/f.txt", "format name + ext");
+eq(path.sep + path.delimiter, "/:", "sep and delimiter");
+eq(posix.join, join, "posix");
+eq(native.relative, relative, "re-exports the native functions");
+let threw = false;
+try { join("a", 1); } catch (e) { threw = e instanceof TypeError; }
+assert(threw, "non-string arguments throw a TypeError");
+// longer than the on-stack buffers
+const long = Array.from({ length: 300 }, (_, i) => "seg" + i).join("/");
+eq(join("/", long, "..", "x"), "/" + long.replace(/\/seg299$/, "") + "/x", "long paths");
+assert(resolve(...Array.from({ length: 40 }, (_, i) => "d" + i)).endsWith("/d38/d39"), "many arguments");
+console.log("✅ parse, format and the rest");
+
+// the module resolver normalizes the same way
+eq(where, "lib/util", "import through ./lib/../lib/./util");
+eq(import.meta.dirname, path.dirname(import.meta.filename), "import.meta.dirname");
+console.log("✅ module resolution");
+
+// node:fs builds its paths with node:path
+fs.mkdirSync(tmp + "/x/./y/../y/z", { recursive: true });
+fs.mkdirSync(tmp + "/x/y/z/", { recursive: true });
+fs.writeFileSync(tmp + "/x/y/z/f.txt", "hello");
+assert(fs.existsSync(tmp + "/x/y/z/f.txt"), "mkdirSync recursive");
+fs.rmSync(tmp + "/x", { recursive: true });
+assert(!fs.existsSync(tmp + "/x"), "rmSync recursive");
+console.log("✅ node:fs");
+
+console.log("All node:path tests passed");
+EOF
+
+STATUS=0
+for BIN in qjsx qjsx-node; do
+    OUTPUT=$(QJSXPATH=./qjsx-node ${QJSX_BIN_DIR}/$BIN "$TEMP_DIR/test_path.js" "$TEMP_DIR" 2>&1 || true)
+    echo "$OUTPUT"
+    if echo "$OUTPUT" | grep -q "All node:path tests passed"; then
+        printf "%b\n" "${GREEN}✅ node:path tests passed with $BIN${NC}"
+    else
+        printf "%b\n" "${RED}❌ node:path tests failed with $BIN${NC}"
+        STATUS=1
+    fi
+done
+
+exit $STATUS
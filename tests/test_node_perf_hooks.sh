@@ -0,0 +1,129 @@
+#!/bin/sh
+# Test event loop monitoring: node:perf_hooks on the qjsx:loop native module
+
+set -e
+cd "$(dirname "$0")/.."
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+NC='\033[0m' # No Color
+
+printf "%b\n" "${BLUE}Testing event loop delay, utilization and long tasks...${NC}"
+
+TEMP_DIR=$(mktemp -d)
+trap "rm -rf $TEMP_DIR" EXIT
+
+cat > "$TEMP_DIR/test_perf_hooks.js" << 'EOF'
+import { monitorEventLoopDelay, performance } from "node:perf_hooks";
+import * as os from "os";
+
+const assert = (cond, msg) => { if (!cond) throw new Error(msg); };
+const spin = ms => { const end = Date.now() + ms; while (Date.now() < end); };
+const sleep = ms => new Promise(resolve => os.setTimeout(resolve, ms));
+
+// delays: 10 ms while idle, longer behind a callback that blocks the loop
+const h = monitorEventLoopDelay({ resolution: 10 });
+assert(h.count === 0 && h.min === 9223372036854776000 && Number.isNaN(h.mean), "empty histogram");
+assert(h.enable() === true && h.enable() === false, "enable() once");
+await sleep(100);
+await new Promise(resolve => os.setTimeout(() => { spin(60); resolve(); }, 1));
+await sleep(50);
+assert(h.disable() === true, "disable()");
+const count = h.count;
+assert(count >= 10, "samples while enabled: " + count);
+assert(h.min >= 9.9e6 && h.min <= 10.5e6, "min is the resolution: " + h.min);
+assert(h.max >= 55e6, "max includes the blocked 60 ms: " + h.max);
+assert(h.percentile(50) >= 9.9e6 && h.percentile(50) < 11e6, "median: " + h.percentile(50));
+assert(h.percentile(100) === h.max && h.mean > h.min && h.stddev > 0, "percentile(100), mean, stddev");
+const p = h.percentiles;
+assert(p.get(0) === h.min && p.get(100) === h.max && p.has(50), "percentiles: " + [...p.keys()]);
+await sleep(30);
+assert(h.count === count, "no samples while disabled");
+h.reset();
+assert(h.count === 0 && h.max === 0, "reset()");
+for (const bad of [0, 1.5, "10"]) {
+    let code;
+    try { monitorEventLoopDelay({ resolution: bad }); } catch (e) { code = e.code; }
+    assert(code === "ERR_OUT_OF_RANGE", "resolution " + bad);
+}
+let threw = false;
+try { h.percentile(0); } catch (e) { threw = e instanceof RangeError; }
+assert(threw, "percentile(0) throws");
+console.log("✅ monitorEventLoopDelay");
+
+// utilization: time waiting for timers and I/O against time running JS
+const elu1 = performance.eventLoopUtilization();
+await sleep(100);
+spin(50);
+const elu = performance.eventLoopUtilization(elu1);
+assert(elu.idle >= 80 && elu.idle < 150, "idle: " + elu.idle);
+assert(elu.active >= 45 && elu.active < 100, "active: " + elu.active);
+assert(elu.utilization > 0.2 && elu.utilization < 0.6, "utilization: " + elu.utilization);
+const elu2 = performance.eventLoopUtilization();
+const delta = performance.eventLoopUtilization(elu2, elu1);
+assert(Math.abs(delta.idle - (elu2.idle - elu1.idle)) < 1e-9, "delta between two readings");
+console.log("✅ eventLoopUtilization");
+
+console.log("All perf_hooks tests passed");
+EOF
+
+cat > "$TEMP_DIR/long_task.js" << 'EOF'
+import * as os from "os";
+
+function hotLoop(ms) {
+    const end = Date.now() + ms;
+    let n = 0;
+    while (Date.now() < end) n++;
+    return n;
+}
+
+os.setTimeout(() => hotLoop(5), 1);
+os.setTimeout(function slowTimer() { hotLoop(100); }, 10);
+EOF
+
+cat > "$TEMP_DIR/long_task_api.js" << 'EOF'
+import { monitorLongTasks } from "node:perf_hooks";
+import * as os from "os";
+
+function busy(ms) { const end = Date.now() + ms; while (Date.now() < end); }
+monitorLongTasks(30);
+os.setTimeout(function reported() { busy(60); monitorLongTasks(0); os.setTimeout(() => busy(60), 1); }, 1);
+EOF
+
+STATUS=0
+for BIN in qjsx qjsx-node; do
+    OUTPUT=$(QJSXPATH=./qjsx-node ${QJSX_BIN_DIR}/$BIN "$TEMP_DIR/test_perf_hooks.js" 2>&1 || true)
+    echo "$OUTPUT"
+    if echo "$OUTPUT" | grep -q "All perf_hooks tests passed"; then
+        printf "%b\n" "${GREEN}✅ perf_hooks tests passed with $BIN${NC}"
+    else
+        printf "%b\n" "${RED}❌ perf_hooks tests failed with $BIN${NC}"
+        STATUS=1
+    fi
+done
+
+# QJSX_LONG_TASK_MS (read when qjsx:loop loads, which qjsx-node always does)
+# reports the 100 ms callback with its stack, not the 5 ms one
+OUTPUT=$(QJSX_LONG_TASK_MS=50 ${QJSX_BIN_DIR}/qjsx-node "$TEMP_DIR/long_task.js" 2>&1 || true)
+echo "$OUTPUT"
+if [ "$(echo "$OUTPUT" | grep -c "Long task")" = 1 ] &&
+   echo "$OUTPUT" | grep -q "hotLoop" && echo "$OUTPUT" | grep -q "slowTimer"; then
+    printf "%b\n" "${GREEN}✅ QJSX_LONG_TASK_MS reports long tasks with their stack${NC}"
+else
+    printf "%b\n" "${RED}❌ QJSX_LONG_TASK_MS did not report the long task${NC}"
+    STATUS=1
+fi
+
+# monitorLongTasks(ms) turns it on and monitorLongTasks(0) off
+OUTPUT=$(QJSXPATH=./qjsx-node ${QJSX_BIN_DIR}/qjsx "$TEMP_DIR/long_task_api.js" 2>&1 || true)
+echo "$OUTPUT"
+if [ "$(echo "$OUTPUT" | grep -c "Long task")" = 1 ] && echo "$OUTPUT" | grep -q "reported"; then
+    printf "%b\n" "${GREEN}✅ monitorLongTasks() reports long tasks${NC}"
+else
+    printf "%b\n" "${RED}❌ monitorLongTasks() did not report the long task once${NC}"
+    STATUS=1
+fi
+
+exit $STATUS
@@ -0,0 +1,134 @@
+#!/bin/sh
+# Test scheduler.postTask() and scheduler.yield() (node:timers/promises on qjsx:loop)
+
+set -e
+cd "$(dirname "$0")/.."
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+NC='\033[0m' # No Color
+
+printf "%b\n" "${BLUE}Testing scheduler.postTask and scheduler.yield...${NC}"
+
+TEMP_DIR=$(mktemp -d)
+trap "rm -rf $TEMP_DIR" EXIT
+
+cat > "$TEMP_DIR/test_scheduler.js" << 'EOF'
+import { scheduler, setTimeout as sleep, setImmediate as immediate } from "node:timers/promises";
+import { stats } from "qjsx:loop";
+import * as os from "os";
+
+const assert = (cond, msg) => { if (!cond) throw new Error(msg); };
+const spin = ms => { const end = Date.now() + ms; while (Date.now() < end); };
+
+// a signal with just what the scheduler uses
+class Signal {
+    aborted = false;
+    listeners = [];
+    addEventListener(type, fn) { this.listeners.push(fn); }
+    removeEventListener(type, fn) { this.listeners = this.listeners.filter(l => l !== fn); }
+    abort(reason) { this.aborted = true; this.reason = reason; this.listeners.forEach(fn => fn()); }
+}
+
+// highest priority first, FIFO within a priority
+const log = [];
+const post = (name, priority) => scheduler.postTask(() => log.push(name), { priority });
+await Promise.all([post("b1", "background"), post("v1", "user-visible"), post("u1", "user-blocking"),
+                   post("v2"), post("b2", "background"), post("u2", "user-blocking")]);
+assert(log.join() === "u1,u2,v1,v2,b1,b2", "priority order: " + log.join());
+console.log("✅ priority order");
+
+// results, errors and argument checks
+assert(await scheduler.postTask(() => 42) === 42, "resolves with the result");
+const err = await scheduler.postTask(() => { throw new Error("boom"); }).catch(e => e);
+assert(err.message === "boom", "rejects with the exception");
+let threw = false;
+try { scheduler.postTask(() => {}, { priority: "urgent" }); } catch (e) { threw = e instanceof TypeError; }
+assert(threw, "invalid priority throws a TypeError");
+threw = false;
+try { scheduler.postTask(42); } catch (e) { threw = e.code === "ERR_INVALID_ARG_TYPE"; }
+assert(threw, "non-function throws ERR_INVALID_ARG_TYPE");
+console.log("✅ results and errors");
+
+// yield() resumes ahead of the other tasks of the task's priority, after higher ones
+log.length = 0;
+await scheduler.postTask(async () => {
+    log.push("a1");
+    post("u", "user-blocking");
+    post("b", "background");
+    await scheduler.yield();
+    log.push("a2");
+}, { priority: "background" });
+await sleep(10);
+assert(log.join() === "a1,u,a2,b", "yield order: " + log.join());
+await scheduler.yield();
+console.log("✅ yield");
+
+// a background task waits at most about a second behind user-blocking work
+let background = 0, chain = 0;
+const start = Date.now();
+scheduler.postTask(() => { background = Date.now() - start; }, { priority: "background" });
+await new Promise(resolve => {
+    const step = () => {
+        spin(1);
+        if (Date.now() - start < 1500) scheduler.postTask(step, { priority: "user-blocking" });
+        else { chain = Date.now() - start; resolve(); }
+    };
+    scheduler.postTask(step, { priority: "user-blocking" });
+});
+assert(background > 900 && background < chain, `background task ran at ${background} ms, chain ended at ${chain} ms`);
+console.log("✅ starvation protection");
+
+// timers and I/O run between slices of tasks
+let fired = 0;
+const t0 = Date.now();
+os.setTimeout(() => { fired = Date.now() - t0; }, 10);
+for (let i = 0; i < 200; i++) scheduler.postTask(() => spin(1), { priority: "user-blocking" });
+await scheduler.postTask(() => {}, { priority: "background" });
+assert(fired > 0 && fired < 100, "timer fired after " + fired + " ms");
+console.log("✅ timers run between tasks");
+
+// delays and abort signals
+const d0 = Date.now();
+await scheduler.postTask(() => {}, { delay: 50 });
+assert(Date.now() - d0 >= 45, "delay");
+const signal = new Signal();
+let ran = false;
+const aborted = scheduler.postTask(() => { ran = true; }, { signal, priority: "background" });
+signal.abort("stop");
+const e = await aborted.catch(e => e);
+assert(e.name === "AbortError" && e.cause === "stop" && !ran, "abort drops a queued task");
+assert(await scheduler.postTask(() => 1, { signal }).catch(e => e.name) === "AbortError", "aborted signal rejects");
+assert(await sleep(10, "v") === "v" && await immediate("w") === "w", "setTimeout and setImmediate resolve with value");
+const s2 = new Signal();
+const slept = sleep(10000, 1, { signal: s2 });
+s2.abort();
+assert(await slept.catch(e => e.code) === "ABORT_ERR", "abort clears the timer");
+console.log("✅ delay and abort");
+
+const before = stats().tasks;
+await scheduler.postTask(() => {});
+assert(stats().tasks - before === 1, "tasks are counted");
+
+if (globalThis.scheduler === scheduler)
+    console.log("✅ global scheduler installed");
+
+console.log("All scheduler tests passed");
+EOF
+
+STATUS=0
+for BIN in qjsx qjsx-node; do
+    OUTPUT=$(QJSXPATH=./qjsx-node ${QJSX_BIN_DIR}/$BIN "$TEMP_DIR/test_scheduler.js" 2>&1 || true)
+    echo "$OUTPUT"
+    if echo "$OUTPUT" | grep -q "All scheduler tests passed" &&
+       { [ "$BIN" = qjsx ] || echo "$OUTPUT" | grep -q "global scheduler installed"; }; then
+        printf "%b\n" "${GREEN}✅ scheduler tests passed with $BIN${NC}"
+    else
+        printf "%b\n" "${RED}❌ scheduler tests failed with $BIN${NC}"
+        STATUS=1
+    fi
+done
+
+exit $STATUS
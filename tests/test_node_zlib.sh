@@ -0,0 +1,172 @@
+#!/bin/sh
+# Test node:zlib (qjsx-node/node/zlib.js on top of the qjsx:zlib native module)
+
+set -e
+cd "$(dirname "$0")/.."
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+NC='\033[0m' # No Color
+
+printf "%b\n" "${BLUE}Testing node:zlib...${NC}"
+
+TEMP_DIR=$(mktemp -d)
+trap "rm -rf $TEMP_DIR" EXIT
+
+cat > "$TEMP_DIR/test_zlib.js" << 'EOF'
+import * as zlib from "node:zlib";
+import * as std from "std";
+import * as os from "os";
+
+const assert = (cond, msg) => { if (!cond) throw new Error(msg); };
+const text = (u8) => String.fromCharCode.apply(null, u8);
+const equal = (a, b) => a.length === b.length && a.every((x, i) => x === b[i]);
+const fails = (fn, code) => { try { fn(); } catch (e) { return e.code === code; } return false; };
+const tmp = scriptArgs[1];
+
+// ~6 MiB of log-like text: big enough for the threaded path
+const line = "2024-01-01T00:00:00Z GET /api/items?id=%d 200 12ms\n";
+const parts = [];
+for (let i = 0; i < 120000; i++) parts.push(line.replace("%d", i * 7919 % 100003));
+const all = parts.join("");
+const big = new Uint8Array(all.length);
+for (let i = 0; i < all.length; i++) big[i] = all.charCodeAt(i);
+
+const pairs = [
+    ["gzip", "gunzip"], ["deflate", "inflate"], ["deflateRaw", "inflateRaw"],
+    ["gzip", "unzip"], ["deflate", "unzip"],
+];
+for (const [c, d] of pairs) {
+    const packed = zlib[c + "Sync"]("hello hello hello");
+    assert(packed instanceof Uint8Array, c + " returns a Uint8Array");
+    assert(text(zlib[d + "Sync"](packed)) === "hello hello hello", c + " -> " + d);
+    for (const threads of [1, undefined]) {
+        const p = zlib[c + "Sync"](big, { threads, level: 6 });
+        assert(p.length < big.length / 4, c + " compresses");
+        assert(equal(zlib[d + "Sync"](p), big), c + " large round trip, threads " + threads);
+    }
+}
+// the threaded path compresses with the window the stream declares
+for (const [c, d] of [["deflate", "inflate"], ["deflateRaw", "inflateRaw"], ["gzip", "gunzip"]]) {
+    for (const windowBits of [9, 12]) {
+        const p = zlib[c + "Sync"](big, { threads: 4, windowBits });
+        assert(equal(zlib[d + "Sync"](p, { windowBits }), big), c + " large round trip, windowBits " + windowBits);
+    }
+}
+console.log("✅ sync round trips");
+
+// views are read in place, with their offset
+const view = new Uint8Array(big.buffer, 1000, 5000);
+assert(equal(zlib.inflateSync(zlib.deflateSync(view)), view), "typed array view");
+assert(equal(zlib.gunzipSync(zlib.gzipSync(new DataView(big.buffer, 10, 20))), big.subarray(10, 30)), "DataView");
+assert(zlib.inflateSync(zlib.deflateSync(big.buffer.slice(0, 100))).length === 100, "ArrayBuffer");
+
+// concatenated gzip members decode as one stream
+const two = new Uint8Array([...zlib.gzipSync("abc"), ...zlib.gzipSync("def")]);
+assert(text(zlib.gunzipSync(two)) === "abcdef", "multi-member gzip");
+assert(zlib.crc32("hello") === 0x3610a686 && zlib.crc32("lo", zlib.crc32("hel")) === 0x3610a686, "crc32");
+
+assert(fails(() => zlib.gunzipSync("not gzip data"), "Z_DATA_ERROR"), "corrupt input");
+assert(fails(() => zlib.gunzipSync(zlib.gzipSync(big).subarray(0, 1000)), "Z_BUF_ERROR"), "truncated input");
+assert(fails(() => zlib.gunzipSync(zlib.gzipSync(big), { maxOutputLength: 1000 }), "ERR_BUFFER_TOO_LARGE"), "maxOutputLength");
+let range = false;
+try { zlib.gzipSync("x", { level: 12 }); } catch (e) { range = e instanceof RangeError; }
+assert(range, "level is range checked");
+console.log("✅ views, members, crc32 and errors");
+
+// the threaded gzip output is a regular gzip file
+if (os.exec(["sh", "-c", "command -v gzip >/dev/null"]) === 0) {
+    const f = std.open(tmp + "/big.gz", "wb");
+    const p = zlib.gzipSync(big, { threads: 4 });
+    f.write(p.buffer, p.byteOffset, p.length);
+    f.close();
+    assert(os.exec(["sh", "-c", `gzip -dc '${tmp}/big.gz' | cmp -s - '${tmp}/big.txt'`]) === 0, "gzip -d reads threaded output");
+    console.log("✅ gzip(1) decodes threaded output");
+}
+
+let zstd = true;
+try {
+    zlib.zstdCompressSync("x");
+} catch (e) {
+    if (e.code !== "ERR_ZLIB_INITIALIZATION_FAILED") throw e;
+    zstd = false;
+    console.log("⚠️  libzstd not found, skipping zstd");
+}
+if (zstd) {
+    const p = zlib.zstdCompressSync(big, { params: { [zlib.constants.ZSTD_c_compressionLevel]: 9 } });
+    assert(p.length < big.length / 4 && equal(zlib.zstdDecompressSync(p), big), "zstd round trip");
+    assert(equal(await zlib.promises.zstdDecompress(await zlib.promises.zstdCompress(big)), big), "zstd async");
+    assert(fails(() => zlib.zstdDecompressSync("garbage!"), "Z_DATA_ERROR"), "zstd corrupt input");
+    console.log("✅ zstd");
+}
+
+// async: callbacks and promises, several jobs in flight
+const results = await Promise.all([
+    zlib.promises.gzip(big), zlib.promises.deflate(big, { level: 1 }), zlib.promises.deflateRaw("small"),
+]);
+assert(equal(await zlib.promises.gunzip(results[0]), big), "promise gzip");
+assert(equal(zlib.inflateSync(results[1]), big), "promise deflate");
+assert(text(zlib.inflateRawSync(results[2])) === "small", "promise deflateRaw");
+const viaCallback = await new Promise((resolve, reject) =>
+    zlib.gzip("callback data", (err, packed) => err ? reject(err) : resolve(packed)));
+assert(text(zlib.gunzipSync(viaCallback)) === "callback data", "callback gzip");
+const cbError = await new Promise(resolve => zlib.inflate("bad", err => resolve(err)));
+assert(cbError && cbError.code === "Z_DATA_ERROR", "callback error");
+let rejected = false;
+await zlib.promises.gunzip("bad").catch(e => { rejected = e.code === "Z_DATA_ERROR"; });
+assert(rejected, "promise rejection");
+console.log("✅ callbacks and promises");
+
+// streams: chunked writes, pipe, async iteration
+const collect = (stream) => new Promise((resolve, reject) => {
+    const chunks = [];
+    stream.on("data", c => chunks.push(c)).on("error", reject).on("end", () => {
+        const all = new Uint8Array(chunks.reduce((n, c) => n + c.length, 0));
+        chunks.reduce((off, c) => (all.set(c, off), off + c.length), 0);
+        resolve(all);
+    });
+});
+const gz = zlib.createGzip({ level: 9 });
+const gunzip = zlib.createGunzip();
+const out = collect(gunzip);
+gz.pipe(gunzip);
+for (let i = 0; i < 100; i++) gz.write(big.subarray(i * 1000, (i + 1) * 1000));
+gz.flush();
+gz.end(big.subarray(100000, 200000));
+assert(equal(await out, big.subarray(0, 200000)), "gzip | gunzip stream");
+
+const inflater = zlib.createInflate();
+const packed = zlib.deflateSync(big);
+for (let i = 0; i < packed.length; i += 4096) inflater.write(packed.subarray(i, i + 4096));
+inflater.end();
+let total = 0;
+for await (const chunk of inflater) total += chunk.length;
+assert(total === big.length, "async iteration");
+
+const broken = zlib.createGunzip();
+const err = await new Promise(resolve => { broken.on("error", resolve); broken.end("definitely not gzip"); });
+assert(err.code === "Z_DATA_ERROR", "stream error event");
+console.log("✅ streams");
+
+console.log("All node:zlib tests passed");
+EOF
+
+# the same text the test generates, for comparing with gzip -d
+awk 'BEGIN { for (i = 0; i < 120000; i++) printf "2024-01-01T00:00:00Z GET /api/items?id=%d 200 12ms\n", i * 7919 % 100003 }' \
+    > "$TEMP_DIR/big.txt"
+
+STATUS=0
+for BIN in qjsx qjsx-node; do
+    OUTPUT=$(QJSXPATH=./qjsx-node ${QJSX_BIN_DIR}/$BIN "$TEMP_DIR/test_zlib.js" "$TEMP_DIR" 2>&1 || true)
+    echo "$OUTPUT"
+    if echo "$OUTPUT" | grep -q "All node:zlib tests passed"; then
+        printf "%b\n" "${GREEN}✅ node:zlib tests passed with $BIN${NC}"
+    else
+        printf "%b\n" "${RED}❌ node:zlib tests failed with $BIN${NC}"
+        STATUS=1
+    fi
+done
+
+exit $STATUS
@@ -0,0 +1,156 @@
+#!/bin/sh
+# Test the performance global: User Timing marks and measures, PerformanceObserver
+
+set -e
+cd "$(dirname "$0")/.."
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+NC='\033[0m' # No Color
+
+printf "%b\n" "${BLUE}Testing performance marks, measures and observers...${NC}"
+
+TEMP_DIR=$(mktemp -d)
+trap "rm -rf $TEMP_DIR" EXIT
+
+cat > "$TEMP_DIR/test_performance.js" << 'EOF'
+import * as os from "os";
+
+const assert = (cond, msg) => { if (!cond) throw new Error(msg); };
+const spin = ms => { const end = Date.now() + ms; while (Date.now() < end); };
+const sleep = ms => new Promise(resolve => os.setTimeout(resolve, ms));
+const names = list => list.map(e => e.name).join(",");
+
+// now(): monotonic, fractional ms since timeOrigin
+const t0 = performance.now();
+spin(20);
+const t1 = performance.now();
+assert(t0 >= 0 && t1 - t0 >= 19 && t1 - t0 < 200, "now() advances: " + (t1 - t0));
+assert(t0 !== Math.floor(t0) || t1 !== Math.floor(t1), "now() has sub-ms precision");
+assert(Math.abs(performance.timeOrigin + t1 - Date.now()) < 50, "timeOrigin + now() is the wall clock");
+assert(performance.toJSON().timeOrigin === performance.timeOrigin, "toJSON()");
+console.log("✅ now() and timeOrigin");
+
+// marks and measures
+assert(performance.mark("a") === undefined, "mark() returns nothing");
+spin(10);
+performance.mark("b", { detail: { step: 2 } });
+performance.mark("c", { startTime: 1 });
+performance.measure("a-b", "a", "b");
+performance.measure("from-start");
+performance.measure("opts", { start: "a", duration: 5, detail: "d" });
+performance.measure("num", { start: 2, end: 4 });
+const marks = performance.getEntriesByType("mark");
+assert(names(marks) === "c,a,b", "marks by startTime: " + names(marks));
+const [a, b] = [marks[1], marks[2]];
+assert(a.entryType === "mark" && a.duration === 0 && a.detail === null, "mark entry");
+assert(b.detail.step === 2 && b.startTime - a.startTime >= 9, "mark detail and time");
+const ab = performance.getEntriesByName("a-b")[0];
+assert(ab.entryType === "measure" && ab.startTime === a.startTime && ab.duration === b.startTime - a.startTime, "measure between marks");
+let err;
+const opts = performance.getEntriesByName("opts", "measure")[0];
+assert(opts.startTime === a.startTime && opts.duration === 5 && opts.detail === "d", "measure options");
+const num = performance.getEntriesByName("num")[0];
+assert(num.startTime === 2 && num.duration === 2, "measure between timestamps");
+assert(performance.getEntriesByName("from-start")[0].startTime === 0, "measure from timeOrigin");
+assert(performance.getEntries().length === 7 && performance.getEntriesByType("resource").length === 0, "getEntries()");
+err = null;
+try { performance.measure("x", "missing"); } catch (e) { err = e; }
+assert(err?.name === "SyntaxError", "measure() with an unknown mark throws a SyntaxError");
+err = null;
+try { performance.measure("x", 2); } catch (e) { err = e; }
+assert(err?.name === "SyntaxError", "startMark is the name of a mark");
+err = null;
+try { performance.measure("x", { duration: 1 }); } catch (e) { err = e; }
+assert(err instanceof TypeError, "duration alone throws TypeError");
+performance.clearMarks("a");
+assert(names(performance.getEntriesByType("mark")) === "c,b", "clearMarks(name)");
+performance.clearMarks();
+performance.clearMeasures("num");
+assert(performance.getEntriesByType("mark").length === 0 && performance.getEntriesByType("measure").length === 3, "clearMarks(), clearMeasures(name)");
+performance.clearMeasures();
+assert(performance.getEntries().length === 0, "clearMeasures()");
+console.log("✅ mark() and measure()");
+
+// observers are called once a turn with the entries added since
+const calls = [];
+const obs = new PerformanceObserver((list, observer) => {
+    assert(observer === obs, "callback gets the observer");
+    calls.push(names(list.getEntries()) + "|" + names(list.getEntriesByType("measure")));
+});
+obs.observe({ entryTypes: ["mark", "measure"] });
+for (let i = 0; i < 3; i++) performance.mark("m" + i);
+performance.measure("m0-m2", "m0", "m2");
+assert(calls.length === 0, "not called synchronously");
+await sleep(1);
+assert(calls.length === 1 && calls[0] === "m0,m0-m2,m1,m2|m0-m2", "one batch per turn: " + calls);
+performance.mark("t1");
+performance.mark("t2");
+assert(names(obs.takeRecords()) === "t1,t2", "takeRecords()");
+await sleep(1);
+assert(calls.length === 1, "taken records are not delivered");
+obs.disconnect();
+performance.mark("after");
+await sleep(1);
+assert(calls.length === 1, "disconnect()");
+
+// buffered: the entries added before observe()
+const seen = [];
+const late = new PerformanceObserver(list => seen.push(names(list.getEntries())));
+late.observe({ type: "mark", buffered: true });
+await sleep(1);
+assert(seen.length === 1 && seen[0].startsWith("m0,m1,m2") && seen[0].endsWith("after"), "buffered: " + seen);
+late.disconnect();
+assert(PerformanceObserver.supportedEntryTypes.join() === "mark,measure", "supportedEntryTypes");
+console.log("✅ PerformanceObserver");
+
+console.log("All performance tests passed");
+EOF
+
+# with nothing else to run, the loop still delivers before it exits
+cat > "$TEMP_DIR/observe_exit.js" << 'EOF'
+new PerformanceObserver(list => console.log("observed", list.getEntries().length))
+    .observe({ type: "mark" });
+performance.mark("one");
+performance.mark("two");
+EOF
+
+STATUS=0
+for BIN in qjsx qjsx-node; do
+    OUTPUT=$(QJSXPATH=./qjsx-node ${QJSX_BIN_DIR}/$BIN "$TEMP_DIR/test_performance.js" 2>&1 || true)
+    echo "$OUTPUT"
+    if echo "$OUTPUT" | grep -q "All performance tests passed"; then
+        printf "%b\n" "${GREEN}✅ performance tests passed with $BIN${NC}"
+    else
+        printf "%b\n" "${RED}❌ performance tests failed with $BIN${NC}"
+        STATUS=1
+    fi
+
+    OUTPUT=$(${QJSX_BIN_DIR}/$BIN "$TEMP_DIR/observe_exit.js" 2>&1 || true)
+    echo "$OUTPUT"
+    if [ "$OUTPUT" = "observed 2" ]; then
+        printf "%b\n" "${GREEN}✅ observers see the last entries with $BIN${NC}"
+    else
+        printf "%b\n" "${RED}❌ observers missed the last entries with $BIN${NC}"
+        STATUS=1
+    fi
+done
+
+# node:perf_hooks exports the globals, with eventLoopUtilization()
+cat > "$TEMP_DIR/perf_hooks.js" << 'EOF'
+import { performance as p, PerformanceObserver as O } from "node:perf_hooks";
+console.log(p === performance && O === PerformanceObserver &&
+            typeof performance.eventLoopUtilization === "function");
+EOF
+OUTPUT=$(${QJSX_BIN_DIR}/qjsx-node "$TEMP_DIR/perf_hooks.js" 2>&1 || true)
+if [ "$OUTPUT" = "true" ]; then
+    printf "%b\n" "${GREEN}✅ node:perf_hooks exports the performance global${NC}"
+else
+    echo "$OUTPUT"
+    printf "%b\n" "${RED}❌ node:perf_hooks does not export the performance global${NC}"
+    STATUS=1
+fi
+
+exit $STATUS
@@ -0,0 +1,90 @@
+#!/bin/sh
+# Test the built-in qjsx:ffi native module
+
+set -e
+cd "$(dirname "$0")/.."
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+NC='\033[0m' # No Color
+
+printf "%b\n" "${BLUE}Testing qjsx:ffi native calls...${NC}"
+
+TEMP_DIR=$(mktemp -d)
+trap "rm -rf $TEMP_DIR" EXIT
+
+cat > "$TEMP_DIR/test_ffi.js" << 'EOF'
+import * as ffi from "qjsx:ffi";
+
+const assert = (cond, msg) => { if (!cond) throw new Error(msg); };
+
+const libc = ffi.dlopen(null);
+const strlen = libc.func("strlen", "u64", ["string"]);
+assert(strlen("héllo") === 6n, "string argument is UTF-8");
+assert(libc.func("abs", "i32", ["i32"])(-42) === 42, "i32");
+assert(libc.func("llabs", "i64", ["i64"])(-(2n ** 40n)) === 2n ** 40n, "i64");
+assert(typeof libc.symbol("malloc") === "bigint", "symbol");
+
+// typed arrays are passed as pointers, without copies
+const buf = new Uint8Array(16);
+libc.func("memset", "ptr", ["ptr", "i32", "u64"])(buf.subarray(4), 7, 3);
+assert(buf.join("") === "0000777000000000", "memset through a subarray");
+
+// out parameters and strings read back from native memory
+const strtol = libc.func("strtol", "i64", ["ptr", "ptr", "i32"]);
+const text = Uint8Array.of(0x34, 0x32, 0x78, 0x79, 0x7a, 0);  // "42xyz"
+const end = new BigUint64Array(1);
+assert(strtol(text, end, 10) === 42n && ffi.cstring(end[0]) === "xyz", "out parameter");
+const getenv = libc.func("getenv", "string", ["string"]);
+assert(getenv("QJSX_FFI_TEST") === "yes" && getenv("QJSX_FFI_UNSET") === null, "string result");
+
+const libm = ffi.dlopen(`libm.${ffi.suffix}.6`);
+assert(libm.func("sqrt", "f64", ["f64"])(2) === Math.SQRT2, "f64");
+assert(libm.func("sqrtf", "f32", ["f32"])(2) === Math.fround(Math.SQRT2), "f32");
+assert(libm.func("ldexp", "f64", ["f64", "i32"])(1.5, 4) === 24, "mixed int and float arguments");
+
+// callbacks: qsort with a JS comparator
+const qsort = libc.func("qsort", "void", ["ptr", "u64", "u64", "ptr"]);
+const values = Int32Array.of(5, -1, 3, 100, 0);
+const cmp = ffi.callback("i32", ["ptr", "ptr"], (a, b) =>
+    new Int32Array(ffi.toArrayBuffer(a, 4))[0] - new Int32Array(ffi.toArrayBuffer(b, 4))[0]);
+qsort(values, 5, 4, cmp);
+assert(values.join() === "-1,0,3,5,100", "qsort callback");
+
+// an exception thrown by a callback surfaces from the outer call
+const bad = ffi.callback("i32", ["ptr", "ptr"], () => { throw new RangeError("from callback"); });
+let threw = false;
+try { qsort(values, 5, 4, bad); } catch (e) { threw = e instanceof RangeError; }
+assert(threw, "callback exception is rethrown");
+bad.close();
+cmp.close();
+
+const p = ffi.ptr(buf);
+assert(new Uint8Array(ffi.toArrayBuffer(p + 4n, 3)).join("") === "777", "ptr and toArrayBuffer");
+
+threw = false;
+try { libc.func("strlen", "u64", ["void"]); } catch (e) { threw = e instanceof TypeError; }
+assert(threw, "invalid signature");
+libm.close();
+threw = false;
+try { libm.symbol("sqrt"); } catch (e) { threw = e instanceof TypeError; }
+assert(threw, "closed library");
+
+console.log("All qjsx:ffi tests passed");
+EOF
+
+# The module must be available both in qjsx and in qjsxc-built executables
+STATUS=0
+for BIN in qjsx qjsx-node; do
+    OUTPUT=$(QJSX_FFI_TEST=yes ${QJSX_BIN_DIR}/$BIN "$TEMP_DIR/test_ffi.js" 2>&1 || true)
+    echo "$OUTPUT"
+    if echo "$OUTPUT" | grep -q "All qjsx:ffi tests passed"; then
+        printf "%b\n" "${GREEN}✅ qjsx:ffi works in $BIN${NC}"
+    else
+        printf "%b\n" "${RED}❌ qjsx:ffi test failed in $BIN!${NC}"
+        STATUS=1
+    fi
+done
+exit $STATUS
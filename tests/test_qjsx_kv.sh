@@ -0,0 +1,124 @@
+#!/bin/sh
+# Test the built-in qjsx:kv native module
+
+set -e
+cd "$(dirname "$0")/.."
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+NC='\033[0m' # No Color
+
+printf "%b\n" "${BLUE}Testing qjsx:kv key-value store...${NC}"
+
+TEMP_DIR=$(mktemp -d)
+trap "rm -rf $TEMP_DIR" EXIT
+
+cat > "$TEMP_DIR/test_kv.js" << 'EOF'
+import * as kv from "qjsx:kv";
+
+const assert = (cond, msg) => { if (!cond) throw new Error(msg); };
+const throws = (fn, type) => { try { fn(); } catch (e) { return e instanceof type; } return false; };
+const path = scriptArgs[1];
+const text = (buf) => String.fromCharCode(...new Uint8Array(buf));
+
+let db = kv.open(path);
+db.put("b", "2");
+db.put("a", "1");
+db.put(new Uint8Array([0, 255]), new Uint8Array([1, 2, 3]));
+assert(db.getString("a") === "1" && db.getString("missing") === undefined, "put and getString");
+assert(text(db.get("b")) === "2", "get returns an ArrayBuffer");
+assert(new Uint8Array(db.get(new Uint8Array([0, 255]))).join() === "1,2,3", "binary keys and values");
+assert(db.delete("b") === true && db.delete("b") === false, "delete");
+
+// large values go to overflow pages
+const big = "x".repeat(100000);
+db.put("big", big);
+assert(db.getString("big") === big, "overflow value");
+
+// transactions: commit, abort, and write() rolling back on throw
+db.write(txn => {
+    for (let i = 0; i < 5000; i++)
+        txn.put("key" + String(i).padStart(5, "0"), "value" + i);
+});
+let txn = db.begin();
+txn.put("aborted", "1");
+assert(txn.getString("aborted") === "1", "a transaction sees its own writes");
+txn.abort();
+assert(db.getString("aborted") === undefined, "abort");
+assert(throws(() => db.write(t => { t.put("thrown", "1"); throw new RangeError("no"); }), RangeError),
+       "write() rethrows");
+assert(db.getString("thrown") === undefined, "write() aborts when the callback throws");
+
+// snapshots: a reader keeps seeing the tree it started with
+const reader = db.begin({ readOnly: true });
+const view = db.get("key00001");
+db.write(t => { t.put("key00001", "changed"); t.delete("key00002"); });
+assert(reader.getString("key00001") === "value1" && reader.getString("key00002") === "value2",
+       "read transaction snapshot");
+assert(text(view) === "value1", "views pin their snapshot");
+assert(db.getString("key00001") === "changed", "new readers see the commit");
+reader.abort();
+
+// range scans
+const keys = [...db.range({ start: "key00010", end: "key00015" })].map(([k]) => k);
+assert(keys.join() === "key00010,key00011,key00012,key00013,key00014", "start and end");
+const rev = [...db.range({ prefix: "key0499", reverse: true, values: "string" })];
+assert(rev.length === 10 && rev[0][0] === "key04999" && rev[0][1] === "value4999", "prefix reverse");
+assert([...db.range({ limit: 3 })].length === 3, "limit");
+const bin = [...db.range({ end: "a", keys: "buffer" })];
+assert(bin.length === 1 && new Uint8Array(bin[0][0]).join() === "0,255", "buffer keys");
+
+// deleting while iterating in a write transaction
+db.write(t => {
+    let n = 0;
+    for (const [k] of t.range({ prefix: "key" })) {
+        if (n++ % 2 === 0)
+            t.delete(k);
+    }
+    assert(n === 4999, "iteration sees every key once");
+});
+assert(db.stat().entries === 2499 + 3, "entries after deleting half");
+
+assert(throws(() => db.put("", "x"), RangeError), "empty key");
+assert(throws(() => db.put("k".repeat(512), "x"), RangeError), "key too long");
+assert(throws(() => db.put(1, "x"), TypeError), "bad key type");
+const ro = db.begin({ readOnly: true });
+assert(throws(() => ro.put("a", "b"), TypeError), "read-only transaction");
+ro.abort();
+const st = db.stat();
+assert(st.pageSize === 4096 && st.depth >= 2 && st.leafPages > 1 && st.overflowPages > 0, "stat");
+db.close();
+assert(throws(() => db.get("a"), TypeError), "closed database");
+
+// reopening sees the committed data
+db = kv.open(path, { readOnly: true });
+assert(db.getString("a") === "1" && db.getString("big") === big && db.stat().entries === 2502, "reopen");
+assert(throws(() => db.put("a", "2"), TypeError), "read-only database");
+db.close();
+
+// the map size bounds the file
+db = kv.open(path + ".small", { mapSize: 65536 });
+assert(throws(() => db.put("big", big), RangeError), "database full");
+db.put("small", "ok");
+assert(db.getString("small") === "ok", "usable after a failed write");
+db.close();
+
+console.log("All qjsx:kv tests passed");
+EOF
+
+# The module must be available both in qjsx and in qjsx-node
+STATUS=0
+for BIN in qjsx qjsx-node; do
+    rm -f "$TEMP_DIR/test.db" "$TEMP_DIR/test.db.small"
+    OUTPUT=$(${QJSX_BIN_DIR}/$BIN "$TEMP_DIR/test_kv.js" "$TEMP_DIR/test.db" 2>&1 || true)
+    echo "$OUTPUT"
+    if echo "$OUTPUT" | grep -q "All qjsx:kv tests passed"; then
+        printf "%b\n" "${GREEN}✅ qjsx:kv works in $BIN${NC}"
+    else
+        printf "%b\n" "${RED}❌ qjsx:kv test failed in $BIN!${NC}"
+        STATUS=1
+    fi
+done
+exit $STATUS
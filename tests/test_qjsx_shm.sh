@@ -0,0 +1,113 @@
+#!/bin/sh
+# Test the built-in qjsx:shm native module
+
+set -e
+cd "$(dirname "$0")/.."
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+NC='\033[0m' # No Color
+
+printf "%b\n" "${BLUE}Testing qjsx:shm shared memory...${NC}"
+
+TEMP_DIR=$(mktemp -d)
+trap "rm -rf $TEMP_DIR" EXIT
+
+# The parent fills a cache and a counter, a child process started with
+# os.exec() reads them back and writes its own entries
+cat > "$TEMP_DIR/test_shm.js" << 'EOF'
+import * as shm from "qjsx:shm";
+import * as os from "os";
+
+const assert = (cond, msg) => { if (!cond) throw new Error(msg); };
+const throws = (fn, type) => { try { fn(); } catch (e) { return e instanceof type; } return false; };
+const [, bin, child, name] = scriptArgs;
+
+shm.unlink(name);
+shm.unlink(name + "-counter");
+const counter = new Int32Array(shm.open(name + "-counter", { size: 4096 }));
+assert(counter.buffer instanceof SharedArrayBuffer && counter.length === 1024, "open");
+Atomics.store(counter, 0, 41);
+
+const cache = new shm.Cache(name, { size: 1 << 20, keySize: 32, valueSize: 64 });
+assert(cache.keySize === 32 && cache.valueSize === 64 && cache.capacity > 5000, "cache geometry");
+for (let i = 0; i < 1000; i++)
+    assert(cache.set("key" + i, "value" + i), "set");
+cache.set(new Uint8Array([1, 2]), new Uint8Array([3, 4, 5]));
+assert(cache.getString("key7") === "value7" && cache.has("key999") && !cache.has("nope"), "get");
+assert(new Uint8Array(cache.get(new Uint8Array([1, 2]))).join() === "3,4,5", "binary keys");
+assert(cache.delete("key0") && !cache.delete("key0") && cache.get("key0") === undefined, "delete");
+assert(throws(() => cache.set("k".repeat(33), "v"), RangeError), "key too long");
+assert(throws(() => cache.set("k", "v".repeat(65)), RangeError), "value too long");
+assert(throws(() => new shm.Cache(name, { keySize: 16 }), RangeError), "geometry mismatch");
+
+const status = os.exec([bin, child, name], { block: true });
+assert(status === 0, "child process failed");
+assert(Atomics.load(counter, 0) === 42, "Atomics across processes");
+assert(cache.getString("child") === "hello from " + name, "child writes are visible");
+assert(cache.count() === 1000, "count");
+
+// a cache can also live in any SharedArrayBuffer
+const sab = new SharedArrayBuffer(65536);
+const local = new shm.Cache(sab, { keySize: 16, valueSize: 16 });
+local.set("a", "b");
+assert(local.getString("a") === "b", "SharedArrayBuffer cache");
+local.clear();
+assert(local.count() === 0, "clear");
+
+// clear() only takes back a slot left busy by a process that is gone:
+// 64-byte header, then 56-byte slots of seq, hash, klen, vlen, pid, key, value
+const words = new Int32Array(sab);
+local.set("a", "b");
+let slot = 16;
+while (!words[slot + 2])
+    slot += 14;
+Atomics.add(words, slot, 1);
+words[slot + 4] = 1;
+local.clear();
+assert(local.count() === 1, "clear() keeps a slot a live process is writing");
+const pid = os.exec(["true"], { block: false });
+os.waitpid(pid, 0);
+words[slot + 4] = pid;
+local.clear();
+assert(local.count() === 0 && local.set("a", "c") && local.getString("a") === "c",
+       "clear() reclaims a slot left by a dead writer");
+
+assert(throws(() => shm.open(name + "-missing", { create: false }), TypeError), "missing segment");
+assert(throws(() => shm.open("a/b", { size: 10 }), TypeError), "invalid name");
+assert(shm.unlink(name) && shm.unlink(name + "-counter") && !shm.unlink(name), "unlink");
+
+console.log("All qjsx:shm tests passed");
+EOF
+
+cat > "$TEMP_DIR/child.js" << 'EOF'
+import * as shm from "qjsx:shm";
+
+const name = scriptArgs[1];
+// the geometry is read from the segment
+const cache = new shm.Cache(name);
+for (let i = 1; i < 1000; i++) {
+    if (cache.getString("key" + i) !== "value" + i)
+        throw new Error("child sees key" + i + " = " + cache.getString("key" + i));
+}
+cache.set("child", "hello from " + name);
+cache.delete(new Uint8Array([1, 2]));
+Atomics.add(new Int32Array(shm.open(name + "-counter")), 0, 1);
+EOF
+
+# The module must be available both in qjsx and in qjsx-node
+STATUS=0
+for BIN in qjsx qjsx-node; do
+    OUTPUT=$(${QJSX_BIN_DIR}/$BIN "$TEMP_DIR/test_shm.js" "${QJSX_BIN_DIR}/$BIN" \
+        "$TEMP_DIR/child.js" "/qjsx-test-$$-$BIN" 2>&1 || true)
+    echo "$OUTPUT"
+    if echo "$OUTPUT" | grep -q "All qjsx:shm tests passed"; then
+        printf "%b\n" "${GREEN}✅ qjsx:shm works in $BIN${NC}"
+    else
+        printf "%b\n" "${RED}❌ qjsx:shm test failed in $BIN!${NC}"
+        STATUS=1
+    fi
+done
+exit $STATUS
@@ -0,0 +1,91 @@
+#!/bin/sh
+# Test the built-in qjsx:simd native module
+
+set -e
+cd "$(dirname "$0")/.."
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+NC='\033[0m' # No Color
+
+printf "%b\n" "${BLUE}Testing qjsx:simd typed-array kernels...${NC}"
+
+TEMP_DIR=$(mktemp -d)
+trap "rm -rf $TEMP_DIR" EXIT
+
+cat > "$TEMP_DIR/test_simd.js" << 'EOF'
+import * as simd from "qjsx:simd";
+
+const assert = (cond, msg) => { if (!cond) throw new Error(msg); };
+const same = (a, b) => a.length === b.length && a.every((x, i) => Object.is(x, b[i]));
+
+const n = 1003;  // not a multiple of any vector width
+const f = new Float64Array(n), g = new Float64Array(n), ints = new Int32Array(n);
+for (let i = 0; i < n; i++) {
+    f[i] = (i * 7919) % 101 - 50.5;
+    g[i] = i / 8;
+    ints[i] = i * 100003 - 5000000;
+}
+
+let sum = 0, dot = 0;
+for (let i = 0; i < n; i++) { sum += f[i]; dot += f[i] * g[i]; }
+assert(Math.abs(simd.sum(f) - sum) < 1e-9, "sum");
+assert(Math.abs(simd.dot(f, g) - dot) < 1e-6, "dot");
+assert(simd.min(f) === Math.min(...f) && simd.max(f) === Math.max(...f), "min/max");
+assert(simd.min(ints) === Math.min(...ints), "int min");
+assert(simd.sum(new Float32Array(0)) === 0 && simd.max(new Int8Array(0)) === -Infinity, "empty");
+assert(Number.isNaN(simd.max(Float64Array.of(1, 2, NaN, 3, 4, 5))), "NaN is sticky");
+
+assert(same(simd.add(null, f, g), f.map((x, i) => x + g[i])), "add");
+assert(same(simd.mul(null, ints, 3), ints.map(x => x * 3)), "int mul by scalar");
+assert(same(simd.add(null, ints, 0.5), ints.map(x => x + 0.5)), "int add of a fraction");
+assert(same(simd.div(null, ints, 7), ints.map(x => x / 7)), "int div");
+assert(same(simd.add(null, Uint8ClampedArray.of(250, 3), 10), Uint8ClampedArray.of(255, 13)), "clamped");
+const dst = new Float64Array(n);
+assert(simd.sub(dst, f, g) === dst && dst[5] === f[5] - g[5], "explicit destination");
+
+const mask = simd.gt(null, f, 0);
+assert(mask instanceof Uint8Array && same(mask, Uint8Array.from(f, x => x > 0 ? 1 : 0)), "gt mask");
+assert(simd.sum(simd.eq(null, f, f)) === n, "eq mask");
+
+const idx = Int32Array.of(3, 0, 1002, 3);
+assert(same(simd.gather(null, f, idx), Float64Array.of(f[3], f[0], f[1002], f[3])), "gather");
+const out = new Float64Array(5);
+simd.scatter(out, Int32Array.of(4, 0), Float64Array.of(1.5, 2.5));
+assert(same(out, Float64Array.of(2.5, 0, 0, 0, 1.5)), "scatter");
+let threw = false;
+try { simd.gather(null, f, Int32Array.of(n)); } catch (e) { threw = e instanceof RangeError; }
+assert(threw, "gather bounds check");
+
+assert(same(simd.prefixSum(null, Int32Array.of(1, 2, 3, 4)), Int32Array.of(1, 3, 6, 10)), "prefixSum");
+assert(same(simd.histogram(Float64Array.of(0, 1, 2, 3, 4, 4, NaN), 4), Uint32Array.of(1, 1, 1, 3)), "histogram");
+
+// sort() must agree with TypedArray.prototype.sort() (NaN last, -0 before +0)
+const mixed = Float64Array.from({ length: 5000 }, (_, i) => [NaN, -0, 0, -Infinity][i % 17] ?? (i * 7919 % 2003) - 1001.25);
+assert(same(simd.sort(mixed.slice()), mixed.slice().sort()), "float sort");
+const wide = Int32Array.from({ length: 5000 }, (_, i) => (i * 2654435761) | 0);
+assert(same(simd.sort(wide.slice()), wide.slice().sort()), "int32 sort");
+assert(same(simd.sort(Int8Array.of(3, -1, 127, -128, 0)), Int8Array.of(-128, -1, 0, 3, 127)), "int8 sort");
+
+threw = false;
+try { simd.sum(new BigInt64Array(4)); } catch (e) { threw = e instanceof TypeError; }
+assert(threw, "BigInt arrays are rejected");
+
+console.log(`All qjsx:simd tests passed (${simd.isa})`);
+EOF
+
+# The module must be available both in qjsx and in qjsxc-built executables
+STATUS=0
+for BIN in qjsx qjsx-node; do
+    OUTPUT=$(${QJSX_BIN_DIR}/$BIN "$TEMP_DIR/test_simd.js" 2>&1 || true)
+    echo "$OUTPUT"
+    if echo "$OUTPUT" | grep -q "All qjsx:simd tests passed"; then
+        printf "%b\n" "${GREEN}✅ qjsx:simd works in $BIN${NC}"
+    else
+        printf "%b\n" "${RED}❌ qjsx:simd test failed in $BIN!${NC}"
+        STATUS=1
+    fi
+done
+exit $STATUS
@@ -0,0 +1,157 @@
+#!/bin/sh
+# Test the built-in qjsx:tar native module, against the system tar
+
+set -e
+cd "$(dirname "$0")/.."
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+NC='\033[0m' # No Color
+
+printf "%b\n" "${BLUE}Testing qjsx:tar archives...${NC}"
+
+TEMP_DIR=$(mktemp -d)
+trap "rm -rf $TEMP_DIR" EXIT
+
+# A tree with a large file, a name too long for ustar, a symlink and an
+# empty directory, plus the same tree archived by tar(1)
+mkdir -p "$TEMP_DIR/src/lib/util" "$TEMP_DIR/src/empty"
+LONG=$(printf 'n%.0s' $(seq 1 130))
+mkdir -p "$TEMP_DIR/src/deep/$LONG"
+echo "long name" > "$TEMP_DIR/src/deep/$LONG/$LONG.txt"
+head -c 3000000 /dev/urandom > "$TEMP_DIR/src/lib/blob.bin"
+echo '{"name": "app"}' > "$TEMP_DIR/src/package.json"
+printf '#!/bin/sh\necho run\n' > "$TEMP_DIR/src/lib/util/run.sh"
+chmod 755 "$TEMP_DIR/src/lib/util/run.sh"
+: > "$TEMP_DIR/src/empty.txt"
+ln -s lib/util/run.sh "$TEMP_DIR/src/run"
+tar --format=posix -cf "$TEMP_DIR/sys.tar" -C "$TEMP_DIR" src
+tar --format=gnu -czf "$TEMP_DIR/sys.tgz" -C "$TEMP_DIR" src
+
+cat > "$TEMP_DIR/test_tar.js" << 'EOF'
+import * as tar from "qjsx:tar";
+import * as os from "os";
+
+const assert = (cond, msg) => { if (!cond) throw new Error(msg); };
+const throws = (fn, pattern) => { try { fn(); } catch (e) { return pattern.test(e.message); } return false; };
+const sh = (cmd) => os.exec(["sh", "-c", cmd]);
+const dir = scriptArgs[1];
+
+// reading archives written by tar(1): mapped, gzip-compressed and from a pipe
+for (const archive of ["sys.tar", "sys.tgz"]) {
+    const names = [];
+    for (const entry of tar.open(`${dir}/${archive}`)) {
+        names.push(entry.name);
+        if (entry.name === "src/package.json")
+            assert(JSON.parse(entry.readString()).name === "app", "readString " + archive);
+        if (entry.name.endsWith(".txt") && entry.name.length > 200)
+            assert(entry.readString() === "long name\n", "long name " + archive);
+        if (entry.name === "src/lib/blob.bin")
+            assert(entry.read().byteLength === 3000000 && entry.size === 3000000, "read " + archive);
+        if (entry.name === "src/run")
+            assert(entry.type === "symlink" && entry.linkname === "lib/util/run.sh", "symlink " + archive);
+        if (entry.name === "src/lib/util/run.sh")
+            assert(entry.mode === 0o755 && entry.type === "file" && entry.mtime > 0, "mode " + archive);
+    }
+    assert(names.includes("src/empty/") && names.length === 12, "all entries of " + archive);
+}
+const [fds0, fds1] = os.pipe();
+os.exec(["cat", `${dir}/sys.tgz`], { stdout: fds1, block: false });
+os.close(fds1);
+assert(tar.list(fds0).length === 12, "list from a pipe");
+os.close(fds0);
+console.log("✅ reading tar(1) archives");
+
+// entries of a mapped archive stay readable, streamed ones only until next()
+const mapped = tar.list(`${dir}/sys.tar`).find(e => e.name === "src/package.json");
+assert(new Uint8Array(mapped.read())[0] === 0x7b, "view into the mapped archive");
+const streamed = tar.list(`${dir}/sys.tgz`).find(e => e.name === "src/package.json");
+assert(throws(() => streamed.read(), /no longer available/), "streamed entry after next()");
+const reader = tar.open(`${dir}/sys.tgz`);
+for (const entry of reader) {
+    if (entry.name !== "src/package.json") continue;
+    entry.read();
+    assert(throws(() => entry.read(), /already read/), "data is read once");
+    break;
+}
+reader.close();
+console.log("✅ entry data lifetime");
+
+// extraction, compared with the original tree
+assert(tar.extract(`${dir}/sys.tgz`, `${dir}/out1`, { strip: 1 }) === 11, "extract count");
+assert(sh(`diff -r --no-dereference ${dir}/src ${dir}/out1`) === 0, "extracted tgz matches");
+tar.extract(`${dir}/sys.tar`, `${dir}/out2`);
+assert(sh(`diff -r --no-dereference ${dir}/src ${dir}/out2/src`) === 0, "extracted tar matches");
+assert(sh(`test "$(stat -c %a ${dir}/out2/src/lib/util/run.sh)" = 755`) === 0, "mode restored");
+assert(sh(`test "$(stat -c %Y ${dir}/out2/src/package.json)" = "$(stat -c %Y ${dir}/src/package.json)"`) === 0, "mtime restored");
+const one = tar.list(`${dir}/sys.tar`).find(e => e.name === "src/lib/blob.bin");
+one.extract(`${dir}/blob.bin`);
+assert(sh(`cmp -s ${dir}/blob.bin ${dir}/src/lib/blob.bin`) === 0, "entry.extract");
+console.log("✅ extraction");
+
+// writing: the system tar must read back what we write
+for (const file of ["ours.tar", "ours.tgz", "ours.tzst"]) {
+    if (file.endsWith(".tzst") && sh("command -v zstd >/dev/null") !== 0) continue;
+    const w = tar.create(`${dir}/${file}`);
+    assert(w.addTree("app", `${dir}/src`) === 12, "addTree count");
+    w.add("app/VERSION", "1.2.3\n", { mode: 0o600, mtime: 1700000000 });
+    w.add("app/bytes.bin", new Uint8Array([1, 2, 3]));
+    w.addDirectory("app/logs");
+    w.addSymlink("app/current", "app");
+    w.addFile("app/copy.bin", `${dir}/src/lib/blob.bin`);
+    w.close();
+    assert(throws(() => w.add("x", "y"), /closed/), "writer is closed");
+    sh(`mkdir ${dir}/x-${file}`);
+    assert(sh(`tar -xf ${dir}/${file} -C ${dir}/x-${file}`) === 0, "tar(1) extracts " + file);
+    assert(sh(`diff -r --no-dereference ${dir}/src ${dir}/x-${file}/app -x VERSION -x bytes.bin -x logs -x current -x copy.bin`) === 0, "tree of " + file);
+    assert(sh(`cmp -s ${dir}/x-${file}/app/copy.bin ${dir}/src/lib/blob.bin`) === 0, "addFile in " + file);
+    assert(sh(`test "$(stat -c '%a %Y' ${dir}/x-${file}/app/VERSION)" = "600 1700000000"`) === 0, "add options in " + file);
+    assert(sh(`test -d ${dir}/x-${file}/app/logs && test -L ${dir}/x-${file}/app/current`) === 0, "directory and symlink in " + file);
+}
+// and a writer on a file descriptor
+const fd = os.open(`${dir}/fd.tar`, os.O_WRONLY | os.O_CREAT | os.O_TRUNC, 0o644);
+const w = tar.create(fd, { compress: "gzip", level: 1 });
+w.add("hello.txt", "hello");
+w.close();
+os.close(fd);
+assert(sh(`test "$(tar -xzOf ${dir}/fd.tar hello.txt)" = hello`) === 0, "writer on an fd");
+console.log("✅ writing archives tar(1) reads");
+
+// hostile archives
+sh(`cd ${dir} && mkdir evil && ln -s /tmp evil/link && echo x > evil/f`);
+sh(`tar -cPf ${dir}/dotdot.tar -C ${dir}/evil --transform 's,^f$,../escaped,' f`);
+sh(`tar -cf ${dir}/through.tar -C ${dir}/evil link --transform 's,^f$,link/escaped,' f`);
+assert(throws(() => tar.extract(`${dir}/dotdot.tar`, `${dir}/out3`), /unsafe path/), "'..' is refused");
+assert(throws(() => tar.extract(`${dir}/through.tar`, `${dir}/out4`), /through symlink/), "symlinks are not followed");
+assert(sh(`test ! -e ${dir}/escaped && test ! -e /tmp/escaped`) === 0, "nothing escaped");
+// a hard link whose target goes through a symlink extracted just before it
+sh(`cd ${dir} && mkdir -p outside evil2/d && echo s > outside/secret && echo s > evil2/d/secret`);
+sh(`cd ${dir}/evil2 && ln d/secret h && ln -s ${dir}/outside link`);
+sh(`tar -cf ${dir}/hard.tar -C ${dir}/evil2 link d/secret h --transform 's,^d/,link/,'`);
+sh(`tar --delete -f ${dir}/hard.tar link/secret`);
+assert(throws(() => tar.extract(`${dir}/hard.tar`, `${dir}/out5`), /through symlink/), "hard link targets are not followed through symlinks");
+assert(sh(`test ! -e ${dir}/out5/h`) === 0, "no hard link to a file outside");
+sh(`head -c 5000 ${dir}/sys.tgz > ${dir}/cut.tgz`);
+assert(throws(() => tar.list(`${dir}/cut.tgz`), /unexpected end/), "truncated archive");
+console.log("✅ hostile archives");
+
+console.log("All qjsx:tar tests passed");
+EOF
+
+# The module must be available both in qjsx and in qjsx-node
+STATUS=0
+for BIN in qjsx qjsx-node; do
+    mkdir "$TEMP_DIR/$BIN"
+    cp -R "$TEMP_DIR/src" "$TEMP_DIR/sys.tar" "$TEMP_DIR/sys.tgz" "$TEMP_DIR/$BIN"
+    OUTPUT=$(${QJSX_BIN_DIR}/$BIN "$TEMP_DIR/test_tar.js" "$TEMP_DIR/$BIN" 2>&1 || true)
+    echo "$OUTPUT"
+    if echo "$OUTPUT" | grep -q "All qjsx:tar tests passed"; then
+        printf "%b\n" "${GREEN}✅ qjsx:tar works in $BIN${NC}"
+    else
+        printf "%b\n" "${RED}❌ qjsx:tar test failed in $BIN!${NC}"
+        STATUS=1
+    fi
+done
+exit $STATUS
@@ -0,0 +1,183 @@
+#!/bin/sh
+# Test the built-in qjsx:wasm WebAssembly module
+
+set -e
+cd "$(dirname "$0")/.."
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+NC='\033[0m' # No Color
+
+printf "%b\n" "${BLUE}Testing qjsx:wasm WebAssembly interpreter...${NC}"
+
+TEMP_DIR=$(mktemp -d)
+trap "rm -rf $TEMP_DIR" EXIT
+
+cat > "$TEMP_DIR/test_wasm.js" << 'EOF'
+import WebAssembly from "qjsx:wasm";
+
+const assert = (cond, msg) => { if (!cond) throw new Error(msg); };
+const throws = (fn, cls, msg) => {
+    let threw = false;
+    try { fn(); } catch (e) { threw = e instanceof cls; }
+    assert(threw, msg);
+};
+
+// Imports env.log(i32); exports add, fib, sum(ptr, len), callLog(x) -> log(2 * x),
+// div, mul64, pair(x) -> [x, x + 1], bump() -> ++counter, sink(x) -> counter = x,
+// plus memory (data "hi" at 0), table [add, fib] and the mutable global counter.
+const bytes = new Uint8Array([
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x20, 0x06, 0x60,
+    0x01, 0x7f, 0x00, 0x60, 0x02, 0x7f, 0x7f, 0x01, 0x7f, 0x60, 0x01, 0x7f,
+    0x01, 0x7f, 0x60, 0x02, 0x7e, 0x7e, 0x01, 0x7e, 0x60, 0x01, 0x7f, 0x02,
+    0x7f, 0x7f, 0x60, 0x00, 0x01, 0x7f, 0x02, 0x0b, 0x01, 0x03, 0x65, 0x6e,
+    0x76, 0x03, 0x6c, 0x6f, 0x67, 0x00, 0x00, 0x03, 0x0a, 0x09, 0x01, 0x02,
+    0x01, 0x00, 0x01, 0x03, 0x04, 0x05, 0x00, 0x04, 0x04, 0x01, 0x70, 0x00,
+    0x02, 0x05, 0x03, 0x01, 0x00, 0x01, 0x06, 0x06, 0x01, 0x7f, 0x01, 0x41,
+    0x00, 0x0b, 0x07, 0x5b, 0x0c, 0x03, 0x61, 0x64, 0x64, 0x00, 0x01, 0x03,
+    0x66, 0x69, 0x62, 0x00, 0x02, 0x03, 0x73, 0x75, 0x6d, 0x00, 0x03, 0x07,
+    0x63, 0x61, 0x6c, 0x6c, 0x4c, 0x6f, 0x67, 0x00, 0x04, 0x03, 0x64, 0x69,
+    0x76, 0x00, 0x05, 0x05, 0x6d, 0x75, 0x6c, 0x36, 0x34, 0x00, 0x06, 0x04,
+    0x70, 0x61, 0x69, 0x72, 0x00, 0x07, 0x04, 0x62, 0x75, 0x6d, 0x70, 0x00,
+    0x08, 0x04, 0x73, 0x69, 0x6e, 0x6b, 0x00, 0x09, 0x06, 0x6d, 0x65, 0x6d,
+    0x6f, 0x72, 0x79, 0x02, 0x00, 0x05, 0x74, 0x61, 0x62, 0x6c, 0x65, 0x01,
+    0x00, 0x07, 0x63, 0x6f, 0x75, 0x6e, 0x74, 0x65, 0x72, 0x03, 0x00, 0x09,
+    0x08, 0x01, 0x00, 0x41, 0x00, 0x0b, 0x02, 0x01, 0x02, 0x0a, 0x87, 0x01,
+    0x09, 0x07, 0x00, 0x20, 0x00, 0x20, 0x01, 0x6a, 0x0b, 0x1c, 0x00, 0x20,
+    0x00, 0x41, 0x02, 0x48, 0x04, 0x7f, 0x20, 0x00, 0x05, 0x20, 0x00, 0x41,
+    0x01, 0x6b, 0x10, 0x02, 0x20, 0x00, 0x41, 0x02, 0x6b, 0x10, 0x02, 0x6a,
+    0x0b, 0x0b, 0x29, 0x01, 0x02, 0x7f, 0x02, 0x40, 0x03, 0x40, 0x20, 0x03,
+    0x20, 0x01, 0x4f, 0x0d, 0x01, 0x20, 0x02, 0x20, 0x00, 0x20, 0x03, 0x6a,
+    0x2d, 0x00, 0x00, 0x6a, 0x21, 0x02, 0x20, 0x03, 0x41, 0x01, 0x6a, 0x21,
+    0x03, 0x0c, 0x00, 0x0b, 0x0b, 0x20, 0x02, 0x0b, 0x09, 0x00, 0x20, 0x00,
+    0x41, 0x02, 0x6c, 0x10, 0x00, 0x0b, 0x07, 0x00, 0x20, 0x00, 0x20, 0x01,
+    0x6d, 0x0b, 0x07, 0x00, 0x20, 0x00, 0x20, 0x01, 0x7e, 0x0b, 0x09, 0x00,
+    0x20, 0x00, 0x20, 0x00, 0x41, 0x01, 0x6a, 0x0b, 0x0b, 0x00, 0x23, 0x00,
+    0x41, 0x01, 0x6a, 0x24, 0x00, 0x23, 0x00, 0x0b, 0x06, 0x00, 0x20, 0x00,
+    0x24, 0x00, 0x0b, 0x0b, 0x08, 0x01, 0x00, 0x41, 0x00, 0x0b, 0x02, 0x68,
+    0x69, 0x00, 0x07, 0x04, 0x6d, 0x65, 0x74, 0x61, 0x76, 0x31
+]);
+
+assert(WebAssembly.validate(bytes), "validate");
+assert(!WebAssembly.validate(new Uint8Array([0, 0x61, 0x73, 0x6d, 2, 0, 0, 0])), "bad version");
+throws(() => new WebAssembly.Module(bytes.subarray(0, 40)), WebAssembly.CompileError, "CompileError");
+assert(new WebAssembly.CompileError("x") instanceof Error, "error classes inherit Error");
+
+const module = new WebAssembly.Module(bytes.buffer);
+assert(WebAssembly.Module.exports(module).map(e => e.name).join() ===
+       "add,fib,sum,callLog,div,mul64,pair,bump,sink,memory,table,counter", "Module.exports");
+assert(WebAssembly.Module.imports(module)[0].kind === "function", "Module.imports");
+const meta = WebAssembly.Module.customSections(module, "meta");
+assert(meta.length === 1 && new Uint8Array(meta[0])[1] === 0x31, "customSections");
+throws(() => new WebAssembly.Instance(module, { env: {} }), WebAssembly.LinkError, "missing import");
+
+const logged = [];
+const { instance } = await WebAssembly.instantiate(bytes, { env: { log: x => logged.push(x) } });
+const ex = instance.exports;
+assert(ex.add(2, 3) === 5 && ex.add(0x7fffffff, 1) === -0x80000000, "i32 wraparound");
+assert(ex.fib(25) === 75025, "recursion");
+assert(ex.mul64(3n, -5n) === -15n, "i64 values are BigInts");
+const pair = ex.pair(4);
+assert(pair[0] === 4 && pair[1] === 5, "multi-value results");
+ex.callLog(21);
+assert(logged[0] === 42, "host import");
+
+// zero-copy memory
+const heap = new Uint8Array(ex.memory.buffer);
+assert(heap[0] === 0x68 && heap[1] === 0x69, "data segment");
+heap.set([1, 2, 3, 250], 1024);
+assert(ex.sum(1024, 4) === 256, "memory shared with JS");
+const oldBuffer = ex.memory.buffer;
+assert(ex.memory.grow(1) === 1 && oldBuffer.byteLength === 0, "grow detaches the old buffer");
+assert(ex.memory.buffer.byteLength === 2 * 65536, "grown buffer");
+throws(() => ex.sum(2 * 65536 - 2, 4), WebAssembly.RuntimeError, "out of bounds trap");
+throws(() => ex.div(1, 0), WebAssembly.RuntimeError, "divide by zero trap");
+
+assert(ex.table.length === 2 && ex.table.get(1)(10) === 55, "table");
+assert(ex.bump() === 1 && ex.bump() === 2 && ex.counter.value === 2, "global");
+
+// an exported function imported by another instance is called directly
+const other = new WebAssembly.Instance(module, { env: { log: ex.sink } });
+other.exports.callLog(50);
+assert(ex.counter.value === 100, "WebAssembly to WebAssembly import");
+
+const g = new WebAssembly.Global({ value: "i64", mutable: true }, 5n);
+g.value = 7n;
+assert(g.value === 7n, "standalone global");
+throws(() => new WebAssembly.Memory({ initial: 1, maximum: 2 }).grow(2), RangeError, "memory maximum");
+
+// SIMD: sum(ptr, n) adds i32 lanes with i32x4.add, scale(ptr, n, k) multiplies
+// f32 lanes by f32x4.splat(k), reverse(dst, src) is an i8x16.shuffle,
+// signs(ptr) an i8x16.bitmask; id(v128) and the v128 global g can't be used
+// from JS. The second module extracts lane 16 of an i8x16.
+const simdBytes = new Uint8Array([
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x1c, 0x05, 0x60,
+    0x02, 0x7f, 0x7f, 0x01, 0x7f, 0x60, 0x03, 0x7f, 0x7f, 0x7d, 0x00, 0x60,
+    0x02, 0x7f, 0x7f, 0x00, 0x60, 0x01, 0x7f, 0x01, 0x7f, 0x60, 0x01, 0x7b,
+    0x01, 0x7b, 0x03, 0x06, 0x05, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x03,
+    0x01, 0x00, 0x01, 0x06, 0x16, 0x01, 0x7b, 0x00, 0xfd, 0x0c, 0x00, 0x01,
+    0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d,
+    0x0e, 0x0f, 0x0b, 0x07, 0x33, 0x07, 0x03, 0x73, 0x75, 0x6d, 0x00, 0x00,
+    0x05, 0x73, 0x63, 0x61, 0x6c, 0x65, 0x00, 0x01, 0x07, 0x72, 0x65, 0x76,
+    0x65, 0x72, 0x73, 0x65, 0x00, 0x02, 0x05, 0x73, 0x69, 0x67, 0x6e, 0x73,
+    0x00, 0x03, 0x02, 0x69, 0x64, 0x00, 0x04, 0x06, 0x6d, 0x65, 0x6d, 0x6f,
+    0x72, 0x79, 0x02, 0x00, 0x01, 0x67, 0x03, 0x00, 0x0a, 0xc1, 0x01, 0x05,
+    0x4a, 0x02, 0x01, 0x7b, 0x01, 0x7f, 0x20, 0x00, 0x20, 0x01, 0x41, 0x02,
+    0x74, 0x6a, 0x21, 0x03, 0x02, 0x40, 0x03, 0x40, 0x20, 0x00, 0x20, 0x03,
+    0x4f, 0x0d, 0x01, 0x20, 0x02, 0x20, 0x00, 0xfd, 0x00, 0x04, 0x00, 0xfd,
+    0xae, 0x01, 0x21, 0x02, 0x20, 0x00, 0x41, 0x10, 0x6a, 0x21, 0x00, 0x0c,
+    0x00, 0x0b, 0x0b, 0x20, 0x02, 0xfd, 0x1b, 0x00, 0x20, 0x02, 0xfd, 0x1b,
+    0x01, 0x6a, 0x20, 0x02, 0xfd, 0x1b, 0x02, 0x6a, 0x20, 0x02, 0xfd, 0x1b,
+    0x03, 0x6a, 0x0b, 0x3d, 0x02, 0x01, 0x7b, 0x01, 0x7f, 0x20, 0x02, 0xfd,
+    0x13, 0x21, 0x03, 0x20, 0x00, 0x20, 0x01, 0x41, 0x02, 0x74, 0x6a, 0x21,
+    0x04, 0x02, 0x40, 0x03, 0x40, 0x20, 0x00, 0x20, 0x04, 0x4f, 0x0d, 0x01,
+    0x20, 0x00, 0x20, 0x00, 0xfd, 0x00, 0x04, 0x00, 0x20, 0x03, 0xfd, 0xe6,
+    0x01, 0xfd, 0x0b, 0x04, 0x00, 0x20, 0x00, 0x41, 0x10, 0x6a, 0x21, 0x00,
+    0x0c, 0x00, 0x0b, 0x0b, 0x0b, 0x26, 0x00, 0x20, 0x00, 0x20, 0x01, 0xfd,
+    0x00, 0x00, 0x00, 0x20, 0x01, 0xfd, 0x00, 0x00, 0x00, 0xfd, 0x0d, 0x0f,
+    0x0e, 0x0d, 0x0c, 0x0b, 0x0a, 0x09, 0x08, 0x07, 0x06, 0x05, 0x04, 0x03,
+    0x02, 0x01, 0x00, 0xfd, 0x0b, 0x00, 0x00, 0x0b, 0x0a, 0x00, 0x20, 0x00,
+    0xfd, 0x00, 0x00, 0x00, 0xfd, 0x64, 0x0b, 0x04, 0x00, 0x20, 0x00, 0x0b
+]);
+const badLane = new Uint8Array([
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x05, 0x01, 0x60,
+    0x00, 0x01, 0x7f, 0x03, 0x02, 0x01, 0x00, 0x0a, 0x19, 0x01, 0x17, 0x00,
+    0xfd, 0x0c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xfd, 0x15, 0x10, 0x0b
+]);
+assert(WebAssembly.validate(simdBytes), "SIMD module");
+assert(!WebAssembly.validate(badLane), "lane index out of range");
+const simd = new WebAssembly.Instance(new WebAssembly.Module(simdBytes)).exports;
+new Int32Array(simd.memory.buffer, 0, 8).set([1, 2, 3, 4, 5, 6, 7, 0x7fffffff]);
+assert(simd.sum(0, 8) === ((28 + 0x7fffffff) | 0), "i32x4 loads and adds");
+const floats = new Float32Array(simd.memory.buffer, 64, 8);
+floats.set([1, -2, 0.5, NaN, 4, 5, 6, 7]);
+simd.scale(64, 8, 3);
+assert(floats.join() === "3,-6,1.5,NaN,12,15,18,21", "f32x4 splat and mul");
+const lanes = new Uint8Array(simd.memory.buffer, 128, 32);
+lanes.set([...Array(16).keys()]);
+simd.reverse(144, 128);
+assert(lanes.subarray(16).join() === "15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0", "i8x16.shuffle");
+new Int8Array(simd.memory.buffer, 128, 16).set([-1, 0, -128, 127, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, -3]);
+assert(simd.signs(128) === 0x8005, "i8x16.bitmask");
+throws(() => simd.id(0), TypeError, "v128 in an exported signature");
+throws(() => simd.g.value, TypeError, "v128 global value");
+
+console.log("All qjsx:wasm tests passed");
+EOF
+
+# The module must be available both in qjsx and in qjsxc-built executables
+STATUS=0
+for BIN in qjsx qjsx-node; do
+    OUTPUT=$(${QJSX_BIN_DIR}/$BIN "$TEMP_DIR/test_wasm.js" 2>&1 || true)
+    echo "$OUTPUT"
+    if echo "$OUTPUT" | grep -q "All qjsx:wasm tests passed"; then
+        printf "%b\n" "${GREEN}✅ qjsx:wasm works in $BIN${NC}"
+    else
+        printf "%b\n" "${RED}❌ qjsx:wasm test failed in $BIN!${NC}"
+        STATUS=1
+    fi
+done
+exit $STATUS